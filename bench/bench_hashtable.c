@@ -0,0 +1,409 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Hash table microbenchmarks -
+ * usage: 'bench_hashtable [max_entries] [dist]'
+ *
+ * Runs each table operation below on tables of 1K,
+ * 10K, 100K, ... entries up to <max_entries> (1000000
+ * by default; 10000000 for the full range, which needs
+ * about 4 GB of memory with long keys), for every key
+ * and value length distribution, or only <dist>.
+ *
+ *      put         add to a table reserved for all keys
+ *      find_hit    find keys of the table, shuffled
+ *      find_miss   find keys not in the table
+ *      exists      exists on keys of the table, shuffled
+ *      delete      delete every key, shuffled
+ *      resize      add to a table that starts at 16
+ *                  buckets and doubles as it fills
+ *      to_file     hashtbl_to_file of the whole table
+ *      load_file   load_hashtbl_from_file of that file
+ *
+ * Keys and values are pseudorandom strings from a fixed
+ * seed, so runs are comparable. Each key starts with
+ * its index, which keeps keys distinct. Output is CSV,
+ * one row per operation, size, and distribution:
+ *
+ *      op,entries,dist,ns_op,p50_ns,p99_ns,bytes_entry
+ *
+ * ns_op is the time of a pass over all keys divided by
+ * the number of keys. p50 and p99 come from a second
+ * pass that times every operation, less the cost of
+ * reading the clock. For to_file and load_file, which
+ * are single operations on the whole table, ns_op is
+ * per entry and p50_ns and p99_ns are empty.
+ * bytes_entry is get_mem_usage of a table holding
+ * every key, divided by the number of keys.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/hashtable.h"
+
+enum {
+    DEFAULT_MAX_ENTRIES = 1000000,
+    MIN_ENTRIES = 1000,
+    RESIZE_START = 16,      // Buckets of table for resize
+    INDEX_CHARS = 5,        // Leading key characters holding index
+    CLOCK_CALIBRATE = 10000
+};
+
+// Key and value length distribution.
+// Lengths are uniform in [min, max].
+struct dist {
+    const char *name;
+    size_t keymin;
+    size_t keymax;
+    size_t valmin;
+    size_t valmax;
+};
+
+static const struct dist DISTS[] = {
+    {"short", 8, 16, 8, 16},
+    {"medium", 16, 32, 32, 64},
+    {"long", 64, HT_KEY_MAX - 1, 64, HT_VAL_MAX - 1},
+    {"mixed", INDEX_CHARS, HT_KEY_MAX - 1, 1, HT_VAL_MAX - 1}
+};
+
+static const char ALNUM[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// Keys and values of one run
+struct dataset {
+    size_t n;
+    char **keys;
+    char **vals;
+    char *arena;
+    size_t *order;      // Shuffled key indexes
+    uint32_t *samples;  // Timed operations, in ns
+};
+
+// Operation on key i of a dataset
+typedef void (*op_fn)(hashtbl tbl, struct dataset *ds, size_t i);
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_rand(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static size_t rand_len(size_t min, size_t max)
+{
+    return min + next_rand() % (max - min + 1);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Median cost of reading the clock twice
+static uint64_t clock_cost;
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void calibrate_clock(void)
+{
+    static uint32_t costs[CLOCK_CALIBRATE];
+    for (size_t i = 0; i < CLOCK_CALIBRATE; i++) {
+        uint64_t start = now_ns();
+        costs[i] = now_ns() - start;
+    }
+    qsort(costs, CLOCK_CALIBRATE, sizeof(uint32_t), cmp_u32);
+    clock_cost = costs[CLOCK_CALIBRATE / 2];
+}
+
+// Fill str with index i in its first INDEX_CHARS
+// characters and random characters up to len
+static void make_string(char *str, size_t i, size_t len, bool with_index)
+{
+    size_t pos = 0;
+    if (with_index) {
+        for (; pos < INDEX_CHARS; pos++) {
+            str[pos] = ALNUM[i % 62];
+            i /= 62;
+        }
+    }
+    for (; pos < len; pos++) {
+        str[pos] = ALNUM[next_rand() % 62];
+    }
+    str[len] = '\0';
+}
+
+// Returns false on memory allocation failure
+static bool make_dataset(struct dataset *ds, size_t n, const struct dist *d)
+{
+    ds->n = n;
+    ds->keys = malloc(n * sizeof(char *));
+    ds->vals = malloc(n * sizeof(char *));
+    ds->order = malloc(n * sizeof(size_t));
+    ds->samples = malloc(n * sizeof(uint32_t));
+    ds->arena = malloc(n * (d->keymax + d->valmax + 2));
+    if (!ds->keys || !ds->vals || !ds->order || !ds->samples || !ds->arena) {
+        return false;
+    }
+
+    char *p = ds->arena;
+    for (size_t i = 0; i < n; i++) {
+        size_t keylen = rand_len(d->keymin, d->keymax);
+        size_t vallen = rand_len(d->valmin, d->valmax);
+        ds->keys[i] = p;
+        make_string(p, i, keylen, true);
+        p += keylen + 1;
+        ds->vals[i] = p;
+        make_string(p, i, vallen, false);
+        p += vallen + 1;
+        ds->order[i] = i;
+    }
+
+    // Fisher-Yates shuffle of lookup order
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = next_rand() % (i + 1);
+        size_t tmp = ds->order[i];
+        ds->order[i] = ds->order[j];
+        ds->order[j] = tmp;
+    }
+    return true;
+}
+
+static void free_dataset(struct dataset *ds)
+{
+    free(ds->keys);
+    free(ds->vals);
+    free(ds->order);
+    free(ds->samples);
+    free(ds->arena);
+}
+
+// Keys of a miss pass differ from every key of the
+// table in their first character, which no key uses.
+// Clearing the mark restores the index character.
+static void mark_missing(struct dataset *ds, bool missing)
+{
+    for (size_t i = 0; i < ds->n; i++) {
+        ds->keys[i][0] = missing ? '-' : ALNUM[i % 62];
+    }
+}
+
+static void op_put(hashtbl tbl, struct dataset *ds, size_t i)
+{
+    if (put(tbl, ds->keys[i], ds->vals[i]) != 1) {
+        fprintf(stderr, "put failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void op_find(hashtbl tbl, struct dataset *ds, size_t i)
+{
+    char valbuff[HT_VAL_MAX];
+    find(valbuff, HT_VAL_MAX, tbl, ds->keys[ds->order[i]]);
+}
+
+static void op_exists(hashtbl tbl, struct dataset *ds, size_t i)
+{
+    if (!exists(tbl, ds->keys[ds->order[i]])) {
+        fprintf(stderr, "exists failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void op_delete(hashtbl tbl, struct dataset *ds, size_t i)
+{
+    delete(tbl, ds->keys[ds->order[i]]);
+}
+
+// Run op on every key. Returns ns per operation.
+static double run_pass(hashtbl tbl, struct dataset *ds, op_fn op)
+{
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < ds->n; i++) {
+        op(tbl, ds, i);
+    }
+    return (double) (now_ns() - start) / ds->n;
+}
+
+// Run op on every key, timing each call,
+// and set p50 and p99 in ns
+static void run_timed_pass(hashtbl tbl, struct dataset *ds, op_fn op,
+                           uint32_t *p50, uint32_t *p99)
+{
+    for (size_t i = 0; i < ds->n; i++) {
+        uint64_t start = now_ns();
+        op(tbl, ds, i);
+        uint64_t ns = now_ns() - start;
+        ds->samples[i] = ns > clock_cost ? ns - clock_cost : 0;
+    }
+    qsort(ds->samples, ds->n, sizeof(uint32_t), cmp_u32);
+    *p50 = ds->samples[ds->n / 2];
+    *p99 = ds->samples[ds->n - 1 - ds->n / 100];
+}
+
+// Table of RESIZE_START buckets, grown to hold
+// reserve entries if reserve is not 0
+static hashtbl new_table(size_t reserve)
+{
+    hashtbl tbl = init_hashtbl(RESIZE_START);
+    if (!tbl || (reserve > 0 && hashtbl_reserve(tbl, reserve) < 0)) {
+        fprintf(stderr, "table allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return tbl;
+}
+
+static void print_row(const char *op, struct dataset *ds, const struct dist *d,
+                      double ns_op, uint32_t p50, uint32_t p99, double bytes)
+{
+    printf("%s,%zu,%s,%.1f,%u,%u,%.1f\n", op, ds->n, d->name, ns_op, p50, p99, bytes);
+}
+
+// Benchmark an operation that changes the table.
+// Each pass runs on a new table, reserved for all
+// keys if reserved, and holding them if filled.
+static void bench_write(const char *op_name, op_fn op, bool reserved, bool filled,
+                        struct dataset *ds, const struct dist *d, double bytes)
+{
+    uint32_t p50;
+    uint32_t p99;
+    double ns_op = 0;
+    for (int timed = 0; timed < 2; timed++) {
+        hashtbl tbl = new_table(reserved ? ds->n : 0);
+        if (filled) {
+            run_pass(tbl, ds, op_put);
+        }
+        if (timed) {
+            run_timed_pass(tbl, ds, op, &p50, &p99);
+        }
+        else {
+            ns_op = run_pass(tbl, ds, op);
+        }
+        destroy_hashtbl(tbl);
+    }
+    print_row(op_name, ds, d, ns_op, p50, p99, bytes);
+}
+
+// Benchmark a lookup on a filled table
+static void bench_read(const char *op_name, op_fn op, hashtbl tbl,
+                       struct dataset *ds, const struct dist *d, double bytes)
+{
+    uint32_t p50;
+    uint32_t p99;
+    double ns_op = run_pass(tbl, ds, op);
+    run_timed_pass(tbl, ds, op, &p50, &p99);
+    print_row(op_name, ds, d, ns_op, p50, p99, bytes);
+}
+
+// Benchmark writing table to file and loading it back
+static void bench_file(hashtbl tbl, struct dataset *ds, const struct dist *d, double bytes)
+{
+    char path[] = "/tmp/pairdb-bench-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w+");
+    if (!f) {
+        fprintf(stderr, "temporary file creation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    unlink(path);
+
+    uint64_t start = now_ns();
+    hashtbl_to_file(tbl, f);
+    fflush(f);
+    double write_ns = (double) (now_ns() - start) / ds->n;
+
+    rewind(f);
+    start = now_ns();
+    hashtbl loaded = load_hashtbl_from_file(f);
+    double load_ns = (double) (now_ns() - start) / ds->n;
+    if (!loaded || get_numentries(loaded) != ds->n) {
+        fprintf(stderr, "load failed\n");
+        exit(EXIT_FAILURE);
+    }
+    destroy_hashtbl(loaded);
+    fclose(f);
+
+    printf("to_file,%zu,%s,%.1f,,,%.1f\n", ds->n, d->name, write_ns, bytes);
+    printf("load_file,%zu,%s,%.1f,,,%.1f\n", ds->n, d->name, load_ns, bytes);
+}
+
+// Read and file operations share one filled table,
+// which is freed before write operations build theirs
+static void bench_dataset(struct dataset *ds, const struct dist *d)
+{
+    hashtbl tbl = new_table(ds->n);
+    run_pass(tbl, ds, op_put);
+    double bytes = (double) get_mem_usage(tbl) / ds->n;
+
+    bench_read("find_hit", op_find, tbl, ds, d, bytes);
+    bench_read("exists", op_exists, tbl, ds, d, bytes);
+    mark_missing(ds, true);
+    bench_read("find_miss", op_find, tbl, ds, d, bytes);
+    mark_missing(ds, false);
+    bench_file(tbl, ds, d, bytes);
+    destroy_hashtbl(tbl);
+
+    bench_write("put", op_put, true, false, ds, d, bytes);
+    bench_write("delete", op_delete, true, true, ds, d, bytes);
+    bench_write("resize", op_put, false, false, ds, d, bytes);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_entries = DEFAULT_MAX_ENTRIES;
+    const char *only = NULL;
+    if (argc > 1) {
+        max_entries = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        only = argv[2];
+    }
+    if (max_entries < MIN_ENTRIES) {
+        fprintf(stderr, "usage: bench_hashtable [max_entries] [short|medium|long|mixed]\n");
+        return EXIT_FAILURE;
+    }
+
+    calibrate_clock();
+    printf("op,entries,dist,ns_op,p50_ns,p99_ns,bytes_entry\n");
+    for (size_t k = 0; k < sizeof(DISTS) / sizeof(DISTS[0]); k++) {
+        if (only && strcmp(only, DISTS[k].name) != 0) {
+            continue;
+        }
+        for (size_t n = MIN_ENTRIES; n <= max_entries; n *= 10) {
+            struct dataset ds = {0};
+            if (!make_dataset(&ds, n, &DISTS[k])) {
+                fprintf(stderr, "memory allocation failed\n");
+                return EXIT_FAILURE;
+            }
+            bench_dataset(&ds, &DISTS[k]);
+            free_dataset(&ds);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
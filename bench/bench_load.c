@@ -0,0 +1,157 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Table load benchmark - usage: 'bench_load [entries]'
+ *
+ * Builds a table of <entries> key-value pairs (1000000
+ * by default), writes it to a temporary file in both
+ * the stream format and the fixed-layout format, and
+ * reports the time to load each. The fixed-layout file
+ * is loaded with 1, 4, and 8 threads. Each load is
+ * repeated and the best time is reported.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/hashtable.h"
+
+enum {
+    DEFAULT_ENTRIES = 1000000,
+    REPEAT = 3
+};
+
+static const unsigned THREAD_COUNTS[] = {1, 4, 8};
+
+static double elapsed_ms(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000.0 +
+           (end.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+// Open unlinked temporary file for reading and writing
+static FILE *open_tmp(void)
+{
+    char path[] = "/tmp/pairdb-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path);
+    return fdopen(fd, "w+");
+}
+
+// Load stream format file. Returns best time in ms.
+static double bench_stream(FILE *f, size_t entries)
+{
+    double best = -1;
+    for (int r = 0; r < REPEAT; r++) {
+        rewind(f);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        hashtbl tbl = load_hashtbl_from_file(f);
+        double ms = elapsed_ms(&start);
+
+        if (!tbl || get_numentries(tbl) != entries) {
+            fprintf(stderr, "stream load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        destroy_hashtbl(tbl);
+        if (best < 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+// Load fixed-layout file with nthreads threads.
+// Returns best time in ms.
+static double bench_fixed(int fd, size_t entries, unsigned nthreads)
+{
+    double best = -1;
+    for (int r = 0; r < REPEAT; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        hashtbl tbl = load_hashtbl_parallel(fd, nthreads);
+        double ms = elapsed_ms(&start);
+
+        if (!tbl || get_numentries(tbl) != entries) {
+            fprintf(stderr, "fixed-layout load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        destroy_hashtbl(tbl);
+        if (best < 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = DEFAULT_ENTRIES;
+    if (argc > 1) {
+        entries = strtoul(argv[1], NULL, 10);
+    }
+
+    hashtbl tbl = init_hashtbl(entries);
+    if (!tbl) {
+        fprintf(stderr, "table allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    char keybuff[HT_KEY_MAX];
+    char valbuff[HT_VAL_MAX];
+    for (size_t i = 0; i < entries; i++) {
+        snprintf(keybuff, HT_KEY_MAX, "key%zu", i);
+        snprintf(valbuff, HT_VAL_MAX, "value-%zu", i * 7919);
+        if (put(tbl, keybuff, valbuff) < 0) {
+            fprintf(stderr, "put failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE *stream = open_tmp();
+    FILE *fixed = open_tmp();
+    if (!stream || !fixed) {
+        fprintf(stderr, "temporary file creation failed\n");
+        return EXIT_FAILURE;
+    }
+    hashtbl_to_file(tbl, stream);
+    fflush(stream);
+    if (hashtbl_sync_file(tbl, fileno(fixed), true, false) < 0) {
+        fprintf(stderr, "fixed-layout write failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("entries: %zu  buckets: %zu  cpus: %ld\n",
+           entries, get_tbl_size(tbl), sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-24s %10s\n", "load", "best ms");
+    printf("%-24s %10.1f\n", "stream", bench_stream(stream, entries));
+    for (size_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "fixed, %u thread%s",
+                 THREAD_COUNTS[i], THREAD_COUNTS[i] == 1 ? "" : "s");
+        printf("%-24s %10.1f\n", label,
+               bench_fixed(fileno(fixed), entries, THREAD_COUNTS[i]));
+    }
+
+    fclose(stream);
+    fclose(fixed);
+    destroy_hashtbl(tbl);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * LSM table benchmark - usage: 'bench_lsm [keys]'
+ *
+ * Writes <keys> distinct keys (1000000 by default) in
+ * random order to an lsm table in a temporary directory,
+ * then overwrites a quarter of them and deletes a tenth.
+ * Reports:
+ *     write amplification - bytes written to table files
+ *         by flushes and compaction / key and value bytes
+ *         written by the workload
+ *     space amplification - bytes of table files on disk /
+ *         key and value bytes of the live data
+ *     read latency - p50 and p99 of random lookups of
+ *         present and absent keys, with blocks read and
+ *         files skipped by Bloom filters
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/lsm.h"
+
+enum {
+    DEFAULT_KEYS = 1000000,
+    LOOKUPS = 100000,
+    KEY_BUFF = 32,
+    VAL_BUFF = 64
+};
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned long long next_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double elapsed_us(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000.0 +
+           (end.tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Key i in the table. Keys with odd suffix
+// are never written, for absent lookups.
+static void make_key(char *dst, size_t i)
+{
+    snprintf(dst, KEY_BUFF, "user%012zu", i * 2);
+}
+
+// Time LOOKUPS random gets. Present keys are drawn
+// from the written keys, absent keys fall between them.
+// Prints p50 and p99 latency in microseconds.
+static void bench_reads(lsm_tbl lsm, size_t keys, bool present)
+{
+    double *lat = malloc(LOOKUPS * sizeof(double));
+    if (!lat) {
+        fprintf(stderr, "memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct lsm_stats before;
+    struct lsm_stats after;
+    lsm_get_stats(lsm, &before);
+
+    char keybuff[KEY_BUFF];
+    char valbuff[VAL_BUFF];
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        size_t k = next_rand() % keys;
+        if (present) {
+            make_key(keybuff, k);
+        }
+        else {
+            snprintf(keybuff, KEY_BUFF, "user%012zu", k * 2 + 1);
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        lsm_get(valbuff, VAL_BUFF, lsm, keybuff);
+        lat[i] = elapsed_us(&start);
+    }
+    lsm_get_stats(lsm, &after);
+
+    qsort(lat, LOOKUPS, sizeof(double), cmp_double);
+    printf("%-16s %10.2f %10.2f %12.2f %12.2f\n",
+           present ? "get present" : "get absent",
+           lat[LOOKUPS / 2], lat[LOOKUPS * 99 / 100],
+           (double) (after.block_reads - before.block_reads) / LOOKUPS,
+           (double) (after.bloom_skips - before.bloom_skips) / LOOKUPS);
+    free(lat);
+}
+
+int main(int argc, char **argv)
+{
+    size_t keys = DEFAULT_KEYS;
+    if (argc > 1) {
+        keys = strtoul(argv[1], NULL, 10);
+    }
+    if (keys == 0) {
+        fprintf(stderr, "usage: bench_lsm [keys]\n");
+        return EXIT_FAILURE;
+    }
+
+    char dirpath[] = "/tmp/pairdb-bench-lsm-XXXXXX";
+    if (!mkdtemp(dirpath)) {
+        fprintf(stderr, "temporary directory creation failed\n");
+        return EXIT_FAILURE;
+    }
+    lsm_tbl lsm = lsm_open(dirpath);
+    if (!lsm) {
+        fprintf(stderr, "table open failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // Random permutation of key indexes
+    size_t *order = malloc(keys * sizeof(size_t));
+    if (!order) {
+        fprintf(stderr, "memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < keys; i++) {
+        order[i] = i;
+    }
+    for (size_t i = keys - 1; i > 0; i--) {
+        size_t j = next_rand() % (i + 1);
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char keybuff[KEY_BUFF];
+    char valbuff[VAL_BUFF];
+    size_t live_bytes = 0;
+    for (size_t i = 0; i < keys; i++) {
+        make_key(keybuff, order[i]);
+        snprintf(valbuff, VAL_BUFF, "value-%zu", order[i] * 7919);
+        if (lsm_put(lsm, keybuff, valbuff) < 0) {
+            fprintf(stderr, "put failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // Overwrite every 4th key, delete every 10th
+    for (size_t i = 0; i < keys; i++) {
+        make_key(keybuff, order[i]);
+        if (order[i] % 10 == 0) {
+            lsm_del(lsm, keybuff);
+            continue;
+        }
+        snprintf(valbuff, VAL_BUFF, "value-%zu", order[i] * 7919);
+        if (order[i] % 4 == 0) {
+            snprintf(valbuff, VAL_BUFF, "updated-%zu", order[i]);
+            lsm_put(lsm, keybuff, valbuff);
+        }
+        live_bytes += strlen(keybuff) + strlen(valbuff);
+    }
+    lsm_flush(lsm, false);
+    lsm_wait_compaction(lsm);
+    double write_ms = elapsed_us(&start) / 1000.0;
+    free(order);
+
+    struct lsm_stats stats;
+    lsm_get_stats(lsm, &stats);
+    size_t disk_bytes = 0;
+    printf("keys: %zu  write time: %.0f ms  flushes: %zu  compactions: %zu\n",
+           keys, write_ms, stats.flushes, stats.compactions);
+    printf("%-8s %8s %14s\n", "level", "files", "bytes");
+    for (int i = 0; i < LSM_MAX_LEVELS; i++) {
+        disk_bytes += stats.level_bytes[i];
+        if (stats.files[i] > 0) {
+            printf("L%-7d %8zu %14zu\n", i, stats.files[i], stats.level_bytes[i]);
+        }
+    }
+    printf("write amplification: %.2f\n",
+           (double) (stats.flush_bytes + stats.compact_bytes) / stats.user_bytes);
+    printf("space amplification: %.2f\n", (double) disk_bytes / live_bytes);
+    printf("memory held: %zu bytes\n\n", lsm_mem_usage(lsm));
+
+    printf("%-16s %10s %10s %12s %12s\n",
+           "lookup", "p50 us", "p99 us", "blocks/get", "skips/get");
+    bench_reads(lsm, keys, true);
+    bench_reads(lsm, keys, false);
+
+    lsm_close(lsm);
+    lsm_remove_dir(dirpath);
+
+    return EXIT_SUCCESS;
+}
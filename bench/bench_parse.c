@@ -0,0 +1,120 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Command parser benchmark - usage: 'bench_parse [lines]'
+ *
+ * Generates <lines> command lines (1000000 by default)
+ * of each kind below and reports the number of lines
+ * parsed per second and the time per line. Lines are
+ * copied back into place before each pass, since the
+ * parser changes its input. Each pass is repeated and
+ * the best time is reported.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/parse.h"
+
+enum {
+    DEFAULT_LINES = 1000000,
+    LINE_LEN = 64,
+    REPEAT = 3
+};
+
+static const char *KINDS[] = {"add", "get", "quoted", "mixed"};
+
+static double elapsed_ms(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000.0 +
+           (end.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void make_line(char *line, const char *kind, size_t i)
+{
+    static const char *mixed[] = {"add key%zu value%zu\n", "get key%zu\n", "del key%zu\n",
+                                  "use table%zu\n", "lstbls\n", "newtbl table%zu hash\n"};
+    if (strcmp(kind, "add") == 0) {
+        snprintf(line, LINE_LEN, "add key%zu value%zu\n", i, i);
+    }
+    else if (strcmp(kind, "get") == 0) {
+        snprintf(line, LINE_LEN, "get key%zu\n", i);
+    }
+    else if (strcmp(kind, "quoted") == 0) {
+        snprintf(line, LINE_LEN, "add \"key %zu\" 'it\\'s value %zu'\n", i, i);
+    }
+    else {
+        snprintf(line, LINE_LEN, mixed[i % 6], i, i);
+    }
+}
+
+// Parse all lines. Returns best time in ms.
+static double bench_kind(char *lines, char *work, size_t count)
+{
+    struct parse_object prs = {0};
+    double best = -1;
+    size_t failed = 0;
+    for (int r = 0; r < REPEAT; r++) {
+        memcpy(work, lines, count * LINE_LEN);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < count; i++) {
+            parse_input(work + i * LINE_LEN, &prs);
+            failed += prs.cmd == FAIL;
+        }
+        double ms = elapsed_ms(&start);
+        if (best < 0 || ms < best) {
+            best = ms;
+        }
+    }
+    if (failed > 0) {
+        fprintf(stderr, "%zu lines failed to parse\n", failed / REPEAT);
+        exit(EXIT_FAILURE);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = DEFAULT_LINES;
+    if (argc > 1) {
+        count = strtoul(argv[1], NULL, 10);
+    }
+    if (count == 0) {
+        fprintf(stderr, "usage: bench_parse [lines]\n");
+        return EXIT_FAILURE;
+    }
+
+    char *lines = malloc(count * LINE_LEN);
+    char *work = malloc(count * LINE_LEN);
+    if (!lines || !work) {
+        fprintf(stderr, "memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %12s %10s\n", "lines", "lines/s", "ns/line");
+    for (size_t k = 0; k < sizeof(KINDS) / sizeof(KINDS[0]); k++) {
+        for (size_t i = 0; i < count; i++) {
+            make_line(lines + i * LINE_LEN, KINDS[k], i);
+        }
+        double ms = bench_kind(lines, work, count);
+        printf("%-8s %12.0f %10.1f\n", KINDS[k],
+               count / (ms / 1000.0), ms * 1000000.0 / count);
+    }
+
+    free(lines);
+    free(work);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,415 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Server load generator - usage:
+ *     'bench_server [connections] [depth] [write_pct] [socket|blocking|uring]'
+ *
+ * Opens <connections> connections (4 by default) to a
+ * pairdb server and keeps <depth> requests (16 by
+ * default) in flight on each, sending REQUESTS requests
+ * in total. <write_pct> percent of requests (0 by
+ * default) add new keys; the rest get random keys of
+ * the KEYS keys added before the run. Reports requests
+ * per second and p50, p90, p99, p99.9, and maximum
+ * latency, measured from sending a request to reading
+ * its reply.
+ *
+ * If no socket is given, a server is started in a
+ * child process with a temporary data directory, with
+ * the I/O backend given (see uring.h) or the default
+ * one, and the number of socket I/O calls it made is
+ * reported when it stops.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../src/server.h"
+#include "../src/wire.h"
+#include "../src/stringutil.h"
+#include "../src/uring.h"
+
+enum {
+    DEFAULT_CONNS = 4,
+    DEFAULT_DEPTH = 16,
+    MAX_CONNS = 256,
+    MAX_DEPTH = 1024,
+    KEYS = 100000,
+    REQUESTS = 500000,
+    READ_CHUNK = 64 * 1024,
+    LOAD_BATCH = 1000,
+    CMD_BUFF = 64
+};
+
+static const char *TBL_NAME = "bench";
+static const char *SERVER_LOG = "server.log";
+
+struct bench_conn {
+    int fd;
+    struct netbuf in;
+    struct netbuf out;
+    double *sent_at;        // Send time of each request in flight
+    size_t sent;
+    size_t done;
+    size_t quota;           // Requests this connection sends
+};
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned long long next_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Connect to socket at path, retrying for up
+// to 2 seconds while a new server starts.
+static int connect_server(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strtcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    for (int tries = 0; tries < 200; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Write all queued output on a blocking socket.
+// Returns -1 on error.
+static int send_out(struct bench_conn *bc)
+{
+    while (netbuf_used(&bc->out) > 0) {
+        ssize_t n = write(bc->fd, bc->out.data + bc->out.off, netbuf_used(&bc->out));
+        if (n <= 0) {
+            return -1;
+        }
+        netbuf_consume(&bc->out, n);
+    }
+    return 1;
+}
+
+static int send_all(struct bench_conn *bc, const char *cmd)
+{
+    netbuf_append(&bc->out, cmd, strlen(cmd));
+    return send_out(bc);
+}
+
+// Queue requests until depth are in flight
+static void fill_pipeline(struct bench_conn *bc, size_t depth, unsigned write_pct,
+                          size_t *next_key)
+{
+    char cmd[CMD_BUFF];
+    while (bc->sent < bc->quota && bc->sent - bc->done < depth) {
+        int len;
+        if (next_rand() % 100 < write_pct) {
+            len = snprintf(cmd, CMD_BUFF, "add key%zu val%zu\n", *next_key, *next_key);
+            (*next_key)++;
+        }
+        else {
+            size_t k = next_rand() % KEYS;
+            len = snprintf(cmd, CMD_BUFF, "get key%zu\n", k);
+        }
+        netbuf_append(&bc->out, cmd, len);
+        bc->sent_at[bc->sent % depth] = now_us();
+        bc->sent++;
+    }
+}
+
+// Send queued requests and read replies, recording
+// latencies. Returns -1 on error.
+static int pump(struct bench_conn *bc, size_t depth, double *lat, size_t *numlat,
+                bool readable)
+{
+    while (netbuf_used(&bc->out) > 0) {
+        ssize_t n = send(bc->fd, bc->out.data + bc->out.off, netbuf_used(&bc->out),
+                         MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            return -1;
+        }
+        netbuf_consume(&bc->out, n);
+    }
+
+    if (!readable) {
+        return 1;
+    }
+    if (netbuf_reserve(&bc->in, READ_CHUNK) < 0) {
+        return -1;
+    }
+    ssize_t n = read(bc->fd, bc->in.data + bc->in.len, READ_CHUNK);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return -1;
+    }
+    if (n > 0) {
+        bc->in.len += n;
+    }
+
+    double t = now_us();
+    ssize_t rlen;
+    while ((rlen = wire_reply_len(bc->in.data + bc->in.off, netbuf_used(&bc->in))) > 0) {
+        lat[(*numlat)++] = t - bc->sent_at[bc->done % depth];
+        bc->done++;
+        netbuf_consume(&bc->in, rlen);
+    }
+    return rlen < 0 ? -1 : 1;
+}
+
+// Wait for count replies. Returns the number
+// of error replies, or -1 on error.
+static long read_replies(struct bench_conn *bc, size_t count)
+{
+    long errors = 0;
+    while (count > 0) {
+        ssize_t rlen = wire_reply_len(bc->in.data + bc->in.off, netbuf_used(&bc->in));
+        if (rlen > 0) {
+            errors += bc->in.data[bc->in.off] == '-';
+            netbuf_consume(&bc->in, rlen);
+            count--;
+            continue;
+        }
+        if (rlen < 0 || netbuf_reserve(&bc->in, READ_CHUNK) < 0) {
+            return -1;
+        }
+        ssize_t n = read(bc->fd, bc->in.data + bc->in.len, READ_CHUNK);
+        if (n <= 0) {
+            return -1;
+        }
+        bc->in.len += n;
+    }
+    return errors;
+}
+
+// Add KEYS keys through one connection,
+// LOAD_BATCH commands per write
+static int load_keys(struct bench_conn *bc)
+{
+    char cmd[CMD_BUFF];
+    snprintf(cmd, CMD_BUFF, "durability none\nuse %s\n", TBL_NAME);
+    send_all(bc, cmd);
+    if (read_replies(bc, 2) != 0) {
+        snprintf(cmd, CMD_BUFF, "newtbl %s\n", TBL_NAME);
+        if (send_all(bc, cmd) < 0 || read_replies(bc, 1) != 0) {
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < KEYS; i += LOAD_BATCH) {
+        size_t n = KEYS - i < LOAD_BATCH ? KEYS - i : LOAD_BATCH;
+        for (size_t k = i; k < i + n; k++) {
+            int len = snprintf(cmd, CMD_BUFF, "add key%zu val%zu\n", k, k);
+            netbuf_append(&bc->out, cmd, len);
+        }
+        if (send_out(bc) < 0 || read_replies(bc, n) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t conns = DEFAULT_CONNS;
+    size_t depth = DEFAULT_DEPTH;
+    unsigned write_pct = 0;
+    const char *path = NULL;
+    enum io_backend io = get_io_backend();
+    if (argc > 1) {
+        conns = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        depth = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        write_pct = (unsigned) strtoul(argv[3], NULL, 10);
+    }
+    if (argc > 4 && find_io_backend(argv[4], &io) < 0) {
+        path = argv[4];
+    }
+    if (conns < 1 || conns > MAX_CONNS || depth < 1 || depth > MAX_DEPTH ||
+        write_pct > 100) {
+        fprintf(stderr, "usage: bench_server [connections] [depth] [write_pct] "
+                        "[socket|blocking|uring]\n");
+        return EXIT_FAILURE;
+    }
+    if (!path && set_io_backend(io) < 0) {
+        fprintf(stderr, "io_uring is not supported on this system\n");
+        return EXIT_FAILURE;
+    }
+
+    // Start a server with its own data directory
+    char tmpdir[] = "/tmp/pairdb-bench-XXXXXX";
+    char sockpath[sizeof(tmpdir) + 32];
+    char logpath[sizeof(tmpdir) + 32];
+    pid_t child = 0;
+    if (!path) {
+        if (!mkdtemp(tmpdir)) {
+            perror("mkdtemp");
+            return EXIT_FAILURE;
+        }
+        snprintf(sockpath, sizeof(sockpath), "%s/pairdb-data", tmpdir);
+        mkdir(sockpath, 0700);
+        snprintf(sockpath, sizeof(sockpath), "%s/pairdb.sock", tmpdir);
+        path = sockpath;
+        snprintf(logpath, sizeof(logpath), "%s/%s", tmpdir, SERVER_LOG);
+
+        fflush(stdout);
+        child = fork();
+        if (child == 0) {
+            setenv("HOME", tmpdir, 1);
+            if (!freopen(logpath, "w", stdout)) {
+                _exit(EXIT_FAILURE);
+            }
+            int status = run_server(path, NULL);
+            fflush(stdout);
+            _exit(status);
+        }
+    }
+
+    struct bench_conn *bcs = calloc(conns, sizeof(struct bench_conn));
+    struct pollfd *fds = calloc(conns, sizeof(struct pollfd));
+    double *lat = malloc((REQUESTS + conns) * sizeof(double));
+    if (!bcs || !fds || !lat) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < conns; i++) {
+        bcs[i].fd = connect_server(path);
+        bcs[i].sent_at = calloc(depth, sizeof(double));
+        bcs[i].quota = REQUESTS / conns + (i < REQUESTS % conns);
+        if (bcs[i].fd < 0 || !bcs[i].sent_at) {
+            fprintf(stderr, "Cannot connect to %s\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (load_keys(&bcs[0]) < 0) {
+        fprintf(stderr, "Cannot load keys\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 1; i < conns; i++) {
+        char cmd[CMD_BUFF];
+        snprintf(cmd, CMD_BUFF, "use %s\n", TBL_NAME);
+        if (send_all(&bcs[i], cmd) < 0 || read_replies(&bcs[i], 1) != 0) {
+            fprintf(stderr, "Cannot select table %s\n", TBL_NAME);
+            return EXIT_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < conns; i++) {
+        fcntl(bcs[i].fd, F_SETFL, O_NONBLOCK);
+    }
+
+    size_t next_key = KEYS;
+    size_t numlat = 0;
+    size_t finished = 0;
+    double start = now_us();
+    while (finished < conns) {
+        for (size_t i = 0; i < conns; i++) {
+            fill_pipeline(&bcs[i], depth, write_pct, &next_key);
+            fds[i].fd = bcs[i].done < bcs[i].quota ? bcs[i].fd : -1;
+            fds[i].events = POLLIN | (netbuf_used(&bcs[i].out) ? POLLOUT : 0);
+            fds[i].revents = 0;
+        }
+        if (poll(fds, conns, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        finished = 0;
+        for (size_t i = 0; i < conns; i++) {
+            if (fds[i].fd >= 0 &&
+                pump(&bcs[i], depth, lat, &numlat, fds[i].revents & (POLLIN | POLLHUP)) < 0) {
+                fprintf(stderr, "Connection %zu failed\n", i);
+                return EXIT_FAILURE;
+            }
+            finished += bcs[i].done >= bcs[i].quota;
+        }
+    }
+    double secs = (now_us() - start) / 1000000.0;
+
+    qsort(lat, numlat, sizeof(double), cmp_double);
+    printf("%zu connections, depth %zu, %u%% writes\n", conns, depth, write_pct);
+    printf("%zu requests in %.3f s: %.0f requests/s\n", numlat, secs, numlat / secs);
+    printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           lat[numlat / 2], lat[numlat * 90 / 100], lat[numlat * 99 / 100],
+           lat[numlat * 999 / 1000], lat[numlat - 1]);
+
+    for (size_t i = 0; i < conns; i++) {
+        close(bcs[i].fd);
+        netbuf_free(&bcs[i].in);
+        netbuf_free(&bcs[i].out);
+        free(bcs[i].sent_at);
+    }
+    free(bcs);
+    free(fds);
+    free(lat);
+
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+
+        // Last line of server output reports
+        // its socket I/O calls
+        char line[256] = "";
+        char last[256] = "";
+        FILE *log = fopen(logpath, "r");
+        while (log && fgets(line, sizeof(line), log)) {
+            strtcpy(last, line, sizeof(last));
+        }
+        if (log) {
+            fclose(log);
+        }
+        printf("%s", last);
+
+        char cmd[sizeof(tmpdir) + 16];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpdir);
+        if (system(cmd) != 0) {
+            fprintf(stderr, "Cannot remove %s\n", tmpdir);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,488 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Sharded server scaling - usage:
+ *     'bench_shards [max_shards] [connections] [depth] [write_pct]'
+ *
+ * Starts the sharded RESP server (see shard.h) with 1,
+ * 2, 4, ... shards up to <max_shards> (16 by default),
+ * each in a child process with a temporary data
+ * directory, and loads KEYS keys with MSET. For each
+ * shard count, client threads keep <depth> requests
+ * (16 by default) in flight on each of <connections>
+ * connections (32 by default), sending REQUESTS
+ * requests in total. <write_pct> percent of requests
+ * (10 by default) are SETs and the rest GETs of random
+ * keys. Prints requests per second, p50 and p99
+ * latency, and the speedup over one shard.
+ *
+ * Client threads compete with the server for CPUs, so
+ * scaling is only meaningful on a machine with at least
+ * twice as many CPUs as the largest shard count.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../src/shard.h"
+#include "../src/wire.h"
+#include "../src/stringutil.h"
+
+enum {
+    DEFAULT_MAX_SHARDS = 16,
+    DEFAULT_CONNS = 32,
+    DEFAULT_DEPTH = 16,
+    DEFAULT_WRITE_PCT = 10,
+    MAX_CONNS = 256,
+    MAX_DEPTH = 1024,
+    CLIENT_THREADS = 8,
+    KEYS = 100000,
+    REQUESTS = 1000000,
+    READ_CHUNK = 64 * 1024,
+    LOAD_BATCH = 500,
+    CMD_BUFF = 96
+};
+
+struct bench_conn {
+    int fd;
+    struct netbuf in;
+    struct netbuf out;
+    double *sent_at;        // Send time of each request in flight
+    size_t sent;
+    size_t done;
+    size_t quota;           // Requests this connection sends
+    unsigned long long rng;
+};
+
+struct client {
+    pthread_t thread;
+    struct bench_conn *conns;
+    size_t numconns;
+    size_t depth;
+    unsigned write_pct;
+    double *lat;
+    size_t numlat;
+    bool failed;
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static unsigned long long next_rand(unsigned long long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Length of the RESP reply at the start of buf, 0 if
+// incomplete, -1 if it is not a reply the benchmark
+// expects (a simple string, error, integer, or bulk
+// string).
+static ssize_t reply_len(const char *buf, size_t len)
+{
+    const char *nl = memchr(buf, '\n', len);
+    if (!nl) {
+        return 0;
+    }
+    size_t line = nl + 1 - buf;
+    switch (buf[0]) {
+        case '+':
+        case '-':
+        case ':':
+            return line;
+        case '$': {
+            long blen = strtol(buf + 1, NULL, 10);
+            if (blen < 0) {
+                return line;
+            }
+            return len < line + blen + 2 ? 0 : (ssize_t) (line + blen + 2);
+        }
+        default:
+            return -1;
+    }
+}
+
+// Connect to socket at path, retrying for up
+// to 2 seconds while a new server starts.
+static int connect_server(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strtcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    for (int tries = 0; tries < 200; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Write all queued output and wait for count
+// replies on a blocking socket. Returns the number
+// of error replies, or -1 on error.
+static long exchange(struct bench_conn *bc, size_t count)
+{
+    while (netbuf_used(&bc->out) > 0) {
+        ssize_t n = write(bc->fd, bc->out.data + bc->out.off, netbuf_used(&bc->out));
+        if (n <= 0) {
+            return -1;
+        }
+        netbuf_consume(&bc->out, n);
+    }
+
+    long errors = 0;
+    while (count > 0) {
+        ssize_t rlen = reply_len(bc->in.data + bc->in.off, netbuf_used(&bc->in));
+        if (rlen > 0) {
+            errors += bc->in.data[bc->in.off] == '-';
+            netbuf_consume(&bc->in, rlen);
+            count--;
+            continue;
+        }
+        if (rlen < 0 || netbuf_reserve(&bc->in, READ_CHUNK) < 0) {
+            return -1;
+        }
+        ssize_t n = read(bc->fd, bc->in.data + bc->in.len, READ_CHUNK);
+        if (n <= 0) {
+            return -1;
+        }
+        bc->in.len += n;
+    }
+    return errors;
+}
+
+// Add KEYS keys with MSET, LOAD_BATCH keys per command
+static int load_keys(struct bench_conn *bc)
+{
+    char arg[CMD_BUFF];
+    for (size_t i = 0; i < KEYS; i += LOAD_BATCH) {
+        size_t n = KEYS - i < LOAD_BATCH ? KEYS - i : LOAD_BATCH;
+        netbuf_printf(&bc->out, "*%zu\r\n$4\r\nMSET\r\n", 2 * n + 1);
+        for (size_t k = i; k < i + n; k++) {
+            int klen = snprintf(arg, CMD_BUFF, "key%zu", k);
+            netbuf_printf(&bc->out, "$%d\r\n%s\r\n", klen, arg);
+            int vlen = snprintf(arg, CMD_BUFF, "val%zu", k);
+            netbuf_printf(&bc->out, "$%d\r\n%s\r\n", vlen, arg);
+        }
+        if (exchange(bc, 1) != 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// Queue requests until depth are in flight
+static void fill_pipeline(struct bench_conn *bc, size_t depth, unsigned write_pct)
+{
+    char key[CMD_BUFF];
+    while (bc->sent < bc->quota && bc->sent - bc->done < depth) {
+        size_t k = next_rand(&bc->rng) % KEYS;
+        int klen = snprintf(key, CMD_BUFF, "key%zu", k);
+        if (next_rand(&bc->rng) % 100 < write_pct) {
+            netbuf_printf(&bc->out, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n",
+                          klen, key, klen, key);
+        }
+        else {
+            netbuf_printf(&bc->out, "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", klen, key);
+        }
+        bc->sent_at[bc->sent % depth] = now_us();
+        bc->sent++;
+    }
+}
+
+// Send queued requests and read replies, recording
+// latencies. Returns -1 on error.
+static int pump(struct client *cl, struct bench_conn *bc, bool readable)
+{
+    while (netbuf_used(&bc->out) > 0) {
+        ssize_t n = send(bc->fd, bc->out.data + bc->out.off, netbuf_used(&bc->out),
+                         MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            return -1;
+        }
+        netbuf_consume(&bc->out, n);
+    }
+
+    if (!readable) {
+        return 1;
+    }
+    if (netbuf_reserve(&bc->in, READ_CHUNK) < 0) {
+        return -1;
+    }
+    ssize_t n = read(bc->fd, bc->in.data + bc->in.len, READ_CHUNK);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return -1;
+    }
+    if (n > 0) {
+        bc->in.len += n;
+    }
+
+    double t = now_us();
+    ssize_t rlen;
+    while ((rlen = reply_len(bc->in.data + bc->in.off, netbuf_used(&bc->in))) > 0) {
+        if (bc->in.data[bc->in.off] == '-') {
+            return -1;
+        }
+        cl->lat[cl->numlat++] = t - bc->sent_at[bc->done % cl->depth];
+        bc->done++;
+        netbuf_consume(&bc->in, rlen);
+    }
+    return rlen < 0 ? -1 : 1;
+}
+
+static void *client_main(void *arg)
+{
+    struct client *cl = arg;
+    struct pollfd *fds = calloc(cl->numconns, sizeof(struct pollfd));
+    if (!fds) {
+        cl->failed = true;
+        return NULL;
+    }
+
+    size_t finished = 0;
+    while (finished < cl->numconns) {
+        for (size_t i = 0; i < cl->numconns; i++) {
+            struct bench_conn *bc = &cl->conns[i];
+            fill_pipeline(bc, cl->depth, cl->write_pct);
+            fds[i].fd = bc->done < bc->quota ? bc->fd : -1;
+            fds[i].events = POLLIN | (netbuf_used(&bc->out) ? POLLOUT : 0);
+            fds[i].revents = 0;
+        }
+        if (poll(fds, cl->numconns, -1) < 0 && errno != EINTR) {
+            cl->failed = true;
+            break;
+        }
+        finished = 0;
+        for (size_t i = 0; i < cl->numconns; i++) {
+            struct bench_conn *bc = &cl->conns[i];
+            if (fds[i].fd >= 0 &&
+                pump(cl, bc, fds[i].revents & (POLLIN | POLLHUP)) < 0) {
+                cl->failed = true;
+                free(fds);
+                return NULL;
+            }
+            finished += bc->done >= bc->quota;
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+// Start a sharded server in a child process with
+// data directory under dir. Returns its pid.
+static pid_t start_server(const char *dir, const char *path, unsigned nshards)
+{
+    // Output not yet written would be written
+    // again by the child
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        setenv("HOME", dir, 1);
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(run_sharded_server(path, nshards));
+    }
+    return child;
+}
+
+// Run the benchmark against the server at path.
+// Sets reqs_per_sec, p50, and p99. Returns -1 on error.
+static int run_load(const char *path, size_t conns, size_t depth, unsigned write_pct,
+                    double *reqs_per_sec, double *p50, double *p99)
+{
+    size_t nthreads = conns < CLIENT_THREADS ? conns : CLIENT_THREADS;
+    struct bench_conn *bcs = calloc(conns, sizeof(struct bench_conn));
+    struct client *clients = calloc(nthreads, sizeof(struct client));
+    double *lat = malloc((REQUESTS + conns) * sizeof(double));
+    if (!bcs || !clients || !lat) {
+        return -1;
+    }
+
+    int status = 1;
+    for (size_t i = 0; i < conns; i++) {
+        bcs[i].fd = connect_server(path);
+        bcs[i].sent_at = calloc(depth, sizeof(double));
+        bcs[i].quota = REQUESTS / conns + (i < REQUESTS % conns);
+        bcs[i].rng = 88172645463325252ULL + i * 7919;
+        if (bcs[i].fd < 0 || !bcs[i].sent_at) {
+            fprintf(stderr, "Cannot connect to %s\n", path);
+            status = -1;
+            break;
+        }
+    }
+    if (status > 0 && load_keys(&bcs[0]) < 0) {
+        fprintf(stderr, "Cannot load keys\n");
+        status = -1;
+    }
+
+    if (status > 0) {
+        // Connections are split evenly between client
+        // threads, and latencies between their arrays
+        size_t first = 0;
+        double *next_lat = lat;
+        for (size_t t = 0; t < nthreads; t++) {
+            struct client *cl = &clients[t];
+            cl->numconns = conns / nthreads + (t < conns % nthreads);
+            cl->conns = &bcs[first];
+            cl->depth = depth;
+            cl->write_pct = write_pct;
+            cl->lat = next_lat;
+            for (size_t i = 0; i < cl->numconns; i++) {
+                fcntl(cl->conns[i].fd, F_SETFL, O_NONBLOCK);
+                next_lat += cl->conns[i].quota;
+            }
+            first += cl->numconns;
+        }
+
+        double start = now_us();
+        for (size_t t = 0; t < nthreads; t++) {
+            pthread_create(&clients[t].thread, NULL, client_main, &clients[t]);
+        }
+        for (size_t t = 0; t < nthreads; t++) {
+            pthread_join(clients[t].thread, NULL);
+        }
+        double secs = (now_us() - start) / 1000000.0;
+
+        // Gather latencies into one array
+        size_t numlat = 0;
+        for (size_t t = 0; t < nthreads; t++) {
+            if (clients[t].failed) {
+                fprintf(stderr, "Client thread %zu failed\n", t);
+                status = -1;
+            }
+            memmove(lat + numlat, clients[t].lat, clients[t].numlat * sizeof(double));
+            numlat += clients[t].numlat;
+        }
+        if (status > 0 && numlat > 0) {
+            qsort(lat, numlat, sizeof(double), cmp_double);
+            *reqs_per_sec = numlat / secs;
+            *p50 = lat[numlat / 2];
+            *p99 = lat[numlat * 99 / 100];
+        }
+    }
+
+    for (size_t i = 0; i < conns; i++) {
+        if (bcs[i].fd > 0) {
+            close(bcs[i].fd);
+        }
+        netbuf_free(&bcs[i].in);
+        netbuf_free(&bcs[i].out);
+        free(bcs[i].sent_at);
+    }
+    free(bcs);
+    free(clients);
+    free(lat);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_shards = DEFAULT_MAX_SHARDS;
+    size_t conns = DEFAULT_CONNS;
+    size_t depth = DEFAULT_DEPTH;
+    unsigned write_pct = DEFAULT_WRITE_PCT;
+    if (argc > 1) {
+        max_shards = (unsigned) strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        conns = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        depth = strtoul(argv[3], NULL, 10);
+    }
+    if (argc > 4) {
+        write_pct = (unsigned) strtoul(argv[4], NULL, 10);
+    }
+    if (max_shards < 1 || max_shards > MAX_SHARDS || conns < 1 || conns > MAX_CONNS ||
+        depth < 1 || depth > MAX_DEPTH || write_pct > 100) {
+        fprintf(stderr,
+                "usage: bench_shards [max_shards] [connections] [depth] [write_pct]\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu connections, depth %zu, %u%% writes, %ld CPUs\n", conns, depth, write_pct,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %14s %10s %10s %8s\n", "shards", "requests/s", "p50 us", "p99 us", "speedup");
+
+    double base = 0;
+    for (unsigned nshards = 1; nshards <= max_shards; nshards *= 2) {
+        char tmpdir[] = "/tmp/pairdb-bench-XXXXXX";
+        char path[sizeof(tmpdir) + 32];
+        if (!mkdtemp(tmpdir)) {
+            perror("mkdtemp");
+            return EXIT_FAILURE;
+        }
+        snprintf(path, sizeof(path), "%s/pairdb-data", tmpdir);
+        mkdir(path, 0700);
+        snprintf(path, sizeof(path), "%s/pairdb.sock", tmpdir);
+
+        pid_t child = start_server(tmpdir, path, nshards);
+        double rps = 0;
+        double p50 = 0;
+        double p99 = 0;
+        int status = child > 0 ? run_load(path, conns, depth, write_pct, &rps, &p50, &p99) : -1;
+        if (child > 0) {
+            kill(child, SIGTERM);
+            waitpid(child, NULL, 0);
+        }
+        char cmd[sizeof(tmpdir) + 16];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpdir);
+        if (system(cmd) != 0) {
+            fprintf(stderr, "Cannot remove %s\n", tmpdir);
+        }
+        if (status < 0) {
+            return EXIT_FAILURE;
+        }
+
+        if (nshards == 1) {
+            base = rps;
+        }
+        printf("%8u %14.0f %10.1f %10.1f %7.2fx\n", nshards, rps, p50, p99, rps / base);
+        fflush(stdout);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,699 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * YCSB-style workloads - usage:
+ *     'bench_ycsb gen <a-f> <prefix> [records] [operations]
+ *                 [zipfian|uniform] [tables]'
+ *     'bench_ycsb lib <prefix>'
+ *     'bench_ycsb bin <prefix> [pairdb]'
+ *
+ * gen writes a workload as two pairdb command files.
+ * <prefix>.load creates <tables> tables (1 by default)
+ * named ycsb0, ycsb1, ... and adds <records> records
+ * (100000 by default), each to table <index> % <tables>.
+ * <prefix>.run holds <operations> operations (500000
+ * by default) in the mix of a YCSB core workload:
+ *
+ *      a   50% read, 50% update
+ *      b   95% read, 5% update
+ *      c   100% read
+ *      d   95% read, 5% insert; reads favor new records
+ *      e   95% scan, 5% insert
+ *      f   50% read, 50% read-modify-write
+ *
+ * Record popularity is zipfian (scrambled, as in YCSB,
+ * so that hot records are spread over the tables) or
+ * uniform. A use command is written whenever the table
+ * of the next record differs from the current one. As
+ * pairdb has no update, an update is a del followed by
+ * an add, and read-modify-write is a get, del, and add.
+ * A scan is 'lsdata limit N cursor C', a page of 1 to
+ * SCAN_MAX pairs starting at a cursor picked with the
+ * popularity distribution, since pairdb cursors are
+ * positions rather than keys. Values are VAL_LEN bytes,
+ * as YCSB's 1 KB records do not fit in a pairdb value.
+ * Workloads are generated from a fixed seed and are
+ * plain command files, so the same files can be
+ * replayed with any build.
+ *
+ * Both replays start from an empty temporary data
+ * directory, run <prefix>.load, and then time
+ * <prefix>.run from the saved tables. lib runs every
+ * command through the db_manager API in this process
+ * and reports, for each command, its latency
+ * percentiles and a histogram of latencies, along with
+ * resident memory over the run. bin runs each file
+ * with 'pairdb --batch' (build/pairdb by default) and
+ * reports the run's commands per second and the
+ * resident memory of the pairdb process every
+ * RSS_INTERVAL_MS ms; its batch summary is printed
+ * to stderr.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../src/parse.h"
+#include "../src/db_manager.h"
+
+enum {
+    DEFAULT_RECORDS = 100000,
+    DEFAULT_OPS = 500000,
+    MAX_TABLES = 1000,
+    VAL_LEN = 90,
+    SCAN_MAX = 100,
+    RSS_SAMPLES = 20,           // Memory samples over a library run
+    RSS_INTERVAL_MS = 100,      // Time between samples of pairdb
+    HIST_SUB_BITS = 3,          // Histogram buckets per power of 2: 8
+    HIST_BUCKETS = 64 << HIST_SUB_BITS,
+    PATH_BUFF = 4096
+};
+
+static const double ZIPF_THETA = 0.99;
+
+// Percent of operations of each kind
+struct mix {
+    char name;
+    unsigned read;
+    unsigned update;
+    unsigned insert;
+    unsigned scan;
+    unsigned rmw;
+    bool latest;        // Reads favor newest records
+};
+
+static const struct mix MIXES[] = {
+    {'a', 50, 50, 0, 0, 0, false},
+    {'b', 95, 5, 0, 0, 0, false},
+    {'c', 100, 0, 0, 0, 0, false},
+    {'d', 95, 0, 5, 0, 0, true},
+    {'e', 0, 0, 5, 95, 0, false},
+    {'f', 50, 0, 0, 0, 50, false}
+};
+
+static const char ALNUM[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+struct generator {
+    const struct mix *mix;
+    size_t loaded;          // Records of the load file
+    size_t records;         // Records loaded or inserted so far
+    size_t tables;
+    size_t curr_tbl;        // Table of last use, tables if none
+    bool zipfian;
+
+    // Zipfian constants for loaded records
+    double zetan;
+    double alpha;
+    double eta;
+
+    FILE *out;
+};
+
+// Latencies of one command
+struct cmd_stats {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t hist[HIST_BUCKETS];
+};
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static uint64_t next_rand(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+// Uniform in [0, 1)
+static double rand_unit(void)
+{
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Resident memory of process pid in MB, 0 if unknown
+static double rss_mb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int) pid);
+    FILE *f = fopen(path, "r");
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (f) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (double) sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+/*
+ *
+ * Workload generation
+ *
+ */
+
+// Zipfian generator of Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases",
+// as used by YCSB
+static void init_zipfian(struct generator *gen)
+{
+    double n = gen->loaded;
+    gen->zetan = 0;
+    for (size_t i = 1; i <= gen->loaded; i++) {
+        gen->zetan += 1.0 / pow(i, ZIPF_THETA);
+    }
+    double zeta2 = 1.0 + 1.0 / pow(2, ZIPF_THETA);
+    gen->alpha = 1.0 / (1.0 - ZIPF_THETA);
+    gen->eta = (1.0 - pow(2.0 / n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / gen->zetan);
+}
+
+// Rank in [0, loaded), 0 the most popular
+static size_t next_rank(struct generator *gen)
+{
+    if (!gen->zipfian) {
+        return next_rand() % gen->loaded;
+    }
+    double u = rand_unit();
+    double uz = u * gen->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, ZIPF_THETA)) {
+        return 1;
+    }
+    size_t rank = gen->loaded * pow(gen->eta * u - gen->eta + 1.0, gen->alpha);
+    return rank < gen->loaded ? rank : gen->loaded - 1;
+}
+
+// FNV-1a hash of rank, which scatters popular
+// ranks over the records
+static uint64_t scramble(size_t rank)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        h ^= (rank >> (i * 8)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Index of record for next operation
+static size_t next_record(struct generator *gen)
+{
+    size_t rank = next_rank(gen);
+    if (gen->mix->latest) {
+        return gen->records - 1 - rank % gen->records;
+    }
+    return scramble(rank) % gen->loaded;
+}
+
+// Write use command if record is not in current table
+static void select_table(struct generator *gen, size_t record)
+{
+    size_t tbl = record % gen->tables;
+    if (tbl != gen->curr_tbl) {
+        fprintf(gen->out, "use ycsb%zu\n", tbl);
+        gen->curr_tbl = tbl;
+    }
+}
+
+static void write_add(struct generator *gen, size_t record)
+{
+    char val[VAL_LEN + 1];
+    for (size_t i = 0; i < VAL_LEN; i++) {
+        val[i] = ALNUM[next_rand() % 62];
+    }
+    val[VAL_LEN] = '\0';
+    fprintf(gen->out, "add user%zu %s\n", record, val);
+}
+
+static void write_operation(struct generator *gen)
+{
+    unsigned pick = next_rand() % 100;
+    const struct mix *mix = gen->mix;
+    if (pick < mix->insert) {
+        size_t record = gen->records++;
+        select_table(gen, record);
+        write_add(gen, record);
+        return;
+    }
+    pick -= mix->insert;
+
+    size_t record = next_record(gen);
+    select_table(gen, record);
+    if (pick < mix->read) {
+        fprintf(gen->out, "get user%zu\n", record);
+    }
+    else if (pick < mix->read + mix->update) {
+        fprintf(gen->out, "del user%zu\n", record);
+        write_add(gen, record);
+    }
+    else if (pick < mix->read + mix->update + mix->scan) {
+        fprintf(gen->out, "lsdata limit %zu cursor %zu\n",
+                1 + (size_t) (next_rand() % SCAN_MAX), record / gen->tables);
+    }
+    else {
+        fprintf(gen->out, "get user%zu\n", record);
+        fprintf(gen->out, "del user%zu\n", record);
+        write_add(gen, record);
+    }
+}
+
+static FILE *open_workload(const char *prefix, const char *ext, const char *mode)
+{
+    char path[PATH_BUFF];
+    snprintf(path, sizeof(path), "%s.%s", prefix, ext);
+    FILE *f = fopen(path, mode);
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+    }
+    return f;
+}
+
+static int generate(int argc, char **argv)
+{
+    if (argc < 4 || strlen(argv[2]) != 1) {
+        return -1;
+    }
+    struct generator gen = {0};
+    for (size_t i = 0; i < sizeof(MIXES) / sizeof(MIXES[0]); i++) {
+        if (MIXES[i].name == argv[2][0]) {
+            gen.mix = &MIXES[i];
+        }
+    }
+    const char *prefix = argv[3];
+    gen.loaded = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_RECORDS;
+    size_t ops = argc > 5 ? strtoul(argv[5], NULL, 10) : DEFAULT_OPS;
+    gen.zipfian = argc <= 6 || strcmp(argv[6], "zipfian") == 0;
+    gen.tables = argc > 7 ? strtoul(argv[7], NULL, 10) : 1;
+    if (!gen.mix || gen.loaded == 0 || ops == 0 || gen.tables == 0 ||
+        gen.tables > MAX_TABLES || (argc > 6 && !gen.zipfian && strcmp(argv[6], "uniform") != 0)) {
+        return -1;
+    }
+    if (gen.zipfian) {
+        init_zipfian(&gen);
+    }
+
+    gen.out = open_workload(prefix, "load", "w");
+    if (!gen.out) {
+        return -2;
+    }
+    for (size_t tbl = 0; tbl < gen.tables; tbl++) {
+        fprintf(gen.out, "newtbl ycsb%zu\n", tbl);
+        for (size_t record = tbl; record < gen.loaded; record += gen.tables) {
+            write_add(&gen, record);
+        }
+    }
+    fclose(gen.out);
+
+    gen.out = open_workload(prefix, "run", "w");
+    if (!gen.out) {
+        return -2;
+    }
+    gen.records = gen.loaded;
+    gen.curr_tbl = gen.tables;
+    for (size_t i = 0; i < ops; i++) {
+        write_operation(&gen);
+    }
+    fclose(gen.out);
+
+    printf("workload %c: %zu records in %zu table%s, %zu operations, %s\n",
+           gen.mix->name, gen.loaded, gen.tables, gen.tables == 1 ? "" : "s",
+           ops, gen.zipfian ? "zipfian" : "uniform");
+    return 1;
+}
+
+/*
+ *
+ * Replay
+ *
+ */
+
+static size_t hist_bucket(uint64_t ns)
+{
+    if (ns < (1u << HIST_SUB_BITS)) {
+        return ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1);
+    return ((size_t) (msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// Largest latency held by bucket
+static uint64_t bucket_max(size_t bucket)
+{
+    if (bucket < (1u << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t) ((1u << HIST_SUB_BITS) + (bucket & ((1u << HIST_SUB_BITS) - 1)))
+                   << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+static void record_latency(struct cmd_stats *st, uint64_t ns, bool ok)
+{
+    st->count++;
+    st->errors += !ok;
+    st->sum_ns += ns;
+    if (ns > st->max_ns) {
+        st->max_ns = ns;
+    }
+    st->hist[hist_bucket(ns)]++;
+}
+
+// Latency at fraction q of commands, to
+// the precision of histogram buckets
+static uint64_t percentile(const struct cmd_stats *st, double q)
+{
+    uint64_t want = (uint64_t) ceil(q * st->count);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; b++) {
+        seen += st->hist[b];
+        if (seen >= want && seen > 0) {
+            uint64_t max = bucket_max(b);
+            return max < st->max_ns ? max : st->max_ns;
+        }
+    }
+    return st->max_ns;
+}
+
+static void print_stats(const char *name, const struct cmd_stats *st)
+{
+    printf("%-8s %9llu commands  %llu errors  mean %llu ns\n", name,
+           (unsigned long long) st->count, (unsigned long long) st->errors,
+           (unsigned long long) (st->sum_ns / st->count));
+    printf("         ns: p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+           (unsigned long long) percentile(st, 0.50),
+           (unsigned long long) percentile(st, 0.90),
+           (unsigned long long) percentile(st, 0.99),
+           (unsigned long long) percentile(st, 0.999),
+           (unsigned long long) st->max_ns);
+
+    // Histogram by power of 2
+    for (size_t group = 0; group < HIST_BUCKETS; group += 1u << HIST_SUB_BITS) {
+        uint64_t count = 0;
+        for (size_t b = group; b < group + (1u << HIST_SUB_BITS); b++) {
+            count += st->hist[b];
+        }
+        if (count == 0) {
+            continue;
+        }
+        double pct = 100.0 * count / st->count;
+        char bar[51];
+        size_t len = (size_t) (pct / 2);
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        printf("    %10llu - %-10llu ns %6.2f%% %s\n",
+               (unsigned long long) (group == 0 ? 0 : bucket_max(group - 1) + 1),
+               (unsigned long long) bucket_max(group + (1u << HIST_SUB_BITS) - 1),
+               pct, bar);
+    }
+}
+
+// Read file into a NUL terminated buffer.
+// Returns NULL on error.
+static char *read_file(const char *prefix, const char *ext, size_t *len)
+{
+    FILE *f = open_workload(prefix, ext, "r");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char *data = size >= 0 ? malloc(size + 1) : NULL;
+    if (!data || fread(data, 1, size, f) != (size_t) size) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    data[size] = '\0';
+    *len = size;
+    return data;
+}
+
+// Counts pairs of an lsdata page
+struct page {
+    long left;
+};
+
+static int count_pair(const char *key, const char *val, void *arg)
+{
+    (void) key;
+    (void) val;
+    struct page *pg = arg;
+    return --pg->left == 0;
+}
+
+// Run parsed command on dbm. Returns true on success.
+static bool run_command(db_mgr dbm, struct parse_object *prs)
+{
+    char buff[VAL_MAX];
+    switch (prs->cmd) {
+        case NEWTABLE:
+            return get_new_tbl(dbm, prs->tbl_name, prs->opt[0] ? prs->opt : NULL) > 0;
+        case USETABLE:
+            return use_tbl(dbm, prs->tbl_name) > 0;
+        case ADD:
+            return add(dbm, prs->key, prs->val) > 0;
+        case GET:
+            return get(buff, VAL_MAX, dbm, prs->key) > 0;
+        case DELETE:
+            return db_remove(dbm, prs->key) > 0;
+        case LSDATA: {
+            struct page pg = {prs->num};
+            size_t cursor = prs->cursor;
+            return scan_tbl(dbm, &cursor, count_pair, &pg) > 0;
+        }
+        case SAVE:
+            return save_curr_tbl(dbm) > 0;
+        default:
+            return false;
+    }
+}
+
+// Run commands of workload file through the db_manager
+// API, with latencies added to stats if not NULL.
+// Returns number of commands run, 0 on error.
+static size_t replay_lib(db_mgr dbm, const char *prefix, const char *ext,
+                         struct cmd_stats *stats)
+{
+    size_t len;
+    char *data = read_file(prefix, ext, &len);
+    if (!data) {
+        return 0;
+    }
+    size_t total = 0;
+    for (char *p = data; *p; p++) {
+        total += *p == '\n';
+    }
+
+    struct parse_object prs = {0};
+    size_t done = 0;
+    uint64_t start = now_ns();
+    char *line = data;
+    while (line < data + len) {
+        char *nl = strchr(line, '\n');
+        if (nl) {
+            *nl = '\0';
+        }
+        parse_input(line, &prs);
+        uint64_t t0 = now_ns();
+        bool ok = run_command(dbm, &prs);
+        uint64_t ns = now_ns() - t0;
+        if (stats) {
+            record_latency(&stats[prs.cmd], ns, ok);
+        }
+        done++;
+        if (stats && total >= RSS_SAMPLES && done % (total / RSS_SAMPLES) == 0) {
+            printf("  %7.2f s %10zu commands  rss %.1f MB\n",
+                   (now_ns() - start) / 1e9, done, rss_mb(getpid()));
+        }
+        line = nl ? nl + 1 : data + len;
+    }
+    free(data);
+    return done;
+}
+
+static int run_lib(const char *prefix)
+{
+    db_mgr dbm = init_db_mgr();
+    if (!dbm || replay_lib(dbm, prefix, "load", NULL) == 0) {
+        fprintf(stderr, "Cannot load %s.load\n", prefix);
+        return -2;
+    }
+    save_all_tbls(dbm);
+    destroy_db_mgr(dbm);
+
+    // Run starts from the saved tables
+    static struct cmd_stats stats[QUIT + 1];
+    dbm = init_db_mgr();
+    uint64_t start = now_ns();
+    size_t done = dbm ? replay_lib(dbm, prefix, "run", stats) : 0;
+    double secs = (now_ns() - start) / 1e9;
+    if (done == 0) {
+        fprintf(stderr, "Cannot run %s.run\n", prefix);
+        return -2;
+    }
+    save_all_tbls(dbm);
+    destroy_db_mgr(dbm);
+
+    printf("%zu commands in %.3f s: %.0f commands/s\n", done, secs, done / secs);
+    for (int cmd = 0; cmd <= QUIT; cmd++) {
+        if (stats[cmd].count > 0) {
+            print_stats(cmd == FAIL ? "invalid" : cmd_name(cmd), &stats[cmd]);
+        }
+    }
+    return 1;
+}
+
+// Run workload file with 'pairdb --batch', sampling
+// its memory. Returns number of commands run,
+// 0 on error.
+static size_t replay_bin(const char *pairdb, const char *prefix, const char *ext,
+                         bool sample)
+{
+    char path[PATH_BUFF];
+    snprintf(path, sizeof(path), "%s.%s", prefix, ext);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 0;
+    }
+    size_t total = 0;
+    int c;
+    while ((c = getc(f)) != EOF) {
+        total += c == '\n';
+    }
+    fclose(f);
+
+    fflush(stdout);
+    uint64_t start = now_ns();
+    pid_t child = fork();
+    if (child == 0) {
+        int in = open(path, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0 || dup2(in, STDIN_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0) {
+            _exit(127);
+        }
+        execl(pairdb, pairdb, "--batch", (char *) NULL);
+        _exit(127);
+    }
+    if (child < 0) {
+        return 0;
+    }
+
+    int status;
+    for (;;) {
+        usleep(RSS_INTERVAL_MS * 1000);
+        if (waitpid(child, &status, WNOHANG) != 0) {
+            break;
+        }
+        double mb = rss_mb(child);
+        if (sample && mb > 0) {
+            printf("  %7.2f s  rss %.1f MB\n", (now_ns() - start) / 1e9, mb);
+        }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "Cannot run %s\n", pairdb);
+        return 0;
+    }
+    if (sample) {
+        double secs = (now_ns() - start) / 1e9;
+        printf("%zu commands in %.3f s: %.0f commands/s\n", total, secs, total / secs);
+    }
+    return total;
+}
+
+static int run_bin(const char *prefix, const char *pairdb)
+{
+    if (replay_bin(pairdb, prefix, "load", false) == 0 ||
+        replay_bin(pairdb, prefix, "run", true) == 0) {
+        return -2;
+    }
+    return 1;
+}
+
+// Run replay in an empty temporary home directory
+static int replay(int argc, char **argv)
+{
+    if (argc < 3) {
+        return -1;
+    }
+    char tmpdir[] = "/tmp/pairdb-bench-XXXXXX";
+    if (!mkdtemp(tmpdir)) {
+        perror("mkdtemp");
+        return -2;
+    }
+    char datadir[sizeof(tmpdir) + 16];
+    snprintf(datadir, sizeof(datadir), "%s/pairdb-data", tmpdir);
+    mkdir(datadir, 0700);
+    setenv("HOME", tmpdir, 1);
+
+    int result;
+    if (strcmp(argv[1], "lib") == 0) {
+        result = run_lib(argv[2]);
+    }
+    else {
+        result = run_bin(argv[2], argc > 3 ? argv[3] : "build/pairdb");
+    }
+
+    char cmd[sizeof(tmpdir) + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpdir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Cannot remove %s\n", tmpdir);
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int result = -1;
+    if (argc > 1 && strcmp(argv[1], "gen") == 0) {
+        result = generate(argc, argv);
+    }
+    else if (argc > 1 && (strcmp(argv[1], "lib") == 0 || strcmp(argv[1], "bin") == 0)) {
+        result = replay(argc, argv);
+    }
+
+    if (result == -1) {
+        fprintf(stderr, "usage: bench_ycsb gen <a-f> <prefix> [records] [operations] "
+                        "[zipfian|uniform] [tables]\n"
+                        "       bench_ycsb lib <prefix>\n"
+                        "       bench_ycsb bin <prefix> [pairdb]\n");
+    }
+    return result == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Binary command stream.
+ *
+ * A length-prefixed form of the add, del, use, and
+ * newtbl commands for bulk loading (see binstream.h
+ * for the format). Records are decoded in place: the
+ * key and value of a decoded record point into the
+ * input buffer.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "binstream.h"
+
+/*---------------- Start - static/internal functions --------------*/
+
+static bool has_val(enum bin_op op)
+{
+    return op == BIN_ADD || op == BIN_NEWTBL;
+}
+
+static size_t varint_size(uint64_t n)
+{
+    size_t size = 1;
+    while (n >= 0x80) {
+        n >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// Read varint at p into n.
+// Returns number of bytes read, 0 if the varint
+// runs past end, -1 if it is longer than
+// BIN_VARINT_MAX bytes.
+static int get_varint(const unsigned char *p, const unsigned char *end, uint64_t *n)
+{
+    uint64_t result = 0;
+    for (int i = 0; i < BIN_VARINT_MAX; i++) {
+        if (p + i == end) {
+            return 0;
+        }
+        result |= (uint64_t) (p[i] & 0x7f) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            *n = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+size_t bin_record_size(enum bin_op op, size_t keylen, size_t vallen)
+{
+    size_t size = 1 + varint_size(keylen) + keylen;
+    if (has_val(op)) {
+        size += varint_size(vallen) + vallen;
+    }
+    return size;
+}
+
+size_t bin_put_varint(char *out, uint64_t n)
+{
+    size_t i = 0;
+    while (n >= 0x80) {
+        out[i++] = (char) (n | 0x80);
+        n >>= 7;
+    }
+    out[i++] = (char) n;
+    return i;
+}
+
+size_t bin_encode(char *out, enum bin_op op, const char *key, size_t keylen,
+                  const char *val, size_t vallen)
+{
+    char *p = out;
+    *p++ = (char) op;
+    p += bin_put_varint(p, keylen);
+    memcpy(p, key, keylen);
+    p += keylen;
+    if (has_val(op)) {
+        p += bin_put_varint(p, vallen);
+        memcpy(p, val, vallen);
+        p += vallen;
+    }
+    return p - out;
+}
+
+int bin_check_header(const char *buff, size_t len)
+{
+    size_t n = len < BIN_HEADER_LEN ? len : BIN_HEADER_LEN;
+    if (memcmp(buff, BIN_MAGIC, n) != 0) {
+        return -1;
+    }
+    return n == BIN_HEADER_LEN ? 1 : 0;
+}
+
+int bin_decode(const char *buff, size_t len, struct bin_record *rec, size_t *used)
+{
+    const unsigned char *p = (const unsigned char *) buff;
+    const unsigned char *end = p + len;
+    if (p == end) {
+        return 0;
+    }
+
+    rec->op = *p++;
+    if (rec->op < BIN_ADD || rec->op > BIN_NEWTBL) {
+        return -1;
+    }
+
+    uint64_t keylen;
+    int n = get_varint(p, end, &keylen);
+    if (n <= 0) {
+        return n;
+    }
+    p += n;
+    if (keylen > (uint64_t) (end - p)) {
+        return 0;
+    }
+    rec->key = (const char *) p;
+    rec->keylen = keylen;
+    p += keylen;
+
+    rec->val = NULL;
+    rec->vallen = 0;
+    if (has_val(rec->op)) {
+        uint64_t vallen;
+        n = get_varint(p, end, &vallen);
+        if (n <= 0) {
+            return n;
+        }
+        p += n;
+        if (vallen > (uint64_t) (end - p)) {
+            return 0;
+        }
+        rec->val = (const char *) p;
+        rec->vallen = vallen;
+        p += vallen;
+    }
+
+    *used = (const char *) p - buff;
+    return 1;
+}
+
+const char *bin_string(char *dst, size_t dsize, const char *src, size_t len)
+{
+    if (len >= dsize) {
+        return "field too long";
+    }
+    if (memchr(src, '\0', len)) {
+        return "NUL byte in field";
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return NULL;
+}
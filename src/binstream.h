@@ -0,0 +1,100 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Binary command stream.
+ *
+ * A length-prefixed form of the add, del, use, and
+ * newtbl commands for bulk loading. Keys and values
+ * are stored as they are, so no quoting or escaping
+ * is needed and a stream is read without scanning
+ * for separators.
+ *
+ * A stream starts with the 5 byte header "PDBS" and
+ * the version byte 1, followed by records:
+ *
+ *      op   keylen   key   [vallen   val]
+ *
+ * op is one byte (enum bin_op). keylen and vallen
+ * are unsigned LEB128 varints: 7 bits per byte, low
+ * bits first, with the high bit set on every byte
+ * but the last. key and val are keylen and vallen
+ * bytes. Only BIN_ADD and BIN_NEWTBL records have a
+ * value; the value of BIN_NEWTBL is the table engine,
+ * empty for the default. For BIN_USE and BIN_NEWTBL,
+ * the key is the table name.
+ *
+ * Tables hold keys and values as C strings, so a key
+ * or value holding a NUL byte is rejected when the
+ * record is run, as is one longer than pairdb accepts.
+ *
+ */
+
+#ifndef BINSTREAM_H
+#define BINSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BIN_MAGIC "PDBS\1"
+
+enum {
+    BIN_HEADER_LEN = 5,
+    BIN_VARINT_MAX = 10     // Longest varint of a 64-bit length
+};
+
+enum bin_op {
+    BIN_ADD = 1,
+    BIN_DEL = 2,
+    BIN_USE = 3,
+    BIN_NEWTBL = 4
+};
+
+// One decoded record. key and val point into the
+// decoded buffer and are not NUL terminated.
+struct bin_record {
+    enum bin_op op;
+    const char *key;
+    size_t keylen;
+    const char *val;        // NULL if op has no value
+    size_t vallen;
+};
+
+// Returns number of bytes of record encoded by
+// bin_encode for keylen and vallen
+size_t bin_record_size(enum bin_op op, size_t keylen, size_t vallen);
+
+// Write unsigned LEB128 varint of n to out, which
+// has room for BIN_VARINT_MAX bytes.
+// Returns number of bytes written.
+size_t bin_put_varint(char *out, uint64_t n);
+
+// Write record to out, which has room for
+// bin_record_size bytes. val is ignored if op has
+// no value. Returns number of bytes written.
+size_t bin_encode(char *out, enum bin_op op, const char *key, size_t keylen,
+                  const char *val, size_t vallen);
+
+// Returns 1 if buff starts with the stream header,
+// 0 if len is too short to tell, -1 otherwise.
+int bin_check_header(const char *buff, size_t len);
+
+// Decode record at start of buff (len bytes) into
+// rec and set used to its length in bytes.
+// Returns 0 if buff holds only part of a record,
+// -1 if the opcode or a varint is malformed,
+// 1 on success.
+int bin_decode(const char *buff, size_t len, struct bin_record *rec, size_t *used);
+
+// Copy key or value of len bytes at src to dst
+// (dsize bytes) as a string.
+// Returns description of error if it holds a NUL
+// byte or does not fit, NULL on success.
+const char *bin_string(char *dst, size_t dsize, const char *src, size_t len);
+
+#endif // BINSTREAM_H
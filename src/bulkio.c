@@ -0,0 +1,1115 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Bulk import and export of key-value pairs
+ * as text files.
+ *
+ * Lines are found with memchr and each line is parsed
+ * in place in the mapping; only the key and value are
+ * copied out. The number of rows is estimated from the
+ * line length of the first SAMPLE_BYTES of the file so
+ * the table can be sized once before the first insert.
+ *
+ * Export encodes each pair directly into an output
+ * buffer of EXPORT_BUFF_SIZE bytes, written with one
+ * write call when it fills. For sorted export, pairs
+ * are copied into large arena blocks; the array of
+ * pairs is split into one run per thread, the runs
+ * are sorted in parallel with qsort, and sorted runs
+ * are merged in pairs, also in parallel, until one
+ * run is left.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pairdbconst.h"
+#include "bulkio.h"
+#include "binstream.h"
+
+enum {
+    SAMPLE_BYTES = 1024 * 1024,  // Input scanned for row estimate
+    MEMBER_MAX = 16,             // Longest JSON member name compared
+    EXPORT_BUFF_SIZE = 4 * 1024 * 1024,
+    ARENA_BLOCK_SIZE = 4 * 1024 * 1024,
+    PAR_SORT_MIN = 65536,        // Fewer pairs are sorted on one thread
+    MAX_SORT_THREADS = 8
+};
+
+// Pair held for sorted export. prefix holds the
+// first 8 bytes of key so that most comparisons
+// do not read the key string.
+struct bulk_pair {
+    uint64_t prefix;
+    const char *key;
+    const char *val;
+};
+
+// Block of memory holding copied key and val strings
+struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    char data[];
+};
+
+struct export_obj {
+    int fd;
+    enum bulk_format fmt;
+    char *buff;
+    size_t used;
+    bool failed;
+    struct export_stats stats;
+    struct timespec start;
+
+    // Sorted export only
+    bool sorted;
+    unsigned nthreads;
+    struct bulk_pair *pairs;
+    size_t npairs;
+    size_t pairs_cap;
+    struct arena_block *arena;
+};
+
+// Sort or merge of part of a pair array
+struct sort_task {
+    struct bulk_pair *src;
+    struct bulk_pair *dst;
+    size_t lo;
+    size_t mid;
+    size_t hi;
+};
+
+// Scan position within one line
+struct scan {
+    const char *p;
+    const char *end;
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Append len bytes of src to dst (dsize bytes)
+// holding *n bytes. Returns false if the result
+// and its NUL char do not fit.
+static bool append(char *dst, size_t *n, size_t dsize, const char *src, size_t len)
+{
+    if (*n + len >= dsize) {
+        return false;
+    }
+    memcpy(dst + *n, src, len);
+    *n += len;
+    return true;
+}
+
+// Estimate number of lines in buff from the
+// average line length of its first bytes
+static size_t estimate_rows(const char *buff, size_t len)
+{
+    size_t sample = len < SAMPLE_BYTES ? len : SAMPLE_BYTES;
+    size_t lines = 0;
+    const char *p = buff;
+    const char *end = buff + sample;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    if (lines == 0) {
+        return 1;
+    }
+    return (size_t) ((double) len / sample * lines) + 1;
+}
+
+// Estimate number of records of binary stream
+// buff from the average size of the records in
+// its first bytes
+static size_t estimate_records(const char *buff, size_t len)
+{
+    size_t sample = len < SAMPLE_BYTES ? len : SAMPLE_BYTES;
+    size_t records = 0;
+    size_t pos = BIN_HEADER_LEN;
+    if (sample <= pos) {
+        return 1;
+    }
+    struct bin_record rec;
+    size_t used;
+    while (bin_decode(buff + pos, sample - pos, &rec, &used) == 1) {
+        records++;
+        pos += used;
+    }
+    if (records == 0) {
+        return 1;
+    }
+    return (size_t) ((double) len / pos * records) + 1;
+}
+
+// Parse one CSV field into dst (dsize bytes),
+// stopping at ',' or end of line.
+// Returns NULL on success, or description of error.
+static const char *csv_field(struct scan *sc, char *dst, size_t dsize)
+{
+    size_t n = 0;
+    const char *p = sc->p;
+
+    if (p < sc->end && *p == '"') {
+        p++;
+        while (true) {
+            const char *q = memchr(p, '"', sc->end - p);
+            if (!q) {
+                return "unterminated quote";
+            }
+            if (!append(dst, &n, dsize, p, q - p)) {
+                return "field too long";
+            }
+            p = q + 1;
+            // "" is a quote character within the field
+            if (p < sc->end && *p == '"') {
+                if (!append(dst, &n, dsize, p, 1)) {
+                    return "field too long";
+                }
+                p++;
+                continue;
+            }
+            break;
+        }
+        if (p < sc->end && *p != ',') {
+            return "text after closing quote";
+        }
+    }
+    else {
+        const char *q = memchr(p, ',', sc->end - p);
+        if (!q) {
+            q = sc->end;
+        }
+        if (!append(dst, &n, dsize, p, q - p)) {
+            return "field too long";
+        }
+        p = q;
+    }
+
+    dst[n] = '\0';
+    sc->p = p;
+    return NULL;
+}
+
+static const char *parse_csv(struct scan *sc, char *key, char *val)
+{
+    const char *err = csv_field(sc, key, KEY_MAX);
+    if (err) {
+        return err;
+    }
+    if (sc->p == sc->end) {
+        return "expected 2 fields";
+    }
+    sc->p++;
+
+    err = csv_field(sc, val, VAL_MAX);
+    if (err) {
+        return err;
+    }
+    if (sc->p != sc->end) {
+        return "expected 2 fields";
+    }
+    return NULL;
+}
+
+static const char *parse_tsv(struct scan *sc, char *key, char *val)
+{
+    const char *tab = memchr(sc->p, '\t', sc->end - sc->p);
+    if (!tab || memchr(tab + 1, '\t', sc->end - tab - 1)) {
+        return "expected 2 fields";
+    }
+
+    size_t n = 0;
+    if (!append(key, &n, KEY_MAX, sc->p, tab - sc->p)) {
+        return "field too long";
+    }
+    key[n] = '\0';
+
+    n = 0;
+    if (!append(val, &n, VAL_MAX, tab + 1, sc->end - tab - 1)) {
+        return "field too long";
+    }
+    val[n] = '\0';
+    return NULL;
+}
+
+static void skip_ws(struct scan *sc)
+{
+    while (sc->p < sc->end &&
+           (*sc->p == ' ' || *sc->p == '\t' || *sc->p == '\r')) {
+        sc->p++;
+    }
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Read 4 hex digits of \u escape at p.
+// Returns -1 if they are not valid.
+static long read_hex4(const char *p, const char *end)
+{
+    if (end - p < 4) {
+        return -1;
+    }
+    long cp = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(p[i]);
+        if (d < 0) {
+            return -1;
+        }
+        cp = cp * 16 + d;
+    }
+    return cp;
+}
+
+// Encode code point as UTF-8 into out.
+// Returns number of bytes written.
+static size_t utf8_encode(long cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char) (0xc0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char) (0xe0 | (cp >> 12));
+        out[1] = (char) (0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char) (0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char) (0xf0 | (cp >> 18));
+    out[1] = (char) (0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char) (0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char) (0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Parse JSON string at sc->p into dst (dsize bytes).
+// Returns NULL on success, or description of error.
+static const char *json_string(struct scan *sc, char *dst, size_t dsize)
+{
+    if (sc->p >= sc->end || *sc->p != '"') {
+        return "expected string";
+    }
+    const char *p = sc->p + 1;
+    size_t n = 0;
+
+    while (true) {
+        // Copy run of plain characters at once
+        const char *q = p;
+        while (q < sc->end && *q != '"' && *q != '\\') {
+            q++;
+        }
+        if (!append(dst, &n, dsize, p, q - p)) {
+            return "field too long";
+        }
+        if (q >= sc->end) {
+            return "unterminated string";
+        }
+        p = q + 1;
+        if (*q == '"') {
+            break;
+        }
+
+        // Escape sequence
+        if (p >= sc->end) {
+            return "unterminated string";
+        }
+        char c;
+        switch (*p++) {
+            case '"': c = '"'; break;
+            case '\\': c = '\\'; break;
+            case '/': c = '/'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                long cp = read_hex4(p, sc->end);
+                if (cp <= 0 || (cp >= 0xdc00 && cp <= 0xdfff)) {
+                    return "invalid escape";
+                }
+                p += 4;
+                // Surrogate pair
+                if (cp >= 0xd800 && cp <= 0xdbff) {
+                    long lo = -1;
+                    if (sc->end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        lo = read_hex4(p + 2, sc->end);
+                    }
+                    if (lo < 0xdc00 || lo > 0xdfff) {
+                        return "invalid escape";
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    p += 6;
+                }
+                char utf8[4];
+                if (!append(dst, &n, dsize, utf8, utf8_encode(cp, utf8))) {
+                    return "field too long";
+                }
+                continue;
+            }
+            default:
+                return "invalid escape";
+        }
+        if (!append(dst, &n, dsize, &c, 1)) {
+            return "field too long";
+        }
+    }
+
+    dst[n] = '\0';
+    sc->p = p;
+    return NULL;
+}
+
+// Skip JSON number, true, false, or null.
+// Objects and arrays are not accepted.
+static const char *json_skip_scalar(struct scan *sc)
+{
+    const char *start = sc->p;
+    while (sc->p < sc->end && *sc->p != ',' && *sc->p != '}' &&
+           *sc->p != ' ' && *sc->p != '\t' && *sc->p != '\r') {
+        if (*sc->p == '{' || *sc->p == '[' || *sc->p == '"') {
+            return "unsupported value";
+        }
+        sc->p++;
+    }
+    return sc->p == start ? "expected value" : NULL;
+}
+
+static const char *parse_jsonl(struct scan *sc, char *key, char *val)
+{
+    bool has_key = false;
+    bool has_val = false;
+
+    skip_ws(sc);
+    if (sc->p >= sc->end || *sc->p != '{') {
+        return "expected object";
+    }
+    sc->p++;
+    skip_ws(sc);
+
+    if (sc->p < sc->end && *sc->p == '}') {
+        sc->p++;
+    }
+    else {
+        while (true) {
+            char name[MEMBER_MAX];
+            const char *err = json_string(sc, name, MEMBER_MAX);
+            if (err) {
+                // Long names are never key or val
+                if (strcmp(err, "field too long") != 0) {
+                    return err;
+                }
+                char skip[VAL_MAX];
+                if ((err = json_string(sc, skip, VAL_MAX)) != NULL) {
+                    return err;
+                }
+                name[0] = '\0';
+            }
+
+            skip_ws(sc);
+            if (sc->p >= sc->end || *sc->p != ':') {
+                return "expected ':'";
+            }
+            sc->p++;
+            skip_ws(sc);
+
+            if (strcmp(name, "key") == 0) {
+                err = json_string(sc, key, KEY_MAX);
+                has_key = true;
+            }
+            else if (strcmp(name, "val") == 0) {
+                err = json_string(sc, val, VAL_MAX);
+                has_val = true;
+            }
+            else if (sc->p < sc->end && *sc->p == '"') {
+                char skip[VAL_MAX];
+                err = json_string(sc, skip, VAL_MAX);
+            }
+            else {
+                err = json_skip_scalar(sc);
+            }
+            if (err) {
+                return err;
+            }
+
+            skip_ws(sc);
+            if (sc->p < sc->end && *sc->p == ',') {
+                sc->p++;
+                skip_ws(sc);
+                continue;
+            }
+            if (sc->p < sc->end && *sc->p == '}') {
+                sc->p++;
+                break;
+            }
+            return "expected ',' or '}'";
+        }
+    }
+
+    skip_ws(sc);
+    if (sc->p != sc->end) {
+        return "text after object";
+    }
+    if (!has_key) {
+        return "missing key";
+    }
+    if (!has_val) {
+        return "missing val";
+    }
+    return NULL;
+}
+
+static void report_bad_row(const struct import_sink *sink, struct import_stats *stats,
+                           size_t lineno, const char *reason)
+{
+    stats->malformed++;
+    if (sink->bad_row) {
+        sink->bad_row(sink->arg, lineno, reason);
+    }
+}
+
+// Pass pair to sink.
+// Returns -2 if sink returned an error, 1 otherwise.
+static int add_row(const struct import_sink *sink, struct import_stats *stats,
+                   const char *key, const char *val)
+{
+    int put_stat = sink->row(sink->arg, key, val);
+    if (put_stat == -1) {
+        stats->duplicates++;
+    }
+    else if (put_stat < 0) {
+        return -2;
+    }
+    else {
+        stats->added++;
+    }
+    return 1;
+}
+
+// Import text rows of buff (len bytes), one per line,
+// parsed by parse_row.
+// Returns -2 if sink returned an error, 1 on success.
+static int import_lines(const char *buff, size_t len,
+                        const char *(*parse_row)(struct scan *, char *, char *),
+                        const struct import_sink *sink, struct import_stats *stats)
+{
+    char key[KEY_MAX];
+    char val[VAL_MAX];
+    const char *p = buff;
+    const char *end = buff + len;
+    size_t lineno = 0;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end;
+        struct scan sc = {p, eol};
+        p = nl ? nl + 1 : end;
+        lineno++;
+
+        if (sc.end > sc.p && sc.end[-1] == '\r') {
+            sc.end--;
+        }
+        if (sc.end == sc.p) {
+            continue;
+        }
+        stats->rows++;
+
+        const char *err = parse_row(&sc, key, val);
+        if (!err && key[0] == '\0') {
+            err = "empty key";
+        }
+        if (err) {
+            report_bad_row(sink, stats, lineno, err);
+            continue;
+        }
+        if (add_row(sink, stats, key, val) < 0) {
+            return -2;
+        }
+    }
+    return 1;
+}
+
+// Import add records of binary command stream buff
+// (len bytes). Other records are reported and
+// skipped; a malformed or truncated record ends
+// the import.
+// Returns -2 if sink returned an error, 1 on success.
+static int import_records(const char *buff, size_t len,
+                          const struct import_sink *sink, struct import_stats *stats)
+{
+    if (bin_check_header(buff, len) != 1) {
+        report_bad_row(sink, stats, 1, "not a binary command stream");
+        return 1;
+    }
+
+    char key[KEY_MAX];
+    char val[VAL_MAX];
+    size_t pos = BIN_HEADER_LEN;
+    size_t recno = 0;
+    while (pos < len) {
+        struct bin_record rec;
+        size_t used;
+        int dec_stat = bin_decode(buff + pos, len - pos, &rec, &used);
+        recno++;
+        stats->rows++;
+        if (dec_stat <= 0) {
+            report_bad_row(sink, stats, recno, dec_stat < 0 ? "malformed record" :
+                                                              "truncated record");
+            return 1;
+        }
+        pos += used;
+
+        const char *err = NULL;
+        if (rec.op != BIN_ADD) {
+            err = "not an add record";
+        }
+        else if (rec.keylen == 0) {
+            err = "empty key";
+        }
+        if (!err) {
+            err = bin_string(key, KEY_MAX, rec.key, rec.keylen);
+        }
+        if (!err) {
+            err = bin_string(val, VAL_MAX, rec.val, rec.vallen);
+        }
+        if (err) {
+            report_bad_row(sink, stats, recno, err);
+            continue;
+        }
+        if (add_row(sink, stats, key, val) < 0) {
+            return -2;
+        }
+    }
+    return 1;
+}
+
+static double elapsed_secs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Write all of buff to fd.
+// Returns -1 on failure, 1 on success.
+static int write_all(int fd, const char *buff, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buff, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buff += n;
+        len -= (size_t) n;
+    }
+    return 1;
+}
+
+static void flush_buff(exporter ex)
+{
+    if (ex->used > 0 && write_all(ex->fd, ex->buff, ex->used) < 0) {
+        ex->failed = true;
+    }
+    ex->stats.bytes += ex->used;
+    ex->used = 0;
+}
+
+// Copy string to out as CSV field, quoted only if
+// it holds a comma, quote, or newline character.
+// Returns end of field in out.
+static char *put_csv(char *out, const char *str)
+{
+    size_t len = strlen(str);
+    if (!strpbrk(str, ",\"\r\n")) {
+        memcpy(out, str, len);
+        return out + len;
+    }
+
+    *out++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] == '"') {
+            *out++ = '"';
+        }
+        *out++ = str[i];
+    }
+    *out++ = '"';
+    return out;
+}
+
+// Copy string to out as JSON string.
+// Returns end of string in out.
+static char *put_json(char *out, const char *str)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    *out++ = '"';
+    for (const unsigned char *p = (const unsigned char *) str; *p; p++) {
+        switch (*p) {
+            case '"': *out++ = '\\'; *out++ = '"'; break;
+            case '\\': *out++ = '\\'; *out++ = '\\'; break;
+            case '\n': *out++ = '\\'; *out++ = 'n'; break;
+            case '\r': *out++ = '\\'; *out++ = 'r'; break;
+            case '\t': *out++ = '\\'; *out++ = 't'; break;
+            default:
+                if (*p < 0x20) {
+                    memcpy(out, "\\u00", 4);
+                    out[4] = HEX[*p >> 4];
+                    out[5] = HEX[*p & 0xf];
+                    out += 6;
+                }
+                else {
+                    *out++ = (char) *p;
+                }
+        }
+    }
+    *out++ = '"';
+    return out;
+}
+
+// Encode pair into output buffer
+static void write_pair(exporter ex, const char *key, const char *val)
+{
+    if (EXPORT_BUFF_SIZE - ex->used < BULK_ROW_MAX) {
+        flush_buff(ex);
+    }
+
+    char *out = bulk_encode_row(ex->buff + ex->used, ex->fmt, key, val);
+    if (!out) {
+        ex->stats.skipped++;
+        return;
+    }
+    ex->used = out - ex->buff;
+    ex->stats.rows++;
+}
+
+// Copy str into exporter arena.
+// Returns NULL on memory allocation error.
+static const char *arena_copy(exporter ex, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    struct arena_block *blk = ex->arena;
+    if (!blk || ARENA_BLOCK_SIZE - blk->used < len) {
+        blk = malloc(sizeof(struct arena_block) + ARENA_BLOCK_SIZE);
+        if (!blk) {
+            return NULL;
+        }
+        blk->used = 0;
+        blk->next = ex->arena;
+        ex->arena = blk;
+    }
+
+    char *copy = blk->data + blk->used;
+    memcpy(copy, str, len);
+    blk->used += len;
+    return copy;
+}
+
+// First 8 bytes of key, zero padded, as a big-endian
+// integer - orders keys as strcmp does
+static uint64_t key_prefix(const char *key)
+{
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = *key ? (unsigned char) *key++ : 0;
+        prefix = (prefix << 8) | c;
+    }
+    return prefix;
+}
+
+// Keep copy of pair for sorted export.
+// Returns -2 on memory allocation error, 1 on success.
+static int keep_pair(exporter ex, const char *key, const char *val)
+{
+    if (ex->npairs == ex->pairs_cap) {
+        size_t cap = ex->pairs_cap ? ex->pairs_cap * 2 : 1024;
+        struct bulk_pair *pairs = realloc(ex->pairs, cap * sizeof(struct bulk_pair));
+        if (!pairs) {
+            return -2;
+        }
+        ex->pairs = pairs;
+        ex->pairs_cap = cap;
+    }
+
+    struct bulk_pair *bp = &ex->pairs[ex->npairs];
+    bp->prefix = key_prefix(key);
+    bp->key = arena_copy(ex, key);
+    bp->val = bp->key ? arena_copy(ex, val) : NULL;
+    if (!bp->val) {
+        return -2;
+    }
+    ex->npairs++;
+    return 1;
+}
+
+static int cmp_pairs(const void *a, const void *b)
+{
+    const struct bulk_pair *pa = a;
+    const struct bulk_pair *pb = b;
+    if (pa->prefix != pb->prefix) {
+        return pa->prefix < pb->prefix ? -1 : 1;
+    }
+    return strcmp(pa->key, pb->key);
+}
+
+// Sort src[lo, hi) in place
+static void *sort_worker(void *arg)
+{
+    struct sort_task *task = arg;
+    qsort(task->src + task->lo, task->hi - task->lo,
+          sizeof(struct bulk_pair), cmp_pairs);
+    return NULL;
+}
+
+// Merge sorted src[lo, mid) and src[mid, hi)
+// into dst[lo, hi)
+static void *merge_worker(void *arg)
+{
+    struct sort_task *task = arg;
+    struct bulk_pair *src = task->src;
+    struct bulk_pair *out = task->dst + task->lo;
+    size_t i = task->lo;
+    size_t j = task->mid;
+
+    while (i < task->mid && j < task->hi) {
+        if (cmp_pairs(&src[j], &src[i]) < 0) {
+            *out++ = src[j++];
+        }
+        else {
+            *out++ = src[i++];
+        }
+    }
+    memcpy(out, src + i, (task->mid - i) * sizeof(struct bulk_pair));
+    out += task->mid - i;
+    memcpy(out, src + j, (task->hi - j) * sizeof(struct bulk_pair));
+    return NULL;
+}
+
+// Run fn on each task, one thread per task. Tasks
+// whose thread cannot be started run on this thread.
+static void run_tasks(struct sort_task *tasks, size_t ntasks, void *(*fn)(void *))
+{
+    pthread_t threads[MAX_SORT_THREADS];
+    bool started[MAX_SORT_THREADS];
+
+    for (size_t i = 0; i < ntasks; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, &tasks[i]) == 0;
+        if (!started[i]) {
+            fn(&tasks[i]);
+        }
+    }
+    for (size_t i = 0; i < ntasks; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+// Sort pairs by key with up to nthreads threads
+static void sort_pairs(struct bulk_pair *pairs, size_t n, unsigned nthreads)
+{
+    // Number of runs is a power of 2 so that
+    // runs can be merged in pairs
+    size_t runs = 1;
+    if (n >= PAR_SORT_MIN) {
+        while (runs * 2 <= nthreads && runs * 2 <= MAX_SORT_THREADS) {
+            runs *= 2;
+        }
+    }
+
+    struct bulk_pair *tmp = runs > 1 ? malloc(n * sizeof(struct bulk_pair)) : NULL;
+    if (!tmp) {
+        qsort(pairs, n, sizeof(struct bulk_pair), cmp_pairs);
+        return;
+    }
+
+    struct sort_task tasks[MAX_SORT_THREADS];
+    for (size_t r = 0; r < runs; r++) {
+        tasks[r] = (struct sort_task) {pairs, NULL, n * r / runs, 0, n * (r + 1) / runs};
+    }
+    run_tasks(tasks, runs, sort_worker);
+
+    struct bulk_pair *src = pairs;
+    struct bulk_pair *dst = tmp;
+    for (size_t width = 1; width < runs; width *= 2) {
+        size_t ntasks = 0;
+        for (size_t r = 0; r < runs; r += 2 * width) {
+            tasks[ntasks++] = (struct sort_task) {
+                src, dst, n * r / runs, n * (r + width) / runs, n * (r + 2 * width) / runs
+            };
+        }
+        run_tasks(tasks, ntasks, merge_worker);
+
+        struct bulk_pair *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != pairs) {
+        memcpy(pairs, src, n * sizeof(struct bulk_pair));
+    }
+    free(tmp);
+}
+
+static void free_exporter(exporter ex)
+{
+    while (ex->arena) {
+        struct arena_block *next = ex->arena->next;
+        free(ex->arena);
+        ex->arena = next;
+    }
+    free(ex->pairs);
+    free(ex->buff);
+    free(ex);
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+enum bulk_format find_bulk_format(const char *name, const char *path)
+{
+    if (!name || name[0] == '\0') {
+        const char *ext = path ? strrchr(path, '.') : NULL;
+        if (ext && strcmp(ext, ".tsv") == 0) {
+            return BULK_TSV;
+        }
+        if (ext && (strcmp(ext, ".jsonl") == 0 || strcmp(ext, ".json") == 0)) {
+            return BULK_JSONL;
+        }
+        if (ext && strcmp(ext, ".bin") == 0) {
+            return BULK_BINARY;
+        }
+        return BULK_CSV;
+    }
+
+    if (strcmp(name, "csv") == 0) {
+        return BULK_CSV;
+    }
+    if (strcmp(name, "tsv") == 0) {
+        return BULK_TSV;
+    }
+    if (strcmp(name, "jsonl") == 0) {
+        return BULK_JSONL;
+    }
+    if (strcmp(name, "binary") == 0) {
+        return BULK_BINARY;
+    }
+    return BULK_UNKNOWN;
+}
+
+char *bulk_encode_row(char *out, enum bulk_format fmt, const char *key, const char *val)
+{
+    switch (fmt) {
+        case BULK_BINARY:
+            return out + bin_encode(out, BIN_ADD, key, strlen(key), val, strlen(val));
+        case BULK_CSV:
+            out = put_csv(out, key);
+            *out++ = ',';
+            out = put_csv(out, val);
+            break;
+        case BULK_TSV: {
+            if (strpbrk(key, "\t\r\n") || strpbrk(val, "\t\r\n")) {
+                return NULL;
+            }
+            size_t keylen = strlen(key);
+            size_t vallen = strlen(val);
+            memcpy(out, key, keylen);
+            out[keylen] = '\t';
+            memcpy(out + keylen + 1, val, vallen);
+            out += keylen + 1 + vallen;
+            break;
+        }
+        default:
+            memcpy(out, "{\"key\":", 7);
+            out = put_json(out + 7, key);
+            memcpy(out, ",\"val\":", 7);
+            out = put_json(out + 7, val);
+            *out++ = '}';
+            break;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+int import_file(const char *path, enum bulk_format fmt,
+                const struct import_sink *sink, struct import_stats *stats)
+{
+    struct import_stats local;
+    if (!stats) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    if (!path || !sink || !sink->row) {
+        return -1;
+    }
+
+    const char *(*parse_row)(struct scan *, char *, char *);
+    switch (fmt) {
+        case BULK_CSV: parse_row = parse_csv; break;
+        case BULK_TSV: parse_row = parse_tsv; break;
+        case BULK_JSONL: parse_row = parse_jsonl; break;
+        case BULK_BINARY: parse_row = NULL; break;
+        default: return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t) st.st_size;
+    stats->bytes = len;
+    if (len == 0) {
+        close(fd);
+        stats->secs = elapsed_secs(&start);
+        return 1;
+    }
+
+    const char *buff = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buff == MAP_FAILED) {
+        return -1;
+    }
+    madvise((void *) buff, len, MADV_SEQUENTIAL);
+
+    int result = 1;
+    size_t rows = fmt == BULK_BINARY ? estimate_records(buff, len) : estimate_rows(buff, len);
+    if (sink->reserve && sink->reserve(sink->arg, rows) < 0) {
+        result = -2;
+    }
+
+    if (result > 0 && fmt == BULK_BINARY) {
+        result = import_records(buff, len, sink, stats);
+    }
+    else if (result > 0) {
+        result = import_lines(buff, len, parse_row, sink, stats);
+    }
+
+    munmap((void *) buff, len);
+    stats->secs = elapsed_secs(&start);
+    return result;
+}
+
+exporter export_open(const char *path, enum bulk_format fmt,
+                     bool sorted, unsigned nthreads)
+{
+    if (!path || fmt == BULK_UNKNOWN) {
+        return NULL;
+    }
+
+    exporter ex = calloc(1, sizeof(struct export_obj));
+    if (!ex) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ex->start);
+    ex->fmt = fmt;
+    ex->sorted = sorted;
+    ex->nthreads = nthreads;
+
+    ex->buff = malloc(EXPORT_BUFF_SIZE);
+    if (!ex->buff) {
+        free(ex);
+        return NULL;
+    }
+
+    ex->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ex->fd < 0) {
+        free(ex->buff);
+        free(ex);
+        return NULL;
+    }
+    if (fmt == BULK_BINARY) {
+        memcpy(ex->buff, BIN_MAGIC, BIN_HEADER_LEN);
+        ex->used = BIN_HEADER_LEN;
+    }
+    return ex;
+}
+
+int export_row(exporter ex, const char *key, const char *val)
+{
+    if (!ex || ex->failed) {
+        return -2;
+    }
+
+    if (ex->sorted) {
+        if (keep_pair(ex, key, val) < 0) {
+            ex->failed = true;
+        }
+    }
+    else {
+        write_pair(ex, key, val);
+    }
+    return ex->failed ? -2 : 1;
+}
+
+int export_close(exporter ex, struct export_stats *stats)
+{
+    if (!ex) {
+        return -1;
+    }
+
+    if (ex->sorted && !ex->failed) {
+        sort_pairs(ex->pairs, ex->npairs, ex->nthreads);
+        for (size_t i = 0; i < ex->npairs && !ex->failed; i++) {
+            write_pair(ex, ex->pairs[i].key, ex->pairs[i].val);
+        }
+    }
+    if (!ex->failed) {
+        flush_buff(ex);
+    }
+    if (close(ex->fd) < 0) {
+        ex->failed = true;
+    }
+
+    int result = ex->failed ? -1 : 1;
+    ex->stats.secs = elapsed_secs(&ex->start);
+    if (stats) {
+        *stats = ex->stats;
+    }
+    free_exporter(ex);
+    return result;
+}
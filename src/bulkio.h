@@ -0,0 +1,140 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Bulk import and export of key-value pairs
+ * as text files.
+ *
+ * The input file is memory mapped and scanned one
+ * line at a time. Each line holds one key-value pair:
+ *      csv     key,val - fields may be enclosed in
+ *              double quotes, with "" for a quote
+ *              character inside a quoted field
+ *      tsv     key<TAB>val - no quoting
+ *      jsonl   {"key": "...", "val": "..."} - other
+ *              members are ignored
+ *
+ * The binary format is a binary command stream of
+ * add records (see binstream.h) and holds keys and
+ * values as they are. It is read record by record
+ * instead of by line; a malformed or truncated record
+ * ends the import.
+ *
+ * Empty lines are skipped. A line that cannot be
+ * parsed, has an empty key, or has a key or value
+ * longer than pairdb accepts is reported and skipped;
+ * the import goes on with the next line.
+ *
+ * Export writes the same formats, quoting and
+ * escaping fields as needed, through a large output
+ * buffer. TSV has no escaping, so pairs holding a tab
+ * or newline character are skipped. Sorted output is
+ * sorted by key with a parallel merge sort.
+ *
+ */
+
+#ifndef BULKIO_H
+#define BULKIO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pairdbconst.h"
+
+enum {
+    BULK_ROW_MAX = (KEY_MAX + VAL_MAX) * 6 + 32     // Longest escaped or binary row
+};
+
+enum bulk_format {
+    BULK_UNKNOWN,
+    BULK_CSV,
+    BULK_TSV,
+    BULK_JSONL,
+    BULK_BINARY
+};
+
+struct import_stats {
+    size_t rows;            // Non-empty lines or records read
+    size_t added;           // Pairs added to the table
+    size_t duplicates;      // Rows whose key already exists
+    size_t malformed;       // Rows reported and skipped
+    size_t bytes;           // Size of input file
+    double secs;            // Time taken
+};
+
+struct export_stats {
+    size_t rows;            // Pairs written
+    size_t skipped;         // Pairs the format cannot hold
+    size_t bytes;           // Bytes written
+    double secs;            // Time taken
+};
+
+// exporter object handle
+typedef struct export_obj *exporter;
+
+// Receives rows from import_file
+struct import_sink {
+    // Called once before the first row with an
+    // estimate of the number of rows. May be NULL.
+    // Returns -2 on memory allocation error, 1 on success.
+    int (*reserve)(void *arg, size_t rows);
+
+    // Add one pair. Returns -1 if key already
+    // exists, -2 on error (stops the import),
+    // 1 on success.
+    int (*row)(void *arg, const char *key, const char *val);
+
+    // Called for each malformed row with its line
+    // or record number (from 1) and a description.
+    // May be NULL.
+    void (*bad_row)(void *arg, size_t lineno, const char *reason);
+
+    void *arg;
+};
+
+// Returns format named name ("csv", "tsv", "jsonl",
+// or "binary"). If name is NULL or empty, the format is
+// chosen from the extension of path, and is csv if
+// the extension is not known.
+// Returns BULK_UNKNOWN if name is not a known format.
+enum bulk_format find_bulk_format(const char *name, const char *path);
+
+// Encode pair of up to KEY_MAX and VAL_MAX bytes as
+// one row of format fmt, as written by export, into
+// out, which must have room for BULK_ROW_MAX bytes.
+// Returns end of row in out, or NULL if the format
+// cannot hold the pair - tsv with a tab or newline.
+char *bulk_encode_row(char *out, enum bulk_format fmt, const char *key, const char *val);
+
+// Read all rows of file at path in format fmt
+// and pass them to sink. stats may be NULL.
+// Returns -1 if file cannot be opened or read,
+// -2 if sink returned an error, 1 on success.
+int import_file(const char *path, enum bulk_format fmt,
+                const struct import_sink *sink, struct import_stats *stats);
+
+// Create or truncate file at path for export in
+// format fmt. If sorted is true, pairs are kept in
+// memory and written in key order by export_close,
+// sorted with up to nthreads threads.
+// Returns NULL on file or memory allocation error.
+exporter export_open(const char *path, enum bulk_format fmt,
+                     bool sorted, unsigned nthreads);
+
+// Add one pair to export. key and val are copied.
+// Returns -2 on file or memory allocation error,
+// 1 on success.
+int export_row(exporter ex, const char *key, const char *val);
+
+// Write remaining pairs, close file, and free
+// exporter. stats may be NULL.
+// Returns -1 on file or memory allocation error,
+// 1 on success.
+int export_close(exporter ex, struct export_stats *stats);
+
+#endif // BULKIO_H
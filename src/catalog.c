@@ -0,0 +1,556 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Table catalog implementation.
+ *
+ * The index file is a hash table on disk, used in
+ * place through a shared memory mapping:
+ *      header      page 0 - struct cat_header
+ *      slots       nslots records of SLOT_SIZE bytes,
+ *                  struct cat_slot, from HEADER_SIZE
+ *
+ * Table names are placed by linear probing from the
+ * FNV-1a hash of the name. A removed record is marked
+ * SLOT_DELETED so probing continues past it. When used
+ * and deleted slots reach LOAD_FACT_LIM of the table,
+ * the index is rewritten to a temporary file, doubled
+ * if more than half the used slots are live records,
+ * and renamed over the index file.
+ *
+ * Each record is written with its state byte last.
+ * Changes reach the disk when the operating system
+ * writes back the mapped pages, or on catalog_sync.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "catalog.h"
+#include "stringutil.h"
+
+/*
+ *
+ * Values for Fowler/Noll/Vo hash function
+ * In public domain - see links
+ * https://github.com/lcn2/fnv/tree/master
+ * https://github.com/lcn2/fnv/blob/master/LICENSE
+ * https://github.com/lcn2/fnv/blob/master/hash_32a.c
+ *
+ */
+
+static const uint32_t HVAL_INIT = 0x811c9dc5;
+static const uint32_t FNV_PRIME = 0x01000193;
+
+static const char FILE_MAGIC[8] = "PDBCAT01";
+static const uint32_t FILE_VERSION = 1;
+static const char *TMP_FILE_EXT = ".tmp";
+
+static const double LOAD_FACT_LIM = 0.70;
+
+enum {
+    HEADER_SIZE = 4096,
+    SLOT_SIZE = 128,
+    INIT_SLOTS = 64,
+    FNAME_DIGITS = 10
+};
+
+enum slot_state {
+    SLOT_EMPTY = 0,
+    SLOT_USED = 1,
+    SLOT_DELETED = 2
+};
+
+
+/*------------------ Data structures -----------------*/
+
+struct cat_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotsize;
+    uint64_t nslots;
+    uint64_t used;          // Slots holding records
+    uint64_t deleted;       // Slots marked SLOT_DELETED
+    uint64_t next_id;       // Next file name number
+};
+
+struct cat_slot {
+    uint8_t state;
+    uint8_t pad[3];
+    uint32_t hash;
+    uint64_t entries;
+    uint64_t bytes;
+    int64_t mtime;
+    char name[TBL_NAME_MAX];
+    char fname[CAT_FNAME_MAX];
+    char engine[CAT_ENGINE_MAX];
+    char reserved[SLOT_SIZE - 32 - TBL_NAME_MAX - CAT_FNAME_MAX - CAT_ENGINE_MAX];
+};
+
+_Static_assert(sizeof(struct cat_slot) == SLOT_SIZE, "catalog slot size");
+_Static_assert(sizeof(struct cat_header) <= HEADER_SIZE, "catalog header size");
+
+struct catalog_obj {
+    char *path;
+    int fd;
+    char *map;
+    size_t maplen;
+    struct cat_header *hdr;
+    struct cat_slot *slots;
+};
+
+
+/*---------------- Start - static/internal functions --------------*/
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hval = HVAL_INIT;
+    for (const unsigned char *p = (const unsigned char *) name; *p; p++) {
+        hval ^= *p;
+        hval *= FNV_PRIME;
+    }
+    return hval;
+}
+
+static size_t file_size(uint64_t nslots)
+{
+    return HEADER_SIZE + nslots * SLOT_SIZE;
+}
+
+static void unmap(catalog cat)
+{
+    if (cat->map) {
+        munmap(cat->map, cat->maplen);
+    }
+    if (cat->fd >= 0) {
+        close(cat->fd);
+    }
+    cat->map = NULL;
+    cat->fd = -1;
+}
+
+// Map index file open at fd into cat.
+// Returns -1 on failure, 1 on success.
+static int map_fd(catalog cat, int fd, size_t len)
+{
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    cat->fd = fd;
+    cat->map = map;
+    cat->maplen = len;
+    cat->hdr = (struct cat_header *) map;
+    cat->slots = (struct cat_slot *) (map + HEADER_SIZE);
+    return 1;
+}
+
+// Create empty index file at path with nslots
+// slots and map it. Returns open fd, -1 on failure.
+static int create_file(const char *path, uint64_t nslots, uint64_t next_id,
+                       char **mapp)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t len = file_size(nslots);
+    if (ftruncate(fd, len) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    struct cat_header *hdr = (struct cat_header *) map;
+    memcpy(hdr->magic, FILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = FILE_VERSION;
+    hdr->slotsize = SLOT_SIZE;
+    hdr->nslots = nslots;
+    hdr->next_id = next_id;
+
+    *mapp = map;
+    return fd;
+}
+
+// Returns slot index of name, or nslots if
+// name is not in catalog. If freep is not NULL,
+// sets it to the first free slot on the probe
+// path, for inserting name.
+static size_t probe(catalog cat, const char *name, uint32_t hash, size_t *freep)
+{
+    size_t nslots = cat->hdr->nslots;
+    size_t firstfree = nslots;
+    size_t i = hash & (nslots - 1);
+    for (size_t n = 0; n < nslots; n++) {
+        struct cat_slot *slot = &cat->slots[i];
+        if (slot->state == SLOT_EMPTY) {
+            if (firstfree == nslots) {
+                firstfree = i;
+            }
+            break;
+        }
+        if (slot->state == SLOT_DELETED) {
+            if (firstfree == nslots) {
+                firstfree = i;
+            }
+        }
+        else if (slot->hash == hash && strcmp(slot->name, name) == 0) {
+            return i;
+        }
+        i = (i + 1) & (nslots - 1);
+    }
+
+    if (freep) {
+        *freep = firstfree;
+    }
+    return nslots;
+}
+
+// Place record in first free slot of its probe
+// path. Table must have a free slot.
+static void place(struct cat_slot *slots, size_t nslots, const struct cat_slot *rec)
+{
+    size_t i = rec->hash & (nslots - 1);
+    while (slots[i].state == SLOT_USED) {
+        i = (i + 1) & (nslots - 1);
+    }
+    slots[i] = *rec;
+}
+
+// Rewrite index without deleted slots, doubling it
+// if it is more than half full, and replace the
+// index file. Returns -1 on failure, 1 on success.
+static int rebuild(catalog cat)
+{
+    uint64_t nslots = cat->hdr->nslots;
+    if (cat->hdr->used * 2 > nslots) {
+        nslots *= 2;
+    }
+
+    char *tmppath = malloc(strlen(cat->path) + strlen(TMP_FILE_EXT) + 1);
+    if (!tmppath) {
+        return -1;
+    }
+    strcpy(tmppath, cat->path);
+    strcat(tmppath, TMP_FILE_EXT);
+
+    char *map;
+    int fd = create_file(tmppath, nslots, cat->hdr->next_id, &map);
+    if (fd < 0) {
+        free(tmppath);
+        return -1;
+    }
+
+    struct cat_header *hdr = (struct cat_header *) map;
+    struct cat_slot *slots = (struct cat_slot *) (map + HEADER_SIZE);
+    for (size_t i = 0; i < cat->hdr->nslots; i++) {
+        if (cat->slots[i].state == SLOT_USED) {
+            place(slots, nslots, &cat->slots[i]);
+            hdr->used++;
+        }
+    }
+
+    size_t len = file_size(nslots);
+    if (msync(map, len, MS_SYNC) < 0 || rename(tmppath, cat->path) < 0) {
+        munmap(map, len);
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return -1;
+    }
+    free(tmppath);
+
+    unmap(cat);
+    cat->fd = fd;
+    cat->map = map;
+    cat->maplen = len;
+    cat->hdr = hdr;
+    cat->slots = slots;
+    return 1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+
+// Open catalog index file at path, creating
+// it if it does not exist.
+// Returns NULL on failure.
+catalog catalog_open(const char *path)
+{
+    if (!path) {
+        return NULL;
+    }
+
+    catalog cat = calloc(1, sizeof(struct catalog_obj));
+    if (!cat) {
+        return NULL;
+    }
+    cat->fd = -1;
+    cat->path = strdup(path);
+    if (!cat->path) {
+        free(cat);
+        return NULL;
+    }
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        char *map;
+        fd = create_file(path, INIT_SLOTS, 1, &map);
+        if (fd < 0) {
+            catalog_close(cat);
+            return NULL;
+        }
+        munmap(map, file_size(INIT_SLOTS));
+    }
+
+    struct stat st;
+    struct cat_header hdr;
+    if (fstat(fd, &st) < 0 ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != FILE_VERSION || hdr.slotsize != SLOT_SIZE ||
+        hdr.nslots == 0 || (hdr.nslots & (hdr.nslots - 1)) != 0 ||
+        (uint64_t) st.st_size < file_size(hdr.nslots) ||
+        map_fd(cat, fd, file_size(hdr.nslots)) < 0) {
+        close(fd);
+        catalog_close(cat);
+        return NULL;
+    }
+
+    return cat;
+}
+
+// Unmap and free catalog. Changes not flushed
+// with catalog_sync are written back by the
+// operating system.
+void catalog_close(catalog cat)
+{
+    if (!cat) {
+        return;
+    }
+
+    unmap(cat);
+    free(cat->path);
+    free(cat);
+}
+
+// Look up table name. Copies its record
+// to entry if entry is not NULL.
+// Returns true if table is in catalog.
+bool catalog_find(catalog cat, const char *name, struct cat_entry *entry)
+{
+    if (!cat || !name) {
+        return false;
+    }
+
+    size_t i = probe(cat, name, hash_name(name), NULL);
+    if (i == cat->hdr->nslots) {
+        return false;
+    }
+
+    if (entry) {
+        struct cat_slot *slot = &cat->slots[i];
+        strtcpy(entry->name, slot->name, TBL_NAME_MAX);
+        strtcpy(entry->fname, slot->fname, CAT_FNAME_MAX);
+        strtcpy(entry->engine, slot->engine, CAT_ENGINE_MAX);
+        entry->entries = slot->entries;
+        entry->bytes = slot->bytes;
+        entry->mtime = slot->mtime;
+    }
+    return true;
+}
+
+// Allocate a new unique file name and copy it to
+// fname (CAT_FNAME_MAX bytes). The name is not
+// reused even if it is never added to the catalog.
+// Returns -2 on file error, 1 on success.
+int catalog_new_fname(catalog cat, char *fname)
+{
+    if (!cat || !fname) {
+        return -2;
+    }
+
+    uint64_t id = cat->hdr->next_id++;
+    snprintf(fname, CAT_FNAME_MAX, "%0*" PRIu64, FNAME_DIGITS, id);
+    return 1;
+}
+
+// Add table with file name and engine. entries,
+// bytes, and mtime are taken from entry.
+// Returns -1 if name already exists, -2 on memory
+// allocation or file error, 1 on success.
+int catalog_add(catalog cat, const struct cat_entry *entry)
+{
+    if (!cat || !entry) {
+        return -2;
+    }
+
+    uint32_t hash = hash_name(entry->name);
+    size_t freeslot;
+    if (probe(cat, entry->name, hash, &freeslot) != cat->hdr->nslots) {
+        return -1;
+    }
+
+    // Keep an empty slot in every probe path
+    if ((cat->hdr->used + cat->hdr->deleted + 1) >
+        cat->hdr->nslots * LOAD_FACT_LIM) {
+        if (rebuild(cat) < 0) {
+            return -2;
+        }
+        probe(cat, entry->name, hash, &freeslot);
+    }
+
+    // Imported tables may have numeric file names -
+    // keep new file names above them
+    char *end;
+    unsigned long long num = strtoull(entry->fname, &end, 10);
+    if (*end == '\0' && end != entry->fname && num >= cat->hdr->next_id) {
+        cat->hdr->next_id = num + 1;
+    }
+
+    struct cat_slot *slot = &cat->slots[freeslot];
+    if (slot->state == SLOT_DELETED) {
+        cat->hdr->deleted--;
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->hash = hash;
+    slot->entries = entry->entries;
+    slot->bytes = entry->bytes;
+    slot->mtime = entry->mtime;
+    strtcpy(slot->name, entry->name, TBL_NAME_MAX);
+    strtcpy(slot->fname, entry->fname, CAT_FNAME_MAX);
+    strtcpy(slot->engine, entry->engine, CAT_ENGINE_MAX);
+    slot->state = SLOT_USED;
+    cat->hdr->used++;
+
+    return 1;
+}
+
+// Update entry count, size, and save time of table.
+// Returns -1 if table is not in catalog, 1 on success.
+int catalog_set_stats(catalog cat, const char *name, uint64_t entries,
+                      uint64_t bytes, int64_t mtime)
+{
+    if (!cat || !name) {
+        return -1;
+    }
+
+    size_t i = probe(cat, name, hash_name(name), NULL);
+    if (i == cat->hdr->nslots) {
+        return -1;
+    }
+
+    cat->slots[i].entries = entries;
+    cat->slots[i].bytes = bytes;
+    cat->slots[i].mtime = mtime;
+    return 1;
+}
+
+// Remove table. Returns -1 if table is not
+// in catalog, 1 on success.
+int catalog_remove(catalog cat, const char *name)
+{
+    if (!cat || !name) {
+        return -1;
+    }
+
+    size_t i = probe(cat, name, hash_name(name), NULL);
+    if (i == cat->hdr->nslots) {
+        return -1;
+    }
+
+    cat->slots[i].state = SLOT_DELETED;
+    cat->hdr->used--;
+    cat->hdr->deleted++;
+    return 1;
+}
+
+size_t catalog_count(catalog cat)
+{
+    return cat ? cat->hdr->used : 0;
+}
+
+// Returns pointer to heap-allocated array of
+// table name strings. Caller is responsible for
+// freeing returned pointer. The strings are owned
+// by the catalog and are valid until it is changed.
+char **catalog_get_names(catalog cat)
+{
+    if (!cat) {
+        return NULL;
+    }
+
+    char **names = calloc(cat->hdr->used + 1, sizeof(char *));
+    if (!names) {
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < cat->hdr->nslots && n < cat->hdr->used; i++) {
+        if (cat->slots[i].state == SLOT_USED) {
+            names[n++] = cat->slots[i].name;
+        }
+    }
+    return names;
+}
+
+// Call fn for every table.
+// Stops early if fn returns nonzero.
+// Returns 1, or -1 if cat is NULL.
+int catalog_foreach(catalog cat, cat_iter_fn fn, void *arg)
+{
+    if (!cat || !fn) {
+        return -1;
+    }
+
+    struct cat_entry entry;
+    for (size_t i = 0; i < cat->hdr->nslots; i++) {
+        struct cat_slot *slot = &cat->slots[i];
+        if (slot->state != SLOT_USED) {
+            continue;
+        }
+        strtcpy(entry.name, slot->name, TBL_NAME_MAX);
+        strtcpy(entry.fname, slot->fname, CAT_FNAME_MAX);
+        strtcpy(entry.engine, slot->engine, CAT_ENGINE_MAX);
+        entry.entries = slot->entries;
+        entry.bytes = slot->bytes;
+        entry.mtime = slot->mtime;
+        if (fn(&entry, arg) != 0) {
+            break;
+        }
+    }
+    return 1;
+}
+
+// Flush changed catalog pages to disk.
+// Returns -1 on failure, 1 on success.
+int catalog_sync(catalog cat)
+{
+    if (!cat) {
+        return -1;
+    }
+
+    return msync(cat->map, cat->maplen, MS_SYNC) < 0 ? -1 : 1;
+}
@@ -0,0 +1,112 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Table catalog.
+ *
+ * The catalog records every saved table - its name,
+ * file name, storage engine, and size - in an index
+ * file that is memory mapped, not loaded. Opening the
+ * catalog takes the same time for any number of tables,
+ * and adding, updating, or removing a table changes
+ * only the pages holding its record and the catalog
+ * header. File names are allocated from a counter
+ * kept in the header, so they never repeat.
+ *
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pairdbconst.h"
+
+enum {
+    CAT_FNAME_MAX = 16,
+    CAT_ENGINE_MAX = 16
+};
+
+// Entry count of tables whose engine
+// cannot count entries cheaply
+#define CAT_ENTRIES_UNKNOWN UINT64_MAX
+
+// catalog object handle
+typedef struct catalog_obj *catalog;
+
+// Record of one table
+struct cat_entry {
+    char name[TBL_NAME_MAX];
+    char fname[CAT_FNAME_MAX];
+    char engine[CAT_ENGINE_MAX];
+    uint64_t entries;       // CAT_ENTRIES_UNKNOWN if not recorded
+    uint64_t bytes;         // Disk space used by table files
+    int64_t mtime;          // Time of last save
+};
+
+// Called by catalog_foreach for each table.
+// Return nonzero to stop iteration.
+typedef int (*cat_iter_fn)(const struct cat_entry *entry, void *arg);
+
+// Open catalog index file at path, creating
+// it if it does not exist.
+// Returns NULL on failure.
+catalog catalog_open(const char *path);
+
+// Unmap and free catalog. Changes not flushed
+// with catalog_sync are written back by the
+// operating system.
+void catalog_close(catalog cat);
+
+// Look up table name. Copies its record
+// to entry if entry is not NULL.
+// Returns true if table is in catalog.
+bool catalog_find(catalog cat, const char *name, struct cat_entry *entry);
+
+// Allocate a new unique file name and copy it to
+// fname (CAT_FNAME_MAX bytes). The name is not
+// reused even if it is never added to the catalog.
+// Returns -2 on file error, 1 on success.
+int catalog_new_fname(catalog cat, char *fname);
+
+// Add table with file name and engine. entries,
+// bytes, and mtime are taken from entry.
+// Returns -1 if name already exists, -2 on memory
+// allocation or file error, 1 on success.
+int catalog_add(catalog cat, const struct cat_entry *entry);
+
+// Update entry count, size, and save time of table.
+// Returns -1 if table is not in catalog, 1 on success.
+int catalog_set_stats(catalog cat, const char *name, uint64_t entries,
+                      uint64_t bytes, int64_t mtime);
+
+// Remove table. Returns -1 if table is not
+// in catalog, 1 on success.
+int catalog_remove(catalog cat, const char *name);
+
+size_t catalog_count(catalog cat);
+
+// Returns pointer to heap-allocated array of
+// table name strings. Caller is responsible for
+// freeing returned pointer. The strings are owned
+// by the catalog and are valid until it is changed.
+char **catalog_get_names(catalog cat);
+
+// Call fn for every table.
+// Stops early if fn returns nonzero.
+// Returns 1, or -1 if cat is NULL.
+int catalog_foreach(catalog cat, cat_iter_fn fn, void *arg);
+
+// Flush changed catalog pages to disk.
+// Returns -1 on failure, 1 on success.
+int catalog_sync(catalog cat);
+
+#endif // CATALOG_H
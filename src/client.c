@@ -0,0 +1,293 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pairdb client. See client.h.
+ *
+ * The client waits on stdin and the server socket with
+ * poll. Command lines read from stdin are queued in an
+ * output buffer and sent when the socket accepts them,
+ * and replies are printed as they complete. Reading
+ * stdin pauses while OUT_HIGH bytes are waiting to be
+ * sent, so a large command file is streamed rather
+ * than held in memory. At the end of stdin, the write
+ * side of the socket is shut down once every command
+ * is sent, and the client exits when the server closes
+ * the connection after the last reply.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "client.h"
+#include "server.h"
+#include "wire.h"
+#include "stringutil.h"
+
+enum {
+    READ_CHUNK = 64 * 1024,
+    OUT_HIGH = 1024 * 1024
+};
+
+static const char *PROMPT = "pairdb>> ";
+
+struct client {
+    int fd;
+    struct netbuf in;       // Replies received
+    struct netbuf out;      // Commands to send
+    struct netbuf cmds;     // stdin not yet split into lines
+    size_t waiting;         // Commands sent without reply
+    bool stdin_eof;
+    bool shut;              // Write side shut down
+    bool interactive;
+    bool failed;            // An error reply was received
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Connect to Unix domain socket at path.
+// Returns -1 on failure.
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strtcpy(addr.sun_path, path, sizeof(addr.sun_path)) < 0) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Cannot connect to pairdb server at %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+// Print one complete reply of len bytes
+static void print_reply(struct client *cl, const char *reply, size_t len)
+{
+    if (reply[0] == '*') {
+        const char *body = (const char *) memchr(reply, '\n', len) + 1;
+        fwrite(body, 1, reply + len - body, stdout);
+    }
+    else if (reply[0] == '-') {
+        fflush(stdout);
+        fwrite(reply + 1, 1, len - 1, stderr);
+        cl->failed = true;
+    }
+    else if (len != 4 || memcmp(reply, "+OK\n", 4) != 0) {
+        fwrite(reply + 1, 1, len - 1, stdout);
+    }
+}
+
+// Move complete lines of cmds to out, skipping
+// blank lines
+static void queue_commands(struct client *cl)
+{
+    while (netbuf_used(&cl->cmds) > 0) {
+        char *start = cl->cmds.data + cl->cmds.off;
+        size_t used = netbuf_used(&cl->cmds);
+        char *nl = memchr(start, '\n', used);
+        if (!nl) {
+            if (!cl->stdin_eof) {
+                return;
+            }
+            // Last line without newline
+            netbuf_append(&cl->cmds, "\n", 1);
+            continue;
+        }
+
+        size_t len = nl + 1 - start;
+        bool blank = true;
+        for (char *p = start; p < nl && blank; p++) {
+            blank = (*p == ' ' || *p == '\t' || *p == '\r');
+        }
+        if (!blank) {
+            netbuf_append(&cl->out, start, len);
+            cl->waiting++;
+        }
+        else if (cl->interactive && cl->waiting == 0) {
+            printf("%s", PROMPT);
+            fflush(stdout);
+        }
+        netbuf_consume(&cl->cmds, len);
+    }
+}
+
+// Read from stdin. Returns -1 on error.
+static int read_stdin(struct client *cl)
+{
+    if (netbuf_reserve(&cl->cmds, READ_CHUNK) < 0) {
+        return -1;
+    }
+    ssize_t n = read(STDIN_FILENO, cl->cmds.data + cl->cmds.len, READ_CHUNK);
+    if (n < 0) {
+        return errno == EINTR ? 1 : -1;
+    }
+    if (n == 0) {
+        cl->stdin_eof = true;
+    }
+    cl->cmds.len += n;
+    queue_commands(cl);
+    return 1;
+}
+
+// Send queued commands. Returns -1 on error.
+static int send_commands(struct client *cl)
+{
+    while (netbuf_used(&cl->out) > 0) {
+        ssize_t n = send(cl->fd, cl->out.data + cl->out.off, netbuf_used(&cl->out),
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            netbuf_consume(&cl->out, n);
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    if (cl->stdin_eof && !cl->shut) {
+        shutdown(cl->fd, SHUT_WR);
+        cl->shut = true;
+    }
+    return 1;
+}
+
+// Read replies and print complete ones.
+// Returns 0 when the server closed the
+// connection, -1 on error.
+static int read_replies(struct client *cl)
+{
+    if (netbuf_reserve(&cl->in, READ_CHUNK) < 0) {
+        return -1;
+    }
+    ssize_t n = read(cl->fd, cl->in.data + cl->in.len, READ_CHUNK);
+    if (n < 0) {
+        return (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    cl->in.len += n;
+
+    ssize_t len;
+    while ((len = wire_reply_len(cl->in.data + cl->in.off, netbuf_used(&cl->in))) > 0) {
+        print_reply(cl, cl->in.data + cl->in.off, len);
+        netbuf_consume(&cl->in, len);
+        if (cl->waiting > 0) {
+            cl->waiting--;
+        }
+        if (cl->interactive && cl->waiting == 0) {
+            printf("%s", PROMPT);
+        }
+    }
+    fflush(stdout);
+    if (len < 0) {
+        fprintf(stderr, "Malformed reply from server\n");
+        return -1;
+    }
+    return 1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+int run_client(const char *path)
+{
+    char *defpath = NULL;
+    if (!path) {
+        defpath = get_socket_path();
+        if (!defpath) {
+            return 2;
+        }
+        path = defpath;
+    }
+
+    struct client cl = {0};
+    cl.fd = connect_socket(path);
+    free(defpath);
+    if (cl.fd < 0) {
+        return 2;
+    }
+    cl.interactive = isatty(STDIN_FILENO);
+    if (cl.interactive) {
+        printf("%s", PROMPT);
+        fflush(stdout);
+    }
+
+    int status = -1;
+    for (;;) {
+        struct pollfd fds[2] = {
+            {.fd = cl.fd, .events = POLLIN},
+            {.fd = STDIN_FILENO, .events = POLLIN}
+        };
+        if (netbuf_used(&cl.out) > 0) {
+            fds[0].events |= POLLOUT;
+        }
+        nfds_t nfds = (!cl.stdin_eof && netbuf_used(&cl.out) < OUT_HIGH) ? 2 : 1;
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (nfds == 2 && (fds[1].revents & (POLLIN | POLLHUP)) && read_stdin(&cl) < 0) {
+            break;
+        }
+        if (send_commands(&cl) < 0) {
+            fprintf(stderr, "Connection to server lost\n");
+            break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int ret = read_replies(&cl);
+            if (ret < 0) {
+                break;
+            }
+            if (ret == 0) {
+                status = cl.waiting == 0 ? 1 : -1;
+                if (cl.waiting > 0) {
+                    fprintf(stderr, "Connection closed by server\n");
+                }
+                break;
+            }
+        }
+    }
+
+    close(cl.fd);
+    netbuf_free(&cl.in);
+    netbuf_free(&cl.out);
+    netbuf_free(&cl.cmds);
+    if (status < 0) {
+        return 2;
+    }
+    return cl.failed ? 1 : 0;
+}
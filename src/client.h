@@ -0,0 +1,32 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pairdb client - 'pairdb -c [socket]'
+ *
+ * Sends command lines read from stdin to a pairdb
+ * server (see server.h) and prints the replies.
+ * Commands are sent as soon as they are read, without
+ * waiting for the replies to earlier commands, so
+ * piping a file of commands to the client keeps the
+ * server busy. Replies are printed in command order.
+ *
+ */
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+// Connect to server at path, or at the default
+// socket if path is NULL, send command lines read
+// from stdin, and print replies. Error replies are
+// printed to stderr.
+// Returns exit status: 1 if any command failed,
+// 2 if the server cannot be reached.
+int run_client(const char *path);
+
+#endif // CLIENT_H
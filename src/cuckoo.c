@@ -0,0 +1,789 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Cuckoo hash table implementation.
+ *
+ * The table is an array of buckets, each with
+ * CK_BUCKET_SLOTS slots. A key's 64-bit FNV-1a hash
+ * selects its first bucket, and a mix of the same hash
+ * selects its second. Each slot keeps the upper 32 bits
+ * of its entry's hash as a tag, so a lookup compares
+ * key strings only for slots whose tag matches.
+ *
+ * An insert uses a free slot in either bucket if there
+ * is one. Otherwise it moves a random entry from one of
+ * the buckets to that entry's other bucket, and so on,
+ * for up to MAX_KICKS moves (a random walk). If no free
+ * slot is found, the bucket array is doubled and every
+ * entry is placed again. The entry left without a slot
+ * when doubling fails for lack of memory is kept in a
+ * one-entry stash, which lookups also check, so a failed
+ * resize never loses an entry.
+ *
+ * Table file format:
+ *      header      struct file_header
+ *      entries     for each entry:
+ *                      key len     1 byte
+ *                      val len     1 byte
+ *                      key         (key len) bytes
+ *                      val         (val len) bytes
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cuckoo.h"
+#include "uring.h"
+#include "stringutil.h"
+
+/*
+ *
+ * Values for Fowler/Noll/Vo hash function
+ * In public domain - see links
+ * https://github.com/lcn2/fnv/tree/master
+ * https://github.com/lcn2/fnv/blob/master/LICENSE
+ *
+ */
+
+static const uint64_t FNV64_INIT = 0xcbf29ce484222325ULL;
+static const uint64_t FNV64_PRIME = 0x100000001b3ULL;
+
+static const double LOAD_FACT_LIM = 0.90;
+
+static const char FILE_MAGIC[8] = "PDBCUCK1";
+static const uint32_t FILE_VERSION = 1;
+
+enum {
+    MIN_BUCKETS = 2,
+    MAX_KICKS = 500,
+    ENTRY_LEN_MAX = 255,        // Key and val lengths are stored in 1 byte
+    WRITE_BUF_SIZE = 65536
+};
+
+
+/*------------------ Data structures -----------------*/
+
+// Entry - key and val strings are stored after
+// the struct in a single allocation
+struct ck_node {
+    uint64_t hash;
+    unsigned char keylen;
+    unsigned char vallen;
+    char data[];            // key + '\0' + val + '\0'
+};
+
+struct bucket {
+    uint32_t tags[CK_BUCKET_SLOTS];
+    struct ck_node *nodes[CK_BUCKET_SLOTS];
+};
+
+struct ck_array {
+    struct bucket *buckets;
+    size_t numbuckets;      // Always a power of 2
+};
+
+struct cuckoo_obj {
+    struct ck_array arr;
+    size_t numentries;
+    struct ck_node *stash;  // Entry not yet placed in a bucket
+    uint64_t rng;           // xorshift state for choosing entries to move
+
+    size_t membytes;
+    size_t kicks;
+    size_t max_kicks;
+    size_t resizes;
+};
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    uint64_t entries;
+};
+
+
+/*---------------- Start - static/internal functions --------------*/
+
+static uint64_t hash_key(const char *key)
+{
+    uint64_t hval = FNV64_INIT;
+    for (const unsigned char *p = (const unsigned char *) key; *p; p++) {
+        hval ^= *p;
+        hval *= FNV64_PRIME;
+    }
+    return hval;
+}
+
+// Finalizer from splitmix64 - spreads hash bits
+// so the second bucket is independent of the first
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t next_rand(struct cuckoo_obj *tbl)
+{
+    tbl->rng ^= tbl->rng << 13;
+    tbl->rng ^= tbl->rng >> 7;
+    tbl->rng ^= tbl->rng << 17;
+    return tbl->rng;
+}
+
+static uint32_t get_tag(uint64_t hash)
+{
+    return (uint32_t) (hash >> 32);
+}
+
+static size_t first_bucket(const struct ck_array *arr, uint64_t hash)
+{
+    return hash & (arr->numbuckets - 1);
+}
+
+static size_t second_bucket(const struct ck_array *arr, uint64_t hash)
+{
+    size_t mask = arr->numbuckets - 1;
+    size_t b1 = hash & mask;
+    size_t b2 = mix(hash) & mask;
+    return (b2 == b1) ? ((b1 + 1) & mask) : b2;
+}
+
+// Bucket other than b that can hold node
+static size_t other_bucket(const struct ck_array *arr, const struct ck_node *node, size_t b)
+{
+    size_t b1 = first_bucket(arr, node->hash);
+    return (b == b1) ? second_bucket(arr, node->hash) : b1;
+}
+
+static const char *node_key(const struct ck_node *node)
+{
+    return node->data;
+}
+
+static const char *node_val(const struct ck_node *node)
+{
+    return node->data + node->keylen + 1;
+}
+
+static size_t node_size(const struct ck_node *node)
+{
+    return sizeof(struct ck_node) + node->keylen + node->vallen + 2;
+}
+
+static struct ck_node *new_node(const char *key, size_t keylen,
+                                const char *val, size_t vallen, uint64_t hash)
+{
+    struct ck_node *node = malloc(sizeof(struct ck_node) + keylen + vallen + 2);
+    if (!node) {
+        return NULL;
+    }
+    node->hash = hash;
+    node->keylen = (unsigned char) keylen;
+    node->vallen = (unsigned char) vallen;
+    memcpy(node->data, key, keylen);
+    node->data[keylen] = '\0';
+    memcpy(node->data + keylen + 1, val, vallen);
+    node->data[keylen + 1 + vallen] = '\0';
+    return node;
+}
+
+// Returns address of slot holding key, or NULL
+static struct ck_node **find_slot(struct cuckoo_obj *tbl, const char *key, uint64_t hash)
+{
+    uint32_t tag = get_tag(hash);
+    size_t b[2] = {first_bucket(&tbl->arr, hash), second_bucket(&tbl->arr, hash)};
+    for (int i = 0; i < 2; i++) {
+        struct bucket *bkt = &tbl->arr.buckets[b[i]];
+        for (int s = 0; s < CK_BUCKET_SLOTS; s++) {
+            if (bkt->nodes[s] && bkt->tags[s] == tag &&
+                strcmp(node_key(bkt->nodes[s]), key) == 0) {
+                return &bkt->nodes[s];
+            }
+        }
+    }
+
+    if (tbl->stash && tbl->stash->hash == hash &&
+        strcmp(node_key(tbl->stash), key) == 0) {
+        return &tbl->stash;
+    }
+    return NULL;
+}
+
+// Store node in a free slot of bucket b.
+// Returns false if bucket is full.
+static bool bucket_add(struct ck_array *arr, size_t b, struct ck_node *node)
+{
+    struct bucket *bkt = &arr->buckets[b];
+    for (int s = 0; s < CK_BUCKET_SLOTS; s++) {
+        if (!bkt->nodes[s]) {
+            bkt->nodes[s] = node;
+            bkt->tags[s] = get_tag(node->hash);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Place node in arr, moving entries to their other
+// bucket as needed. Returns true on success. On
+// failure, *nodep is set to the entry left without
+// a slot, which may not be the node passed in.
+static bool place(struct cuckoo_obj *tbl, struct ck_array *arr, struct ck_node **nodep)
+{
+    struct ck_node *node = *nodep;
+    size_t b1 = first_bucket(arr, node->hash);
+    size_t b2 = second_bucket(arr, node->hash);
+    if (bucket_add(arr, b1, node) || bucket_add(arr, b2, node)) {
+        return true;
+    }
+
+    size_t b = (next_rand(tbl) & 1) ? b1 : b2;
+    for (size_t kick = 1; kick <= MAX_KICKS; kick++) {
+        struct bucket *bkt = &arr->buckets[b];
+        int s = next_rand(tbl) % CK_BUCKET_SLOTS;
+        struct ck_node *victim = bkt->nodes[s];
+        bkt->nodes[s] = node;
+        bkt->tags[s] = get_tag(node->hash);
+        node = victim;
+        tbl->kicks++;
+
+        b = other_bucket(arr, node, b);
+        if (bucket_add(arr, b, node)) {
+            if (kick > tbl->max_kicks) {
+                tbl->max_kicks = kick;
+            }
+            return true;
+        }
+    }
+
+    *nodep = node;
+    return false;
+}
+
+// Rebuild table with at least numbuckets buckets,
+// placing every entry and the stash again. Doubles
+// the size again if entries still cannot be placed.
+// Returns -2 on memory allocation error, leaving
+// table unchanged; 1 on success.
+static int rebuild(struct cuckoo_obj *tbl, size_t numbuckets)
+{
+    while (true) {
+        struct ck_array arr;
+        arr.numbuckets = numbuckets;
+        arr.buckets = calloc(numbuckets, sizeof(struct bucket));
+        if (!arr.buckets) {
+            return -2;
+        }
+
+        bool placed = true;
+        for (size_t i = 0; i < tbl->arr.numbuckets && placed; i++) {
+            struct bucket *bkt = &tbl->arr.buckets[i];
+            for (int s = 0; s < CK_BUCKET_SLOTS && placed; s++) {
+                struct ck_node *node = bkt->nodes[s];
+                if (node) {
+                    placed = place(tbl, &arr, &node);
+                }
+            }
+        }
+        if (placed && tbl->stash) {
+            struct ck_node *node = tbl->stash;
+            placed = place(tbl, &arr, &node);
+        }
+
+        if (placed) {
+            tbl->membytes -= tbl->arr.numbuckets * sizeof(struct bucket);
+            tbl->membytes += arr.numbuckets * sizeof(struct bucket);
+            free(tbl->arr.buckets);
+            tbl->arr = arr;
+            tbl->stash = NULL;
+            tbl->resizes++;
+            return 1;
+        }
+
+        // Old array still holds every entry
+        free(arr.buckets);
+        numbuckets *= 2;
+    }
+}
+
+// Smallest power of 2 number of buckets holding
+// capacity entries within the load factor limit
+static size_t buckets_for(size_t capacity)
+{
+    size_t needed = (size_t) (capacity / (LOAD_FACT_LIM * CK_BUCKET_SLOTS)) + 1;
+    size_t n = MIN_BUCKETS;
+    while (n < needed) {
+        n *= 2;
+    }
+    return n;
+}
+
+// Add node for a key not in the table.
+// Returns -2 on memory allocation error, 1 on success.
+static int insert_node(struct cuckoo_obj *tbl, struct ck_node *node)
+{
+    // Stash must be placed before it can take
+    // another entry
+    if (tbl->stash && rebuild(tbl, tbl->arr.numbuckets * 2) < 0) {
+        return -2;
+    }
+
+    size_t limit = (size_t) (tbl->arr.numbuckets * CK_BUCKET_SLOTS * LOAD_FACT_LIM);
+    if (tbl->numentries + 1 > limit) {
+        if (rebuild(tbl, tbl->arr.numbuckets * 2) < 0) {
+            return -2;
+        }
+    }
+
+    tbl->numentries++;
+    tbl->membytes += node_size(node);
+
+    if (!place(tbl, &tbl->arr, &node)) {
+        // node is now the entry left without a slot
+        tbl->stash = node;
+        rebuild(tbl, tbl->arr.numbuckets * 2);
+    }
+    return 1;
+}
+
+// Read exactly len bytes from fd.
+// Returns -1 on error or end of file, 1 on success.
+static int read_full(int fd, char *buff, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = read(fd, buff, len);
+        if (r <= 0) {
+            return -1;
+        }
+        buff += r;
+        len -= r;
+    }
+    return 1;
+}
+
+// Entry at slot position pos of cuckoo_scan,
+// NULL if the slot is empty
+static struct ck_node *slot_node(struct cuckoo_obj *tbl, size_t pos)
+{
+    size_t bkt = pos / CK_BUCKET_SLOTS;
+    if (bkt == tbl->arr.numbuckets) {
+        return tbl->stash;
+    }
+    return tbl->arr.buckets[bkt].nodes[pos % CK_BUCKET_SLOTS];
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+
+// Returns handle to table allocated on heap with
+// room for at least capacity entries.
+// Returns NULL on failure.
+// Free with cuckoo_destroy function.
+cuckoo_tbl cuckoo_init(size_t capacity)
+{
+    cuckoo_tbl tbl = calloc(1, sizeof(struct cuckoo_obj));
+    if (!tbl) {
+        return NULL;
+    }
+
+    tbl->arr.numbuckets = buckets_for(capacity);
+    tbl->arr.buckets = calloc(tbl->arr.numbuckets, sizeof(struct bucket));
+    if (!tbl->arr.buckets) {
+        free(tbl);
+        return NULL;
+    }
+
+    tbl->rng = 0x9e3779b97f4a7c15ULL;
+    tbl->membytes = sizeof(struct cuckoo_obj) +
+                    tbl->arr.numbuckets * sizeof(struct bucket);
+    return tbl;
+}
+
+void cuckoo_destroy(cuckoo_tbl tbl)
+{
+    if (!tbl) {
+        return;
+    }
+
+    for (size_t i = 0; i < tbl->arr.numbuckets; i++) {
+        for (int s = 0; s < CK_BUCKET_SLOTS; s++) {
+            free(tbl->arr.buckets[i].nodes[s]);
+        }
+    }
+    free(tbl->stash);
+    free(tbl->arr.buckets);
+    free(tbl);
+}
+
+// Grow table to hold capacity entries without
+// rebuilding. Never shrinks the table.
+// Returns -2 on memory allocation failure,
+// 1 on success.
+int cuckoo_reserve(cuckoo_tbl tbl, size_t capacity)
+{
+    if (!tbl) {
+        return -2;
+    }
+
+    size_t numbuckets = buckets_for(capacity);
+    if (numbuckets <= tbl->arr.numbuckets) {
+        return 1;
+    }
+    return rebuild(tbl, numbuckets);
+}
+
+// Input: two strings, key and val, to be added to table.
+// Output: -1 if key already exists,
+//         -2 on memory allocation failure,
+//          1 on success.
+int cuckoo_put(cuckoo_tbl tbl, const char *key, const char *val)
+{
+    if (!tbl || !key || !val) {
+        return -2;
+    }
+
+    size_t keylen = strlen(key);
+    size_t vallen = strlen(val);
+    if (keylen > ENTRY_LEN_MAX || vallen > ENTRY_LEN_MAX) {
+        return -2;
+    }
+
+    uint64_t hash = hash_key(key);
+    if (find_slot(tbl, key, hash)) {
+        return -1;
+    }
+
+    struct ck_node *node = new_node(key, keylen, val, vallen, hash);
+    if (!node) {
+        return -2;
+    }
+
+    if (insert_node(tbl, node) < 0) {
+        free(node);
+        return -2;
+    }
+    return 1;
+}
+
+// Searches for value associated with key.
+// If found, copies value to dst.
+// Returns length of value string copied to dst.
+// Returns 0 on error or if value not found.
+size_t cuckoo_find(char *dst, size_t dsize, cuckoo_tbl tbl, const char *key)
+{
+    if (!dst || !tbl || !key) {
+        return 0;
+    }
+
+    struct ck_node **slot = find_slot(tbl, key, hash_key(key));
+    if (!slot) {
+        return 0;
+    }
+
+    ssize_t len = strtcpy(dst, node_val(*slot), dsize);
+    return len < 0 ? 0 : (size_t) len;
+}
+
+bool cuckoo_exists(cuckoo_tbl tbl, const char *key)
+{
+    if (!tbl || !key) {
+        return false;
+    }
+
+    return find_slot(tbl, key, hash_key(key)) != NULL;
+}
+
+// key and value removed
+// running multiple times on same key has no effect
+void cuckoo_delete(cuckoo_tbl tbl, const char *key)
+{
+    if (!tbl || !key) {
+        return;
+    }
+
+    struct ck_node **slot = find_slot(tbl, key, hash_key(key));
+    if (!slot) {
+        return;
+    }
+
+    tbl->membytes -= node_size(*slot);
+    tbl->numentries--;
+    free(*slot);
+    *slot = NULL;
+}
+
+size_t cuckoo_count(cuckoo_tbl tbl)
+{
+    return tbl ? tbl->numentries : 0;
+}
+
+// Returns bytes of heap memory held by table,
+// including bucket array and all entries
+size_t cuckoo_mem_usage(cuckoo_tbl tbl)
+{
+    return tbl ? tbl->membytes : 0;
+}
+
+// Collects keys or vals into array for
+// cuckoo_get_keys and cuckoo_get_vals
+struct collect_arg {
+    char **arr;
+    size_t n;
+    bool vals;
+};
+
+static int collect_entry(const char *key, const char *val, void *arg)
+{
+    struct collect_arg *c = arg;
+    c->arr[c->n++] = (char *) (c->vals ? val : key);
+    return 0;
+}
+
+// Returns pointer to heap-allocated array of
+// key strings. Caller is responsible for
+// freeing returned pointer.
+char **cuckoo_get_keys(cuckoo_tbl tbl)
+{
+    if (!tbl) {
+        return NULL;
+    }
+
+    struct collect_arg c = {calloc(tbl->numentries + 1, sizeof(char *)), 0, false};
+    if (c.arr) {
+        cuckoo_foreach(tbl, collect_entry, &c);
+    }
+    return c.arr;
+}
+
+// Returns pointer to heap-allocated array of
+// val strings in the same order as cuckoo_get_keys.
+// Caller is responsible for freeing returned pointer.
+char **cuckoo_get_vals(cuckoo_tbl tbl)
+{
+    if (!tbl) {
+        return NULL;
+    }
+
+    struct collect_arg c = {calloc(tbl->numentries + 1, sizeof(char *)), 0, true};
+    if (c.arr) {
+        cuckoo_foreach(tbl, collect_entry, &c);
+    }
+    return c.arr;
+}
+
+// Call fn for every key-value pair in table
+// order. Stops early if fn returns nonzero.
+// Returns 1, or -1 if tbl is NULL.
+int cuckoo_foreach(cuckoo_tbl tbl, ck_iter_fn fn, void *arg)
+{
+    if (!tbl || !fn) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < tbl->arr.numbuckets; i++) {
+        struct bucket *bkt = &tbl->arr.buckets[i];
+        for (int s = 0; s < CK_BUCKET_SLOTS; s++) {
+            struct ck_node *node = bkt->nodes[s];
+            if (node && fn(node_key(node), node_val(node), arg) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    if (tbl->stash) {
+        fn(node_key(tbl->stash), node_val(tbl->stash), arg);
+    }
+    return 1;
+}
+
+// Slot positions are numbered bucket by bucket,
+// and the stash follows the last slot
+size_t cuckoo_scan(cuckoo_tbl tbl, size_t cursor, ck_iter_fn fn, void *arg)
+{
+    if (!tbl || !fn) {
+        return 0;
+    }
+
+    size_t end = tbl->arr.numbuckets * CK_BUCKET_SLOTS + 1;
+    size_t pos = cursor;
+    while (pos < end) {
+        struct ck_node *node = slot_node(tbl, pos++);
+        if (node && fn(node_key(node), node_val(node), arg) != 0) {
+            break;
+        }
+    }
+
+    while (pos < end && !slot_node(tbl, pos)) {
+        pos++;
+    }
+    return pos < end ? pos : 0;
+}
+
+// Appends entries to write buffer for
+// cuckoo_write_fd, queueing its write when full
+struct write_arg {
+    file_writer fw;
+    char *buff;
+    size_t len;
+    off_t offset;       // File offset of buff
+    bool failed;
+};
+
+static int write_entry(const char *key, const char *val, void *arg)
+{
+    struct write_arg *w = arg;
+    size_t keylen = strlen(key);
+    size_t vallen = strlen(val);
+    size_t reclen = 2 + keylen + vallen;
+
+    if (w->len + reclen > WRITE_BUF_SIZE) {
+        if (fw_write(w->fw, w->buff, w->len, w->offset) < 0 ||
+            !(w->buff = fw_buffer(w->fw))) {
+            w->failed = true;
+            return 1;
+        }
+        w->offset += w->len;
+        w->len = 0;
+    }
+
+    char *p = w->buff + w->len;
+    p[0] = (char) keylen;
+    p[1] = (char) vallen;
+    memcpy(p + 2, key, keylen);
+    memcpy(p + 2 + keylen, val, vallen);
+    w->len += reclen;
+    return 0;
+}
+
+// Write all entries to file open for writing at fd,
+// starting at the current file offset, and flush it
+// to disk with fsync if sync is true. The file offset
+// is left after the table.
+// Returns number of bytes written, -1 on error.
+// Caller is responsible for closing fd.
+ssize_t cuckoo_write_fd(cuckoo_tbl tbl, int fd, bool sync)
+{
+    if (!tbl || fd < 0) {
+        return -1;
+    }
+
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (start < 0) {
+        return -1;
+    }
+    struct write_arg w = {fw_open(fd, WRITE_BUF_SIZE), NULL, 0, start, false};
+    if (!w.fw) {
+        return -1;
+    }
+    w.buff = fw_buffer(w.fw);
+
+    struct file_header hdr = {0};
+    memcpy(hdr.magic, FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = FILE_VERSION;
+    hdr.entries = tbl->numentries;
+    memcpy(w.buff, &hdr, sizeof(hdr));
+    w.len = sizeof(hdr);
+
+    cuckoo_foreach(tbl, write_entry, &w);
+    if (!w.failed && fw_finish(w.fw, w.buff, w.len, w.offset, sync) < 0) {
+        w.failed = true;
+    }
+    w.offset += w.len;
+    if (fw_close(w.fw) < 0 || w.failed || lseek(fd, w.offset, SEEK_SET) < 0) {
+        return -1;
+    }
+
+    return (ssize_t) (w.offset - start);
+}
+
+// Load table from file written by cuckoo_write_fd.
+// Input - file descriptor open for reading.
+// Returns NULL if fd does not hold a cuckoo table
+// or on memory allocation failure.
+// Caller is responsible for closing fd.
+cuckoo_tbl cuckoo_load_fd(int fd)
+{
+    struct file_header hdr;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || lseek(fd, 0, SEEK_SET) < 0 ||
+        read_full(fd, (char *) &hdr, sizeof(hdr)) < 0 ||
+        memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != FILE_VERSION || (off_t) sizeof(hdr) > st.st_size) {
+        return NULL;
+    }
+
+    size_t datalen = st.st_size - sizeof(hdr);
+    if (hdr.entries > datalen / 2) {
+        return NULL;
+    }
+
+    char *data = malloc(datalen + 1);
+    cuckoo_tbl tbl = data ? cuckoo_init(hdr.entries) : NULL;
+    if (!tbl || read_full(fd, data, datalen) < 0) {
+        free(data);
+        cuckoo_destroy(tbl);
+        return NULL;
+    }
+
+    char keybuff[ENTRY_LEN_MAX + 1];
+    char valbuff[ENTRY_LEN_MAX + 1];
+    size_t pos = 0;
+    for (uint64_t i = 0; i < hdr.entries; i++) {
+        if (pos + 2 > datalen) {
+            break;
+        }
+        size_t keylen = (unsigned char) data[pos];
+        size_t vallen = (unsigned char) data[pos + 1];
+        if (pos + 2 + keylen + vallen > datalen) {
+            break;
+        }
+        memcpy(keybuff, data + pos + 2, keylen);
+        keybuff[keylen] = '\0';
+        memcpy(valbuff, data + pos + 2 + keylen, vallen);
+        valbuff[vallen] = '\0';
+        pos += 2 + keylen + vallen;
+
+        if (cuckoo_put(tbl, keybuff, valbuff) == -2) {
+            break;
+        }
+    }
+    free(data);
+
+    if (pos != datalen) {
+        cuckoo_destroy(tbl);
+        return NULL;
+    }
+    return tbl;
+}
+
+// Copy table counters to stats.
+void cuckoo_get_stats(cuckoo_tbl tbl, struct cuckoo_stats *stats)
+{
+    if (!tbl || !stats) {
+        return;
+    }
+
+    stats->entries = tbl->numentries;
+    stats->buckets = tbl->arr.numbuckets;
+    stats->kicks = tbl->kicks;
+    stats->max_kicks = tbl->max_kicks;
+    stats->resizes = tbl->resizes;
+}
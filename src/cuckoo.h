@@ -0,0 +1,129 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Cuckoo hash table.
+ *
+ * Every key has two candidate buckets of
+ * CK_BUCKET_SLOTS slots each, chosen by two hash
+ * functions, and is always stored in one of them.
+ * A lookup checks at most 2 * CK_BUCKET_SLOTS slots,
+ * so lookups take constant time in the worst case,
+ * not only on average. An insert into two full
+ * buckets moves an existing entry to its other
+ * bucket, repeating until a free slot is found;
+ * the table is doubled if this takes too long.
+ *
+ */
+
+#ifndef CUCKOO_H
+#define CUCKOO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum {
+    CK_BUCKET_SLOTS = 4
+};
+
+// cuckoo table object handle
+typedef struct cuckoo_obj *cuckoo_tbl;
+
+// Table counters
+struct cuckoo_stats {
+    size_t entries;
+    size_t buckets;
+    size_t kicks;       // Entries moved to their other bucket by inserts
+    size_t max_kicks;   // Longest chain of moves for one insert
+    size_t resizes;
+};
+
+// Called by cuckoo_foreach for each entry.
+// Return nonzero to stop iteration.
+typedef int (*ck_iter_fn)(const char *key, const char *val, void *arg);
+
+// Returns handle to table allocated on heap with
+// room for at least capacity entries.
+// Returns NULL on failure.
+// Free with cuckoo_destroy function.
+cuckoo_tbl cuckoo_init(size_t capacity);
+
+void cuckoo_destroy(cuckoo_tbl tbl);
+
+// Grow table to hold capacity entries without
+// rebuilding. Never shrinks the table.
+// Returns -2 on memory allocation failure,
+// 1 on success.
+int cuckoo_reserve(cuckoo_tbl tbl, size_t capacity);
+
+// Input: two strings, key and val, to be added to table.
+// Output: -1 if key already exists,
+//         -2 on memory allocation failure,
+//          1 on success.
+int cuckoo_put(cuckoo_tbl tbl, const char *key, const char *val);
+
+// Searches for value associated with key.
+// If found, copies value to dst.
+// Returns length of value string copied to dst.
+// Returns 0 on error or if value not found.
+size_t cuckoo_find(char *dst, size_t dsize, cuckoo_tbl tbl, const char *key);
+
+bool cuckoo_exists(cuckoo_tbl tbl, const char *key);
+
+// key and value removed
+// running multiple times on same key has no effect
+void cuckoo_delete(cuckoo_tbl tbl, const char *key);
+
+size_t cuckoo_count(cuckoo_tbl tbl);
+
+// Returns bytes of heap memory held by table,
+// including bucket array and all entries
+size_t cuckoo_mem_usage(cuckoo_tbl tbl);
+
+// Returns pointer to heap-allocated array of
+// key strings. Caller is responsible for
+// freeing returned pointer.
+char **cuckoo_get_keys(cuckoo_tbl tbl);
+
+// Returns pointer to heap-allocated array of
+// val strings in the same order as cuckoo_get_keys.
+// Caller is responsible for freeing returned pointer.
+char **cuckoo_get_vals(cuckoo_tbl tbl);
+
+// Call fn for every key-value pair in table
+// order. Stops early if fn returns nonzero.
+// Returns 1, or -1 if tbl is NULL.
+int cuckoo_foreach(cuckoo_tbl tbl, ck_iter_fn fn, void *arg);
+
+// Call fn for entries in table order starting at
+// slot cursor (0 for the first) until fn returns
+// nonzero. Returns cursor of the next entry to visit,
+// or 0 if no entries are left. Scanning with the
+// returned cursors visits every entry once if the
+// table is not changed between calls.
+size_t cuckoo_scan(cuckoo_tbl tbl, size_t cursor, ck_iter_fn fn, void *arg);
+
+// Write all entries to file open for writing at fd,
+// starting at the current file offset, and flush it
+// to disk with fsync if sync is true.
+// Returns number of bytes written, -1 on error.
+// Caller is responsible for closing fd.
+ssize_t cuckoo_write_fd(cuckoo_tbl tbl, int fd, bool sync);
+
+// Load table from file written by cuckoo_write_fd.
+// Input - file descriptor open for reading.
+// Returns NULL if fd does not hold a cuckoo table
+// or on memory allocation failure.
+// Caller is responsible for closing fd.
+cuckoo_tbl cuckoo_load_fd(int fd);
+
+// Copy table counters to stats.
+void cuckoo_get_stats(cuckoo_tbl tbl, struct cuckoo_stats *stats);
+
+#endif // CUCKOO_H
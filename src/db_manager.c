@@ -14,13 +14,33 @@
  * interact with a database. The db_mgr object can work
  * with only 1 current table at any one time, but can save
  * multiple tables. A table can be set to current with
- * the get_new_tbl or use_tbl functions. Use the
+ * the get_new_tbl or use_tbl functions. Tables used
+ * earlier stay open in an open table cache, so switching
+ * back to them does not reload them from disk. Updated
+ * tables are saved when they are closed to keep the
+ * cache within its memory budget. Use the
  * save_curr_tbl function to write the current table
- * to disk. Data can be accessed in multiple ways - one
+ * to disk, and save_all_tbls to write all updated open
+ * tables. Data can be accessed in multiple ways - one
  * key-value pair at a time, a list of keys, a list of
  * values. The user is responsible for freeing the db_mgr
  * with the destroy_db_mgr function.
  *
+ * Saved tables are recorded in the table catalog
+ * (see catalog.h) with their file name, engine, and
+ * size. The catalog is memory mapped, so startup
+ * time does not depend on the number of tables.
+ *
+ * Each table uses a storage engine (see engine.h),
+ * chosen when the table is created and recorded with
+ * the table file name in the catalog. The table list
+ * of earlier versions is only read once, to import
+ * it into the catalog. All table
+ * operations go through the engine of the table.
+ * Files of file engines are written by db_manager
+ * with the current durability mode; directory engines
+ * write their own files.
+ *
  */
 
 
@@ -28,315 +48,1845 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "pairdbconst.h"
 #include "db_manager.h"
 #include "hashtable.h"
+#include "engine.h"
+#include "catalog.h"
+#include "bulkio.h"
 #include "stringutil.h"
 
 // File/path string constants
 // Name of file for list of tables managed by db_mgr
 static const char *PAIRDB_DIR = "pairdb-data";
+static const char *CATALOG_FNAME = "catalog";
+static const char *CATALOG_FILE_EXT = ".idx";
+
+// Table list of earlier versions - imported
+// into the catalog on first start
 static const char *TBL_LIST_FNAME = "tbl_list";
 static const char *PDB_FILE_EXT = ".pairdb";
+static const char *TMP_FILE_EXT = ".tmp";
+
+// Separates table file name from engine name
+// in old table list entries - "<fname>:<engine>".
+// Entries with no engine name use the default
+// hash engine.
+static const char ENGINE_SEP = ':';
 
 enum {
-    INIT_HASHTBL_SIZE = 32,
-    TBL_FNAME_LEN = 11  // 10 digit random string + '\0'
+    DEFAULT_GROUP_MS = 100,
+    MAX_LOAD_THREADS = 8,
+    MIN_OPEN_INDEX = 16     // Buckets of open table name index, a power of 2
+};
+
+static const size_t DEFAULT_CACHE_BUDGET = (size_t) 256 * 1024 * 1024;
+
+// Names of DB_EV_ flags, lowest bit first
+static const char *EVENT_NAMES[] = {
+    "load", "save", "full-save", "resize", "evict", "fork", "bgsave-wait"
+};
+
+// Table held open in memory by db_mgr. Open tables
+// form a list in least recently used order - head
+// is the most recently used table - and are
+// indexed by name in a chained hash table.
+struct open_tbl {
+    char *name;
+    const struct tbl_engine *eng;
+    void *tbl;      // Table handle of eng
+
+    // Indicates whether table has been updated
+    // since opening or since it was last saved
+    bool updated;
+
+    // Memory of table counted in cache resident
+    // total, as of the last time it was measured
+    size_t mem;
+
+    struct open_tbl *prev;
+    struct open_tbl *next;
+    struct open_tbl *hnext;     // Next in name index bucket
+};
+
+// Table file written under DUR_GROUP, waiting for
+// the next group commit to fsync it. A full save is
+// written to tmppath and renamed over path after
+// fsync. An in-place save has tmppath set to NULL.
+struct pending_save {
+    int fd;
+    char *tmppath;
+    char *path;
+    struct pending_save *next;
 };
 
 // Struct managed through handle declared in
 // db_manager.h:
 // typedef struct db_manager *db_mgr
 struct db_manager {
-    // Name of current table that
-    // db_mgr can perform operations on
-    char *curr_tbl_name;
-
-    // Hashtable holding data for current table
-    hashtbl curr_tbl;
-
-    // Indicates whether current table has been
-    // updated since opening or since it was
-    // last saved
-    bool curr_tbl_updated;
-
-    // List of all tables currently saved on disk
-    // A table is initially added to active_tbls
-    // when the save_curr_tbl function is called
-    // on a table for the first time
-    hashtbl active_tbls;
-
-    // Name of file that holds active_tbls data
-    char *active_tbls_fname;
+    // Current table that db_mgr can perform
+    // operations on - always one of the open
+    // tables, or NULL if no table is selected
+    struct open_tbl *curr;
+
+    // Open table cache. Tables stay open after
+    // switching to another table, so switching
+    // back needs no load from disk. When the
+    // memory held by open tables exceeds
+    // cache_budget, least recently used tables
+    // are saved if updated and closed. The
+    // current table is never closed this way.
+    struct open_tbl *lru_head;
+    struct open_tbl *lru_tail;
+    size_t cache_budget;
+    struct cache_stats cache_stats;
+
+    // Name index of open tables, with index_size
+    // buckets, and running totals of open tables
+    // and their memory. Tables are changed through
+    // the current table, so the total is kept up
+    // to date by measuring the current table when
+    // another becomes current and before use.
+    struct open_tbl **index;
+    size_t index_size;
+    size_t num_open;
+    size_t resident;
+
+    // Catalog of all tables saved on disk.
+    // A file engine table is added when it is
+    // saved for the first time, a directory
+    // engine table when it is created.
+    catalog cat;
+
+    // Background save state. bgsave_pid is the
+    // child process writing a snapshot (0 if no
+    // save is running) and bgsave_fd is the read
+    // end of the pipe the child reports through.
+    pid_t bgsave_pid;
+    int bgsave_fd;
+    char bgsave_tbl_name[TBL_NAME_MAX];
+    struct timespec bgsave_start;
+
+    // Result of the last finished background save,
+    // held until it is reported by poll_bgsave
+    struct bgsave_info bgsave_last;
+    bool bgsave_unreported;
+
+    // Durability mode and save counters. Under
+    // DUR_GROUP, saves are queued on pending and
+    // committed by the flusher thread every
+    // group_ms milliseconds. pending_lock guards
+    // pending and dur_stats.
+    enum durability dur_mode;
+    unsigned int group_ms;
+    struct durability_stats dur_stats;
+    struct pending_save *pending;
+    pthread_mutex_t pending_lock;
+    pthread_cond_t flusher_cond;
+    pthread_t flusher;
+    bool flusher_running;
+    bool flusher_stop;
+
+    // Path of directory holding table files -
+    // flushed after renames so new directory
+    // entries survive a crash
+    char *data_dir;
+
+    // Threads used to load large tables from disk
+    unsigned load_threads;
+
+    // Command latencies, and DB_EV_ flags of work
+    // done since the current command started
+    latency lat;
+    unsigned events;
+};
+
+// Result sent from background save child process
+// to parent through pipe
+struct bgsave_result {
+    int success;
+    size_t bytes;
 };
 
 /*------------- Static functions -----------------*/
 
-// Input: file name without ".pairdb" file extension.
+// Input: file name without file extension.
 // Allocates string on heap:
-//     absolute_pairdb_dir_path + input_file_name + ".pairdb"
-// Use return value to write to and read from file.
+//     absolute_pairdb_dir_path + input_file_name + ext
 // Caller is responsible for freeing allocated string.
-static char *get_full_path(const char *fname)
+static char *get_full_path_ext(const char *fname, const char *ext)
 {
     const char *home = getenv("HOME");
     size_t buffsize = strlen(home) + 1 +         // Add 1 for '/'
                       strlen(PAIRDB_DIR) + 1 +   // Add 1 for '/'
                       strlen(fname) +
-                      strlen(PDB_FILE_EXT) + 1;  // Add 1 for terminating nul char
+                      strlen(ext) + 1;           // Add 1 for terminating nul char
     char *fullpath = calloc(1, buffsize);
+    if (!fullpath) {
+        return NULL;
+    }
     strcat(fullpath, home);
     strcat(fullpath, "/");
     strcat(fullpath, PAIRDB_DIR);
     strcat(fullpath, "/");
     strcat(fullpath, fname);
-    strcat(fullpath, PDB_FILE_EXT);
+    strcat(fullpath, ext);
     return fullpath;
 }
 
-/* ----------- End static functions ----------------*/
+// Input: file name without ".pairdb" file extension.
+// Allocates string on heap:
+//     absolute_pairdb_dir_path + input_file_name + ".pairdb"
+// Use return value to write to and read from file.
+// Caller is responsible for freeing allocated string.
+static char *get_full_path(const char *fname)
+{
+    return get_full_path_ext(fname, PDB_FILE_EXT);
+}
 
-// Returns NULL on memory allocation error
-db_mgr init_db_mgr()
+// Allocates path of table file or directory
+// of engine eng for fname.
+// Caller is responsible for freeing allocated string.
+static char *get_tbl_path(const char *fname, const struct tbl_engine *eng)
 {
-    db_mgr ptr = calloc(1, sizeof(struct db_manager));
-    if (!ptr) {
+    return get_full_path_ext(fname, eng->ext);
+}
+
+// Allocates string on heap: absolute_pairdb_dir_path
+// Caller is responsible for freeing allocated string.
+static char *get_data_dir(void)
+{
+    const char *home = getenv("HOME");
+    size_t buffsize = strlen(home) + 1 +         // Add 1 for '/'
+                      strlen(PAIRDB_DIR) + 1;    // Add 1 for terminating nul char
+    char *dirpath = calloc(1, buffsize);
+    if (!dirpath) {
+        return NULL;
+    }
+    strcat(dirpath, home);
+    strcat(dirpath, "/");
+    strcat(dirpath, PAIRDB_DIR);
+    return dirpath;
+}
+
+// Allocates string on heap: path + ".tmp"
+static char *get_tmp_path(const char *path)
+{
+    char *tmppath = calloc(1, strlen(path) + strlen(TMP_FILE_EXT) + 1);
+    if (!tmppath) {
         return NULL;
     }
+    strcat(tmppath, path);
+    strcat(tmppath, TMP_FILE_EXT);
+    return tmppath;
+}
+
+// fsync directory so that renamed
+// directory entries are durable
+static int sync_dir(const char *dirpath)
+{
+    int fd = open(dirpath, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+static void free_pending(struct pending_save *p)
+{
+    free(p->tmppath);
+    free(p->path);
+    free(p);
+}
+
+// Group commit - fsync all pending table files,
+// rename each over its table file, then fsync the
+// data directory once for the whole group.
+// Caller must hold pending_lock.
+static void flush_pending_locked(db_mgr dbm)
+{
+    if (!dbm->pending) {
+        return;
+    }
+
+    struct pending_save *p = dbm->pending;
+    while (p) {
+        struct pending_save *next = p->next;
+        // tmppath is NULL for files updated in place
+        if (p->tmppath) {
+            if (fsync(p->fd) == 0) {
+                rename(p->tmppath, p->path);
+            }
+            else {
+                unlink(p->tmppath);
+            }
+        }
+        else {
+            fsync(p->fd);
+        }
+        dbm->dur_stats.fsyncs++;
+        close(p->fd);
+        free_pending(p);
+        p = next;
+    }
+    dbm->pending = NULL;
+
+    sync_dir(dbm->data_dir);
+    dbm->dur_stats.fsyncs++;
+    dbm->dur_stats.group_commits++;
+}
+
+static void flush_pending(db_mgr dbm)
+{
+    pthread_mutex_lock(&dbm->pending_lock);
+    flush_pending_locked(dbm);
+    pthread_mutex_unlock(&dbm->pending_lock);
+}
+
+// Flusher thread for DUR_GROUP - commits
+// pending saves every group_ms milliseconds
+static void *flusher_main(void *arg)
+{
+    db_mgr dbm = arg;
+
+    pthread_mutex_lock(&dbm->pending_lock);
+    while (!dbm->flusher_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += dbm->group_ms / 1000;
+        deadline.tv_nsec += (long) (dbm->group_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        int rc = 0;
+        while (!dbm->flusher_stop && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&dbm->flusher_cond,
+                                        &dbm->pending_lock, &deadline);
+        }
+        flush_pending_locked(dbm);
+    }
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    return NULL;
+}
+
+static void stop_flusher(db_mgr dbm)
+{
+    if (!dbm->flusher_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&dbm->pending_lock);
+    dbm->flusher_stop = true;
+    pthread_cond_signal(&dbm->flusher_cond);
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    pthread_join(dbm->flusher, NULL);
+    dbm->flusher_running = false;
+    dbm->flusher_stop = false;
+}
+
+// Remove pending save for path from pending list.
+// Caller must hold pending_lock.
+static void drop_pending_locked(db_mgr dbm, const char *path)
+{
+    struct pending_save **pp = &dbm->pending;
+    while (*pp) {
+        if (strcmp((*pp)->path, path) == 0) {
+            struct pending_save *old = *pp;
+            *pp = old->next;
+            close(old->fd);
+            free_pending(old);
+            return;
+        }
+        pp = &(*pp)->next;
+    }
+}
+
+// Returns true if a save to path is queued
+// for group commit. Caller must hold pending_lock.
+static bool is_pending_locked(db_mgr dbm, const char *path)
+{
+    for (struct pending_save *p = dbm->pending; p; p = p->next) {
+        if (strcmp(p->path, path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Queue fd for the next group commit. tmppath is
+// renamed over path at commit - NULL if fd is the
+// table file itself, updated in place. Takes
+// ownership of fd and tmppath.
+// Returns -1 on memory allocation failure.
+// Caller must hold pending_lock.
+static int add_pending_locked(db_mgr dbm, int fd, char *tmppath, const char *path)
+{
+    struct pending_save *p = calloc(1, sizeof(struct pending_save));
+    if (!p) {
+        return -1;
+    }
+    p->path = strdup(path);
+    if (!p->path) {
+        free(p);
+        return -1;
+    }
+    p->fd = fd;
+    p->tmppath = tmppath;
+    p->next = dbm->pending;
+    dbm->pending = p;
+    return 1;
+}
+
+// Update table file at path in place, writing
+// only changes since the last save. The file must
+// already hold this table as of its last save.
+// Caller must hold pending_lock.
+// Returns number of bytes written, 0 on failure.
+static size_t commit_tbl_delta_locked(db_mgr dbm, const struct tbl_engine *eng,
+                                      void *tbl, const char *path)
+{
+    // An in-place save of a file already queued for
+    // group commit is covered by the queued fsync
+    bool queued = is_pending_locked(dbm, path);
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // DUR_ON_SAVE - the engine flushes the file
+    // after its last write
+    bool sync = (dbm->dur_mode == DUR_ON_SAVE);
+    ssize_t bytes = eng->persist(tbl, fd, false, sync);
+    if (bytes <= 0) {
+        close(fd);
+        return 0;
+    }
+
+    if (dbm->dur_mode == DUR_GROUP && !queued) {
+        if (add_pending_locked(dbm, fd, NULL, path) < 0) {
+            bytes = (fsync(fd) == 0) ? bytes : 0;
+            close(fd);
+        }
+        return (size_t) bytes;
+    }
+
+    dbm->dur_stats.fsyncs += sync;
+    close(fd);
+
+    return (size_t) bytes;
+}
+
+// Write table to temporary file next to path,
+// then commit the file according to durability mode.
+// The file at path is replaced only by rename of a
+// completely written file. Caller must hold pending_lock.
+// Returns number of bytes written, 0 on failure.
+static size_t commit_tbl_full_locked(db_mgr dbm, const struct tbl_engine *eng,
+                                     void *tbl, const char *path)
+{
+    char *tmppath = get_tmp_path(path);
+    if (!tmppath) {
+        return 0;
+    }
+
+    // A save queued for the same file is superseded
+    // by this one - it is written to the same
+    // temporary file
+    drop_pending_locked(dbm, path);
+
+    int fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmppath);
+        return 0;
+    }
+
+    bool sync = (dbm->dur_mode == DUR_ON_SAVE);
+    ssize_t bytes = eng->persist(tbl, fd, true, sync);
+    if (bytes <= 0) {
+        bytes = 0;
+    }
+
+    if (bytes > 0 && dbm->dur_mode == DUR_GROUP) {
+        if (add_pending_locked(dbm, fd, tmppath, path) > 0) {
+            return (size_t) bytes;
+        }
+        bytes = 0;
+    }
+    dbm->dur_stats.fsyncs += sync;
+    close(fd);
+
+    // DUR_NONE and DUR_ON_SAVE - commit now
+    if (bytes == 0 || rename(tmppath, path) < 0) {
+        unlink(tmppath);
+        bytes = 0;
+    }
+    else if (dbm->dur_mode == DUR_ON_SAVE) {
+        sync_dir(dbm->data_dir);
+        dbm->dur_stats.fsyncs++;
+    }
+    free(tmppath);
+
+    return (size_t) bytes;
+}
+
+// Save table of file engine eng to table file at
+// path. The file is rewritten in full through a
+// temporary file if it does not exist yet or the
+// engine needs a full write, and is updated in
+// place with only the changes otherwise.
+// Returns number of bytes written, 0 on failure.
+static size_t commit_tbl_file(db_mgr dbm, const struct tbl_engine *eng,
+                              void *tbl, const char *path)
+{
+    pthread_mutex_lock(&dbm->pending_lock);
+
+    bool full = !eng->needs_full || eng->needs_full(tbl);
+
+    size_t bytes;
+    if (!full && access(path, F_OK) == 0) {
+        // A full rewrite still waiting for group
+        // commit must be renamed into place first
+        struct pending_save *p = dbm->pending;
+        while (p && !(p->tmppath && strcmp(p->path, path) == 0)) {
+            p = p->next;
+        }
+        if (p) {
+            flush_pending_locked(dbm);
+        }
+        bytes = commit_tbl_delta_locked(dbm, eng, tbl, path);
+        dbm->events |= DB_EV_SAVE;
+    }
+    else {
+        bytes = commit_tbl_full_locked(dbm, eng, tbl, path);
+        dbm->events |= DB_EV_FULL_SAVE;
+    }
+
+    if (bytes > 0) {
+        dbm->dur_stats.saves++;
+        dbm->dur_stats.bytes += bytes;
+    }
+    else if (eng->mark_saved) {
+        // Changes may be partly written -
+        // next save rewrites the whole file
+        eng->mark_saved(tbl, false);
+    }
+
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    return bytes;
+}
+
+// Flush catalog changes to disk unless durability
+// mode is DUR_NONE. Catalog changes are small and
+// infrequent - DUR_GROUP flushes them immediately
+// like DUR_ON_SAVE.
+static int sync_catalog(db_mgr dbm)
+{
+    if (dbm->dur_mode == DUR_NONE) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&dbm->pending_lock);
+    dbm->dur_stats.fsyncs++;
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    return catalog_sync(dbm->cat);
+}
+
+// Disk space used by file at path, or by all
+// files in directory at path
+static uint64_t path_disk_bytes(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return (uint64_t) st.st_blocks * 512;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    int dfd = dirfd(dir);
+    uint64_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (fstatat(dfd, de->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            total += (uint64_t) st.st_blocks * 512;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+// Record entry count and size of open table in
+// catalog after a save. Directory engine tables
+// are not counted, since counting may read every
+// table file. Not flushed to disk by itself - the
+// record is written back with other catalog changes
+// or by the operating system.
+static void record_tbl_stats(db_mgr dbm, struct open_tbl *ot)
+{
+    struct cat_entry entry;
+    if (!catalog_find(dbm->cat, ot->name, &entry)) {
+        return;
+    }
+
+    char *path = get_tbl_path(entry.fname, ot->eng);
+    if (!path) {
+        return;
+    }
+
+    uint64_t entries = ot->eng->dir_storage ? CAT_ENTRIES_UNKNOWN
+                                            : ot->eng->count(ot->tbl);
+    catalog_set_stats(dbm->cat, ot->name, entries, path_disk_bytes(path),
+                      (int64_t) time(NULL));
+    free(path);
+}
+
+// Look up table in catalog. Writes file name
+// to fname (CAT_FNAME_MAX bytes) and sets eng.
+// Returns false if table is not in catalog
+// or its engine is unknown.
+static bool find_tbl_entry(db_mgr dbm, char *tblname, char *fname,
+                           const struct tbl_engine **eng)
+{
+    struct cat_entry entry;
+    if (!catalog_find(dbm->cat, tblname, &entry)) {
+        return false;
+    }
+
+    *eng = find_engine(entry.engine);
+    if (!*eng) {
+        return false;
+    }
+    strtcpy(fname, entry.fname, CAT_FNAME_MAX);
+    return true;
+}
+
+// Get file name for table from catalog.
+// If the table has not been saved before, a new
+// file name is allocated and the table is added
+// to the catalog with its engine.
+// Writes file name to fname (CAT_FNAME_MAX bytes).
+// Returns -1 on failure, 1 on success.
+static int get_tbl_fname(db_mgr dbm, char *tblname, const struct tbl_engine *eng,
+                         char *fname)
+{
+    const struct tbl_engine *found;
+    if (find_tbl_entry(dbm, tblname, fname, &found)) {
+        return 1;
+    }
+
+    struct cat_entry entry = {0};
+    strtcpy(entry.name, tblname, TBL_NAME_MAX);
+    strtcpy(entry.engine, eng->name, CAT_ENGINE_MAX);
+    entry.mtime = (int64_t) time(NULL);
+
+    // Skip file names left on disk by a table
+    // created before a crash but never recorded
+    char *path = NULL;
+    do {
+        free(path);
+        if (catalog_new_fname(dbm->cat, entry.fname) < 0) {
+            return -1;
+        }
+        path = get_tbl_path(entry.fname, eng);
+    } while (path && access(path, F_OK) == 0);
+    if (!path) {
+        return -1;
+    }
+    free(path);
+
+    if (catalog_add(dbm->cat, &entry) < 0) {
+        return -1;
+    }
+    sync_catalog(dbm);
+
+    strtcpy(fname, entry.fname, CAT_FNAME_MAX);
+    return 1;
+}
+
+// Adds each entry of old table list to catalog
+struct import_arg {
+    db_mgr dbm;
+    int failed;
+};
+
+static int import_tbl_entry(const char *key, const char *val, void *arg)
+{
+    struct import_arg *imp = arg;
+
+    struct cat_entry entry = {0};
+    strtcpy(entry.name, key, TBL_NAME_MAX);
+    strtcpy(entry.fname, val, CAT_FNAME_MAX);
+    const struct tbl_engine *eng = default_engine();
+    char *sep = strchr(entry.fname, ENGINE_SEP);
+    if (sep) {
+        *sep = '\0';
+        eng = find_engine(val + (sep - entry.fname) + 1);
+    }
+    if (!eng) {
+        imp->failed = 1;
+        return 0;
+    }
+    strtcpy(entry.engine, eng->name, CAT_ENGINE_MAX);
+    entry.entries = CAT_ENTRIES_UNKNOWN;
+
+    char *path = get_tbl_path(entry.fname, eng);
+    if (path) {
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            entry.mtime = (int64_t) st.st_mtime;
+        }
+        entry.bytes = path_disk_bytes(path);
+        free(path);
+    }
+
+    if (catalog_add(imp->dbm->cat, &entry) == -2) {
+        imp->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Import table list file written by earlier versions
+// into catalog, then remove it. The table list is
+// kept if any entry cannot be imported.
+static void import_tbl_list(db_mgr dbm)
+{
+    char *path = get_full_path(TBL_LIST_FNAME);
+    if (!path || access(path, F_OK) < 0) {
+        free(path);
+        return;
+    }
+
+    hashtbl list = default_engine()->open(path, 1);
+    if (!list) {
+        free(path);
+        return;
+    }
+
+    struct import_arg imp = {dbm, 0};
+    hashtbl_foreach(list, import_tbl_entry, &imp);
+    destroy_hashtbl(list);
+
+    if (!imp.failed && catalog_sync(dbm->cat) > 0) {
+        unlink(path);
+        sync_dir(dbm->data_dir);
+    }
+    free(path);
+}
+
+// Find open table by name.
+// Returns NULL if table is not open.
+static struct open_tbl *find_open_tbl(db_mgr dbm, const char *tblname)
+{
+    size_t pos = hash_key(tblname) & (dbm->index_size - 1);
+    for (struct open_tbl *ot = dbm->index[pos]; ot; ot = ot->hnext) {
+        if (strcmp(ot->name, tblname) == 0) {
+            return ot;
+        }
+    }
+    return NULL;
+}
+
+// Double number of name index buckets. The index
+// is left unchanged if the new buckets cannot be
+// allocated - lookups only become slower.
+static void grow_index(db_mgr dbm)
+{
+    size_t newsize = dbm->index_size * 2;
+    struct open_tbl **newindex = calloc(newsize, sizeof(struct open_tbl *));
+    if (!newindex) {
+        return;
+    }
+
+    for (size_t i = 0; i < dbm->index_size; i++) {
+        struct open_tbl *ot = dbm->index[i];
+        while (ot) {
+            struct open_tbl *next = ot->hnext;
+            size_t pos = hash_key(ot->name) & (newsize - 1);
+            ot->hnext = newindex[pos];
+            newindex[pos] = ot;
+            ot = next;
+        }
+    }
+
+    free(dbm->index);
+    dbm->index = newindex;
+    dbm->index_size = newsize;
+}
+
+static void index_insert(db_mgr dbm, struct open_tbl *ot)
+{
+    if (dbm->num_open >= dbm->index_size) {
+        grow_index(dbm);
+    }
+    size_t pos = hash_key(ot->name) & (dbm->index_size - 1);
+    ot->hnext = dbm->index[pos];
+    dbm->index[pos] = ot;
+}
+
+static void index_remove(db_mgr dbm, struct open_tbl *ot)
+{
+    size_t pos = hash_key(ot->name) & (dbm->index_size - 1);
+    struct open_tbl **link = &dbm->index[pos];
+    while (*link && *link != ot) {
+        link = &(*link)->hnext;
+    }
+    if (*link) {
+        *link = ot->hnext;
+    }
+    ot->hnext = NULL;
+}
+
+// Remove open table from LRU list
+static void lru_unlink(db_mgr dbm, struct open_tbl *ot)
+{
+    if (ot->prev) {
+        ot->prev->next = ot->next;
+    }
+    else {
+        dbm->lru_head = ot->next;
+    }
+
+    if (ot->next) {
+        ot->next->prev = ot->prev;
+    }
+    else {
+        dbm->lru_tail = ot->prev;
+    }
+
+    ot->prev = NULL;
+    ot->next = NULL;
+}
+
+// Add open table to LRU list as most recently used
+static void lru_push_front(db_mgr dbm, struct open_tbl *ot)
+{
+    ot->prev = NULL;
+    ot->next = dbm->lru_head;
+    if (dbm->lru_head) {
+        dbm->lru_head->prev = ot;
+    }
+    dbm->lru_head = ot;
+    if (!dbm->lru_tail) {
+        dbm->lru_tail = ot;
+    }
+}
+
+// Allocate open table entry for a table using
+// engine eng. Set tbl field after allocating.
+// Returns NULL on memory allocation error.
+static struct open_tbl *new_open_tbl(const char *tblname, const struct tbl_engine *eng)
+{
+    struct open_tbl *ot = calloc(1, sizeof(struct open_tbl));
+    if (!ot) {
+        return NULL;
+    }
+
+    ot->name = strndup(tblname, TBL_NAME_MAX);
+    if (!ot->name) {
+        free(ot);
+        return NULL;
+    }
+
+    ot->eng = eng;
+    return ot;
+}
+
+// Free open table entry not added to the open
+// table cache, closing its table if set
+static void free_open_tbl(struct open_tbl *ot)
+{
+    if (ot->tbl) {
+        ot->eng->close(ot->tbl);
+    }
+    free(ot->name);
+    free(ot);
+}
+
+// Measure memory held by open table and update
+// cache resident total
+static void update_tbl_mem(db_mgr dbm, struct open_tbl *ot)
+{
+    size_t mem = ot->eng->mem_usage(ot->tbl);
+    dbm->resident = dbm->resident - ot->mem + mem;
+    ot->mem = mem;
+}
+
+// Apply durability mode to files a directory
+// engine writes on its own, such as lsm memtable
+// flushes. DUR_GROUP lets the engine sync them
+// together every group_ms.
+static void set_tbl_sync(db_mgr dbm, struct open_tbl *ot)
+{
+    if (ot->eng->set_sync) {
+        ot->eng->set_sync(ot->tbl, dbm->dur_mode == DUR_ON_SAVE,
+                          dbm->dur_mode == DUR_GROUP ? dbm->group_ms : 0);
+    }
+}
+
+// Add open table with its table set to open table
+// cache as most recently used
+static void add_open_tbl(db_mgr dbm, struct open_tbl *ot)
+{
+    set_tbl_sync(dbm, ot);
+    lru_push_front(dbm, ot);
+    index_insert(dbm, ot);
+    dbm->num_open++;
+    ot->mem = 0;
+    update_tbl_mem(dbm, ot);
+}
+
+// Remove table from open table cache without saving
+// and free its memory. Clears current table if ot
+// is the current table.
+static void close_open_tbl(db_mgr dbm, struct open_tbl *ot)
+{
+    lru_unlink(dbm, ot);
+    index_remove(dbm, ot);
+    dbm->num_open--;
+    dbm->resident -= ot->mem;
+    if (dbm->curr == ot) {
+        dbm->curr = NULL;
+    }
+    free_open_tbl(ot);
+}
+
+static double elapsed_msecs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Write table to temporary file next to path,
+// optionally flush to disk, then rename over path.
+// Used by background save child processes, which
+// commit their own snapshot. The file at path is
+// never left partially written.
+// Returns number of bytes written, 0 on failure.
+static size_t write_tbl_file(const struct tbl_engine *eng, void *tbl,
+                             const char *path, bool sync)
+{
+    char *tmppath = get_tmp_path(path);
+    if (!tmppath) {
+        return 0;
+    }
+
+    int fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmppath);
+        return 0;
+    }
+
+    ssize_t bytes = eng->persist(tbl, fd, true, sync);
+    close(fd);
+
+    if (bytes <= 0 || rename(tmppath, path) < 0) {
+        unlink(tmppath);
+        free(tmppath);
+        return 0;
+    }
+
+    free(tmppath);
+    return (size_t) bytes;
+}
+
+// Collect result of background save child process.
+// If wait is false, returns immediately when the
+// child is still running.
+static void reap_bgsave(db_mgr dbm, bool wait)
+{
+    if (dbm->bgsave_pid <= 0) {
+        return;
+    }
+
+    int status;
+    pid_t pid = waitpid(dbm->bgsave_pid, &status, WNOHANG);
+    if (pid == 0 && wait) {
+        dbm->events |= DB_EV_BGSAVE_WAIT;
+        pid = waitpid(dbm->bgsave_pid, &status, 0);
+    }
+    if (pid == 0) {
+        return;
+    }
+
+    struct bgsave_result res = {0};
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        read(dbm->bgsave_fd, &res, sizeof(res)) != sizeof(res)) {
+        res.success = 0;
+    }
+    close(dbm->bgsave_fd);
+
+    struct bgsave_info *info = &dbm->bgsave_last;
+    strtcpy(info->tbl_name, dbm->bgsave_tbl_name, TBL_NAME_MAX);
+    info->success = res.success;
+    info->bytes = res.bytes;
+    info->msecs = elapsed_msecs(&dbm->bgsave_start);
+    dbm->bgsave_unreported = true;
+
+    if (res.success) {
+        pthread_mutex_lock(&dbm->pending_lock);
+        dbm->dur_stats.saves++;
+        dbm->dur_stats.bytes += res.bytes;
+        if (dbm->dur_mode != DUR_NONE) {
+            dbm->dur_stats.fsyncs += 2;
+        }
+        pthread_mutex_unlock(&dbm->pending_lock);
+    }
+
+    dbm->bgsave_pid = 0;
+    dbm->bgsave_fd = -1;
+
+    // Changes captured by a failed snapshot
+    // still need to be saved
+    struct open_tbl *ot = find_open_tbl(dbm, dbm->bgsave_tbl_name);
+    if (res.success && ot) {
+        record_tbl_stats(dbm, ot);
+    }
+    if (!res.success && ot) {
+        ot->updated = true;
+        if (ot->eng->mark_saved) {
+            ot->eng->mark_saved(ot->tbl, false);
+        }
+    }
+}
+
+// Save table of directory engine. Files are
+// flushed with fsync in DUR_ON_SAVE mode. In
+// DUR_GROUP mode the engine syncs them together
+// with its other files every group_ms (set_tbl_sync);
+// engines that cannot sync files this way are
+// treated as in DUR_ON_SAVE mode.
+// Returns -1 on failure, 1 on success.
+static int save_dir_tbl(db_mgr dbm, struct open_tbl *ot)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    bool sync = (dbm->dur_mode == DUR_ON_SAVE ||
+                 (dbm->dur_mode == DUR_GROUP && !ot->eng->set_sync));
+    ssize_t bytes = ot->eng->persist(ot->tbl, -1, false, sync);
+    dbm->events |= DB_EV_SAVE;
+
+    pthread_mutex_lock(&dbm->pending_lock);
+    dbm->dur_stats.save_msecs += elapsed_msecs(&start);
+    if (bytes > 0) {
+        dbm->dur_stats.saves++;
+        dbm->dur_stats.bytes += bytes;
+        if (sync) {
+            // Table file and engine's file list
+            dbm->dur_stats.fsyncs += 2;
+        }
+    }
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    if (bytes < 0) {
+        return -1;
+    }
+
+    ot->updated = false;
+    record_tbl_stats(dbm, ot);
+    return 1;
+}
+
+// Write open table to disk if it has been updated.
+// The saved table is added to the catalog
+// if it is not there already.
+// Returns -1 on failure, 1 on success.
+static int save_open_tbl(db_mgr dbm, struct open_tbl *ot)
+{
+    // A running background save must finish first -
+    // it replaces the table file when it completes
+    // and may have failed to save current changes
+    reap_bgsave(dbm, true);
+
+    if (!ot->updated) {
+        return 1;
+    }
+
+    if (ot->eng->dir_storage) {
+        return save_dir_tbl(dbm, ot);
+    }
+
+    // if db exists - get file name from catalog
+    // else - create new file name
+    char fname[CAT_FNAME_MAX];
+    if (get_tbl_fname(dbm, ot->name, ot->eng, fname) < 0) {
+        return -1;
+    }
+
+    char *tbl_fname = get_tbl_path(fname, ot->eng);
+    if (!tbl_fname) {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t result = commit_tbl_file(dbm, ot->eng, ot->tbl, tbl_fname);
+
+    free(tbl_fname);
+
+    pthread_mutex_lock(&dbm->pending_lock);
+    dbm->dur_stats.save_msecs += elapsed_msecs(&start);
+    pthread_mutex_unlock(&dbm->pending_lock);
+
+    if (result > 0) {
+        ot->updated = false;
+        record_tbl_stats(dbm, ot);
+        return 1;
+    }
+    else {
+        return -1;
+    }
+}
+
+// Close least recently used tables until open
+// tables fit within cache_budget. Updated tables
+// are saved before closing; a table that fails to
+// save stays open. The current table stays open.
+static void evict_tbls(db_mgr dbm)
+{
+    if (dbm->curr) {
+        update_tbl_mem(dbm, dbm->curr);
+    }
+    struct open_tbl *ot = dbm->lru_tail;
+    while (ot && dbm->resident > dbm->cache_budget) {
+        struct open_tbl *prev = ot->prev;
+        if (ot != dbm->curr && save_open_tbl(dbm, ot) > 0) {
+            close_open_tbl(dbm, ot);
+            dbm->cache_stats.evictions++;
+            dbm->events |= DB_EV_EVICT;
+        }
+        ot = prev;
+    }
+}
+
+// Make open table the current table
+static void set_curr_tbl(db_mgr dbm, struct open_tbl *ot)
+{
+    // Count changes made to previous current table
+    if (dbm->curr && dbm->curr != ot) {
+        update_tbl_mem(dbm, dbm->curr);
+    }
+    lru_unlink(dbm, ot);
+    lru_push_front(dbm, ot);
+    dbm->curr = ot;
+    evict_tbls(dbm);
+}
+
+// Tables of directory engines need no snapshot
+// process - the engine writes only recent changes
+// and does the rest of its work in the background.
+// The save runs in the foreground and is reported
+// by poll_bgsave.
+// Returns 1, or -1 if the save fails.
+static int bgsave_dir_tbl(db_mgr dbm)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t bytes_before = dbm->dur_stats.bytes;
+
+    int result = save_open_tbl(dbm, dbm->curr);
+
+    struct bgsave_info *info = &dbm->bgsave_last;
+    strtcpy(info->tbl_name, dbm->curr->name, TBL_NAME_MAX);
+    info->success = (result > 0);
+    info->bytes = dbm->dur_stats.bytes - bytes_before;
+    info->msecs = elapsed_msecs(&start);
+    dbm->bgsave_unreported = true;
+
+    return result > 0 ? 1 : -1;
+}
+
+/* ----------- End static functions ----------------*/
+
+// Returns NULL on memory allocation error
+db_mgr init_db_mgr()
+{
+    db_mgr ptr = calloc(1, sizeof(struct db_manager));
+    if (!ptr) {
+        return NULL;
+    }
+
+    char *catpath = get_full_path_ext(CATALOG_FNAME, CATALOG_FILE_EXT);
+    if (!catpath) {
+        free(ptr);
+        return NULL;
+    }
+
+    // Creates empty catalog if it does not exist
+    ptr->cat = catalog_open(catpath);
+    free(catpath);
+    if (!ptr->cat) {
+        free(ptr);
+        return NULL;
+    }
+
+    ptr->data_dir = get_data_dir();
+    ptr->lat = latency_init();
+    ptr->index = calloc(MIN_OPEN_INDEX, sizeof(struct open_tbl *));
+    if (!ptr->data_dir || !ptr->lat || !ptr->index) {
+        free(ptr->index);
+        free(ptr->data_dir);
+        latency_destroy(ptr->lat);
+        catalog_close(ptr->cat);
+        free(ptr);
+        return NULL;
+    }
+
+    ptr->curr = NULL;
+    ptr->lru_head = NULL;
+    ptr->lru_tail = NULL;
+    ptr->cache_budget = DEFAULT_CACHE_BUDGET;
+    ptr->index_size = MIN_OPEN_INDEX;
+    ptr->num_open = 0;
+    ptr->resident = 0;
+
+    // One load thread per CPU, up to MAX_LOAD_THREADS
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1) {
+        ncpu = 1;
+    }
+    if (ncpu > MAX_LOAD_THREADS) {
+        ncpu = MAX_LOAD_THREADS;
+    }
+    ptr->load_threads = (unsigned) ncpu;
+    ptr->bgsave_pid = 0;
+    ptr->bgsave_fd = -1;
+
+    ptr->dur_mode = DUR_ON_SAVE;
+    ptr->group_ms = DEFAULT_GROUP_MS;
+    ptr->pending = NULL;
+    ptr->flusher_running = false;
+    ptr->flusher_stop = false;
+    pthread_mutex_init(&ptr->pending_lock, NULL);
+    pthread_cond_init(&ptr->flusher_cond, NULL);
+
+    if (catalog_count(ptr->cat) == 0) {
+        import_tbl_list(ptr);
+    }
+
+    return ptr;
+}
+
+void destroy_db_mgr(db_mgr dbm)
+{
+    if (!dbm) {
+        return;
+    }
+
+    reap_bgsave(dbm, true);
+
+    // Commit any saves waiting for a group commit,
+    // then flush table counters changed by saves
+    stop_flusher(dbm);
+    flush_pending(dbm);
+    sync_catalog(dbm);
+    pthread_mutex_destroy(&dbm->pending_lock);
+    pthread_cond_destroy(&dbm->flusher_cond);
+
+    catalog_close(dbm->cat);
+
+    while (dbm->lru_head) {
+        close_open_tbl(dbm, dbm->lru_head);
+    }
+
+    free(dbm->index);
+    free(dbm->data_dir);
+    latency_destroy(dbm->lat);
+    free(dbm);
+}
+
+char *get_data_path(const char *fname)
+{
+    if (!getenv("HOME")) {
+        return NULL;
+    }
+    return get_full_path_ext(fname, "");
+}
+
+// Check whether db_mgr object has a
+// current db table to perform
+// operations
+bool has_curr_tbl(db_mgr dbm)
+{
+    if (!dbm) {
+        return false;
+    }
+
+    return (dbm->curr);
+}
+
+// Create new table directory of directory engine
+// and record the table in catalog.
+// Returns NULL on failure.
+static void *new_dir_tbl(db_mgr dbm, char *tblname, const struct tbl_engine *eng)
+{
+    char fname[CAT_FNAME_MAX];
+    if (get_tbl_fname(dbm, tblname, eng, fname) < 0) {
+        return NULL;
+    }
+
+    char *dirpath = get_tbl_path(fname, eng);
+    void *tbl = dirpath ? eng->create(dirpath) : NULL;
+    free(dirpath);
+
+    if (!tbl) {
+        catalog_remove(dbm->cat, tblname);
+        sync_catalog(dbm);
+    }
+    return tbl;
+}
+
+// Get new empty table for use with db_mgr.
+// The previous current table stays open in the
+// open table cache.
+// Input: valid db_mgr handle, new table name string,
+//        engine name ("hash", "cuckoo", or "lsm";
+//        NULL or empty for the default hash engine)
+// Returns:
+//      -1 if table with tblname already exists
+//      -2 on memory allocation error
+//      -3 if engine is not a known engine name
+//      1 on success
+// New table of a file engine exists only in memory
+// and is not written to disk until it is saved. New
+// lsm table directory is created on disk immediately.
+int get_new_tbl(db_mgr dbm, char *tblname, const char *engine)
+{
+    if (!dbm || !dbm->cat) {
+        return -2;
+    }
+
+    const struct tbl_engine *eng = find_engine(engine);
+    if (!eng) {
+        return -3;
+    }
+
+    if (catalog_find(dbm->cat, tblname, NULL) || find_open_tbl(dbm, tblname)) {
+        return -1;
+    }
+
+    struct open_tbl *ot = new_open_tbl(tblname, eng);
+    if (!ot) {
+        return -2;
+    }
+
+    if (eng->dir_storage) {
+        ot->tbl = new_dir_tbl(dbm, tblname, eng);
+        if (!ot->tbl) {
+            free_open_tbl(ot);
+            return -2;
+        }
+    }
+    else {
+        ot->tbl = eng->create(NULL);
+        if (!ot->tbl) {
+            free_open_tbl(ot);
+            return -2;
+        }
+
+        // Set to true to ensure new table is saved
+        // even if no data are added
+        ot->updated = true;
+    }
+
+    add_open_tbl(dbm, ot);
+    set_curr_tbl(dbm, ot);
+
+    return 1;
+}
+
+// Use a previously saved table within db_mgr.
+// If the table is open in the open table cache,
+// it becomes the current table without loading
+// from disk. Otherwise it is loaded from disk.
+// The previous current table stays open.
+// Input: valid db_mgr handle, table name string
+// Returns:
+//      -1 if table with tblname does not exist
+//      -2 on memory allocation error
+//      1 on success
+// Modifications to the table are not saved
+// to disk until it is saved.
+int use_tbl(db_mgr dbm, char *tblname)
+{
+    if (!dbm || !dbm->cat) {
+        return -2;
+    }
+
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    if (ot) {
+        dbm->cache_stats.hits++;
+        set_curr_tbl(dbm, ot);
+        return 1;
+    }
+
+    char fname[CAT_FNAME_MAX];
+    const struct tbl_engine *eng;
+    if (!find_tbl_entry(dbm, tblname, fname, &eng)) {
+        return -1;
+    }
+
+    dbm->cache_stats.misses++;
+
+    char *tbl_path = get_tbl_path(fname, eng);
+    if (!tbl_path) {
+        return -2;
+    }
+
+    ot = new_open_tbl(tblname, eng);
+    if (!ot) {
+        free(tbl_path);
+        return -2;
+    }
+
+    if (!eng->dir_storage) {
+        // Table file may be waiting for group commit
+        flush_pending(dbm);
+    }
+    ot->tbl = eng->open(tbl_path, dbm->load_threads);
+    free(tbl_path);
+    dbm->events |= DB_EV_LOAD;
+
+    if (!ot->tbl) {
+        free_open_tbl(ot);
+        return -2;
+    }
+
+    add_open_tbl(dbm, ot);
+    set_curr_tbl(dbm, ot);
+
+    return 1;
+}
+
+// Writes db to file and keeps table
+// as current table in db_mgr.
+// The saved table is added to the catalog
+// if it is not there already.
+// Returns -1 on failure,
+// returns 1 on success.
+int save_curr_tbl(db_mgr dbm)
+{
+    if (!dbm || !dbm->curr) {
+        return -1;
+    }
+
+    return save_open_tbl(dbm, dbm->curr);
+}
+
+// Writes db to file without updating it in place.
+// Returns -1 on failure,
+// returns 1 on success.
+int save_curr_tbl_atomic(db_mgr dbm)
+{
+    if (!dbm || !dbm->curr) {
+        return -1;
+    }
+
+    // Engines that save in place write the whole
+    // table to a new file when marked unsaved
+    const struct tbl_engine *eng = dbm->curr->eng;
+    if (eng->mark_saved) {
+        eng->mark_saved(dbm->curr->tbl, false);
+    }
+    return save_open_tbl(dbm, dbm->curr);
+}
+
+// While hold is true, the current table writes
+// nothing to disk outside saves.
+void hold_curr_tbl_flush(db_mgr dbm, bool hold)
+{
+    if (!dbm || !dbm->curr) {
+        return;
+    }
+
+    const struct tbl_engine *eng = dbm->curr->eng;
+    if (eng->hold_flush) {
+        eng->hold_flush(dbm->curr->tbl, hold);
+    }
+}
+
+// Writes all updated open tables to disk.
+// Returns -1 if any table fails to save,
+// returns 1 on success.
+int save_all_tbls(db_mgr dbm)
+{
+    if (!dbm) {
+        return -1;
+    }
+
+    int result = 1;
+    for (struct open_tbl *ot = dbm->lru_head; ot; ot = ot->next) {
+        if (save_open_tbl(dbm, ot) < 0) {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+// Save table tblname if updated and close it,
+// leaving no current table if it was current.
+// Returns 0 if table is not open, -1 if it
+// fails to save, 1 on success.
+int close_tbl(db_mgr dbm, char *tblname)
+{
+    if (!dbm) {
+        return -1;
+    }
+
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    if (!ot) {
+        return 0;
+    }
+    if (save_open_tbl(dbm, ot) < 0) {
+        return -1;
+    }
+    close_open_tbl(dbm, ot);
+    return 1;
+}
+
+// Store entries for replace_tbl in new table
+struct replace_arg {
+    const struct tbl_engine *eng;
+    void *tbl;
+    bool failed;
+};
+
+static int replace_pair(const char *key, const char *val, void *arg)
+{
+    struct replace_arg *ra = arg;
+    if (ra->eng->put(ra->tbl, key, val) == -2) {
+        ra->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+// Replace contents of table tblname with the pairs
+// given by src, creating the table with the default
+// engine if it does not exist, and save it. The new
+// contents are built in a new table, so the table
+// file is rewritten in full.
+// Returns -3 if the table uses a directory engine,
+// -2 on memory allocation error, -1 if the table
+// fails to save, 1 on success.
+int replace_tbl(db_mgr dbm, char *tblname, pair_source_fn src, void *arg)
+{
+    if (!dbm || !dbm->cat || !src) {
+        return -2;
+    }
 
-    ptr->active_tbls_fname = get_full_path(TBL_LIST_FNAME);
-    if (!ptr->active_tbls_fname) {
-        return NULL;
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    char fname[CAT_FNAME_MAX];
+    const struct tbl_engine *eng;
+    if (ot) {
+        eng = ot->eng;
     }
-
-    // Check whether tbl_list file exists
-    if (access(ptr->active_tbls_fname, F_OK) == 0) {
-        // If exists, load tbl from file
-        FILE *inf = fopen(ptr->active_tbls_fname, "r");
-        if (!inf) {
-            free(ptr->active_tbls_fname);
-            free(ptr);
-            fclose(inf);
-            return NULL;
-        }
-        ptr->active_tbls = load_hashtbl_from_file(inf);
-        fclose(inf);
+    else if (!find_tbl_entry(dbm, tblname, fname, &eng)) {
+        eng = find_engine(NULL);
     }
-    else {
-        // If it doesn't exist, create new hashtable
-        // to be written when db_mgr object is freed
-        ptr->active_tbls = init_hashtbl(INIT_HASHTBL_SIZE);
+    if (eng->dir_storage) {
+        return -3;
     }
 
-    if (!ptr->active_tbls) {
-        free(ptr);
-        return NULL;
+    struct replace_arg ra = {eng, eng->create(NULL), false};
+    if (!ra.tbl) {
+        return -2;
+    }
+    if (src(replace_pair, &ra, arg) < 0 || ra.failed) {
+        eng->close(ra.tbl);
+        return -2;
+    }
+    if (eng->mark_saved) {
+        eng->mark_saved(ra.tbl, false);
     }
 
-    ptr->curr_tbl = NULL;
-    ptr->curr_tbl_name = NULL;
-    ptr->curr_tbl_updated = false;
+    if (ot) {
+        // A background save of the old contents
+        // must not complete after this save
+        reap_bgsave(dbm, true);
+        eng->close(ot->tbl);
+        ot->tbl = ra.tbl;
+        update_tbl_mem(dbm, ot);
+    }
+    else {
+        ot = new_open_tbl(tblname, eng);
+        if (!ot) {
+            eng->close(ra.tbl);
+            return -2;
+        }
+        ot->tbl = ra.tbl;
+        add_open_tbl(dbm, ot);
+    }
+    ot->updated = true;
+    set_curr_tbl(dbm, ot);
 
-    return ptr;
+    return save_open_tbl(dbm, ot);
 }
 
-void destroy_db_mgr(db_mgr dbm)
+// Set memory budget for open table cache in bytes.
+// Least recently used tables are closed until
+// open tables fit within the budget.
+void set_cache_budget(db_mgr dbm, size_t budget)
 {
     if (!dbm) {
         return;
     }
 
-    // Write active_tbls to file
-    FILE *outf = fopen(dbm->active_tbls_fname, "w");
-    if (outf) {
-        hashtbl_to_file(dbm->active_tbls, outf);
-    }
-    fclose(outf);
-
-    destroy_hashtbl(dbm->active_tbls);
+    dbm->cache_budget = budget;
+    evict_tbls(dbm);
+}
 
-    if (dbm->curr_tbl) {
-        destroy_hashtbl(dbm->curr_tbl);
+// Copy open table cache counters to stats.
+void get_cache_stats(db_mgr dbm, struct cache_stats *stats)
+{
+    if (!dbm || !stats) {
+        return;
     }
 
-    if (dbm->curr_tbl_name) {
-        free(dbm->curr_tbl_name);
+    *stats = dbm->cache_stats;
+    stats->budget = dbm->cache_budget;
+    if (dbm->curr) {
+        update_tbl_mem(dbm, dbm->curr);
     }
-
-    free(dbm->active_tbls_fname);
-    free(dbm);
+    stats->resident = dbm->resident;
+    stats->open_tbls = dbm->num_open;
 }
 
-// Check whether db_mgr object has a
-// current db table to perform
-// operations
-bool has_curr_tbl(db_mgr dbm)
+// Name of durability mode: "none", "on-save",
+// or "group"
+const char *durability_name(enum durability mode)
 {
-    if (!dbm) {
-        return false;
+    switch (mode) {
+        case DUR_NONE:
+            return "none";
+        case DUR_ON_SAVE:
+            return "on-save";
+        case DUR_GROUP:
+            return "group";
     }
-
-    return (dbm->curr_tbl);
+    return "";
 }
 
-// Get new empty table for use with db_mgr.
-// Use save_curr_tbl to keep current table
-// data, as this function overwrites current data.
-// Input: valid db_mgr handle, new table name string
-// Returns:
-//      -1 if table with tblname already exists
-//      -2 on memory allocation error
-//      1 on success
-// New table returned exists only in memory and
-// is not written to disk until save_curr_tbl
-// is called.
-int get_new_tbl(db_mgr dbm, char *tblname)
+// Set mode to durability mode with name.
+// Returns -1 if name is not a mode, 1 on success.
+int find_durability(const char *name, enum durability *mode)
 {
-    if (!dbm || !dbm->active_tbls) {
-        return -2;
+    const enum durability modes[] = {DUR_NONE, DUR_ON_SAVE, DUR_GROUP};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (strcmp(name, durability_name(modes[i])) == 0) {
+            *mode = modes[i];
+            return 1;
+        }
     }
+    return -1;
+}
 
-    if (exists(dbm->active_tbls, tblname)) {
+// Set durability mode. group_ms is used only
+// with DUR_GROUP and must be greater than 0.
+// Pending group saves are flushed when the
+// mode changes.
+// Returns 1 on success, -1 on failure.
+int set_durability(db_mgr dbm, enum durability mode, unsigned int group_ms)
+{
+    if (!dbm || (mode == DUR_GROUP && group_ms == 0)) {
         return -1;
     }
 
-    if (dbm->curr_tbl) {
-        destroy_hashtbl(dbm->curr_tbl);
-    }
+    stop_flusher(dbm);
+    flush_pending(dbm);
 
-    if (dbm->curr_tbl_name) {
-        free(dbm->curr_tbl_name);
+    int result = 1;
+    dbm->dur_mode = mode;
+    if (mode == DUR_GROUP) {
+        dbm->group_ms = group_ms;
+        if (pthread_create(&dbm->flusher, NULL, flusher_main, dbm) != 0) {
+            dbm->dur_mode = DUR_ON_SAVE;
+            result = -1;
+        }
+        else {
+            dbm->flusher_running = true;
+        }
     }
 
-    dbm->curr_tbl = init_hashtbl(INIT_HASHTBL_SIZE);
-    if (!dbm->curr_tbl) {
-        return -2;
+    for (struct open_tbl *ot = dbm->lru_head; ot; ot = ot->next) {
+        set_tbl_sync(dbm, ot);
     }
+    return result;
+}
 
-    dbm->curr_tbl_name = strndup(tblname, TBL_NAME_MAX);
-    if (!dbm->curr_tbl_name) {
-        return -2;
+// Copy durability mode and save counters to stats.
+void get_durability_stats(db_mgr dbm, struct durability_stats *stats)
+{
+    if (!dbm || !stats) {
+        return;
     }
 
-    // Set to true to ensure new table is saved
-    // even if no data are added
-    dbm->curr_tbl_updated = true;
+    pthread_mutex_lock(&dbm->pending_lock);
+    *stats = dbm->dur_stats;
+    pthread_mutex_unlock(&dbm->pending_lock);
 
-    return 1;
+    stats->mode = dbm->dur_mode;
+    stats->group_ms = dbm->group_ms;
+
+    struct io_stats io;
+    get_file_io_stats(&io);
+    stats->io = get_io_backend();
+    stats->io_calls = io.calls;
 }
 
-// Use a previously saved table within db_mgr.
-// Use save_curr_tbl to keep current table
-// data, as this function overwrites current data.
-// Input: valid db_mgr handle, table name string
-// Returns:
-//      -1 if table with tblname does not exist
-//      -2 on memory allocation error
-//      1 on success
-// Modifications to the table are not saved
-// to disk until save_curr_tbl is called.
-int use_tbl(db_mgr dbm, char *tblname)
+// Writes a point-in-time snapshot of the current
+// table in a forked child process. The child shares
+// table memory with the parent copy-on-write, so the
+// parent can keep serving commands while the snapshot
+// is written. The snapshot is written to a temporary
+// file, flushed to disk with fsync, and renamed over
+// the previous table file only after it is complete.
+// Returns 1 if the background save was started,
+//         0 if the table has no unsaved changes,
+//        -1 on failure,
+//        -2 if a background save is already running.
+int bgsave_curr_tbl(db_mgr dbm)
 {
-    if (!dbm || !dbm->active_tbls) {
-        return -2;
+    if (!dbm || !dbm->curr) {
+        return -1;
     }
 
-    if (!exists(dbm->active_tbls, tblname)) {
-        return -1;
+    reap_bgsave(dbm, false);
+    if (dbm->bgsave_pid > 0) {
+        return -2;
     }
 
-    if (dbm->curr_tbl) {
-        destroy_hashtbl(dbm->curr_tbl);
+    if (!dbm->curr->updated) {
+        return 0;
     }
 
-    if (dbm->curr_tbl_name) {
-        free(dbm->curr_tbl_name);
+    if (dbm->curr->eng->dir_storage) {
+        return bgsave_dir_tbl(dbm);
     }
 
-    char fname[TBL_FNAME_LEN];
-    find(fname, TBL_FNAME_LEN, dbm->active_tbls, tblname);
+    char fname[CAT_FNAME_MAX];
+    if (get_tbl_fname(dbm, dbm->curr->name, dbm->curr->eng, fname) < 0) {
+        return -1;
+    }
 
-    char *tbl_fname = get_full_path(fname);
+    char *tbl_fname = get_tbl_path(fname, dbm->curr->eng);
     if (!tbl_fname) {
-        return -2;
+        return -1;
     }
 
-    FILE *inf = fopen(tbl_fname, "r");
-    if (!inf) {
-        return -2;
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        free(tbl_fname);
+        return -1;
     }
 
-    dbm->curr_tbl = load_hashtbl_from_file(inf);
-    fclose(inf);
-
-    if (!dbm->curr_tbl) {
-        return -2;
+    clock_gettime(CLOCK_MONOTONIC, &dbm->bgsave_start);
+
+    // Commit any queued save of this table first -
+    // the child writes through the same temporary
+    // file. Holding pending_lock across fork keeps
+    // the flusher thread idle while the child's
+    // copy of memory is taken.
+    pthread_mutex_lock(&dbm->pending_lock);
+    flush_pending_locked(dbm);
+    pid_t pid = fork();
+    if (pid != 0) {
+        pthread_mutex_unlock(&dbm->pending_lock);
+    }
+    if (pid < 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        free(tbl_fname);
+        return -1;
     }
 
-    dbm->curr_tbl_name = strndup(tblname, TBL_NAME_MAX);
-    if (!dbm->curr_tbl_name) {
-        return -2;
+    if (pid == 0) {
+        // Child - write snapshot and report result.
+        // _exit skips stdio buffer flushes and
+        // other cleanup belonging to the parent.
+        close(pipefd[0]);
+        struct bgsave_result res = {0};
+        bool sync = (dbm->dur_mode != DUR_NONE);
+        res.bytes = write_tbl_file(dbm->curr->eng, dbm->curr->tbl, tbl_fname, sync);
+        res.success = (res.bytes > 0);
+        if (res.success && sync) {
+            sync_dir(dbm->data_dir);
+        }
+        ssize_t w = write(pipefd[1], &res, sizeof(res));
+        _exit(w == sizeof(res) ? EXIT_SUCCESS : EXIT_FAILURE);
     }
 
+    close(pipefd[1]);
     free(tbl_fname);
 
-    dbm->curr_tbl_updated = false;
+    dbm->bgsave_pid = pid;
+    dbm->bgsave_fd = pipefd[0];
+    dbm->events |= DB_EV_FORK;
+    strtcpy(dbm->bgsave_tbl_name, dbm->curr->name, TBL_NAME_MAX);
+
+    // Snapshot holds all changes made so far -
+    // reset to false so only later changes are
+    // saved. Set back to true if snapshot fails.
+    // The snapshot replaces the table file, so
+    // change tracking starts over from it.
+    dbm->curr->updated = false;
+    if (dbm->curr->eng->mark_saved) {
+        dbm->curr->eng->mark_saved(dbm->curr->tbl, true);
+    }
 
     return 1;
-
 }
 
-// Writes db to file and keeps table
-// as current table in db_mgr.
-// The saved table is added to active_tbls
-// if it is not there already.
-// Returns -1 on failure,
-// returns 1 on success.
-int save_curr_tbl(db_mgr dbm)
+// Check for completion of a background save.
+// If wait is true, blocks until a running save finishes.
+// Returns 1 and fills info if a save has finished,
+// returns 0 if no save has finished.
+int poll_bgsave(db_mgr dbm, struct bgsave_info *info, bool wait)
 {
-    if (!dbm || !dbm->curr_tbl || !dbm->curr_tbl_name) {
-        return -1;
-    }
-
-    if (!dbm->curr_tbl_updated) {
-        return 1;
+    if (!dbm) {
+        return 0;
     }
 
-    char fname[TBL_FNAME_LEN];
-
-    // if db exists - get file name from active_tbls
-    // else - create new file name
-    if (exists(dbm->active_tbls, dbm->curr_tbl_name)) {
-        find(fname, TBL_FNAME_LEN, dbm->active_tbls, dbm->curr_tbl_name);
-    }
-    else {
-        getrandstr(fname, TBL_FNAME_LEN);
-        put(dbm->active_tbls, dbm->curr_tbl_name, fname);
-    }
+    reap_bgsave(dbm, wait);
 
-    char *tbl_fname = get_full_path(fname);
-    if (!tbl_fname) {
-        return -1;
+    if (!dbm->bgsave_unreported) {
+        return 0;
     }
 
-    FILE *outf = fopen(tbl_fname, "w");
-    if (!outf) {
-        return -1;
+    if (info) {
+        *info = dbm->bgsave_last;
     }
-    size_t result = hashtbl_to_file(dbm->curr_tbl, outf);
-    fclose(outf);
-
-    free(tbl_fname);
+    dbm->bgsave_unreported = false;
 
-    if (result > 0) {
-        dbm->curr_tbl_updated = false;
-        return 1;
-    }
-    else {
-        return -1;
-    }
+    return 1;
 }
 
 // Drop table
@@ -367,43 +1917,47 @@ int save_curr_tbl(db_mgr dbm)
 // return value.
 int drop_tbl(db_mgr dbm, char *tblname)
 {
-    if (!dbm || !dbm->active_tbls) {
+    if (!dbm || !dbm->cat) {
         return -2;
     }
 
-    // If current table is table to be deleted,
-    // clear current table and table name
-    if (dbm->curr_tbl && dbm->curr_tbl_name &&
-        strcmp(dbm->curr_tbl_name, tblname) == 0) {
-        destroy_hashtbl(dbm->curr_tbl);
-        dbm->curr_tbl = NULL;
-        dbm->curr_tbl_updated = false;
-        free(dbm->curr_tbl_name);
-        dbm->curr_tbl_name = NULL;
+    // Background save or pending group commit
+    // would recreate the file after it is deleted
+    reap_bgsave(dbm, true);
+    flush_pending(dbm);
+
+    // If table to be deleted is open, close it.
+    // If it is the current table, current
+    // table is cleared.
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    if (ot) {
+        close_open_tbl(dbm, ot);
     }
 
-    // If tblname is not in active_tbls,
+    // If tblname is not in catalog,
     // then there is no file for the table
-    if (!exists(dbm->active_tbls, tblname)) {
+    char fname[CAT_FNAME_MAX];
+    const struct tbl_engine *eng;
+    if (!find_tbl_entry(dbm, tblname, fname, &eng)) {
         return -1;
     }
 
-    char fname[TBL_FNAME_LEN];
-    find(fname, TBL_FNAME_LEN, dbm->active_tbls, tblname);
-    char *fullname = get_full_path(fname);
+    char *fullname = get_tbl_path(fname, eng);
     if (!fullname) {
         return -2;
     }
 
-    if (unlink(fullname) < 0) {
+    if (eng->remove(fullname) < 0) {
+        free(fullname);
         return -2;
     }
 
-    // Table is only removed from active_tbls
+    // Table is only removed from catalog
     // if unlink is successful and the file
     // is removed from disk
-    delete(dbm->active_tbls, tblname);
+    catalog_remove(dbm->cat, tblname);
     free(fullname);
+    sync_catalog(dbm);
 
     return 1;
 }
@@ -416,13 +1970,19 @@ int drop_tbl(db_mgr dbm, char *tblname)
 // Attempt to add key that already exists results in failure.
 int add(db_mgr dbm, char *key, char *val)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
         return -2;
     }
 
-    dbm->curr_tbl_updated = true;
+    dbm->curr->updated = true;
 
-    return put(dbm->curr_tbl, key, val);
+    const struct tbl_engine *eng = dbm->curr->eng;
+    size_t resizes = eng->resizes ? eng->resizes(dbm->curr->tbl) : 0;
+    int result = eng->put(dbm->curr->tbl, key, val);
+    if (eng->resizes && eng->resizes(dbm->curr->tbl) != resizes) {
+        dbm->events |= DB_EV_RESIZE;
+    }
+    return result;
 }
 
 // Searches for value associated with key.
@@ -433,11 +1993,163 @@ int add(db_mgr dbm, char *key, char *val)
 // Returns 0 on error or if value not found.
 size_t get(char *dst, size_t dsize, db_mgr dbm, char *key)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
+        return 0;
+    }
+
+    return dbm->curr->eng->get(dst, dsize, dbm->curr->tbl, key);
+}
+
+// Look up key in table tblname without making it
+// the current table. A table that is not open is
+// read through the lookup function of its engine
+// if it has one, which reads only what the lookup
+// needs. Otherwise the table is opened with use_tbl
+// and becomes the current table.
+// Returns -1 if table does not exist, -2 on memory
+// allocation or file error, 0 if key not found,
+// 1 and copies value to dst if found.
+int lookup_tbl(db_mgr dbm, char *tblname, char *key, char *dst, size_t dsize)
+{
+    if (!dbm || !dbm->cat) {
+        return -2;
+    }
+
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    char fname[CAT_FNAME_MAX];
+    const struct tbl_engine *eng;
+    if (!ot) {
+        if (!find_tbl_entry(dbm, tblname, fname, &eng)) {
+            return -1;
+        }
+    }
+
+    if (!ot && eng->lookup) {
+        char *tbl_path = get_tbl_path(fname, eng);
+        if (!tbl_path) {
+            return -2;
+        }
+        flush_pending(dbm);
+        int ret = eng->lookup(tbl_path, key, dst, dsize);
+        free(tbl_path);
+        if (ret >= 0) {
+            return ret;
+        }
+    }
+
+    if (!ot) {
+        int ret = use_tbl(dbm, tblname);
+        if (ret < 0) {
+            return ret;
+        }
+        ot = dbm->curr;
+    }
+
+    if (!ot->eng->exists(ot->tbl, key)) {
         return 0;
     }
+    ot->eng->get(dst, dsize, ot->tbl, key);
+    return 1;
+}
+
+// Add key and val to, or delete key from if val is
+// NULL, table tblname and save the table, without
+// making it the current table. A table that is not
+// open is updated through the update function of
+// its engine if it has one, which writes only what
+// the change needs. Otherwise the table is opened
+// with use_tbl, becomes the current table, and is
+// saved with save_curr_tbl.
+// Returns -1 if table does not exist, -2 on memory
+// allocation or file error, -3 if key to add already
+// exists, 0 if key to delete not found, 1 on success.
+int update_tbl(db_mgr dbm, char *tblname, char *key, char *val)
+{
+    if (!dbm || !dbm->cat) {
+        return -2;
+    }
+
+    struct open_tbl *ot = find_open_tbl(dbm, tblname);
+    struct cat_entry entry;
+    const struct tbl_engine *eng = NULL;
+    if (!ot) {
+        if (!catalog_find(dbm->cat, tblname, &entry)) {
+            return -1;
+        }
+        eng = find_engine(entry.engine);
+        if (!eng) {
+            return -1;
+        }
+    }
+
+    if (!ot && eng->update) {
+        char *tbl_path = get_tbl_path(entry.fname, eng);
+        if (!tbl_path) {
+            return -2;
+        }
+        flush_pending(dbm);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bool sync = dbm->dur_mode != DUR_NONE;
+        int ret = eng->update(tbl_path, key, val, sync);
+        free(tbl_path);
+
+        if (ret == 1) {
+            dbm->events |= DB_EV_SAVE;
+            pthread_mutex_lock(&dbm->pending_lock);
+            dbm->dur_stats.saves++;
+            dbm->dur_stats.save_msecs += elapsed_msecs(&start);
+            if (sync) {
+                dbm->dur_stats.fsyncs++;
+            }
+            pthread_mutex_unlock(&dbm->pending_lock);
+
+            if (entry.entries != CAT_ENTRIES_UNKNOWN) {
+                entry.entries += val ? 1 : -1;
+            }
+            catalog_set_stats(dbm->cat, tblname, entry.entries, entry.bytes,
+                              (int64_t) time(NULL));
+        }
+        if (ret != -3) {
+            return ret == -1 ? -3 : ret;
+        }
+    }
+
+    if (!ot) {
+        int ret = use_tbl(dbm, tblname);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    else {
+        set_curr_tbl(dbm, ot);
+    }
+
+    if (val) {
+        int ret = add(dbm, key, val);
+        if (ret < 0) {
+            return ret == -1 ? -3 : ret;
+        }
+    }
+    else {
+        if (!dbm->curr->eng->exists(dbm->curr->tbl, key)) {
+            return 0;
+        }
+        db_remove(dbm, key);
+    }
+
+    return save_curr_tbl(dbm) < 0 ? -2 : 1;
+}
+
+// Returns true if key is in current table
+bool has_key(db_mgr dbm, char *key)
+{
+    if (!dbm || !dbm->curr) {
+        return false;
+    }
 
-    return find(dst, dsize, dbm->curr_tbl, key);
+    return dbm->curr->eng->exists(dbm->curr->tbl, key);
 }
 
 // Key and value removed from current table.
@@ -445,12 +2157,14 @@ size_t get(char *dst, size_t dsize, db_mgr dbm, char *key)
 // Returns 1 on success, 0 on failure.
 int db_remove(db_mgr dbm, char *key)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
         return 0;
     }
 
-    delete(dbm->curr_tbl, key);
-    dbm->curr_tbl_updated = true;
+    if (dbm->curr->eng->del(dbm->curr->tbl, key) < 0) {
+        return 0;
+    }
+    dbm->curr->updated = true;
 
     return 1;
 }
@@ -461,11 +2175,11 @@ int db_remove(db_mgr dbm, char *key)
 // and on error.
 size_t get_num_tbl_entries(db_mgr dbm)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
         return 0;
     }
 
-    return get_numentries(dbm->curr_tbl);
+    return dbm->curr->eng->count(dbm->curr->tbl);
 }
 
 // Returns pointer to heap-allocated array of
@@ -473,11 +2187,11 @@ size_t get_num_tbl_entries(db_mgr dbm)
 // freeing returned pointer.
 char **get_tbl_keys(db_mgr dbm)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
         return NULL;
     }
 
-    return get_keys(dbm->curr_tbl);
+    return dbm->curr->eng->keys(dbm->curr->tbl);
 }
 
 // Returns pointer to heap-allocated array of
@@ -485,11 +2199,225 @@ char **get_tbl_keys(db_mgr dbm)
 // freeing returned pointer.
 char **get_tbl_vals(db_mgr dbm)
 {
-    if (!dbm || !dbm->curr_tbl) {
+    if (!dbm || !dbm->curr) {
         return NULL;
     }
 
-    return get_vals(dbm->curr_tbl);
+    return dbm->curr->eng->vals(dbm->curr->tbl);
+}
+
+// Call fn for every key-value pair in current
+// table. Stops early if fn returns nonzero.
+// Returns 1 on success, -1 if there is no
+// current table or on error.
+int iterate_tbl(db_mgr dbm, engine_iter_fn fn, void *arg)
+{
+    if (!dbm || !dbm->curr || !fn) {
+        return -1;
+    }
+
+    return dbm->curr->eng->iterate(dbm->curr->tbl, fn, arg);
+}
+
+// Scan of a table whose engine has no scan
+// operation. The cursor is the number of
+// entries visited by earlier calls.
+struct pos_scan {
+    engine_iter_fn fn;
+    void *arg;
+    size_t cursor;
+    size_t pos;
+    bool stopped;       // fn returned nonzero
+    bool more;          // An entry follows
+};
+
+static int pos_scan_entry(const char *key, const char *val, void *arg)
+{
+    struct pos_scan *ps = arg;
+    if (ps->stopped) {
+        ps->more = true;
+        return 1;
+    }
+    if (ps->pos++ < ps->cursor) {
+        return 0;
+    }
+    ps->stopped = ps->fn(key, val, ps->arg) != 0;
+    return 0;
+}
+
+// Call fn for entries of current table from
+// position *cursor until fn returns nonzero, and
+// set *cursor to the position of the next entry,
+// or 0 if no entries are left.
+// Returns 1 on success, -1 if there is no
+// current table or on error.
+int scan_tbl(db_mgr dbm, size_t *cursor, engine_iter_fn fn, void *arg)
+{
+    if (!dbm || !dbm->curr || !fn) {
+        return -1;
+    }
+
+    const struct tbl_engine *eng = dbm->curr->eng;
+    if (eng->scan) {
+        *cursor = eng->scan(dbm->curr->tbl, *cursor, fn, arg);
+        return 1;
+    }
+
+    struct pos_scan ps = {fn, arg, *cursor, 0, false, false};
+    if (eng->iterate(dbm->curr->tbl, pos_scan_entry, &ps) < 0) {
+        return -1;
+    }
+    *cursor = ps.more ? ps.pos : 0;
+    return 1;
+}
+
+// Import sink adding rows to open table
+struct import_tbl_arg {
+    struct open_tbl *ot;
+    void (*bad_row)(void *arg, size_t lineno, const char *reason);
+    void *bad_row_arg;
+};
+
+static int import_reserve(void *arg, size_t rows)
+{
+    struct open_tbl *ot = ((struct import_tbl_arg *) arg)->ot;
+    if (!ot->eng->reserve) {
+        return 1;
+    }
+    return ot->eng->reserve(ot->tbl, ot->eng->count(ot->tbl) + rows);
+}
+
+static int import_row(void *arg, const char *key, const char *val)
+{
+    struct open_tbl *ot = ((struct import_tbl_arg *) arg)->ot;
+    return ot->eng->put(ot->tbl, key, val);
+}
+
+static void import_bad_row(void *arg, size_t lineno, const char *reason)
+{
+    struct import_tbl_arg *imp = arg;
+    if (imp->bad_row) {
+        imp->bad_row(imp->bad_row_arg, lineno, reason);
+    }
+}
+
+// Add all rows of file at path in format fmt to
+// current table. Rows whose key already exists are
+// skipped, as with add. bad_row is called for each
+// malformed row and may be NULL.
+// Returns -1 if there is no current table or the
+// file cannot be read, -2 on memory allocation or
+// table file error, 1 on success.
+int import_tbl(db_mgr dbm, const char *path, enum bulk_format fmt,
+               struct import_stats *stats,
+               void (*bad_row)(void *arg, size_t lineno, const char *reason),
+               void *arg)
+{
+    if (!dbm || !dbm->curr) {
+        return -1;
+    }
+
+    struct import_tbl_arg imp = {dbm->curr, bad_row, arg};
+    struct import_sink sink = {
+        .reserve = import_reserve,
+        .row = import_row,
+        .bad_row = import_bad_row,
+        .arg = &imp
+    };
+
+    struct import_stats local;
+    if (!stats) {
+        stats = &local;
+    }
+
+    // A failed import may have added some rows
+    int result = import_file(path, fmt, &sink, stats);
+    if (stats->added > 0) {
+        dbm->curr->updated = true;
+    }
+    return result;
+}
+
+static int export_pair(const char *key, const char *val, void *arg)
+{
+    return export_row(arg, key, val) < 0;
+}
+
+// Write all pairs of current table to file at path
+// in format fmt, in key order if sorted is true.
+// Returns -1 if there is no current table, -2 on
+// file, memory allocation, or table error, 1 on success.
+int export_tbl(db_mgr dbm, const char *path, enum bulk_format fmt,
+               bool sorted, struct export_stats *stats)
+{
+    if (!dbm || !dbm->curr) {
+        return -1;
+    }
+
+    exporter ex = export_open(path, fmt, sorted, dbm->load_threads);
+    if (!ex) {
+        return -2;
+    }
+
+    int iter_stat = dbm->curr->eng->iterate(dbm->curr->tbl, export_pair, ex);
+    if (export_close(ex, stats) < 0 || iter_stat < 0) {
+        return -2;
+    }
+    return 1;
+}
+
+// Fill info for current table.
+// Returns 1 on success, -1 if there is
+// no current table.
+int get_tbl_info(db_mgr dbm, struct tbl_info *info)
+{
+    if (!dbm || !dbm->curr || !info) {
+        return -1;
+    }
+
+    info->engine = dbm->curr->eng->name;
+    info->numstats = dbm->curr->eng->stats(dbm->curr->tbl, info->stats, ENGINE_STATS_MAX);
+    return 1;
+}
+
+void format_db_events(unsigned events, char *dst, size_t dsize)
+{
+    size_t len = 0;
+    dst[0] = '\0';
+    for (size_t i = 0; i < sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]); i++) {
+        if ((events & (1u << i)) && len < dsize) {
+            int n = snprintf(dst + len, dsize - len, "%s%s", len ? "," : "",
+                             EVENT_NAMES[i]);
+            len += n > 0 ? (size_t) n : 0;
+        }
+    }
+    if (len == 0) {
+        strtcpy(dst, "-", dsize);
+    }
+}
+
+latency get_latency(db_mgr dbm)
+{
+    return dbm ? dbm->lat : NULL;
+}
+
+void start_cmd_latency(db_mgr dbm, struct timespec *start)
+{
+    dbm->events = 0;
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void record_cmd_latency(db_mgr dbm, size_t cmd, const struct timespec *start,
+                        const char *tblname, const char *arg)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000 +
+                  now.tv_nsec - start->tv_nsec;
+
+    if (latency_record(dbm->lat, cmd, ns)) {
+        latency_log_slow(dbm->lat, cmd, ns, dbm->events, tblname, arg);
+    }
 }
 
 // Get number of tables saved in file.
@@ -497,11 +2425,11 @@ char **get_tbl_vals(db_mgr dbm)
 // and on error.
 size_t get_numtbls(db_mgr dbm)
 {
-    if (!dbm || !dbm->active_tbls) {
+    if (!dbm || !dbm->cat) {
         return -1;
     }
 
-    return get_numentries(dbm->active_tbls);
+    return catalog_count(dbm->cat);
 }
 
 // Returns pointer to heap-allocated array of
@@ -509,10 +2437,22 @@ size_t get_numtbls(db_mgr dbm)
 // freeing returned pointer.
 char **get_tbls(db_mgr dbm)
 {
-    if (!dbm || !dbm->active_tbls) {
+    if (!dbm || !dbm->cat) {
         return NULL;
     }
 
-    return get_keys(dbm->active_tbls);
+    return catalog_get_names(dbm->cat);
+}
+
+// Call fn with the catalog record of every
+// saved table. Stops early if fn returns nonzero.
+// Returns -1 on error, 1 on success.
+int list_tbls(db_mgr dbm, cat_iter_fn fn, void *arg)
+{
+    if (!dbm || !dbm->cat) {
+        return -1;
+    }
+
+    return catalog_foreach(dbm->cat, fn, arg);
 }
 
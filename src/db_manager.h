@@ -14,9 +14,14 @@
  * interact with a database. The db_mgr object can work
  * with only 1 current table at any one time, but can save
  * multiple tables. A table can be set to current with
- * the get_new_tbl or use_tbl functions. Use the
+ * the get_new_tbl or use_tbl functions. Tables used
+ * earlier stay open in an open table cache, so switching
+ * back to them does not reload them from disk. Updated
+ * tables are saved when they are closed to keep the
+ * cache within its memory budget. Use the
  * save_curr_tbl function to write the current table
- * to disk. Data can be accessed in multiple ways - one
+ * to disk, and save_all_tbls to write all updated open
+ * tables. Data can be accessed in multiple ways - one
  * key-value pair at a time, a list of keys, a list of
  * values. The user is responsible for freeing the db_mgr
  * with the destroy_db_mgr function.
@@ -26,6 +31,17 @@
 #ifndef DB_MANAGER_H
 #define DB_MANAGER_H
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "pairdbconst.h"
+#include "engine.h"
+#include "catalog.h"
+#include "bulkio.h"
+#include "uring.h"
+#include "latency.h"
+
 // Use handle to db_mgr to interact
 // with database tables and files
 typedef struct db_manager *db_mgr;
@@ -36,34 +52,50 @@ typedef struct db_manager *db_mgr;
 db_mgr init_db_mgr();
 void destroy_db_mgr(db_mgr dbm);
 
+// Allocates path of file fname in the directory
+// holding table files, ~/pairdb-data/fname.
+// Returns NULL if HOME is not set or on memory
+// allocation error.
+// Caller is responsible for freeing path.
+char *get_data_path(const char *fname);
+
 // Check whether db_mgr object has a
 // current db table to perform
 // operations
 bool has_curr_tbl(db_mgr dbm);
 
 // Get new empty table for use with db_mgr.
-// Use save_curr_tbl to keep current table
-// data, as this function overwrites current data.
-// Input: valid db_mgr handle, new table name string
+// The previous current table stays open in the
+// open table cache.
+// Input: valid db_mgr handle, new table name string,
+//        engine name ("hash" or "lsm"; NULL or empty
+//        for the default hash engine)
 // Returns:
 //      -1 if table with tblname already exists
 //      -2 on memory allocation error
+//      -3 if engine is not a known engine name
 //      1 on success
-// New table returned exists only in memory and
-// is not written to disk until save_curr_tbl
-// is called.
-int get_new_tbl(db_mgr dbm, char *tblname);
+// New hash table returned exists only in memory and
+// is not written to disk until it is saved. New lsm
+// table directory is created on disk immediately.
+//
+// A hash table is held in memory and saved to a
+// single file. An lsm table is stored in sorted
+// files on disk and may be larger than memory.
+int get_new_tbl(db_mgr dbm, char *tblname, const char *engine);
 
 // Use a previously saved table within db_mgr.
-// Use save_curr_tbl to keep current table
-// data, as this function overwrites current data.
+// If the table is open in the open table cache,
+// it becomes the current table without loading
+// from disk. Otherwise it is loaded from disk.
+// The previous current table stays open.
 // Input: valid db_mgr handle, table name string
 // Returns:
 //      -1 if table with tblname does not exist
 //      -2 on memory allocation error
 //      1 on success
 // Modifications to the table are not saved
-// to disk until save_curr_tbl is called.
+// to disk until it is saved.
 int use_tbl(db_mgr dbm, char *tblname);
 
 // Writes db to file and keeps table
@@ -72,6 +104,157 @@ int use_tbl(db_mgr dbm, char *tblname);
 // returns 1 on success.
 int save_curr_tbl(db_mgr dbm);
 
+// Writes db to file like save_curr_tbl, but a table
+// of a file engine is always written in full to a
+// temporary file that is renamed over the table file,
+// never updated in place, so a crash during the save
+// leaves either the old or the new table on disk.
+// The save costs a write and fsync of the whole
+// table however few entries changed, where
+// save_curr_tbl writes only the changed pages of a
+// hash table. Tables of directory engines are saved
+// as by save_curr_tbl.
+// Returns -1 on failure,
+// returns 1 on success.
+int save_curr_tbl_atomic(db_mgr dbm);
+
+// While hold is true, the current table writes
+// nothing to disk outside saves - an lsm table
+// keeps its memtable in memory however large it
+// grows - so changes made until the next save
+// reach disk together. Tables of file engines are
+// written only by saves in any case.
+void hold_curr_tbl_flush(db_mgr dbm, bool hold);
+
+// Writes all updated open tables to disk.
+// Returns -1 if any table fails to save,
+// returns 1 on success.
+int save_all_tbls(db_mgr dbm);
+
+// Save table tblname if updated and close it,
+// leaving no current table if it was current.
+// Returns 0 if table is not open, -1 if it
+// fails to save, 1 on success.
+int close_tbl(db_mgr dbm, char *tblname);
+
+// Source of pairs for replace_tbl. Calls fn with
+// fnarg for every pair and stops if fn returns
+// nonzero. Returns -1 on error.
+typedef int (*pair_source_fn)(engine_iter_fn fn, void *fnarg, void *arg);
+
+// Replace contents of table tblname with the pairs
+// given by src, creating the table with the default
+// engine if it does not exist, and save it as the
+// current table. The table file is rewritten in full.
+// Returns -3 if the table uses a directory engine,
+// -2 on memory allocation error, -1 if the table
+// fails to save, 1 on success.
+int replace_tbl(db_mgr dbm, char *tblname, pair_source_fn src, void *arg);
+
+// Open table cache counters
+struct cache_stats {
+    size_t hits;        // use_tbl found table open
+    size_t misses;      // use_tbl loaded table from disk
+    size_t evictions;   // Tables closed to stay within budget
+    size_t open_tbls;   // Number of open tables
+    size_t resident;    // Bytes held by open tables
+    size_t budget;      // Memory budget in bytes
+};
+
+// Set memory budget for open table cache in bytes.
+// Least recently used tables are saved if updated
+// and closed until open tables fit within the
+// budget. The current table is never closed.
+void set_cache_budget(db_mgr dbm, size_t budget);
+
+// Copy open table cache counters to stats.
+void get_cache_stats(db_mgr dbm, struct cache_stats *stats);
+
+// Durability modes for table saves. Every save
+// writes a temporary file and renames it over the
+// previous table file, so a table file is never
+// left partially written. The mode sets when data
+// is flushed to disk with fsync:
+//      DUR_NONE    - never; fastest, but saves made
+//                    shortly before a system crash
+//                    may be lost
+//      DUR_ON_SAVE - every save is flushed before
+//                    the save returns (default)
+//      DUR_GROUP   - saves are committed in groups;
+//                    pending saves are flushed and
+//                    renamed together every group_ms
+//                    milliseconds
+enum durability {
+    DUR_NONE,
+    DUR_ON_SAVE,
+    DUR_GROUP
+};
+
+// Counters for measuring save cost under
+// each durability mode
+struct durability_stats {
+    enum durability mode;
+    unsigned int group_ms;
+    size_t saves;
+    size_t bytes;
+    size_t fsyncs;
+    size_t group_commits;
+    double save_msecs;  // Time spent in foreground saves
+
+    // I/O backend of table file writes, and system
+    // calls made by them in this process (writes
+    // and fsyncs, or io_uring submissions)
+    enum io_backend io;
+    size_t io_calls;
+};
+
+// Name of durability mode: "none", "on-save",
+// or "group"
+const char *durability_name(enum durability mode);
+
+// Set mode to durability mode with name.
+// Returns -1 if name is not a mode, 1 on success.
+int find_durability(const char *name, enum durability *mode);
+
+// Set durability mode. group_ms is used only
+// with DUR_GROUP and must be greater than 0.
+// Pending group saves are flushed when the
+// mode changes.
+// Returns 1 on success, -1 on failure.
+int set_durability(db_mgr dbm, enum durability mode, unsigned int group_ms);
+
+// Copy durability mode and save counters to stats.
+void get_durability_stats(db_mgr dbm, struct durability_stats *stats);
+
+// Background save status reported by poll_bgsave.
+// bytes and msecs describe the snapshot written
+// by the background process.
+struct bgsave_info {
+    char tbl_name[TBL_NAME_MAX];
+    bool success;
+    size_t bytes;
+    double msecs;
+};
+
+// Writes a point-in-time snapshot of the current
+// table in a forked child process. The child shares
+// table memory with the parent copy-on-write, so the
+// parent can keep serving commands while the snapshot
+// is written. The snapshot is written to a temporary
+// file, flushed to disk with fsync, and renamed over
+// the previous table file only after it is complete.
+// Returns 1 if the background save was started,
+//         0 if the table has no unsaved changes,
+//        -1 on failure,
+//        -2 if a background save is already running.
+int bgsave_curr_tbl(db_mgr dbm);
+
+// Check for completion of a background save.
+// If wait is true, blocks until a running save finishes.
+// Returns 1 and fills info if a save has finished,
+// returns 0 if no save has finished.
+int poll_bgsave(db_mgr dbm, struct bgsave_info *info, bool wait);
+
 // Drop table
 // Input: db_mgr object and string name
 // of table to be deleted.
@@ -116,6 +299,29 @@ int add(db_mgr dbm, char *key, char *val);
 // Returns 0 on error or if value not found.
 size_t get(char *dst, size_t dsize, db_mgr dbm, char *key);
 
+// Look up key in table tblname without loading
+// the whole table if its engine can read single
+// keys from disk. Otherwise the table is opened
+// and becomes the current table.
+// Returns -1 if table does not exist, -2 on memory
+// allocation or file error, 0 if key not found,
+// 1 and copies value to dst if found.
+int lookup_tbl(db_mgr dbm, char *tblname, char *key, char *dst, size_t dsize);
+
+// Add key and val to, or delete key from if val
+// is NULL, table tblname and save the table. Tables
+// that are not open are updated on disk without
+// being loaded if their engine supports it.
+// Otherwise the table is opened, becomes the
+// current table, and is saved.
+// Returns -1 if table does not exist, -2 on memory
+// allocation or file error, -3 if key to add already
+// exists, 0 if key to delete not found, 1 on success.
+int update_tbl(db_mgr dbm, char *tblname, char *key, char *val);
+
+// Returns true if key is in current table
+bool has_key(db_mgr dbm, char *key);
+
 // Key and value removed from current table.
 // Running multiple times on the same key has no effect.
 // Returns 1 on success, 0 on failure.
@@ -137,6 +343,92 @@ char **get_tbl_keys(db_mgr dbm);
 // freeing returned pointer.
 char **get_tbl_vals(db_mgr dbm);
 
+// Call fn for every key-value pair in current
+// table. Stops early if fn returns nonzero.
+// Returns 1 on success, -1 if there is no
+// current table or on error.
+int iterate_tbl(db_mgr dbm, engine_iter_fn fn, void *arg);
+
+// Call fn for entries of current table in the
+// order of iterate_tbl, starting at position
+// *cursor (0 for the first), until fn returns
+// nonzero. *cursor is set to the position of the
+// next entry, or 0 if no entries are left, so a
+// table can be listed in pages. Every entry is
+// visited once if the table does not change
+// between calls. Engines that cannot start at a
+// position skip the entries before it.
+// Returns 1 on success, -1 if there is no
+// current table or on error.
+int scan_tbl(db_mgr dbm, size_t *cursor, engine_iter_fn fn, void *arg);
+
+// Add all rows of file at path in format fmt to
+// current table. Rows whose key already exists are
+// skipped, as with add. bad_row is called for each
+// malformed row and may be NULL.
+// Returns -1 if there is no current table or the
+// file cannot be read, -2 on memory allocation or
+// table file error, 1 on success.
+int import_tbl(db_mgr dbm, const char *path, enum bulk_format fmt,
+               struct import_stats *stats,
+               void (*bad_row)(void *arg, size_t lineno, const char *reason),
+               void *arg);
+
+// Write all pairs of current table to file at path
+// in format fmt, in key order if sorted is true.
+// Returns -1 if there is no current table, -2 on
+// file, memory allocation, or table error, 1 on success.
+int export_tbl(db_mgr dbm, const char *path, enum bulk_format fmt,
+               bool sorted, struct export_stats *stats);
+
+// Engine and engine counters of current table
+struct tbl_info {
+    const char *engine;
+    size_t numstats;
+    struct engine_stat stats[ENGINE_STATS_MAX];
+};
+
+// Fill info for current table.
+// Returns 1 on success, -1 if there is
+// no current table.
+int get_tbl_info(db_mgr dbm, struct tbl_info *info);
+
+// Internal work that can make a command slow.
+// db_mgr records the work it does as flags, so
+// that a slow command can be reported with what
+// it triggered.
+enum db_event {
+    DB_EV_LOAD = 1,         // Table loaded from disk
+    DB_EV_SAVE = 2,         // Table saved with only its changes
+    DB_EV_FULL_SAVE = 4,    // Table file rewritten in full
+    DB_EV_RESIZE = 8,       // Table resized by add
+    DB_EV_EVICT = 16,       // Open tables closed to fit cache budget
+    DB_EV_FORK = 32,        // Background save process started
+    DB_EV_BGSAVE_WAIT = 64  // Waited for running background save
+};
+
+// Write names of event flags in events to dst,
+// separated by commas, or "-" if there are none.
+void format_db_events(unsigned events, char *dst, size_t dsize);
+
+// Latency histograms and slow log of commands
+// run on dbm, held by dbm and freed with it.
+// Commands are recorded with start_cmd_latency
+// and record_cmd_latency.
+latency get_latency(db_mgr dbm);
+
+// Read the monotonic clock into start and clear
+// event flags before running a command.
+void start_cmd_latency(db_mgr dbm, struct timespec *start);
+
+// Add the time since start to the histogram of
+// command kind cmd. If the command reaches the
+// slow log threshold, it is logged with tblname,
+// arg, and the events since start_cmd_latency.
+// tblname and arg may be NULL.
+void record_cmd_latency(db_mgr dbm, size_t cmd, const struct timespec *start,
+                        const char *tblname, const char *arg);
+
 // Get number of tables saved in file.
 // Returns 0 if there are no tables
 // and on error.
@@ -147,4 +439,9 @@ size_t get_numtbls(db_mgr dbm);
 // freeing returned pointer.
 char **get_tbls(db_mgr dbm);
 
+// Call fn with the catalog record of every
+// saved table. Stops early if fn returns nonzero.
+// Returns -1 on error, 1 on success.
+int list_tbls(db_mgr dbm, cat_iter_fn fn, void *arg);
+
 #endif // DB_MANAGER_H
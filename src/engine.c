@@ -0,0 +1,562 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Table storage engines - adapters from the engine
+ * operations declared in engine.h to the hashtable,
+ * cuckoo, and lsm table modules.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "hashtable.h"
+#include "cuckoo.h"
+#include "lsm.h"
+
+enum {
+    INIT_HASHTBL_SIZE = 32,
+    INIT_CUCKOO_CAPACITY = 32
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Append counter to stats if there is room.
+// Returns new number of counters.
+static size_t add_stat(struct engine_stat *stats, size_t n, size_t max,
+                       const char *name, size_t value)
+{
+    if (n < max) {
+        stats[n].name = name;
+        stats[n].value = value;
+        n++;
+    }
+    return n;
+}
+
+static int remove_file(const char *path)
+{
+    return unlink(path) < 0 ? -1 : 1;
+}
+
+/*
+ *
+ * hash engine - hashtable.h
+ *
+ */
+
+static void *hash_create(const char *path)
+{
+    (void) path;
+    return init_hashtbl(INIT_HASHTBL_SIZE);
+}
+
+// Reads the fixed-layout format, falling back to
+// the stream format used by earlier versions.
+// Tables loaded from the stream format are
+// rewritten in full on their next save.
+static void *hash_open(const char *path, unsigned nthreads)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    hashtbl tbl = load_hashtbl_parallel(fd, nthreads);
+    if (tbl) {
+        close(fd);
+        return tbl;
+    }
+
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return NULL;
+    }
+    FILE *inf = fdopen(fd, "r");
+    if (!inf) {
+        close(fd);
+        return NULL;
+    }
+    tbl = load_hashtbl_from_file(inf);
+    fclose(inf);
+    hashtbl_mark_unsynced(tbl);
+
+    return tbl;
+}
+
+static void hash_close(void *tbl)
+{
+    destroy_hashtbl(tbl);
+}
+
+static size_t hash_get(char *dst, size_t dsize, void *tbl, const char *key)
+{
+    return find(dst, dsize, tbl, (char *) key);
+}
+
+static int hash_lookup(const char *path, const char *key, char *dst, size_t dsize)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = hashtbl_lookup_fd(fd, key, dst, dsize);
+    close(fd);
+    return ret;
+}
+
+static int hash_update(const char *path, const char *key, const char *val, bool sync)
+{
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return -3;
+    }
+    int ret = hashtbl_update_fd(fd, key, val, sync);
+    if (close(fd) < 0 && ret > 0) {
+        ret = -2;
+    }
+    return ret;
+}
+
+static bool hash_exists(void *tbl, const char *key)
+{
+    return exists(tbl, (char *) key);
+}
+
+static int hash_put(void *tbl, const char *key, const char *val)
+{
+    return put(tbl, (char *) key, (char *) val);
+}
+
+static int hash_del(void *tbl, const char *key)
+{
+    delete(tbl, (char *) key);
+    return 1;
+}
+
+static size_t hash_count(void *tbl)
+{
+    return get_numentries(tbl);
+}
+
+static int hash_reserve(void *tbl, size_t n)
+{
+    return hashtbl_reserve(tbl, n);
+}
+
+static char **hash_keys(void *tbl)
+{
+    return get_keys(tbl);
+}
+
+static char **hash_vals(void *tbl)
+{
+    return get_vals(tbl);
+}
+
+static int hash_iterate(void *tbl, engine_iter_fn fn, void *arg)
+{
+    return hashtbl_foreach(tbl, fn, arg);
+}
+
+static size_t hash_scan(void *tbl, size_t cursor, engine_iter_fn fn, void *arg)
+{
+    return hashtbl_scan(tbl, cursor, fn, arg);
+}
+
+static ssize_t hash_persist(void *tbl, int fd, bool full, bool sync)
+{
+    return hashtbl_sync_file(tbl, fd, full, sync);
+}
+
+static bool hash_needs_full(void *tbl)
+{
+    return hashtbl_needs_full_sync(tbl);
+}
+
+static void hash_mark_saved(void *tbl, bool saved)
+{
+    if (saved) {
+        hashtbl_mark_synced(tbl);
+    }
+    else {
+        hashtbl_mark_unsynced(tbl);
+    }
+}
+
+static size_t hash_mem_usage(void *tbl)
+{
+    return get_mem_usage(tbl);
+}
+
+static size_t hash_resizes(void *tbl)
+{
+    return get_num_resizes(tbl);
+}
+
+static size_t hash_stats(void *tbl, struct engine_stat *stats, size_t max)
+{
+    size_t n = 0;
+    n = add_stat(stats, n, max, "entries", get_numentries(tbl));
+    n = add_stat(stats, n, max, "buckets", get_tbl_size(tbl));
+    n = add_stat(stats, n, max, "resizes", get_num_resizes(tbl));
+    n = add_stat(stats, n, max, "memory_bytes", get_mem_usage(tbl));
+    return n;
+}
+
+/*
+ *
+ * cuckoo engine - cuckoo.h
+ *
+ */
+
+static void *ck_create(const char *path)
+{
+    (void) path;
+    return cuckoo_init(INIT_CUCKOO_CAPACITY);
+}
+
+static void *ck_open(const char *path, unsigned nthreads)
+{
+    (void) nthreads;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    cuckoo_tbl tbl = cuckoo_load_fd(fd);
+    close(fd);
+    return tbl;
+}
+
+static void ck_close(void *tbl)
+{
+    cuckoo_destroy(tbl);
+}
+
+static size_t ck_get(char *dst, size_t dsize, void *tbl, const char *key)
+{
+    return cuckoo_find(dst, dsize, tbl, key);
+}
+
+static bool ck_exists(void *tbl, const char *key)
+{
+    return cuckoo_exists(tbl, key);
+}
+
+static int ck_put(void *tbl, const char *key, const char *val)
+{
+    return cuckoo_put(tbl, key, val);
+}
+
+static int ck_del(void *tbl, const char *key)
+{
+    cuckoo_delete(tbl, key);
+    return 1;
+}
+
+static size_t ck_count(void *tbl)
+{
+    return cuckoo_count(tbl);
+}
+
+static int ck_reserve(void *tbl, size_t n)
+{
+    return cuckoo_reserve(tbl, n);
+}
+
+static size_t ck_resizes(void *tbl)
+{
+    struct cuckoo_stats cs = {0};
+    cuckoo_get_stats(tbl, &cs);
+    return cs.resizes;
+}
+
+static char **ck_keys(void *tbl)
+{
+    return cuckoo_get_keys(tbl);
+}
+
+static char **ck_vals(void *tbl)
+{
+    return cuckoo_get_vals(tbl);
+}
+
+static int ck_iterate(void *tbl, engine_iter_fn fn, void *arg)
+{
+    return cuckoo_foreach(tbl, fn, arg);
+}
+
+static size_t ck_scan(void *tbl, size_t cursor, engine_iter_fn fn, void *arg)
+{
+    return cuckoo_scan(tbl, cursor, fn, arg);
+}
+
+// Cuckoo tables are always written in full
+static ssize_t ck_persist(void *tbl, int fd, bool full, bool sync)
+{
+    (void) full;
+    return cuckoo_write_fd(tbl, fd, sync);
+}
+
+static size_t ck_mem_usage(void *tbl)
+{
+    return cuckoo_mem_usage(tbl);
+}
+
+static size_t ck_stats(void *tbl, struct engine_stat *stats, size_t max)
+{
+    struct cuckoo_stats cs = {0};
+    cuckoo_get_stats(tbl, &cs);
+
+    size_t n = 0;
+    n = add_stat(stats, n, max, "entries", cs.entries);
+    n = add_stat(stats, n, max, "buckets", cs.buckets);
+    n = add_stat(stats, n, max, "slots", cs.buckets * CK_BUCKET_SLOTS);
+    n = add_stat(stats, n, max, "kicks", cs.kicks);
+    n = add_stat(stats, n, max, "max_kick_chain", cs.max_kicks);
+    n = add_stat(stats, n, max, "resizes", cs.resizes);
+    n = add_stat(stats, n, max, "memory_bytes", cuckoo_mem_usage(tbl));
+    return n;
+}
+
+/*
+ *
+ * lsm engine - lsm.h
+ *
+ */
+
+static const char *LSM_LEVEL_FILES[LSM_MAX_LEVELS] = {
+    "files_l0", "files_l1", "files_l2", "files_l3",
+    "files_l4", "files_l5", "files_l6"
+};
+
+static void *lsm_eng_create(const char *path)
+{
+    return lsm_open(path);
+}
+
+static void *lsm_eng_open(const char *path, unsigned nthreads)
+{
+    (void) nthreads;
+    return lsm_open(path);
+}
+
+static void lsm_eng_close(void *tbl)
+{
+    lsm_close(tbl);
+}
+
+static size_t lsm_eng_get(char *dst, size_t dsize, void *tbl, const char *key)
+{
+    return lsm_get(dst, dsize, tbl, key);
+}
+
+static bool lsm_eng_exists(void *tbl, const char *key)
+{
+    return lsm_exists(tbl, key);
+}
+
+// lsm_put replaces values - existing
+// keys are checked first
+static int lsm_eng_put(void *tbl, const char *key, const char *val)
+{
+    if (lsm_exists(tbl, key)) {
+        return -1;
+    }
+    return lsm_put(tbl, key, val);
+}
+
+static int lsm_eng_del(void *tbl, const char *key)
+{
+    return lsm_del(tbl, key);
+}
+
+static size_t lsm_eng_count(void *tbl)
+{
+    return lsm_count(tbl);
+}
+
+static char **lsm_eng_keys(void *tbl)
+{
+    return lsm_get_keys(tbl);
+}
+
+static char **lsm_eng_vals(void *tbl)
+{
+    return lsm_get_vals(tbl);
+}
+
+static int lsm_eng_iterate(void *tbl, engine_iter_fn fn, void *arg)
+{
+    return lsm_scan(tbl, fn, arg);
+}
+
+static ssize_t lsm_eng_persist(void *tbl, int fd, bool full, bool sync)
+{
+    (void) fd;
+    (void) full;
+    return lsm_flush(tbl, sync);
+}
+
+static void lsm_eng_set_sync(void *tbl, bool sync, unsigned int group_ms)
+{
+    lsm_set_sync(tbl, sync, group_ms);
+}
+
+static void lsm_eng_hold_flush(void *tbl, bool hold)
+{
+    lsm_hold_flush(tbl, hold);
+}
+
+static size_t lsm_eng_mem_usage(void *tbl)
+{
+    return lsm_mem_usage(tbl);
+}
+
+static size_t lsm_eng_stats(void *tbl, struct engine_stat *stats, size_t max)
+{
+    struct lsm_stats ls = {0};
+    lsm_get_stats(tbl, &ls);
+
+    size_t n = 0;
+    n = add_stat(stats, n, max, "memtable_entries", ls.memtable_entries);
+    n = add_stat(stats, n, max, "memtable_bytes", ls.memtable_bytes);
+    for (int i = 0; i < LSM_MAX_LEVELS; i++) {
+        if (ls.files[i] > 0) {
+            n = add_stat(stats, n, max, LSM_LEVEL_FILES[i], ls.files[i]);
+        }
+    }
+    n = add_stat(stats, n, max, "flushes", ls.flushes);
+    n = add_stat(stats, n, max, "compactions", ls.compactions);
+    n = add_stat(stats, n, max, "bloom_skips", ls.bloom_skips);
+    n = add_stat(stats, n, max, "block_reads", ls.block_reads);
+    n = add_stat(stats, n, max, "memory_bytes", lsm_mem_usage(tbl));
+    return n;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+
+static const struct tbl_engine ENGINES[] = {
+    {
+        .name = "hash",
+        .ext = ".pairdb",
+        .dir_storage = false,
+        .create = hash_create,
+        .open = hash_open,
+        .close = hash_close,
+        .get = hash_get,
+        .lookup = hash_lookup,
+        .update = hash_update,
+        .exists = hash_exists,
+        .put = hash_put,
+        .del = hash_del,
+        .count = hash_count,
+        .reserve = hash_reserve,
+        .resizes = hash_resizes,
+        .keys = hash_keys,
+        .vals = hash_vals,
+        .iterate = hash_iterate,
+        .scan = hash_scan,
+        .persist = hash_persist,
+        .needs_full = hash_needs_full,
+        .mark_saved = hash_mark_saved,
+        .set_sync = NULL,
+        .hold_flush = NULL,
+        .remove = remove_file,
+        .mem_usage = hash_mem_usage,
+        .stats = hash_stats
+    },
+    {
+        .name = "cuckoo",
+        .ext = ".cuckoo",
+        .dir_storage = false,
+        .create = ck_create,
+        .open = ck_open,
+        .close = ck_close,
+        .get = ck_get,
+        .lookup = NULL,
+        .update = NULL,
+        .exists = ck_exists,
+        .put = ck_put,
+        .del = ck_del,
+        .count = ck_count,
+        .reserve = ck_reserve,
+        .resizes = ck_resizes,
+        .keys = ck_keys,
+        .vals = ck_vals,
+        .iterate = ck_iterate,
+        .scan = ck_scan,
+        .persist = ck_persist,
+        .needs_full = NULL,
+        .mark_saved = NULL,
+        .set_sync = NULL,
+        .hold_flush = NULL,
+        .remove = remove_file,
+        .mem_usage = ck_mem_usage,
+        .stats = ck_stats
+    },
+    {
+        .name = "lsm",
+        .ext = ".lsm",
+        .dir_storage = true,
+        .create = lsm_eng_create,
+        .open = lsm_eng_open,
+        .close = lsm_eng_close,
+        .get = lsm_eng_get,
+        .lookup = NULL,
+        .update = NULL,
+        .exists = lsm_eng_exists,
+        .put = lsm_eng_put,
+        .del = lsm_eng_del,
+        .count = lsm_eng_count,
+        .resizes = NULL,
+        .keys = lsm_eng_keys,
+        .vals = lsm_eng_vals,
+        .iterate = lsm_eng_iterate,
+        .scan = NULL,
+        .persist = lsm_eng_persist,
+        .needs_full = NULL,
+        .mark_saved = NULL,
+        .set_sync = lsm_eng_set_sync,
+        .hold_flush = lsm_eng_hold_flush,
+        .remove = lsm_remove_dir,
+        .mem_usage = lsm_eng_mem_usage,
+        .stats = lsm_eng_stats
+    }
+};
+
+// Returns engine with name, or the default hash
+// engine if name is NULL or empty.
+// Returns NULL if name is not a known engine.
+const struct tbl_engine *find_engine(const char *name)
+{
+    if (!name || name[0] == '\0') {
+        return default_engine();
+    }
+
+    for (size_t i = 0; i < sizeof(ENGINES) / sizeof(ENGINES[0]); i++) {
+        if (strcmp(name, ENGINES[i].name) == 0) {
+            return &ENGINES[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns the default hash engine
+const struct tbl_engine *default_engine(void)
+{
+    return &ENGINES[0];
+}
@@ -0,0 +1,195 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Table storage engines.
+ *
+ * A storage engine is a table of operations that
+ * db_manager calls for every table it opens. Each
+ * engine works on its own table handle, passed to
+ * the operations as void *. Available engines:
+ *
+ *      hash    Hash table with quadratic probing, held
+ *              in memory and saved to a fixed-layout
+ *              file updated in place (hashtable.h).
+ *              The default engine.
+ *      cuckoo  Cuckoo hash table with worst-case
+ *              constant time lookups, held in memory
+ *              and saved to a single file (cuckoo.h).
+ *      lsm     Log-structured merge tree stored in a
+ *              directory, for tables larger than
+ *              memory (lsm.h).
+ *
+ * File engines store a table in one file. db_manager
+ * opens the file and handles temporary files, renames,
+ * and fsync for them, so every file engine gets the
+ * same durability modes. Directory engines manage the
+ * files in their directory themselves.
+ *
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum {
+    ENGINE_STATS_MAX = 16
+};
+
+// Named engine counter reported by the stats operation
+struct engine_stat {
+    const char *name;
+    size_t value;
+};
+
+// Called by the iterate operation for each entry.
+// Return nonzero to stop iteration.
+typedef int (*engine_iter_fn)(const char *key, const char *val, void *arg);
+
+struct tbl_engine {
+    const char *name;
+
+    // Extension of table file or directory name
+    const char *ext;
+
+    // True if table is stored in a directory
+    // managed by the engine
+    bool dir_storage;
+
+    // Returns new empty table, NULL on failure.
+    // Directory engines create their directory at
+    // path; file engines do not use path.
+    void *(*create)(const char *path);
+
+    // Returns table stored at path, loaded with up
+    // to nthreads threads if the engine supports it.
+    // Returns NULL on failure.
+    void *(*open)(const char *path, unsigned nthreads);
+
+    void (*close)(void *tbl);
+
+    // Copies value of key to dst. Returns length
+    // of value, 0 if key not found.
+    size_t (*get)(char *dst, size_t dsize, void *tbl, const char *key);
+
+    bool (*exists)(void *tbl, const char *key);
+
+    // May be NULL. Looks up key in table stored at
+    // path without opening the table. Returns 1 and
+    // copies value to dst if found, 0 if not found,
+    // -1 if the file cannot be read this way - the
+    // caller then opens the table.
+    int (*lookup)(const char *path, const char *key, char *dst, size_t dsize);
+
+    // May be NULL. Adds key and val to, or deletes
+    // key from if val is NULL, table stored at path
+    // without opening the table, flushed to disk if
+    // sync is true. Returns 1 on success, 0 if key to
+    // delete not found, -1 if key to add already
+    // exists, -2 on file error, -3 if the file cannot
+    // be updated this way - the caller then opens
+    // the table.
+    int (*update)(const char *path, const char *key, const char *val, bool sync);
+
+    // Returns -1 if key already exists, -2 on memory
+    // allocation or file error, 1 on success.
+    int (*put)(void *tbl, const char *key, const char *val);
+
+    // Returns 1 on success, -2 on memory allocation
+    // or file error. Deleting a missing key succeeds.
+    int (*del)(void *tbl, const char *key);
+
+    size_t (*count)(void *tbl);
+
+    // May be NULL. Make room for at least n entries
+    // so that adding them does not resize the table.
+    // Returns -2 on memory allocation error, 1 on success.
+    int (*reserve)(void *tbl, size_t n);
+
+    // May be NULL. Number of times the table has
+    // been resized since it was created or opened.
+    // NULL - the table never resizes.
+    size_t (*resizes)(void *tbl);
+
+    // Heap-allocated arrays of key and val strings
+    // in the same order. Caller frees the array;
+    // strings are owned by the table.
+    char **(*keys)(void *tbl);
+    char **(*vals)(void *tbl);
+
+    // Calls fn for every entry. Returns 1 when done
+    // or stopped by fn, -1 on error.
+    int (*iterate)(void *tbl, engine_iter_fn fn, void *arg);
+
+    // May be NULL. Calls fn for entries from position
+    // cursor (0 for the first) in iterate order until
+    // fn returns nonzero. Returns cursor of the next
+    // entry, 0 if no entries are left. Cursors hold
+    // while the table is not changed between calls.
+    // NULL - the caller counts entries with iterate.
+    size_t (*scan)(void *tbl, size_t cursor, engine_iter_fn fn, void *arg);
+
+    // Write table to storage. Returns bytes written,
+    // -1 on error.
+    // File engines: write table to file open for
+    // reading and writing at fd. If full is true, fd
+    // is an empty file; otherwise it holds the table
+    // as of its last save. fd is flushed to disk
+    // before persist returns if sync is true.
+    // Directory engines: write unsaved changes to the
+    // table directory, flushed to disk if sync is
+    // true. fd and full are not used.
+    ssize_t (*persist)(void *tbl, int fd, bool full, bool sync);
+
+    // File engines only, may be NULL. Returns true if
+    // the next save must write a new file rather than
+    // update the existing one. NULL - always true.
+    bool (*needs_full)(void *tbl);
+
+    // File engines only, may be NULL. Record whether
+    // the table file matches the table - after a save
+    // made outside persist, or after a failed save.
+    void (*mark_saved)(void *tbl, bool saved);
+
+    // Directory engines only, may be NULL. Set whether
+    // files the engine writes on its own, outside
+    // persist, are flushed to disk: with fsync if sync
+    // is true, otherwise together every group_ms
+    // milliseconds, or never if group_ms is 0.
+    void (*set_sync)(void *tbl, bool sync, unsigned int group_ms);
+
+    // Directory engines only, may be NULL. While hold
+    // is true, the engine writes nothing on its own, so
+    // changes made until the next persist reach disk
+    // together in it.
+    void (*hold_flush)(void *tbl, bool hold);
+
+    // Delete table file or directory at path.
+    // Returns 1 on success, -1 on failure.
+    int (*remove)(const char *path);
+
+    // Bytes of memory held by table
+    size_t (*mem_usage)(void *tbl);
+
+    // Fill up to max engine counters.
+    // Returns number of counters filled.
+    size_t (*stats)(void *tbl, struct engine_stat *stats, size_t max);
+};
+
+// Returns engine with name, or the default hash
+// engine if name is NULL or empty.
+// Returns NULL if name is not a known engine.
+const struct tbl_engine *find_engine(const char *name);
+
+// Returns the default hash engine
+const struct tbl_engine *default_engine(void);
+
+#endif // ENGINE_H
@@ -0,0 +1,354 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Hash quality analysis. See hashstat.h.
+ *
+ * The simulated table is an array of occupied flags,
+ * one per bucket, and an array of the number of keys
+ * whose home is each bucket. Full hash collisions are
+ * counted by sorting the hash values of all keys.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "hashstat.h"
+#include "hashtable.h"
+#include "pairdbconst.h"
+
+enum {
+    KEYS_INIT_CAP = 1024
+};
+
+static const char *HASH_NAMES[] = {"fnv1a", "fnv1a-mix", "murmur3", "djb2"};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// MurmurHash3 32-bit finalizer
+// In public domain - see link
+// https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+static uint32_t fmix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+// MurmurHash3 x86_32 with seed 0
+static uint32_t murmur3(const char *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+    size_t len = strlen(key);
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    uint32_t h = 0;
+
+    size_t nblocks = len / 4;
+    for (size_t i = 0; i < nblocks; i++) {
+        uint32_t k = (uint32_t) p[i * 4] | (uint32_t) p[i * 4 + 1] << 8 |
+                     (uint32_t) p[i * 4 + 2] << 16 | (uint32_t) p[i * 4 + 3] << 24;
+        k *= c1;
+        k = rotl32(k, 15);
+        k *= c2;
+        h ^= k;
+        h = rotl32(h, 13);
+        h = h * 5 + 0xe6546b64;
+    }
+
+    const unsigned char *tail = p + nblocks * 4;
+    uint32_t k = 0;
+    switch (len & 3) {
+        case 3:
+            k ^= (uint32_t) tail[2] << 16;
+            // fall through
+        case 2:
+            k ^= (uint32_t) tail[1] << 8;
+            // fall through
+        case 1:
+            k ^= tail[0];
+            k *= c1;
+            k = rotl32(k, 15);
+            k *= c2;
+            h ^= k;
+    }
+
+    h ^= (uint32_t) len;
+    return fmix32(h);
+}
+
+static uint32_t djb2(const char *key)
+{
+    uint32_t h = 5381;
+    for (const unsigned char *p = (const unsigned char *) key; *p; p++) {
+        h = h * 33 + *p;
+    }
+    return h;
+}
+
+static int cmp_hash(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+    return (x > y) - (x < y);
+}
+
+// Number of keys whose hash is shared with another key
+static size_t count_collisions(unsigned int *hashes, size_t n)
+{
+    qsort(hashes, n, sizeof(unsigned int), cmp_hash);
+    size_t collisions = 0;
+    size_t run = 1;
+    for (size_t i = 1; i <= n; i++) {
+        if (i < n && hashes[i] == hashes[i - 1]) {
+            run++;
+            continue;
+        }
+        if (run > 1) {
+            collisions += run;
+        }
+        run = 1;
+    }
+    return collisions;
+}
+
+// Keep key among outliers if its probe
+// sequence is one of the longest
+static void add_outlier(struct hs_report *rep, const char *key, size_t probes)
+{
+    size_t pos = rep->numoutliers;
+    if (pos == HS_OUTLIERS) {
+        if (probes <= rep->outliers[HS_OUTLIERS - 1].probes) {
+            return;
+        }
+        pos--;
+    }
+    else {
+        rep->numoutliers++;
+    }
+    while (pos > 0 && rep->outliers[pos - 1].probes < probes) {
+        rep->outliers[pos] = rep->outliers[pos - 1];
+        pos--;
+    }
+    rep->outliers[pos].key = key;
+    rep->outliers[pos].probes = probes;
+}
+
+// x to the power of n, by squaring
+static double ipow(double x, size_t n)
+{
+    double result = 1;
+    while (n > 0) {
+        if (n & 1) {
+            result *= x;
+        }
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+const char *hs_hash_name(enum hs_hash fn)
+{
+    return fn < HS_NUM_HASHES ? HASH_NAMES[fn] : "";
+}
+
+unsigned int hs_hash_key(enum hs_hash fn, const char *key)
+{
+    switch (fn) {
+        case HS_FNV1A_MIX:
+            return fmix32(hash_key(key));
+        case HS_MURMUR3:
+            return murmur3(key);
+        case HS_DJB2:
+            return djb2(key);
+        default:
+            return hash_key(key);
+    }
+}
+
+int hs_keys_add(struct hs_keys *ks, const char *key)
+{
+    if (ks->numkeys == ks->cap) {
+        size_t cap = ks->cap ? ks->cap * 2 : KEYS_INIT_CAP;
+        char **keys = realloc(ks->keys, cap * sizeof(char *));
+        if (!keys) {
+            return -2;
+        }
+        ks->keys = keys;
+        ks->cap = cap;
+    }
+
+    // Keys are cut to the length tables store
+    char *copy = strndup(key, KEY_MAX - 1);
+    if (!copy) {
+        return -2;
+    }
+    ks->keys[ks->numkeys++] = copy;
+    return 1;
+}
+
+int hs_keys_read(struct hs_keys *ks, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int result = 1;
+    while (result == 1 && (len = getline(&line, &cap, f)) >= 0) {
+        line[strcspn(line, "\t\r\n")] = '\0';
+        if (line[0] != '\0') {
+            result = hs_keys_add(ks, line);
+        }
+    }
+    if (result == 1 && ferror(f)) {
+        result = -1;
+    }
+    free(line);
+    fclose(f);
+    return result;
+}
+
+void hs_keys_free(struct hs_keys *ks)
+{
+    for (size_t i = 0; i < ks->numkeys; i++) {
+        free(ks->keys[i]);
+    }
+    free(ks->keys);
+    ks->keys = NULL;
+    ks->numkeys = 0;
+    ks->cap = 0;
+}
+
+int hs_analyze(const struct hs_keys *ks, enum hs_hash fn, double load_lim,
+               bool full, struct hs_report *rep)
+{
+    memset(rep, 0, sizeof(struct hs_report));
+    if (ks->numkeys == 0 || !(load_lim > 0 && load_lim <= 1)) {
+        return -1;
+    }
+
+    size_t n = ks->numkeys;
+    size_t arrsize = 1;
+    while ((double) n / arrsize > load_lim) {
+        arrsize *= 2;
+    }
+    if (full) {
+        if (arrsize > 1 && (size_t) (arrsize * load_lim) > n) {
+            arrsize /= 2;
+        }
+        size_t fit = arrsize * load_lim;
+        n = fit > 0 && fit < n ? fit : n;
+    }
+    size_t mask = arrsize - 1;
+
+    bool *used = calloc(arrsize, sizeof(bool));
+    uint32_t *homes = calloc(arrsize, sizeof(uint32_t));
+    unsigned int *hashes = malloc(n * sizeof(unsigned int));
+    if (!used || !homes || !hashes) {
+        free(used);
+        free(homes);
+        free(hashes);
+        return -2;
+    }
+
+    double total_probes = 0;
+    for (size_t k = 0; k < n; k++) {
+        unsigned int hv = hs_hash_key(fn, ks->keys[k]);
+        hashes[k] = hv;
+        homes[hv & mask]++;
+
+        // Probe sequence of arr_insert in hashtable.c
+        size_t i = 0;
+        size_t probe = hv;
+        while (used[probe & mask]) {
+            i++;
+            probe = (size_t) hv + ((i * i + i) / 2);
+        }
+        used[probe & mask] = true;
+
+        rep->probes[i < HS_PROBE_MAX ? i : HS_PROBE_MAX]++;
+        total_probes += i;
+        if (i > rep->maxprobe) {
+            rep->maxprobe = i;
+        }
+        add_outlier(rep, ks->keys[k], i);
+    }
+
+    double sum_sq = 0;
+    for (size_t b = 0; b < arrsize; b++) {
+        rep->home[homes[b] < HS_HOME_MAX ? homes[b] : HS_HOME_MAX]++;
+        sum_sq += (double) homes[b] * homes[b];
+    }
+
+    rep->numkeys = n;
+    rep->arrsize = arrsize;
+    rep->load = (double) n / arrsize;
+    rep->mean_probes = total_probes / n;
+    rep->clustering = n > 1 ? (double) arrsize / (n - 1) * (sum_sq / n - 1) : 0;
+    rep->hash_collisions = count_collisions(hashes, n);
+
+    free(used);
+    free(homes);
+    free(hashes);
+    return 1;
+}
+
+size_t hs_probe_percentile(const struct hs_report *rep, double q)
+{
+    size_t seen = 0;
+    for (size_t i = 0; i < HS_PROBE_MAX; i++) {
+        seen += rep->probes[i];
+        if (seen >= q * rep->numkeys) {
+            return i;
+        }
+    }
+    return HS_PROBE_MAX;
+}
+
+double hs_uniform_home(const struct hs_report *rep, size_t k)
+{
+    if (rep->arrsize < 2) {
+        return k == 1 ? rep->arrsize : 0;
+    }
+
+    // Binomial probability that a bucket is home to
+    // j of n keys, from p(0) = (1 - 1/m)^n
+    double m = rep->arrsize;
+    double n = rep->numkeys;
+    double p = ipow(1.0 - 1.0 / m, rep->numkeys);
+    double below = 0;
+    for (size_t j = 0; j < k && j < HS_HOME_MAX; j++) {
+        below += p;
+        p = j < n ? p * (n - j) / ((j + 1) * (m - 1)) : 0;
+    }
+    if (k >= HS_HOME_MAX) {
+        return below < 1 ? m * (1.0 - below) : 0;
+    }
+    return m * p;
+}
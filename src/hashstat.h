@@ -0,0 +1,138 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Hash quality analysis - hashstat
+ *
+ * Inserts a set of keys into a simulated hash table
+ * laid out as hashtable.c lays out its tables: a power
+ * of 2 number of buckets, sized as by hashtbl_reserve
+ * for a given load factor limit, and quadratic probing
+ * with the sequence hash + (i * i + i) / 2. Only bucket
+ * positions are simulated, so any hash function and
+ * load factor limit can be tried on the same keys.
+ *
+ * The report holds the number of keys per home bucket
+ * (the bucket of probe 0), the number of keys placed
+ * after each probe length, the keys with the longest
+ * probe sequences, the number of keys sharing a full
+ * 32-bit hash value, and the clustering coefficient of
+ * home buckets:
+ *
+ *      C = m / (n - 1) * (sum(x_i^2) / n - 1)
+ *
+ * for n keys in m buckets, where x_i is the number of
+ * keys whose home bucket is i. A hash that spreads keys
+ * as a uniformly random one does gives C close to 1;
+ * greater values mean keys are clustered.
+ *
+ * Keys are inserted in the order given. Probe lengths
+ * in a real table also depend on the order of inserts,
+ * deletes, and resizes, so they may differ slightly.
+ *
+ */
+
+#ifndef HASHSTAT_H
+#define HASHSTAT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+enum {
+    HS_HOME_MAX = 8,        // Home bucket counts above are added to this one
+    HS_PROBE_MAX = 64,      // Probe lengths above are added to this one
+    HS_OUTLIERS = 10        // Longest probe sequences kept
+};
+
+// Hash functions that can be compared
+enum hs_hash {
+    HS_FNV1A,           // FNV-1a, as used by hashtable.c
+    HS_FNV1A_MIX,       // FNV-1a followed by the MurmurHash3 finalizer
+    HS_MURMUR3,         // MurmurHash3 x86_32, seed 0
+    HS_DJB2,            // Bernstein's hash, h * 33 + c
+    HS_NUM_HASHES
+};
+
+// Key set to analyze
+struct hs_keys {
+    char **keys;
+    size_t numkeys;
+    size_t cap;
+};
+
+struct hs_outlier {
+    const char *key;
+    size_t probes;
+};
+
+struct hs_report {
+    size_t numkeys;
+    size_t arrsize;
+    double load;
+
+    // Buckets that are home to 0, 1, ... keys
+    size_t home[HS_HOME_MAX + 1];
+    double clustering;
+
+    // Keys placed after 0, 1, ... probes
+    size_t probes[HS_PROBE_MAX + 1];
+    size_t maxprobe;
+    double mean_probes;
+
+    // Keys whose hash value equals that of
+    // another key
+    size_t hash_collisions;
+
+    // Longest probe sequences, longest first
+    struct hs_outlier outliers[HS_OUTLIERS];
+    size_t numoutliers;
+};
+
+// Name of hash function, "" if unknown
+const char *hs_hash_name(enum hs_hash fn);
+
+// Hash of key with function fn
+unsigned int hs_hash_key(enum hs_hash fn, const char *key);
+
+// Add copy of key to key set.
+// Returns 1 on success, -2 on memory allocation error.
+int hs_keys_add(struct hs_keys *ks, const char *key);
+
+// Add keys of a key dump to key set: one key per line,
+// up to the first tab, so that 'lsdata format tsv' and
+// tsv export output can be read. Empty lines are skipped.
+// Returns 1 on success, -1 if the file cannot be read,
+// -2 on memory allocation error.
+int hs_keys_read(struct hs_keys *ks, const char *path);
+
+// Free keys of key set
+void hs_keys_free(struct hs_keys *ks);
+
+// Insert keys of ks into a simulated table with hash
+// function fn and load factor limit load_lim, and fill
+// rep. If full, the table is the largest one that the
+// keys fill to load_lim, and only the first keys that
+// fit are inserted, as in a table about to resize.
+// Otherwise the table is sized for all keys, as by
+// hashtbl_reserve. Outlier keys point into ks.
+// Returns 1 on success, -1 if ks holds no keys or
+// load_lim is not in (0, 1], -2 on memory allocation
+// error.
+int hs_analyze(const struct hs_keys *ks, enum hs_hash fn, double load_lim,
+               bool full, struct hs_report *rep);
+
+// Probe length within which fraction q of the
+// keys of rep were placed
+size_t hs_probe_percentile(const struct hs_report *rep, double q);
+
+// Expected number of buckets that are home to k keys
+// (k or more for HS_HOME_MAX) for the keys and table
+// size of rep if hash values were uniformly random
+double hs_uniform_home(const struct hs_report *rep, size_t k);
+
+#endif // HASHSTAT_H
@@ -16,6 +16,24 @@
  * This prevents false negatives and stops the search
  * function from degrading to linear time.
  *
+ * Tables can be written in two file formats. The stream
+ * format (hashtbl_to_file) writes only occupied buckets
+ * one after another. The fixed-layout format
+ * (hashtbl_sync_file) gives every bucket a fixed-size
+ * slot at a known file offset, grouped into pages. The
+ * table keeps a dirty bit for each page of buckets, so
+ * a fixed-layout file can be updated in place by
+ * rewriting only the pages changed since the last sync.
+ * A full rewrite is needed only after the table array
+ * is resized, since every bucket position changes.
+ *
+ * The bucket array of a fixed-layout file is split into
+ * up to HT_FILE_CHUNKS chunks of whole pages, and the
+ * header records the offset and entry count of each
+ * chunk. Since every slot is stored at its table
+ * position, chunks can be loaded by several threads at
+ * once, each placing entries straight into their buckets.
+ *
  */
 
 
@@ -23,8 +41,16 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "hashtable.h"
+#include "uring.h"
 #include "stringutil.h"
 
 /*
@@ -49,6 +75,22 @@ static const unsigned int FNV_PRIME = 0x01000193; // FNV hash
 static const unsigned int RESIZE_FACTOR = 2;
 static const double LOAD_FACT_LIM = 0.60;
 
+/*
+ *
+ * Values for fixed-layout table files
+ *
+ */
+
+static const char FILE_MAGIC[8] = "PAIRDBF1";
+static const uint32_t FILE_VERSION = 2;
+static const uint32_t FILE_VERSION_NOCHUNKS = 1;   // Header without chunk table
+
+enum {
+    PAGE_SLOTS = HT_FILE_PAGE / HT_FILE_SLOT,  // Buckets per dirty page
+    WRITE_BUF_PAGES = 64,                      // Pages per write call
+    LOAD_MT_MIN_SLOTS = 65536                  // Smaller tables load on one thread
+};
+
 
 /*------------------ Data structures -----------------*/
 
@@ -59,6 +101,35 @@ struct hashtbl_obj {
     size_t arrsize;     // Full table size including empty and used buckets
     size_t numentries;  // Number of occupied buckets
     size_t maxprobe;    // Max number of probes performed during data insert
+
+    // Set when an empty bucket may lie within the
+    // probing sequence of a key, after a delete or a
+    // load from file, and cleared when every entry is
+    // reinserted on resize. Without gaps, a lookup can
+    // stop at the first empty bucket.
+    bool gaps;
+
+    // Dirty tracking for fixed-layout files - one bit per
+    // page of PAGE_SLOTS buckets changed since last sync.
+    // full_dirty is set when every page must be rewritten
+    // (new table, or bucket positions changed on resize).
+    unsigned char *dirty;
+    size_t numpages;
+    bool full_dirty;
+
+    // Occupied buckets in each file chunk of
+    // chunkslots buckets, recorded in the file
+    // header for scheduling parallel loads
+    size_t chunkslots;
+    size_t chunk_used[HT_FILE_CHUNKS];
+
+    // Heap memory held by the table, kept up
+    // to date on insert, delete, and resize
+    size_t membytes;
+
+    // Number of resizes since table was
+    // created or loaded
+    size_t resizes;
 };
 
 struct node {
@@ -68,8 +139,149 @@ struct node {
     size_t tblpos;          // Table position stored for efficient loading from file
 };
 
+// Fixed-layout file chunk - byte offset of
+// first slot and number of occupied slots
+struct file_chunk {
+    uint64_t offset;
+    uint64_t entries;
+};
+
+// Fixed-layout file header, stored at start of page 0.
+// Version 1 files have no chunk table (numchunks 0).
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotsize;
+    uint64_t arrsize;
+    uint64_t numentries;
+    uint64_t maxprobe;
+    uint32_t numchunks;
+    uint32_t pad;
+    struct file_chunk chunks[HT_FILE_CHUNKS];
+};
+
+// Fixed-layout file bucket slot. Slot for bucket i
+// is stored at HT_FILE_PAGE + i * HT_FILE_SLOT.
+// Unused slots are all zero bytes.
+struct file_slot {
+    uint32_t hashval;
+    uint8_t used;
+    uint8_t keylen;
+    uint8_t vallen;
+    uint8_t pad;
+    char key[HT_KEY_MAX];
+    char val[HT_VAL_MAX];
+    char reserved[HT_FILE_SLOT - 8 - HT_KEY_MAX - HT_VAL_MAX];
+};
+
+_Static_assert(sizeof(struct file_slot) == HT_FILE_SLOT,
+               "file_slot must fill HT_FILE_SLOT bytes");
+_Static_assert(sizeof(struct file_header) <= HT_FILE_PAGE,
+               "file_header must fit in first page");
+
+// Range of buckets loaded as one unit of work
+struct load_chunk {
+    size_t first;
+    size_t nslots;
+    size_t entries;     // From file header - used for scheduling only
+};
+
+// State shared by all threads of one parallel load.
+// Each thread takes the next chunk from the chunk
+// list until none are left. Chunks never overlap,
+// so threads write to disjoint buckets of tbl->arr.
+struct load_job {
+    int fd;
+    hashtbl tbl;
+    struct load_chunk *chunks;
+    size_t numchunks;
+    atomic_size_t next;
+    atomic_bool failed;
+};
+
+// Per-thread load results, merged into the
+// table after all threads finish
+struct load_worker {
+    pthread_t thread;
+    bool started;
+    struct load_job *job;
+    size_t numentries;
+    size_t membytes;
+    size_t maxprobe;
+};
+
 /*---------------- Start - static/internal functions --------------*/
 
+// Heap memory held by node and its strings
+static size_t node_mem(struct node *np)
+{
+    return sizeof(struct node) + strlen(np->key) + 1 + strlen(np->val) + 1;
+}
+
+// Allocate node with key and val strings stored in
+// the same block, directly after the node. Copies
+// keylen bytes of key and vallen bytes of val.
+// Returns NULL on memory allocation failure.
+static struct node *new_node(const char *key, size_t keylen,
+                             const char *val, size_t vallen)
+{
+    struct node *np = malloc(sizeof(struct node) + keylen + 1 + vallen + 1);
+    if (!np) {
+        return NULL;
+    }
+
+    np->key = (char *) (np + 1);
+    memcpy(np->key, key, keylen);
+    np->key[keylen] = '\0';
+
+    np->val = np->key + keylen + 1;
+    memcpy(np->val, val, vallen);
+    np->val[vallen] = '\0';
+
+    np->hashval = 0;
+    np->tblpos = 0;
+
+    return np;
+}
+
+// Buckets per file chunk for table of arrsize
+// buckets - whole pages, at most HT_FILE_CHUNKS chunks
+static size_t get_chunkslots(size_t arrsize)
+{
+    size_t pages = (arrsize + PAGE_SLOTS - 1) / PAGE_SLOTS;
+    size_t chunkpages = (pages + HT_FILE_CHUNKS - 1) / HT_FILE_CHUNKS;
+    return chunkpages * PAGE_SLOTS;
+}
+
+// Dirty page bitmap helpers
+static void mark_dirty(hashtbl tbl, size_t pos)
+{
+    size_t page = pos / PAGE_SLOTS;
+    tbl->dirty[page / 8] |= (unsigned char) (1 << (page % 8));
+}
+
+static bool is_dirty(hashtbl tbl, size_t page)
+{
+    return tbl->dirty[page / 8] & (1 << (page % 8));
+}
+
+// Allocate cleared dirty bitmap sized for tbl->arrsize.
+// Returns -1 on memory allocation failure.
+static int alloc_dirty(hashtbl tbl)
+{
+    size_t numpages = (tbl->arrsize + PAGE_SLOTS - 1) / PAGE_SLOTS;
+    unsigned char *dirty = calloc((numpages + 7) / 8, 1);
+    if (!dirty) {
+        return -1;
+    }
+    free(tbl->dirty);
+    tbl->membytes -= (tbl->numpages + 7) / 8;
+    tbl->dirty = dirty;
+    tbl->numpages = numpages;
+    tbl->membytes += (numpages + 7) / 8;
+    return 1;
+}
+
 static double get_load_factor(hashtbl ht)
 {
     if (!ht) {
@@ -133,23 +345,43 @@ static void arr_insert(hashtbl tbl, struct node *np)
     // cache table position for faster
     // loading from disk
     np->tblpos = probe % tbl->arrsize;
+
+    mark_dirty(tbl, np->tblpos);
+    tbl->chunk_used[np->tblpos / tbl->chunkslots]++;
 }
 
+// key and val are stored in the node
+// block - see new_node
 static void free_node(struct node *np)
 {
-    if (!np) {
-        return;
-    }
+    free(np);
+}
 
-    if (np->key) {
-        free(np->key);
-    }
+// find hash table array index of key string
+// with hash value hv
+// returns -1 if key not found
+static ssize_t get_index_by_hash(hashtbl tbl, char *key, unsigned int hv)
+{
+    struct node **arr = tbl->arr;
+    size_t mask = tbl->arrsize - 1;
+    size_t probe = hv;
 
-    if (np->val) {
-        free(np->val);
+    // Loop exits if key has not been found within maxprobe iterations.
+    // Table size is a power of 2, so probe & mask is probe % arrsize.
+    // Keys are only compared if their stored hash values match.
+    for (size_t i = 0; i <= tbl->maxprobe; i++) {
+        probe = (size_t) hv + ((i * i + i) / 2);
+        struct node *np = arr[probe & mask];
+        if (np && np->hashval == hv && strcmp(key, np->key) == 0) {
+            return probe & mask;
+        }
+        // arr_insert would have put key here
+        if (!np && !tbl->gaps) {
+            break;
+        }
     }
 
-    free(np);
+    return -1;
 }
 
 // find hash table array index by key string
@@ -160,53 +392,71 @@ static ssize_t get_index_by_key(hashtbl tbl, char *key)
         return -1;
     }
 
-    struct node **arr = tbl->arr;
-    ssize_t hv = fnv_hash(key);
-    size_t probe = hv;
-
-    // Loop exits if key has not been found within maxprobe iterations
-    for (size_t i = 0; i <= tbl->maxprobe; i++) {
-        probe = hv + ((i * i + i) / 2);
-        // Start at hashvalue % table size
-        if (arr[probe % tbl->arrsize]) {
-            if (strcmp(key, arr[probe % tbl->arrsize]->key) == 0) {
-                return probe % tbl->arrsize;
-            }
-        }
-    }
-
-    return -1;
+    return get_index_by_hash(tbl, key, fnv_hash(key));
 }
 
-// resize tbl array when load factor reaches LOAD_FACT_LIM
+// resize tbl array to newsize buckets, a power of 2
 // returns 1 if successful
 // returns -1 on memory allocation failure or invalid table
-static int resize(hashtbl tbl)
+static int resize_to(hashtbl tbl, size_t newsize)
 {
     if (!tbl) {
         return -1;
     }
 
+    // Table is left unchanged if the
+    // new array cannot be allocated
+    struct node **newarr = calloc(newsize, sizeof(struct node *));
+    if (!newarr) {
+        return -1;
+    }
+
     struct node **prevarr = tbl->arr;
-    tbl->arr = NULL;
     size_t prevsize = tbl->arrsize;
-    tbl->arrsize *= RESIZE_FACTOR;
-    tbl->arr = calloc(tbl->arrsize, sizeof(struct node *));
-    if (!tbl->arr) {
+    tbl->arr = newarr;
+    tbl->arrsize = newsize;
+
+    // All bucket positions change - file
+    // must be rewritten in full. On failure,
+    // restore previous array - dirty bitmap
+    // is only replaced on success
+    if (alloc_dirty(tbl) < 0) {
+        tbl->arr = prevarr;
+        tbl->arrsize = prevsize;
+        free(newarr);
         return -1;
     }
+    tbl->full_dirty = true;
+
+    tbl->chunkslots = get_chunkslots(tbl->arrsize);
+    memset(tbl->chunk_used, 0, sizeof(tbl->chunk_used));
 
     for (size_t i = 0; i < prevsize; i++) {
         if (prevarr[i]) {
             arr_insert(tbl, prevarr[i]);
         }
     }
+    tbl->gaps = false;
 
     free(prevarr);
+    tbl->membytes += (tbl->arrsize - prevsize) * sizeof(struct node *);
+    tbl->resizes++;
 
     return 1;
 }
 
+// resize tbl array when load factor reaches LOAD_FACT_LIM
+// returns 1 if successful
+// returns -1 on memory allocation failure or invalid table
+static int resize(hashtbl tbl)
+{
+    if (!tbl) {
+        return -1;
+    }
+
+    return resize_to(tbl, tbl->arrsize * RESIZE_FACTOR);
+}
+
 // Input: unsigned integer a
 // Returns: the nearest power of 2 that is
 // greater than a
@@ -251,6 +501,210 @@ static size_t topower2(size_t a)
     }
 }
 
+// Returns probe iteration i at which the node's
+// hash value reaches its stored table position.
+// Triangular number probing visits every bucket of
+// a power of 2 sized table within arrsize probes.
+static size_t probe_dist(hashtbl tbl, struct node *np)
+{
+    size_t hv = np->hashval;
+    for (size_t i = 0; i < tbl->arrsize; i++) {
+        if ((hv + ((i * i + i) / 2)) % tbl->arrsize == np->tblpos) {
+            return i;
+        }
+    }
+    return tbl->arrsize;
+}
+
+// Number of bucket slots stored in page
+static size_t page_slots(hashtbl tbl, size_t page)
+{
+    size_t first = page * PAGE_SLOTS;
+    size_t left = tbl->arrsize - first;
+    return left < PAGE_SLOTS ? left : PAGE_SLOTS;
+}
+
+// Fill buf with file slots for all buckets in page.
+// Returns true if any bucket in page is occupied.
+static bool fill_page(hashtbl tbl, size_t page, char *buf)
+{
+    size_t first = page * PAGE_SLOTS;
+    size_t nslots = page_slots(tbl, page);
+    bool used = false;
+
+    memset(buf, 0, nslots * HT_FILE_SLOT);
+    for (size_t i = 0; i < nslots; i++) {
+        struct node *np = tbl->arr[first + i];
+        if (!np) {
+            continue;
+        }
+        struct file_slot *slot = (struct file_slot *) (buf + i * HT_FILE_SLOT);
+        slot->hashval = np->hashval;
+        slot->used = 1;
+        slot->keylen = (uint8_t) strlen(np->key);
+        slot->vallen = (uint8_t) strlen(np->val);
+        memcpy(slot->key, np->key, slot->keylen);
+        memcpy(slot->val, np->val, slot->vallen);
+        used = true;
+    }
+
+    return used;
+}
+
+// Read len bytes at offset into buf.
+// Returns -1 on read error or short file.
+static ssize_t pread_all(int fd, char *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(fd, buf + done, len - done, offset + done);
+        if (r <= 0) {
+            return -1;
+        }
+        done += r;
+    }
+    return (ssize_t) done;
+}
+
+// Read and check header of fixed-layout file.
+// Returns -1 if fd does not hold a fixed-layout
+// table, 1 on success.
+static int read_file_header(int fd, struct file_header *hdr)
+{
+    if (pread_all(fd, (char *) hdr, sizeof(*hdr), 0) < 0 ||
+        memcmp(hdr->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        (hdr->version != FILE_VERSION && hdr->version != FILE_VERSION_NOCHUNKS) ||
+        hdr->slotsize != HT_FILE_SLOT ||
+        hdr->arrsize == 0 || (hdr->arrsize & (hdr->arrsize - 1)) != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+// Load all slots of chunk into tbl. Slots are read
+// WRITE_BUF_PAGES pages at a time into buf.
+// Returns -1 on read error, memory allocation
+// failure, or a malformed slot.
+static int load_chunk(struct load_worker *w, struct load_chunk *chunk,
+                      size_t chunkidx, char *buf)
+{
+    hashtbl tbl = w->job->tbl;
+    size_t used = 0;
+
+    size_t pos = chunk->first;
+    size_t end = chunk->first + chunk->nslots;
+    while (pos < end) {
+        size_t nslots = end - pos;
+        if (nslots > WRITE_BUF_PAGES * PAGE_SLOTS) {
+            nslots = WRITE_BUF_PAGES * PAGE_SLOTS;
+        }
+        off_t offset = HT_FILE_PAGE + (off_t) pos * HT_FILE_SLOT;
+        if (pread_all(w->job->fd, buf, nslots * HT_FILE_SLOT, offset) < 0) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < nslots; i++) {
+            struct file_slot *slot = (struct file_slot *) (buf + i * HT_FILE_SLOT);
+            if (!slot->used) {
+                continue;
+            }
+            if (slot->keylen >= HT_KEY_MAX || slot->vallen >= HT_VAL_MAX) {
+                return -1;
+            }
+
+            struct node *np = new_node(slot->key, slot->keylen,
+                                       slot->val, slot->vallen);
+            if (!np) {
+                return -1;
+            }
+            np->hashval = slot->hashval;
+            np->tblpos = pos + i;
+
+            tbl->arr[np->tblpos] = np;
+            used++;
+            w->membytes += node_mem(np);
+
+            size_t dist = probe_dist(tbl, np);
+            if (dist > w->maxprobe) {
+                w->maxprobe = dist;
+            }
+        }
+        pos += nslots;
+    }
+
+    // Only this thread loads this chunk
+    tbl->chunk_used[chunkidx] = used;
+    w->numentries += used;
+
+    return 1;
+}
+
+// Thread entry point for parallel load - takes
+// chunks from the shared job until none are left
+// or another thread has failed
+static void *load_worker_main(void *arg)
+{
+    struct load_worker *w = arg;
+    struct load_job *job = w->job;
+
+    char *buf = malloc(WRITE_BUF_PAGES * HT_FILE_PAGE);
+    if (!buf) {
+        atomic_store(&job->failed, true);
+        return NULL;
+    }
+
+    while (!atomic_load(&job->failed)) {
+        size_t i = atomic_fetch_add(&job->next, 1);
+        if (i >= job->numchunks) {
+            break;
+        }
+        // Chunk index in table, not position
+        // in the scheduled order
+        size_t chunkidx = job->chunks[i].first / job->tbl->chunkslots;
+        if (load_chunk(w, &job->chunks[i], chunkidx, buf) < 0) {
+            atomic_store(&job->failed, true);
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Sort chunks with most entries first
+static int cmp_chunk_entries(const void *a, const void *b)
+{
+    const struct load_chunk *ca = a;
+    const struct load_chunk *cb = b;
+    if (ca->entries != cb->entries) {
+        return ca->entries < cb->entries ? 1 : -1;
+    }
+    return ca->first < cb->first ? -1 : 1;
+}
+
+// Fill chunks with the bucket ranges of tbl, ordered
+// by entry counts from the file header so the largest
+// chunks are loaded first. Files without a chunk table
+// are loaded in file order. Counts are used only for
+// ordering - every chunk is read, since an in-place
+// update cut short can leave the header out of date.
+static void fill_load_chunks(hashtbl tbl, struct file_header *hdr,
+                             struct load_chunk *chunks, size_t numchunks)
+{
+    bool has_counts = hdr->numchunks == numchunks;
+    for (size_t c = 0; c < numchunks; c++) {
+        chunks[c].first = c * tbl->chunkslots;
+        chunks[c].nslots = tbl->arrsize - chunks[c].first;
+        if (chunks[c].nslots > tbl->chunkslots) {
+            chunks[c].nslots = tbl->chunkslots;
+        }
+        chunks[c].entries = has_counts ? hdr->chunks[c].entries : 0;
+    }
+
+    if (has_counts) {
+        qsort(chunks, numchunks, sizeof(struct load_chunk), cmp_chunk_entries);
+    }
+}
+
 /*--------------- End - static/internal functions --------------*/
 
 
@@ -281,6 +735,17 @@ hashtbl init_hashtbl(size_t tblsize)
     ptr->arrsize = tblsize;
     ptr->numentries = 0;
     ptr->maxprobe = 0;
+    ptr->resizes = 0;
+    ptr->chunkslots = get_chunkslots(tblsize);
+    ptr->membytes = sizeof(struct hashtbl_obj) + tblsize * sizeof(struct node *);
+
+    // New table has never been written to a file
+    if (alloc_dirty(ptr) < 0) {
+        free(ptr->arr);
+        free(ptr);
+        return NULL;
+    }
+    ptr->full_dirty = true;
 
     return ptr;
 }
@@ -300,6 +765,7 @@ void destroy_hashtbl(hashtbl tbl)
     }
 
     free(tbl->arr);
+    free(tbl->dirty);
     free(tbl);
 }
 
@@ -325,7 +791,8 @@ int put(hashtbl tbl, char *key, char *val)
     }
 
     // stop if key already exists
-    if (get_index_by_key(tbl, key) >= 0) {
+    unsigned int hv = fnv_hash(key);
+    if (get_index_by_hash(tbl, key, hv) >= 0) {
         return -1;
     }
 
@@ -336,34 +803,68 @@ int put(hashtbl tbl, char *key, char *val)
         }
     }
 
-    struct node *np = calloc(1, sizeof(struct node));
+    struct node *np = new_node(key, strnlen(key, HT_KEY_MAX - 1),
+                               val, strnlen(val, HT_VAL_MAX - 1));
     if (!np) {
         return -2;
     }
 
-    np->key = strndup(key, HT_KEY_MAX - 1);
-    if (!np->key) {
-        free(np);
-        return -2;
-    }
-
-    np->val = strndup(val, HT_VAL_MAX - 1);
-    if (!np->val) {
-        free(np->key);
-        free(np);
-        return -2;
-    }
-
     // hash value stored within node for quicker
     // loading from disk and quicker execution
     // of array expansion when necessary
-    np->hashval = fnv_hash(np->key);
+    np->hashval = hv;
 
     arr_insert(tbl, np);
     tbl->numentries++;
+    tbl->membytes += node_mem(np);
+    return 1;
+}
+
+int hashtbl_replace(hashtbl tbl, char *key, char *val)
+{
+    if (!tbl) {
+        return -2;
+    }
+
+    ssize_t i = get_index_by_key(tbl, key);
+    if (i < 0) {
+        return -1;
+    }
+
+    // New node is built before the old one is freed
+    struct node *old = tbl->arr[i];
+    struct node *np = new_node(old->key, strlen(old->key),
+                               val, strnlen(val, HT_VAL_MAX - 1));
+    if (!np) {
+        return -2;
+    }
+    np->hashval = old->hashval;
+    np->tblpos = old->tblpos;
+
+    tbl->membytes = tbl->membytes - node_mem(old) + node_mem(np);
+    tbl->arr[i] = np;
+    free_node(old);
+    mark_dirty(tbl, i);
     return 1;
 }
 
+int hashtbl_reserve(hashtbl tbl, size_t numentries)
+{
+    if (!tbl) {
+        return -2;
+    }
+
+    size_t newsize = tbl->arrsize;
+    while ((double) numentries / newsize > LOAD_FACT_LIM) {
+        newsize *= RESIZE_FACTOR;
+    }
+    if (newsize == tbl->arrsize) {
+        return 1;
+    }
+
+    return resize_to(tbl, newsize) < 0 ? -2 : 1;
+}
+
 size_t find(char *dst, size_t dsize, hashtbl tbl, char *key)
 {
     if (!tbl) {
@@ -394,6 +895,18 @@ bool exists(hashtbl tbl, char *key)
     return true;
 }
 
+// FNV-1a hash of key, as used to place keys
+// in the table
+unsigned int hash_key(const char *key)
+{
+    return fnv_hash((void *) key);
+}
+
+double hashtbl_load_limit(void)
+{
+    return LOAD_FACT_LIM;
+}
+
 // removes node (key, value, hash value, arr position)
 // from hash table and frees allocated memory
 // idempotent - running multiple times on the same
@@ -409,9 +922,13 @@ void delete(hashtbl tbl, char *key)
         return;
     }
 
+    tbl->membytes -= node_mem(tbl->arr[i]);
     free_node(tbl->arr[i]);
     tbl->arr[i] = NULL;
+    tbl->gaps = true;
     tbl->numentries--;
+    mark_dirty(tbl, i);
+    tbl->chunk_used[i / tbl->chunkslots]--;
 }
 
 size_t get_tbl_size(hashtbl tbl)
@@ -432,6 +949,28 @@ size_t get_numentries(hashtbl tbl)
     return tbl->numentries;
 }
 
+// Returns bytes of heap memory held by table,
+// including bucket array and all entries
+size_t get_mem_usage(hashtbl tbl)
+{
+    if (!tbl) {
+        return 0;
+    }
+
+    return tbl->membytes;
+}
+
+// Returns number of times table has been resized
+// since it was created or loaded from file
+size_t get_num_resizes(hashtbl tbl)
+{
+    if (!tbl) {
+        return 0;
+    }
+
+    return tbl->resizes;
+}
+
 // Returns pointer to heap-allocated array of
 // key strings. Caller is responsible for
 // freeing returned pointer.
@@ -480,6 +1019,47 @@ char **get_vals(hashtbl tbl)
     return valarr;
 }
 
+// Call fn for every key-value pair in table
+// order. Stops early if fn returns nonzero.
+// Returns 1, or -1 if tbl is NULL.
+int hashtbl_foreach(hashtbl tbl, ht_iter_fn fn, void *arg)
+{
+    if (!tbl || !fn) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < tbl->arrsize; i++) {
+        struct node *nptr = tbl->arr[i];
+        if (nptr && fn(nptr->key, nptr->val, arg) != 0) {
+            break;
+        }
+    }
+
+    return 1;
+}
+
+size_t hashtbl_scan(hashtbl tbl, size_t cursor, ht_iter_fn fn, void *arg)
+{
+    if (!tbl || !fn) {
+        return 0;
+    }
+
+    size_t i = cursor;
+    while (i < tbl->arrsize) {
+        struct node *nptr = tbl->arr[i++];
+        if (nptr && fn(nptr->key, nptr->val, arg) != 0) {
+            break;
+        }
+    }
+
+    // Skip empty buckets, so that a cursor
+    // is returned only if entries are left
+    while (i < tbl->arrsize && !tbl->arr[i]) {
+        i++;
+    }
+    return i < tbl->arrsize ? i : 0;
+}
+
 // Write (binary) all key-val pairs and
 // metadata to file stream provided.
 // Writes starting at location pointed
@@ -574,6 +1154,8 @@ hashtbl load_hashtbl_from_file(FILE *inf)
 
     hashtbl tbl = init_hashtbl(arrsize);
     tbl->maxprobe = maxprobe;
+    // Entries keep their saved buckets
+    tbl->gaps = true;
 
     char keybuff[HT_KEY_MAX] = {0};
     char valbuff[HT_VAL_MAX] = {0};
@@ -581,21 +1163,20 @@ hashtbl load_hashtbl_from_file(FILE *inf)
     size_t vallen;
     struct node *nptr = NULL;
     for (size_t i = 0; i < numentries; i++) {
-        nptr = calloc(1, sizeof(struct node));
-
         // Read keylen
         fread(&keylen, sizeof(size_t), 1, inf);
 
         // Read key
         fread(keybuff, keylen, 1, inf);
-        nptr->key = strndup(keybuff, HT_KEY_MAX - 1);
 
         // Read vallen
         fread(&vallen, sizeof(size_t), 1, inf);
 
         // Read val
         fread(valbuff, vallen, 1, inf);
-        nptr->val = strndup(valbuff, HT_VAL_MAX - 1);
+
+        nptr = new_node(keybuff, strnlen(keybuff, HT_KEY_MAX - 1),
+                        valbuff, strnlen(valbuff, HT_VAL_MAX - 1));
 
         // Read hashval
         fread(&nptr->hashval, sizeof(unsigned int), 1, inf);
@@ -606,10 +1187,415 @@ hashtbl load_hashtbl_from_file(FILE *inf)
         // Add to array
         tbl->arr[nptr->tblpos] = nptr;
         tbl->numentries++;
+        tbl->membytes += node_mem(nptr);
+        tbl->chunk_used[nptr->tblpos / tbl->chunkslots]++;
     }
 
     return tbl;
 }
 
+// Write table to fixed-layout file open for
+// reading and writing at fd. If full is true,
+// or the table was resized or never written,
+// the file is truncated and every occupied page
+// is written. Otherwise only pages changed since
+// the last sync are rewritten in place. Runs of
+// pages are written through a file_writer (see
+// uring.h), so with io_uring the next run is
+// filled while earlier runs are written. The file
+// is flushed with fsync after the header if sync
+// is true.
+// Pages with no entries are left as file holes
+// on a full write.
+// Returns number of bytes written, -1 on error.
+ssize_t hashtbl_sync_file(hashtbl tbl, int fd, bool full, bool sync)
+{
+    if (!tbl || fd < 0) {
+        return -1;
+    }
+
+    full = full || tbl->full_dirty;
+
+    if (full) {
+        off_t fsize = HT_FILE_PAGE + (off_t) tbl->arrsize * HT_FILE_SLOT;
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, fsize) < 0) {
+            return -1;
+        }
+    }
+
+    file_writer fw = fw_open(fd, WRITE_BUF_PAGES * HT_FILE_PAGE);
+    if (!fw) {
+        return -1;
+    }
 
+    // Consecutive pages are collected in a buffer
+    // and written with a single write
+    char *buf = fw_buffer(fw);
+    size_t written = 0;
+    size_t run_start = 0;
+    size_t run_pages = 0;
+    size_t run_bytes = 0;
+    for (size_t page = 0; buf && page <= tbl->numpages; page++) {
+        bool write_page = false;
+        if (page < tbl->numpages && (full || is_dirty(tbl, page))) {
+            size_t nbytes = page_slots(tbl, page) * HT_FILE_SLOT;
+            bool used = fill_page(tbl, page, buf + run_bytes);
+            // Empty pages are holes on full write,
+            // zeroed in place on delta write
+            write_page = used || !full;
+            if (write_page) {
+                if (run_pages == 0) {
+                    run_start = page;
+                }
+                run_pages++;
+                run_bytes += nbytes;
+            }
+        }
+
+        if (run_pages > 0 && (!write_page || run_pages == WRITE_BUF_PAGES)) {
+            off_t offset = HT_FILE_PAGE + (off_t) run_start * PAGE_SLOTS * HT_FILE_SLOT;
+            if (fw_write(fw, buf, run_bytes, offset) < 0) {
+                buf = NULL;
+                break;
+            }
+            written += run_bytes;
+            run_pages = 0;
+            run_bytes = 0;
+            buf = fw_buffer(fw);
+        }
+    }
+    if (!buf) {
+        fw_close(fw);
+        return -1;
+    }
+
+    // Header page written last - table metadata
+    // is updated after all bucket data is in place
+    memset(buf, 0, HT_FILE_PAGE);
+    struct file_header *hdr = (struct file_header *) buf;
+    memcpy(hdr->magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    hdr->version = FILE_VERSION;
+    hdr->slotsize = HT_FILE_SLOT;
+    hdr->arrsize = tbl->arrsize;
+    hdr->numentries = tbl->numentries;
+    hdr->maxprobe = tbl->maxprobe;
+    hdr->numchunks = (uint32_t) ((tbl->arrsize + tbl->chunkslots - 1) / tbl->chunkslots);
+    for (uint32_t c = 0; c < hdr->numchunks; c++) {
+        hdr->chunks[c].offset = HT_FILE_PAGE + (uint64_t) c * tbl->chunkslots * HT_FILE_SLOT;
+        hdr->chunks[c].entries = tbl->chunk_used[c];
+    }
+    int finished = fw_finish(fw, buf, HT_FILE_PAGE, 0, sync);
+    if (fw_close(fw) < 0 || finished < 0) {
+        return -1;
+    }
+    written += HT_FILE_PAGE;
+
+    hashtbl_mark_synced(tbl);
+
+    return (ssize_t) written;
+}
+
+// Load hashtable from fixed-layout file
+// written by hashtbl_sync_file.
+// Input - file descriptor open for reading.
+// Returns - handle to hashtable allocated on heap,
+// NULL if fd does not hold a fixed-layout table
+// or on memory allocation failure.
+hashtbl load_hashtbl_from_fd(int fd)
+{
+    return load_hashtbl_parallel(fd, 1);
+}
+
+// Load hashtable from fixed-layout file using
+// up to nthreads threads, including the calling
+// thread. Chunks from the file header are shared
+// out between threads, largest first.
+// Returns NULL on the same conditions as
+// load_hashtbl_from_fd.
+hashtbl load_hashtbl_parallel(int fd, unsigned nthreads)
+{
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct file_header hdr;
+    if (read_file_header(fd, &hdr) < 0) {
+        return NULL;
+    }
 
+    hashtbl tbl = init_hashtbl(hdr.arrsize);
+    if (!tbl) {
+        return NULL;
+    }
+    if (tbl->arrsize != hdr.arrsize) {
+        destroy_hashtbl(tbl);
+        return NULL;
+    }
+    // Entries keep their saved buckets
+    tbl->gaps = true;
+
+    struct load_job job = {
+        .fd = fd,
+        .tbl = tbl,
+        .numchunks = (tbl->arrsize + tbl->chunkslots - 1) / tbl->chunkslots
+    };
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+
+    job.chunks = calloc(job.numchunks, sizeof(struct load_chunk));
+    if (!job.chunks) {
+        destroy_hashtbl(tbl);
+        return NULL;
+    }
+    fill_load_chunks(tbl, &hdr, job.chunks, job.numchunks);
+
+    if (nthreads < 1 || tbl->arrsize < LOAD_MT_MIN_SLOTS) {
+        nthreads = 1;
+    }
+    if (nthreads > job.numchunks) {
+        nthreads = (unsigned) job.numchunks;
+    }
+
+    struct load_worker *workers = calloc(nthreads, sizeof(struct load_worker));
+    if (!workers) {
+        free(job.chunks);
+        destroy_hashtbl(tbl);
+        return NULL;
+    }
+
+    // Worker 0 runs on the calling thread. If a thread
+    // cannot be started, the remaining threads take
+    // its share of the chunks.
+    for (unsigned i = 0; i < nthreads; i++) {
+        workers[i].job = &job;
+    }
+    for (unsigned i = 1; i < nthreads; i++) {
+        workers[i].started = pthread_create(&workers[i].thread, NULL,
+                                            load_worker_main, &workers[i]) == 0;
+    }
+    load_worker_main(&workers[0]);
+
+    // numentries and maxprobe are rebuilt from the
+    // slots themselves rather than trusted from the
+    // header, in case an in-place update was cut short
+    for (unsigned i = 0; i < nthreads; i++) {
+        if (i > 0 && workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        tbl->numentries += workers[i].numentries;
+        tbl->membytes += workers[i].membytes;
+        if (workers[i].maxprobe > tbl->maxprobe) {
+            tbl->maxprobe = workers[i].maxprobe;
+        }
+    }
+
+    bool failed = atomic_load(&job.failed);
+    free(workers);
+    free(job.chunks);
+    if (failed) {
+        destroy_hashtbl(tbl);
+        return NULL;
+    }
+
+    hashtbl_mark_synced(tbl);
+
+    return tbl;
+}
+
+// Look up key in fixed-layout file without
+// loading the table. The file is memory mapped
+// and only the slots on the probe sequence of
+// key are read, up to maxprobe from the header.
+// Returns 1 and copies value to dst if found,
+// 0 if not found, -1 if fd does not hold a
+// fixed-layout table or on error.
+// Caller is responsible for closing fd.
+int hashtbl_lookup_fd(int fd, const char *key, char *dst, size_t dsize)
+{
+    if (fd < 0 || !key) {
+        return -1;
+    }
+
+    struct file_header hdr;
+    struct stat st;
+    if (read_file_header(fd, &hdr) < 0 || fstat(fd, &st) < 0) {
+        return -1;
+    }
+
+    // Slots past the end of a short file are
+    // treated as unused rather than read
+    size_t mapsize = (size_t) st.st_size;
+    size_t fslots = mapsize > HT_FILE_PAGE ? (mapsize - HT_FILE_PAGE) / HT_FILE_SLOT : 0;
+    if (fslots == 0) {
+        return 0;
+    }
+
+    char *map = mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, mapsize, MADV_RANDOM);
+
+    size_t keylen = strlen(key);
+    size_t hv = fnv_hash((void *) key);
+    size_t mask = hdr.arrsize - 1;
+    int found = 0;
+    for (size_t i = 0; i <= hdr.maxprobe; i++) {
+        size_t pos = (hv + ((i * i + i) / 2)) & mask;
+        if (pos >= fslots) {
+            continue;
+        }
+        const struct file_slot *slot =
+            (const struct file_slot *) (map + HT_FILE_PAGE + pos * HT_FILE_SLOT);
+        if (slot->used && slot->hashval == (uint32_t) hv &&
+            slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0) {
+            if (dst && dsize > 0) {
+                size_t n = slot->vallen < dsize - 1 ? slot->vallen : dsize - 1;
+                memcpy(dst, slot->val, n);
+                dst[n] = '\0';
+            }
+            found = 1;
+            break;
+        }
+    }
+
+    munmap(map, mapsize);
+    return found;
+}
+
+// Add pair to, or delete key from, fixed-layout
+// file in place, as put and delete would on the
+// loaded table. Only the slot of the key and the
+// file header are written. The file must hold
+// every slot of the table, and an added pair must
+// not take the table past LOAD_FACT_LIM, since
+// that would resize the table.
+int hashtbl_update_fd(int fd, const char *key, const char *val, bool sync)
+{
+    if (fd < 0 || !key) {
+        return -2;
+    }
+
+    struct file_header hdr;
+    struct stat st;
+    if (read_file_header(fd, &hdr) < 0 || fstat(fd, &st) < 0) {
+        return -3;
+    }
+
+    size_t mapsize = HT_FILE_PAGE + hdr.arrsize * HT_FILE_SLOT;
+    if ((size_t) st.st_size < mapsize ||
+        (val && (double) hdr.numentries / hdr.arrsize > LOAD_FACT_LIM)) {
+        return -3;
+    }
+
+    char *map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -2;
+    }
+    madvise(map, mapsize, MADV_RANDOM);
+
+    // Look for key within maxprobe, noting the first
+    // unused slot on the way. An added pair goes in
+    // the first unused slot, which may lie past
+    // maxprobe, as in arr_insert.
+    size_t keylen = strnlen(key, HT_KEY_MAX - 1);
+    size_t hv = fnv_hash((void *) key);
+    size_t mask = hdr.arrsize - 1;
+    struct file_slot *found = NULL;
+    struct file_slot *unused = NULL;
+    size_t slotpos = 0;
+    size_t unusedprobe = 0;
+    for (size_t i = 0; i <= hdr.maxprobe || (val && !unused); i++) {
+        size_t pos = (hv + ((i * i + i) / 2)) & mask;
+        struct file_slot *slot = (struct file_slot *) (map + HT_FILE_PAGE + pos * HT_FILE_SLOT);
+        if (!slot->used) {
+            if (!unused) {
+                unused = slot;
+                slotpos = pos;
+                unusedprobe = i;
+            }
+        }
+        else if (i <= hdr.maxprobe && slot->hashval == (uint32_t) hv &&
+                 slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0) {
+            found = slot;
+            slotpos = pos;
+            break;
+        }
+    }
+
+    int ret = 1;
+    int64_t delta = 0;
+    if (val && found) {
+        ret = -1;
+    }
+    else if (!val && !found) {
+        ret = 0;
+    }
+    else if (val) {
+        memset(unused, 0, HT_FILE_SLOT);
+        unused->hashval = (uint32_t) hv;
+        unused->used = 1;
+        unused->keylen = (uint8_t) keylen;
+        unused->vallen = (uint8_t) strnlen(val, HT_VAL_MAX - 1);
+        memcpy(unused->key, key, unused->keylen);
+        memcpy(unused->val, val, unused->vallen);
+        if (unusedprobe > hdr.maxprobe) {
+            hdr.maxprobe = unusedprobe;
+        }
+        delta = 1;
+    }
+    else {
+        memset(found, 0, HT_FILE_SLOT);
+        delta = -1;
+    }
+
+    // Slot is written before the header, which the
+    // loader does not rely on for entry counts
+    if (delta != 0) {
+        hdr.numentries += delta;
+        size_t c = slotpos / get_chunkslots(hdr.arrsize);
+        if (c < hdr.numchunks) {
+            hdr.chunks[c].entries += delta;
+        }
+        memcpy(map, &hdr, sizeof(hdr));
+    }
+
+    if (munmap(map, mapsize) < 0 || (delta != 0 && sync && fsync(fd) < 0)) {
+        ret = -2;
+    }
+    return ret;
+}
+
+// Returns true if the next hashtbl_sync_file
+// call must rewrite the whole file
+bool hashtbl_needs_full_sync(hashtbl tbl)
+{
+    if (!tbl) {
+        return true;
+    }
+
+    return tbl->full_dirty;
+}
+
+// Clear dirty page tracking - the table is
+// treated as matching its file
+void hashtbl_mark_synced(hashtbl tbl)
+{
+    if (!tbl) {
+        return;
+    }
+
+    memset(tbl->dirty, 0, (tbl->numpages + 7) / 8);
+    tbl->full_dirty = false;
+}
+
+// Force the next hashtbl_sync_file call
+// to rewrite the whole file
+void hashtbl_mark_unsynced(hashtbl tbl)
+{
+    if (!tbl) {
+        return;
+    }
+
+    tbl->full_dirty = true;
+}
@@ -16,6 +16,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 // Data size constants
 enum {
@@ -23,6 +24,18 @@ enum {
     HT_VAL_MAX = 100
 };
 
+// Fixed-layout file constants. Page 0 of a
+// fixed-layout file holds the table header.
+// Bucket i is stored in a slot of HT_FILE_SLOT
+// bytes at offset HT_FILE_PAGE + i * HT_FILE_SLOT.
+// Up to HT_FILE_CHUNKS chunks of the bucket array
+// are recorded in the header for parallel loading.
+enum {
+    HT_FILE_PAGE = 4096,
+    HT_FILE_SLOT = 256,
+    HT_FILE_CHUNKS = 64
+};
+
 // hashtable object handle
 typedef struct hashtbl_obj *hashtbl;
 
@@ -40,6 +53,14 @@ void destroy_hashtbl(hashtbl tbl);
 size_t get_tbl_size(hashtbl tbl);
 size_t get_numentries(hashtbl tbl);
 
+// Returns bytes of heap memory held by table,
+// including bucket array and all entries
+size_t get_mem_usage(hashtbl tbl);
+
+// Returns number of times table has been resized
+// since it was created or loaded from file
+size_t get_num_resizes(hashtbl tbl);
+
 // put
 // Input: two strings, key and val, to be added to table.
 // Output: -1 if key already exists,
@@ -48,6 +69,18 @@ size_t get_numentries(hashtbl tbl);
 // Attempt to add key that already exists results in failure.
 int put(hashtbl tbl, char *key, char *val);
 
+// Replace value of key in place, keeping its
+// bucket. On failure the old value is kept.
+// Returns -1 if key does not exist, -2 on memory
+// allocation failure, 1 on success.
+int hashtbl_replace(hashtbl tbl, char *key, char *val);
+
+// Grow table so that it holds numentries entries
+// without resizing. Never shrinks the table.
+// Returns -2 on memory allocation failure,
+// 1 on success.
+int hashtbl_reserve(hashtbl tbl, size_t numentries);
+
 // Searches for value associated with key.
 // If found, copies value to dst.
 // Caller is responsible for allocating
@@ -58,6 +91,13 @@ size_t find(char *dst, size_t dsize, hashtbl tbl, char *key);
 
 bool exists(hashtbl tbl, char *key);
 
+// FNV-1a hash of key, as used to place keys
+// in the table
+unsigned int hash_key(const char *key);
+
+// Load factor above which a table doubles in size
+double hashtbl_load_limit(void);
+
 // key and value removed
 // running multiple times on same key has no effect
 void delete(hashtbl tbl, char *key);
@@ -72,6 +112,23 @@ char **get_keys(hashtbl tbl);
 // freeing returned pointer.
 char **get_vals(hashtbl tbl);
 
+// Called by hashtbl_foreach for each entry.
+// Return nonzero to stop iteration.
+typedef int (*ht_iter_fn)(const char *key, const char *val, void *arg);
+
+// Call fn for every key-value pair in table
+// order. Stops early if fn returns nonzero.
+// Returns 1, or -1 if tbl is NULL.
+int hashtbl_foreach(hashtbl tbl, ht_iter_fn fn, void *arg);
+
+// Call fn for entries in table order starting at
+// bucket cursor (0 for the first) until fn returns
+// nonzero. Returns cursor of the next entry to visit,
+// or 0 if no entries are left. Scanning with the
+// returned cursors visits every entry once if the
+// table is not changed between calls.
+size_t hashtbl_scan(hashtbl tbl, size_t cursor, ht_iter_fn fn, void *arg);
+
 // Write (binary) all key-val pairs and
 // metadata to file stream provided.
 // Writes starting at location pointed
@@ -89,4 +146,69 @@ size_t hashtbl_to_file(hashtbl tbl, FILE *outf);
 // Caller is responsible for closing stream.
 hashtbl load_hashtbl_from_file(FILE *inf);
 
+// Write table to fixed-layout file open for
+// reading and writing at fd. If full is true,
+// or the table was resized or never written,
+// the file is truncated and every occupied page
+// is written. Otherwise only pages changed since
+// the last sync are rewritten in place. If sync is
+// true, the file is flushed to disk with fsync.
+// Returns number of bytes written, -1 on error.
+// Caller is responsible for closing fd.
+ssize_t hashtbl_sync_file(hashtbl tbl, int fd, bool full, bool sync);
+
+// Load hashtable from fixed-layout file
+// written by hashtbl_sync_file.
+// Input - file descriptor open for reading.
+// Returns - handle to hashtable allocated on heap,
+// NULL if fd does not hold a fixed-layout table
+// or on memory allocation failure.
+// Caller is responsible for closing fd.
+hashtbl load_hashtbl_from_fd(int fd);
+
+// Load hashtable from fixed-layout file using up
+// to nthreads threads, including the calling thread.
+// Each thread loads whole chunks of the file into
+// their bucket positions. Small tables are loaded
+// on the calling thread only.
+// Returns NULL on the same conditions as
+// load_hashtbl_from_fd.
+// Caller is responsible for closing fd.
+hashtbl load_hashtbl_parallel(int fd, unsigned nthreads);
+
+// Look up key in fixed-layout file without
+// loading the table. Only the slots on the probe
+// sequence of key are read.
+// Returns 1 and copies value to dst if found,
+// 0 if not found, -1 if fd does not hold a
+// fixed-layout table or on error.
+// Caller is responsible for closing fd.
+int hashtbl_lookup_fd(int fd, const char *key, char *dst, size_t dsize);
+
+// Add key and val to, or delete key from if val
+// is NULL, fixed-layout file without loading the
+// table. The file is flushed to disk if sync is true.
+// Returns:
+//      1 on success
+//      0 if key to delete not found
+//      -1 if key to add already exists
+//      -2 on file error
+//      -3 if the file cannot be updated in place -
+//         not a fixed-layout table, or adding would
+//         resize the table
+// Caller is responsible for closing fd.
+int hashtbl_update_fd(int fd, const char *key, const char *val, bool sync);
+
+// Returns true if the next hashtbl_sync_file
+// call must rewrite the whole file
+bool hashtbl_needs_full_sync(hashtbl tbl);
+
+// Clear dirty page tracking - the table is
+// treated as matching its file
+void hashtbl_mark_synced(hashtbl tbl);
+
+// Force the next hashtbl_sync_file call
+// to rewrite the whole file
+void hashtbl_mark_unsynced(hashtbl tbl);
+
 #endif // HASHTABLE_H
@@ -0,0 +1,220 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Command latency tracking. See latency.h.
+ *
+ * Latencies below LAT_SUB_BUCKETS ns have a bucket
+ * each. Above that, a latency with highest set bit b
+ * goes to the bucket for its top LAT_SUB_BITS + 1
+ * bits: group b - LAT_SUB_BITS + 1, and within the
+ * group, the LAT_SUB_BITS bits below bit b.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "latency.h"
+#include "stringutil.h"
+
+struct cmd_hist {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[LAT_BUCKETS];
+};
+
+// Struct managed through handle declared in
+// latency.h: typedef struct latency_obj *latency
+struct latency_obj {
+    struct cmd_hist hists[LAT_CMDS];
+
+    // Slow log ring - next is the position of the
+    // next entry, numslow the number of entries held
+    struct lat_slow slowlog[LAT_SLOWLOG_LEN];
+    size_t next;
+    size_t numslow;
+    uint64_t slow_ns;
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+static size_t bucket_of(uint64_t ns)
+{
+    if (ns < LAT_SUB_BUCKETS) {
+        return ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (msb - LAT_SUB_BITS)) & (LAT_SUB_BUCKETS - 1);
+    return ((size_t) (msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + sub;
+}
+
+// Smallest latency held by bucket
+static uint64_t bucket_low(size_t bucket)
+{
+    if (bucket < LAT_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (bucket >> LAT_SUB_BITS) - 1;
+    return (uint64_t) (LAT_SUB_BUCKETS + (bucket & (LAT_SUB_BUCKETS - 1))) << shift;
+}
+
+// Largest latency held by bucket
+static uint64_t bucket_high(size_t bucket)
+{
+    if (bucket < LAT_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (bucket >> LAT_SUB_BITS) - 1;
+    return bucket_low(bucket) + ((uint64_t) 1 << shift) - 1;
+}
+
+// Latency at fraction q of recorded commands
+static uint64_t percentile(const struct cmd_hist *h, double q)
+{
+    uint64_t want = (uint64_t) (q * h->count);
+    if (want < q * h->count || want == 0) {
+        want++;
+    }
+    uint64_t seen = 0;
+    for (size_t b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= want) {
+            uint64_t high = bucket_high(b);
+            return high < h->max_ns ? high : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+latency latency_init(void)
+{
+    latency lat = calloc(1, sizeof(struct latency_obj));
+    if (!lat) {
+        return NULL;
+    }
+    lat->slow_ns = (uint64_t) LAT_SLOW_MS * 1000000;
+    return lat;
+}
+
+void latency_destroy(latency lat)
+{
+    free(lat);
+}
+
+bool latency_record(latency lat, size_t cmd, uint64_t ns)
+{
+    if (!lat || cmd >= LAT_CMDS) {
+        return false;
+    }
+
+    struct cmd_hist *h = &lat->hists[cmd];
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->buckets[bucket_of(ns)]++;
+
+    return ns >= lat->slow_ns;
+}
+
+void latency_log_slow(latency lat, size_t cmd, uint64_t ns, unsigned events,
+                      const char *tbl_name, const char *arg)
+{
+    if (!lat) {
+        return;
+    }
+
+    struct lat_slow *entry = &lat->slowlog[lat->next];
+    entry->when = time(NULL);
+    entry->cmd = cmd;
+    entry->ns = ns;
+    entry->events = events;
+    strtcpy(entry->tbl_name, tbl_name ? tbl_name : "", TBL_NAME_MAX);
+    strtcpy(entry->arg, arg ? arg : "", LAT_ARG_MAX);
+
+    lat->next = (lat->next + 1) % LAT_SLOWLOG_LEN;
+    if (lat->numslow < LAT_SLOWLOG_LEN) {
+        lat->numslow++;
+    }
+}
+
+void latency_summary(latency lat, size_t cmd, struct lat_summary *sum)
+{
+    memset(sum, 0, sizeof(struct lat_summary));
+    if (!lat || cmd >= LAT_CMDS || lat->hists[cmd].count == 0) {
+        return;
+    }
+
+    const struct cmd_hist *h = &lat->hists[cmd];
+    sum->count = h->count;
+    sum->total_ns = h->total_ns;
+    sum->max_ns = h->max_ns;
+    sum->p50_ns = percentile(h, 0.50);
+    sum->p90_ns = percentile(h, 0.90);
+    sum->p99_ns = percentile(h, 0.99);
+    sum->p999_ns = percentile(h, 0.999);
+}
+
+uint64_t latency_bucket(latency lat, size_t cmd, size_t bucket,
+                        uint64_t *low_ns, uint64_t *high_ns)
+{
+    if (!lat || cmd >= LAT_CMDS || bucket >= LAT_BUCKETS) {
+        return 0;
+    }
+
+    *low_ns = bucket_low(bucket);
+    *high_ns = bucket_high(bucket);
+    return lat->hists[cmd].buckets[bucket];
+}
+
+void latency_slowlog(latency lat, int (*fn)(const struct lat_slow *entry, void *arg),
+                     void *arg)
+{
+    if (!lat) {
+        return;
+    }
+
+    for (size_t i = 1; i <= lat->numslow; i++) {
+        size_t pos = (lat->next + LAT_SLOWLOG_LEN - i) % LAT_SLOWLOG_LEN;
+        if (fn(&lat->slowlog[pos], arg) != 0) {
+            return;
+        }
+    }
+}
+
+unsigned int latency_slow_ms(latency lat)
+{
+    return lat ? (unsigned int) (lat->slow_ns / 1000000) : 0;
+}
+
+void latency_set_slow_ms(latency lat, unsigned int ms)
+{
+    if (lat) {
+        lat->slow_ns = (uint64_t) ms * 1000000;
+    }
+}
+
+void latency_reset(latency lat)
+{
+    if (!lat) {
+        return;
+    }
+
+    memset(lat->hists, 0, sizeof(lat->hists));
+    lat->next = 0;
+    lat->numslow = 0;
+}
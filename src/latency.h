@@ -0,0 +1,123 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Command latency tracking - latency
+ *
+ * Keeps a latency histogram for each kind of command
+ * and a slow log of the most recent commands that took
+ * at least a threshold time, with the internal work
+ * each one triggered.
+ *
+ * Histograms are log-linear, as in HdrHistogram: each
+ * power of 2 of nanoseconds is split into LAT_SUB_BUCKETS
+ * equal buckets, so every recorded latency is known to
+ * within 1 / LAT_SUB_BUCKETS of its value, from 1 ns up
+ * to hours, in a fixed array of counters. Recording a
+ * latency is a few arithmetic operations and one counter
+ * increment, so commands can always be timed.
+ *
+ * The slow log is a ring of LAT_SLOWLOG_LEN entries;
+ * once full, each new entry replaces the oldest.
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pairdbconst.h"
+
+enum {
+    LAT_CMDS = 32,              // Command kinds, numbered from 0
+    LAT_SUB_BITS = 3,
+    LAT_SUB_BUCKETS = 1 << LAT_SUB_BITS,
+    LAT_BUCKETS = (65 - LAT_SUB_BITS) << LAT_SUB_BITS,  // Up to 2^64 ns
+    LAT_SLOWLOG_LEN = 128,
+    LAT_ARG_MAX = 64,           // Bytes of command argument kept in slow log
+    LAT_SLOW_MS = 10            // Default slow log threshold
+};
+
+// latency object handle
+typedef struct latency_obj *latency;
+
+// Latency summary of one command kind
+struct lat_summary {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+};
+
+// Slow log entry
+struct lat_slow {
+    time_t when;                // Wall clock time command finished
+    size_t cmd;
+    uint64_t ns;
+    unsigned events;            // Internal work triggered, set by caller
+    char tbl_name[TBL_NAME_MAX];
+    char arg[LAT_ARG_MAX];      // First argument, cut to LAT_ARG_MAX - 1 bytes
+};
+
+// Returns handle to latency object allocated on
+// heap, with empty histograms and slow log and the
+// slow log threshold set to LAT_SLOW_MS.
+// Returns NULL on failure.
+// Free with latency_destroy function.
+latency latency_init(void);
+
+void latency_destroy(latency lat);
+
+// Add latency of ns nanoseconds to histogram of
+// command kind cmd. Commands with cmd of LAT_CMDS
+// or more are not recorded.
+// Returns true if ns reaches the slow log threshold,
+// so that the command should be logged with
+// latency_log_slow.
+bool latency_record(latency lat, size_t cmd, uint64_t ns);
+
+// Add entry for command kind cmd to slow log.
+// tbl_name and arg may be NULL.
+void latency_log_slow(latency lat, size_t cmd, uint64_t ns, unsigned events,
+                      const char *tbl_name, const char *arg);
+
+// Fill summary of histogram of command kind cmd.
+// Percentiles are the largest latency of the bucket
+// that holds them, and at most max_ns.
+void latency_summary(latency lat, size_t cmd, struct lat_summary *sum);
+
+// Number of latencies of command kind cmd recorded in
+// bucket, and the range of latencies it holds.
+// Buckets are numbered from 0 to LAT_BUCKETS - 1 in
+// order of latency.
+uint64_t latency_bucket(latency lat, size_t cmd, size_t bucket,
+                        uint64_t *low_ns, uint64_t *high_ns);
+
+// Call fn for slow log entries from newest to
+// oldest. Stops early if fn returns nonzero.
+void latency_slowlog(latency lat, int (*fn)(const struct lat_slow *entry, void *arg),
+                     void *arg);
+
+// Slow log threshold in milliseconds. Commands
+// taking at least this long are logged; 0 logs
+// every command.
+unsigned int latency_slow_ms(latency lat);
+void latency_set_slow_ms(latency lat, unsigned int ms);
+
+// Clear all histograms and the slow log.
+// The slow log threshold is kept.
+void latency_reset(latency lat);
+
+#endif // LATENCY_H
@@ -0,0 +1,2202 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * LSM tree table implementation.
+ *
+ * The memtable is a skip list sorted by key. Deleted
+ * keys are kept in the memtable and in table files as
+ * tombstones (entries with no value) until compaction
+ * merges them into the last level holding data.
+ *
+ * Table directory layout:
+ *      MANIFEST        list of live table files by level
+ *      <id>.sst        immutable sorted table file
+ *
+ * Table (SSTable) file format:
+ *      data blocks     entries in key order, at most
+ *                      BLOCK_SIZE bytes per block:
+ *                          key len     1 byte
+ *                          val len     1 byte (TOMBSTONE if deleted)
+ *                          key         (key len) bytes
+ *                          val         (val len) bytes
+ *      block index     for each block:
+ *                          offset      8 bytes
+ *                          length      4 bytes
+ *                          key len     1 byte
+ *                          first key   (key len) bytes
+ *                      then the largest key in the file
+ *                      (1 byte length + key)
+ *      Bloom filter    BLOOM_BITS_PER_KEY bits per key
+ *      footer          struct sst_footer
+ *
+ * Level 0 files are written from the memtable and may
+ * overlap - they are searched newest first. Files in
+ * every other level cover disjoint key ranges and are
+ * sorted by key. Level n + 1 may hold LEVEL_GROWTH
+ * times more data than level n. When level 0 holds
+ * L0_COMPACT_TRIGGER files, or another level grows past
+ * its limit, the background compaction thread merges
+ * files from that level with the overlapping files in
+ * the next level and writes the result to the next level.
+ *
+ * The lock protects the levels, the manifest, and file
+ * ids. Lookups and scans hold the lock while reading
+ * files, so compaction never deletes a file in use. The
+ * memtable is used only by the thread calling the public
+ * functions. Compaction reads its input files without
+ * the lock, since only the compaction thread removes files.
+ *
+ * A file flushed without fsync is left out of MANIFEST
+ * when group_ms is set (lsm_set_sync). The compaction
+ * thread flushes such files to disk and then writes
+ * MANIFEST with fsync, so after a crash the table holds
+ * every change up to the last synced MANIFEST, and the
+ * files written after it are removed as orphans.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "lsm.h"
+#include "pairdbconst.h"
+#include "stringutil.h"
+
+/*
+ *
+ * Values for Fowler/Noll/Vo hash function
+ * In public domain - see links
+ * https://github.com/lcn2/fnv/tree/master
+ * https://github.com/lcn2/fnv/blob/master/LICENSE
+ * https://github.com/lcn2/fnv/blob/master/hash_32a.c
+ *
+ */
+
+static const unsigned int HVAL_INIT = 0x811c9dc5; // FNV hash
+static const unsigned int FNV_PRIME = 0x01000193; // FNV hash
+
+/*
+ *
+ * Values for table files and levels
+ *
+ */
+
+static const char SST_MAGIC[8] = "PDBSST01";
+static const char *SST_EXT = ".sst";
+static const char *MANIFEST_FNAME = "MANIFEST";
+static const char *MANIFEST_TMP_FNAME = "MANIFEST.tmp";
+static const char *MANIFEST_HEADER = "pairdb-lsm 1";
+
+static const size_t DEFAULT_MEMTABLE_MAX = (size_t) 4 * 1024 * 1024;
+
+enum {
+    BLOCK_SIZE = 4096,          // Max data block size
+    MAX_HEIGHT = 12,            // Max skip list node height
+    L0_COMPACT_TRIGGER = 4,     // Level 0 files that start a compaction
+    L0_STALL = 12,              // Level 0 files that block flushes
+    LEVEL_GROWTH = 10,          // Size ratio between levels
+    FILE_SIZE_FACTOR = 2,       // Compaction output files - memtable sizes
+    BLOOM_BITS_PER_KEY = 10,
+    BLOOM_K = 7,                // Hash functions per key (~1% false positives)
+    TOMBSTONE = 0xFF,           // val len of deleted key
+    PATH_LEN = 4096,
+    MANIFEST_LINE = 128
+};
+
+
+/*------------------ Data structures -----------------*/
+
+// Memtable skip list node. Key is stored in the
+// same block, after the next pointers. val is
+// NULL for a deleted key (tombstone).
+struct mem_node {
+    char *key;
+    char *val;
+    int height;
+    struct mem_node *next[];
+};
+
+struct memtable {
+    struct mem_node *head;
+    int height;         // Highest level in use
+    size_t bytes;       // Heap memory held by nodes
+    size_t count;
+    uint64_t rng;       // xorshift state for node heights
+};
+
+// Open table file. Block index and Bloom
+// filter are held in memory.
+struct sst {
+    uint64_t id;
+    int fd;
+    size_t filesize;
+    size_t numentries;
+    size_t numblocks;
+    uint64_t *blk_off;
+    uint32_t *blk_len;
+    char **blk_key;         // First key of each block
+    char *keyarena;         // Storage for block keys and largest key
+    const char *smallest;
+    const char *largest;
+    uint64_t *bloom;
+    size_t bloom_bits;
+    uint32_t bloom_k;
+    bool synced;            // File flushed to disk with fsync
+    size_t membytes;
+};
+
+// Files in one level. Level 0 files are ordered
+// newest first. Other levels are ordered by key.
+struct level {
+    struct sst **files;
+    size_t count;
+    size_t cap;
+    size_t bytes;
+};
+
+// Table file footer, stored in the last bytes of the file
+struct sst_footer {
+    char magic[8];
+    uint64_t index_off;
+    uint64_t index_len;
+    uint64_t bloom_off;
+    uint64_t bloom_len;
+    uint64_t numentries;
+    uint64_t numblocks;
+    uint32_t bloom_k;
+    uint32_t pad;
+};
+
+// lsm table operations performed using pointer
+// to lsm_obj - pointer defined in header file
+struct lsm_obj {
+    char *dir;
+    struct memtable mem;
+    size_t memtable_max;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t compactor;
+    bool compactor_running;
+    bool stop;
+    bool compacting;
+    bool compact_failed;    // Compaction stops after a file error
+
+    // Flushes made by put and del are written with
+    // fsync if sync is true. Otherwise, if group_ms is
+    // greater than 0, files are left out of MANIFEST
+    // until the compaction thread flushes them to
+    // disk together at sync_due.
+    bool sync;
+    unsigned int group_ms;
+    bool sync_pending;
+    struct timespec sync_due;
+
+    // Set by lsm_hold_flush - put and del let the
+    // memtable grow past memtable_max
+    bool hold_flush;
+
+    struct level levels[LSM_MAX_LEVELS];
+    uint64_t next_id;
+
+    // Largest key of the last file compacted from each
+    // level - files are compacted in turn across the key space
+    char *compact_ptr[LSM_MAX_LEVELS];
+
+    struct lsm_stats stats;
+
+    // Strings returned by lsm_get_keys and lsm_get_vals
+    char *keys_arena;
+    char *vals_arena;
+};
+
+// Table file being written
+struct sst_builder {
+    int fd;
+    char *path;
+    char block[BLOCK_SIZE];
+    size_t blocklen;
+    char firstkey[KEY_MAX];
+    char lastkey[KEY_MAX];
+    uint64_t offset;
+    char *index;
+    size_t indexlen;
+    size_t indexcap;
+    uint32_t *hashes;       // Key hashes for Bloom filter
+    size_t numentries;
+    size_t hashcap;
+    size_t numblocks;
+};
+
+// Iterator over the memtable (files is NULL), or
+// over a list of files with disjoint key ranges
+// in key order. k and v point to the current key
+// and value - v is NULL for a tombstone.
+struct iter {
+    struct mem_node *node;
+    struct sst **files;
+    size_t numfiles;
+    size_t file;
+    size_t blk;
+    char *buf;
+    size_t pos;
+    size_t len;
+    char key[KEY_MAX];
+    char val[VAL_MAX];
+    const char *k;
+    const char *v;
+    bool valid;
+    bool failed;
+};
+
+// Merge of iterators. Iterators earlier in its
+// hold newer data and win when keys are equal.
+struct merge {
+    struct iter *its;
+    size_t n;
+    char key[KEY_MAX];
+    char val[VAL_MAX];
+    bool tomb;
+    bool failed;
+};
+
+// One compaction - inputs from level are merged with
+// overlapping files from level + 1 into outputs
+struct compaction {
+    int level;
+    struct sst **inputs;
+    size_t numinputs;
+    struct sst **next;
+    size_t numnext;
+    struct sst **outputs;
+    size_t numoutputs;
+    size_t outcap;
+    size_t outbytes;
+    size_t target;          // Output file size
+    bool drop_tombstones;   // No older data below output level
+    bool move;              // Input moved to next level without rewriting
+};
+
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Fowler/Noll/Vo hash function
+// In public domain - see links
+// https://github.com/lcn2/fnv/tree/master
+// https://github.com/lcn2/fnv/blob/master/LICENSE
+// https://github.com/lcn2/fnv/blob/master/hash_32a.c
+static uint32_t fnv_hash(const char *key)
+{
+    uint32_t hval = HVAL_INIT;
+    const unsigned char *p = (const unsigned char *) key;
+
+    while (*p) {
+        hval ^= (uint32_t) *p++;
+        hval *= FNV_PRIME;
+    }
+
+    return hval;
+}
+
+// Grow array at *arr to hold at least need elements
+// of elemsize bytes. Returns -1 on memory allocation failure.
+static int grow_array(void **arr, size_t *cap, size_t need, size_t elemsize)
+{
+    if (need <= *cap) {
+        return 1;
+    }
+
+    size_t newcap = *cap ? *cap * 2 : 16;
+    while (newcap < need) {
+        newcap *= 2;
+    }
+
+    void *p = realloc(*arr, newcap * elemsize);
+    if (!p) {
+        return -1;
+    }
+    *arr = p;
+    *cap = newcap;
+    return 1;
+}
+
+static ssize_t write_all(int fd, const char *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = write(fd, buf + done, len - done);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += w;
+    }
+    return (ssize_t) done;
+}
+
+static ssize_t pread_all(int fd, char *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(fd, buf + done, len - done, offset + done);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        done += r;
+    }
+    return (ssize_t) done;
+}
+
+static void get_sst_path(lsm_tbl lsm, uint64_t id, char *path)
+{
+    snprintf(path, PATH_LEN, "%s/%06" PRIu64 "%s", lsm->dir, id, SST_EXT);
+}
+
+static void get_lsm_path(lsm_tbl lsm, const char *fname, char *path)
+{
+    snprintf(path, PATH_LEN, "%s/%s", lsm->dir, fname);
+}
+
+// Flush directory entries of table directory
+static int sync_lsm_dir(lsm_tbl lsm)
+{
+    int fd = open(lsm->dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result < 0 ? -1 : 1;
+}
+
+/*------------------ Memtable -----------------*/
+
+static int mem_init(struct memtable *mt)
+{
+    mt->head = calloc(1, sizeof(struct mem_node) +
+                         MAX_HEIGHT * sizeof(struct mem_node *));
+    if (!mt->head) {
+        return -1;
+    }
+    mt->head->height = MAX_HEIGHT;
+    mt->height = 1;
+    mt->bytes = 0;
+    mt->count = 0;
+    if (mt->rng == 0) {
+        mt->rng = 0x9E3779B97F4A7C15ULL;
+    }
+    return 1;
+}
+
+static void mem_free(struct memtable *mt)
+{
+    if (!mt->head) {
+        return;
+    }
+
+    struct mem_node *x = mt->head->next[0];
+    while (x) {
+        struct mem_node *next = x->next[0];
+        free(x->val);
+        free(x);
+        x = next;
+    }
+    free(mt->head);
+    mt->head = NULL;
+}
+
+// Node height - each level above 1 with probability 1/4
+static int random_height(struct memtable *mt)
+{
+    mt->rng ^= mt->rng << 13;
+    mt->rng ^= mt->rng >> 7;
+    mt->rng ^= mt->rng << 17;
+    uint64_t r = mt->rng;
+
+    int height = 1;
+    while (height < MAX_HEIGHT && (r & 3) == 0) {
+        height++;
+        r >>= 2;
+    }
+    return height;
+}
+
+// Returns first node with key >= key, NULL if none.
+// If update is not NULL, fills update with the last
+// node before key at each level.
+static struct mem_node *mem_find_ge(struct memtable *mt, const char *key,
+                                    struct mem_node **update)
+{
+    struct mem_node *x = mt->head;
+    for (int i = mt->height - 1; i >= 0; i--) {
+        while (x->next[i] && strcmp(x->next[i]->key, key) < 0) {
+            x = x->next[i];
+        }
+        if (update) {
+            update[i] = x;
+        }
+    }
+    return x->next[0];
+}
+
+static size_t val_mem(const char *val)
+{
+    return val ? strlen(val) + 1 : 0;
+}
+
+// Set key to val in memtable. val NULL marks key deleted.
+// Returns -1 on memory allocation failure.
+static int mem_set(struct memtable *mt, const char *key, const char *val)
+{
+    char *v = NULL;
+    if (val) {
+        v = strndup(val, VAL_MAX - 1);
+        if (!v) {
+            return -1;
+        }
+    }
+
+    struct mem_node *update[MAX_HEIGHT];
+    struct mem_node *x = mem_find_ge(mt, key, update);
+    if (x && strcmp(x->key, key) == 0) {
+        mt->bytes -= val_mem(x->val);
+        free(x->val);
+        x->val = v;
+        mt->bytes += val_mem(v);
+        return 1;
+    }
+
+    int height = random_height(mt);
+    size_t keylen = strnlen(key, KEY_MAX - 1);
+    size_t nodesize = sizeof(struct mem_node) +
+                      height * sizeof(struct mem_node *) + keylen + 1;
+    x = malloc(nodesize);
+    if (!x) {
+        free(v);
+        return -1;
+    }
+    x->key = (char *) &x->next[height];
+    memcpy(x->key, key, keylen);
+    x->key[keylen] = '\0';
+    x->val = v;
+    x->height = height;
+
+    if (height > mt->height) {
+        for (int i = mt->height; i < height; i++) {
+            update[i] = mt->head;
+        }
+        mt->height = height;
+    }
+    for (int i = 0; i < height; i++) {
+        x->next[i] = update[i]->next[i];
+        update[i]->next[i] = x;
+    }
+
+    mt->bytes += nodesize + val_mem(v);
+    mt->count++;
+    return 1;
+}
+
+/*------------------ Bloom filter -----------------*/
+
+// Double hashing - bit positions are h, h + delta,
+// h + 2 * delta, ... for BLOOM_K positions
+static void bloom_add(uint64_t *bits, size_t nbits, uint32_t k, uint32_t h)
+{
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (uint32_t i = 0; i < k; i++) {
+        size_t bit = h % nbits;
+        bits[bit / 64] |= (uint64_t) 1 << (bit % 64);
+        h += delta;
+    }
+}
+
+static bool bloom_may_contain(const uint64_t *bits, size_t nbits, uint32_t k, uint32_t h)
+{
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (uint32_t i = 0; i < k; i++) {
+        size_t bit = h % nbits;
+        if (!(bits[bit / 64] & ((uint64_t) 1 << (bit % 64)))) {
+            return false;
+        }
+        h += delta;
+    }
+    return true;
+}
+
+/*------------------ Table file writing -----------------*/
+
+static void builder_release(struct sst_builder *b)
+{
+    if (b->fd >= 0) {
+        close(b->fd);
+        b->fd = -1;
+    }
+    free(b->path);
+    free(b->index);
+    free(b->hashes);
+    b->path = NULL;
+    b->index = NULL;
+    b->hashes = NULL;
+}
+
+// Discard partly written file
+static void builder_abort(struct sst_builder *b)
+{
+    if (b->path) {
+        unlink(b->path);
+    }
+    builder_release(b);
+}
+
+// Start new table file with id.
+// Returns -1 on failure.
+static int builder_start(lsm_tbl lsm, struct sst_builder *b, uint64_t id)
+{
+    memset(b, 0, sizeof(struct sst_builder));
+    b->fd = -1;
+
+    char path[PATH_LEN];
+    get_sst_path(lsm, id, path);
+    b->path = strdup(path);
+    if (!b->path) {
+        return -1;
+    }
+
+    b->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (b->fd < 0) {
+        builder_release(b);
+        return -1;
+    }
+    return 1;
+}
+
+// Write current block and add it to the block index
+static int builder_flush_block(struct sst_builder *b)
+{
+    if (b->blocklen == 0) {
+        return 1;
+    }
+
+    if (write_all(b->fd, b->block, b->blocklen) < 0) {
+        return -1;
+    }
+
+    size_t keylen = strlen(b->firstkey);
+    if (grow_array((void **) &b->index, &b->indexcap,
+                   b->indexlen + 13 + keylen, 1) < 0) {
+        return -1;
+    }
+    char *p = b->index + b->indexlen;
+    uint32_t len = (uint32_t) b->blocklen;
+    memcpy(p, &b->offset, 8);
+    memcpy(p + 8, &len, 4);
+    p[12] = (char) keylen;
+    memcpy(p + 13, b->firstkey, keylen);
+    b->indexlen += 13 + keylen;
+
+    b->offset += b->blocklen;
+    b->blocklen = 0;
+    b->numblocks++;
+    return 1;
+}
+
+// Add entry to table file. Entries must be
+// added in key order. val NULL adds a tombstone.
+static int builder_add(struct sst_builder *b, const char *key, const char *val)
+{
+    size_t keylen = strlen(key);
+    size_t vallen = val ? strlen(val) : 0;
+    size_t need = 2 + keylen + vallen;
+
+    if (b->blocklen + need > BLOCK_SIZE && builder_flush_block(b) < 0) {
+        return -1;
+    }
+    if (b->blocklen == 0) {
+        memcpy(b->firstkey, key, keylen + 1);
+    }
+
+    char *p = b->block + b->blocklen;
+    p[0] = (char) keylen;
+    p[1] = (char) (val ? vallen : TOMBSTONE);
+    memcpy(p + 2, key, keylen);
+    if (val) {
+        memcpy(p + 2 + keylen, val, vallen);
+    }
+    b->blocklen += need;
+    memcpy(b->lastkey, key, keylen + 1);
+
+    if (grow_array((void **) &b->hashes, &b->hashcap,
+                   b->numentries + 1, sizeof(uint32_t)) < 0) {
+        return -1;
+    }
+    b->hashes[b->numentries++] = fnv_hash(key);
+    return 1;
+}
+
+// Bytes written to table file so far
+static size_t builder_size(struct sst_builder *b)
+{
+    return b->offset + b->blocklen;
+}
+
+// Write block index, Bloom filter, and footer,
+// and close file. If sync is true, the file is
+// flushed to disk. A file with no entries is removed.
+// Returns file size, 0 if file had no entries,
+// -1 on failure.
+static ssize_t builder_finish(struct sst_builder *b, bool sync)
+{
+    if (builder_flush_block(b) < 0) {
+        builder_abort(b);
+        return -1;
+    }
+    if (b->numentries == 0) {
+        builder_abort(b);
+        return 0;
+    }
+
+    // Largest key follows block entries in the index
+    size_t keylen = strlen(b->lastkey);
+    if (grow_array((void **) &b->index, &b->indexcap,
+                   b->indexlen + 1 + keylen, 1) < 0) {
+        builder_abort(b);
+        return -1;
+    }
+    b->index[b->indexlen] = (char) keylen;
+    memcpy(b->index + b->indexlen + 1, b->lastkey, keylen);
+    b->indexlen += 1 + keylen;
+
+    size_t nbits = b->numentries * BLOOM_BITS_PER_KEY;
+    nbits = (nbits + 63) / 64 * 64;
+    uint64_t *bloom = calloc(nbits / 64, sizeof(uint64_t));
+    if (!bloom) {
+        builder_abort(b);
+        return -1;
+    }
+    for (size_t i = 0; i < b->numentries; i++) {
+        bloom_add(bloom, nbits, BLOOM_K, b->hashes[i]);
+    }
+
+    struct sst_footer footer = {0};
+    memcpy(footer.magic, SST_MAGIC, sizeof(SST_MAGIC));
+    footer.index_off = b->offset;
+    footer.index_len = b->indexlen;
+    footer.bloom_off = b->offset + b->indexlen;
+    footer.bloom_len = nbits / 8;
+    footer.numentries = b->numentries;
+    footer.numblocks = b->numblocks;
+    footer.bloom_k = BLOOM_K;
+
+    if (write_all(b->fd, b->index, b->indexlen) < 0 ||
+        write_all(b->fd, (char *) bloom, nbits / 8) < 0 ||
+        write_all(b->fd, (char *) &footer, sizeof(footer)) < 0 ||
+        (sync && fsync(b->fd) < 0)) {
+        free(bloom);
+        builder_abort(b);
+        return -1;
+    }
+    free(bloom);
+
+    size_t size = footer.bloom_off + footer.bloom_len + sizeof(footer);
+    builder_release(b);
+    return (ssize_t) size;
+}
+
+/*------------------ Table file reading -----------------*/
+
+static void sst_free(struct sst *s)
+{
+    if (!s) {
+        return;
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    free(s->blk_off);
+    free(s->blk_len);
+    free(s->blk_key);
+    free(s->keyarena);
+    free(s->bloom);
+    free(s);
+}
+
+// Parse block index read from file into s.
+// Returns -1 if index is malformed.
+static int sst_parse_index(struct sst *s, const char *index, size_t len)
+{
+    char *arena = s->keyarena;
+    size_t p = 0;
+    for (size_t i = 0; i < s->numblocks; i++) {
+        if (p + 13 > len) {
+            return -1;
+        }
+        memcpy(&s->blk_off[i], index + p, 8);
+        memcpy(&s->blk_len[i], index + p + 8, 4);
+        size_t keylen = (unsigned char) index[p + 12];
+        if (keylen >= KEY_MAX || p + 13 + keylen > len ||
+            s->blk_len[i] > BLOCK_SIZE) {
+            return -1;
+        }
+        memcpy(arena, index + p + 13, keylen);
+        arena[keylen] = '\0';
+        s->blk_key[i] = arena;
+        arena += keylen + 1;
+        p += 13 + keylen;
+    }
+
+    if (p + 1 > len) {
+        return -1;
+    }
+    size_t keylen = (unsigned char) index[p];
+    if (keylen >= KEY_MAX || p + 1 + keylen > len) {
+        return -1;
+    }
+    memcpy(arena, index + p + 1, keylen);
+    arena[keylen] = '\0';
+    s->largest = arena;
+    s->smallest = s->blk_key[0];
+    return 1;
+}
+
+// Open table file with id and load its block
+// index and Bloom filter.
+// Returns NULL on file error, malformed file,
+// or memory allocation failure.
+static struct sst *sst_open(lsm_tbl lsm, uint64_t id)
+{
+    char path[PATH_LEN];
+    get_sst_path(lsm, id, path);
+
+    struct sst *s = calloc(1, sizeof(struct sst));
+    if (!s) {
+        return NULL;
+    }
+    s->id = id;
+    // lsm_flush clears synced for files it
+    // writes without fsync
+    s->synced = true;
+    s->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (s->fd < 0 || fstat(s->fd, &st) < 0 ||
+        (size_t) st.st_size < sizeof(struct sst_footer)) {
+        sst_free(s);
+        return NULL;
+    }
+    s->filesize = st.st_size;
+
+    struct sst_footer footer;
+    if (pread_all(s->fd, (char *) &footer, sizeof(footer),
+                  st.st_size - sizeof(footer)) < 0 ||
+        memcmp(footer.magic, SST_MAGIC, sizeof(SST_MAGIC)) != 0 ||
+        footer.numblocks == 0 || footer.bloom_len == 0 ||
+        footer.bloom_len % 8 != 0 ||
+        footer.index_off + footer.index_len > footer.bloom_off ||
+        footer.bloom_off + footer.bloom_len + sizeof(footer) > s->filesize) {
+        sst_free(s);
+        return NULL;
+    }
+    s->numentries = footer.numentries;
+    s->numblocks = footer.numblocks;
+    s->bloom_bits = footer.bloom_len * 8;
+    s->bloom_k = footer.bloom_k;
+
+    char *index = malloc(footer.index_len);
+    s->blk_off = calloc(s->numblocks, sizeof(uint64_t));
+    s->blk_len = calloc(s->numblocks, sizeof(uint32_t));
+    s->blk_key = calloc(s->numblocks, sizeof(char *));
+    s->keyarena = malloc(footer.index_len);
+    s->bloom = malloc(footer.bloom_len);
+    if (!index || !s->blk_off || !s->blk_len || !s->blk_key ||
+        !s->keyarena || !s->bloom ||
+        pread_all(s->fd, index, footer.index_len, footer.index_off) < 0 ||
+        pread_all(s->fd, (char *) s->bloom, footer.bloom_len, footer.bloom_off) < 0 ||
+        sst_parse_index(s, index, footer.index_len) < 0) {
+        free(index);
+        sst_free(s);
+        return NULL;
+    }
+    free(index);
+
+    s->membytes = sizeof(struct sst) +
+                  s->numblocks * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(char *)) +
+                  footer.index_len + footer.bloom_len;
+    return s;
+}
+
+// Decode entry at buf[pos] into key and val.
+// Returns size of entry, 0 if entry is malformed.
+static size_t decode_entry(const char *buf, size_t len, size_t pos,
+                           char *key, char *val, bool *tomb)
+{
+    if (pos + 2 > len) {
+        return 0;
+    }
+    size_t keylen = (unsigned char) buf[pos];
+    unsigned int vl = (unsigned char) buf[pos + 1];
+    *tomb = (vl == TOMBSTONE);
+    size_t vallen = *tomb ? 0 : vl;
+    if (keylen >= KEY_MAX || vallen >= VAL_MAX ||
+        pos + 2 + keylen + vallen > len) {
+        return 0;
+    }
+
+    memcpy(key, buf + pos + 2, keylen);
+    key[keylen] = '\0';
+    memcpy(val, buf + pos + 2 + keylen, vallen);
+    val[vallen] = '\0';
+    return 2 + keylen + vallen;
+}
+
+// Search table file for key. Called with lock held.
+// Returns 1 if file holds key - val is filled, or
+// tomb is set if key was deleted. Returns 0 if file
+// does not hold key, -1 on read error.
+static int sst_get(lsm_tbl lsm, struct sst *s, const char *key,
+                   uint32_t hash, char *val, bool *tomb)
+{
+    if (strcmp(key, s->smallest) < 0 || strcmp(key, s->largest) > 0) {
+        return 0;
+    }
+    if (!bloom_may_contain(s->bloom, s->bloom_bits, s->bloom_k, hash)) {
+        lsm->stats.bloom_skips++;
+        return 0;
+    }
+
+    // Find last block with first key <= key
+    size_t lo = 0;
+    size_t hi = s->numblocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(s->blk_key[mid], key) <= 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return 0;
+    }
+    size_t blk = lo - 1;
+
+    char buf[BLOCK_SIZE];
+    size_t len = s->blk_len[blk];
+    if (pread_all(s->fd, buf, len, s->blk_off[blk]) < 0) {
+        return -1;
+    }
+    lsm->stats.block_reads++;
+
+    char entkey[KEY_MAX];
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = decode_entry(buf, len, pos, entkey, val, tomb);
+        if (n == 0) {
+            return -1;
+        }
+        int cmp = strcmp(entkey, key);
+        if (cmp == 0) {
+            return 1;
+        }
+        if (cmp > 0) {
+            break;
+        }
+        pos += n;
+    }
+    return 0;
+}
+
+/*------------------ Levels -----------------*/
+
+// Insert file at index pos of level
+static int level_insert(struct level *lv, size_t pos, struct sst *s)
+{
+    if (grow_array((void **) &lv->files, &lv->cap,
+                   lv->count + 1, sizeof(struct sst *)) < 0) {
+        return -1;
+    }
+    memmove(&lv->files[pos + 1], &lv->files[pos],
+            (lv->count - pos) * sizeof(struct sst *));
+    lv->files[pos] = s;
+    lv->count++;
+    lv->bytes += s->filesize;
+    return 1;
+}
+
+static void level_remove(struct level *lv, struct sst *s)
+{
+    for (size_t i = 0; i < lv->count; i++) {
+        if (lv->files[i] == s) {
+            memmove(&lv->files[i], &lv->files[i + 1],
+                    (lv->count - i - 1) * sizeof(struct sst *));
+            lv->count--;
+            lv->bytes -= s->filesize;
+            return;
+        }
+    }
+}
+
+// Index at which s is inserted to keep level in key order
+static size_t level_sorted_pos(struct level *lv, struct sst *s)
+{
+    size_t pos = 0;
+    while (pos < lv->count && strcmp(lv->files[pos]->smallest, s->smallest) < 0) {
+        pos++;
+    }
+    return pos;
+}
+
+// Search levels for key. Called with lock held.
+// Returns 1 if found - val is filled, 0 if key
+// is not found or deleted, -1 on read error.
+static int levels_get(lsm_tbl lsm, const char *key, char *val)
+{
+    uint32_t hash = fnv_hash(key);
+    bool tomb = false;
+
+    // Level 0 files may overlap - newest first
+    struct level *lv = &lsm->levels[0];
+    for (size_t i = 0; i < lv->count; i++) {
+        int r = sst_get(lsm, lv->files[i], key, hash, val, &tomb);
+        if (r != 0) {
+            return r < 0 ? -1 : !tomb;
+        }
+    }
+
+    // At most one file in each other level can hold key
+    for (int l = 1; l < LSM_MAX_LEVELS; l++) {
+        lv = &lsm->levels[l];
+        size_t lo = 0;
+        size_t hi = lv->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (strcmp(lv->files[mid]->largest, key) < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if (lo < lv->count) {
+            int r = sst_get(lsm, lv->files[lo], key, hash, val, &tomb);
+            if (r != 0) {
+                return r < 0 ? -1 : !tomb;
+            }
+        }
+    }
+    return 0;
+}
+
+// Flush table files written without fsync to disk.
+// Called with lock held. Returns -1 on failure.
+static int sync_files(lsm_tbl lsm)
+{
+    for (int l = 0; l < LSM_MAX_LEVELS; l++) {
+        for (size_t i = 0; i < lsm->levels[l].count; i++) {
+            struct sst *s = lsm->levels[l].files[i];
+            if (!s->synced) {
+                if (fsync(s->fd) < 0) {
+                    return -1;
+                }
+                s->synced = true;
+            }
+        }
+    }
+    return 1;
+}
+
+// Write list of table files to MANIFEST. The list is
+// written to a temporary file and renamed, so MANIFEST
+// always names a complete set of files. If sync is
+// true, listed files are flushed to disk before
+// MANIFEST, so a synced MANIFEST never names a file
+// that may be lost in a crash. Called with lock held.
+// Returns -1 on failure.
+static int write_manifest(lsm_tbl lsm, bool sync)
+{
+    if (sync && sync_files(lsm) < 0) {
+        return -1;
+    }
+
+    char tmppath[PATH_LEN];
+    char path[PATH_LEN];
+    get_lsm_path(lsm, MANIFEST_TMP_FNAME, tmppath);
+    get_lsm_path(lsm, MANIFEST_FNAME, path);
+
+    FILE *f = fopen(tmppath, "w");
+    if (!f) {
+        return -1;
+    }
+
+    fprintf(f, "%s\nnext %" PRIu64 "\n", MANIFEST_HEADER, lsm->next_id);
+    for (int l = 0; l < LSM_MAX_LEVELS; l++) {
+        for (size_t i = 0; i < lsm->levels[l].count; i++) {
+            fprintf(f, "%d %" PRIu64 "\n", l, lsm->levels[l].files[i]->id);
+        }
+    }
+
+    bool ok = (fflush(f) == 0) && (!sync || fsync(fileno(f)) == 0);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmppath, path) < 0) {
+        unlink(tmppath);
+        return -1;
+    }
+
+    if (sync) {
+        sync_lsm_dir(lsm);
+        lsm->sync_pending = false;
+    }
+    return 1;
+}
+
+// Load table files listed in MANIFEST.
+// A missing MANIFEST is a new, empty table.
+// Returns -1 on failure.
+static int read_manifest(lsm_tbl lsm)
+{
+    char path[PATH_LEN];
+    get_lsm_path(lsm, MANIFEST_FNAME, path);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return errno == ENOENT ? 1 : -1;
+    }
+
+    char line[MANIFEST_LINE];
+    if (!fgets(line, MANIFEST_LINE, f) ||
+        strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0 ||
+        fscanf(f, "next %" SCNu64 "\n", &lsm->next_id) != 1) {
+        fclose(f);
+        return -1;
+    }
+
+    int level;
+    uint64_t id;
+    int result = 1;
+    while (fscanf(f, "%d %" SCNu64 "\n", &level, &id) == 2) {
+        struct sst *s = NULL;
+        if (level < 0 || level >= LSM_MAX_LEVELS || !(s = sst_open(lsm, id))) {
+            result = -1;
+            break;
+        }
+        struct level *lv = &lsm->levels[level];
+        if (level_insert(lv, lv->count, s) < 0) {
+            sst_free(s);
+            result = -1;
+            break;
+        }
+    }
+
+    fclose(f);
+    return result;
+}
+
+// Remove table files not listed in MANIFEST, left
+// by a flush or compaction cut short
+static void remove_orphans(lsm_tbl lsm)
+{
+    DIR *d = opendir(lsm->dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        const char *ext = strrchr(ent->d_name, '.');
+        if (!ext || strcmp(ext, SST_EXT) != 0) {
+            continue;
+        }
+        uint64_t id = strtoull(ent->d_name, NULL, 10);
+
+        bool live = false;
+        for (int l = 0; l < LSM_MAX_LEVELS && !live; l++) {
+            for (size_t i = 0; i < lsm->levels[l].count; i++) {
+                if (lsm->levels[l].files[i]->id == id) {
+                    live = true;
+                    break;
+                }
+            }
+        }
+        if (!live) {
+            char path[PATH_LEN];
+            get_lsm_path(lsm, ent->d_name, path);
+            unlink(path);
+        }
+    }
+    closedir(d);
+
+    char tmppath[PATH_LEN];
+    get_lsm_path(lsm, MANIFEST_TMP_FNAME, tmppath);
+    unlink(tmppath);
+}
+
+/*------------------ Iterators -----------------*/
+
+static void iter_init_mem(struct iter *it, struct memtable *mt)
+{
+    memset(it, 0, sizeof(struct iter));
+    it->node = mt->head->next[0];
+    it->valid = (it->node != NULL);
+    if (it->valid) {
+        it->k = it->node->key;
+        it->v = it->node->val;
+    }
+}
+
+// Advance file iterator to next entry,
+// reading blocks as needed
+static void iter_next_entry(struct iter *it)
+{
+    while (true) {
+        if (it->pos < it->len) {
+            bool tomb;
+            size_t n = decode_entry(it->buf, it->len, it->pos,
+                                    it->key, it->val, &tomb);
+            if (n == 0) {
+                it->failed = true;
+                it->valid = false;
+                return;
+            }
+            it->pos += n;
+            it->k = it->key;
+            it->v = tomb ? NULL : it->val;
+            it->valid = true;
+            return;
+        }
+
+        if (it->file >= it->numfiles) {
+            it->valid = false;
+            return;
+        }
+        struct sst *s = it->files[it->file];
+        if (it->blk >= s->numblocks) {
+            it->file++;
+            it->blk = 0;
+            continue;
+        }
+
+        size_t len = s->blk_len[it->blk];
+        if (pread_all(s->fd, it->buf, len, s->blk_off[it->blk]) < 0) {
+            it->failed = true;
+            it->valid = false;
+            return;
+        }
+        it->blk++;
+        it->pos = 0;
+        it->len = len;
+    }
+}
+
+static void iter_init_files(struct iter *it, struct sst **files, size_t numfiles)
+{
+    memset(it, 0, sizeof(struct iter));
+    it->files = files;
+    it->numfiles = numfiles;
+    it->buf = malloc(BLOCK_SIZE);
+    if (!it->buf) {
+        it->failed = true;
+        return;
+    }
+    iter_next_entry(it);
+}
+
+static void iter_next(struct iter *it)
+{
+    if (it->files) {
+        iter_next_entry(it);
+        return;
+    }
+
+    it->node = it->node->next[0];
+    it->valid = (it->node != NULL);
+    if (it->valid) {
+        it->k = it->node->key;
+        it->v = it->node->val;
+    }
+}
+
+static void iters_free(struct iter *its, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        free(its[i].buf);
+    }
+    free(its);
+}
+
+// Move merge to next key. Returns false at end of
+// all iterators or when an iterator fails.
+static bool merge_next(struct merge *m)
+{
+    size_t win = m->n;
+    for (size_t i = 0; i < m->n; i++) {
+        struct iter *it = &m->its[i];
+        if (it->failed) {
+            m->failed = true;
+            return false;
+        }
+        if (it->valid && (win == m->n || strcmp(it->k, m->its[win].k) < 0)) {
+            win = i;
+        }
+    }
+    if (win == m->n) {
+        return false;
+    }
+
+    strtcpy(m->key, m->its[win].k, KEY_MAX);
+    m->tomb = (m->its[win].v == NULL);
+    if (!m->tomb) {
+        strtcpy(m->val, m->its[win].v, VAL_MAX);
+    }
+
+    // Older versions of key are skipped
+    for (size_t i = 0; i < m->n; i++) {
+        struct iter *it = &m->its[i];
+        if (it->valid && strcmp(it->k, m->key) == 0) {
+            iter_next(it);
+        }
+    }
+    return true;
+}
+
+// Iterators over memtable and all levels, newest
+// first. Called with lock held.
+// Returns NULL on memory allocation failure.
+static struct iter *open_table_iters(lsm_tbl lsm, size_t *n)
+{
+    size_t count = 1 + lsm->levels[0].count;
+    for (int l = 1; l < LSM_MAX_LEVELS; l++) {
+        count += (lsm->levels[l].count > 0);
+    }
+
+    struct iter *its = calloc(count, sizeof(struct iter));
+    if (!its) {
+        return NULL;
+    }
+
+    size_t i = 0;
+    iter_init_mem(&its[i++], &lsm->mem);
+    for (size_t f = 0; f < lsm->levels[0].count; f++) {
+        iter_init_files(&its[i++], &lsm->levels[0].files[f], 1);
+    }
+    for (int l = 1; l < LSM_MAX_LEVELS; l++) {
+        if (lsm->levels[l].count > 0) {
+            iter_init_files(&its[i++], lsm->levels[l].files, lsm->levels[l].count);
+        }
+    }
+
+    *n = count;
+    return its;
+}
+
+/*------------------ Compaction -----------------*/
+
+static size_t level_max_bytes(lsm_tbl lsm, int level)
+{
+    size_t max = lsm->memtable_max * LEVEL_GROWTH;
+    for (int l = 1; l < level; l++) {
+        max *= LEVEL_GROWTH;
+    }
+    return max;
+}
+
+// Level most in need of compaction, -1 if none.
+// Called with lock held.
+static int compaction_level(lsm_tbl lsm)
+{
+    if (lsm->levels[0].count >= L0_COMPACT_TRIGGER) {
+        return 0;
+    }
+    for (int l = 1; l < LSM_MAX_LEVELS - 1; l++) {
+        if (lsm->levels[l].bytes > level_max_bytes(lsm, l)) {
+            return l;
+        }
+    }
+    return -1;
+}
+
+static void free_compaction(struct compaction *c)
+{
+    free(c->inputs);
+    free(c->next);
+    free(c->outputs);
+}
+
+// Choose files for next compaction. Called with
+// lock held. Returns false if no compaction is
+// needed or on memory allocation failure.
+static bool pick_compaction(lsm_tbl lsm, struct compaction *c)
+{
+    memset(c, 0, sizeof(struct compaction));
+    c->level = compaction_level(lsm);
+    if (c->level < 0) {
+        return false;
+    }
+
+    struct level *lv = &lsm->levels[c->level];
+    struct level *nv = &lsm->levels[c->level + 1];
+    c->inputs = calloc(lv->count, sizeof(struct sst *));
+    c->next = calloc(nv->count + 1, sizeof(struct sst *));
+    if (!c->inputs || !c->next) {
+        free_compaction(c);
+        return false;
+    }
+
+    const char *lo;
+    const char *hi;
+    if (c->level == 0) {
+        // All level 0 files, since they may overlap
+        c->numinputs = lv->count;
+        memcpy(c->inputs, lv->files, lv->count * sizeof(struct sst *));
+        lo = lv->files[0]->smallest;
+        hi = lv->files[0]->largest;
+        for (size_t i = 1; i < lv->count; i++) {
+            if (strcmp(lv->files[i]->smallest, lo) < 0) {
+                lo = lv->files[i]->smallest;
+            }
+            if (strcmp(lv->files[i]->largest, hi) > 0) {
+                hi = lv->files[i]->largest;
+            }
+        }
+    }
+    else {
+        // Next file after the last one compacted
+        size_t pick = 0;
+        char *ptr = lsm->compact_ptr[c->level];
+        if (ptr) {
+            for (size_t i = 0; i < lv->count; i++) {
+                if (strcmp(lv->files[i]->smallest, ptr) > 0) {
+                    pick = i;
+                    break;
+                }
+            }
+        }
+        c->numinputs = 1;
+        c->inputs[0] = lv->files[pick];
+        lo = c->inputs[0]->smallest;
+        hi = c->inputs[0]->largest;
+
+        free(lsm->compact_ptr[c->level]);
+        lsm->compact_ptr[c->level] = strdup(hi);
+    }
+
+    for (size_t i = 0; i < nv->count; i++) {
+        struct sst *s = nv->files[i];
+        if (strcmp(s->largest, lo) >= 0 && strcmp(s->smallest, hi) <= 0) {
+            c->next[c->numnext++] = s;
+        }
+    }
+
+    // Tombstones are only needed while an older
+    // version of the key may exist in a lower level
+    c->drop_tombstones = true;
+    for (int l = c->level + 2; l < LSM_MAX_LEVELS; l++) {
+        if (lsm->levels[l].count > 0) {
+            c->drop_tombstones = false;
+        }
+    }
+
+    c->move = (c->numinputs == 1 && c->numnext == 0);
+    c->target = lsm->memtable_max * FILE_SIZE_FACTOR;
+    return true;
+}
+
+// Finish current output file of compaction and open it
+static int finish_output(lsm_tbl lsm, struct compaction *c,
+                         struct sst_builder *b, uint64_t id)
+{
+    ssize_t size = builder_finish(b, true);
+    if (size <= 0) {
+        return size < 0 ? -1 : 1;
+    }
+
+    struct sst *s = sst_open(lsm, id);
+    if (!s || grow_array((void **) &c->outputs, &c->outcap,
+                         c->numoutputs + 1, sizeof(struct sst *)) < 0) {
+        char path[PATH_LEN];
+        get_sst_path(lsm, id, path);
+        unlink(path);
+        sst_free(s);
+        return -1;
+    }
+    c->outputs[c->numoutputs++] = s;
+    c->outbytes += size;
+    return 1;
+}
+
+// Remove compaction output files after a failure
+static void discard_outputs(lsm_tbl lsm, struct compaction *c)
+{
+    for (size_t i = 0; i < c->numoutputs; i++) {
+        char path[PATH_LEN];
+        get_sst_path(lsm, c->outputs[i]->id, path);
+        sst_free(c->outputs[i]);
+        unlink(path);
+    }
+    c->numoutputs = 0;
+}
+
+// Merge compaction inputs into new files for the next
+// level. Runs without lock - input files are removed
+// only by the compaction thread.
+// Returns -1 on failure.
+static int run_compaction(lsm_tbl lsm, struct compaction *c)
+{
+    // Level 0 inputs may overlap and each gets an
+    // iterator. Other inputs are a single file.
+    size_t n = c->numinputs + (c->numnext > 0);
+    struct iter *its = calloc(n, sizeof(struct iter));
+    if (!its) {
+        return -1;
+    }
+    for (size_t i = 0; i < c->numinputs; i++) {
+        iter_init_files(&its[i], &c->inputs[i], 1);
+    }
+    if (c->numnext > 0) {
+        iter_init_files(&its[c->numinputs], c->next, c->numnext);
+    }
+
+    struct merge m = {.its = its, .n = n};
+    struct sst_builder *b = malloc(sizeof(struct sst_builder));
+    if (!b) {
+        iters_free(its, n);
+        return -1;
+    }
+
+    bool open = false;
+    uint64_t id = 0;
+    int result = 1;
+    while (result > 0 && merge_next(&m)) {
+        if (m.tomb && c->drop_tombstones) {
+            continue;
+        }
+        if (!open) {
+            pthread_mutex_lock(&lsm->lock);
+            id = lsm->next_id++;
+            pthread_mutex_unlock(&lsm->lock);
+            if (builder_start(lsm, b, id) < 0) {
+                result = -1;
+                break;
+            }
+            open = true;
+        }
+        if (builder_add(b, m.key, m.tomb ? NULL : m.val) < 0) {
+            result = -1;
+            break;
+        }
+        if (builder_size(b) >= c->target) {
+            open = false;
+            result = finish_output(lsm, c, b, id);
+        }
+    }
+
+    if (m.failed) {
+        result = -1;
+    }
+    if (open) {
+        if (result > 0) {
+            result = finish_output(lsm, c, b, id);
+        }
+        else {
+            builder_abort(b);
+        }
+    }
+    if (result < 0) {
+        discard_outputs(lsm, c);
+    }
+
+    free(b);
+    iters_free(its, n);
+    return result;
+}
+
+// Replace compaction inputs with outputs in levels,
+// write MANIFEST, and delete input files. Called
+// with lock held. Returns -1 on failure - levels are
+// left unchanged and outputs are discarded.
+static int install_compaction(lsm_tbl lsm, struct compaction *c)
+{
+    struct level *lv = &lsm->levels[c->level];
+    struct level *nv = &lsm->levels[c->level + 1];
+
+    if (c->move) {
+        // Single file with no overlap in the next
+        // level moves down without rewriting
+        struct sst *s = c->inputs[0];
+        if (level_insert(nv, level_sorted_pos(nv, s), s) < 0) {
+            return -1;
+        }
+        level_remove(lv, s);
+        if (write_manifest(lsm, true) < 0) {
+            level_remove(nv, s);
+            level_insert(lv, c->level == 0 ? lv->count : level_sorted_pos(lv, s), s);
+            return -1;
+        }
+        return 1;
+    }
+
+    for (size_t i = 0; i < c->numinputs; i++) {
+        level_remove(lv, c->inputs[i]);
+    }
+    for (size_t i = 0; i < c->numnext; i++) {
+        level_remove(nv, c->next[i]);
+    }
+
+    bool ok = true;
+    size_t added = 0;
+    for (; added < c->numoutputs && ok; added++) {
+        struct sst *s = c->outputs[added];
+        ok = level_insert(nv, level_sorted_pos(nv, s), s) > 0;
+    }
+    if (ok) {
+        ok = write_manifest(lsm, true) > 0;
+    }
+
+    if (!ok) {
+        // Put inputs back - level 0 inputs are the
+        // oldest files, so they go back at the end
+        for (size_t i = 0; i < added; i++) {
+            level_remove(nv, c->outputs[i]);
+        }
+        for (size_t i = 0; i < c->numinputs; i++) {
+            struct sst *s = c->inputs[i];
+            level_insert(lv, c->level == 0 ? lv->count : level_sorted_pos(lv, s), s);
+        }
+        for (size_t i = 0; i < c->numnext; i++) {
+            level_insert(nv, level_sorted_pos(nv, c->next[i]), c->next[i]);
+        }
+        discard_outputs(lsm, c);
+        return -1;
+    }
+
+    for (size_t i = 0; i < c->numinputs + c->numnext; i++) {
+        struct sst *s = i < c->numinputs ? c->inputs[i] : c->next[i - c->numinputs];
+        char path[PATH_LEN];
+        get_sst_path(lsm, s->id, path);
+        sst_free(s);
+        unlink(path);
+    }
+
+    lsm->stats.compactions++;
+    lsm->stats.compact_bytes += c->outbytes;
+    return 1;
+}
+
+// Set time at which files flushed without
+// fsync are next made durable
+static void set_sync_due(lsm_tbl lsm)
+{
+    clock_gettime(CLOCK_REALTIME, &lsm->sync_due);
+    lsm->sync_due.tv_sec += lsm->group_ms / 1000;
+    lsm->sync_due.tv_nsec += (long) (lsm->group_ms % 1000) * 1000000L;
+    if (lsm->sync_due.tv_nsec >= 1000000000L) {
+        lsm->sync_due.tv_sec++;
+        lsm->sync_due.tv_nsec -= 1000000000L;
+    }
+}
+
+static bool sync_is_due(lsm_tbl lsm)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > lsm->sync_due.tv_sec ||
+           (now.tv_sec == lsm->sync_due.tv_sec &&
+            now.tv_nsec >= lsm->sync_due.tv_nsec);
+}
+
+// Background compaction thread - waits for a level
+// to need compaction, then compacts it. Also makes
+// files flushed without fsync durable once they are
+// group_ms old.
+static void *compactor_main(void *arg)
+{
+    lsm_tbl lsm = arg;
+
+    pthread_mutex_lock(&lsm->lock);
+    while (!lsm->stop) {
+        if (lsm->sync_pending && sync_is_due(lsm)) {
+            // Files stay pending and are tried
+            // again by the next flush if this fails
+            if (write_manifest(lsm, true) < 0) {
+                set_sync_due(lsm);
+            }
+            continue;
+        }
+
+        struct compaction c;
+        if (lsm->compact_failed || !pick_compaction(lsm, &c)) {
+            if (lsm->sync_pending) {
+                pthread_cond_timedwait(&lsm->cond, &lsm->lock, &lsm->sync_due);
+            }
+            else {
+                pthread_cond_wait(&lsm->cond, &lsm->lock);
+            }
+            continue;
+        }
+
+        lsm->compacting = true;
+        pthread_mutex_unlock(&lsm->lock);
+        int result = c.move ? 1 : run_compaction(lsm, &c);
+        pthread_mutex_lock(&lsm->lock);
+
+        if (result < 0 || install_compaction(lsm, &c) < 0) {
+            lsm->compact_failed = true;
+        }
+        free_compaction(&c);
+        lsm->compacting = false;
+        pthread_cond_broadcast(&lsm->cond);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+
+    return NULL;
+}
+
+/*------------------ Scans -----------------*/
+
+// Strings collected by lsm_get_keys and lsm_get_vals.
+// Offsets into arena are kept while arena grows.
+struct collect {
+    bool vals;
+    char *arena;
+    size_t len;
+    size_t cap;
+    size_t *offs;
+    size_t n;
+    size_t offcap;
+    bool failed;
+};
+
+static int collect_fn(const char *key, const char *val, void *arg)
+{
+    struct collect *c = arg;
+    const char *str = c->vals ? val : key;
+    size_t len = strlen(str) + 1;
+
+    if (grow_array((void **) &c->arena, &c->cap, c->len + len, 1) < 0 ||
+        grow_array((void **) &c->offs, &c->offcap, c->n + 1, sizeof(size_t)) < 0) {
+        c->failed = true;
+        return 1;
+    }
+    memcpy(c->arena + c->len, str, len);
+    c->offs[c->n++] = c->len;
+    c->len += len;
+    return 0;
+}
+
+// Collect all keys or vals. Replaces *arena with
+// the new string storage.
+static char **collect_strs(lsm_tbl lsm, bool vals, char **arena)
+{
+    struct collect c = {.vals = vals};
+    if (lsm_scan(lsm, collect_fn, &c) < 0 || c.failed) {
+        free(c.arena);
+        free(c.offs);
+        return NULL;
+    }
+
+    char **strs = calloc(c.n ? c.n : 1, sizeof(char *));
+    if (!strs) {
+        free(c.arena);
+        free(c.offs);
+        return NULL;
+    }
+    for (size_t i = 0; i < c.n; i++) {
+        strs[i] = c.arena + c.offs[i];
+    }
+    free(c.offs);
+
+    free(*arena);
+    *arena = c.arena;
+    return strs;
+}
+
+static int count_fn(const char *key, const char *val, void *arg)
+{
+    (void) key;
+    (void) val;
+    (*(size_t *) arg)++;
+    return 0;
+}
+
+// Flush memtable if it has reached memtable_max,
+// synced as set by lsm_set_sync, unless flushes
+// are held.
+// Returns -2 on failure, as put and del do.
+static int maybe_flush(lsm_tbl lsm)
+{
+    if (lsm->mem.bytes >= lsm->memtable_max && !lsm->hold_flush &&
+        lsm_flush(lsm, lsm->sync) < 0) {
+        return -2;
+    }
+    return 1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+
+
+/*---------------- LSM table public functions -----------------*/
+
+// Open table stored in directory dirpath,
+// creating the directory if it does not exist,
+// and start its background compaction thread.
+// Returns NULL on failure.
+lsm_tbl lsm_open(const char *dirpath)
+{
+    if (!dirpath) {
+        return NULL;
+    }
+
+    if (mkdir(dirpath, 0755) < 0 && errno != EEXIST) {
+        return NULL;
+    }
+
+    lsm_tbl lsm = calloc(1, sizeof(struct lsm_obj));
+    if (!lsm) {
+        return NULL;
+    }
+
+    lsm->dir = strdup(dirpath);
+    if (!lsm->dir || mem_init(&lsm->mem) < 0) {
+        free(lsm->dir);
+        free(lsm);
+        return NULL;
+    }
+    lsm->memtable_max = DEFAULT_MEMTABLE_MAX;
+    lsm->sync = true;
+    lsm->next_id = 1;
+    pthread_mutex_init(&lsm->lock, NULL);
+    pthread_cond_init(&lsm->cond, NULL);
+
+    if (read_manifest(lsm) < 0) {
+        lsm_close(lsm);
+        return NULL;
+    }
+    remove_orphans(lsm);
+
+    // Without a compaction thread the table still
+    // works, but level 0 is never merged
+    lsm->compactor_running =
+        (pthread_create(&lsm->compactor, NULL, compactor_main, lsm) == 0);
+
+    return lsm;
+}
+
+// Stop compaction and free table. Changes not
+// written with lsm_flush are discarded; flushed
+// files waiting for a group sync are synced.
+void lsm_close(lsm_tbl lsm)
+{
+    if (!lsm) {
+        return;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    lsm->stop = true;
+    pthread_cond_broadcast(&lsm->cond);
+    pthread_mutex_unlock(&lsm->lock);
+    if (lsm->compactor_running) {
+        pthread_join(lsm->compactor, NULL);
+    }
+
+    // Files still waiting for the compaction thread
+    pthread_mutex_lock(&lsm->lock);
+    if (lsm->sync_pending) {
+        write_manifest(lsm, true);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+
+    for (int l = 0; l < LSM_MAX_LEVELS; l++) {
+        for (size_t i = 0; i < lsm->levels[l].count; i++) {
+            sst_free(lsm->levels[l].files[i]);
+        }
+        free(lsm->levels[l].files);
+        free(lsm->compact_ptr[l]);
+    }
+
+    mem_free(&lsm->mem);
+    pthread_mutex_destroy(&lsm->lock);
+    pthread_cond_destroy(&lsm->cond);
+    free(lsm->keys_arena);
+    free(lsm->vals_arena);
+    free(lsm->dir);
+    free(lsm);
+}
+
+// Set memtable size in bytes at which the
+// memtable is written to a level 0 file.
+void lsm_set_memtable_max(lsm_tbl lsm, size_t bytes)
+{
+    if (!lsm || bytes == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    lsm->memtable_max = bytes;
+    pthread_cond_broadcast(&lsm->cond);
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+// Set whether memtable flushes made by lsm_put and
+// lsm_del are written with fsync. If sync is false
+// and group_ms is greater than 0, the compaction
+// thread flushes their files and MANIFEST to disk
+// together within group_ms milliseconds.
+void lsm_set_sync(lsm_tbl lsm, bool sync, unsigned int group_ms)
+{
+    if (!lsm) {
+        return;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    lsm->sync = sync;
+    lsm->group_ms = group_ms;
+    if (lsm->sync_pending) {
+        set_sync_due(lsm);
+    }
+    pthread_cond_broadcast(&lsm->cond);
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+// While hold is true, lsm_put and lsm_del never
+// flush the memtable, so changes made until the
+// next lsm_flush reach disk as one file.
+void lsm_hold_flush(lsm_tbl lsm, bool hold)
+{
+    if (!lsm) {
+        return;
+    }
+    lsm->hold_flush = hold;
+}
+
+// Set value of key, replacing any previous value.
+// Returns 1 on success, -2 on memory allocation
+// or file error.
+int lsm_put(lsm_tbl lsm, const char *key, const char *val)
+{
+    if (!lsm || !key || !val) {
+        return -2;
+    }
+
+    if (mem_set(&lsm->mem, key, val) < 0) {
+        return -2;
+    }
+    lsm->stats.user_bytes += strlen(key) + strlen(val);
+
+    return maybe_flush(lsm);
+}
+
+// Searches for value associated with key.
+// If found, copies value to dst.
+// Returns length of value string copied to dst.
+// Returns 0 on error or if value not found.
+size_t lsm_get(char *dst, size_t dsize, lsm_tbl lsm, const char *key)
+{
+    if (!lsm || !key || !dst) {
+        return 0;
+    }
+
+    char val[VAL_MAX];
+    struct mem_node *x = mem_find_ge(&lsm->mem, key, NULL);
+    if (x && strcmp(x->key, key) == 0) {
+        if (!x->val) {
+            return 0;
+        }
+        strtcpy(val, x->val, VAL_MAX);
+    }
+    else {
+        pthread_mutex_lock(&lsm->lock);
+        int found = levels_get(lsm, key, val);
+        pthread_mutex_unlock(&lsm->lock);
+        if (found <= 0) {
+            return 0;
+        }
+    }
+
+    ssize_t cpy = strtcpy(dst, val, dsize);
+
+    return (cpy < 0) ? dsize - 1 : (size_t) cpy;
+}
+
+bool lsm_exists(lsm_tbl lsm, const char *key)
+{
+    char val[VAL_MAX];
+    return lsm_get(val, VAL_MAX, lsm, key) > 0;
+}
+
+// Remove key. Deleting a key that does not
+// exist has no effect on lookups.
+// Returns 1 on success, -2 on memory allocation
+// or file error.
+int lsm_del(lsm_tbl lsm, const char *key)
+{
+    if (!lsm || !key) {
+        return -2;
+    }
+
+    if (mem_set(&lsm->mem, key, NULL) < 0) {
+        return -2;
+    }
+    lsm->stats.user_bytes += strlen(key);
+
+    return maybe_flush(lsm);
+}
+
+// Call fn for every key in key order.
+// Returns 1 when all keys were visited or
+// fn stopped the scan, -1 on file error.
+int lsm_scan(lsm_tbl lsm, lsm_scan_fn fn, void *arg)
+{
+    if (!lsm || !fn) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+
+    size_t n = 0;
+    struct iter *its = open_table_iters(lsm, &n);
+    if (!its) {
+        pthread_mutex_unlock(&lsm->lock);
+        return -1;
+    }
+
+    struct merge m = {.its = its, .n = n};
+    while (merge_next(&m)) {
+        if (!m.tomb && fn(m.key, m.val, arg) != 0) {
+            break;
+        }
+    }
+
+    iters_free(its, n);
+    pthread_mutex_unlock(&lsm->lock);
+
+    return m.failed ? -1 : 1;
+}
+
+// Returns number of keys in table. Requires
+// a full scan of the table.
+size_t lsm_count(lsm_tbl lsm)
+{
+    size_t count = 0;
+    lsm_scan(lsm, count_fn, &count);
+    return count;
+}
+
+// Returns pointer to heap-allocated array of
+// key strings in key order. Strings are owned
+// by the table.
+char **lsm_get_keys(lsm_tbl lsm)
+{
+    if (!lsm) {
+        return NULL;
+    }
+
+    return collect_strs(lsm, false, &lsm->keys_arena);
+}
+
+// Returns pointer to heap-allocated array of
+// val strings in key order. Strings are owned
+// by the table.
+char **lsm_get_vals(lsm_tbl lsm)
+{
+    if (!lsm) {
+        return NULL;
+    }
+
+    return collect_strs(lsm, true, &lsm->vals_arena);
+}
+
+// Write memtable to a new level 0 file. If sync
+// is true, the file and table manifest are flushed
+// to disk with fsync before returning. Otherwise,
+// if group_ms is set with lsm_set_sync, they are
+// flushed by the compaction thread within group_ms.
+// Returns number of bytes written, -1 on error.
+ssize_t lsm_flush(lsm_tbl lsm, bool sync)
+{
+    if (!lsm) {
+        return -1;
+    }
+
+    if (lsm->mem.count == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    // Flushes wait while compaction catches up
+    // with level 0, which lookups search file by file
+    while (lsm->levels[0].count >= L0_STALL && lsm->compactor_running &&
+           !lsm->compact_failed) {
+        pthread_cond_wait(&lsm->cond, &lsm->lock);
+    }
+    uint64_t id = lsm->next_id++;
+    pthread_mutex_unlock(&lsm->lock);
+
+    struct sst_builder *b = malloc(sizeof(struct sst_builder));
+    if (!b || builder_start(lsm, b, id) < 0) {
+        free(b);
+        return -1;
+    }
+    for (struct mem_node *x = lsm->mem.head->next[0]; x; x = x->next[0]) {
+        if (builder_add(b, x->key, x->val) < 0) {
+            builder_abort(b);
+            free(b);
+            return -1;
+        }
+    }
+    ssize_t size = builder_finish(b, sync);
+    free(b);
+    if (size <= 0) {
+        return -1;
+    }
+
+    char path[PATH_LEN];
+    get_sst_path(lsm, id, path);
+    struct sst *s = sst_open(lsm, id);
+    struct memtable mem = {.rng = lsm->mem.rng};
+    if (!s || mem_init(&mem) < 0) {
+        sst_free(s);
+        unlink(path);
+        return -1;
+    }
+
+    s->synced = sync;
+
+    pthread_mutex_lock(&lsm->lock);
+    if (level_insert(&lsm->levels[0], 0, s) < 0) {
+        pthread_mutex_unlock(&lsm->lock);
+        mem_free(&mem);
+        sst_free(s);
+        unlink(path);
+        return -1;
+    }
+    if (!sync && lsm->group_ms > 0 && lsm->compactor_running) {
+        // Compaction thread writes MANIFEST
+        if (!lsm->sync_pending) {
+            lsm->sync_pending = true;
+            set_sync_due(lsm);
+        }
+    }
+    else if (write_manifest(lsm, sync) < 0) {
+        level_remove(&lsm->levels[0], s);
+        pthread_mutex_unlock(&lsm->lock);
+        mem_free(&mem);
+        sst_free(s);
+        unlink(path);
+        return -1;
+    }
+    lsm->stats.flushes++;
+    lsm->stats.flush_bytes += size;
+    pthread_cond_broadcast(&lsm->cond);
+    pthread_mutex_unlock(&lsm->lock);
+
+    mem_free(&lsm->mem);
+    lsm->mem = mem;
+
+    return size;
+}
+
+// Block until no compaction is running or needed.
+void lsm_wait_compaction(lsm_tbl lsm)
+{
+    if (!lsm) {
+        return;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    while (lsm->compactor_running && !lsm->compact_failed &&
+           (lsm->compacting || compaction_level(lsm) >= 0)) {
+        pthread_cond_wait(&lsm->cond, &lsm->lock);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+// Returns bytes of memory held by table -
+// memtable, block indexes, and Bloom filters
+size_t lsm_mem_usage(lsm_tbl lsm)
+{
+    if (!lsm) {
+        return 0;
+    }
+
+    size_t total = sizeof(struct lsm_obj) + lsm->mem.bytes;
+    pthread_mutex_lock(&lsm->lock);
+    for (int l = 0; l < LSM_MAX_LEVELS; l++) {
+        for (size_t i = 0; i < lsm->levels[l].count; i++) {
+            total += lsm->levels[l].files[i]->membytes;
+        }
+    }
+    pthread_mutex_unlock(&lsm->lock);
+
+    return total;
+}
+
+// Copy table counters to stats.
+void lsm_get_stats(lsm_tbl lsm, struct lsm_stats *stats)
+{
+    if (!lsm || !stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&lsm->lock);
+    *stats = lsm->stats;
+    for (int l = 0; l < LSM_MAX_LEVELS; l++) {
+        stats->files[l] = lsm->levels[l].count;
+        stats->level_bytes[l] = lsm->levels[l].bytes;
+    }
+    pthread_mutex_unlock(&lsm->lock);
+
+    stats->memtable_bytes = lsm->mem.bytes;
+    stats->memtable_entries = lsm->mem.count;
+}
+
+// Delete table directory dirpath and all files
+// in it. The table must not be open.
+// Returns 1 on success, -1 on failure.
+int lsm_remove_dir(const char *dirpath)
+{
+    if (!dirpath) {
+        return -1;
+    }
+
+    DIR *d = opendir(dirpath);
+    if (!d) {
+        return -1;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        char path[PATH_LEN];
+        snprintf(path, PATH_LEN, "%s/%s", dirpath, ent->d_name);
+        unlink(path);
+    }
+    closedir(d);
+
+    return rmdir(dirpath) < 0 ? -1 : 1;
+}
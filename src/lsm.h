@@ -0,0 +1,160 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Log-structured merge tree (LSM tree) table.
+ *
+ * An lsm table stores key-value pairs in a directory
+ * on disk and holds only recent changes and small
+ * per-file indexes in memory, so a table can be much
+ * larger than available memory. Changes are collected
+ * in a sorted in-memory memtable. When the memtable
+ * is full, or when the table is flushed, it is written
+ * to a new immutable sorted table file (SSTable) in
+ * level 0. A background thread merges files into
+ * larger levels (leveled compaction), discarding
+ * overwritten values and deleted keys. Each file has
+ * a block index and a Bloom filter, so a lookup reads
+ * at most one block from each file that may hold the
+ * key.
+ *
+ */
+
+#ifndef LSM_H
+#define LSM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum {
+    LSM_MAX_LEVELS = 7
+};
+
+// lsm table object handle
+typedef struct lsm_obj *lsm_tbl;
+
+// Table counters. Byte counts for files
+// are sizes on disk.
+struct lsm_stats {
+    size_t memtable_bytes;          // Memory held by memtable
+    size_t memtable_entries;
+    size_t files[LSM_MAX_LEVELS];   // Table files in each level
+    size_t level_bytes[LSM_MAX_LEVELS];
+    size_t user_bytes;      // Key and value bytes written by put and del
+    size_t flush_bytes;     // Bytes written by memtable flushes
+    size_t compact_bytes;   // Bytes written by compaction
+    size_t flushes;
+    size_t compactions;
+    size_t bloom_skips;     // File reads avoided by Bloom filters
+    size_t block_reads;     // Blocks read by lookups
+};
+
+// Called by lsm_scan for each key in order.
+// Return nonzero to stop the scan.
+typedef int (*lsm_scan_fn)(const char *key, const char *val, void *arg);
+
+// Open table stored in directory dirpath,
+// creating the directory if it does not exist,
+// and start its background compaction thread.
+// Returns NULL on failure.
+lsm_tbl lsm_open(const char *dirpath);
+
+// Stop compaction and free table. Changes not
+// written with lsm_flush are discarded; flushed
+// files waiting for a group sync are synced.
+void lsm_close(lsm_tbl lsm);
+
+// Set memtable size in bytes at which the
+// memtable is written to a level 0 file.
+// Larger values use more memory and write
+// fewer, larger files.
+void lsm_set_memtable_max(lsm_tbl lsm, size_t bytes);
+
+// Set whether memtable flushes made by lsm_put and
+// lsm_del are written with fsync (the default). If
+// sync is false and group_ms is greater than 0, the
+// compaction thread flushes their files and MANIFEST
+// to disk together within group_ms milliseconds, so
+// a crash loses at most the last group_ms of flushes.
+// With group_ms 0 they are left to the OS.
+void lsm_set_sync(lsm_tbl lsm, bool sync, unsigned int group_ms);
+
+// While hold is true, lsm_put and lsm_del never
+// flush the memtable, however large it grows, so
+// changes made until the next lsm_flush reach disk
+// together as one file listed by one MANIFEST
+// update. Releasing the hold does not flush.
+void lsm_hold_flush(lsm_tbl lsm, bool hold);
+
+// Set value of key, replacing any previous value.
+// Returns 1 on success, -2 on memory allocation
+// or file error.
+int lsm_put(lsm_tbl lsm, const char *key, const char *val);
+
+// Searches for value associated with key.
+// If found, copies value to dst.
+// Returns length of value string copied to dst.
+// Returns 0 on error or if value not found.
+size_t lsm_get(char *dst, size_t dsize, lsm_tbl lsm, const char *key);
+
+bool lsm_exists(lsm_tbl lsm, const char *key);
+
+// Remove key. Deleting a key that does not
+// exist has no effect on lookups.
+// Returns 1 on success, -2 on memory allocation
+// or file error.
+int lsm_del(lsm_tbl lsm, const char *key);
+
+// Call fn for every key in key order.
+// Returns 1 when all keys were visited or
+// fn stopped the scan, -1 on file error.
+int lsm_scan(lsm_tbl lsm, lsm_scan_fn fn, void *arg);
+
+// Returns number of keys in table. Requires
+// a full scan of the table.
+size_t lsm_count(lsm_tbl lsm);
+
+// Returns pointer to heap-allocated array of
+// key strings in key order. Caller is responsible
+// for freeing returned pointer. The strings are
+// owned by the table and are valid until the next
+// call to lsm_get_keys or lsm_close.
+char **lsm_get_keys(lsm_tbl lsm);
+
+// Returns pointer to heap-allocated array of
+// val strings in key order. Caller is responsible
+// for freeing returned pointer. The strings are
+// owned by the table and are valid until the next
+// call to lsm_get_vals or lsm_close.
+char **lsm_get_vals(lsm_tbl lsm);
+
+// Write memtable to a new level 0 file. If sync
+// is true, the file and table manifest are flushed
+// to disk with fsync before returning. Otherwise,
+// if group_ms is set with lsm_set_sync, they are
+// flushed by the compaction thread within group_ms.
+// Returns number of bytes written, -1 on error.
+ssize_t lsm_flush(lsm_tbl lsm, bool sync);
+
+// Block until no compaction is running or needed.
+void lsm_wait_compaction(lsm_tbl lsm);
+
+// Returns bytes of memory held by table -
+// memtable, block indexes, and Bloom filters
+size_t lsm_mem_usage(lsm_tbl lsm);
+
+// Copy table counters to stats.
+void lsm_get_stats(lsm_tbl lsm, struct lsm_stats *stats);
+
+// Delete table directory dirpath and all files
+// in it. The table must not be open.
+// Returns 1 on success, -1 on failure.
+int lsm_remove_dir(const char *dirpath);
+
+#endif // LSM_H
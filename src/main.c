@@ -25,7 +25,7 @@
  * ------------------- Commands -----------------------
  *         SYNTAX                   ACTIONS
  * newtbl <table_name>        Creates a new table in
- *                            memory and sets as current
+ *   [hash|cuckoo|lsm]        memory and sets as current
  *                            table to be used for
  *                            subsequent commands.
  *                            Command fails if a table
@@ -33,8 +33,13 @@
  *                            exists. If used when another
  *                            table is already set as
  *                            current table, that table
- *                            is saved before switching
- *                            to the new table.
+ *                            stays open in memory.
+ *                            Optional engine: hash
+ *                            (default) and cuckoo keep
+ *                            the table in memory, lsm
+ *                            stores it on disk in sorted
+ *                            files for tables larger than
+ *                            memory.
  *
  * use <table_name>           Loads a previously saved
  *                            table into memory and sets
@@ -42,15 +47,27 @@
  *                            for subsequent commands.
  *                            Command fails if a table
  *                            with <table_name> does not
- *                            exist. If used when another
- *                            table is already set as
- *                            current table, that table is
- *                            saved before switching to the
- *                            table specified.
+ *                            exist. Tables used earlier
+ *                            stay open in memory, so
+ *                            switching back to them does
+ *                            not reload them from disk.
+ *                            Updated tables are saved when
+ *                            closed to stay within the
+ *                            cache memory budget.
  *
  * save                       Saves current table to disk.
  *
- * lstbls                     Prints list of all saved tables.
+ * bgsave                     Saves a snapshot of current table
+ *                            to disk in a background process.
+ *                            Commands can be used while the
+ *                            snapshot is written. Completion,
+ *                            duration, and bytes written are
+ *                            reported when the save finishes.
+ *
+ * lstbls [-l]                Prints list of all saved tables.
+ *                            With -l, also prints engine, number
+ *                            of entries, disk size, and time of
+ *                            last save of each table.
  *
  * drop <table_name>          Drops table by deleting file
  *                            associated with <table_name> and
@@ -73,13 +90,88 @@
  * del <key>                  Deletes <key> <val> pair from
  *                            current table.
  *
- * lsdata                     Lists all key-value pairs in current
- *                            table.
+ * lsdata [limit N]           Lists all key-value pairs in current
+ *   [cursor C]               table. With limit, lists at most N
+ *   [format plain|tsv|json]  pairs and prints the cursor of the
+ *                            next page if pairs are left; the
+ *                            page starts at cursor C (0 for the
+ *                            first). tsv prints key<TAB>val
+ *                            rows, json one document.
+ *
+ * durability [mode] [ms]     Sets when saves are flushed to
+ *                            disk. Modes: none, on-save
+ *                            (default), group. In group mode,
+ *                            saves are committed together every
+ *                            <ms> milliseconds. With no
+ *                            arguments, prints the current
+ *                            mode and save counters.
+ *
+ * cache [budget_mb]          Sets memory budget for open
+ *                            tables in megabytes. With no
+ *                            argument, prints cache hits,
+ *                            misses, evictions, and memory
+ *                            held by open tables.
+ *
+ * info                       Prints storage engine of current
+ *                            table and engine counters.
+ *
+ * import <table_name> <file> Adds key-value pairs from <file>
+ *   [csv|tsv|jsonl|binary]   to <table_name>, creating it if it
+ *                            does not exist, and sets it as
+ *                            current table. The format is taken
+ *                            from the file extension if not
+ *                            given. Malformed rows are reported
+ *                            and skipped. Can also be run as
+ *                            'pairdb import <table_name> <file>
+ *                            [format]' at the command line.
+ *
+ * export <table_name> <file> Writes all key-value pairs of
+ *   [csv|tsv|jsonl|binary]   <table_name> to <file> and sets
+ *   [sorted]                 <table_name> as current table.
+ *                            With sorted, pairs are written
+ *                            in key order. The format is
+ *                            taken from the file extension
+ *                            if not given. Can also be run
+ *                            as 'pairdb export <table_name>
+ *                            <file> [format] [sorted]' at
+ *                            the command line.
+ *
+ * begin                      Starts a transaction on current
+ *                            table. Adds and deletes that
+ *                            follow are held in the
+ *                            transaction: get and lsdata show
+ *                            them, but other clients do not
+ *                            see them until commit. Commands
+ *                            that change or save tables, such
+ *                            as use, save, and import, fail
+ *                            until the transaction ends.
+ *
+ * commit                     Applies all writes of the
+ *                            transaction to the table at once
+ *                            and saves the table, with one
+ *                            flush to disk for the whole
+ *                            transaction.
+ *
+ * abort                      Drops all writes of the
+ *                            transaction. quit and end of
+ *                            input also abort an open
+ *                            transaction.
+ *
+ * latency [reset|            Prints count, mean, and p50 to
+ *   slow [ms]|<command>]     max latency of each command run
+ *                            since start or the last reset.
+ *                            With a command word, prints its
+ *                            latency histogram. 'latency slow'
+ *                            prints the latest commands that
+ *                            took at least ms milliseconds (10
+ *                            by default, set with 'latency slow
+ *                            <ms>'), with any table load,
+ *                            resize, or save they caused.
  *
  * help                       Prints information on commands.
  *
  * quit                       Quit interactive program and save
- *                            current table to disk.
+ *                            all updated tables to disk.
  *
  * Any of the above commands can be placed in an input file with
  * one command per line (separated by the newline character). Use
@@ -97,41 +189,137 @@
  *   command line:
  *      pairdb < input.txt
  *
+ * When stdin is not a terminal, or with 'pairdb --batch',
+ * commands run in batch mode: no prompts are printed, end
+ * of input quits as quit does, and a summary of commands,
+ * errors, and elapsed time is printed to stderr. Exit
+ * status is 1 if any command failed.
+ *
+ * 'pairdb encode < input.txt > input.bin' writes the add,
+ * del, use, and newtbl commands of input.txt as a binary
+ * command stream (see binstream.h), and
+ * 'pairdb --binary < input.bin' runs a binary command
+ * stream in batch mode without parsing. A stream of add
+ * commands can also be imported with the binary format.
+ *
+ * 'pairdb hashstat <table_name>' or
+ * 'pairdb hashstat --keys <file>' reports how the keys
+ * spread over hash table buckets and compares hash
+ * functions and load factor limits (see hashstat.h).
+ *
+ * Single commands can also be run at the command line
+ * without the interactive program. Commands on the keys
+ * of a table take the table name first:
+ *
+ *      pairdb get <table_name> <key>
+ *      pairdb add <table_name> <key> <val>
+ *      pairdb del <table_name> <key>
+ *      pairdb lsdata <table_name> [limit N] ...
+ *      pairdb info <table_name>
+ *
+ * lstbls, newtbl, drop, import, and export take the same
+ * arguments as at the prompt. Exit status is 1 if a key
+ * is not found or already exists, and 2 on other errors.
+ *
+ * Pairdb can also run as a server that keeps tables open
+ * for many clients (see server.h):
+ *
+ *      pairdb serve [socket] [--resp <socket|port>]
+ *      pairdb -c [socket]
+ *
+ * 'pairdb -c' sends commands read from stdin to the server
+ * and prints the replies. The default socket is
+ * ~/pairdb-data/pairdb.sock. With --resp, the server also
+ * accepts Redis clients on a second Unix socket, or on a
+ * TCP port of the loopback address.
+ *
+ *      pairdb serve --resp <socket|port> --shards [N]
+ *
+ * serves Redis clients only, with the keys of each table
+ * split between N worker threads (see shard.h).
+ *
+ * 'serve --io blocking|uring' chooses how the server does
+ * socket and table file I/O (see uring.h). The default is
+ * uring when the kernel supports it.
+ *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "parse.h"
 #include "db_manager.h"
 #include "messages.h"
+#include "server.h"
+#include "uring.h"
+#include "shard.h"
+#include "client.h"
+#include "binstream.h"
+#include "pipeline.h"
+#include "txn.h"
+#include "hashstat.h"
+#include "hashtable.h"
+
+enum {
+    MAX_BAD_ROWS_SHOWN = 10,
+    BATCH_BLOCK = 1024 * 1024,  // Bytes of binary input read per read call
+    BATCH_OUTBUFF = 1024 * 1024 // Stdout buffer in batch mode
+};
 
+// Exit status of command line commands
 enum {
-    INBUFF_SIZE = 256
+    CLI_OK = 0,
+    CLI_NOT_FOUND = 1,
+    CLI_ERROR = 2
 };
 
 // Forward declarations
-void handle_lstables(db_mgr dbm);
-void handle_newtable(db_mgr dbm, struct parse_object *parse_ptr);
-void handle_usetable(db_mgr dbm, struct parse_object *parse_ptr);
-void handle_add(db_mgr dbm, struct parse_object *parse_ptr);
-void handle_get(db_mgr dbm, struct parse_object *parse_ptr);
-void handle_droptable(db_mgr dbm, struct parse_object *parse_ptr);
-void handle_lsdata(db_mgr dbm);
+void handle_lstables(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_newtable(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_usetable(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_add(db_mgr dbm, txn trans, struct parse_object *parse_ptr);
+int handle_get(db_mgr dbm, txn trans, struct parse_object *parse_ptr);
+int handle_droptable(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_lsdata(db_mgr dbm, txn trans, struct parse_object *parse_ptr);
+int handle_bgsave(db_mgr dbm);
+int handle_durability(db_mgr dbm, struct parse_object *parse_ptr);
+void handle_cache(db_mgr dbm, struct parse_object *parse_ptr);
+void handle_info(db_mgr dbm);
+int handle_latency(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_import(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_export(db_mgr dbm, struct parse_object *parse_ptr);
+int handle_begin(db_mgr dbm, txn *trans);
+int handle_commit(txn *trans);
+void abort_open_txn(txn *trans);
+int run_command_line(int argc, char *argv[]);
+int run_serve(int argc, char *argv[]);
+int run_input_cmd(db_mgr dbm, txn *trans, struct parse_object *parse_ptr);
+int run_batch(void);
+int run_binary(void);
+int run_encode(void);
+int run_hashstat(int argc, char *argv[]);
+void report_bgsave(db_mgr dbm, bool wait);
 
 /*
  * pairdb main execution loop
  *
  * Main initializes a parse object that reads from
- * an input buffer allocated on the stack. User
- * input is parsed - if the command is valid/well-formed,
- * a valid parse object is returned, and a switch
- * statement on the parse command is executed for
- * database operations. The input buffer on the stack
- * is cleared after each loop iteration to ensure
- * the parse function receives clean input.
+ * an input buffer filled by getline, which grows it to
+ * hold lines of any length. User input is parsed in
+ * place - if the command is valid/well-formed, a valid
+ * parse object is returned, and the command is run by
+ * run_input_cmd for database operations.
+ *
+ * When stdin is not a terminal, or with --batch, the
+ * commands are run by run_batch instead, without
+ * prompts.
  *
  * An initialized db manager object is used to create,
  * manipulate, save, and delete database tables.
@@ -140,15 +328,39 @@ void handle_lsdata(db_mgr dbm);
 
 int main(int argc, char *argv[])
 {
-    // Print program info if any command line
-    // argument is provided
+    // Run a single command given on the command
+    // line, or print program info if it is not
+    // a command line command
     if (argc > 1) {
-        printf("%s", long_help_msg());
-        exit(EXIT_FAILURE);
+        if (strcmp(argv[1], "serve") == 0) {
+            return run_serve(argc, argv);
+        }
+        if (strcmp(argv[1], "-c") == 0 && argc <= 3) {
+            return run_client(argc == 3 ? argv[2] : NULL);
+        }
+        if (strcmp(argv[1], "--batch") == 0 && argc == 2) {
+            return run_batch();
+        }
+        if (strcmp(argv[1], "--binary") == 0 && argc == 2) {
+            return run_binary();
+        }
+        if (strcmp(argv[1], "encode") == 0 && argc == 2) {
+            return run_encode();
+        }
+        if (strcmp(argv[1], "hashstat") == 0) {
+            return run_hashstat(argc, argv);
+        }
+        return run_command_line(argc, argv);
+    }
+
+    if (!isatty(STDIN_FILENO)) {
+        return run_batch();
     }
 
     struct parse_object parse_data = {0};
-    char inbuff[INBUFF_SIZE];
+    txn trans = NULL;
+    char *inbuff = NULL;
+    size_t inbuff_size = 0;
 
     db_mgr dbmgr = init_db_mgr();
     if (!dbmgr) {
@@ -159,97 +371,227 @@ int main(int argc, char *argv[])
 
     bool run_loop = true;
     while (run_loop) {
-        // clear input buffer
-        memset(inbuff, 0, INBUFF_SIZE);
+        report_bgsave(dbmgr, false);
 
         printf("pairdb>> ");
 
-        fgets(inbuff, INBUFF_SIZE, stdin);
-        parse_input(inbuff, &parse_data);
-
-        // Commands 'use <tbl_name>' or 'newtbl <tbl_name>'
-        // will set the table name that will be used until
-        // another 'use' or 'newtbl' command is received.
-        if ((parse_data.cmd == ADD ||
-            parse_data.cmd == GET ||
-            parse_data.cmd == DELETE ||
-            parse_data.cmd == SAVE ||
-            parse_data.cmd == LSDATA) &&
-            parse_data.tbl_name[0] == '\0') {
-                printf("No table selected: 'use <tbl_name>' or 'newtbl <tbl_name>'\n");
-                printf("Use 'lstbls' to see all tables\n");
-                continue;
-            }
+        // End of input quits
+        if (getline(&inbuff, &inbuff_size, stdin) < 0) {
+            char quit[] = "quit";
+            parse_input(quit, &parse_data);
+        }
+        else {
+            parse_input(inbuff, &parse_data);
+        }
 
-        switch (parse_data.cmd) {
+        run_loop = run_input_cmd(dbmgr, &trans, &parse_data) != 0;
+    }
+    free(inbuff);
+    destroy_db_mgr(dbmgr);
+}
+
+// Returns true if cmd changes or saves tables
+// and cannot be used in a transaction
+static bool ends_txn_first(enum CMD cmd)
+{
+    switch (cmd) {
+        case NEWTABLE:
+        case USETABLE:
+        case SAVE:
+        case BGSAVE:
+        case DROPTABLE:
+        case IMPORT:
+        case EXPORT:
+        case BEGIN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Runs command for run_input_cmd, which times it
+static int dispatch_input_cmd(db_mgr dbmgr, txn *trans, struct parse_object *parse_ptr)
+{
+    if ((parse_ptr->cmd == ADD ||
+        parse_ptr->cmd == GET ||
+        parse_ptr->cmd == DELETE ||
+        parse_ptr->cmd == SAVE ||
+        parse_ptr->cmd == BGSAVE ||
+        parse_ptr->cmd == LSDATA ||
+        parse_ptr->cmd == INFO ||
+        parse_ptr->cmd == BEGIN) &&
+        parse_ptr->tbl_name[0] == '\0') {
+            printf("No table selected: 'use <tbl_name>' or 'newtbl <tbl_name>'\n");
+            printf("Use 'lstbls' to see all tables\n");
+            return -1;
+        }
 
-            case FAIL:
+    if (*trans && ends_txn_first(parse_ptr->cmd)) {
+        printf("Transaction in progress: 'commit' or 'abort' first\n");
+        return -1;
+    }
+
+    switch (parse_ptr->cmd) {
+
+        case FAIL:
+            if (parse_ptr->error) {
+                printf("%s\n", parse_ptr->error);
+            }
+            else {
                 printf("%s", short_help_msg());
-                break;
+            }
+            return -1;
 
-            case LSTABLES:
-                handle_lstables(dbmgr);
-                break;
+        case LSTABLES:
+            handle_lstables(dbmgr, parse_ptr);
+            return 1;
 
-            case NEWTABLE:
-                if (has_curr_tbl(dbmgr)) {
-                    save_curr_tbl(dbmgr);
-                }
-                handle_newtable(dbmgr, &parse_data);
-                break;
+        case NEWTABLE:
+            return handle_newtable(dbmgr, parse_ptr);
 
-            case USETABLE:
-                if (has_curr_tbl(dbmgr)) {
-                    save_curr_tbl(dbmgr);
-                }
-                handle_usetable(dbmgr, &parse_data);
-                break;
+        case USETABLE:
+            return handle_usetable(dbmgr, parse_ptr);
 
-            case ADD:
-                handle_add(dbmgr, &parse_data);
-                break;
+        case ADD:
+            return handle_add(dbmgr, *trans, parse_ptr);
 
-            case GET:
-                handle_get(dbmgr, &parse_data);
-                break;
+        case GET:
+            return handle_get(dbmgr, *trans, parse_ptr);
 
-            case DELETE:
-                db_remove(dbmgr, parse_data.key);
-                break;
+        case DELETE:
+            if (*trans) {
+                txn_remove(*trans, parse_ptr->key);
+            }
+            else {
+                db_remove(dbmgr, parse_ptr->key);
+            }
+            return 1;
 
-            case SAVE:
-                if (has_curr_tbl(dbmgr)) {
-                    save_curr_tbl(dbmgr);
-                }
-                break;
+        case SAVE:
+            if (has_curr_tbl(dbmgr) && save_curr_tbl(dbmgr) < 0) {
+                printf("Save failed\n");
+                return -1;
+            }
+            return 1;
 
-            case DROPTABLE:
-                handle_droptable(dbmgr, &parse_data);
-                break;
+        case BGSAVE:
+            return handle_bgsave(dbmgr);
 
-            case LSDATA:
-                handle_lsdata(dbmgr);
-                break;
+        case DROPTABLE:
+            return handle_droptable(dbmgr, parse_ptr);
 
-            case HELP:
-                printf("%s", long_help_msg());
-                break;
+        case LSDATA:
+            return handle_lsdata(dbmgr, *trans, parse_ptr);
 
-            case QUIT:
-                if (has_curr_tbl(dbmgr)) {
-                    save_curr_tbl(dbmgr);
-                }
-                run_loop = false;
-                break;
-        }
+        case HELP:
+            printf("%s", long_help_msg());
+            return 1;
+
+        case DURABILITY:
+            return handle_durability(dbmgr, parse_ptr);
+
+        case CACHE:
+            handle_cache(dbmgr, parse_ptr);
+            return 1;
+
+        case INFO:
+            handle_info(dbmgr);
+            return 1;
+
+        case IMPORT:
+            return handle_import(dbmgr, parse_ptr);
+
+        case EXPORT:
+            return handle_export(dbmgr, parse_ptr);
+
+        case BEGIN:
+            return handle_begin(dbmgr, trans);
+
+        case COMMIT:
+            return handle_commit(trans);
+
+        case ABORT:
+            if (!*trans) {
+                printf("No transaction in progress\n");
+                return -1;
+            }
+            txn_abort(*trans);
+            *trans = NULL;
+            return 1;
+
+        case LATENCY:
+            return handle_latency(dbmgr, parse_ptr);
+
+        case QUIT:
+            abort_open_txn(trans);
+            save_all_tbls(dbmgr);
+            report_bgsave(dbmgr, true);
+            return 0;
     }
-    destroy_db_mgr(dbmgr);
+    return -1;
+}
+
+// Runs command parsed from a line of input at the
+// prompt or in batch mode. Commands 'use <tbl_name>'
+// or 'newtbl <tbl_name>' set the table name in
+// parse_ptr that will be used until another 'use' or
+// 'newtbl' command is received. trans holds the open
+// transaction, NULL if there is none. The time the
+// command takes is recorded in the latency histograms
+// of dbmgr, except for invalid and latency commands.
+// Returns 0 after quit, -1 if the command failed,
+// 1 otherwise.
+int run_input_cmd(db_mgr dbmgr, txn *trans, struct parse_object *parse_ptr)
+{
+    if (parse_ptr->cmd == FAIL || parse_ptr->cmd == LATENCY) {
+        return dispatch_input_cmd(dbmgr, trans, parse_ptr);
+    }
+
+    struct timespec start;
+    start_cmd_latency(dbmgr, &start);
+    int result = dispatch_input_cmd(dbmgr, trans, parse_ptr);
+    record_cmd_latency(dbmgr, parse_ptr->cmd, &start, parse_ptr->tbl_name,
+                       parse_ptr->key[0] != '\0' ? parse_ptr->key : parse_ptr->path);
+    return result;
 }
 
 
 
-void handle_lstables(db_mgr dbm)
+// Prints one line of lstbls -l
+static int print_tbl_entry(const struct cat_entry *entry, void *arg)
 {
+    (void) arg;
+
+    char entries[24] = "-";
+    if (entry->entries != CAT_ENTRIES_UNKNOWN) {
+        snprintf(entries, sizeof(entries), "%" PRIu64, entry->entries);
+    }
+
+    char saved[32] = "-";
+    time_t mtime = (time_t) entry->mtime;
+    struct tm tm;
+    if (entry->mtime > 0 && localtime_r(&mtime, &tm)) {
+        strftime(saved, sizeof(saved), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+
+    printf("%-*s %-8s %12s %12" PRIu64 "  %s\n", TBL_NAME_MAX - 2, entry->name,
+           entry->engine, entries, entry->bytes, saved);
+    return 0;
+}
+
+void handle_lstables(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    if (strcmp(parse_ptr->opt, "-l") == 0) {
+        printf("%-*s %-8s %12s %12s  %s\n", TBL_NAME_MAX - 2, "table",
+               "engine", "entries", "bytes", "saved");
+        list_tbls(dbm, print_tbl_entry, NULL);
+        return;
+    }
+    else if (parse_ptr->opt[0] != '\0') {
+        printf("%s", short_help_msg());
+        return;
+    }
+
     size_t numtbls = get_numtbls(dbm);
     char **tbls = get_tbls(dbm);
     for (size_t i = 0; i < numtbls; i++) {
@@ -258,57 +600,76 @@ void handle_lstables(db_mgr dbm)
     free(tbls);
 }
 
-void handle_newtable(db_mgr dbm, struct parse_object *parse_ptr)
+// Handlers of commands that can fail return
+// 1 on success, -1 on failure
+
+int handle_newtable(db_mgr dbm, struct parse_object *parse_ptr)
 {
-    int newtbl_stat = get_new_tbl(dbm, parse_ptr->tbl_name);
+    const char *engine = parse_ptr->opt[0] ? parse_ptr->opt : NULL;
+    int newtbl_stat = get_new_tbl(dbm, parse_ptr->tbl_name, engine);
     if (newtbl_stat == -1) {
         printf("Table already exists\n");
         // Reset table name field in parse_object
         parse_ptr->tbl_name[0] = '\0';
+        return -1;
+    }
+    else if (newtbl_stat == -3) {
+        printf("Unknown table engine\n");
+        parse_ptr->tbl_name[0] = '\0';
+        return -1;
     }
     else if (newtbl_stat == -2) {
         fprintf(stderr, "Memory allocation error\n");
         exit(EXIT_FAILURE);
     }
+    return 1;
 }
 
-void handle_usetable(db_mgr dbm, struct parse_object *parse_ptr)
+int handle_usetable(db_mgr dbm, struct parse_object *parse_ptr)
 {
     int usetbl_stat = use_tbl(dbm, parse_ptr->tbl_name);
     if (usetbl_stat == -1) {
         printf("Table does not exist\n");
         // Reset table name field in parse_object
         parse_ptr->tbl_name[0] = '\0';
+        return -1;
     }
     else if (usetbl_stat == -2) {
         fprintf(stderr, "Memory allocation error\n");
         exit(EXIT_FAILURE);
     }
+    return 1;
 }
 
-void handle_add(db_mgr dbm, struct parse_object *parse_ptr)
+int handle_add(db_mgr dbm, txn trans, struct parse_object *parse_ptr)
 {
-    int result = add(dbm, parse_ptr->key, parse_ptr->val);
+    int result = trans ? txn_add(trans, parse_ptr->key, parse_ptr->val) :
+                         add(dbm, parse_ptr->key, parse_ptr->val);
     if (result == -1) {
         printf("Key %s already exists\n", parse_ptr->key);
+        return -1;
     }
     else if (result == -2) {
         printf("Memory allocation error\n");
+        return -1;
     }
+    return 1;
 }
 
-void handle_get(db_mgr dbm, struct parse_object *parse_ptr)
+int handle_get(db_mgr dbm, txn trans, struct parse_object *parse_ptr)
 {
     char buff[VAL_MAX];
-    if (get(buff, VAL_MAX, dbm, parse_ptr->key) == 0) {
+    size_t len = trans ? txn_get(buff, VAL_MAX, trans, parse_ptr->key) :
+                         get(buff, VAL_MAX, dbm, parse_ptr->key);
+    if (len == 0) {
         printf("Value not found\n");
+        return -1;
     }
-    else {
-        printf("%s\n", buff);
-    }
+    printf("%s\n", buff);
+    return 1;
 }
 
-void handle_droptable(db_mgr dbm, struct parse_object *parse_ptr)
+int handle_droptable(db_mgr dbm, struct parse_object *parse_ptr)
 {
     int drop_stat = drop_tbl(dbm, parse_ptr->tbl_name);
     if (drop_stat == -1) {
@@ -322,19 +683,1219 @@ void handle_droptable(db_mgr dbm, struct parse_object *parse_ptr)
     if (!has_curr_tbl(dbm)) {
         parse_ptr->tbl_name[0] = '\0';
     }
+    return drop_stat < 0 ? -1 : 1;
 }
 
-void handle_lsdata(db_mgr dbm)
+// Output formats of lsdata
+enum lsdata_format {
+    LS_UNKNOWN,
+    LS_PLAIN,
+    LS_TSV,
+    LS_JSON
+};
+
+enum {
+    LSDATA_BUFF = 1 << 20   // Size of lsdata output buffer
+};
+
+// State of lsdata listing. Rows are formatted
+// into buff, which is written to stdout with one
+// fwrite when it is too full for another row.
+struct lister {
+    enum lsdata_format fmt;
+    char *buff;
+    size_t used;
+    size_t rows;
+    size_t limit;       // Rows to list, 0 for all
+    size_t skipped;     // tsv pairs holding tab or newline
+};
+
+static enum lsdata_format find_lsdata_format(const char *name)
 {
-    printf("KEY\t\t\t-\tVAL\n");
-    printf("--------------------------------------\n");
-    size_t numentries = get_num_tbl_entries(dbm);
-    char **keys = get_tbl_keys(dbm);
-    char **vals = get_tbl_vals(dbm);
-    for (size_t i = 0; i < numentries; i++) {
-        printf("%s\t\t\t-\t%s\n", keys[i], vals[i]);
+    if (name[0] == '\0' || strcmp(name, "plain") == 0) {
+        return LS_PLAIN;
+    }
+    if (strcmp(name, "tsv") == 0) {
+        return LS_TSV;
+    }
+    if (strcmp(name, "json") == 0) {
+        return LS_JSON;
+    }
+    return LS_UNKNOWN;
+}
+
+static void flush_lister(struct lister *ls)
+{
+    fwrite(ls->buff, 1, ls->used, stdout);
+    ls->used = 0;
+}
+
+// Appends one pair to lsdata output.
+// Returns nonzero when limit is reached.
+static int list_pair(const char *key, const char *val, void *arg)
+{
+    struct lister *ls = arg;
+    if (LSDATA_BUFF - ls->used < BULK_ROW_MAX + 8) {
+        flush_lister(ls);
+    }
+
+    char *out = ls->buff + ls->used;
+    if (ls->fmt == LS_PLAIN) {
+        out += sprintf(out, "%s\t\t\t-\t%s\n", key, val);
+    }
+    else if (ls->fmt == LS_TSV) {
+        out = bulk_encode_row(out, BULK_TSV, key, val);
+        if (!out) {
+            ls->skipped++;
+            return 0;
+        }
+    }
+    else {
+        // Objects of json array are separated
+        // by a comma before every one but the first
+        if (ls->rows > 0) {
+            *out++ = ',';
+            *out++ = '\n';
+        }
+        out = bulk_encode_row(out, BULK_JSONL, key, val) - 1;
+    }
+    ls->used = out - ls->buff;
+    ls->rows++;
+    return ls->limit > 0 && ls->rows == ls->limit;
+}
+
+// Lists pairs of current table, or of the table
+// as seen by an open transaction, from cursor of
+// parse_ptr. The position of the next page is
+// printed if rows are left after limit.
+// Returns 1 on success, -1 on error.
+int handle_lsdata(db_mgr dbm, txn trans, struct parse_object *parse_ptr)
+{
+    struct lister ls = {0};
+    ls.fmt = find_lsdata_format(parse_ptr->opt);
+    ls.limit = parse_ptr->num;
+    if (ls.fmt == LS_UNKNOWN) {
+        printf("Unknown lsdata format\n");
+        return -1;
+    }
+    if (trans && (parse_ptr->num > 0 || parse_ptr->cursor > 0)) {
+        printf("limit and cursor are not available in a transaction\n");
+        return -1;
+    }
+
+    ls.buff = malloc(LSDATA_BUFF);
+    if (!ls.buff) {
+        printf("Memory allocation error\n");
+        return -1;
+    }
+    if (ls.fmt == LS_PLAIN) {
+        ls.used = sprintf(ls.buff, "KEY\t\t\t-\tVAL\n"
+                                   "--------------------------------------\n");
+    }
+    else if (ls.fmt == LS_JSON) {
+        ls.used = sprintf(ls.buff, "{\"pairs\":[\n");
+    }
+
+    size_t cursor = parse_ptr->cursor;
+    int result;
+    if (trans) {
+        result = txn_iterate(trans, list_pair, &ls);
+    }
+    else {
+        result = scan_tbl(dbm, &cursor, list_pair, &ls);
+    }
+
+    char *out = ls.buff + ls.used;
+    if (ls.fmt == LS_PLAIN && cursor > 0) {
+        out += sprintf(out, "Next cursor: %zu\n", cursor);
+    }
+    else if (ls.fmt == LS_JSON) {
+        out += sprintf(out, "%s],\"cursor\":%zu}\n", ls.rows > 0 ? "\n" : "", cursor);
+    }
+    ls.used = out - ls.buff;
+    flush_lister(&ls);
+    fflush(stdout);
+    free(ls.buff);
+
+    // tsv output holds only rows, so that it
+    // can be read back with import
+    if (ls.fmt == LS_TSV && cursor > 0) {
+        fprintf(stderr, "Next cursor: %zu\n", cursor);
+    }
+    if (ls.skipped > 0) {
+        fprintf(stderr, "%zu pairs skipped: tab or newline in tsv field\n", ls.skipped);
+    }
+    return result < 0 ? -1 : 1;
+}
+
+int handle_bgsave(db_mgr dbm)
+{
+    int result = bgsave_curr_tbl(dbm);
+    if (result == 1) {
+        printf("Background save started\n");
+    }
+    else if (result == 0) {
+        printf("No changes to save\n");
+    }
+    else if (result == -2) {
+        printf("Background save already in progress\n");
+    }
+    else {
+        printf("Background save failed to start\n");
+    }
+    return result < 0 ? -1 : 1;
+}
+
+// Print result of finished background save, if any.
+// If wait is true, waits for a running save to finish.
+void report_bgsave(db_mgr dbm, bool wait)
+{
+    struct bgsave_info info;
+    if (poll_bgsave(dbm, &info, wait) != 1) {
+        return;
+    }
+
+    if (info.success) {
+        printf("Background save of %s completed: %zu bytes in %.3f ms\n",
+               info.tbl_name, info.bytes, info.msecs);
+    }
+    else {
+        printf("Background save of %s failed\n", info.tbl_name);
+    }
+}
+
+int handle_durability(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    struct durability_stats stats;
+    get_durability_stats(dbm, &stats);
+
+    // No mode given - print mode and counters
+    if (parse_ptr->opt[0] == '\0') {
+        printf("mode: %s", durability_name(stats.mode));
+        if (stats.mode == DUR_GROUP) {
+            printf(" (%u ms)", stats.group_ms);
+        }
+        printf("\n");
+        printf("saves: %zu\n", stats.saves);
+        printf("bytes written: %zu\n", stats.bytes);
+        printf("fsyncs: %zu\n", stats.fsyncs);
+        printf("group commits: %zu\n", stats.group_commits);
+        printf("avg save time: %.3f ms\n",
+               stats.saves ? stats.save_msecs / stats.saves : 0.0);
+        printf("io: %s\n", io_backend_name(stats.io));
+        printf("io calls: %zu\n", stats.io_calls);
+        return 1;
+    }
+
+    enum durability mode;
+    if (find_durability(parse_ptr->opt, &mode) < 0) {
+        printf("Unknown durability mode: none, on-save, group\n");
+        return -1;
+    }
+
+    unsigned int group_ms = parse_ptr->num > 0 ?
+                            (unsigned int) parse_ptr->num : stats.group_ms;
+    if (set_durability(dbm, mode, group_ms) < 0) {
+        printf("Could not set durability mode\n");
+        return -1;
+    }
+    return 1;
+}
+
+void handle_cache(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    // Budget given - set budget in megabytes
+    if (parse_ptr->opt[0] != '\0') {
+        set_cache_budget(dbm, (size_t) parse_ptr->num * 1024 * 1024);
+        return;
+    }
+
+    struct cache_stats stats;
+    get_cache_stats(dbm, &stats);
+    printf("hits: %zu\n", stats.hits);
+    printf("misses: %zu\n", stats.misses);
+    printf("evictions: %zu\n", stats.evictions);
+    printf("open tables: %zu\n", stats.open_tbls);
+    printf("resident: %zu bytes\n", stats.resident);
+    printf("budget: %zu bytes\n", stats.budget);
+}
+
+void handle_info(db_mgr dbm)
+{
+    struct tbl_info info;
+    if (get_tbl_info(dbm, &info) < 0) {
+        return;
+    }
+
+    printf("engine: %s\n", info.engine);
+    for (size_t i = 0; i < info.numstats; i++) {
+        printf("%s: %zu\n", info.stats[i].name, info.stats[i].value);
+    }
+}
+
+// Prints latency summary line of every command
+// kind that has been timed
+static void print_latency_summary(latency lat)
+{
+    bool any = false;
+    for (int cmd = LSTABLES; cmd <= QUIT; cmd++) {
+        struct lat_summary sum;
+        latency_summary(lat, cmd, &sum);
+        if (sum.count == 0) {
+            continue;
+        }
+        if (!any) {
+            printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n", "command", "count",
+                   "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+            any = true;
+        }
+        printf("%-10s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               cmd_name(cmd), sum.count, sum.total_ns / 1e3 / sum.count,
+               sum.p50_ns / 1e3, sum.p90_ns / 1e3, sum.p99_ns / 1e3,
+               sum.p999_ns / 1e3, sum.max_ns / 1e3);
+    }
+    if (!any) {
+        printf("No commands timed\n");
+    }
+}
+
+// Prints latency histogram of command kind cmd,
+// one line per power of 2 of nanoseconds
+static void print_latency_hist(latency lat, enum CMD cmd)
+{
+    struct lat_summary sum;
+    latency_summary(lat, cmd, &sum);
+    if (sum.count == 0) {
+        printf("No %s commands timed\n", cmd_name(cmd));
+        return;
+    }
+    printf("%s: %" PRIu64 " commands, mean %.1f us, p50 %.1f us, p99 %.1f us, "
+           "max %.1f us\n", cmd_name(cmd), sum.count, sum.total_ns / 1e3 / sum.count,
+           sum.p50_ns / 1e3, sum.p99_ns / 1e3, sum.max_ns / 1e3);
+
+    for (size_t group = 0; group < LAT_BUCKETS; group += LAT_SUB_BUCKETS) {
+        uint64_t count = 0;
+        uint64_t low = 0;
+        uint64_t high = 0;
+        uint64_t unused;
+        for (size_t b = group; b < group + LAT_SUB_BUCKETS; b++) {
+            count += latency_bucket(lat, cmd, b, b == group ? &low : &unused, &high);
+        }
+        if (count == 0) {
+            continue;
+        }
+        double pct = 100.0 * count / sum.count;
+        char bar[51];
+        size_t len = (size_t) (pct / 2);
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        printf("%12" PRIu64 " - %-12" PRIu64 " ns %10" PRIu64 " %6.2f%% %s\n",
+               low, high, count, pct, bar);
     }
-    free(keys);
-    free(vals);
 }
 
+// Prints one slow log entry
+static int print_slow_entry(const struct lat_slow *entry, void *arg)
+{
+    (void) arg;
+
+    char when[32] = "-";
+    struct tm tm;
+    if (localtime_r(&entry->when, &tm)) {
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+    char events[64];
+    format_db_events(entry->events, events, sizeof(events));
+
+    printf("%s  %-8s %10.3f ms  %-12s %-16s %s\n", when, cmd_name(entry->cmd),
+           entry->ns / 1e6, entry->tbl_name[0] ? entry->tbl_name : "-",
+           entry->arg[0] ? entry->arg : "-", events);
+    return 0;
+}
+
+// latency                  - summary of every command
+// latency <command>        - histogram of one command
+// latency slow [ms]        - slow log, or set its threshold
+// latency reset            - clear histograms and slow log
+int handle_latency(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    latency lat = get_latency(dbm);
+    const char *opt = parse_ptr->opt;
+    bool ms_given = parse_ptr->key[0] != '\0';
+
+    if (opt[0] == '\0') {
+        print_latency_summary(lat);
+        return 1;
+    }
+    if (strcmp(opt, "slow") == 0) {
+        if (ms_given) {
+            latency_set_slow_ms(lat, (unsigned int) parse_ptr->num);
+            return 1;
+        }
+        printf("Commands taking at least %u ms, newest first:\n", latency_slow_ms(lat));
+        latency_slowlog(lat, print_slow_entry, NULL);
+        return 1;
+    }
+    if (ms_given) {
+        printf("%s", short_help_msg());
+        return -1;
+    }
+    if (strcmp(opt, "reset") == 0) {
+        latency_reset(lat);
+        return 1;
+    }
+    for (int cmd = LSTABLES; cmd <= QUIT; cmd++) {
+        if (strcmp(opt, cmd_name(cmd)) == 0) {
+            print_latency_hist(lat, cmd);
+            return 1;
+        }
+    }
+    printf("Unknown command: %s\n", opt);
+    return -1;
+}
+
+// Prints first MAX_BAD_ROWS_SHOWN malformed rows
+static void print_bad_row(void *arg, size_t lineno, const char *reason)
+{
+    size_t *shown = arg;
+    if (*shown < MAX_BAD_ROWS_SHOWN) {
+        printf("line %zu: %s\n", lineno, reason);
+    }
+    (*shown)++;
+}
+
+// Returns 1 on success, -1 on failure
+int handle_import(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    enum bulk_format fmt = find_bulk_format(parse_ptr->opt, parse_ptr->path);
+    if (fmt == BULK_UNKNOWN || access(parse_ptr->path, R_OK) < 0) {
+        if (fmt == BULK_UNKNOWN) {
+            printf("Unknown import format\n");
+        }
+        else {
+            printf("Cannot read file %s\n", parse_ptr->path);
+        }
+        // Current table is unchanged
+        if (!has_curr_tbl(dbm)) {
+            parse_ptr->tbl_name[0] = '\0';
+        }
+        return -1;
+    }
+
+    // Import creates the table if it does not exist
+    int tbl_stat = use_tbl(dbm, parse_ptr->tbl_name);
+    if (tbl_stat == -1) {
+        tbl_stat = get_new_tbl(dbm, parse_ptr->tbl_name, NULL);
+    }
+    if (tbl_stat == -2) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t shown = 0;
+    struct import_stats stats;
+    int import_stat = import_tbl(dbm, parse_ptr->path, fmt, &stats,
+                                 print_bad_row, &shown);
+    if (import_stat == -1) {
+        printf("Cannot read file %s\n", parse_ptr->path);
+        return -1;
+    }
+    if (import_stat == -2) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Imported %zu of %zu rows in %.2f s (%.0f rows/s)\n",
+           stats.added, stats.rows, stats.secs,
+           stats.secs > 0 ? stats.rows / stats.secs : 0.0);
+    if (stats.duplicates > 0) {
+        printf("%zu rows skipped: key already exists\n", stats.duplicates);
+    }
+    if (stats.malformed > MAX_BAD_ROWS_SHOWN) {
+        printf("%zu malformed rows skipped (first %d shown)\n",
+               stats.malformed, MAX_BAD_ROWS_SHOWN);
+    }
+    else if (stats.malformed > 0) {
+        printf("%zu malformed rows skipped\n", stats.malformed);
+    }
+    return 1;
+}
+
+// Returns 1 on success, -1 on failure
+int handle_export(db_mgr dbm, struct parse_object *parse_ptr)
+{
+    enum bulk_format fmt = find_bulk_format(parse_ptr->opt, parse_ptr->path);
+    if (fmt == BULK_UNKNOWN) {
+        printf("Unknown export format\n");
+        if (!has_curr_tbl(dbm)) {
+            parse_ptr->tbl_name[0] = '\0';
+        }
+        return -1;
+    }
+
+    if (handle_usetable(dbm, parse_ptr) < 0) {
+        return -1;
+    }
+
+    struct export_stats stats;
+    if (export_tbl(dbm, parse_ptr->path, fmt, parse_ptr->num == 1, &stats) < 0) {
+        printf("Cannot write file %s\n", parse_ptr->path);
+        return -1;
+    }
+
+    double mbytes = stats.bytes / (1024.0 * 1024.0);
+    printf("Exported %zu rows (%.1f MB) in %.2f s (%.1f MB/s)\n",
+           stats.rows, mbytes, stats.secs,
+           stats.secs > 0 ? mbytes / stats.secs : 0.0);
+    if (stats.skipped > 0) {
+        printf("%zu rows skipped: tab or newline in tsv field\n", stats.skipped);
+    }
+    return 1;
+}
+
+int handle_begin(db_mgr dbm, txn *trans)
+{
+    *trans = txn_begin(dbm);
+    if (!*trans) {
+        printf("Memory allocation error\n");
+        return -1;
+    }
+    return 1;
+}
+
+int handle_commit(txn *trans)
+{
+    if (!*trans) {
+        printf("No transaction in progress\n");
+        return -1;
+    }
+
+    int result = txn_commit(*trans);
+    *trans = NULL;
+    if (result == -1) {
+        printf("Transaction aborted: a key it adds was added since it began\n");
+    }
+    else if (result == -2) {
+        printf("Memory allocation error - transaction aborted\n");
+    }
+    else if (result == -3) {
+        printf("Save failed\n");
+    }
+    return result < 0 ? -1 : 1;
+}
+
+// Abort transaction left open at quit
+// or end of input
+void abort_open_txn(txn *trans)
+{
+    if (*trans) {
+        printf("Transaction aborted: not committed\n");
+        txn_abort(*trans);
+        *trans = NULL;
+    }
+}
+
+// Prints message for error status of use_tbl,
+// lookup_tbl, or update_tbl to stderr
+static void print_tbl_error(int status)
+{
+    if (status == -1) {
+        fprintf(stderr, "Table does not exist\n");
+    }
+    else if (status == -2) {
+        fprintf(stderr, "Table read or write error\n");
+    }
+}
+
+// Runs one command on a table given as command
+// line arguments, without loading the table if
+// its engine can read or update single keys on
+// disk. Returns exit status.
+static int run_tbl_command(db_mgr dbm, char *tblname, struct parse_object *parse_ptr)
+{
+    char buff[VAL_MAX];
+    int status;
+    switch (parse_ptr->cmd) {
+        case GET:
+            status = lookup_tbl(dbm, tblname, parse_ptr->key, buff, VAL_MAX);
+            if (status == 1) {
+                printf("%s\n", buff);
+                return CLI_OK;
+            }
+            if (status == 0) {
+                fprintf(stderr, "Value not found\n");
+                return CLI_NOT_FOUND;
+            }
+            break;
+
+        case ADD:
+        case DELETE:
+            status = update_tbl(dbm, tblname, parse_ptr->key,
+                                parse_ptr->cmd == ADD ? parse_ptr->val : NULL);
+            if (status == 1) {
+                return CLI_OK;
+            }
+            if (status == 0) {
+                fprintf(stderr, "Key %s not found\n", parse_ptr->key);
+                return CLI_NOT_FOUND;
+            }
+            if (status == -3) {
+                fprintf(stderr, "Key %s already exists\n", parse_ptr->key);
+                return CLI_NOT_FOUND;
+            }
+            break;
+
+        default:
+            status = use_tbl(dbm, tblname);
+            if (status < 0) {
+                break;
+            }
+            if (parse_ptr->cmd == LSDATA) {
+                return handle_lsdata(dbm, NULL, parse_ptr) < 0 ? CLI_ERROR : CLI_OK;
+            }
+            handle_info(dbm);
+            return CLI_OK;
+    }
+
+    print_tbl_error(status);
+    return CLI_ERROR;
+}
+
+// Runs one command given as command line arguments.
+// Commands on a table take the table name as their
+// first argument:
+//      pairdb get <table_name> <key>
+//      pairdb add <table_name> <key> <val>
+//      pairdb del <table_name> <key>
+//      pairdb lsdata <table_name> [limit N] ...
+//      pairdb info <table_name>
+// Commands on tables:
+//      pairdb lstbls [-l]
+//      pairdb newtbl <table_name> [engine]
+//      pairdb drop <table_name>
+//      pairdb import <table_name> <file> [format]
+//      pairdb export <table_name> <file> [format] [sorted]
+// Arguments are parsed as a command typed at the
+// prompt, but without its quoting rules. Changes
+// are saved before returning. Prints program info
+// if arguments are not a command line command.
+// Returns exit status: CLI_NOT_FOUND if a key is
+// not found or already exists, CLI_ERROR on any
+// other failure.
+int run_command_line(int argc, char *argv[])
+{
+    struct parse_object parse_data = {0};
+    char *tblname = NULL;
+
+    const char *tbl_cmds[] = {"get", "add", "del", "lsdata", "info"};
+    for (size_t i = 0; i < sizeof(tbl_cmds) / sizeof(tbl_cmds[0]); i++) {
+        if (argc > 2 && strcmp(argv[1], tbl_cmds[i]) == 0) {
+            // Drop table name from the arguments parsed
+            tblname = argv[2];
+            argv[2] = argv[1];
+            argv++;
+            argc--;
+            break;
+        }
+    }
+    parse_argv(argc - 1, argv + 1, &parse_data);
+
+    if (parse_data.cmd == HELP) {
+        printf("%s", long_help_msg());
+        return CLI_OK;
+    }
+    bool valid;
+    switch (parse_data.cmd) {
+        case GET:
+        case ADD:
+        case DELETE:
+        case LSDATA:
+        case INFO:
+            valid = tblname != NULL;
+            break;
+        case LSTABLES:
+        case NEWTABLE:
+        case DROPTABLE:
+        case IMPORT:
+        case EXPORT:
+            valid = true;
+            break;
+        default:
+            valid = false;
+            break;
+    }
+    if (!valid) {
+        if (parse_data.error) {
+            fprintf(stderr, "%s\n", parse_data.error);
+        }
+        else {
+            printf("%s", long_help_msg());
+        }
+        return CLI_ERROR;
+    }
+
+    db_mgr dbmgr = init_db_mgr();
+    if (!dbmgr) {
+        return CLI_ERROR;
+    }
+
+    int status = CLI_OK;
+    switch (parse_data.cmd) {
+        case LSTABLES:
+            handle_lstables(dbmgr, &parse_data);
+            break;
+
+        case NEWTABLE:
+            handle_newtable(dbmgr, &parse_data);
+            if (parse_data.tbl_name[0] == '\0' || save_curr_tbl(dbmgr) < 0) {
+                status = CLI_ERROR;
+            }
+            break;
+
+        case DROPTABLE:
+            if (drop_tbl(dbmgr, parse_data.tbl_name) < 0) {
+                fprintf(stderr, "Table does not exist\n");
+                status = CLI_ERROR;
+            }
+            break;
+
+        case IMPORT:
+            if (handle_import(dbmgr, &parse_data) < 0) {
+                status = CLI_ERROR;
+            }
+            else if (save_curr_tbl(dbmgr) < 0) {
+                fprintf(stderr, "Table save failed\n");
+                status = CLI_ERROR;
+            }
+            break;
+
+        case EXPORT:
+            if (handle_export(dbmgr, &parse_data) < 0) {
+                status = CLI_ERROR;
+            }
+            break;
+
+        default:
+            status = run_tbl_command(dbmgr, tblname, &parse_data);
+            break;
+    }
+
+    destroy_db_mgr(dbmgr);
+    return status;
+}
+
+// Runs 'pairdb serve [socket] [--resp <socket|port>]'
+// or 'pairdb serve --resp <socket|port> --shards [N]',
+// either with [--io blocking|uring].
+// Returns exit status.
+int run_serve(int argc, char *argv[])
+{
+    const char *path = NULL;
+    const char *resp_addr = NULL;
+    bool sharded = false;
+    unsigned nshards = 0;
+    bool io_set = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--resp") == 0 && i + 1 < argc && !resp_addr) {
+            resp_addr = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shards") == 0 && !sharded) {
+            sharded = true;
+            // Shard count is optional
+            if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+                char *end;
+                unsigned long n = strtoul(argv[++i], &end, 10);
+                if (*end != '\0' || n == 0 || n > MAX_SHARDS) {
+                    fprintf(stderr, "Shard count must be 1 to %d\n", MAX_SHARDS);
+                    return CLI_ERROR;
+                }
+                nshards = (unsigned) n;
+            }
+        }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc && !io_set) {
+            io_set = true;
+            enum io_backend io;
+            if (find_io_backend(argv[++i], &io) < 0) {
+                fprintf(stderr, "I/O backend must be blocking or uring\n");
+                return CLI_ERROR;
+            }
+            if (set_io_backend(io) < 0) {
+                fprintf(stderr, "io_uring is not supported on this system\n");
+                return CLI_ERROR;
+            }
+        }
+        else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: pairdb serve [socket] [--resp <socket|port>] "
+                            "[--io blocking|uring]\n"
+                            "       pairdb serve --resp <socket|port> --shards [N] "
+                            "[--io blocking|uring]\n");
+            return CLI_ERROR;
+        }
+    }
+
+    // Sharded server speaks RESP only
+    if (sharded) {
+        if (!resp_addr || path) {
+            fprintf(stderr, "usage: pairdb serve --resp <socket|port> --shards [N] "
+                            "[--io blocking|uring]\n");
+            return CLI_ERROR;
+        }
+        return run_sharded_server(resp_addr, nshards);
+    }
+    return run_server(path, resp_addr);
+}
+
+// Commands run and failed in batch mode,
+// indexed by enum CMD
+struct batch_stats {
+    size_t count[QUIT + 1];
+    size_t errors[QUIT + 1];
+};
+
+static void print_batch_stats(const struct batch_stats *stats, double secs)
+{
+    size_t total = 0;
+    size_t errors = 0;
+    for (int i = 0; i <= QUIT; i++) {
+        total += stats->count[i];
+        errors += stats->errors[i];
+    }
+
+    fprintf(stderr, "pairdb batch: %zu commands in %.3f s (%.0f commands/s), "
+                    "%zu errors\n", total, secs, secs > 0 ? total / secs : 0.0, errors);
+    for (int i = 0; i <= QUIT; i++) {
+        if (stats->count[i] == 0) {
+            continue;
+        }
+        fprintf(stderr, "  %-12s %12zu", cmd_name(i), stats->count[i]);
+        if (stats->errors[i] > 0) {
+            fprintf(stderr, "  (%zu errors)", stats->errors[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+// Runs the commands of chunk in order, taking the
+// table name from tbl_name for commands that do not
+// set it, as a parse object kept across commands
+// would. Returns 0 after quit, 1 otherwise.
+static int run_batch_chunk(db_mgr dbm, txn *trans, struct cmd_chunk *chunk,
+                           char *tbl_name, struct batch_stats *stats)
+{
+    for (size_t i = 0; i < chunk->ncmds; i++) {
+        struct parse_object *cmd = &chunk->cmds[i];
+        if (!cmd->tbl_set) {
+            memcpy(cmd->tbl_name, tbl_name, TBL_NAME_MAX);
+        }
+
+        enum CMD type = cmd->cmd;
+        int status = run_input_cmd(dbm, trans, cmd);
+        stats->count[type]++;
+        stats->errors[type] += status < 0;
+
+        // Commands may also clear the table name
+        memcpy(tbl_name, cmd->tbl_name, TBL_NAME_MAX);
+        if (status == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Runs 'pairdb --batch', or 'pairdb' with stdin not a
+// terminal. Runs the commands of stdin as at the prompt,
+// but without the intro and prompts, in three stages
+// (see pipeline.h): a reader thread reads and parses
+// blocks of input, this thread runs the commands in
+// order, and their output is written by a writer
+// thread. End of input quits as the quit command does.
+// A summary of commands run, errors, and elapsed time
+// is printed to stderr.
+// Returns exit status, CLI_NOT_FOUND if any command failed.
+int run_batch(void)
+{
+    db_mgr dbmgr = init_db_mgr();
+    if (!dbmgr) {
+        return CLI_ERROR;
+    }
+    pipeline pl = pipeline_start(STDIN_FILENO);
+    FILE *out = pipeline_output(STDOUT_FILENO);
+    if (!pl || !out) {
+        pipeline_stop(pl);
+        if (out) {
+            fclose(out);
+        }
+        destroy_db_mgr(dbmgr);
+        return CLI_ERROR;
+    }
+
+    // Command handlers print to stdout, which is
+    // a variable that can be set in glibc
+    fflush(stdout);
+    FILE *term_out = stdout;
+    stdout = out;
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct batch_stats stats = {0};
+    char tbl_name[TBL_NAME_MAX] = "";
+    txn trans = NULL;
+    bool quit = false;
+    struct cmd_chunk *chunk;
+    while (!quit && (chunk = pipeline_next(pl)) != NULL) {
+        quit = run_batch_chunk(dbmgr, &trans, chunk, tbl_name, &stats) == 0;
+        pipeline_release(pl, chunk);
+        report_bgsave(dbmgr, false);
+    }
+    pipeline_stop(pl);
+
+    if (!quit) {
+        abort_open_txn(&trans);
+        save_all_tbls(dbmgr);
+        report_bgsave(dbmgr, true);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stdout = term_out;
+    if (fclose(out) == EOF) {
+        perror("write");
+    }
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    print_batch_stats(&stats, secs);
+
+    size_t errors = 0;
+    for (int i = 0; i <= QUIT; i++) {
+        errors += stats.errors[i];
+    }
+    destroy_db_mgr(dbmgr);
+    return errors > 0 ? CLI_NOT_FOUND : CLI_OK;
+}
+
+// Sets up parse object to run record, copying its
+// key and value or table name and engine.
+// Returns description of error, NULL on success.
+static const char *record_to_cmd(const struct bin_record *rec, struct parse_object *parse_ptr,
+                                 char *key, char *val)
+{
+    static const enum CMD cmds[] = {
+        [BIN_ADD] = ADD, [BIN_DEL] = DELETE, [BIN_USE] = USETABLE, [BIN_NEWTBL] = NEWTABLE
+    };
+    parse_ptr->cmd = cmds[rec->op];
+    parse_ptr->key = key;
+    parse_ptr->val = val;
+    parse_ptr->opt = val;
+    val[0] = '\0';
+
+    if (rec->keylen == 0) {
+        return rec->op == BIN_ADD || rec->op == BIN_DEL ? "empty key" : "empty table name";
+    }
+    if (rec->op == BIN_ADD || rec->op == BIN_DEL) {
+        const char *err = bin_string(key, KEY_MAX, rec->key, rec->keylen);
+        if (!err && rec->op == BIN_ADD) {
+            err = bin_string(val, VAL_MAX, rec->val, rec->vallen);
+        }
+        return err;
+    }
+
+    // Value of newtbl is the engine
+    const char *err = bin_string(key, TBL_NAME_MAX, rec->key, rec->keylen);
+    if (!err && rec->op == BIN_NEWTBL) {
+        err = bin_string(val, VAL_MAX, rec->val, rec->vallen);
+    }
+    if (!err) {
+        memcpy(parse_ptr->tbl_name, key, rec->keylen + 1);
+    }
+    return err;
+}
+
+// Runs 'pairdb --binary'. Runs the records of a binary
+// command stream at stdin (see binstream.h) as batch mode
+// runs command lines, without parsing: each record is
+// decoded where it lies in the input block. A malformed
+// record, or one longer than a block, ends the input.
+// Returns exit status, CLI_NOT_FOUND if any command
+// failed, CLI_ERROR if the input is not a binary
+// command stream or is malformed.
+int run_binary(void)
+{
+    char *block = malloc(BATCH_BLOCK);
+    db_mgr dbmgr = init_db_mgr();
+    if (!block || !dbmgr) {
+        free(block);
+        destroy_db_mgr(dbmgr);
+        return CLI_ERROR;
+    }
+    setvbuf(stdout, NULL, _IOFBF, BATCH_OUTBUFF);
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct parse_object parse_data = {0};
+    txn trans = NULL;
+    struct batch_stats stats = {0};
+    char key[KEY_MAX];
+    char val[VAL_MAX];
+    size_t len = 0;
+    size_t recno = 0;
+    bool header = false;
+    bool malformed = false;
+    bool eof = false;
+    while (!malformed && !eof) {
+        ssize_t n = read(STDIN_FILENO, block + len, BATCH_BLOCK - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("read");
+        }
+        eof = n <= 0;
+        len += n > 0 ? n : 0;
+
+        size_t pos = 0;
+        if (!header) {
+            int hdr_stat = bin_check_header(block, len);
+            if (hdr_stat < 0 || (hdr_stat == 0 && eof)) {
+                fprintf(stderr, "Input is not a binary command stream\n");
+                free(block);
+                destroy_db_mgr(dbmgr);
+                return CLI_ERROR;
+            }
+            header = hdr_stat == 1;
+            pos = header ? BIN_HEADER_LEN : 0;
+        }
+
+        struct bin_record rec;
+        size_t used;
+        int dec_stat = 0;
+        while (header && (dec_stat = bin_decode(block + pos, len - pos, &rec, &used)) == 1) {
+            pos += used;
+            recno++;
+            const char *err = record_to_cmd(&rec, &parse_data, key, val);
+            if (err) {
+                printf("Record %zu: %s\n", recno, err);
+                stats.count[parse_data.cmd]++;
+                stats.errors[parse_data.cmd]++;
+                continue;
+            }
+            enum CMD cmd = parse_data.cmd;
+            stats.count[cmd]++;
+            stats.errors[cmd] += run_input_cmd(dbmgr, &trans, &parse_data) < 0;
+        }
+
+        // Keep the start of an unfinished record
+        len -= pos;
+        memmove(block, block + pos, len);
+        if (header && (dec_stat < 0 || (len > 0 && (eof || len == BATCH_BLOCK)))) {
+            printf("Record %zu: %s\n", recno + 1, dec_stat < 0 ? "malformed record" :
+                   eof ? "truncated record" : "record too long");
+            malformed = true;
+        }
+
+        report_bgsave(dbmgr, false);
+    }
+
+    save_all_tbls(dbmgr);
+    report_bgsave(dbmgr, true);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fflush(stdout);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    print_batch_stats(&stats, secs);
+
+    size_t errors = 0;
+    for (int i = 0; i <= QUIT; i++) {
+        errors += stats.errors[i];
+    }
+    free(block);
+    destroy_db_mgr(dbmgr);
+    if (malformed) {
+        return CLI_ERROR;
+    }
+    return errors > 0 ? CLI_NOT_FOUND : CLI_OK;
+}
+
+// Adds key to key set of hashstat
+static int collect_key(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    return hs_keys_add(arg, key) < 0;
+}
+
+// Prints distributions of hashstat report rep
+static void print_hashstat(const struct hs_report *rep)
+{
+    printf("Keys sharing a 32-bit hash value: %zu\n", rep->hash_collisions);
+    printf("Clustering coefficient: %.3f (1 for a uniformly random hash)\n\n",
+           rep->clustering);
+
+    printf("%-20s %12s %14s\n", "keys/home bucket", "buckets", "uniform hash");
+    for (size_t k = 0; k <= HS_HOME_MAX; k++) {
+        char label[16];
+        snprintf(label, sizeof(label), k < HS_HOME_MAX ? "%zu" : "%zu+", k);
+        printf("%-20s %12zu %14.1f\n", label, rep->home[k], hs_uniform_home(rep, k));
+    }
+
+    printf("\n%-20s %12s %8s\n", "probe length", "keys", "percent");
+    for (size_t i = 0; i <= HS_PROBE_MAX && i <= rep->maxprobe; i++) {
+        if (rep->probes[i] == 0) {
+            continue;
+        }
+        char label[16];
+        snprintf(label, sizeof(label), i < HS_PROBE_MAX ? "%zu" : "%zu+", i);
+        printf("%-20s %12zu %7.3f%%\n", label, rep->probes[i],
+               100.0 * rep->probes[i] / rep->numkeys);
+    }
+
+    printf("\nLongest probe sequences (maxprobe %zu):\n", rep->maxprobe);
+    for (size_t i = 0; i < rep->numoutliers; i++) {
+        printf("%6zu  %s\n", rep->outliers[i].probes, rep->outliers[i].key);
+    }
+}
+
+// Runs 'pairdb hashstat <table_name>' or
+// 'pairdb hashstat --keys <file>'. Places the keys of
+// a table, or of a key dump, in a simulated hash table
+// (see hashstat.h) and prints the home bucket and probe
+// length distributions for the hash and load factor
+// limit of hash tables, followed by a comparison of
+// other hashes and limits on the same keys.
+// Returns exit status.
+int run_hashstat(int argc, char *argv[])
+{
+    static const double limits[] = {0.50, 0.60, 0.70, 0.80};
+    struct hs_keys ks = {0};
+    int status;
+    if (argc == 4 && strcmp(argv[2], "--keys") == 0) {
+        status = hs_keys_read(&ks, argv[3]);
+        if (status == -1) {
+            fprintf(stderr, "Cannot read %s\n", argv[3]);
+        }
+    }
+    else if (argc == 3) {
+        db_mgr dbm = init_db_mgr();
+        if (!dbm) {
+            return CLI_ERROR;
+        }
+        status = use_tbl(dbm, argv[2]);
+        if (status < 0) {
+            print_tbl_error(status);
+        }
+        else if (iterate_tbl(dbm, collect_key, &ks) < 0) {
+            status = -2;
+        }
+        destroy_db_mgr(dbm);
+    }
+    else {
+        fprintf(stderr, "usage: pairdb hashstat <table_name>\n"
+                        "       pairdb hashstat --keys <file>\n");
+        return CLI_ERROR;
+    }
+    if (status == -2) {
+        fprintf(stderr, "Memory allocation error\n");
+    }
+    if (status < 0 || ks.numkeys == 0) {
+        if (status >= 0) {
+            fprintf(stderr, "No keys to analyze\n");
+        }
+        hs_keys_free(&ks);
+        return CLI_ERROR;
+    }
+
+    double curr_lim = hashtbl_load_limit();
+    struct hs_report rep;
+    if (hs_analyze(&ks, HS_FNV1A, curr_lim, false, &rep) < 0) {
+        fprintf(stderr, "Memory allocation error\n");
+        hs_keys_free(&ks);
+        return CLI_ERROR;
+    }
+    printf("%zu keys, hash %s, load factor limit %.2f: %zu buckets, load %.3f\n",
+           rep.numkeys, hs_hash_name(HS_FNV1A), curr_lim, rep.arrsize, rep.load);
+    print_hashstat(&rep);
+
+    // Tables filled to each limit, as just before
+    // they resize, where probing costs the most
+    printf("\nTables filled to load factor limit:\n");
+    printf("%-10s %6s %10s %10s %7s %5s %5s %10s %10s\n", "hash", "limit", "keys",
+           "buckets", "mean", "p99", "max", "clustering", "collisions");
+    for (int fn = 0; fn < HS_NUM_HASHES; fn++) {
+        for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+            if (hs_analyze(&ks, fn, limits[l], true, &rep) < 0) {
+                fprintf(stderr, "Memory allocation error\n");
+                hs_keys_free(&ks);
+                return CLI_ERROR;
+            }
+            bool curr = fn == HS_FNV1A && limits[l] == curr_lim;
+            printf("%-10s %5.2f%s %10zu %10zu %7.3f %5zu %5zu %10.3f %10zu\n",
+                   hs_hash_name(fn), limits[l], curr ? "*" : " ", rep.numkeys,
+                   rep.arrsize, rep.mean_probes, hs_probe_percentile(&rep, 0.99),
+                   rep.maxprobe, rep.clustering, rep.hash_collisions);
+        }
+    }
+    printf("* current hash and limit\n");
+
+    hs_keys_free(&ks);
+    return CLI_OK;
+}
+
+// Runs 'pairdb encode'. Writes the add, del, use, and
+// newtbl commands of the command lines at stdin to stdout
+// as a binary command stream for 'pairdb --binary'.
+// Lines with other commands, or that cannot be parsed,
+// are reported to stderr and skipped.
+// Returns exit status, CLI_NOT_FOUND if any line was
+// skipped.
+int run_encode(void)
+{
+    setvbuf(stdout, NULL, _IOFBF, BATCH_OUTBUFF);
+    fwrite(BIN_MAGIC, 1, BIN_HEADER_LEN, stdout);
+
+    struct parse_object parse_data = {0};
+    char record[BIN_VARINT_MAX * 2 + KEY_MAX + VAL_MAX + 1];
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t lineno = 0;
+    size_t errors = 0;
+    ssize_t n;
+    while ((n = getline(&line, &line_size, stdin)) >= 0) {
+        lineno++;
+        // Blank lines are skipped
+        if (line[0] == '\n') {
+            continue;
+        }
+        parse_input(line, &parse_data);
+
+        const char *key = parse_data.key;
+        const char *val = parse_data.val;
+        enum bin_op op;
+        switch (parse_data.cmd) {
+            case ADD: op = BIN_ADD; break;
+            case DELETE: op = BIN_DEL; break;
+            case USETABLE: op = BIN_USE; key = parse_data.tbl_name; break;
+            case NEWTABLE:
+                op = BIN_NEWTBL;
+                key = parse_data.tbl_name;
+                val = parse_data.opt;
+                break;
+            default:
+                fprintf(stderr, "line %zu: %s\n", lineno,
+                        parse_data.error ? parse_data.error : "not an add, del, use, or newtbl command");
+                errors++;
+                continue;
+        }
+        size_t len = bin_encode(record, op, key, strlen(key), val, strlen(val));
+        fwrite(record, 1, len, stdout);
+    }
+    free(line);
+
+    if (fflush(stdout) == EOF) {
+        perror("write");
+        return CLI_ERROR;
+    }
+    return errors > 0 ? CLI_NOT_FOUND : CLI_OK;
+}
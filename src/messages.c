@@ -9,6 +9,9 @@
  *
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "messages.h"
 
 const char *intro_msg()
@@ -28,24 +31,35 @@ const char *short_help_msg()
 {
     const char *msg =
                 "syntax error\n"
-                "commands: newtbl <tbl_name>\n"
+                "commands: newtbl <tbl_name> [hash|cuckoo|lsm]\n"
                 "          use <tbl_name>\n"
                 "          save\n"
-                "          lstbls\n"
+                "          bgsave\n"
+                "          lstbls [-l]\n"
                 "          drop <tbl_name>\n"
                 "          add <key> <val>\n"
                 "          get <key>\n"
                 "          del <key>\n"
-                "          lsdata\n"
+                "          lsdata [limit N] [cursor C] [format plain|tsv|json]\n"
+                "          durability [none|on-save|group] [ms]\n"
+                "          cache [budget_mb]\n"
+                "          info\n"
+                "          import <tbl_name> <file> [csv|tsv|jsonl|binary]\n"
+                "          export <tbl_name> <file> [csv|tsv|jsonl|binary] [sorted]\n"
+                "          begin\n"
+                "          commit\n"
+                "          abort\n"
+                "          latency [reset|slow [ms]|<command>]\n"
                 "          help\n"
                 "          quit\n"
                 "use help command for more info\n";
     return msg;
 }
 
-const char *long_help_msg()
-{
-    const char *msg =
+// Help text is kept in sections to stay within
+// the string literal length compilers must support.
+// long_help_msg joins the sections on first use.
+static const char *const long_help_sections[] = {
             "Pairdb is an interactive key-value database for use\n"
             "at the command line - usage: 'pairdb'. This program\n"
             "also accepts input files at stdin to execute batch\n"
@@ -62,7 +76,7 @@ const char *long_help_msg()
             "------------------- Commands -----------------------\n"
             "         SYNTAX                   ACTIONS           \n"
             " newtbl <table_name>        Creates a new table in\n"
-            "                            memory and sets as current\n"
+            "   [hash|cuckoo|lsm]        memory and sets as current\n"
             "                            table to be used for\n"
             "                            subsequent commands.\n"
             "                            Command fails if a table\n"
@@ -70,21 +84,37 @@ const char *long_help_msg()
             "                            exists. If used when another\n"
             "                            table is already set as\n"
             "                            current table, that table\n"
-            "                            is saved before switching\n"
-            "                            to the new table.\n\n"
+            "                            stays open in memory.\n"
+            "                            Optional engine: hash\n"
+            "                            (default) and cuckoo keep\n"
+            "                            the table in memory, lsm\n"
+            "                            stores it on disk in sorted\n"
+            "                            files for tables larger than\n"
+            "                            memory.\n\n"
             " use <table_name>           Loads a previously saved\n"
             "                            table into memory and sets\n"
             "                            as current table to be used\n"
             "                            for subsequent commands.\n"
             "                            Command fails if a table\n"
             "                            with <table_name> does not\n"
-            "                            exist. If used when another\n"
-            "                            table is already set as\n"
-            "                            current table, that table is\n"
-            "                            saved before switching to the\n"
-            "                            table specified.\n\n"
+            "                            exist. Tables used earlier\n"
+            "                            stay open in memory, so\n"
+            "                            switching back to them does\n"
+            "                            not reload them from disk.\n"
+            "                            Updated tables are saved when\n"
+            "                            closed to stay within the\n"
+            "                            cache memory budget.\n\n",
             " save                       Saves current table to disk.\n\n"
-            " lstbls                     Prints list of all saved tables.\n\n"
+            " bgsave                     Saves a snapshot of current table\n"
+            "                            to disk in a background process.\n"
+            "                            Commands can be used while the\n"
+            "                            snapshot is written. Completion,\n"
+            "                            duration, and bytes written are\n"
+            "                            reported when the save finishes.\n\n"
+            " lstbls [-l]                Prints list of all saved tables.\n"
+            "                            With -l, also prints engine, number\n"
+            "                            of entries, disk size, and time of\n"
+            "                            last save of each table.\n\n"
             " drop <table_name>          Drops table by deleting file\n"
             "                            associated with <table_name> and\n"
             "                            removing <table_name> from database\n"
@@ -93,7 +123,7 @@ const char *long_help_msg()
             "                            table data is cleared from memory,\n"
             "                            and another table must be created\n"
             "                            or selected to perform any table\n"
-            "                            operations.\n\n"
+            "                            operations.\n\n",
             " add <key> <val>            Adds key-value pair to current\n"
             "                            table. Command fails if <key>\n"
             "                            already exists in current table.\n\n"
@@ -102,11 +132,77 @@ const char *long_help_msg()
             "                            table.\n\n"
             " del <key>                  Deletes <key> <val> pair from\n"
             "                            current table.\n\n"
-            " lsdata                     Lists all key-value pairs in current\n"
-            "                            table.\n\n"
+            " lsdata [limit N]           Lists all key-value pairs in current\n"
+            "   [cursor C]               table. With limit, lists at most N\n"
+            "   [format plain|tsv|json]  pairs and prints the cursor of the\n"
+            "                            next page if pairs are left; the\n"
+            "                            page starts at cursor C (0 for the\n"
+            "                            first). tsv prints key<TAB>val\n"
+            "                            rows, json one document.\n\n"
+            " durability [mode] [ms]     Sets when saves are flushed to\n"
+            "                            disk. Modes: none, on-save\n"
+            "                            (default), group. In group mode,\n"
+            "                            saves are committed together every\n"
+            "                            <ms> milliseconds. With no\n"
+            "                            arguments, prints the current\n"
+            "                            mode and save counters.\n\n"
+            " cache [budget_mb]          Sets memory budget for open\n"
+            "                            tables in megabytes. With no\n"
+            "                            argument, prints cache hits,\n"
+            "                            misses, evictions, and memory\n"
+            "                            held by open tables.\n\n"
+            " info                       Prints storage engine of current\n"
+            "                            table and engine counters.\n\n"
+            " import <table_name> <file> Adds key-value pairs from <file>\n"
+            "   [csv|tsv|jsonl|binary]   to <table_name>, creating it if it\n"
+            "                            does not exist, and sets it as\n"
+            "                            current table. The format is taken\n"
+            "                            from the file extension if not\n"
+            "                            given. Malformed rows are reported\n"
+            "                            and skipped. Can also be run as\n"
+            "                            'pairdb import <table_name> <file>\n"
+            "                            [format]' at the command line.\n\n"
+            " export <table_name> <file> Writes all key-value pairs of\n"
+            "   [csv|tsv|jsonl|binary]   <table_name> to <file> and sets\n"
+            "   [sorted]                 <table_name> as current table.\n"
+            "                            With sorted, pairs are written\n"
+            "                            in key order. The format is\n"
+            "                            taken from the file extension\n"
+            "                            if not given. Can also be run\n"
+            "                            as 'pairdb export <table_name>\n"
+            "                            <file> [format] [sorted]' at\n"
+            "                            the command line.\n\n",
+            " begin                      Starts a transaction on current\n"
+            "                            table. Adds and deletes that\n"
+            "                            follow are held in the\n"
+            "                            transaction: get and lsdata show\n"
+            "                            them, but other clients do not\n"
+            "                            see them until commit. Commands\n"
+            "                            that change or save tables, such\n"
+            "                            as use, save, and import, fail\n"
+            "                            until the transaction ends.\n\n"
+            " commit                     Applies all writes of the\n"
+            "                            transaction to the table at once\n"
+            "                            and saves the table, with one\n"
+            "                            flush to disk for the whole\n"
+            "                            transaction.\n\n"
+            " abort                      Drops all writes of the\n"
+            "                            transaction. quit and end of\n"
+            "                            input also abort an open\n"
+            "                            transaction.\n\n",
+            " latency [reset|            Prints count, mean, and p50 to\n"
+            "   slow [ms]|<command>]     max latency of each command run\n"
+            "                            since start or the last reset.\n"
+            "                            With a command word, prints its\n"
+            "                            latency histogram. 'latency slow'\n"
+            "                            prints the latest commands that\n"
+            "                            took at least ms milliseconds (10\n"
+            "                            by default, set with 'latency slow\n"
+            "                            <ms>'), with any table load,\n"
+            "                            resize, or save they caused.\n\n",
             " help                       Prints information on commands.\n\n"
             " quit                       Quit interactive program and save\n"
-            "                            current table to disk.\n\n"
+            "                            all updated tables to disk.\n\n"
             " Any of the above commands can be placed in an input file with\n"
             " one command per line (separated by the newline character). Use\n"
             " the quit command on the final line. All data will be saved\n"
@@ -118,7 +214,74 @@ const char *long_help_msg()
             "      add key2 val2\n"
             "      quit\n\n"
             "   command line:\n"
-            "      pairdb < input.txt\n";
+            "      pairdb < input.txt\n\n"
+            " When stdin is not a terminal, or with 'pairdb --batch',\n"
+            " commands run in batch mode: no prompts are printed,\n"
+            " end of input quits as quit does, and a summary of\n"
+            " commands, errors, and elapsed time is printed to\n"
+            " stderr. Exit status is 1 if any command failed.\n"
+            " 'pairdb encode < input.txt > input.bin' writes the\n"
+            " add, del, use, and newtbl commands of input.txt as\n"
+            " a binary command stream, with each key and value\n"
+            " stored by length instead of quoted, and\n"
+            " 'pairdb --binary < input.bin' runs it in batch mode.\n"
+            " Such a stream of add commands can also be imported\n"
+            " with the binary format.\n\n"
+            " 'pairdb hashstat <table_name>' or 'pairdb hashstat\n"
+            " --keys <file>' reports how the keys of a table, or\n"
+            " one key per line of a file, spread over hash table\n"
+            " buckets: keys per home bucket, probe lengths, and\n"
+            " longest probe sequences, and compares hash\n"
+            " functions and load factor limits on the same keys.\n\n"
+            " Single commands can also be run at the command\n"
+            " line without the interactive program. Commands on\n"
+            " the keys of a table take the table name first:\n\n"
+            "      pairdb get <table_name> <key>\n"
+            "      pairdb add <table_name> <key> <val>\n"
+            "      pairdb del <table_name> <key>\n"
+            "      pairdb lsdata <table_name> [limit N] ...\n"
+            "      pairdb info <table_name>\n\n"
+            " lstbls, newtbl, drop, import, and export take the\n"
+            " same arguments as at the prompt. Exit status is 1\n"
+            " if a key is not found or already exists, and 2 on\n"
+            " other errors.\n\n"
+            " Pairdb can also run as a server that keeps tables\n"
+            " open for many clients:\n\n"
+            "      pairdb serve [socket] [--resp <socket|port>]\n"
+            "      pairdb -c [socket]\n\n"
+            " 'pairdb -c' sends commands read from stdin to the\n"
+            " server and prints the replies. The default socket\n"
+            " is ~/pairdb-data/pairdb.sock. With --resp, Redis\n"
+            " clients are also served on a second socket or on\n"
+            " a TCP port of 127.0.0.1.\n\n"
+            "      pairdb serve --resp <socket|port> --shards [N]\n\n"
+            " serves Redis clients only, with the keys of each\n"
+            " table split between N threads, one per CPU by\n"
+            " default. With --io blocking|uring, serve chooses\n"
+            " how sockets and table files are written; uring\n"
+            " is the default where the kernel supports it.\n",
+    NULL
+};
+
+const char *long_help_msg()
+{
+    static char *msg = NULL;
+    if (msg) {
+        return msg;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; long_help_sections[i]; i++) {
+        len += strlen(long_help_sections[i]);
+    }
+
+    msg = calloc(1, len + 1);
+    if (!msg) {
+        return "";
+    }
+    for (size_t i = 0; long_help_sections[i]; i++) {
+        strcat(msg, long_help_sections[i]);
+    }
 
     return msg;
 }
@@ -16,7 +16,9 @@
 enum {
     TBL_NAME_MAX = 32,
     KEY_MAX = 100,
-    VAL_MAX = 100
+    VAL_MAX = 100,
+    OPT_MAX = 16,
+    PATH_MAX_LEN = 256
 };
 
 #endif // CONSTANTS_H
@@ -16,30 +16,41 @@
  * arguments is provided for a command, then the CMD field
  * is set to FAIL.
  *
- * Input is parsed in 4 steps:
+ * Input is parsed in 3 steps:
  *
- *  1. Preprocess -     The newline character left in the input
- *                      buffer by fgets is replaced with the NUL
- *                      character. The input buffer is scanned.
- *                      All spaces outside of sections enclosed
- *                      in single or double quotation marks are
- *                      replaced with a marker character for
- *                      further processing.
+ *  1. Tokenize -       The input buffer is split into tokens
+ *                      in a single pass. Tokens are separated
+ *                      by spaces, tabs, and newline characters
+ *                      outside of sections enclosed in single
+ *                      or double quotation marks. Quotation
+ *                      marks are removed and escape sequences
+ *                      are replaced as the token is scanned,
+ *                      and the token is NUL terminated where
+ *                      it ends, so every token is a slice of
+ *                      the input buffer. Tokens have no length
+ *                      limit.
  *
- *  2. Tokenize -       The preprocessed input buffer is broken
- *                      into separate strings based on the new
- *                      marker character and quotation mark
- *                      characters.
+ *  2. Command Parse -  The initial token is looked up in a
+ *                      perfect hash table of command words,
+ *                      built at compile time, so a command is
+ *                      found with one string comparison. If
+ *                      it is not valid, the enum CMD element
+ *                      of the parse object is set to FAIL.
  *
- *  3. Command Parse -  The initial string is parsed to determine
- *                      whether it is a valid command. If it is
- *                      not valid, the enum CMD element of the
- *                      parse object is set to FAIL.
- *
- *  4. Argument Parse - The rest of the strings are parsed. The
+ *  3. Argument Parse - The rest of the tokens are parsed. The
  *                      argument parse function determines whether
  *                      the correct number of arguments are present
  *                      for each command. Extra arguments are ignored.
+ *                      Keys, values, and other arguments are
+ *                      pointed to where they lie in the input
+ *                      buffer rather than copied. Only the table
+ *                      name is copied, as it is kept for later
+ *                      commands.
+ *
+ * The parse_argv function parses arguments that are already
+ * separate strings, such as program arguments, with steps 2
+ * and 3 only. Quotation marks and backslashes in arguments
+ * are kept.
  *
  */
 
@@ -47,159 +58,461 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include "pairdbconst.h"
 #include "parse.h"
-#include "stringutil.h"
 
 enum {
-    MAX_ARGS = 3
+    MAX_ARGS = 7,
+    CMD_TABLE_SIZE = 64     // Power of 2
+};
+
+// Command words, indexed by enum CMD
+static const char *const cmd_names[] = {
+    [FAIL] = "invalid",
+    [LSTABLES] = "lstbls",
+    [NEWTABLE] = "newtbl",
+    [USETABLE] = "use",
+    [ADD] = "add",
+    [GET] = "get",
+    [DELETE] = "del",
+    [SAVE] = "save",
+    [BGSAVE] = "bgsave",
+    [DROPTABLE] = "drop",
+    [LSDATA] = "lsdata",
+    [HELP] = "help",
+    [DURABILITY] = "durability",
+    [CACHE] = "cache",
+    [INFO] = "info",
+    [IMPORT] = "import",
+    [EXPORT] = "export",
+    [BEGIN] = "begin",
+    [COMMIT] = "commit",
+    [ABORT] = "abort",
+    [LATENCY] = "latency",
+    [QUIT] = "quit"
 };
 
+// Token of input, a slice of the input
+// buffer, NUL terminated in place
+struct token {
+    char *ptr;
+    size_t len;
+};
+
+struct cmd_entry {
+    const char *word;
+    size_t len;
+    enum CMD cmd;
+};
+
+// Perfect hash of command words - no two command
+// words have the same hash of their length, first
+// character, and last character. A new command word
+// that collides with another is reported by the
+// compiler, as both initialize the same entry of
+// cmd_table (-Woverride-init).
+#define CMD_HASH(len, first, last)                                \
+    (((size_t) (len) * 3 + (size_t) (unsigned char) (first) * 20 + \
+      (size_t) (unsigned char) (last)) & (CMD_TABLE_SIZE - 1))
+
+#define CMD_ENTRY(word, first, last, cmd) \
+    [CMD_HASH(sizeof(word) - 1, first, last)] = {word, sizeof(word) - 1, cmd}
+
+static const struct cmd_entry cmd_table[CMD_TABLE_SIZE] = {
+    CMD_ENTRY("lstbls", 'l', 's', LSTABLES),
+    CMD_ENTRY("newtbl", 'n', 'l', NEWTABLE),
+    CMD_ENTRY("use", 'u', 'e', USETABLE),
+    CMD_ENTRY("add", 'a', 'd', ADD),
+    CMD_ENTRY("get", 'g', 't', GET),
+    CMD_ENTRY("del", 'd', 'l', DELETE),
+    CMD_ENTRY("save", 's', 'e', SAVE),
+    CMD_ENTRY("bgsave", 'b', 'e', BGSAVE),
+    CMD_ENTRY("drop", 'd', 'p', DROPTABLE),
+    CMD_ENTRY("lsdata", 'l', 'a', LSDATA),
+    CMD_ENTRY("help", 'h', 'p', HELP),
+    CMD_ENTRY("durability", 'd', 'y', DURABILITY),
+    CMD_ENTRY("cache", 'c', 'e', CACHE),
+    CMD_ENTRY("info", 'i', 'o', INFO),
+    CMD_ENTRY("import", 'i', 't', IMPORT),
+    CMD_ENTRY("export", 'e', 't', EXPORT),
+    CMD_ENTRY("begin", 'b', 'n', BEGIN),
+    CMD_ENTRY("commit", 'c', 't', COMMIT),
+    CMD_ENTRY("abort", 'a', 't', ABORT),
+    CMD_ENTRY("latency", 'l', 'y', LATENCY),
+    CMD_ENTRY("quit", 'q', 't', QUIT)
+};
+
+// Value of arguments not given
+static char empty_arg[] = "";
+
 /*---------- start - static/internal functions ------------*/
 
-static void preprocess(char *cp)
+// Parse non-negative decimal integer from str.
+// Returns -1 if str is not a valid number.
+static long parse_num(const char *str)
 {
-    // fgets leaves newline char in
-    // buffer as last char of string.
-    // Replace newline char with NUL
-    // char to get NUL terminated
-    // input string.
-    char *end = &cp[strlen(cp) - 1];
-    *end = '\0';
-
-    bool inquote = false;
-
-    for (; cp < end; cp++) {
-        // determine whether cp is within a quoted section
-        // check for single and double quote chars
-        if (*cp == '"' || *cp == '\'') {
-            if (inquote == false) {
-                inquote = true;
-            }
-            else {
-                inquote = false;
-            }
-        }
+    char *end;
+    errno = 0;
+    long n = strtol(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || n < 0) {
+        return -1;
+    }
+    return n;
+}
 
-        // if not in a quoted section, replace space with tab
-        if (!inquote && *cp == ' ') {
-            *cp = '\t';
-        }
+static bool is_separator(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Character of escape sequence '\ch',
+// '\0' if it is not an escape sequence
+static char unescape(char ch)
+{
+    switch (ch) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case '\\':
+        case '"':
+        case '\'':
+        case ' ':
+            return ch;
+        default:
+            return '\0';
     }
 }
 
-static void tokenize(char *inbuff, char *argv[], size_t len)
+// Split inbuff into at most max tokens in a single
+// pass. Each token is written back over its own
+// input, as removing quotation marks and escape
+// characters only shortens it, and NUL terminated.
+// Returns number of tokens.
+static size_t tokenize(char *inbuff, struct token *toks, size_t max)
 {
-    char *delim = "\t\'\"";
-    char *temp = strtok(inbuff, delim);
-    argv[0] = temp;
+    size_t n = 0;
+    char *r = inbuff;
+    while (n < max) {
+        while (is_separator(*r)) {
+            r++;
+        }
+        if (*r == '\0') {
+            break;
+        }
 
-    for (size_t i = 1; i < len && temp; i++) {
-        temp = strtok(NULL, delim);
-        argv[i] = temp;
+        char *w = r;
+        toks[n].ptr = w;
+        char quote = '\0';
+        while (*r != '\0') {
+            char ch = *r;
+            if (!quote && is_separator(ch)) {
+                r++;
+                break;
+            }
+            if (ch == '\\' && r[1] != '\0' && unescape(r[1]) != '\0') {
+                *w++ = unescape(r[1]);
+                r += 2;
+            }
+            else if ((ch == '"' || ch == '\'') && (!quote || ch == quote)) {
+                // Quotation marks open and close a section
+                // within the token and are removed
+                quote = quote ? '\0' : ch;
+                r++;
+            }
+            else {
+                *w++ = ch;
+                r++;
+            }
+        }
+        toks[n].len = w - toks[n].ptr;
+        *w = '\0';
+        n++;
     }
+    return n;
 }
 
-static enum CMD parse_cmd(char *str_cmd)
+static enum CMD parse_cmd(const struct token *tok)
 {
-    if (str_cmd == NULL) {
+    if (tok->len == 0) {
         return FAIL;
     }
 
-    if (strcmp(str_cmd, "lstbls") == 0) {
-        return LSTABLES;
-    }
-    else if (strcmp(str_cmd, "newtbl") == 0) {
-        return NEWTABLE;
-    }
-    else if (strcmp(str_cmd, "use") == 0) {
-        return USETABLE;
-    }
-    else if (strcmp(str_cmd, "add") == 0) {
-        return ADD;
-    }
-    else if (strcmp(str_cmd, "get") == 0) {
-        return GET;
-    }
-    else if (strcmp(str_cmd, "del") == 0) {
-        return DELETE;
-    }
-    else if (strcmp(str_cmd, "save") == 0) {
-        return SAVE;
+    const struct cmd_entry *entry =
+        &cmd_table[CMD_HASH(tok->len, tok->ptr[0], tok->ptr[tok->len - 1])];
+    if (entry->word && entry->len == tok->len &&
+        memcmp(entry->word, tok->ptr, tok->len) == 0) {
+        return entry->cmd;
     }
-    else if (strcmp(str_cmd, "drop") == 0) {
-        return DROPTABLE;
-    }
-    else if (strcmp(str_cmd, "lsdata") == 0) {
-        return LSDATA;
+    return FAIL;
+}
+
+// Set table name to tok, which is copied as
+// the table name is kept for later commands.
+// Returns false if tok is too long.
+static bool set_tbl_name(struct parse_object *prs_data, const struct token *tok)
+{
+    if (tok->len >= TBL_NAME_MAX) {
+        prs_data->cmd = FAIL;
+        prs_data->error = "Table name too long";
+        return false;
     }
-    else if (strcmp(str_cmd, "help") == 0) {
-        return HELP;
+    memcpy(prs_data->tbl_name, tok->ptr, tok->len + 1);
+    prs_data->tbl_set = true;
+    return true;
+}
+
+// Set key, and val if val_tok is not NULL, to
+// their tokens. Returns false if either is too
+// long to be stored in a table.
+static bool set_key_val(struct parse_object *prs_data, const struct token *key_tok,
+                        const struct token *val_tok)
+{
+    if (key_tok->len >= KEY_MAX) {
+        prs_data->cmd = FAIL;
+        prs_data->error = "Key too long";
+        return false;
     }
-    else if (strcmp(str_cmd, "quit") == 0) {
-        return QUIT;
+    if (val_tok && val_tok->len >= VAL_MAX) {
+        prs_data->cmd = FAIL;
+        prs_data->error = "Value too long";
+        return false;
     }
-    else {
-        return FAIL;
+    prs_data->key = key_tok->ptr;
+    if (val_tok) {
+        prs_data->val = val_tok->ptr;
     }
+    return true;
 }
 
-static void parse_args(char *argv[], struct parse_object *prs_data)
+// Parse arguments of command, argc tokens
+// including the command word
+static void parse_args(struct token *argv, size_t argc, struct parse_object *prs_data)
 {
     switch (prs_data->cmd) {
         case FAIL:
         case QUIT:
         case SAVE:
+        case BGSAVE:
         case HELP:
+        case INFO:
+        case BEGIN:
+        case COMMIT:
+        case ABORT:
+            break;
+
         case LSTABLES:
-        case LSDATA:
+            // Optional argument: lstbls [-l]
+            if (argc > 1) {
+                prs_data->opt = argv[1].ptr;
+            }
             break;
 
         case NEWTABLE:
+            // Optional argument: newtbl <table_name> [engine]
+            if (argc < 2) {
+                prs_data->cmd = FAIL;
+                return;
+            }
+            if (!set_tbl_name(prs_data, &argv[1])) {
+                return;
+            }
+            if (argc > 2) {
+                prs_data->opt = argv[2].ptr;
+            }
+            break;
+
+        case IMPORT:
+            // import <table_name> <file> [format]
+            if (argc < 3) {
+                prs_data->cmd = FAIL;
+                return;
+            }
+            if (!set_tbl_name(prs_data, &argv[1])) {
+                return;
+            }
+            prs_data->path = argv[2].ptr;
+            if (argc > 3) {
+                prs_data->opt = argv[3].ptr;
+            }
+            break;
+
+        case EXPORT:
+            // export <table_name> <file> [format] [sorted]
+            // Sets num to 1 for sorted output
+            if (argc < 3) {
+                prs_data->cmd = FAIL;
+                return;
+            }
+            if (!set_tbl_name(prs_data, &argv[1])) {
+                return;
+            }
+            prs_data->path = argv[2].ptr;
+            for (size_t i = 3; i < argc; i++) {
+                if (strcmp(argv[i].ptr, "sorted") == 0 && prs_data->num == 0) {
+                    prs_data->num = 1;
+                }
+                else if (prs_data->opt[0] == '\0') {
+                    prs_data->opt = argv[i].ptr;
+                }
+                else {
+                    prs_data->cmd = FAIL;
+                    return;
+                }
+            }
+            break;
+
+        case LSDATA:
+            // Optional settings in any order:
+            // lsdata [limit N] [cursor C] [format F]
+            // Sets num to limit and opt to format
+            for (size_t i = 1; i < argc; i += 2) {
+                char *setting = argv[i].ptr;
+                char *arg = i + 1 < argc ? argv[i + 1].ptr : NULL;
+                if (!arg) {
+                    prs_data->cmd = FAIL;
+                }
+                else if (strcmp(setting, "limit") == 0) {
+                    prs_data->num = parse_num(arg);
+                    if (prs_data->num <= 0) {
+                        prs_data->cmd = FAIL;
+                    }
+                }
+                else if (strcmp(setting, "cursor") == 0) {
+                    prs_data->cursor = parse_num(arg);
+                    if (prs_data->cursor < 0) {
+                        prs_data->cmd = FAIL;
+                    }
+                }
+                else if (strcmp(setting, "format") == 0) {
+                    prs_data->opt = arg;
+                }
+                else {
+                    prs_data->cmd = FAIL;
+                }
+            }
+            break;
+
         case USETABLE:
         case DROPTABLE:
-            if (argv[1] == NULL) {
+            if (argc < 2) {
                 prs_data->cmd = FAIL;
                 return;
             }
-            strtcpy(prs_data->tbl_name, argv[1], TBL_NAME_MAX);
+            set_tbl_name(prs_data, &argv[1]);
             break;
 
         case ADD:
-            if (argv[1] == NULL || argv[2] == NULL) {
+            if (argc < 3) {
                 prs_data->cmd = FAIL;
                 return;
             }
-            strtcpy(prs_data->key, argv[1], KEY_MAX);
-            strtcpy(prs_data->val, argv[2], VAL_MAX);
+            set_key_val(prs_data, &argv[1], &argv[2]);
             break;
 
         case GET:
-            if (argv[1] == NULL) {
+        case DELETE:
+            if (argc < 2) {
                 prs_data->cmd = FAIL;
                 return;
             }
-            strtcpy(prs_data->key, argv[1], KEY_MAX);
+            set_key_val(prs_data, &argv[1], NULL);
             break;
 
-        case DELETE:
-            if (argv[1] == NULL) {
+        case DURABILITY:
+            // Both arguments optional:
+            // durability [mode] [group_ms]
+            if (argc < 2) {
+                break;
+            }
+            prs_data->opt = argv[1].ptr;
+            if (argc > 2) {
+                prs_data->num = parse_num(argv[2].ptr);
+                if (prs_data->num < 0) {
+                    prs_data->cmd = FAIL;
+                }
+            }
+            break;
+
+        case LATENCY:
+            // Optional arguments: latency [reset|slow|<command>]
+            // or latency slow <ms>. Sets key to ms as given
+            // and num to its value.
+            if (argc < 2) {
+                break;
+            }
+            prs_data->opt = argv[1].ptr;
+            if (argc > 2) {
+                prs_data->key = argv[2].ptr;
+                prs_data->num = parse_num(argv[2].ptr);
+                if (prs_data->num < 0 || argc > 3) {
+                    prs_data->cmd = FAIL;
+                }
+            }
+            break;
+
+        case CACHE:
+            // Optional argument: cache [budget_mb]
+            if (argc < 2) {
+                break;
+            }
+            prs_data->opt = argv[1].ptr;
+            prs_data->num = parse_num(argv[1].ptr);
+            if (prs_data->num < 0) {
                 prs_data->cmd = FAIL;
-                return;
             }
-            strtcpy(prs_data->key, argv[1], KEY_MAX);
             break;
     }
 }
 
+// Clear arguments of last command,
+// except for the table name
+static void reset_args(struct parse_object *prs_data)
+{
+    prs_data->key = empty_arg;
+    prs_data->val = empty_arg;
+    prs_data->opt = empty_arg;
+    prs_data->path = empty_arg;
+    prs_data->num = 0;
+    prs_data->cursor = 0;
+    prs_data->error = NULL;
+    prs_data->tbl_set = false;
+}
+
 /*-------------- end - static/internal functions --------------*/
 
 void parse_input(char *inbuff, struct parse_object *prs_data)
 {
-    preprocess(inbuff);
-    char *argv[MAX_ARGS] = {NULL};
-    tokenize(inbuff, argv, MAX_ARGS);
-    prs_data->cmd = parse_cmd(argv[0]);
-    parse_args(argv, prs_data);
+    reset_args(prs_data);
+    struct token argv[MAX_ARGS];
+    size_t argc = tokenize(inbuff, argv, MAX_ARGS);
+    prs_data->cmd = argc > 0 ? parse_cmd(&argv[0]) : FAIL;
+    parse_args(argv, argc, prs_data);
+}
+
+void parse_argv(int argc, char *argv[], struct parse_object *prs_data)
+{
+    reset_args(prs_data);
+    struct token args[MAX_ARGS];
+    if (argc < 1 || argc > MAX_ARGS) {
+        prs_data->cmd = FAIL;
+        return;
+    }
+    for (int i = 0; i < argc; i++) {
+        args[i].ptr = argv[i];
+        args[i].len = strlen(argv[i]);
+    }
+    prs_data->cmd = parse_cmd(&args[0]);
+    parse_args(args, argc, prs_data);
+}
+
+// Command word of cmd, as typed at the prompt,
+// or "invalid" for FAIL
+const char *cmd_name(enum CMD cmd)
+{
+    return cmd_names[cmd];
 }
@@ -14,7 +14,8 @@
  * and the key, value, and table name fields are set accordingly.
  * If a command is not recognized or an incorrect number of
  * arguments is provided for a command, then the CMD field
- * is set to FAIL.
+ * is set to FAIL. Commands with optional settings, such as
+ * 'durability group 50', use the opt and num fields.
  *
  */
 
@@ -23,6 +24,7 @@
 #define PARSE_H
 
 #include <stddef.h>
+#include <stdbool.h>
 
 #include "pairdbconst.h"
 
@@ -35,19 +37,60 @@ enum CMD {
     GET,
     DELETE,
     SAVE,
+    BGSAVE,
     DROPTABLE,
     LSDATA,
     HELP,
+    DURABILITY,
+    CACHE,
+    INFO,
+    IMPORT,
+    EXPORT,
+    BEGIN,
+    COMMIT,
+    ABORT,
+    LATENCY,
     QUIT
 };
 
 struct parse_object {
     enum CMD cmd;
+
+    // Kept until another command sets it
     char tbl_name[TBL_NAME_MAX];
-    char key[KEY_MAX];
-    char val[VAL_MAX];
+    bool tbl_set;       // tbl_name set by the last command
+
+    // Arguments of the last command. They point into
+    // the buffer passed to parse_input, or to the
+    // strings passed to parse_argv, and are valid as
+    // long as it is. Arguments not given are "".
+    char *key;
+    char *val;
+    char *opt;          // Optional command setting
+    char *path;         // File argument
+    long num;           // Optional numeric argument, 0 if not given
+    long cursor;        // lsdata cursor, 0 if not given
+
+    // Reason cmd is FAIL if an argument is too long
+    // to be stored, NULL otherwise
+    const char *error;
 };
 
+// Parse command line in inbuff, which is changed:
+// tokens are unquoted, unescaped, and NUL terminated
+// in place. Escape sequences are \n, \t, \r, \\,
+// \", \', and \<space>; a backslash followed by any
+// other character is kept.
 void parse_input(char *inbuff, struct parse_object *prs_data);
 
+// Parse command given as argc separate strings,
+// without the quoting rules of parse_input.
+// Sets cmd to FAIL if there are more arguments
+// than any command takes.
+void parse_argv(int argc, char *argv[], struct parse_object *prs_data);
+
+// Command word of cmd, as typed at the prompt,
+// or "invalid" for FAIL
+const char *cmd_name(enum CMD cmd);
+
 #endif // PARSE_H
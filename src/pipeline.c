@@ -0,0 +1,416 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pipelined batch input and output. See pipeline.h.
+ *
+ * The reader owns a chunk from the time it takes it
+ * from the free ring until it passes it on through the
+ * full ring, and the caller from then until it releases
+ * it. The start of an unfinished line at the end of a
+ * block is moved to the start of the next chunk's
+ * block, so every line is parsed within one block.
+ *
+ * The output stream is a stdio stream with a custom
+ * write function (fopencookie). When its buffer fills,
+ * the buffer is copied into a free output block that is
+ * passed to the writer thread, so the caller does not
+ * wait for write calls.
+ *
+ */
+
+// fopencookie
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "pipeline.h"
+#include "parse.h"
+
+enum {
+    CACHE_LINE = 64,
+    RING_SIZE = 8,                  // Entries per ring, power of 2
+    RING_MASK = RING_SIZE - 1,
+    NCHUNKS = 4,                    // Chunks parsed ahead of the caller
+    CHUNK_BYTES = 1024 * 1024,      // Input block of a chunk
+    CHUNK_CMDS = 16384,             // Most commands in a chunk
+    NOUT_BLOCKS = 4,
+    OUT_BLOCK = 1024 * 1024
+};
+
+// Single-producer single-consumer ring of pointers.
+// head is written only by the consumer and tail only
+// by the producer, each on its own cache line. The
+// semaphores count entries and free slots, so that a
+// stage sleeps instead of spinning when its ring is
+// empty or full.
+struct ring {
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    _Alignas(CACHE_LINE) void *slots[RING_SIZE];
+    sem_t entries;
+    sem_t space;
+};
+
+// Chunk and the input block its commands point into
+struct chunk_buf {
+    struct cmd_chunk chunk;     // First member, so a chunk is its buffer
+    char *block;                // CHUNK_BYTES + 1 bytes
+};
+
+struct pipeline_obj {
+    int fd;
+    pthread_t reader;
+    bool done;                  // End of input passed to caller
+    struct ring full;           // Parsed chunks, then NULL at end of input
+    struct ring free;
+    struct chunk_buf bufs[NCHUNKS];
+};
+
+struct out_block {
+    size_t len;
+    char data[OUT_BLOCK];
+};
+
+struct output_obj {
+    int fd;
+    pthread_t writer;
+    atomic_bool failed;
+    struct ring full;           // Blocks to write, then NULL to stop
+    struct ring free;
+    struct out_block *blocks[NOUT_BLOCKS];
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+static void ring_init(struct ring *r)
+{
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    sem_init(&r->entries, 0, 0);
+    sem_init(&r->space, 0, RING_SIZE);
+}
+
+static void ring_destroy(struct ring *r)
+{
+    sem_destroy(&r->entries);
+    sem_destroy(&r->space);
+}
+
+// Wait for semaphore, retrying after signals
+static void sem_wait_all(sem_t *sem)
+{
+    while (sem_wait(sem) < 0 && errno == EINTR) {
+        continue;
+    }
+}
+
+// Add entry, waiting for a free slot
+static void ring_push(struct ring *r, void *p)
+{
+    sem_wait_all(&r->space);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    r->slots[tail & RING_MASK] = p;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    sem_post(&r->entries);
+}
+
+// Take oldest entry, waiting for one
+static void *ring_pop(struct ring *r)
+{
+    sem_wait_all(&r->entries);
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_load_explicit(&r->tail, memory_order_acquire);
+    void *p = r->slots[head & RING_MASK];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    sem_post(&r->space);
+    return p;
+}
+
+// Set cmd to a command line that was too long
+static void too_long(struct parse_object *cmd)
+{
+    char empty[] = "";
+    parse_input(empty, cmd);
+    cmd->error = "Command too long";
+}
+
+// Fill block, holding len bytes, with input up to
+// at least one newline. At end of input, a newline
+// is added after an unfinished last line.
+// Returns new length of block.
+static size_t fill_block(int fd, char *block, size_t len, bool *eof)
+{
+    while (len < CHUNK_BYTES) {
+        ssize_t n = read(fd, block + len, CHUNK_BYTES - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                perror("read");
+            }
+            *eof = true;
+            if (len > 0) {
+                block[len++] = '\n';
+            }
+            break;
+        }
+        len += n;
+        if (memchr(block + len - n, '\n', n)) {
+            break;
+        }
+    }
+    return len;
+}
+
+static void *reader_main(void *arg)
+{
+    pipeline pl = arg;
+    const char *carry = NULL;   // Unparsed input at end of last block
+    size_t carry_len = 0;
+    bool carry_lines = false;   // carry holds complete lines
+    bool skipping = false;      // Dropping a line that is too long
+    bool eof = false;
+
+    while (!eof || carry_lines) {
+        struct chunk_buf *buf = ring_pop(&pl->free);
+        char *block = buf->block;
+        memmove(block, carry, carry_len);
+        size_t len = carry_len;
+        if (!carry_lines) {
+            len = fill_block(pl->fd, block, len, &eof);
+        }
+
+        struct parse_object *cmds = buf->chunk.cmds;
+        size_t n = 0;
+        char *pos = block;
+        char *end = block + len;
+        char *nl;
+        while (n < CHUNK_CMDS && (nl = memchr(pos, '\n', end - pos))) {
+            if (skipping) {
+                too_long(&cmds[n++]);
+                skipping = false;
+            }
+            else if (nl - pos >= PIPE_LINE_MAX) {
+                too_long(&cmds[n++]);
+            }
+            // Blank lines are skipped
+            else if (nl > pos) {
+                *nl = '\0';
+                parse_input(pos, &cmds[n++]);
+            }
+            pos = nl + 1;
+        }
+        buf->chunk.ncmds = n;
+
+        // Keep the rest for the next block. An
+        // unfinished line longer than any command
+        // is dropped and reported at its newline.
+        carry = pos;
+        carry_len = end - pos;
+        carry_lines = n == CHUNK_CMDS && memchr(pos, '\n', carry_len);
+        if (!carry_lines && carry_len > PIPE_LINE_MAX) {
+            carry_len = 0;
+            skipping = true;
+        }
+        ring_push(&pl->full, buf);
+    }
+    ring_push(&pl->full, NULL);
+    return NULL;
+}
+
+static void free_pipeline(pipeline pl)
+{
+    for (size_t i = 0; i < NCHUNKS; i++) {
+        free(pl->bufs[i].chunk.cmds);
+        free(pl->bufs[i].block);
+    }
+    ring_destroy(&pl->full);
+    ring_destroy(&pl->free);
+    free(pl);
+}
+
+static void *writer_main(void *arg)
+{
+    struct output_obj *out = arg;
+    struct out_block *blk;
+    while ((blk = ring_pop(&out->full)) != NULL) {
+        const char *p = blk->data;
+        size_t len = blk->len;
+        while (len > 0 && !atomic_load(&out->failed)) {
+            ssize_t n = write(out->fd, p, len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                atomic_store(&out->failed, true);
+                break;
+            }
+            p += n;
+            len -= n;
+        }
+        ring_push(&out->free, blk);
+    }
+    return NULL;
+}
+
+// Write function of output stream. Copies buff
+// into output blocks for the writer thread.
+static ssize_t output_write(void *cookie, const char *buff, size_t size)
+{
+    struct output_obj *out = cookie;
+    if (atomic_load(&out->failed)) {
+        errno = EIO;
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        struct out_block *blk = ring_pop(&out->free);
+        blk->len = size - done < OUT_BLOCK ? size - done : OUT_BLOCK;
+        memcpy(blk->data, buff + done, blk->len);
+        done += blk->len;
+        ring_push(&out->full, blk);
+    }
+    return (ssize_t) size;
+}
+
+static void free_output(struct output_obj *out)
+{
+    for (size_t i = 0; i < NOUT_BLOCKS; i++) {
+        free(out->blocks[i]);
+    }
+    ring_destroy(&out->full);
+    ring_destroy(&out->free);
+    free(out);
+}
+
+// Close function of output stream. Waits for
+// the writer thread to write all blocks.
+static int output_close(void *cookie)
+{
+    struct output_obj *out = cookie;
+    ring_push(&out->full, NULL);
+    pthread_join(out->writer, NULL);
+    int result = atomic_load(&out->failed) ? -1 : 0;
+    free_output(out);
+    return result;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+pipeline pipeline_start(int fd)
+{
+    pipeline pl = calloc(1, sizeof(struct pipeline_obj));
+    if (!pl) {
+        return NULL;
+    }
+    pl->fd = fd;
+    ring_init(&pl->full);
+    ring_init(&pl->free);
+
+    for (size_t i = 0; i < NCHUNKS; i++) {
+        struct chunk_buf *buf = &pl->bufs[i];
+        buf->chunk.cmds = calloc(CHUNK_CMDS, sizeof(struct parse_object));
+        buf->block = malloc(CHUNK_BYTES + 1);
+        if (!buf->chunk.cmds || !buf->block) {
+            free_pipeline(pl);
+            return NULL;
+        }
+        ring_push(&pl->free, buf);
+    }
+
+    if (pthread_create(&pl->reader, NULL, reader_main, pl) != 0) {
+        free_pipeline(pl);
+        return NULL;
+    }
+    return pl;
+}
+
+struct cmd_chunk *pipeline_next(pipeline pl)
+{
+    if (pl->done) {
+        return NULL;
+    }
+    struct chunk_buf *buf = ring_pop(&pl->full);
+    if (!buf) {
+        pl->done = true;
+        return NULL;
+    }
+    return &buf->chunk;
+}
+
+void pipeline_release(pipeline pl, struct cmd_chunk *chunk)
+{
+    ring_push(&pl->free, (struct chunk_buf *) chunk);
+}
+
+void pipeline_stop(pipeline pl)
+{
+    if (!pl) {
+        return;
+    }
+    // The reader may still wait for input or for
+    // a free chunk if the caller stopped early
+    if (!pl->done) {
+        pthread_cancel(pl->reader);
+    }
+    pthread_join(pl->reader, NULL);
+    free_pipeline(pl);
+}
+
+FILE *pipeline_output(int fd)
+{
+    struct output_obj *out = calloc(1, sizeof(struct output_obj));
+    if (!out) {
+        return NULL;
+    }
+    out->fd = fd;
+    atomic_init(&out->failed, false);
+    ring_init(&out->full);
+    ring_init(&out->free);
+
+    for (size_t i = 0; i < NOUT_BLOCKS; i++) {
+        out->blocks[i] = malloc(sizeof(struct out_block));
+        if (!out->blocks[i]) {
+            free_output(out);
+            return NULL;
+        }
+        ring_push(&out->free, out->blocks[i]);
+    }
+
+    cookie_io_functions_t funcs = {
+        .read = NULL,
+        .write = output_write,
+        .seek = NULL,
+        .close = output_close
+    };
+    if (pthread_create(&out->writer, NULL, writer_main, out) != 0) {
+        free_output(out);
+        return NULL;
+    }
+    FILE *stream = fopencookie(out, "w", funcs);
+    if (!stream) {
+        ring_push(&out->full, NULL);
+        pthread_join(out->writer, NULL);
+        free_output(out);
+        return NULL;
+    }
+    setvbuf(stream, NULL, _IOFBF, OUT_BLOCK);
+    return stream;
+}
@@ -0,0 +1,80 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pipelined batch input and output.
+ *
+ * Batch mode runs in three stages on their own
+ * threads. A reader thread reads input in blocks and
+ * parses each line in place into a chunk of commands.
+ * The caller takes chunks in input order and runs
+ * their commands. Output written by the caller to a
+ * stream from pipeline_output is handed in large
+ * blocks to a writer thread.
+ *
+ * Stages pass chunks and output blocks through
+ * single-producer single-consumer rings. A full ring
+ * blocks its producer and an empty one its consumer,
+ * so each stage runs ahead of the next by at most a
+ * few blocks.
+ *
+ * Each command is parsed with its own parse_object,
+ * whose tbl_name is set only if tbl_set is true. The
+ * caller keeps the table name across commands.
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "parse.h"
+
+enum {
+    PIPE_LINE_MAX = 64 * 1024   // Longest command line
+};
+
+typedef struct pipeline_obj *pipeline;
+
+// Commands parsed from one block of input.
+// Arguments point into the block.
+struct cmd_chunk {
+    struct parse_object *cmds;
+    size_t ncmds;
+};
+
+// Start reader thread parsing the lines of fd.
+// Blank lines are skipped; a line longer than
+// PIPE_LINE_MAX is passed on as FAIL with error
+// "Command too long".
+// Returns NULL on memory allocation or thread
+// creation failure.
+pipeline pipeline_start(int fd);
+
+// Returns next chunk in input order, waiting for
+// it to be parsed, or NULL at end of input.
+struct cmd_chunk *pipeline_next(pipeline pl);
+
+// Return chunk from pipeline_next to the reader
+// once its commands have been run
+void pipeline_release(pipeline pl, struct cmd_chunk *chunk);
+
+// Stop reader thread, even if it waits for input,
+// and free pipeline
+void pipeline_stop(pipeline pl);
+
+// Returns fully buffered stream whose output is
+// written to fd by a writer thread. fclose flushes
+// the stream and waits for the writer to finish.
+// Returns NULL on memory allocation or thread
+// creation failure.
+FILE *pipeline_output(int fd);
+
+#endif // PIPELINE_H
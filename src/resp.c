@@ -0,0 +1,277 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * RESP2 decoder and reply encoders. See resp.h.
+ *
+ * The decoder makes one pass over a command and copies
+ * nothing: a bulk string is skipped by its length, so
+ * the cost of decoding does not depend on the size of
+ * keys and values. There is no limit on argument size
+ * other than RESP_MAX_BULK. A command that is not yet
+ * complete is decoded again from its start when more
+ * input arrives, which costs one step per argument.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "resp.h"
+
+enum {
+    ARGS_MIN = 8,
+    LEN_DIGITS_MAX = 18,
+    HEADER_MAX = 24     // Type byte, sign, 20 digits, \r\n
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Parse decimal length starting at p and ending
+// with \r\n. Sets next to the byte after \r\n.
+// Returns 1 on success, 0 if incomplete, -1 if
+// malformed.
+static int parse_len(const char *p, const char *end, long long *n, const char **next)
+{
+    long long val = 0;
+    int digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (++digits > LEN_DIGITS_MAX) {
+            return -1;
+        }
+        val = val * 10 + (*p - '0');
+    }
+    if (end - p < 2) {
+        return (p == end || *p == '\r') ? 0 : -1;
+    }
+    if (digits == 0 || p[0] != '\r' || p[1] != '\n') {
+        return -1;
+    }
+    *n = val;
+    *next = p + 2;
+    return 1;
+}
+
+// Make room for n arguments
+static int reserve_args(struct resp_cmd *cmd, size_t n)
+{
+    if (n <= cmd->cap) {
+        return 1;
+    }
+    size_t newcap = cmd->cap ? cmd->cap : ARGS_MIN;
+    while (newcap < n) {
+        newcap *= 2;
+    }
+    struct resp_arg *argv = realloc(cmd->argv, newcap * sizeof(struct resp_arg));
+    if (!argv) {
+        return -2;
+    }
+    cmd->argv = argv;
+    cmd->cap = newcap;
+    return 1;
+}
+
+// Decode inline command: words separated
+// by spaces or tabs on one line
+static ssize_t parse_inline(char *buf, size_t len, struct resp_cmd *cmd)
+{
+    char *nl = memchr(buf, '\n', len);
+    if (!nl) {
+        return len > RESP_INLINE_MAX ? -1 : 0;
+    }
+    char *end = nl;
+    if (end > buf && end[-1] == '\r') {
+        end--;
+    }
+
+    cmd->argc = 0;
+    char *p = buf;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        char *word = p;
+        while (p < end && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        if (reserve_args(cmd, cmd->argc + 1) < 0) {
+            return -2;
+        }
+        cmd->argv[cmd->argc].data = word;
+        cmd->argv[cmd->argc].len = p - word;
+        cmd->argc++;
+        // Separator or line end becomes the terminator
+        if (p < end) {
+            *p++ = '\0';
+        }
+    }
+    *end = '\0';
+    return nl + 1 - buf;
+}
+
+// Append type byte, number, and \r\n
+static int put_header(struct netbuf *out, char type, long long n)
+{
+    if (netbuf_reserve(out, HEADER_MAX) < 0) {
+        return -2;
+    }
+    char digits[HEADER_MAX];
+    char *d = digits + sizeof(digits);
+    unsigned long long u = n < 0 ? 0 - (unsigned long long) n : (unsigned long long) n;
+    do {
+        *--d = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (n < 0) {
+        *--d = '-';
+    }
+
+    char *dst = out->data + out->len;
+    size_t ndigits = digits + sizeof(digits) - d;
+    *dst++ = type;
+    memcpy(dst, d, ndigits);
+    dst += ndigits;
+    *dst++ = '\r';
+    *dst++ = '\n';
+    out->len = dst - out->data;
+    return 1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+// Decode the command at the start of buf.
+// Bulk string arguments are checked and recorded
+// first; they are terminated in place only once the
+// whole command is known to be in buf.
+ssize_t resp_parse(char *buf, size_t len, struct resp_cmd *cmd)
+{
+    if (len == 0) {
+        return 0;
+    }
+    if (buf[0] != '*') {
+        return parse_inline(buf, len, cmd);
+    }
+
+    const char *end = buf + len;
+    const char *p;
+    long long argc;
+    int ret = parse_len(buf + 1, end, &argc, &p);
+    if (ret <= 0) {
+        return ret;
+    }
+    if (argc > RESP_MAX_ARGS) {
+        return -1;
+    }
+    if (reserve_args(cmd, (size_t) argc) < 0) {
+        return -2;
+    }
+
+    for (long long i = 0; i < argc; i++) {
+        if (p == end) {
+            return 0;
+        }
+        if (*p != '$') {
+            return -1;
+        }
+        long long blen;
+        ret = parse_len(p + 1, end, &blen, &p);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (blen > RESP_MAX_BULK) {
+            return -1;
+        }
+        if (end - p < blen + 2) {
+            return 0;
+        }
+        if (p[blen] != '\r' || p[blen + 1] != '\n') {
+            return -1;
+        }
+        cmd->argv[i].data = buf + (p - buf);
+        cmd->argv[i].len = (size_t) blen;
+        p += blen + 2;
+    }
+
+    cmd->argc = (size_t) argc;
+    for (size_t i = 0; i < cmd->argc; i++) {
+        cmd->argv[i].data[cmd->argv[i].len] = '\0';
+    }
+    return p - buf;
+}
+
+void resp_cmd_free(struct resp_cmd *cmd)
+{
+    free(cmd->argv);
+    cmd->argv = NULL;
+    cmd->argc = 0;
+    cmd->cap = 0;
+}
+
+bool resp_storable(const struct resp_arg *arg, size_t max)
+{
+    return arg->len > 0 && arg->len < max && !memchr(arg->data, '\0', arg->len);
+}
+
+bool resp_check_storable(struct netbuf *out, const struct resp_arg *arg, size_t max)
+{
+    if (resp_storable(arg, max)) {
+        return true;
+    }
+    if (arg->len == 0) {
+        resp_error(out, "empty keys and values are not supported");
+    }
+    else if (arg->len >= max) {
+        netbuf_printf(out, "-ERR keys and values are limited to %zu bytes\r\n", max - 1);
+    }
+    else {
+        resp_error(out, "keys and values cannot contain NUL bytes");
+    }
+    return false;
+}
+
+int resp_simple(struct netbuf *out, const char *text)
+{
+    return netbuf_printf(out, "+%s\r\n", text);
+}
+
+int resp_error(struct netbuf *out, const char *msg)
+{
+    return netbuf_printf(out, "-ERR %s\r\n", msg);
+}
+
+int resp_int(struct netbuf *out, long long n)
+{
+    return put_header(out, ':', n);
+}
+
+int resp_bulk(struct netbuf *out, const char *data, size_t len)
+{
+    if (put_header(out, '$', (long long) len) < 0 ||
+        netbuf_reserve(out, len + 2) < 0) {
+        return -2;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    out->data[out->len++] = '\r';
+    out->data[out->len++] = '\n';
+    return 1;
+}
+
+int resp_nil(struct netbuf *out)
+{
+    return netbuf_append(out, "$-1\r\n", 5);
+}
+
+int resp_array(struct netbuf *out, size_t n)
+{
+    return put_header(out, '*', (long long) n);
+}
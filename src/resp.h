@@ -0,0 +1,99 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * RESP2, the protocol of Redis clients, for the
+ * pairdb server (see server.h).
+ *
+ * A command is an array of bulk strings:
+ *
+ *      *<argc>\r\n  then for each argument
+ *      $<len>\r\n<len bytes>\r\n
+ *
+ * or an inline command, a line of words separated by
+ * spaces. Replies are simple strings (+), errors (-),
+ * integers (:), bulk strings ($, $-1 for nil), and
+ * arrays (*).
+ *
+ * Commands are decoded in place: arguments point into
+ * the buffer holding the command, and the byte after
+ * each argument is overwritten with '\0' so arguments
+ * can be used as C strings. Arguments may still hold
+ * '\0' bytes, so their length is given as well.
+ *
+ */
+
+#ifndef RESP_H
+#define RESP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "wire.h"
+
+enum {
+    RESP_MAX_ARGS = 1024 * 1024,
+    RESP_MAX_BULK = 512 * 1024 * 1024,
+    RESP_INLINE_MAX = 64 * 1024
+};
+
+struct resp_arg {
+    char *data;
+    size_t len;
+};
+
+// Decoded command. The argument array is reused
+// by later commands.
+struct resp_cmd {
+    struct resp_arg *argv;
+    size_t argc;
+    size_t cap;
+};
+
+// Decode the command at the start of buf.
+// Returns number of bytes of the command, 0 if buf
+// does not yet hold a complete command, -1 if buf
+// does not start with a valid command, -2 on memory
+// allocation error. buf is modified only when a
+// complete command is decoded.
+ssize_t resp_parse(char *buf, size_t len, struct resp_cmd *cmd);
+
+void resp_cmd_free(struct resp_cmd *cmd);
+
+// Returns true if arg can be stored as a key or
+// value in a buffer of size max: not empty, shorter
+// than max, and without '\0' bytes.
+bool resp_storable(const struct resp_arg *arg, size_t max);
+
+// Appends an error reply and returns false if
+// arg cannot be stored in a buffer of size max
+bool resp_check_storable(struct netbuf *out, const struct resp_arg *arg, size_t max);
+
+// Reply encoders. Each returns -2 on memory
+// allocation error, 1 on success.
+
+// +<text>
+int resp_simple(struct netbuf *out, const char *text);
+
+// -ERR <msg>
+int resp_error(struct netbuf *out, const char *msg);
+
+// :<n>
+int resp_int(struct netbuf *out, long long n);
+
+// $<len> followed by len bytes of data
+int resp_bulk(struct netbuf *out, const char *data, size_t len);
+
+// $-1
+int resp_nil(struct netbuf *out);
+
+// *<n>, followed by n replies
+int resp_array(struct netbuf *out, size_t n);
+
+#endif // RESP_H
@@ -0,0 +1,1834 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pairdb server. See server.h.
+ *
+ * Every connection has an input buffer holding bytes
+ * read but not yet run, and an output buffer holding
+ * replies not yet sent. When a connection becomes
+ * readable, everything available is read and every
+ * complete command line in the input buffer is run,
+ * appending its reply to the output buffer. Replies
+ * are sent as far as the socket accepts them; the rest
+ * wait for the socket to become writable. A client
+ * that sends commands faster than it reads replies
+ * stops being read once OUT_HIGH bytes of replies are
+ * waiting, so one connection cannot grow its output
+ * buffer without bound.
+ *
+ * The database manager has one current table, while
+ * every connection has its own. Before running a
+ * command on a table, the table of the connection is
+ * made current with use_tbl, which finds the table
+ * already open in the table cache.
+ *
+ * A connection may have an open transaction (see
+ * txn.h) on its table. Its writes stay in the
+ * transaction until commit, so other connections
+ * read only the table, and a commit is applied while
+ * no other command runs.
+ *
+ * RESP connections share the same buffers and event
+ * loop. Their commands are decoded in place in the
+ * input buffer (see resp.c) and run directly on the
+ * database manager, without going through the command
+ * line parser, so keys and values are limited only by
+ * the table engines.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+
+#include "server.h"
+#include "wire.h"
+#include "resp.h"
+#include "parse.h"
+#include "db_manager.h"
+#include "messages.h"
+#include "stringutil.h"
+#include "uring.h"
+#include "txn.h"
+
+static const char *SOCKET_FNAME = "pairdb.sock";
+
+// Table of a new RESP connection, as Redis
+// clients start on database 0
+static const char *RESP_DEFAULT_TBL = "0";
+
+enum {
+    LINE_MAX_LEN = 64 * 1024,   // Longest command line
+    READ_MAX = 256 * 1024,      // Bytes read per connection per wakeup
+    RECV_CHUNK = 64 * 1024,     // Bytes read per connection per io_uring batch
+    OUT_HIGH = 4 * 1024 * 1024, // Stop reading above this much output
+    MAX_EVENTS = 64,
+    MAX_LISTENERS = 2,
+    SCAN_COUNT = 10,            // Default SCAN COUNT
+    POLL_MS = 500               // Wakeup interval to report bgsave
+};
+
+// Protocol of a listening socket and
+// of its connections
+enum proto {
+    PROTO_TEXT,
+    PROTO_RESP
+};
+
+struct listener {
+    int fd;
+    enum proto proto;
+    bool tcp;
+    const char *path;       // Unix socket, removed at exit
+};
+
+struct conn {
+    int fd;
+    enum proto proto;
+    struct netbuf in;
+    struct netbuf out;
+
+    // Current table of this connection, "" if none
+    char tbl_name[TBL_NAME_MAX];
+
+    // Open transaction on the table of this
+    // connection, NULL if none
+    txn trans;
+
+    // Peer closed its side, or sent quit. The
+    // connection is closed once replies are sent.
+    bool eof;
+    bool quit;
+
+    // Discarding a command line too long to run
+    // until its newline is found
+    bool skipping;
+
+    // Events registered with epoll
+    uint32_t events;
+
+    struct conn *prev;
+    struct conn *next;
+};
+
+struct server {
+    int epfd;
+    struct listener listeners[MAX_LISTENERS];
+    size_t numlisteners;
+    db_mgr dbm;
+
+    // Name of current table of dbm, "" if unknown
+    char curr_tbl[TBL_NAME_MAX];
+
+    // Lines of multi-line reply being built
+    struct netbuf lines;
+    size_t numlines;
+    size_t page_limit;      // Lines of lsdata page, 0 for all
+
+    // Arguments of RESP command being run
+    struct resp_cmd cmd;
+
+    struct conn *conns;
+    size_t numconns;
+    size_t requests;
+
+    // Ring of socket reads and sends, NULL with
+    // the blocking backend
+    uring ring;
+
+    // Read and send calls of the blocking backend
+    size_t io_calls;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/*---------------- Start - static/internal functions --------------*/
+
+static void handle_stop_signal(int sig)
+{
+    (void) sig;
+    stop_requested = 1;
+}
+
+/*
+ *
+ * Replies
+ *
+ */
+
+static void reply_ok(struct conn *c)
+{
+    netbuf_append(&c->out, "+OK\n", 4);
+}
+
+static void reply_text(struct conn *c, const char *text)
+{
+    netbuf_printf(&c->out, "+%s\n", text);
+}
+
+static void reply_err(struct conn *c, const char *msg)
+{
+    netbuf_printf(&c->out, "-%s\n", msg);
+}
+
+// Add one line to multi-line reply being built
+static void add_line(struct server *srv, const char *text)
+{
+    netbuf_printf(&srv->lines, "%s\n", text);
+    srv->numlines++;
+}
+
+// Send multi-line reply built with add_line
+static void reply_lines(struct server *srv, struct conn *c)
+{
+    netbuf_printf(&c->out, "*%zu\n", srv->numlines);
+    netbuf_append(&c->out, srv->lines.data + srv->lines.off, netbuf_used(&srv->lines));
+    netbuf_consume(&srv->lines, netbuf_used(&srv->lines));
+    srv->numlines = 0;
+}
+
+// Add every line of text to multi-line reply
+static void add_text_lines(struct server *srv, const char *text)
+{
+    const char *p = text;
+    const char *nl;
+    while ((nl = strchr(p, '\n')) != NULL) {
+        netbuf_append(&srv->lines, p, nl + 1 - p);
+        srv->numlines++;
+        p = nl + 1;
+    }
+    if (*p) {
+        add_line(srv, p);
+    }
+}
+
+/*
+ *
+ * Commands
+ *
+ */
+
+// Make table of connection the current table of
+// the database manager. Replies with an error and
+// returns false if it cannot be used.
+static bool select_conn_tbl(struct server *srv, struct conn *c)
+{
+    if (c->tbl_name[0] == '\0') {
+        reply_err(c, "No table selected: 'use <tbl_name>' or 'newtbl <tbl_name>'");
+        return false;
+    }
+    if (has_curr_tbl(srv->dbm) && strcmp(srv->curr_tbl, c->tbl_name) == 0) {
+        return true;
+    }
+
+    int ret = use_tbl(srv->dbm, c->tbl_name);
+    if (ret == -1) {
+        reply_err(c, "Table does not exist");
+        c->tbl_name[0] = '\0';
+        return false;
+    }
+    if (ret == -2) {
+        reply_err(c, "Table read error");
+        return false;
+    }
+    strtcpy(srv->curr_tbl, c->tbl_name, TBL_NAME_MAX);
+    return true;
+}
+
+static int add_pair_line(const char *key, const char *val, void *arg)
+{
+    struct server *srv = arg;
+    netbuf_printf(&srv->lines, "%s\t%s\n", key, val);
+    srv->numlines++;
+    return 0;
+}
+
+// Add pair line until limit of lsdata is reached
+static int add_page_line(const char *key, const char *val, void *arg)
+{
+    struct server *srv = arg;
+    add_pair_line(key, val, srv);
+    return srv->numlines == srv->page_limit;
+}
+
+static int add_tbl_entry_line(const struct cat_entry *entry, void *arg)
+{
+    struct server *srv = arg;
+    if (entry->entries == CAT_ENTRIES_UNKNOWN) {
+        netbuf_printf(&srv->lines, "%s\t%s\t-\t%llu\n", entry->name, entry->engine,
+                      (unsigned long long) entry->bytes);
+    }
+    else {
+        netbuf_printf(&srv->lines, "%s\t%s\t%llu\t%llu\n", entry->name, entry->engine,
+                      (unsigned long long) entry->entries,
+                      (unsigned long long) entry->bytes);
+    }
+    srv->numlines++;
+    return 0;
+}
+
+static void run_lstables(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    if (strcmp(prs->opt, "-l") == 0) {
+        list_tbls(srv->dbm, add_tbl_entry_line, srv);
+    }
+    else if (prs->opt[0] != '\0') {
+        reply_err(c, "Unknown option: lstbls [-l]");
+        return;
+    }
+    else {
+        size_t numtbls = get_numtbls(srv->dbm);
+        char **tbls = get_tbls(srv->dbm);
+        for (size_t i = 0; tbls && i < numtbls; i++) {
+            add_line(srv, tbls[i]);
+        }
+        free(tbls);
+    }
+    reply_lines(srv, c);
+}
+
+static void run_newtable(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    const char *engine = prs->opt[0] ? prs->opt : NULL;
+    int ret = get_new_tbl(srv->dbm, prs->tbl_name, engine);
+    if (ret == -1) {
+        reply_err(c, "Table already exists");
+    }
+    else if (ret == -3) {
+        reply_err(c, "Unknown table engine");
+    }
+    else if (ret < 0) {
+        reply_err(c, "Memory allocation error");
+    }
+    else {
+        strtcpy(c->tbl_name, prs->tbl_name, TBL_NAME_MAX);
+        strtcpy(srv->curr_tbl, prs->tbl_name, TBL_NAME_MAX);
+        reply_ok(c);
+    }
+}
+
+static void run_usetable(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    strtcpy(c->tbl_name, prs->tbl_name, TBL_NAME_MAX);
+    if (select_conn_tbl(srv, c)) {
+        reply_ok(c);
+    }
+}
+
+static void run_droptable(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    int ret = drop_tbl(srv->dbm, prs->tbl_name);
+    if (!has_curr_tbl(srv->dbm)) {
+        srv->curr_tbl[0] = '\0';
+    }
+    if (ret == -1) {
+        reply_err(c, "No file found - not deleted");
+    }
+    else if (ret < 0) {
+        reply_err(c, "File read error");
+    }
+    else {
+        reply_ok(c);
+    }
+}
+
+static void run_durability(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    struct durability_stats stats;
+    get_durability_stats(srv->dbm, &stats);
+
+    if (prs->opt[0] == '\0') {
+        netbuf_printf(&srv->lines, "mode: %s", durability_name(stats.mode));
+        if (stats.mode == DUR_GROUP) {
+            netbuf_printf(&srv->lines, " (%u ms)", stats.group_ms);
+        }
+        netbuf_printf(&srv->lines, "\nsaves: %zu\nbytes written: %zu\nfsyncs: %zu\n"
+                      "group commits: %zu\navg save time: %.3f ms\nio: %s\nio calls: %zu\n",
+                      stats.saves, stats.bytes, stats.fsyncs, stats.group_commits,
+                      stats.saves ? stats.save_msecs / stats.saves : 0.0,
+                      io_backend_name(stats.io), stats.io_calls);
+        srv->numlines += 8;
+        reply_lines(srv, c);
+        return;
+    }
+
+    enum durability mode;
+    if (find_durability(prs->opt, &mode) < 0) {
+        reply_err(c, "Unknown durability mode: none, on-save, group");
+        return;
+    }
+    unsigned int group_ms = prs->num > 0 ? (unsigned int) prs->num : stats.group_ms;
+    if (set_durability(srv->dbm, mode, group_ms) < 0) {
+        reply_err(c, "Could not set durability mode");
+        return;
+    }
+    reply_ok(c);
+}
+
+static void run_cache(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    if (prs->opt[0] != '\0') {
+        set_cache_budget(srv->dbm, (size_t) prs->num * 1024 * 1024);
+        reply_ok(c);
+        return;
+    }
+
+    struct cache_stats stats;
+    get_cache_stats(srv->dbm, &stats);
+    netbuf_printf(&srv->lines, "hits: %zu\nmisses: %zu\nevictions: %zu\n"
+                  "open tables: %zu\nresident: %zu bytes\nbudget: %zu bytes\n",
+                  stats.hits, stats.misses, stats.evictions, stats.open_tbls,
+                  stats.resident, stats.budget);
+    srv->numlines += 6;
+    reply_lines(srv, c);
+}
+
+static void run_info(struct server *srv, struct conn *c)
+{
+    struct tbl_info info;
+    if (get_tbl_info(srv->dbm, &info) < 0) {
+        reply_err(c, "No table selected");
+        return;
+    }
+
+    netbuf_printf(&srv->lines, "engine: %s\n", info.engine);
+    srv->numlines++;
+    for (size_t i = 0; i < info.numstats; i++) {
+        netbuf_printf(&srv->lines, "%s: %zu\n", info.stats[i].name, info.stats[i].value);
+        srv->numlines++;
+    }
+    reply_lines(srv, c);
+}
+
+// Import runs on the server thread, so other
+// clients wait until it is done
+static void run_import(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    enum bulk_format fmt = find_bulk_format(prs->opt, prs->path);
+    if (fmt == BULK_UNKNOWN) {
+        reply_err(c, "Unknown import format");
+        return;
+    }
+    if (access(prs->path, R_OK) < 0) {
+        netbuf_printf(&c->out, "-Cannot read file %s\n", prs->path);
+        return;
+    }
+
+    int ret = use_tbl(srv->dbm, prs->tbl_name);
+    if (ret == -1) {
+        ret = get_new_tbl(srv->dbm, prs->tbl_name, NULL);
+    }
+    if (ret < 0) {
+        reply_err(c, "Memory allocation error");
+        return;
+    }
+    strtcpy(c->tbl_name, prs->tbl_name, TBL_NAME_MAX);
+    strtcpy(srv->curr_tbl, prs->tbl_name, TBL_NAME_MAX);
+
+    struct import_stats stats;
+    ret = import_tbl(srv->dbm, prs->path, fmt, &stats, NULL, NULL);
+    if (ret == -1) {
+        netbuf_printf(&c->out, "-Cannot read file %s\n", prs->path);
+        return;
+    }
+    if (ret < 0) {
+        reply_err(c, "Memory allocation error");
+        return;
+    }
+    netbuf_printf(&c->out, "+Imported %zu of %zu rows in %.2f s, "
+                  "%zu duplicate and %zu malformed rows skipped\n",
+                  stats.added, stats.rows, stats.secs, stats.duplicates,
+                  stats.malformed);
+}
+
+static void run_export(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    enum bulk_format fmt = find_bulk_format(prs->opt, prs->path);
+    if (fmt == BULK_UNKNOWN) {
+        reply_err(c, "Unknown export format");
+        return;
+    }
+
+    char prev[TBL_NAME_MAX];
+    strtcpy(prev, c->tbl_name, TBL_NAME_MAX);
+    strtcpy(c->tbl_name, prs->tbl_name, TBL_NAME_MAX);
+    if (!select_conn_tbl(srv, c)) {
+        strtcpy(c->tbl_name, prev, TBL_NAME_MAX);
+        return;
+    }
+
+    struct export_stats stats;
+    if (export_tbl(srv->dbm, prs->path, fmt, prs->num == 1, &stats) < 0) {
+        netbuf_printf(&c->out, "-Cannot write file %s\n", prs->path);
+        return;
+    }
+    netbuf_printf(&c->out, "+Exported %zu rows in %.2f s\n", stats.rows, stats.secs);
+}
+
+static void run_bgsave(struct server *srv, struct conn *c)
+{
+    int ret = bgsave_curr_tbl(srv->dbm);
+    if (ret == 1) {
+        reply_text(c, "Background save started");
+    }
+    else if (ret == 0) {
+        reply_text(c, "No changes to save");
+    }
+    else if (ret == -2) {
+        reply_err(c, "Background save already in progress");
+    }
+    else {
+        reply_err(c, "Background save failed to start");
+    }
+}
+
+// Lists pairs of table of connection, or of the
+// table as seen by its transaction. With a limit,
+// a last line "cursor <C>" gives the position of
+// the next page if pairs are left. Pairs are sent
+// as key<TAB>val lines in any format but json.
+static void run_lsdata(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    if (prs->opt[0] != '\0' && strcmp(prs->opt, "plain") != 0 &&
+        strcmp(prs->opt, "tsv") != 0) {
+        reply_err(c, "Unknown lsdata format");
+        return;
+    }
+    if (c->trans) {
+        if (prs->num > 0 || prs->cursor > 0) {
+            reply_err(c, "limit and cursor are not available in a transaction");
+            return;
+        }
+        txn_iterate(c->trans, add_pair_line, srv);
+        reply_lines(srv, c);
+        return;
+    }
+
+    size_t cursor = prs->cursor;
+    srv->page_limit = prs->num;
+    scan_tbl(srv->dbm, &cursor, add_page_line, srv);
+    if (cursor > 0) {
+        netbuf_printf(&srv->lines, "cursor %zu\n", cursor);
+        srv->numlines++;
+    }
+    reply_lines(srv, c);
+}
+
+static int add_slow_line(const struct lat_slow *entry, void *arg)
+{
+    struct server *srv = arg;
+    char events[64];
+    format_db_events(entry->events, events, sizeof(events));
+    netbuf_printf(&srv->lines, "%lld %s %.3f ms %s %s %s\n", (long long) entry->when,
+                  cmd_name(entry->cmd), entry->ns / 1e6,
+                  entry->tbl_name[0] ? entry->tbl_name : "-",
+                  entry->arg[0] ? entry->arg : "-", events);
+    srv->numlines++;
+    return 0;
+}
+
+// Latencies of commands run by the server, in
+// microseconds, as by 'latency' at the prompt.
+// Slow log lines give the time the command
+// finished in seconds since the epoch.
+static void run_latency(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    latency lat = get_latency(srv->dbm);
+    bool ms_given = prs->key[0] != '\0';
+
+    if (strcmp(prs->opt, "slow") == 0 && ms_given) {
+        latency_set_slow_ms(lat, (unsigned int) prs->num);
+        reply_ok(c);
+        return;
+    }
+    if (strcmp(prs->opt, "slow") == 0) {
+        latency_slowlog(lat, add_slow_line, srv);
+        reply_lines(srv, c);
+        return;
+    }
+    if (ms_given) {
+        reply_err(c, "Unknown command or wrong arguments - 'help' lists commands");
+        return;
+    }
+    if (strcmp(prs->opt, "reset") == 0) {
+        latency_reset(lat);
+        reply_ok(c);
+        return;
+    }
+
+    // One command - its summary and histogram
+    // buckets, as "<low_ns> <high_ns> <count>"
+    bool one = prs->opt[0] != '\0';
+    bool found = false;
+    for (int cmd = LSTABLES; cmd <= QUIT; cmd++) {
+        if (one && strcmp(prs->opt, cmd_name(cmd)) != 0) {
+            continue;
+        }
+        found = true;
+        struct lat_summary sum;
+        latency_summary(lat, cmd, &sum);
+        if (sum.count == 0) {
+            continue;
+        }
+        netbuf_printf(&srv->lines, "%s count %llu mean %.1f p50 %.1f p90 %.1f "
+                      "p99 %.1f p99.9 %.1f max %.1f\n", cmd_name(cmd),
+                      (unsigned long long) sum.count, sum.total_ns / 1e3 / sum.count,
+                      sum.p50_ns / 1e3, sum.p90_ns / 1e3, sum.p99_ns / 1e3,
+                      sum.p999_ns / 1e3, sum.max_ns / 1e3);
+        srv->numlines++;
+        for (size_t b = 0; one && b < LAT_BUCKETS; b++) {
+            uint64_t low;
+            uint64_t high;
+            uint64_t count = latency_bucket(lat, cmd, b, &low, &high);
+            if (count > 0) {
+                netbuf_printf(&srv->lines, "%llu %llu %llu\n", (unsigned long long) low,
+                              (unsigned long long) high, (unsigned long long) count);
+                srv->numlines++;
+            }
+        }
+    }
+    if (!found) {
+        reply_err(c, "Unknown command");
+        return;
+    }
+    reply_lines(srv, c);
+}
+
+static void run_begin(struct server *srv, struct conn *c)
+{
+    c->trans = txn_begin(srv->dbm);
+    if (!c->trans) {
+        reply_err(c, "Memory allocation error");
+    }
+    else {
+        reply_ok(c);
+    }
+}
+
+// Commit transaction of connection, whose
+// table is the current table
+static void run_commit(struct conn *c)
+{
+    int ret = txn_commit(c->trans);
+    c->trans = NULL;
+    if (ret == -1) {
+        reply_err(c, "Transaction aborted: a key it adds was added since it began");
+    }
+    else if (ret == -2) {
+        reply_err(c, "Memory allocation error - transaction aborted");
+    }
+    else if (ret == -3) {
+        reply_err(c, "Table save failed");
+    }
+    else {
+        reply_ok(c);
+    }
+}
+
+// Returns true if cmd changes or saves tables
+// and cannot be used in a transaction
+static bool ends_txn_first(enum CMD cmd)
+{
+    switch (cmd) {
+        case NEWTABLE:
+        case USETABLE:
+        case SAVE:
+        case BGSAVE:
+        case DROPTABLE:
+        case IMPORT:
+        case EXPORT:
+        case BEGIN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Run one parsed command and append its reply
+static void run_command(struct server *srv, struct conn *c, struct parse_object *prs)
+{
+    char buff[VAL_MAX];
+
+    if (c->trans && ends_txn_first(prs->cmd)) {
+        reply_err(c, "Transaction in progress: 'commit' or 'abort' first");
+        return;
+    }
+    if ((prs->cmd == COMMIT || prs->cmd == ABORT) && !c->trans) {
+        reply_err(c, "No transaction in progress");
+        return;
+    }
+
+    // Commands on the current table of the connection.
+    // A transaction whose table cannot be used is
+    // aborted.
+    switch (prs->cmd) {
+        case ADD:
+        case GET:
+        case DELETE:
+        case SAVE:
+        case BGSAVE:
+        case LSDATA:
+        case INFO:
+        case BEGIN:
+        case COMMIT:
+            if (!select_conn_tbl(srv, c)) {
+                txn_abort(c->trans);
+                c->trans = NULL;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    switch (prs->cmd) {
+        case FAIL:
+            reply_err(c, prs->error ? prs->error :
+                      "Unknown command or wrong arguments - 'help' lists commands");
+            break;
+
+        case LSTABLES:
+            run_lstables(srv, c, prs);
+            break;
+
+        case NEWTABLE:
+            run_newtable(srv, c, prs);
+            break;
+
+        case USETABLE:
+            run_usetable(srv, c, prs);
+            break;
+
+        case ADD: {
+            int ret = c->trans ? txn_add(c->trans, prs->key, prs->val) :
+                                 add(srv->dbm, prs->key, prs->val);
+            if (ret == -1) {
+                netbuf_printf(&c->out, "-Key %s already exists\n", prs->key);
+            }
+            else if (ret < 0) {
+                reply_err(c, "Memory allocation error");
+            }
+            else {
+                reply_ok(c);
+            }
+            break;
+        }
+
+        case GET:
+            if ((c->trans ? txn_get(buff, VAL_MAX, c->trans, prs->key) :
+                            get(buff, VAL_MAX, srv->dbm, prs->key)) == 0) {
+                reply_err(c, "Value not found");
+            }
+            else {
+                reply_text(c, buff);
+            }
+            break;
+
+        case DELETE:
+            if (c->trans) {
+                txn_remove(c->trans, prs->key);
+            }
+            else {
+                db_remove(srv->dbm, prs->key);
+            }
+            reply_ok(c);
+            break;
+
+        case SAVE:
+            if (save_curr_tbl(srv->dbm) < 0) {
+                reply_err(c, "Table save failed");
+            }
+            else {
+                reply_ok(c);
+            }
+            break;
+
+        case BGSAVE:
+            run_bgsave(srv, c);
+            break;
+
+        case DROPTABLE:
+            run_droptable(srv, c, prs);
+            break;
+
+        case LSDATA:
+            run_lsdata(srv, c, prs);
+            break;
+
+        case HELP:
+            add_text_lines(srv, long_help_msg());
+            reply_lines(srv, c);
+            break;
+
+        case DURABILITY:
+            run_durability(srv, c, prs);
+            break;
+
+        case CACHE:
+            run_cache(srv, c, prs);
+            break;
+
+        case INFO:
+            run_info(srv, c);
+            break;
+
+        case IMPORT:
+            run_import(srv, c, prs);
+            break;
+
+        case EXPORT:
+            run_export(srv, c, prs);
+            break;
+
+        case BEGIN:
+            run_begin(srv, c);
+            break;
+
+        case COMMIT:
+            run_commit(c);
+            break;
+
+        case ABORT:
+            txn_abort(c->trans);
+            c->trans = NULL;
+            reply_ok(c);
+            break;
+
+        case LATENCY:
+            run_latency(srv, c, prs);
+            break;
+
+        case QUIT:
+            reply_ok(c);
+            c->quit = true;
+            c->eof = true;
+            break;
+    }
+}
+
+// Run command line of len bytes, without its
+// newline, parsed in place in the input buffer
+static void run_line(struct server *srv, struct conn *c, char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    line[len] = '\0';
+
+    struct parse_object prs = {0};
+    parse_input(line, &prs);
+    if (prs.cmd == FAIL || prs.cmd == LATENCY) {
+        run_command(srv, c, &prs);
+    }
+    else {
+        struct timespec start;
+        start_cmd_latency(srv->dbm, &start);
+        run_command(srv, c, &prs);
+        record_cmd_latency(srv->dbm, prs.cmd, &start, c->tbl_name,
+                           prs.key[0] != '\0' ? prs.key : prs.path);
+    }
+    srv->requests++;
+}
+
+// Run complete command lines in input buffer
+// until OUT_HIGH bytes of replies are waiting.
+// Returns true if a complete line is left.
+static bool run_text_requests(struct server *srv, struct conn *c)
+{
+    while (!c->quit) {
+        char *start = c->in.data + c->in.off;
+        size_t used = netbuf_used(&c->in);
+        char *nl = used ? memchr(start, '\n', used) : NULL;
+
+        if (!nl) {
+            // A line longer than any command is dropped
+            // as it arrives and answered at its newline
+            if (used > LINE_MAX_LEN) {
+                netbuf_consume(&c->in, used);
+                c->skipping = true;
+            }
+            return false;
+        }
+        if (netbuf_used(&c->out) >= OUT_HIGH) {
+            return true;
+        }
+
+        if (c->skipping || nl - start > LINE_MAX_LEN) {
+            reply_err(c, "Command too long");
+            c->skipping = false;
+        }
+        else {
+            run_line(srv, c, start, nl - start);
+        }
+        netbuf_consume(&c->in, nl + 1 - start);
+    }
+    return false;
+}
+
+/*
+ *
+ * RESP commands
+ *
+ */
+
+// Make table of RESP connection the current table
+// of the database manager, creating it if create is
+// true. Returns 0 if the table does not exist and
+// create is false, -1 after replying with an error.
+static int select_resp_tbl(struct server *srv, struct conn *c, bool create)
+{
+    if (has_curr_tbl(srv->dbm) && strcmp(srv->curr_tbl, c->tbl_name) == 0) {
+        return 1;
+    }
+
+    int ret = use_tbl(srv->dbm, c->tbl_name);
+    if (ret == -1 && create) {
+        ret = get_new_tbl(srv->dbm, c->tbl_name, NULL);
+    }
+    if (ret == -1) {
+        return 0;
+    }
+    if (ret < 0) {
+        resp_error(&c->out, "table read error");
+        return -1;
+    }
+    strtcpy(srv->curr_tbl, c->tbl_name, TBL_NAME_MAX);
+    return 1;
+}
+
+// Add key and val to current table,
+// replacing the value of an existing key
+static int set_pair(struct server *srv, char *key, char *val)
+{
+    if (has_key(srv->dbm, key)) {
+        db_remove(srv->dbm, key);
+    }
+    return add(srv->dbm, key, val);
+}
+
+static void resp_run_ping(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) srv;
+    if (cmd->argc == 2) {
+        resp_bulk(&c->out, cmd->argv[1].data, cmd->argv[1].len);
+    }
+    else {
+        resp_simple(&c->out, "PONG");
+    }
+}
+
+static void resp_run_echo(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) srv;
+    resp_bulk(&c->out, cmd->argv[1].data, cmd->argv[1].len);
+}
+
+static void resp_run_quit(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) srv;
+    (void) cmd;
+    resp_simple(&c->out, "OK");
+    c->quit = true;
+    c->eof = true;
+}
+
+// Client libraries ask for command details
+// on connecting; none are given
+static void resp_run_command(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) srv;
+    (void) cmd;
+    resp_array(&c->out, 0);
+}
+
+static void resp_run_select(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) srv;
+    if (!resp_storable(&cmd->argv[1], TBL_NAME_MAX)) {
+        resp_error(&c->out, "invalid table name");
+        return;
+    }
+    strtcpy(c->tbl_name, cmd->argv[1].data, TBL_NAME_MAX);
+    resp_simple(&c->out, "OK");
+}
+
+static void resp_run_get(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    char buff[VAL_MAX];
+    size_t len = 0;
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel < 0) {
+        return;
+    }
+    if (sel == 1 && resp_storable(&cmd->argv[1], KEY_MAX)) {
+        len = get(buff, VAL_MAX, srv->dbm, cmd->argv[1].data);
+    }
+
+    if (len == 0) {
+        resp_nil(&c->out);
+    }
+    else {
+        resp_bulk(&c->out, buff, len);
+    }
+}
+
+// SET key val [NX|XX]
+static void resp_run_set(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    bool nx = false;
+    bool xx = false;
+    for (size_t i = 3; i < cmd->argc; i++) {
+        if (strcasecmp(cmd->argv[i].data, "NX") == 0) {
+            nx = true;
+        }
+        else if (strcasecmp(cmd->argv[i].data, "XX") == 0) {
+            xx = true;
+        }
+        else {
+            resp_error(&c->out, "syntax error");
+            return;
+        }
+    }
+    if (nx && xx) {
+        resp_error(&c->out, "syntax error");
+        return;
+    }
+    if (!resp_check_storable(&c->out, &cmd->argv[1], KEY_MAX) ||
+        !resp_check_storable(&c->out, &cmd->argv[2], VAL_MAX)) {
+        return;
+    }
+    if (select_resp_tbl(srv, c, true) < 0) {
+        return;
+    }
+
+    char *key = cmd->argv[1].data;
+    if (nx || xx) {
+        bool exists = has_key(srv->dbm, key);
+        if ((nx && exists) || (xx && !exists)) {
+            resp_nil(&c->out);
+            return;
+        }
+    }
+    if (set_pair(srv, key, cmd->argv[2].data) < 0) {
+        resp_error(&c->out, "memory allocation error");
+        return;
+    }
+    resp_simple(&c->out, "OK");
+}
+
+// Number of keys of cmd in current table,
+// removing them if remove is true
+static long long count_keys(struct server *srv, struct resp_cmd *cmd, bool remove)
+{
+    long long n = 0;
+    for (size_t i = 1; i < cmd->argc; i++) {
+        char *key = cmd->argv[i].data;
+        if (resp_storable(&cmd->argv[i], KEY_MAX) && has_key(srv->dbm, key)) {
+            if (remove) {
+                db_remove(srv->dbm, key);
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+static void resp_run_del(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel >= 0) {
+        resp_int(&c->out, sel == 1 ? count_keys(srv, cmd, true) : 0);
+    }
+}
+
+static void resp_run_exists(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel >= 0) {
+        resp_int(&c->out, sel == 1 ? count_keys(srv, cmd, false) : 0);
+    }
+}
+
+static void resp_run_mget(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    char buff[VAL_MAX];
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel < 0) {
+        return;
+    }
+
+    resp_array(&c->out, cmd->argc - 1);
+    for (size_t i = 1; i < cmd->argc; i++) {
+        size_t len = 0;
+        if (sel == 1 && resp_storable(&cmd->argv[i], KEY_MAX)) {
+            len = get(buff, VAL_MAX, srv->dbm, cmd->argv[i].data);
+        }
+        if (len == 0) {
+            resp_nil(&c->out);
+        }
+        else {
+            resp_bulk(&c->out, buff, len);
+        }
+    }
+}
+
+// MSET key val [key val ...] - pairs are checked
+// first so that either all or none are set
+static void resp_run_mset(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    if (cmd->argc % 2 == 0) {
+        resp_error(&c->out, "wrong number of arguments for 'mset' command");
+        return;
+    }
+    for (size_t i = 1; i < cmd->argc; i += 2) {
+        if (!resp_check_storable(&c->out, &cmd->argv[i], KEY_MAX) ||
+            !resp_check_storable(&c->out, &cmd->argv[i + 1], VAL_MAX)) {
+            return;
+        }
+    }
+    if (select_resp_tbl(srv, c, true) < 0) {
+        return;
+    }
+
+    for (size_t i = 1; i < cmd->argc; i += 2) {
+        if (set_pair(srv, cmd->argv[i].data, cmd->argv[i + 1].data) < 0) {
+            resp_error(&c->out, "memory allocation error");
+            return;
+        }
+    }
+    resp_simple(&c->out, "OK");
+}
+
+static void resp_run_dbsize(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    (void) cmd;
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel >= 0) {
+        resp_int(&c->out, sel == 1 ? (long long) get_num_tbl_entries(srv->dbm) : 0);
+    }
+}
+
+// State of a SCAN call
+struct scan_state {
+    struct server *srv;
+    size_t count;       // Entries to visit in this call
+    size_t visited;
+    const char *pattern;
+    size_t numkeys;
+};
+
+static int scan_key(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    struct scan_state *st = arg;
+    if (!st->pattern || fnmatch(st->pattern, key, 0) == 0) {
+        resp_bulk(&st->srv->lines, key, strlen(key));
+        st->numkeys++;
+    }
+    st->visited++;
+    return st->visited == st->count;
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count]
+// The cursor is the scan_tbl position of the table
+// where the call resumes, so a scan of a table that
+// does not change returns every key exactly once.
+static void resp_run_scan(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    struct scan_state st = {.srv = srv, .count = SCAN_COUNT};
+    char *end;
+    size_t cursor = strtoull(cmd->argv[1].data, &end, 10);
+    if (*end != '\0' || cmd->argv[1].data[0] == '-') {
+        resp_error(&c->out, "invalid cursor");
+        return;
+    }
+    for (size_t i = 2; i < cmd->argc; i += 2) {
+        if (i + 1 == cmd->argc) {
+            resp_error(&c->out, "syntax error");
+            return;
+        }
+        const char *val = cmd->argv[i + 1].data;
+        if (strcasecmp(cmd->argv[i].data, "MATCH") == 0) {
+            st.pattern = strcmp(val, "*") == 0 ? NULL : val;
+        }
+        else if (strcasecmp(cmd->argv[i].data, "COUNT") == 0) {
+            st.count = strtoull(val, &end, 10);
+            if (*end != '\0' || st.count == 0 || val[0] == '-') {
+                resp_error(&c->out, "syntax error");
+                return;
+            }
+        }
+        else {
+            resp_error(&c->out, "syntax error");
+            return;
+        }
+    }
+
+    int sel = select_resp_tbl(srv, c, false);
+    if (sel < 0) {
+        return;
+    }
+    if (sel == 1) {
+        scan_tbl(srv->dbm, &cursor, scan_key, &st);
+    }
+    else {
+        cursor = 0;
+    }
+
+    char next[24];
+    int len = snprintf(next, sizeof(next), "%zu", cursor);
+    resp_array(&c->out, 2);
+    resp_bulk(&c->out, next, len);
+    resp_array(&c->out, st.numkeys);
+    netbuf_append(&c->out, srv->lines.data + srv->lines.off, netbuf_used(&srv->lines));
+    netbuf_consume(&srv->lines, netbuf_used(&srv->lines));
+}
+
+struct resp_command {
+    const char *name;
+    size_t min_args;    // Including command name
+    size_t max_args;    // 0 if unlimited
+    void (*run)(struct server *srv, struct conn *c, struct resp_cmd *cmd);
+};
+
+static const struct resp_command resp_commands[] = {
+    {"get", 2, 2, resp_run_get},
+    {"set", 3, 5, resp_run_set},
+    {"mget", 2, 0, resp_run_mget},
+    {"mset", 3, 0, resp_run_mset},
+    {"del", 2, 0, resp_run_del},
+    {"exists", 2, 0, resp_run_exists},
+    {"scan", 2, 6, resp_run_scan},
+    {"dbsize", 1, 1, resp_run_dbsize},
+    {"select", 2, 2, resp_run_select},
+    {"ping", 1, 2, resp_run_ping},
+    {"echo", 2, 2, resp_run_echo},
+    {"quit", 1, 1, resp_run_quit},
+    {"command", 1, 0, resp_run_command}
+};
+
+// Run one decoded RESP command and append its reply
+static void run_resp_command(struct server *srv, struct conn *c, struct resp_cmd *cmd)
+{
+    const char *name = cmd->argv[0].data;
+    size_t numcmds = sizeof(resp_commands) / sizeof(resp_commands[0]);
+    for (size_t i = 0; i < numcmds; i++) {
+        const struct resp_command *rc = &resp_commands[i];
+        if (strcasecmp(name, rc->name) != 0) {
+            continue;
+        }
+        if (cmd->argc < rc->min_args || (rc->max_args && cmd->argc > rc->max_args)) {
+            netbuf_printf(&c->out, "-ERR wrong number of arguments for '%s' command\r\n",
+                          rc->name);
+            return;
+        }
+        rc->run(srv, c, cmd);
+        return;
+    }
+
+    resp_error(&c->out, "unknown command");
+}
+
+// Run complete RESP commands in input buffer
+// until OUT_HIGH bytes of replies are waiting.
+// Returns true if input is left. A malformed
+// command closes the connection after an error
+// reply, as the rest of the input cannot be
+// decoded.
+static bool run_resp_requests(struct server *srv, struct conn *c)
+{
+    while (!c->quit) {
+        if (netbuf_used(&c->out) >= OUT_HIGH) {
+            return netbuf_used(&c->in) > 0;
+        }
+
+        ssize_t len = resp_parse(c->in.data + c->in.off, netbuf_used(&c->in), &srv->cmd);
+        if (len == 0) {
+            return false;
+        }
+        if (len < 0) {
+            resp_error(&c->out, len == -1 ? "Protocol error" : "memory allocation error");
+            netbuf_consume(&c->in, netbuf_used(&c->in));
+            c->quit = true;
+            c->eof = true;
+            return false;
+        }
+
+        if (srv->cmd.argc > 0) {
+            run_resp_command(srv, c, &srv->cmd);
+            srv->requests++;
+        }
+        netbuf_consume(&c->in, len);
+    }
+    return false;
+}
+
+// Run waiting requests in the protocol of
+// the connection. Returns true if a complete
+// request may be left.
+static bool run_requests(struct server *srv, struct conn *c)
+{
+    if (c->proto == PROTO_RESP) {
+        return run_resp_requests(srv, c);
+    }
+    return run_text_requests(srv, c);
+}
+
+/*
+ *
+ * Connections
+ *
+ */
+
+// Returns listener at ptr, NULL if
+// ptr is a connection
+static struct listener *find_listener(struct server *srv, void *ptr)
+{
+    for (size_t i = 0; i < srv->numlisteners; i++) {
+        if (ptr == &srv->listeners[i]) {
+            return &srv->listeners[i];
+        }
+    }
+    return NULL;
+}
+
+static void close_conn(struct server *srv, struct conn *c)
+{
+    epoll_ctl(srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    netbuf_free(&c->in);
+    netbuf_free(&c->out);
+    txn_abort(c->trans);
+
+    if (c->prev) {
+        c->prev->next = c->next;
+    }
+    else {
+        srv->conns = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    srv->numconns--;
+    free(c);
+}
+
+static void accept_conns(struct server *srv, struct listener *l)
+{
+    for (;;) {
+        int fd = accept(l->fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            close(fd);
+            continue;
+        }
+
+        struct conn *c = calloc(1, sizeof(struct conn));
+        if (!c) {
+            close(fd);
+            return;
+        }
+        c->fd = fd;
+        c->proto = l->proto;
+        if (c->proto == PROTO_RESP) {
+            strtcpy(c->tbl_name, RESP_DEFAULT_TBL, TBL_NAME_MAX);
+        }
+        if (l->tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        c->events = EPOLLIN;
+        struct epoll_event ev = {.events = c->events, .data.ptr = c};
+        if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(c);
+            return;
+        }
+
+        c->next = srv->conns;
+        if (srv->conns) {
+            srv->conns->prev = c;
+        }
+        srv->conns = c;
+        srv->numconns++;
+    }
+}
+
+// Update epoll events of connection after its
+// requests are run, or close it if it is finished
+static void finish_conn(struct server *srv, struct conn *c, bool more)
+{
+    if (c->eof && netbuf_used(&c->out) == 0 && !more) {
+        close_conn(srv, c);
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!c->eof && netbuf_used(&c->out) < OUT_HIGH) {
+        events |= EPOLLIN;
+    }
+    if (netbuf_used(&c->out) > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events) {
+        struct epoll_event ev = {.events = events, .data.ptr = c};
+        epoll_ctl(srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+// Run waiting requests, send replies, and update
+// epoll events of connection. Closes connection
+// when it is finished or fails.
+static void service_conn(struct server *srv, struct conn *c)
+{
+    bool more;
+    do {
+        more = run_requests(srv, c);
+        int calls = netbuf_send(&c->out, c->fd);
+        if (calls < 0) {
+            close_conn(srv, c);
+            return;
+        }
+        srv->io_calls += calls;
+    } while (more && netbuf_used(&c->out) == 0);
+
+    finish_conn(srv, c, more);
+}
+
+// Serve events of one epoll_wait with the
+// blocking backend
+static void serve_events(struct server *srv, struct epoll_event *events, int n)
+{
+    for (int i = 0; i < n; i++) {
+        struct listener *l = find_listener(srv, events[i].data.ptr);
+        if (l) {
+            accept_conns(srv, l);
+            continue;
+        }
+        struct conn *c = events[i].data.ptr;
+        if (events[i].events & EPOLLERR) {
+            close_conn(srv, c);
+            continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+            int calls = netbuf_read(&c->in, c->fd, READ_MAX, &c->eof);
+            if (calls < 0) {
+                close_conn(srv, c);
+                continue;
+            }
+            srv->io_calls += calls;
+        }
+        service_conn(srv, c);
+    }
+}
+
+// Queue one send of the waiting replies of each
+// connection of batch with output, submit them
+// together, and take their results. Connections
+// whose send fails are marked failed.
+static void uring_send_batch(struct server *srv, struct conn **batch, bool *failed,
+                             size_t n)
+{
+    unsigned queued = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct conn *c = batch[i];
+        if (!c || failed[i] || netbuf_used(&c->out) == 0) {
+            continue;
+        }
+        if (uring_send(srv->ring, c->fd, c->out.data + c->out.off,
+                       netbuf_used(&c->out), i) < 0) {
+            failed[i] = true;
+            continue;
+        }
+        queued++;
+    }
+    if (queued == 0) {
+        return;
+    }
+    if (uring_submit(srv->ring, queued) < 0) {
+        // Requests were not passed to the kernel
+        // or cannot be waited for
+        for (size_t i = 0; i < n; i++) {
+            failed[i] = failed[i] || (batch[i] && netbuf_used(&batch[i]->out) > 0);
+        }
+        return;
+    }
+
+    uint64_t data;
+    int res;
+    while (uring_inflight(srv->ring) > 0) {
+        if (!uring_result(srv->ring, &data, &res)) {
+            if (uring_submit(srv->ring, 1) < 0) {
+                break;
+            }
+            continue;
+        }
+        if (res > 0) {
+            netbuf_consume(&batch[data]->out, res);
+        }
+        else if (res != -EAGAIN && res != -EWOULDBLOCK && res != -EINTR) {
+            failed[data] = true;
+        }
+    }
+}
+
+// Serve events of one epoll_wait with io_uring.
+// The reads of all readable connections are
+// submitted with one system call, then their
+// requests are run and the sends of all replies
+// are submitted with one more, instead of one
+// read and one send call per connection.
+static void serve_events_uring(struct server *srv, struct epoll_event *events, int n)
+{
+    struct conn *batch[MAX_EVENTS];
+    bool failed[MAX_EVENTS] = {0};
+    bool more[MAX_EVENTS] = {0};
+    size_t numbatch = 0;
+    unsigned queued = 0;
+
+    for (int i = 0; i < n; i++) {
+        struct listener *l = find_listener(srv, events[i].data.ptr);
+        if (l) {
+            accept_conns(srv, l);
+            continue;
+        }
+        struct conn *c = events[i].data.ptr;
+        if (events[i].events & EPOLLERR) {
+            close_conn(srv, c);
+            continue;
+        }
+        size_t idx = numbatch++;
+        batch[idx] = c;
+        if (!(events[i].events & (EPOLLIN | EPOLLHUP))) {
+            continue;
+        }
+        if (netbuf_reserve(&c->in, RECV_CHUNK) < 0 ||
+            uring_recv(srv->ring, c->fd, c->in.data + c->in.len, RECV_CHUNK, idx) < 0) {
+            failed[idx] = true;
+            continue;
+        }
+        queued++;
+    }
+
+    if (queued > 0 && uring_submit(srv->ring, queued) < 0) {
+        perror("io_uring_enter");
+        stop_requested = 1;
+        return;
+    }
+    uint64_t data;
+    int res;
+    while (uring_inflight(srv->ring) > 0) {
+        if (!uring_result(srv->ring, &data, &res)) {
+            if (uring_submit(srv->ring, 1) < 0) {
+                break;
+            }
+            continue;
+        }
+        if (res > 0) {
+            batch[data]->in.len += res;
+        }
+        else if (res == 0) {
+            batch[data]->eof = true;
+        }
+        else if (res != -EAGAIN && res != -EWOULDBLOCK && res != -EINTR) {
+            failed[data] = true;
+        }
+    }
+
+    // Run requests and send replies until every
+    // connection is blocked on its socket or has
+    // run all complete requests
+    bool pending = true;
+    for (size_t i = 0; i < numbatch; i++) {
+        more[i] = true;
+    }
+    while (pending) {
+        for (size_t i = 0; i < numbatch; i++) {
+            if (batch[i] && !failed[i] && more[i]) {
+                more[i] = run_requests(srv, batch[i]);
+            }
+        }
+        uring_send_batch(srv, batch, failed, numbatch);
+
+        pending = false;
+        for (size_t i = 0; i < numbatch; i++) {
+            struct conn *c = batch[i];
+            if (!c) {
+                continue;
+            }
+            if (failed[i]) {
+                close_conn(srv, c);
+                batch[i] = NULL;
+            }
+            else if (more[i] && netbuf_used(&c->out) == 0) {
+                pending = true;
+            }
+            else {
+                finish_conn(srv, c, more[i]);
+                batch[i] = NULL;
+            }
+        }
+    }
+}
+
+// Print result of finished background save, if any
+static void report_server_bgsave(struct server *srv, bool wait)
+{
+    struct bgsave_info info;
+    if (poll_bgsave(srv->dbm, &info, wait) != 1) {
+        return;
+    }
+    if (info.success) {
+        printf("Background save of %s completed: %zu bytes in %.3f ms\n",
+               info.tbl_name, info.bytes, info.msecs);
+    }
+    else {
+        printf("Background save of %s failed\n", info.tbl_name);
+    }
+    fflush(stdout);
+}
+
+// Create listening socket at path. An existing
+// socket file is replaced unless a server is
+// accepting connections on it.
+// Returns -1 on failure.
+static int listen_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strtcpy(addr.sun_path, path, sizeof(addr.sun_path)) < 0) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "A server is already running on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Create listening TCP socket on port of the
+// loopback address. Returns -1 on failure.
+static int listen_tcp(const char *port)
+{
+    char *end;
+    unsigned long num = strtoul(port, &end, 10);
+    if (*end != '\0' || num == 0 || num > 65535) {
+        fprintf(stderr, "Invalid port: %s\n", port);
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_port = htons((uint16_t) num);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "127.0.0.1:%s: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Returns true if addr is a port number
+static bool is_port(const char *addr)
+{
+    if (!*addr) {
+        return false;
+    }
+    for (; *addr; addr++) {
+        if (*addr < '0' || *addr > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Add listener for proto on addr (see listen_addr).
+// Returns -1 on failure.
+static int add_listener(struct server *srv, const char *addr, enum proto proto)
+{
+    struct listener *l = &srv->listeners[srv->numlisteners];
+    bool tcp;
+    l->fd = listen_addr(addr, &tcp);
+    if (l->fd < 0) {
+        return -1;
+    }
+    l->proto = proto;
+    l->tcp = tcp;
+    l->path = tcp ? NULL : addr;
+    srv->numlisteners++;
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = l};
+    if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, l->fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    printf("pairdb serving %son %s%s\n", proto == PROTO_RESP ? "RESP " : "",
+           tcp ? "127.0.0.1:" : "", addr);
+    return 1;
+}
+
+static void close_listeners(struct server *srv)
+{
+    for (size_t i = 0; i < srv->numlisteners; i++) {
+        close(srv->listeners[i].fd);
+        if (srv->listeners[i].path) {
+            unlink(srv->listeners[i].path);
+        }
+    }
+    srv->numlisteners = 0;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+// Create non-blocking listening socket on addr,
+// a TCP port of the loopback address if addr is a
+// number, else a Unix domain socket path.
+int listen_addr(const char *addr, bool *tcp)
+{
+    *tcp = is_port(addr);
+    return *tcp ? listen_tcp(addr) : listen_socket(addr);
+}
+
+// Allocates path of default server socket,
+// ~/pairdb-data/pairdb.sock.
+// Caller is responsible for freeing path.
+char *get_socket_path(void)
+{
+    return get_data_path(SOCKET_FNAME);
+}
+
+int run_server(const char *path, const char *resp_addr)
+{
+    char *defpath = NULL;
+    if (!path) {
+        defpath = get_socket_path();
+        if (!defpath) {
+            return EXIT_FAILURE;
+        }
+        path = defpath;
+    }
+
+    struct server srv = {0};
+    srv.dbm = init_db_mgr();
+    if (!srv.dbm) {
+        free(defpath);
+        return EXIT_FAILURE;
+    }
+
+    srv.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv.epfd < 0 || add_listener(&srv, path, PROTO_TEXT) < 0 ||
+        (resp_addr && add_listener(&srv, resp_addr, PROTO_RESP) < 0)) {
+        close_listeners(&srv);
+        if (srv.epfd >= 0) {
+            close(srv.epfd);
+        }
+        destroy_db_mgr(srv.dbm);
+        free(defpath);
+        return EXIT_FAILURE;
+    }
+
+    if (get_io_backend() == IO_URING) {
+        srv.ring = uring_init(MAX_EVENTS);
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested) {
+        int n = epoll_wait(srv.epfd, events, MAX_EVENTS, POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        if (srv.ring) {
+            serve_events_uring(&srv, events, n);
+        }
+        else {
+            serve_events(&srv, events, n);
+        }
+
+        report_server_bgsave(&srv, false);
+    }
+
+    while (srv.conns) {
+        close_conn(&srv, srv.conns);
+    }
+    close_listeners(&srv);
+    close(srv.epfd);
+
+    int status = save_all_tbls(srv.dbm) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    report_server_bgsave(&srv, true);
+
+    struct io_stats stats = {.calls = srv.io_calls};
+    if (srv.ring) {
+        uring_get_stats(srv.ring, &stats);
+        uring_destroy(srv.ring);
+    }
+    printf("pairdb server stopped after %zu requests, %zu socket I/O calls (%s)\n",
+           srv.requests, stats.calls, io_backend_name(get_io_backend()));
+
+    netbuf_free(&srv.lines);
+    resp_cmd_free(&srv.cmd);
+    destroy_db_mgr(srv.dbm);
+    free(defpath);
+    return status;
+}
@@ -0,0 +1,71 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Pairdb server - 'pairdb serve [socket]'
+ *
+ * The server keeps tables open in one database
+ * manager and serves requests from many clients over
+ * a Unix domain socket, so tables are loaded from
+ * disk once rather than by every client process.
+ *
+ * Clients send command lines as typed at the pairdb
+ * prompt and get one reply per command (see wire.h).
+ * Each connection selects its own current table with
+ * 'use' or 'newtbl'. Requests are run one at a time
+ * on a single thread driven by an epoll event loop,
+ * in the order each connection sent them; a client may
+ * send many requests without waiting for replies.
+ *
+ * The server can also speak RESP2, the protocol of
+ * Redis clients (see resp.h), on a second socket, so
+ * Redis client libraries and benchmark tools can be
+ * used with pairdb. It supports PING, ECHO, QUIT,
+ * SELECT, GET, SET [NX|XX], DEL, EXISTS, MGET, MSET,
+ * SCAN [MATCH] [COUNT], and DBSIZE. SELECT takes a
+ * table name, and a RESP connection starts on table
+ * "0". As Redis databases always exist, a table that
+ * does not exist reads as empty and is created by the
+ * first write.
+ *
+ * The server stops on SIGINT or SIGTERM and saves all
+ * updated tables before exiting.
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+// Allocates path of default server socket,
+// ~/pairdb-data/pairdb.sock.
+// Caller is responsible for freeing path.
+// Returns NULL on memory allocation error.
+char *get_socket_path(void);
+
+// Create non-blocking listening socket on addr,
+// a TCP port of the loopback address if addr is a
+// number, else a Unix domain socket path. An
+// existing socket file is replaced unless a server
+// is accepting connections on it. Sets tcp to true
+// for a TCP socket.
+// Returns -1 on failure.
+int listen_addr(const char *addr, bool *tcp);
+
+// Serve requests on Unix domain socket at path,
+// or at the default socket if path is NULL, until
+// SIGINT or SIGTERM is received. If resp_addr is
+// not NULL, RESP clients are served on the TCP port
+// it names on the loopback address if it is a
+// number, or else on the Unix domain socket at
+// resp_addr.
+// Returns exit status.
+int run_server(const char *path, const char *resp_addr);
+
+#endif // SERVER_H
@@ -0,0 +1,1610 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Sharded server. See shard.h.
+ *
+ * Each worker has an epoll event loop over the shared
+ * listening socket, its own connections, and an
+ * eventfd that other workers write to after queueing
+ * requests for it. Queues hold pointers to requests.
+ * A request is filled in by the worker of the
+ * connection, run by the worker owning its key, and
+ * passed back to be counted off its command. The
+ * request belongs to one worker at a time, handed over
+ * by the release and acquire ordering of the queue, so
+ * no other synchronization is needed. A queue that is
+ * full leaves requests in a backlog of the sending
+ * worker, retried every loop.
+ *
+ * Commands of a connection waiting for other workers
+ * are kept in order in a list of pending commands. A
+ * command whose key is in the worker's own shard is run
+ * at once, without a pending entry, when no earlier
+ * command is waiting.
+ *
+ * Tables are loaded and split under a lock held only
+ * while a connection selects a table it has not used
+ * before. The database manager is used only under this
+ * lock, and to save tables after the workers stop.
+ *
+ */
+
+// CPU affinity of worker threads
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "shard.h"
+#include "server.h"
+#include "resp.h"
+#include "wire.h"
+#include "hashtable.h"
+#include "db_manager.h"
+#include "pairdbconst.h"
+#include "stringutil.h"
+
+// Table of a new connection, as Redis
+// clients start on database 0
+static const char *DEFAULT_TBL = "0";
+
+enum {
+    CACHE_LINE = 64,
+    QUEUE_SIZE = 1024,          // Requests per queue, power of 2
+    QUEUE_MASK = QUEUE_SIZE - 1,
+    SHARD_TBL_SIZE = 1024,      // Initial buckets of each shard
+    READ_MAX = 256 * 1024,      // Bytes read per connection per wakeup
+    OUT_HIGH = 4 * 1024 * 1024, // Stop reading above this much output
+    MAX_INFLIGHT = 1024,        // Stop reading above this many pending commands
+    MAX_EVENTS = 64,
+    POLL_MS = 500,
+    SCAN_COUNT = 10,            // Default SCAN COUNT
+    SCAN_SHARD_BITS = 8         // Low bits of a SCAN cursor give the shard
+};
+
+// Single-producer single-consumer queue. head is
+// written only by the consumer and tail only by the
+// producer, each on its own cache line.
+struct spsc_queue {
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    _Alignas(CACHE_LINE) struct shard_req *slots[QUEUE_SIZE];
+};
+
+// Shard of a table, used only by its worker
+struct shard_part {
+    _Alignas(CACHE_LINE) hashtbl tbl;
+    bool updated;
+};
+
+// Table split into one shard per worker
+struct shard_tbl {
+    char name[TBL_NAME_MAX];
+    struct shard_part *parts;
+    struct shard_tbl *next;
+};
+
+enum req_op {
+    OP_GET,
+    OP_SET,
+    OP_SET_NX,
+    OP_SET_XX,
+    OP_DEL,
+    OP_EXISTS,
+    OP_COUNT,
+    OP_SCAN
+};
+
+// Operation on one shard. Copies of the key and value
+// travel with the request, so the input buffer of the
+// connection can be reused while it is away.
+struct shard_req {
+    struct pending *cmd;
+    struct shard_tbl *tbl;
+    unsigned home;          // Worker of the connection
+    unsigned shard;         // Worker owning the shard
+    enum req_op op;
+    bool done;              // Run by its shard
+
+    // Count, 1 if found or set, 0 if not,
+    // -1 on error. Entries visited by SCAN.
+    long long result;
+
+    char key[KEY_MAX];      // Key, or SCAN pattern ("" for all)
+    char val[VAL_MAX];      // Value to set, or value found
+    size_t vlen;
+
+    // SCAN
+    size_t pos;             // hashtbl_scan cursor in the shard
+    size_t count;           // Entries to visit
+    bool more;              // Entries left after those visited
+    struct netbuf keys;     // Keys found, encoded as bulk strings
+    size_t numkeys;
+
+    struct shard_req *next; // Backlog link
+};
+
+enum reply_kind {
+    REPLY_READY,            // Encoded in reply
+    REPLY_VALUE,            // GET
+    REPLY_SET,              // SET
+    REPLY_SUM,              // DEL, EXISTS, DBSIZE
+    REPLY_VALUES,           // MGET
+    REPLY_ALL_SET,          // MSET
+    REPLY_SCAN
+};
+
+// Command waiting for its requests, or for
+// earlier commands of its connection
+struct pending {
+    enum reply_kind kind;
+    struct shard_conn *conn;
+    size_t waiting;         // Requests not yet done
+    struct netbuf reply;    // REPLY_READY
+    struct pending *next;
+    size_t nreqs;
+    struct shard_req reqs[];
+};
+
+struct shard_conn {
+    int fd;
+    struct netbuf in;
+    struct netbuf out;
+    struct shard_tbl *tbl;  // Current table
+
+    struct pending *head;   // Oldest pending command
+    struct pending *tail;
+    size_t inflight;        // Number of pending commands
+
+    bool eof;
+    bool quit;
+    bool closed;            // Socket closed, freed when no command is pending
+    bool dirty;             // On the dirty list of the worker
+    uint32_t events;
+
+    struct shard_conn *prev;
+    struct shard_conn *next;
+    struct shard_conn *dirty_next;
+};
+
+struct shard_server;
+
+struct worker {
+    _Alignas(CACHE_LINE) struct shard_server *srv;
+    unsigned id;
+    pthread_t thread;
+    int epfd;
+    int evfd;               // Written by workers that queue requests
+
+    // Requests waiting for room in the queue to each
+    // worker, and workers to wake up
+    struct shard_req **backlog_head;
+    struct shard_req **backlog_tail;
+    bool *notify;
+
+    struct shard_conn *conns;
+
+    // Connections with finished commands
+    struct shard_conn *dirty;
+
+    struct resp_cmd cmd;
+    size_t requests;
+};
+
+struct shard_server {
+    unsigned nshards;
+    struct worker *workers;
+
+    // Queue from worker i to worker j
+    // at queues[i * nshards + j]
+    struct spsc_queue **queues;
+
+    int lfd;
+    atomic_bool stop;
+
+    // Tables loaded so far, and the database
+    // manager used to load them
+    pthread_mutex_t tbl_lock;
+    struct shard_tbl *tbls;
+    db_mgr dbm;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/*---------------- Start - static/internal functions --------------*/
+
+static void handle_stop_signal(int sig)
+{
+    (void) sig;
+    stop_requested = 1;
+}
+
+/*
+ *
+ * Queues
+ *
+ */
+
+static struct spsc_queue *queue_of(struct shard_server *srv, unsigned src, unsigned dst)
+{
+    return srv->queues[src * srv->nshards + dst];
+}
+
+static bool spsc_push(struct spsc_queue *q, struct shard_req *req)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == QUEUE_SIZE) {
+        return false;
+    }
+    q->slots[tail & QUEUE_MASK] = req;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static struct shard_req *spsc_pop(struct spsc_queue *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    struct shard_req *req = q->slots[head & QUEUE_MASK];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return req;
+}
+
+/*
+ *
+ * Tables
+ *
+ */
+
+// Shard of key. The bucket of a key within a shard
+// comes from the low bits of its hash, so the shard
+// is taken from the high bits of the hash mixed by a
+// multiplication.
+static unsigned shard_of(const struct shard_server *srv, const char *key)
+{
+    uint32_t h = hash_key(key) * 2654435769u;
+    return (unsigned) (((uint64_t) h * srv->nshards) >> 32);
+}
+
+static void free_shard_tbl(struct shard_server *srv, struct shard_tbl *st)
+{
+    for (unsigned i = 0; st->parts && i < srv->nshards; i++) {
+        destroy_hashtbl(st->parts[i].tbl);
+    }
+    free(st->parts);
+    free(st);
+}
+
+struct split_arg {
+    struct shard_server *srv;
+    struct shard_tbl *st;
+    bool failed;
+};
+
+static int split_pair(const char *key, const char *val, void *arg)
+{
+    struct split_arg *sa = arg;
+    hashtbl tbl = sa->st->parts[shard_of(sa->srv, key)].tbl;
+    if (put(tbl, (char *) key, (char *) val) == -2) {
+        sa->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+// Load table name, or start it empty if it does not
+// exist, and split it into shards. Sets err and returns
+// NULL on failure. Called with tbl_lock held.
+static struct shard_tbl *load_shard_tbl(struct shard_server *srv, const char *name,
+                                        const char **err)
+{
+    *err = "memory allocation error";
+    struct shard_tbl *st = calloc(1, sizeof(struct shard_tbl));
+    if (!st) {
+        return NULL;
+    }
+    strtcpy(st->name, name, TBL_NAME_MAX);
+    st->parts = aligned_alloc(CACHE_LINE, srv->nshards * sizeof(struct shard_part));
+    if (!st->parts) {
+        free(st);
+        return NULL;
+    }
+    memset(st->parts, 0, srv->nshards * sizeof(struct shard_part));
+    for (unsigned i = 0; i < srv->nshards; i++) {
+        st->parts[i].tbl = init_hashtbl(SHARD_TBL_SIZE);
+        if (!st->parts[i].tbl) {
+            free_shard_tbl(srv, st);
+            return NULL;
+        }
+    }
+
+    int ret = use_tbl(srv->dbm, st->name);
+    if (ret == -1) {
+        return st;
+    }
+    if (ret < 0) {
+        *err = "table read error";
+        free_shard_tbl(srv, st);
+        return NULL;
+    }
+
+    struct tbl_info info;
+    get_tbl_info(srv->dbm, &info);
+    const struct tbl_engine *eng = find_engine(info.engine);
+    if (!eng || eng->dir_storage) {
+        *err = "table engine cannot be sharded";
+        free_shard_tbl(srv, st);
+        return NULL;
+    }
+
+    // Room for an even share of the entries plus
+    // some slack, so shards do not resize
+    size_t share = get_num_tbl_entries(srv->dbm) / srv->nshards;
+    for (unsigned i = 0; i < srv->nshards; i++) {
+        hashtbl_reserve(st->parts[i].tbl, share + share / 8);
+    }
+
+    struct split_arg sa = {srv, st, false};
+    if (iterate_tbl(srv->dbm, split_pair, &sa) < 0 || sa.failed) {
+        free_shard_tbl(srv, st);
+        return NULL;
+    }
+
+    // Shards hold the table from now on
+    close_tbl(srv->dbm, st->name);
+    return st;
+}
+
+// Find table name, loading it on first use.
+// Sets err and returns NULL on failure.
+static struct shard_tbl *get_shard_tbl(struct shard_server *srv, const char *name,
+                                       const char **err)
+{
+    pthread_mutex_lock(&srv->tbl_lock);
+    struct shard_tbl *st = srv->tbls;
+    while (st && strcmp(st->name, name) != 0) {
+        st = st->next;
+    }
+    if (!st) {
+        st = load_shard_tbl(srv, name, err);
+        if (st) {
+            st->next = srv->tbls;
+            srv->tbls = st;
+        }
+    }
+    pthread_mutex_unlock(&srv->tbl_lock);
+    return st;
+}
+
+// Pair source for replace_tbl - every
+// pair of every shard of a table
+static int shard_tbl_pairs(engine_iter_fn fn, void *fnarg, void *arg)
+{
+    struct shard_tbl *st = ((struct split_arg *) arg)->st;
+    struct shard_server *srv = ((struct split_arg *) arg)->srv;
+    for (unsigned i = 0; i < srv->nshards; i++) {
+        if (hashtbl_foreach(st->parts[i].tbl, fn, fnarg) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// Save tables changed by clients. Called
+// after all workers have stopped.
+static int save_shard_tbls(struct shard_server *srv)
+{
+    int status = 1;
+    for (struct shard_tbl *st = srv->tbls; st; st = st->next) {
+        bool updated = false;
+        for (unsigned i = 0; i < srv->nshards; i++) {
+            updated |= st->parts[i].updated;
+        }
+        if (!updated) {
+            continue;
+        }
+
+        struct split_arg sa = {srv, st, false};
+        if (replace_tbl(srv->dbm, st->name, shard_tbl_pairs, &sa) < 0) {
+            fprintf(stderr, "Could not save table %s\n", st->name);
+            status = -1;
+        }
+        close_tbl(srv->dbm, st->name);
+    }
+    return status;
+}
+
+/*
+ *
+ * Requests
+ *
+ */
+
+static int scan_key(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    struct shard_req *req = arg;
+    if (req->key[0] == '\0' || fnmatch(req->key, key, 0) == 0) {
+        resp_bulk(&req->keys, key, strlen(key));
+        req->numkeys++;
+    }
+    req->result++;
+    return (size_t) req->result == req->count;
+}
+
+// Run request on the shard of worker w
+static void run_req(struct worker *w, struct shard_req *req)
+{
+    struct shard_part *part = &req->tbl->parts[w->id];
+    switch (req->op) {
+        case OP_GET:
+            req->vlen = find(req->val, VAL_MAX, part->tbl, req->key);
+            req->result = req->vlen > 0;
+            break;
+
+        case OP_SET:
+        case OP_SET_NX:
+        case OP_SET_XX: {
+            bool found = exists(part->tbl, req->key);
+            if ((req->op == OP_SET_NX && found) || (req->op == OP_SET_XX && !found)) {
+                req->result = 0;
+                break;
+            }
+            // Replaced in place, so a failed set
+            // keeps the old value
+            int result = found ? hashtbl_replace(part->tbl, req->key, req->val)
+                               : put(part->tbl, req->key, req->val);
+            req->result = result < 0 ? -1 : 1;
+            part->updated = true;
+            break;
+        }
+
+        case OP_DEL:
+            req->result = exists(part->tbl, req->key);
+            if (req->result) {
+                delete(part->tbl, req->key);
+                part->updated = true;
+            }
+            break;
+
+        case OP_EXISTS:
+            req->result = exists(part->tbl, req->key);
+            break;
+
+        case OP_COUNT:
+            req->result = (long long) get_numentries(part->tbl);
+            break;
+
+        case OP_SCAN:
+            req->result = 0;
+            req->pos = hashtbl_scan(part->tbl, req->pos, scan_key, req);
+            req->more = req->pos != 0;
+            break;
+    }
+    req->done = true;
+}
+
+static void mark_dirty(struct worker *w, struct shard_conn *c)
+{
+    if (!c->dirty) {
+        c->dirty = true;
+        c->dirty_next = w->dirty;
+        w->dirty = c;
+    }
+}
+
+static void receive_req(struct worker *w, struct shard_req *req);
+
+// Pass request to worker dst, or handle
+// it at once if dst is this worker
+static void send_req(struct worker *w, struct shard_req *req, unsigned dst)
+{
+    if (dst == w->id) {
+        receive_req(w, req);
+        return;
+    }
+
+    if (!w->backlog_head[dst] && spsc_push(queue_of(w->srv, w->id, dst), req)) {
+        w->notify[dst] = true;
+        return;
+    }
+    req->next = NULL;
+    if (w->backlog_tail[dst]) {
+        w->backlog_tail[dst]->next = req;
+    }
+    else {
+        w->backlog_head[dst] = req;
+    }
+    w->backlog_tail[dst] = req;
+}
+
+// Run a request for this worker's shard and pass it
+// back, or count off a request that has been run
+static void receive_req(struct worker *w, struct shard_req *req)
+{
+    if (!req->done) {
+        run_req(w, req);
+        if (req->home != w->id) {
+            send_req(w, req, req->home);
+            return;
+        }
+    }
+
+    struct pending *p = req->cmd;
+    if (--p->waiting == 0) {
+        mark_dirty(w, p->conn);
+    }
+}
+
+// Handle requests and replies queued for w.
+// Returns true if queues may hold more.
+static bool drain_queues(struct worker *w)
+{
+    bool more = false;
+    for (unsigned src = 0; src < w->srv->nshards; src++) {
+        if (src == w->id) {
+            continue;
+        }
+        struct spsc_queue *q = queue_of(w->srv, src, w->id);
+        size_t handled = 0;
+        struct shard_req *req;
+        while (handled < QUEUE_SIZE && (req = spsc_pop(q)) != NULL) {
+            receive_req(w, req);
+            handled++;
+        }
+        more |= (handled == QUEUE_SIZE);
+    }
+    return more;
+}
+
+// Move backlogged requests to their queues.
+// Returns true if any are left.
+static bool flush_backlogs(struct worker *w)
+{
+    bool left = false;
+    for (unsigned dst = 0; dst < w->srv->nshards; dst++) {
+        struct spsc_queue *q = queue_of(w->srv, w->id, dst);
+        while (w->backlog_head[dst] && spsc_push(q, w->backlog_head[dst])) {
+            w->backlog_head[dst] = w->backlog_head[dst]->next;
+            w->notify[dst] = true;
+        }
+        if (!w->backlog_head[dst]) {
+            w->backlog_tail[dst] = NULL;
+        }
+        left |= (w->backlog_head[dst] != NULL);
+    }
+    return left;
+}
+
+// Wake workers that were sent requests
+static void notify_workers(struct worker *w)
+{
+    uint64_t one = 1;
+    for (unsigned dst = 0; dst < w->srv->nshards; dst++) {
+        if (w->notify[dst]) {
+            w->notify[dst] = false;
+            if (write(w->srv->workers[dst].evfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                perror("eventfd");
+            }
+        }
+    }
+}
+
+/*
+ *
+ * Replies
+ *
+ */
+
+// Append reply of a command whose requests are done
+static void encode_reply(struct worker *w, struct netbuf *out, enum reply_kind kind,
+                         struct shard_req *reqs, size_t nreqs)
+{
+    long long sum = 0;
+    switch (kind) {
+        case REPLY_READY:
+            break;
+
+        case REPLY_VALUE:
+            if (reqs[0].result > 0) {
+                resp_bulk(out, reqs[0].val, reqs[0].vlen);
+            }
+            else {
+                resp_nil(out);
+            }
+            break;
+
+        case REPLY_SET:
+            if (reqs[0].result > 0) {
+                resp_simple(out, "OK");
+            }
+            else if (reqs[0].result == 0) {
+                resp_nil(out);
+            }
+            else {
+                resp_error(out, "memory allocation error");
+            }
+            break;
+
+        case REPLY_SUM:
+            for (size_t i = 0; i < nreqs; i++) {
+                sum += reqs[i].result;
+            }
+            resp_int(out, sum);
+            break;
+
+        case REPLY_VALUES:
+            resp_array(out, nreqs);
+            for (size_t i = 0; i < nreqs; i++) {
+                encode_reply(w, out, REPLY_VALUE, &reqs[i], 1);
+            }
+            break;
+
+        case REPLY_ALL_SET:
+            for (size_t i = 0; i < nreqs; i++) {
+                sum += reqs[i].result < 0;
+            }
+            if (sum > 0) {
+                resp_error(out, "memory allocation error");
+            }
+            else {
+                resp_simple(out, "OK");
+            }
+            break;
+
+        case REPLY_SCAN: {
+            // Next cursor: rest of this shard,
+            // else start of the next shard
+            unsigned shard = reqs[0].shard;
+            size_t next = 0;
+            if (reqs[0].more) {
+                next = (reqs[0].pos << SCAN_SHARD_BITS) | shard;
+            }
+            else if (shard + 1 < w->srv->nshards) {
+                next = shard + 1;
+            }
+            char cursor[24];
+            int len = snprintf(cursor, sizeof(cursor), "%zu", next);
+            resp_array(out, 2);
+            resp_bulk(out, cursor, len);
+            resp_array(out, reqs[0].numkeys);
+            netbuf_append(out, reqs[0].keys.data + reqs[0].keys.off,
+                          netbuf_used(&reqs[0].keys));
+            break;
+        }
+    }
+}
+
+static void free_pending(struct pending *p)
+{
+    netbuf_free(&p->reply);
+    for (size_t i = 0; i < p->nreqs; i++) {
+        netbuf_free(&p->reqs[i].keys);
+    }
+    free(p);
+}
+
+// Add pending command with nreqs requests to
+// connection. Returns NULL on memory allocation
+// error, after marking the connection to close.
+static struct pending *new_pending(struct shard_conn *c, enum reply_kind kind, size_t nreqs)
+{
+    struct pending *p = calloc(1, sizeof(struct pending) + nreqs * sizeof(struct shard_req));
+    if (!p) {
+        c->quit = true;
+        c->eof = true;
+        return NULL;
+    }
+    p->kind = kind;
+    p->conn = c;
+    p->nreqs = nreqs;
+    for (size_t i = 0; i < nreqs; i++) {
+        p->reqs[i].cmd = p;
+    }
+
+    if (c->tail) {
+        c->tail->next = p;
+    }
+    else {
+        c->head = p;
+    }
+    c->tail = p;
+    c->inflight++;
+    return p;
+}
+
+// Send requests of pending command that are
+// not already done
+static void send_pending(struct worker *w, struct pending *p)
+{
+    p->waiting = 1;
+    for (size_t i = 0; i < p->nreqs; i++) {
+        if (!p->reqs[i].done) {
+            p->waiting++;
+        }
+    }
+    for (size_t i = 0; i < p->nreqs; i++) {
+        if (!p->reqs[i].done) {
+            send_req(w, &p->reqs[i], p->reqs[i].shard);
+        }
+    }
+    // Held until all requests are sent, as local
+    // requests finish during send_req
+    if (--p->waiting == 0) {
+        mark_dirty(w, p->conn);
+    }
+}
+
+// Output buffer for a reply that is ready now - the
+// connection's own, or that of a new pending command
+// if earlier commands are still waiting for shards.
+// Returns NULL on memory allocation error.
+static struct netbuf *reply_buf(struct worker *w, struct shard_conn *c)
+{
+    if (!c->head) {
+        return &c->out;
+    }
+    struct pending *p = new_pending(c, REPLY_READY, 0);
+    if (!p) {
+        return NULL;
+    }
+    mark_dirty(w, c);
+    return &p->reply;
+}
+
+// Append replies of finished commands at the
+// head of the pending list, in order. Replies
+// of a closed connection are dropped.
+static void emit_replies(struct worker *w, struct shard_conn *c)
+{
+    while (c->head && c->head->waiting == 0) {
+        struct pending *p = c->head;
+        if (!c->closed) {
+            if (p->kind == REPLY_READY) {
+                netbuf_append(&c->out, p->reply.data + p->reply.off, netbuf_used(&p->reply));
+            }
+            else {
+                encode_reply(w, &c->out, p->kind, p->reqs, p->nreqs);
+            }
+        }
+        c->head = p->next;
+        if (!c->head) {
+            c->tail = NULL;
+        }
+        c->inflight--;
+        free_pending(p);
+    }
+}
+
+/*
+ *
+ * Commands
+ *
+ */
+
+// Fill request for key, and val if not NULL,
+// in current table of connection
+static void fill_req(struct worker *w, struct shard_conn *c, struct shard_req *req,
+                     enum req_op op, const struct resp_arg *key, const struct resp_arg *val)
+{
+    req->tbl = c->tbl;
+    req->home = w->id;
+    req->op = op;
+    memcpy(req->key, key->data, key->len + 1);
+    if (val) {
+        memcpy(req->val, val->data, val->len + 1);
+    }
+    req->shard = shard_of(w->srv, req->key);
+}
+
+// Run command with a single request. It runs at once
+// if its key is in this worker's shard and no earlier
+// command is waiting; otherwise it is sent to its shard.
+static void run_single(struct worker *w, struct shard_conn *c, enum reply_kind kind,
+                       struct shard_req *req)
+{
+    if (!c->head && req->shard == w->id) {
+        run_req(w, req);
+        encode_reply(w, &c->out, kind, req, 1);
+        return;
+    }
+
+    struct pending *p = new_pending(c, kind, 1);
+    if (!p) {
+        return;
+    }
+    struct pending *cmd = p->reqs[0].cmd;
+    p->reqs[0] = *req;
+    p->reqs[0].cmd = cmd;
+    send_pending(w, p);
+}
+
+static void shard_run_ping(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    struct netbuf *out = reply_buf(w, c);
+    if (!out) {
+        return;
+    }
+    if (cmd->argc == 2) {
+        resp_bulk(out, cmd->argv[1].data, cmd->argv[1].len);
+    }
+    else {
+        resp_simple(out, "PONG");
+    }
+}
+
+static void shard_run_echo(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    struct netbuf *out = reply_buf(w, c);
+    if (out) {
+        resp_bulk(out, cmd->argv[1].data, cmd->argv[1].len);
+    }
+}
+
+static void shard_run_quit(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    (void) cmd;
+    struct netbuf *out = reply_buf(w, c);
+    if (out) {
+        resp_simple(out, "OK");
+    }
+    c->quit = true;
+    c->eof = true;
+}
+
+static void shard_run_command(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    (void) cmd;
+    struct netbuf *out = reply_buf(w, c);
+    if (out) {
+        resp_array(out, 0);
+    }
+}
+
+// Commands already sent keep the table they
+// were sent with
+static void shard_run_select(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    struct netbuf *out = reply_buf(w, c);
+    if (!out) {
+        return;
+    }
+    if (!resp_storable(&cmd->argv[1], TBL_NAME_MAX)) {
+        resp_error(out, "invalid table name");
+        return;
+    }
+
+    const char *err;
+    struct shard_tbl *st = get_shard_tbl(w->srv, cmd->argv[1].data, &err);
+    if (!st) {
+        resp_error(out, err);
+        return;
+    }
+    c->tbl = st;
+    resp_simple(out, "OK");
+}
+
+static void shard_run_get(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    if (!resp_storable(&cmd->argv[1], KEY_MAX)) {
+        struct netbuf *out = reply_buf(w, c);
+        if (out) {
+            resp_nil(out);
+        }
+        return;
+    }
+
+    struct shard_req req = {0};
+    fill_req(w, c, &req, OP_GET, &cmd->argv[1], NULL);
+    run_single(w, c, REPLY_VALUE, &req);
+}
+
+// SET key val [NX|XX]
+static void shard_run_set(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    enum req_op op = OP_SET;
+    bool syntax_ok = true;
+    for (size_t i = 3; i < cmd->argc; i++) {
+        if (strcasecmp(cmd->argv[i].data, "NX") == 0 && op != OP_SET_XX) {
+            op = OP_SET_NX;
+        }
+        else if (strcasecmp(cmd->argv[i].data, "XX") == 0 && op != OP_SET_NX) {
+            op = OP_SET_XX;
+        }
+        else {
+            syntax_ok = false;
+        }
+    }
+    if (!syntax_ok || !resp_storable(&cmd->argv[1], KEY_MAX) ||
+        !resp_storable(&cmd->argv[2], VAL_MAX)) {
+        struct netbuf *out = reply_buf(w, c);
+        if (!out) {
+            return;
+        }
+        if (!syntax_ok) {
+            resp_error(out, "syntax error");
+        }
+        else if (resp_check_storable(out, &cmd->argv[1], KEY_MAX)) {
+            resp_check_storable(out, &cmd->argv[2], VAL_MAX);
+        }
+        return;
+    }
+
+    struct shard_req req = {0};
+    fill_req(w, c, &req, op, &cmd->argv[1], &cmd->argv[2]);
+    run_single(w, c, REPLY_SET, &req);
+}
+
+// DEL and EXISTS - one request per key that can
+// be in the table, summed in the reply
+static void run_key_count(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd,
+                          enum req_op op)
+{
+    size_t nkeys = 0;
+    for (size_t i = 1; i < cmd->argc; i++) {
+        nkeys += resp_storable(&cmd->argv[i], KEY_MAX);
+    }
+    if (nkeys == 0) {
+        struct netbuf *out = reply_buf(w, c);
+        if (out) {
+            resp_int(out, 0);
+        }
+        return;
+    }
+
+    struct pending *p = new_pending(c, REPLY_SUM, nkeys);
+    if (!p) {
+        return;
+    }
+    size_t r = 0;
+    for (size_t i = 1; i < cmd->argc; i++) {
+        if (resp_storable(&cmd->argv[i], KEY_MAX)) {
+            fill_req(w, c, &p->reqs[r++], op, &cmd->argv[i], NULL);
+        }
+    }
+    send_pending(w, p);
+}
+
+static void shard_run_del(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    run_key_count(w, c, cmd, OP_DEL);
+}
+
+static void shard_run_exists(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    run_key_count(w, c, cmd, OP_EXISTS);
+}
+
+static void shard_run_mget(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    struct pending *p = new_pending(c, REPLY_VALUES, cmd->argc - 1);
+    if (!p) {
+        return;
+    }
+    for (size_t i = 1; i < cmd->argc; i++) {
+        struct shard_req *req = &p->reqs[i - 1];
+        if (resp_storable(&cmd->argv[i], KEY_MAX)) {
+            fill_req(w, c, req, OP_GET, &cmd->argv[i], NULL);
+        }
+        else {
+            // Cannot be in the table
+            req->done = true;
+        }
+    }
+    send_pending(w, p);
+}
+
+// MSET key val [key val ...] - pairs are checked
+// first so that either all or none are sent
+static void shard_run_mset(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    bool valid = cmd->argc % 2 == 1;
+    for (size_t i = 1; valid && i < cmd->argc; i++) {
+        valid = resp_storable(&cmd->argv[i], i % 2 ? KEY_MAX : VAL_MAX);
+    }
+    if (!valid) {
+        struct netbuf *out = reply_buf(w, c);
+        if (!out) {
+            return;
+        }
+        if (cmd->argc % 2 == 0) {
+            resp_error(out, "wrong number of arguments for 'mset' command");
+            return;
+        }
+        for (size_t i = 1; i < cmd->argc; i++) {
+            if (!resp_check_storable(out, &cmd->argv[i], i % 2 ? KEY_MAX : VAL_MAX)) {
+                return;
+            }
+        }
+        return;
+    }
+
+    struct pending *p = new_pending(c, REPLY_ALL_SET, cmd->argc / 2);
+    if (!p) {
+        return;
+    }
+    for (size_t i = 1; i < cmd->argc; i += 2) {
+        fill_req(w, c, &p->reqs[i / 2], OP_SET, &cmd->argv[i], &cmd->argv[i + 1]);
+    }
+    send_pending(w, p);
+}
+
+// One count request per shard
+static void shard_run_dbsize(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    (void) cmd;
+    struct pending *p = new_pending(c, REPLY_SUM, w->srv->nshards);
+    if (!p) {
+        return;
+    }
+    for (unsigned i = 0; i < w->srv->nshards; i++) {
+        p->reqs[i].tbl = c->tbl;
+        p->reqs[i].home = w->id;
+        p->reqs[i].shard = i;
+        p->reqs[i].op = OP_COUNT;
+    }
+    send_pending(w, p);
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count]
+// A cursor holds a shard in its low bits and the
+// number of entries of that shard already visited
+// above them. Each call scans a single shard.
+static void shard_run_scan(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    const char *err = NULL;
+    char *end;
+    size_t cursor = strtoull(cmd->argv[1].data, &end, 10);
+    size_t count = SCAN_COUNT;
+    const struct resp_arg *pattern = NULL;
+    if (*end != '\0' || cmd->argv[1].data[0] == '-' ||
+        (cursor & ((1u << SCAN_SHARD_BITS) - 1)) >= w->srv->nshards) {
+        err = "invalid cursor";
+    }
+    for (size_t i = 2; !err && i < cmd->argc; i += 2) {
+        if (i + 1 == cmd->argc) {
+            err = "syntax error";
+        }
+        else if (strcasecmp(cmd->argv[i].data, "MATCH") == 0) {
+            pattern = &cmd->argv[i + 1];
+            if (pattern->len >= KEY_MAX) {
+                err = "pattern too long";
+            }
+        }
+        else if (strcasecmp(cmd->argv[i].data, "COUNT") == 0) {
+            const char *val = cmd->argv[i + 1].data;
+            count = strtoull(val, &end, 10);
+            if (*end != '\0' || count == 0 || val[0] == '-') {
+                err = "syntax error";
+            }
+        }
+        else {
+            err = "syntax error";
+        }
+    }
+    if (err) {
+        struct netbuf *out = reply_buf(w, c);
+        if (out) {
+            resp_error(out, err);
+        }
+        return;
+    }
+
+    struct shard_req req = {0};
+    req.tbl = c->tbl;
+    req.home = w->id;
+    req.op = OP_SCAN;
+    req.shard = cursor & ((1u << SCAN_SHARD_BITS) - 1);
+    req.pos = cursor >> SCAN_SHARD_BITS;
+    req.count = count;
+    if (pattern && strcmp(pattern->data, "*") != 0) {
+        memcpy(req.key, pattern->data, pattern->len + 1);
+    }
+
+    if (!c->head && req.shard == w->id) {
+        run_req(w, &req);
+        encode_reply(w, &c->out, REPLY_SCAN, &req, 1);
+        netbuf_free(&req.keys);
+        return;
+    }
+    run_single(w, c, REPLY_SCAN, &req);
+}
+
+struct shard_command {
+    const char *name;
+    size_t min_args;    // Including command name
+    size_t max_args;    // 0 if unlimited
+    void (*run)(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd);
+};
+
+static const struct shard_command shard_commands[] = {
+    {"get", 2, 2, shard_run_get},
+    {"set", 3, 5, shard_run_set},
+    {"mget", 2, 0, shard_run_mget},
+    {"mset", 3, 0, shard_run_mset},
+    {"del", 2, 0, shard_run_del},
+    {"exists", 2, 0, shard_run_exists},
+    {"scan", 2, 6, shard_run_scan},
+    {"dbsize", 1, 1, shard_run_dbsize},
+    {"select", 2, 2, shard_run_select},
+    {"ping", 1, 2, shard_run_ping},
+    {"echo", 2, 2, shard_run_echo},
+    {"quit", 1, 1, shard_run_quit},
+    {"command", 1, 0, shard_run_command}
+};
+
+static void run_shard_command(struct worker *w, struct shard_conn *c, struct resp_cmd *cmd)
+{
+    const char *name = cmd->argv[0].data;
+    size_t numcmds = sizeof(shard_commands) / sizeof(shard_commands[0]);
+    for (size_t i = 0; i < numcmds; i++) {
+        const struct shard_command *sc = &shard_commands[i];
+        if (strcasecmp(name, sc->name) != 0) {
+            continue;
+        }
+        if (cmd->argc < sc->min_args || (sc->max_args && cmd->argc > sc->max_args)) {
+            struct netbuf *out = reply_buf(w, c);
+            if (out) {
+                netbuf_printf(out, "-ERR wrong number of arguments for '%s' command\r\n",
+                              sc->name);
+            }
+            return;
+        }
+        sc->run(w, c, cmd);
+        return;
+    }
+
+    struct netbuf *out = reply_buf(w, c);
+    if (out) {
+        resp_error(out, "unknown command");
+    }
+}
+
+// Run complete commands in input buffer until
+// OUT_HIGH bytes of replies or MAX_INFLIGHT
+// pending commands are waiting.
+// Returns true if input is left.
+static bool run_requests(struct worker *w, struct shard_conn *c)
+{
+    while (!c->quit) {
+        if (netbuf_used(&c->out) >= OUT_HIGH || c->inflight >= MAX_INFLIGHT) {
+            return netbuf_used(&c->in) > 0;
+        }
+
+        ssize_t len = resp_parse(c->in.data + c->in.off, netbuf_used(&c->in), &w->cmd);
+        if (len == 0) {
+            return false;
+        }
+        if (len < 0) {
+            struct netbuf *out = reply_buf(w, c);
+            if (out) {
+                resp_error(out, len == -1 ? "Protocol error" : "memory allocation error");
+            }
+            netbuf_consume(&c->in, netbuf_used(&c->in));
+            c->quit = true;
+            c->eof = true;
+            return false;
+        }
+
+        if (w->cmd.argc > 0) {
+            run_shard_command(w, c, &w->cmd);
+            w->requests++;
+        }
+        netbuf_consume(&c->in, len);
+    }
+    return false;
+}
+
+/*
+ *
+ * Connections
+ *
+ */
+
+// Free connection once it is closed and
+// no command of it is pending
+static void release_conn(struct shard_conn *c)
+{
+    if (c->closed && c->inflight == 0 && !c->dirty) {
+        netbuf_free(&c->in);
+        netbuf_free(&c->out);
+        free(c);
+    }
+}
+
+static void close_conn(struct worker *w, struct shard_conn *c)
+{
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->closed = true;
+
+    if (c->prev) {
+        c->prev->next = c->next;
+    }
+    else {
+        w->conns = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    release_conn(c);
+}
+
+static void accept_conns(struct worker *w)
+{
+    for (;;) {
+        int fd = accept(w->srv->lfd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        const char *err;
+        struct shard_conn *c = calloc(1, sizeof(struct shard_conn));
+        if (!c || !(c->tbl = get_shard_tbl(w->srv, DEFAULT_TBL, &err))) {
+            free(c);
+            close(fd);
+            return;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        struct epoll_event ev = {.events = c->events, .data.ptr = c};
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(c);
+            return;
+        }
+
+        c->next = w->conns;
+        if (w->conns) {
+            w->conns->prev = c;
+        }
+        w->conns = c;
+    }
+}
+
+// Run waiting commands, send replies, and update
+// epoll events of connection
+static void service_conn(struct worker *w, struct shard_conn *c)
+{
+    bool more;
+    do {
+        more = run_requests(w, c);
+        emit_replies(w, c);
+        if (netbuf_send(&c->out, c->fd) < 0) {
+            close_conn(w, c);
+            return;
+        }
+    } while (more && netbuf_used(&c->out) == 0 && c->inflight < MAX_INFLIGHT);
+
+    if (c->eof && !more && c->inflight == 0 && netbuf_used(&c->out) == 0) {
+        close_conn(w, c);
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!c->eof && netbuf_used(&c->out) < OUT_HIGH && c->inflight < MAX_INFLIGHT) {
+        events |= EPOLLIN;
+    }
+    if (netbuf_used(&c->out) > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events) {
+        struct epoll_event ev = {.events = events, .data.ptr = c};
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+// Send replies of commands finished since the
+// last loop, and resume connections that stopped
+// reading while waiting for them
+static void service_dirty(struct worker *w)
+{
+    while (w->dirty) {
+        struct shard_conn *c = w->dirty;
+        w->dirty = c->dirty_next;
+        c->dirty = false;
+        if (c->closed) {
+            emit_replies(w, c);
+            release_conn(c);
+        }
+        else {
+            service_conn(w, c);
+        }
+    }
+}
+
+static void pin_worker(struct worker *w)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->id % ncpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    pin_worker(w);
+
+    struct epoll_event events[MAX_EVENTS];
+    int timeout = POLL_MS;
+    while (!atomic_load_explicit(&w->srv->stop, memory_order_relaxed)) {
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (!ptr) {
+                accept_conns(w);
+                continue;
+            }
+            if (ptr == &w->evfd) {
+                uint64_t count;
+                if (read(w->evfd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("eventfd");
+                }
+                continue;
+            }
+
+            struct shard_conn *c = ptr;
+            if (events[i].events & EPOLLERR) {
+                close_conn(w, c);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP)) &&
+                netbuf_read(&c->in, c->fd, READ_MAX, &c->eof) < 0) {
+                close_conn(w, c);
+                continue;
+            }
+            service_conn(w, c);
+        }
+
+        bool more = drain_queues(w);
+        service_dirty(w);
+        more |= flush_backlogs(w);
+        notify_workers(w);
+
+        // Poll again at once while work is left
+        timeout = more ? 0 : POLL_MS;
+    }
+    return NULL;
+}
+
+// Free connections and pending commands of worker
+// and its event loop. Called after all workers stop.
+static void destroy_worker(struct worker *w)
+{
+    while (w->conns) {
+        struct shard_conn *c = w->conns;
+        w->conns = c->next;
+        close(c->fd);
+        while (c->head) {
+            struct pending *p = c->head;
+            c->head = p->next;
+            free_pending(p);
+        }
+        netbuf_free(&c->in);
+        netbuf_free(&c->out);
+        free(c);
+    }
+    if (w->epfd >= 0) {
+        close(w->epfd);
+    }
+    if (w->evfd >= 0) {
+        close(w->evfd);
+    }
+    free(w->backlog_head);
+    free(w->backlog_tail);
+    free(w->notify);
+    resp_cmd_free(&w->cmd);
+}
+
+// Set up event loop of worker id.
+// Returns -1 on failure.
+static int init_worker(struct shard_server *srv, unsigned id)
+{
+    struct worker *w = &srv->workers[id];
+    w->srv = srv;
+    w->id = id;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    w->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    w->backlog_head = calloc(srv->nshards, sizeof(struct shard_req *));
+    w->backlog_tail = calloc(srv->nshards, sizeof(struct shard_req *));
+    w->notify = calloc(srv->nshards, sizeof(bool));
+    if (w->epfd < 0 || w->evfd < 0 || !w->backlog_head || !w->backlog_tail || !w->notify) {
+        return -1;
+    }
+
+    // Each connection wakes only one worker
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, srv->lfd, &ev) < 0) {
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &w->evfd;
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &ev) < 0 ? -1 : 1;
+}
+
+// Allocate workers and queues. Returns -1 on failure.
+static int init_shards(struct shard_server *srv)
+{
+    srv->workers = aligned_alloc(CACHE_LINE, srv->nshards * sizeof(struct worker));
+    srv->queues = calloc((size_t) srv->nshards * srv->nshards, sizeof(struct spsc_queue *));
+    if (!srv->workers || !srv->queues) {
+        return -1;
+    }
+    memset(srv->workers, 0, srv->nshards * sizeof(struct worker));
+    for (unsigned i = 0; i < srv->nshards; i++) {
+        srv->workers[i].epfd = -1;
+        srv->workers[i].evfd = -1;
+    }
+
+    for (size_t i = 0; i < (size_t) srv->nshards * srv->nshards; i++) {
+        srv->queues[i] = aligned_alloc(CACHE_LINE, sizeof(struct spsc_queue));
+        if (!srv->queues[i]) {
+            return -1;
+        }
+        atomic_init(&srv->queues[i]->head, 0);
+        atomic_init(&srv->queues[i]->tail, 0);
+    }
+
+    for (unsigned i = 0; i < srv->nshards; i++) {
+        if (init_worker(srv, i) < 0) {
+            perror("worker");
+            return -1;
+        }
+    }
+    return 1;
+}
+
+static void destroy_shards(struct shard_server *srv)
+{
+    for (unsigned i = 0; srv->workers && i < srv->nshards; i++) {
+        destroy_worker(&srv->workers[i]);
+    }
+    for (size_t i = 0; srv->queues && i < (size_t) srv->nshards * srv->nshards; i++) {
+        free(srv->queues[i]);
+    }
+    while (srv->tbls) {
+        struct shard_tbl *st = srv->tbls;
+        srv->tbls = st->next;
+        free_shard_tbl(srv, st);
+    }
+    free(srv->workers);
+    free(srv->queues);
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+int run_sharded_server(const char *addr, unsigned nshards)
+{
+    if (nshards == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nshards = ncpus > 0 ? (unsigned) ncpus : 1;
+    }
+    if (nshards > MAX_SHARDS) {
+        nshards = MAX_SHARDS;
+    }
+
+    struct shard_server srv = {.nshards = nshards};
+    atomic_init(&srv.stop, false);
+    pthread_mutex_init(&srv.tbl_lock, NULL);
+    srv.dbm = init_db_mgr();
+    if (!srv.dbm) {
+        return EXIT_FAILURE;
+    }
+
+    bool tcp;
+    srv.lfd = listen_addr(addr, &tcp);
+    if (srv.lfd < 0 || init_shards(&srv) < 0) {
+        if (srv.lfd >= 0) {
+            close(srv.lfd);
+            if (!tcp) {
+                unlink(addr);
+            }
+        }
+        destroy_shards(&srv);
+        destroy_db_mgr(srv.dbm);
+        return EXIT_FAILURE;
+    }
+
+    // Workers start with stop signals blocked,
+    // so only this thread receives them
+    struct sigaction sa = {0};
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigset_t block;
+    sigset_t prev;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &prev);
+
+    unsigned started = 0;
+    for (; started < nshards; started++) {
+        if (pthread_create(&srv.workers[started].thread, NULL, worker_main,
+                           &srv.workers[started]) != 0) {
+            perror("pthread_create");
+            stop_requested = 1;
+            break;
+        }
+    }
+
+    printf("pairdb serving RESP on %s%s with %u shards\n", tcp ? "127.0.0.1:" : "", addr,
+           nshards);
+    fflush(stdout);
+
+    while (!stop_requested) {
+        sigsuspend(&prev);
+    }
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+
+    atomic_store(&srv.stop, true);
+    uint64_t one = 1;
+    size_t requests = 0;
+    for (unsigned i = 0; i < started; i++) {
+        if (write(srv.workers[i].evfd, &one, sizeof(one)) < 0) {
+            perror("eventfd");
+        }
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(srv.workers[i].thread, NULL);
+        requests += srv.workers[i].requests;
+    }
+
+    close(srv.lfd);
+    if (!tcp) {
+        unlink(addr);
+    }
+
+    int status = save_shard_tbls(&srv) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    printf("pairdb server stopped after %zu requests\n", requests);
+
+    destroy_shards(&srv);
+    destroy_db_mgr(srv.dbm);
+    pthread_mutex_destroy(&srv.tbl_lock);
+    return status;
+}
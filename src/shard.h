@@ -0,0 +1,56 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Sharded server -
+ *     'pairdb serve --resp <socket|port> --shards [N]'
+ *
+ * The server of server.h runs every request on one
+ * thread. The sharded server serves RESP clients (see
+ * resp.h) with N worker threads, one per CPU by default,
+ * each pinned to its own CPU. The keys of every table
+ * are split between the workers by hash: each worker
+ * owns one shard of each table, a hash table that only
+ * it reads or writes, so shards need no locks.
+ *
+ * Every worker also accepts connections and serves
+ * them from its own event loop. A command on a key of
+ * another worker's shard is passed to that worker in a
+ * single-producer single-consumer queue, one for each
+ * pair of workers, and the result is passed back the
+ * same way. Commands on several keys (MGET, MSET, DEL,
+ * EXISTS) and on whole tables (DBSIZE, SCAN) are split
+ * into one request per key or shard, and the reply is
+ * sent when every part is done. Replies are sent in the
+ * order commands were received.
+ *
+ * The commands are those of the RESP front end of the
+ * server (see server.h). A table is loaded and split
+ * into shards the first time a client selects it, and
+ * tables changed by clients are saved when the server
+ * stops on SIGINT or SIGTERM. MSET and multi-key DEL
+ * are not atomic across shards. Tables of directory
+ * engines (lsm) cannot be served.
+ *
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+enum {
+    MAX_SHARDS = 64
+};
+
+// Serve RESP clients on addr (see listen_addr in
+// server.h) with nshards worker threads, or one per
+// CPU if nshards is 0, until SIGINT or SIGTERM is
+// received.
+// Returns exit status.
+int run_sharded_server(const char *addr, unsigned nshards);
+
+#endif // SHARD_H
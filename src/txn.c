@@ -0,0 +1,259 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Transactions. See txn.h.
+ *
+ * The overlay is two hash tables. puts holds the keys
+ * added by the transaction and their values. dels
+ * holds the keys of the table deleted by the
+ * transaction. A key deleted and then added again is
+ * in both, and replaces the key of the table on commit.
+ *
+ * A commit first checks that no key added by the
+ * transaction has been added to the table by another
+ * client since, and records the values of the keys it
+ * deletes. Then the deletes and adds are applied. If
+ * an add fails, the applied writes are undone from the
+ * recorded values, so the table is left as it was.
+ *
+ * The table is saved with save_curr_tbl_atomic. A
+ * table of a file engine is written in full to a
+ * temporary file renamed over the table file, never
+ * in place. An lsm table holds its memtable flushes
+ * from the first write of the commit to the save, so
+ * the save writes the commit as one new table file
+ * added to the table by one MANIFEST rename. Either
+ * way a crash leaves the table as it was before the
+ * commit or after it.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "txn.h"
+#include "db_manager.h"
+#include "hashtable.h"
+#include "pairdbconst.h"
+
+enum {
+    TXN_TBL_SIZE = 64   // Initial size of overlay tables
+};
+
+struct txn_obj {
+    db_mgr dbm;
+    hashtbl puts;
+    hashtbl dels;
+};
+
+// State of a commit step over the overlay
+struct commit_arg {
+    txn t;
+    hashtbl old;        // Values of deleted keys before commit
+    int status;
+};
+
+// State of iteration over the table
+// as seen by a transaction
+struct iter_arg {
+    txn t;
+    engine_iter_fn fn;
+    void *fnarg;
+    int stop;
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+static int check_conflict(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    struct commit_arg *ca = arg;
+    if (!exists(ca->t->dels, (char *) key) && has_key(ca->t->dbm, (char *) key)) {
+        ca->status = -1;
+        return 1;
+    }
+    return 0;
+}
+
+static int save_old(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    struct commit_arg *ca = arg;
+    char buff[VAL_MAX];
+    if (get(buff, VAL_MAX, ca->t->dbm, (char *) key) > 0 &&
+        put(ca->old, (char *) key, buff) < 0) {
+        ca->status = -2;
+        return 1;
+    }
+    return 0;
+}
+
+static int apply_del(const char *key, const char *val, void *arg)
+{
+    (void) val;
+    struct commit_arg *ca = arg;
+    db_remove(ca->t->dbm, (char *) key);
+    return 0;
+}
+
+static int apply_put(const char *key, const char *val, void *arg)
+{
+    struct commit_arg *ca = arg;
+    if (add(ca->t->dbm, (char *) key, (char *) val) < 0) {
+        ca->status = -2;
+        return 1;
+    }
+    return 0;
+}
+
+static int restore_old(const char *key, const char *val, void *arg)
+{
+    struct commit_arg *ca = arg;
+    add(ca->t->dbm, (char *) key, (char *) val);
+    return 0;
+}
+
+// Undo a commit cut short: keys added by the
+// transaction are removed and deleted keys are
+// added back with their old values
+static void undo_commit(struct commit_arg *ca)
+{
+    hashtbl_foreach(ca->t->puts, apply_del, ca);
+    hashtbl_foreach(ca->old, restore_old, ca);
+}
+
+// Pass pair of table to caller unless the
+// transaction deleted or replaced it
+static int visible_pair(const char *key, const char *val, void *arg)
+{
+    struct iter_arg *ia = arg;
+    if (exists(ia->t->puts, (char *) key) || exists(ia->t->dels, (char *) key)) {
+        return 0;
+    }
+    ia->stop = ia->fn(key, val, ia->fnarg);
+    return ia->stop;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+txn txn_begin(db_mgr dbm)
+{
+    if (!has_curr_tbl(dbm)) {
+        return NULL;
+    }
+
+    txn t = malloc(sizeof(struct txn_obj));
+    if (!t) {
+        return NULL;
+    }
+    t->dbm = dbm;
+    t->puts = init_hashtbl(TXN_TBL_SIZE);
+    t->dels = init_hashtbl(TXN_TBL_SIZE);
+    if (!t->puts || !t->dels) {
+        txn_abort(t);
+        return NULL;
+    }
+    return t;
+}
+
+void txn_abort(txn t)
+{
+    if (!t) {
+        return;
+    }
+    destroy_hashtbl(t->puts);
+    destroy_hashtbl(t->dels);
+    free(t);
+}
+
+int txn_add(txn t, char *key, char *val)
+{
+    if (exists(t->puts, key) ||
+        (!exists(t->dels, key) && has_key(t->dbm, key))) {
+        return -1;
+    }
+    return put(t->puts, key, val) < 0 ? -2 : 1;
+}
+
+int txn_remove(txn t, char *key)
+{
+    if (exists(t->puts, key)) {
+        delete(t->puts, key);
+        return 1;
+    }
+    if (!exists(t->dels, key) && has_key(t->dbm, key)) {
+        return put(t->dels, key, "") < 0 ? 0 : 1;
+    }
+    return 1;
+}
+
+size_t txn_get(char *dst, size_t dsize, txn t, char *key)
+{
+    if (exists(t->puts, key)) {
+        return find(dst, dsize, t->puts, key);
+    }
+    if (exists(t->dels, key)) {
+        return 0;
+    }
+    return get(dst, dsize, t->dbm, key);
+}
+
+int txn_iterate(txn t, engine_iter_fn fn, void *arg)
+{
+    struct iter_arg ia = {t, fn, arg, 0};
+    if (iterate_tbl(t->dbm, visible_pair, &ia) < 0) {
+        return -1;
+    }
+    if (ia.stop) {
+        return 1;
+    }
+    return hashtbl_foreach(t->puts, fn, arg);
+}
+
+size_t txn_num_writes(txn t)
+{
+    return get_numentries(t->puts) + get_numentries(t->dels);
+}
+
+int txn_commit(txn t)
+{
+    if (txn_num_writes(t) == 0) {
+        txn_abort(t);
+        return 1;
+    }
+
+    struct commit_arg ca = {t, init_hashtbl(TXN_TBL_SIZE), 1};
+    if (!ca.old) {
+        txn_abort(t);
+        return -2;
+    }
+
+    hashtbl_foreach(t->puts, check_conflict, &ca);
+    if (ca.status == 1) {
+        hashtbl_foreach(t->dels, save_old, &ca);
+    }
+    if (ca.status == 1) {
+        // Nothing reaches disk before the save
+        hold_curr_tbl_flush(t->dbm, true);
+        hashtbl_foreach(t->dels, apply_del, &ca);
+        hashtbl_foreach(t->puts, apply_put, &ca);
+        if (ca.status < 0) {
+            undo_commit(&ca);
+        }
+    }
+
+    int result = ca.status;
+    if (result == 1 && save_curr_tbl_atomic(t->dbm) < 0) {
+        result = -3;
+    }
+    hold_curr_tbl_flush(t->dbm, false);
+    destroy_hashtbl(ca.old);
+    txn_abort(t);
+    return result;
+}
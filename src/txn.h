@@ -0,0 +1,95 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Transactions - txn
+ *
+ * A transaction groups adds and deletes on the current
+ * table of a db_mgr so that they take effect together.
+ * Writes made after txn_begin are held in an overlay
+ * owned by the transaction and are not seen in the
+ * table: gets and iteration through the transaction
+ * see the table with the overlay applied, while other
+ * readers of the table see none of it. txn_commit
+ * applies the whole overlay to the table in one step
+ * and saves the table once, so a commit of any number
+ * of writes costs one table save instead of a save
+ * per write. Nothing of the commit is written before
+ * that save - lsm tables hold their memtable flushes
+ * until it - and the save replaces the table file, or
+ * adds one lsm table file, with a rename, so a commit
+ * is on disk in full or not at all. txn_abort drops
+ * the overlay.
+ *
+ * The table of a transaction must be the current
+ * table of the db_mgr whenever a txn function is
+ * called with it. Keys and values are held in hash
+ * tables (hashtable.h) and are limited to KEY_MAX
+ * and VAL_MAX bytes, as for text commands.
+ *
+ */
+
+#ifndef TXN_H
+#define TXN_H
+
+#include <stddef.h>
+
+#include "db_manager.h"
+#include "engine.h"
+
+// Transaction object handle
+typedef struct txn_obj *txn;
+
+// Start transaction on current table of dbm.
+// Returns NULL if dbm has no current table or
+// on memory allocation failure.
+txn txn_begin(db_mgr dbm);
+
+// Drop writes of transaction and free it
+void txn_abort(txn t);
+
+// Add key and val in transaction.
+// Returns -1 if key exists in the table as
+// seen by the transaction, -2 on memory
+// allocation failure, 1 on success.
+int txn_add(txn t, char *key, char *val);
+
+// Delete key in transaction. Deleting a key
+// that does not exist has no effect.
+// Returns 1 on success, 0 on failure.
+int txn_remove(txn t, char *key);
+
+// Copy value of key, as seen by the transaction,
+// to dst. Returns length of value copied, 0 if
+// key not found.
+size_t txn_get(char *dst, size_t dsize, txn t, char *key);
+
+// Call fn for every key-value pair of the table
+// as seen by the transaction. Stops early if fn
+// returns nonzero. Returns 1 on success, -1 on
+// error.
+int txn_iterate(txn t, engine_iter_fn fn, void *arg);
+
+// Number of adds and deletes held by transaction
+size_t txn_num_writes(txn t);
+
+// Apply writes of transaction to the table and
+// save it. The transaction is freed whether or
+// not the commit succeeds.
+// Returns:
+//      1 on success
+//     -1 if a key added by the transaction was
+//        added to the table since; nothing is
+//        applied
+//     -2 on memory allocation failure; nothing
+//        is applied
+//     -3 if the table fails to save; the writes
+//        are applied in memory but not saved
+int txn_commit(txn t);
+
+#endif // TXN_H
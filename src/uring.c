@@ -0,0 +1,715 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * io_uring I/O path. See uring.h.
+ *
+ * A ring is used by one thread at a time. File
+ * writers share one ring per thread, created on first
+ * use and freed when the thread exits. A process
+ * forked from one with a ring, such as a background
+ * save, creates its own, as the inherited ring is
+ * still in use by the parent.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "uring.h"
+
+static const char *IO_NAMES[] = {"blocking", "uring"};
+
+enum {
+    WRITER_RING_SIZE = 2 * FW_BUFS
+};
+
+// -1 unknown, 0 no, 1 yes
+static atomic_int uring_supported = -1;
+static _Atomic enum io_backend io_backend = IO_URING;
+
+// Counters of closed file writers
+static atomic_size_t file_calls = 0;
+static atomic_size_t file_requests = 0;
+static atomic_size_t file_bytes = 0;
+
+// Ring of the file writers of each thread
+static pthread_key_t writer_ring_key;
+static pthread_once_t writer_ring_once = PTHREAD_ONCE_INIT;
+
+#ifdef HAVE_IO_URING
+
+struct uring_obj {
+    int fd;
+    pid_t pid;          // Process that set up the ring
+
+    // Submission ring
+    void *sq_map;
+    size_t sq_map_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned queued;    // Requests queued since last submit
+
+    // Completion ring, in the mapping
+    // of the submission ring
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned inflight;  // Submitted requests without a taken result
+    struct io_stats stats;
+};
+
+#else
+
+struct uring_obj {
+    pid_t pid;
+    struct io_stats stats;
+};
+
+#endif
+
+struct file_writer_obj {
+    int fd;
+    size_t bufsize;
+    uring ring;         // NULL with the blocking backend
+    char *bufs[FW_BUFS];
+    bool busy[FW_BUFS]; // Queued or being written
+
+    // Write of each busy buffer, finished by
+    // pwrite if it completes short
+    size_t lens[FW_BUFS];
+    off_t offsets[FW_BUFS];
+
+    bool failed;
+    struct io_stats stats;
+    size_t ring_calls;  // System calls of ring before fw_open
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+#ifdef HAVE_IO_URING
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+// Next free submission entry, cleared,
+// or NULL if the ring is full
+static struct io_uring_sqe *get_sqe(uring ring)
+{
+    unsigned head = atomic_load_explicit((_Atomic unsigned *) ring->sq_head,
+                                         memory_order_acquire);
+    unsigned tail = *ring->sq_tail;
+    if (tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    return sqe;
+}
+
+// Publish entry filled after get_sqe
+static void push_sqe(uring ring, struct io_uring_sqe *sqe, uint64_t data, unsigned flags)
+{
+    sqe->user_data = data;
+    if (flags & URING_LINK) {
+        sqe->flags |= IOSQE_IO_LINK;
+    }
+    if (flags & URING_DRAIN) {
+        sqe->flags |= IOSQE_IO_DRAIN;
+    }
+    atomic_store_explicit((_Atomic unsigned *) ring->sq_tail, *ring->sq_tail + 1,
+                          memory_order_release);
+    ring->queued++;
+    ring->stats.requests++;
+}
+
+#endif
+
+static void free_writer_ring(void *ring)
+{
+    uring_destroy(ring);
+}
+
+static void make_writer_ring_key(void)
+{
+    pthread_key_create(&writer_ring_key, free_writer_ring);
+}
+
+// Ring of file writers of this thread, set up
+// on first use. Returns NULL if io_uring is not
+// available.
+static uring writer_ring(void)
+{
+    pthread_once(&writer_ring_once, make_writer_ring_key);
+    uring ring = pthread_getspecific(writer_ring_key);
+    if (ring && ring->pid != getpid()) {
+        // Inherited across fork - the parent's ring.
+        // Only this process's mappings are removed.
+        uring_destroy(ring);
+        ring = NULL;
+    }
+    if (!ring) {
+        ring = uring_init(WRITER_RING_SIZE);
+        pthread_setspecific(writer_ring_key, ring);
+    }
+    return ring;
+}
+
+// Write all bytes in buf at offset.
+// Returns -1 on write error.
+static int pwrite_all(struct file_writer_obj *fw, const char *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = pwrite(fw->fd, buf + done, len - done, offset + done);
+        fw->stats.calls++;
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return -1;
+        }
+        done += w;
+    }
+    return 1;
+}
+
+// Take results of writer's ring, freeing their
+// buffers. Data of a write is its buffer index;
+// FW_BUFS is the fsync of fw_finish.
+static void take_results(struct file_writer_obj *fw)
+{
+    uint64_t data;
+    int res;
+    while (uring_result(fw->ring, &data, &res)) {
+        if (data >= FW_BUFS) {
+            fw->failed |= (res < 0);
+            continue;
+        }
+        size_t i = (size_t) data;
+        if (res < 0) {
+            fw->failed = true;
+        }
+        else if ((size_t) res < fw->lens[i] &&
+                 pwrite_all(fw, fw->bufs[i] + res, fw->lens[i] - res,
+                            fw->offsets[i] + res) < 0) {
+            fw->failed = true;
+        }
+        fw->busy[i] = false;
+    }
+}
+
+// Submit queued writes and wait for wait results
+static int submit_writes(struct file_writer_obj *fw, unsigned wait)
+{
+    if (uring_submit(fw->ring, wait) < 0) {
+        fw->failed = true;
+        return -1;
+    }
+    take_results(fw);
+    return fw->failed ? -1 : 1;
+}
+
+// Queue write of buffer buf of writer, making room
+// in the ring if needed. Returns -1 on error.
+static int queue_write(struct file_writer_obj *fw, char *buf, size_t len, off_t offset,
+                       unsigned flags)
+{
+    size_t i = 0;
+    while (fw->bufs[i] != buf) {
+        i++;
+    }
+    fw->busy[i] = true;
+    fw->lens[i] = len;
+    fw->offsets[i] = offset;
+
+    // A write linked to an fsync needs room for
+    // both, as they must be submitted together
+    unsigned room = (flags & URING_LINK) ? 2 : 1;
+    if (uring_inflight(fw->ring) + room > WRITER_RING_SIZE &&
+        submit_writes(fw, uring_inflight(fw->ring)) < 0) {
+        return -1;
+    }
+    if (uring_write(fw->ring, fw->fd, buf, len, offset, i, flags) < 0) {
+        fw->failed = true;
+        return -1;
+    }
+    return 1;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+const char *io_backend_name(enum io_backend io)
+{
+    return IO_NAMES[io];
+}
+
+int find_io_backend(const char *name, enum io_backend *io)
+{
+    for (size_t i = 0; i < sizeof(IO_NAMES) / sizeof(IO_NAMES[0]); i++) {
+        if (strcmp(name, IO_NAMES[i]) == 0) {
+            *io = (enum io_backend) i;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+bool uring_available(void)
+{
+    int supported = atomic_load(&uring_supported);
+    if (supported < 0) {
+        uring ring = uring_init(1);
+        supported = (ring != NULL);
+        uring_destroy(ring);
+        atomic_store(&uring_supported, supported);
+    }
+    return supported;
+}
+
+int set_io_backend(enum io_backend io)
+{
+    if (io == IO_URING && !uring_available()) {
+        return -1;
+    }
+    atomic_store(&io_backend, io);
+    return 1;
+}
+
+enum io_backend get_io_backend(void)
+{
+    enum io_backend io = atomic_load(&io_backend);
+    return (io == IO_URING && !uring_available()) ? IO_BLOCKING : io;
+}
+
+#ifdef HAVE_IO_URING
+
+uring uring_init(unsigned entries)
+{
+    struct io_uring_params p = {0};
+    int fd = sys_uring_setup(entries, &p);
+    if (fd < 0) {
+        return NULL;
+    }
+    // One mapping for both rings is assumed
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct uring_obj *ring = calloc(1, sizeof(struct uring_obj));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->pid = getpid();
+    ring->sq_entries = p.sq_entries;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sq_map_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sq_map != MAP_FAILED) {
+            munmap(ring->sq_map, ring->sq_map_size);
+        }
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_map;
+    ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+    ring->cq_head = (unsigned *) (sq + p.cq_off.head);
+    ring->cq_tail = (unsigned *) (sq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *) (sq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (sq + p.cq_off.cqes);
+    return ring;
+}
+
+void uring_destroy(uring ring)
+{
+    if (!ring) {
+        return;
+    }
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    free(ring);
+}
+
+int uring_write(uring ring, int fd, const void *buf, size_t len, off_t offset,
+                uint64_t data, unsigned flags)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = (unsigned) len;
+    sqe->off = (uint64_t) offset;
+    ring->stats.bytes += len;
+    push_sqe(ring, sqe, data, flags);
+    return 1;
+}
+
+int uring_fsync(uring ring, int fd, uint64_t data, unsigned flags)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    push_sqe(ring, sqe, data, flags);
+    return 1;
+}
+
+// Socket requests return -EAGAIN rather than
+// waiting for the socket, as event loops wait
+// for sockets with epoll
+int uring_recv(uring ring, int fd, void *buf, size_t len, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = (unsigned) len;
+    sqe->msg_flags = MSG_DONTWAIT;
+    push_sqe(ring, sqe, data, 0);
+    return 1;
+}
+
+int uring_send(uring ring, int fd, const void *buf, size_t len, uint64_t data)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = (unsigned) len;
+    sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+    ring->stats.bytes += len;
+    push_sqe(ring, sqe, data, 0);
+    return 1;
+}
+
+int uring_submit(uring ring, unsigned wait)
+{
+    unsigned submit = ring->queued;
+    for (;;) {
+        int ret = sys_uring_enter(ring->fd, submit, wait,
+                                  wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+        ring->stats.calls++;
+        if (ret >= 0) {
+            ring->queued -= (unsigned) ret;
+            ring->inflight += (unsigned) ret;
+            submit -= (unsigned) ret;
+            if (submit == 0) {
+                return 1;
+            }
+            // Kernel took only some requests - submit
+            // the rest, still waiting for results
+            continue;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+bool uring_result(uring ring, uint64_t *data, int *res)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = atomic_load_explicit((_Atomic unsigned *) ring->cq_tail,
+                                         memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    *data = cqe->user_data;
+    *res = cqe->res;
+    atomic_store_explicit((_Atomic unsigned *) ring->cq_head, head + 1,
+                          memory_order_release);
+    ring->inflight--;
+    return true;
+}
+
+unsigned uring_inflight(uring ring)
+{
+    return ring->queued + ring->inflight;
+}
+
+#else
+
+// io_uring is not built in - no ring can be set
+// up, so callers take the blocking path
+
+uring uring_init(unsigned entries)
+{
+    (void) entries;
+    return NULL;
+}
+
+void uring_destroy(uring ring)
+{
+    free(ring);
+}
+
+int uring_write(uring ring, int fd, const void *buf, size_t len, off_t offset,
+                uint64_t data, unsigned flags)
+{
+    (void) ring, (void) fd, (void) buf, (void) len;
+    (void) offset, (void) data, (void) flags;
+    return -1;
+}
+
+int uring_fsync(uring ring, int fd, uint64_t data, unsigned flags)
+{
+    (void) ring, (void) fd, (void) data, (void) flags;
+    return -1;
+}
+
+int uring_recv(uring ring, int fd, void *buf, size_t len, uint64_t data)
+{
+    (void) ring, (void) fd, (void) buf, (void) len, (void) data;
+    return -1;
+}
+
+int uring_send(uring ring, int fd, const void *buf, size_t len, uint64_t data)
+{
+    (void) ring, (void) fd, (void) buf, (void) len, (void) data;
+    return -1;
+}
+
+int uring_submit(uring ring, unsigned wait)
+{
+    (void) ring, (void) wait;
+    return -1;
+}
+
+bool uring_result(uring ring, uint64_t *data, int *res)
+{
+    (void) ring, (void) data, (void) res;
+    return false;
+}
+
+unsigned uring_inflight(uring ring)
+{
+    (void) ring;
+    return 0;
+}
+
+#endif // HAVE_IO_URING
+
+void uring_get_stats(uring ring, struct io_stats *stats)
+{
+    stats->calls += ring->stats.calls;
+    stats->requests += ring->stats.requests;
+    stats->bytes += ring->stats.bytes;
+}
+
+file_writer fw_open(int fd, size_t bufsize)
+{
+    struct file_writer_obj *fw = calloc(1, sizeof(struct file_writer_obj));
+    if (!fw) {
+        return NULL;
+    }
+    fw->fd = fd;
+    fw->bufsize = bufsize;
+    if (get_io_backend() == IO_URING) {
+        fw->ring = writer_ring();
+    }
+    if (fw->ring) {
+        struct io_stats ring_stats = {0};
+        uring_get_stats(fw->ring, &ring_stats);
+        fw->ring_calls = ring_stats.calls;
+    }
+
+    // The blocking backend writes each buffer
+    // before the next one is filled
+    size_t nbufs = fw->ring ? FW_BUFS : 1;
+    for (size_t i = 0; i < nbufs; i++) {
+        fw->bufs[i] = malloc(bufsize);
+        if (!fw->bufs[i]) {
+            fw_close(fw);
+            return NULL;
+        }
+    }
+    return fw;
+}
+
+char *fw_buffer(file_writer fw)
+{
+    if (fw->failed) {
+        return NULL;
+    }
+    if (!fw->ring) {
+        return fw->bufs[0];
+    }
+
+    for (;;) {
+        for (size_t i = 0; i < FW_BUFS; i++) {
+            if (!fw->busy[i]) {
+                return fw->bufs[i];
+            }
+        }
+        // All buffers are queued or being written -
+        // submit queued writes together and wait for
+        // half of the buffers, so each system call
+        // covers several writes
+        if (submit_writes(fw, FW_BUFS / 2) < 0) {
+            return NULL;
+        }
+    }
+}
+
+int fw_write(file_writer fw, char *buf, size_t len, off_t offset)
+{
+    if (fw->failed) {
+        return -1;
+    }
+    fw->stats.requests++;
+    fw->stats.bytes += len;
+    if (!fw->ring) {
+        if (pwrite_all(fw, buf, len, offset) < 0) {
+            fw->failed = true;
+            return -1;
+        }
+        return 1;
+    }
+    return queue_write(fw, buf, len, offset, 0);
+}
+
+int fw_finish(file_writer fw, char *buf, size_t len, off_t offset, bool sync)
+{
+    if (!fw->ring) {
+        if (len > 0 && fw_write(fw, buf, len, offset) < 0) {
+            return -1;
+        }
+        if (sync) {
+            fw->stats.calls++;
+            fw->stats.requests++;
+            if (fsync(fw->fd) < 0) {
+                fw->failed = true;
+            }
+        }
+        return fw->failed ? -1 : 1;
+    }
+
+    if (fw->failed) {
+        return -1;
+    }
+    // Last write starts after all earlier writes
+    // complete, and the fsync once it succeeds
+    unsigned flags = URING_DRAIN | (sync ? URING_LINK : 0);
+    if (len > 0) {
+        fw->stats.requests++;
+        fw->stats.bytes += len;
+        if (queue_write(fw, buf, len, offset, flags) < 0) {
+            return -1;
+        }
+    }
+    if (sync) {
+        // Linked requests must be submitted together
+        if (uring_fsync(fw->ring, fw->fd, FW_BUFS, len > 0 ? 0 : URING_DRAIN) < 0) {
+            fw->failed = true;
+            return -1;
+        }
+        fw->stats.requests++;
+    }
+
+    while (!fw->failed && uring_inflight(fw->ring) > 0) {
+        submit_writes(fw, uring_inflight(fw->ring));
+    }
+    return fw->failed ? -1 : 1;
+}
+
+int fw_close(file_writer fw)
+{
+    while (fw->ring && uring_inflight(fw->ring) > 0) {
+        if (uring_submit(fw->ring, uring_inflight(fw->ring)) < 0) {
+            fw->failed = true;
+            break;
+        }
+        take_results(fw);
+    }
+    if (fw->ring) {
+        struct io_stats ring_stats = {0};
+        uring_get_stats(fw->ring, &ring_stats);
+        fw->stats.calls += ring_stats.calls - fw->ring_calls;
+    }
+
+    atomic_fetch_add(&file_calls, fw->stats.calls);
+    atomic_fetch_add(&file_requests, fw->stats.requests);
+    atomic_fetch_add(&file_bytes, fw->stats.bytes);
+
+    int status = fw->failed ? -1 : 1;
+    for (size_t i = 0; i < FW_BUFS; i++) {
+        free(fw->bufs[i]);
+    }
+    free(fw);
+    return status;
+}
+
+void get_file_io_stats(struct io_stats *stats)
+{
+    stats->calls = atomic_load(&file_calls);
+    stats->requests = atomic_load(&file_requests);
+    stats->bytes = atomic_load(&file_bytes);
+}
@@ -0,0 +1,164 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * io_uring I/O path.
+ *
+ * An io_uring is a pair of rings shared with the
+ * kernel: I/O requests are queued in the submission
+ * ring and passed to the kernel together by a single
+ * io_uring_enter call, and their results are read from
+ * the completion ring without further system calls.
+ * The rings are set up with raw system calls, so no
+ * library is needed. io_uring is built in when the
+ * kernel headers define it, and is used only if the
+ * running kernel supports it; otherwise the blocking
+ * path (pwrite, fsync, read, send) is used.
+ *
+ * The backend chosen with set_io_backend applies to
+ * table file writes made through a file_writer and to
+ * the server's socket I/O.
+ *
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum io_backend {
+    IO_BLOCKING,
+    IO_URING
+};
+
+// Name of backend: "blocking" or "uring"
+const char *io_backend_name(enum io_backend io);
+
+// Set io to backend with name.
+// Returns -1 if name is not a backend, 1 on success.
+int find_io_backend(const char *name, enum io_backend *io);
+
+// Returns true if io_uring is built in and
+// supported by the running kernel
+bool uring_available(void);
+
+// Set backend of file writers and servers started
+// afterwards. The default is IO_URING if available.
+// Returns -1 if io is IO_URING and io_uring is not
+// available, 1 on success.
+int set_io_backend(enum io_backend io);
+
+enum io_backend get_io_backend(void);
+
+/*
+ *
+ * Rings
+ *
+ */
+
+typedef struct uring_obj *uring;
+
+// Flags of queued requests
+enum {
+    URING_LINK = 1,     // Next request starts when this one succeeds
+    URING_DRAIN = 2     // Starts after all earlier requests complete
+};
+
+// Returns handle to ring with room for entries
+// queued requests, NULL if io_uring is not
+// available or on failure.
+uring uring_init(unsigned entries);
+
+void uring_destroy(uring ring);
+
+// Queue requests. data is returned with the result.
+// Each returns -1 if the submission ring is full,
+// 1 on success.
+int uring_write(uring ring, int fd, const void *buf, size_t len, off_t offset,
+                uint64_t data, unsigned flags);
+int uring_fsync(uring ring, int fd, uint64_t data, unsigned flags);
+int uring_recv(uring ring, int fd, void *buf, size_t len, uint64_t data);
+int uring_send(uring ring, int fd, const void *buf, size_t len, uint64_t data);
+
+// Submit queued requests and wait until at least
+// wait results are ready, in one system call.
+// Returns -1 on error, 1 on success.
+int uring_submit(uring ring, unsigned wait);
+
+// Take next result. Sets data to the data of its
+// request and res to its return value, -errno on
+// failure. Returns false if no result is ready.
+bool uring_result(uring ring, uint64_t *data, int *res);
+
+// Number of queued requests and of results
+// not yet taken
+unsigned uring_inflight(uring ring);
+
+// Counters of a ring, or of a file_writer
+struct io_stats {
+    size_t calls;       // System calls made for I/O
+    size_t requests;    // Writes, fsyncs, reads, sends
+    size_t bytes;
+};
+
+// Add counters of ring to stats
+void uring_get_stats(uring ring, struct io_stats *stats);
+
+/*
+ *
+ * File writer
+ *
+ */
+
+// Writes a file through buffers of a fixed size.
+// With io_uring, up to FW_BUFS buffers are written
+// while the caller fills the next one, and the
+// writes of all filled buffers are submitted
+// together. With the blocking backend each buffer
+// is written with pwrite when it is queued.
+typedef struct file_writer_obj *file_writer;
+
+enum {
+    FW_BUFS = 8
+};
+
+// Returns handle to writer for fd with buffers of
+// bufsize bytes, NULL on memory allocation failure.
+file_writer fw_open(int fd, size_t bufsize);
+
+// Returns a buffer of bufsize bytes that is not
+// being written, waiting for a write to complete if
+// needed. Returns NULL if an earlier write failed.
+char *fw_buffer(file_writer fw);
+
+// Queue write of len bytes of buf, a buffer from
+// fw_buffer, at offset.
+// Returns -1 on write error, 1 on success.
+int fw_write(file_writer fw, char *buf, size_t len, off_t offset);
+
+// Write len bytes of buf, a buffer from fw_buffer,
+// at offset once all earlier writes are complete,
+// followed by fsync of the file if sync is true,
+// and wait for both. With io_uring, the last write
+// and the fsync are submitted together as linked
+// requests.
+// Returns -1 on write or fsync error, 1 on success.
+int fw_finish(file_writer fw, char *buf, size_t len, off_t offset, bool sync);
+
+// Free writer, waiting for writes in progress, and
+// add its counters to those of get_file_io_stats.
+// Returns -1 if any write failed, 1 otherwise.
+int fw_close(file_writer fw);
+
+// Counters of all file writers closed so far
+void get_file_io_stats(struct io_stats *stats);
+
+#endif // URING_H
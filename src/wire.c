@@ -0,0 +1,224 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Connection buffers and text protocol of the pairdb
+ * server. See wire.h for the reply format.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "wire.h"
+
+enum {
+    NETBUF_MIN = 4096,
+    READ_CHUNK = 64 * 1024      // Bytes read per read call
+};
+
+/*---------------- Start - static/internal functions --------------*/
+
+// Parse decimal count of a *<n> reply header
+// between p and end. Returns -1 if malformed.
+static ssize_t parse_count(const char *p, const char *end)
+{
+    if (p == end) {
+        return -1;
+    }
+    ssize_t n = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9' || n > (ssize_t) 1 << 40) {
+            return -1;
+        }
+        n = n * 10 + (*p - '0');
+    }
+    return n;
+}
+
+/*--------------- End - static/internal functions --------------*/
+
+// Make room for at least n more bytes after len.
+// Consumed bytes are moved out of the way first;
+// the buffer grows by doubling.
+int netbuf_reserve(struct netbuf *buf, size_t n)
+{
+    if (buf->cap - buf->len >= n) {
+        return 1;
+    }
+
+    size_t used = buf->len - buf->off;
+    if (buf->off > 0) {
+        memmove(buf->data, buf->data + buf->off, used);
+        buf->off = 0;
+        buf->len = used;
+        if (buf->cap - buf->len >= n) {
+            return 1;
+        }
+    }
+
+    size_t newcap = buf->cap ? buf->cap : NETBUF_MIN;
+    while (newcap - used < n) {
+        newcap *= 2;
+    }
+    char *data = realloc(buf->data, newcap);
+    if (!data) {
+        return -2;
+    }
+    buf->data = data;
+    buf->cap = newcap;
+    return 1;
+}
+
+int netbuf_append(struct netbuf *buf, const char *src, size_t n)
+{
+    if (netbuf_reserve(buf, n) < 0) {
+        return -2;
+    }
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+    return 1;
+}
+
+// Formats into the free space of the buffer,
+// growing it and formatting again if needed
+int netbuf_printf(struct netbuf *buf, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = buf->data ? vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap)
+                      : vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return -2;
+    }
+    if ((size_t) n < buf->cap - buf->len) {
+        buf->len += n;
+        return 1;
+    }
+
+    if (netbuf_reserve(buf, (size_t) n + 1) < 0) {
+        return -2;
+    }
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+    va_end(ap);
+    buf->len += n;
+    return 1;
+}
+
+size_t netbuf_used(const struct netbuf *buf)
+{
+    return buf->len - buf->off;
+}
+
+void netbuf_consume(struct netbuf *buf, size_t n)
+{
+    buf->off += n;
+    if (buf->off >= buf->len) {
+        buf->off = 0;
+        buf->len = 0;
+    }
+}
+
+void netbuf_free(struct netbuf *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->off = 0;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+int netbuf_read(struct netbuf *buf, int fd, size_t max, bool *eof)
+{
+    size_t total = 0;
+    int calls = 0;
+    while (total < max) {
+        if (netbuf_reserve(buf, READ_CHUNK) < 0) {
+            return -1;
+        }
+        ssize_t n = read(fd, buf->data + buf->len, READ_CHUNK);
+        calls++;
+        if (n > 0) {
+            buf->len += n;
+            total += n;
+        }
+        else if (n == 0) {
+            *eof = true;
+            return calls;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? calls : -1;
+        }
+    }
+    return calls;
+}
+
+int netbuf_send(struct netbuf *buf, int fd)
+{
+    int calls = 0;
+    while (netbuf_used(buf) > 0) {
+        ssize_t n = send(fd, buf->data + buf->off, netbuf_used(buf), MSG_NOSIGNAL);
+        calls++;
+        if (n > 0) {
+            netbuf_consume(buf, n);
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return calls;
+        }
+        else {
+            return -1;
+        }
+    }
+    return calls;
+}
+
+ssize_t wire_reply_len(const char *buf, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    if (buf[0] != '+' && buf[0] != '-' && buf[0] != '*') {
+        return -1;
+    }
+
+    const char *end = buf + len;
+    const char *nl = memchr(buf, '\n', len);
+    if (!nl) {
+        return 0;
+    }
+    if (buf[0] != '*') {
+        return nl + 1 - buf;
+    }
+
+    ssize_t lines = parse_count(buf + 1, nl);
+    if (lines < 0) {
+        return -1;
+    }
+    const char *p = nl + 1;
+    for (ssize_t i = 0; i < lines; i++) {
+        nl = memchr(p, '\n', end - p);
+        if (!nl) {
+            return 0;
+        }
+        p = nl + 1;
+    }
+    return p - buf;
+}
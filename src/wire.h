@@ -0,0 +1,82 @@
+/*
+ * Pairdb - a command line key-value database
+ * --------------------------------------------------
+ * Copyright (C) 2025 Nikolai Hladick
+ * SPDX-License-Identifier: MIT
+ * https://github.com/nhladick/pairdb
+ * nhladick@gmail.com
+ * --------------------------------------------------
+ *
+ * Connection buffers and text protocol of the pairdb
+ * server (see server.h).
+ *
+ * A request is one command line, as typed at the
+ * pairdb prompt, ending with a newline character.
+ * Requests may be sent without waiting for replies;
+ * replies are sent in request order. Each request
+ * gets exactly one reply:
+ *
+ *      +<text>         single-line result
+ *      -<message>      error or key not found
+ *      *<n>            followed by n lines of text
+ *
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Growable byte buffer. Data starts at off and
+// ends at len; consumed bytes are dropped lazily
+// when the buffer needs room.
+struct netbuf {
+    char *data;
+    size_t off;
+    size_t len;
+    size_t cap;
+};
+
+// Make room for at least n more bytes after len.
+// Returns -2 on memory allocation error, 1 on success.
+int netbuf_reserve(struct netbuf *buf, size_t n);
+
+// Append n bytes. Returns -2 on memory allocation
+// error, 1 on success.
+int netbuf_append(struct netbuf *buf, const char *src, size_t n);
+
+// Append formatted text. Returns -2 on memory
+// allocation or format error, 1 on success.
+int netbuf_printf(struct netbuf *buf, const char *fmt, ...);
+
+// Number of unconsumed bytes
+size_t netbuf_used(const struct netbuf *buf);
+
+// Drop n bytes from the start of the data
+void netbuf_consume(struct netbuf *buf, size_t n);
+
+void netbuf_free(struct netbuf *buf);
+
+// Read from non-blocking socket fd until it has
+// no more data or max bytes are read. Sets eof if
+// the peer closed its side.
+// Returns -1 on socket or memory allocation error,
+// otherwise the number of read calls made.
+int netbuf_read(struct netbuf *buf, int fd, size_t max, bool *eof);
+
+// Send data on non-blocking socket fd until it is
+// all sent or the socket is full, consuming what
+// was sent.
+// Returns -1 on socket error, otherwise the
+// number of send calls made.
+int netbuf_send(struct netbuf *buf, int fd);
+
+// Returns length of the first complete reply in
+// buf, including its final newline, 0 if buf does
+// not yet hold a complete reply, -1 if buf does not
+// start with a reply.
+ssize_t wire_reply_len(const char *buf, size_t len);
+
+#endif // WIRE_H
@@ -9,6 +9,19 @@ STRUTIL_TEST=test/test_stringutil.c
 PARSE_TEST=test/test_parse.c
 HTABLE_TEST=test/test_hashtable.c
 MEM_TEST=test/test_mem_hashtable.c
+LSM_TEST=test/test_lsm.c
+CUCKOO_TEST=test/test_cuckoo.c
+CATALOG_TEST=test/test_catalog.c
+BULKIO_TEST=test/test_bulkio.c
+WIRE_TEST=test/test_wire.c
+RESP_TEST=test/test_resp.c
+URING_TEST=test/test_uring.c
+BINSTREAM_TEST=test/test_binstream.c
+PIPELINE_TEST=test/test_pipeline.c
+HASHSTAT_TEST=test/test_hashstat.c
+LATENCY_TEST=test/test_latency.c
+SHARD_TEST=test/test_shard.c
+TXN_TEST=test/test_txn.c
 
 # All test output written to output file
 TEST_OUT=test/test_output.txt
@@ -62,6 +75,159 @@ else
     HTABLE_OBJ=test/build/hashtable.o
 fi
 
+# lsm
+LSM_OBJ=""
+if [ -f build/lsm.o ]; then
+    LSM_OBJ=build/lsm.o
+else
+    gcc -o test/build/lsm.o -c src/lsm.c
+    LSM_OBJ=test/build/lsm.o
+fi
+
+# cuckoo
+CUCKOO_OBJ=""
+if [ -f build/cuckoo.o ]; then
+    CUCKOO_OBJ=build/cuckoo.o
+else
+    gcc -o test/build/cuckoo.o -c src/cuckoo.c
+    CUCKOO_OBJ=test/build/cuckoo.o
+fi
+
+# catalog
+CATALOG_OBJ=""
+if [ -f build/catalog.o ]; then
+    CATALOG_OBJ=build/catalog.o
+else
+    gcc -o test/build/catalog.o -c src/catalog.c
+    CATALOG_OBJ=test/build/catalog.o
+fi
+
+# bulkio
+BULKIO_OBJ=""
+if [ -f build/bulkio.o ]; then
+    BULKIO_OBJ=build/bulkio.o
+else
+    gcc -o test/build/bulkio.o -c src/bulkio.c
+    BULKIO_OBJ=test/build/bulkio.o
+fi
+
+# wire
+WIRE_OBJ=""
+if [ -f build/wire.o ]; then
+    WIRE_OBJ=build/wire.o
+else
+    gcc -o test/build/wire.o -c src/wire.c
+    WIRE_OBJ=test/build/wire.o
+fi
+
+# resp
+RESP_OBJ=""
+if [ -f build/resp.o ]; then
+    RESP_OBJ=build/resp.o
+else
+    gcc -o test/build/resp.o -c src/resp.c
+    RESP_OBJ=test/build/resp.o
+fi
+
+# uring
+URING_OBJ=""
+if [ -f build/uring.o ]; then
+    URING_OBJ=build/uring.o
+else
+    gcc -pthread -o test/build/uring.o -c src/uring.c
+    URING_OBJ=test/build/uring.o
+fi
+
+# binstream
+BINSTREAM_OBJ=""
+if [ -f build/binstream.o ]; then
+    BINSTREAM_OBJ=build/binstream.o
+else
+    gcc -o test/build/binstream.o -c src/binstream.c
+    BINSTREAM_OBJ=test/build/binstream.o
+fi
+
+# pipeline
+PIPELINE_OBJ=""
+if [ -f build/pipeline.o ]; then
+    PIPELINE_OBJ=build/pipeline.o
+else
+    gcc -pthread -o test/build/pipeline.o -c src/pipeline.c
+    PIPELINE_OBJ=test/build/pipeline.o
+fi
+
+# hashstat
+HASHSTAT_OBJ=""
+if [ -f build/hashstat.o ]; then
+    HASHSTAT_OBJ=build/hashstat.o
+else
+    gcc -o test/build/hashstat.o -c src/hashstat.c
+    HASHSTAT_OBJ=test/build/hashstat.o
+fi
+
+# latency
+LATENCY_OBJ=""
+if [ -f build/latency.o ]; then
+    LATENCY_OBJ=build/latency.o
+else
+    gcc -o test/build/latency.o -c src/latency.c
+    LATENCY_OBJ=test/build/latency.o
+fi
+
+# txn
+TXN_OBJ=""
+if [ -f build/txn.o ]; then
+    TXN_OBJ=build/txn.o
+else
+    gcc -o test/build/txn.o -c src/txn.c
+    TXN_OBJ=test/build/txn.o
+fi
+
+# messages
+MESSAGES_OBJ=""
+if [ -f build/messages.o ]; then
+    MESSAGES_OBJ=build/messages.o
+else
+    gcc -o test/build/messages.o -c src/messages.c
+    MESSAGES_OBJ=test/build/messages.o
+fi
+
+# engine
+ENGINE_OBJ=""
+if [ -f build/engine.o ]; then
+    ENGINE_OBJ=build/engine.o
+else
+    gcc -o test/build/engine.o -c src/engine.c
+    ENGINE_OBJ=test/build/engine.o
+fi
+
+# db_manager
+DBMGR_OBJ=""
+if [ -f build/db_manager.o ]; then
+    DBMGR_OBJ=build/db_manager.o
+else
+    gcc -pthread -o test/build/db_manager.o -c src/db_manager.c
+    DBMGR_OBJ=test/build/db_manager.o
+fi
+
+# server
+SERVER_OBJ=""
+if [ -f build/server.o ]; then
+    SERVER_OBJ=build/server.o
+else
+    gcc -pthread -o test/build/server.o -c src/server.c
+    SERVER_OBJ=test/build/server.o
+fi
+
+# shard
+SHARD_OBJ=""
+if [ -f build/shard.o ]; then
+    SHARD_OBJ=build/shard.o
+else
+    gcc -pthread -o test/build/shard.o -c src/shard.c
+    SHARD_OBJ=test/build/shard.o
+fi
+
 # Build and run string tests
 gcc -o test/build/test_stringutil $STRUTIL_TEST $UNITY_OBJ $STRUTIL_OBJ
 echo "---------- String Tests -----------" > $TEST_OUT
@@ -73,12 +239,77 @@ echo "---------- Parse Tests ------------" >> $TEST_OUT
 ./test/build/test_parse >> $TEST_OUT
 
 # Build and run hashtable tests
-gcc -o test/build/test_hashtable $HTABLE_TEST $UNITY_OBJ $HTABLE_OBJ $STRUTIL_OBJ
+gcc -pthread -o test/build/test_hashtable $HTABLE_TEST $UNITY_OBJ $HTABLE_OBJ $URING_OBJ $STRUTIL_OBJ
 echo "--------- Hashtable Tests ---------" >> $TEST_OUT
 ./test/build/test_hashtable >> $TEST_OUT
 
+# Build and run lsm tests
+gcc -pthread -o test/build/test_lsm $LSM_TEST $UNITY_OBJ $LSM_OBJ $STRUTIL_OBJ
+echo "------------ LSM Tests ------------" >> $TEST_OUT
+./test/build/test_lsm >> $TEST_OUT
+
+# Build and run cuckoo tests
+gcc -pthread -o test/build/test_cuckoo $CUCKOO_TEST $UNITY_OBJ $CUCKOO_OBJ $URING_OBJ $STRUTIL_OBJ
+echo "----------- Cuckoo Tests ----------" >> $TEST_OUT
+./test/build/test_cuckoo >> $TEST_OUT
+
+# Build and run catalog tests
+gcc -o test/build/test_catalog $CATALOG_TEST $UNITY_OBJ $CATALOG_OBJ $STRUTIL_OBJ
+echo "---------- Catalog Tests ----------" >> $TEST_OUT
+./test/build/test_catalog >> $TEST_OUT
+
+# Build and run bulk import tests
+gcc -pthread -o test/build/test_bulkio $BULKIO_TEST $UNITY_OBJ $BULKIO_OBJ $BINSTREAM_OBJ $HTABLE_OBJ $URING_OBJ $STRUTIL_OBJ
+echo "---------- Bulk I/O Tests ---------" >> $TEST_OUT
+./test/build/test_bulkio >> $TEST_OUT
+
+# Build and run server protocol tests
+gcc -o test/build/test_wire $WIRE_TEST $UNITY_OBJ $WIRE_OBJ
+echo "------------ Wire Tests -----------" >> $TEST_OUT
+./test/build/test_wire >> $TEST_OUT
+
+# Build and run RESP protocol tests
+gcc -o test/build/test_resp $RESP_TEST $UNITY_OBJ $RESP_OBJ $WIRE_OBJ
+echo "------------ RESP Tests -----------" >> $TEST_OUT
+./test/build/test_resp >> $TEST_OUT
+
+# Build and run io_uring tests
+gcc -pthread -o test/build/test_uring $URING_TEST $UNITY_OBJ $URING_OBJ
+echo "----------- URing Tests -----------" >> $TEST_OUT
+./test/build/test_uring >> $TEST_OUT
+
+# Build and run binary command stream tests
+gcc -o test/build/test_binstream $BINSTREAM_TEST $UNITY_OBJ $BINSTREAM_OBJ
+echo "--------- Binstream Tests ----------" >> $TEST_OUT
+./test/build/test_binstream >> $TEST_OUT
+
+# Build and run batch pipeline tests
+gcc -pthread -o test/build/test_pipeline $PIPELINE_TEST $UNITY_OBJ $PIPELINE_OBJ $PARSE_OBJ
+echo "--------- Pipeline Tests ----------" >> $TEST_OUT
+./test/build/test_pipeline >> $TEST_OUT
+
+# Build and run hash quality analysis tests
+gcc -pthread -o test/build/test_hashstat $HASHSTAT_TEST $UNITY_OBJ $HASHSTAT_OBJ $HTABLE_OBJ $URING_OBJ $STRUTIL_OBJ
+echo "--------- Hashstat Tests ----------" >> $TEST_OUT
+./test/build/test_hashstat >> $TEST_OUT
+
+# Build and run command latency tests
+gcc -o test/build/test_latency $LATENCY_TEST $UNITY_OBJ $LATENCY_OBJ $STRUTIL_OBJ
+echo "---------- Latency Tests ----------" >> $TEST_OUT
+./test/build/test_latency >> $TEST_OUT
+
+# Build and run sharded server tests
+gcc -pthread -o test/build/test_shard $SHARD_TEST $UNITY_OBJ $SHARD_OBJ $SERVER_OBJ $TXN_OBJ $PARSE_OBJ $MESSAGES_OBJ $RESP_OBJ $WIRE_OBJ $DBMGR_OBJ $ENGINE_OBJ $CATALOG_OBJ $BULKIO_OBJ $BINSTREAM_OBJ $HTABLE_OBJ $CUCKOO_OBJ $LSM_OBJ $LATENCY_OBJ $URING_OBJ $STRUTIL_OBJ
+echo "----------- Shard Tests -----------" >> $TEST_OUT
+./test/build/test_shard >> $TEST_OUT
+
+# Build and run transaction tests
+gcc -pthread -o test/build/test_txn $TXN_TEST $UNITY_OBJ $TXN_OBJ $DBMGR_OBJ $ENGINE_OBJ $CATALOG_OBJ $BULKIO_OBJ $BINSTREAM_OBJ $HTABLE_OBJ $CUCKOO_OBJ $LSM_OBJ $LATENCY_OBJ $URING_OBJ $STRUTIL_OBJ
+echo "------------ Txn Tests ------------" >> $TEST_OUT
+./test/build/test_txn >> $TEST_OUT
+
 # Build and run hashtable memory allocation/deallocation test
-gcc -o test/build/test_mem_hashtable $MEM_TEST $HTABLE_OBJ $STRUTIL_OBJ
+gcc -pthread -o test/build/test_mem_hashtable $MEM_TEST $HTABLE_OBJ $URING_OBJ $STRUTIL_OBJ
 echo "---------- Hashtable Memory Test ------------" >> $TEST_OUT
 valgrind ./test/build/test_mem_hashtable 2>> $TEST_OUT
 
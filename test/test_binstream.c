@@ -0,0 +1,112 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "unity/unity.h"
+#include "../src/binstream.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_varint(void)
+{
+    char buff[BIN_VARINT_MAX];
+    TEST_ASSERT_EQUAL_UINT(1, bin_put_varint(buff, 0));
+    TEST_ASSERT_EQUAL_UINT(1, bin_put_varint(buff, 127));
+    TEST_ASSERT_EQUAL_UINT(0x7f, (unsigned char) buff[0]);
+    TEST_ASSERT_EQUAL_UINT(2, bin_put_varint(buff, 300));
+    TEST_ASSERT_EQUAL_MEMORY("\xac\x02", buff, 2);
+    TEST_ASSERT_EQUAL_UINT(BIN_VARINT_MAX, bin_put_varint(buff, UINT64_MAX));
+}
+
+// Records decode to what was encoded, with key
+// and value pointing into the buffer
+void test_encode_decode(void)
+{
+    char buff[512];
+    char val[300];
+    memset(val, 'v', sizeof(val));
+    size_t len = bin_encode(buff, BIN_ADD, "k\n1", 3, val, sizeof(val));
+    TEST_ASSERT_EQUAL_UINT(bin_record_size(BIN_ADD, 3, sizeof(val)), len);
+    TEST_ASSERT_EQUAL_UINT(1 + 1 + 3 + 2 + 300, len);
+    len += bin_encode(buff + len, BIN_DEL, "k2", 2, "ignored", 7);
+
+    struct bin_record rec;
+    size_t used;
+    TEST_ASSERT_EQUAL_INT(1, bin_decode(buff, len, &rec, &used));
+    TEST_ASSERT_EQUAL_INT(BIN_ADD, rec.op);
+    TEST_ASSERT_EQUAL_UINT(3, rec.keylen);
+    TEST_ASSERT_TRUE(rec.key == buff + 2);
+    TEST_ASSERT_EQUAL_MEMORY("k\n1", rec.key, 3);
+    TEST_ASSERT_EQUAL_UINT(300, rec.vallen);
+    TEST_ASSERT_EQUAL_MEMORY(val, rec.val, 300);
+
+    size_t pos = used;
+    TEST_ASSERT_EQUAL_INT(1, bin_decode(buff + pos, len - pos, &rec, &used));
+    TEST_ASSERT_EQUAL_INT(BIN_DEL, rec.op);
+    TEST_ASSERT_EQUAL_MEMORY("k2", rec.key, 2);
+    TEST_ASSERT_NULL(rec.val);
+    TEST_ASSERT_EQUAL_UINT(len, pos + used);
+}
+
+// Every prefix of a record is incomplete
+void test_partial_record(void)
+{
+    char buff[64];
+    size_t len = bin_encode(buff, BIN_NEWTBL, "tbl1", 4, "cuckoo", 6);
+    struct bin_record rec;
+    size_t used;
+    for (size_t i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL_INT(0, bin_decode(buff, i, &rec, &used));
+    }
+    TEST_ASSERT_EQUAL_INT(1, bin_decode(buff, len, &rec, &used));
+    TEST_ASSERT_EQUAL_MEMORY("cuckoo", rec.val, 6);
+}
+
+void test_malformed(void)
+{
+    struct bin_record rec;
+    size_t used;
+    TEST_ASSERT_EQUAL_INT(-1, bin_decode("\x09\x01k", 3, &rec, &used));
+    TEST_ASSERT_EQUAL_INT(-1, bin_decode("\x00\x01k", 3, &rec, &used));
+
+    // Varint longer than BIN_VARINT_MAX bytes
+    char buff[16];
+    buff[0] = BIN_DEL;
+    memset(buff + 1, 0xff, sizeof(buff) - 1);
+    TEST_ASSERT_EQUAL_INT(-1, bin_decode(buff, sizeof(buff), &rec, &used));
+}
+
+void test_header_and_strings(void)
+{
+    TEST_ASSERT_EQUAL_INT(1, bin_check_header(BIN_MAGIC "\x01", BIN_HEADER_LEN + 1));
+    TEST_ASSERT_EQUAL_INT(0, bin_check_header("PDB", 3));
+    TEST_ASSERT_EQUAL_INT(-1, bin_check_header("PDBS\2", BIN_HEADER_LEN));
+    TEST_ASSERT_EQUAL_INT(-1, bin_check_header("add k v\n", 8));
+
+    char dst[8];
+    TEST_ASSERT_NULL(bin_string(dst, sizeof(dst), "a b\tc", 5));
+    TEST_ASSERT_EQUAL_STRING("a b\tc", dst);
+    TEST_ASSERT_NOT_NULL(bin_string(dst, sizeof(dst), "a\0b", 3));
+    TEST_ASSERT_NOT_NULL(bin_string(dst, sizeof(dst), "12345678", 8));
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_varint);
+    RUN_TEST(test_encode_decode);
+    RUN_TEST(test_partial_record);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_header_and_strings);
+
+    return UNITY_END();
+}
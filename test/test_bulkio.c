@@ -0,0 +1,322 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/bulkio.h"
+#include "../src/hashtable.h"
+#include "../src/binstream.h"
+
+static char path[] = "/tmp/pairdb-bulkio-test-XXXXXX";
+
+// Sink adding rows to a hash table and recording
+// line number of last malformed row
+struct test_sink {
+    hashtbl tbl;
+    size_t reserved;
+    size_t last_bad;
+};
+
+static int test_reserve(void *arg, size_t rows)
+{
+    ((struct test_sink *) arg)->reserved = rows;
+    return 1;
+}
+
+static int test_row(void *arg, const char *key, const char *val)
+{
+    return put(((struct test_sink *) arg)->tbl, (char *) key, (char *) val);
+}
+
+static void test_bad_row(void *arg, size_t lineno, const char *reason)
+{
+    (void) reason;
+    ((struct test_sink *) arg)->last_bad = lineno;
+}
+
+// Write contents to temporary file and import it
+static int import_str(const char *contents, enum bulk_format fmt,
+                      struct test_sink *ts, struct import_stats *stats)
+{
+    FILE *f = fopen(path, "w");
+    fputs(contents, f);
+    fclose(f);
+
+    ts->tbl = init_hashtbl(8);
+    ts->reserved = 0;
+    ts->last_bad = 0;
+    struct import_sink sink = {test_reserve, test_row, test_bad_row, ts};
+    return import_file(path, fmt, &sink, stats);
+}
+
+void setUp(void)
+{
+    strcpy(path, "/tmp/pairdb-bulkio-test-XXXXXX");
+    close(mkstemp(path));
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+
+void test_csv(void)
+{
+    struct test_sink ts;
+    struct import_stats stats;
+    TEST_ASSERT_EQUAL_INT(1, import_str("k1,v1\r\n"
+                                        "\"k,2\",\"say \"\"hi\"\"\"\n"
+                                        "\n"
+                                        "k3,\n"
+                                        "k1,dup\n"
+                                        "k4\n"
+                                        "\"k5,v5\n"
+                                        "k6,v6",
+                                        BULK_CSV, &ts, &stats));
+    TEST_ASSERT_EQUAL_INT(7, stats.rows);
+    TEST_ASSERT_EQUAL_INT(4, stats.added);
+    TEST_ASSERT_EQUAL_INT(1, stats.duplicates);
+    TEST_ASSERT_EQUAL_INT(2, stats.malformed);
+    TEST_ASSERT_EQUAL_INT(7, ts.last_bad);
+    TEST_ASSERT_GREATER_THAN(0, ts.reserved);
+
+    char valbuff[100];
+    find(valbuff, 100, ts.tbl, "k1");
+    TEST_ASSERT_EQUAL_STRING("v1", valbuff);
+    find(valbuff, 100, ts.tbl, "k,2");
+    TEST_ASSERT_EQUAL_STRING("say \"hi\"", valbuff);
+    TEST_ASSERT_EQUAL_INT(true, exists(ts.tbl, "k3"));
+    TEST_ASSERT_EQUAL_INT(true, exists(ts.tbl, "k6"));
+
+    destroy_hashtbl(ts.tbl);
+}
+
+void test_tsv(void)
+{
+    struct test_sink ts;
+    struct import_stats stats;
+    TEST_ASSERT_EQUAL_INT(1, import_str("a\tb c\nd\te\tf\n\tempty\n", BULK_TSV,
+                                        &ts, &stats));
+    TEST_ASSERT_EQUAL_INT(1, stats.added);
+    TEST_ASSERT_EQUAL_INT(2, stats.malformed);
+
+    char valbuff[100];
+    find(valbuff, 100, ts.tbl, "a");
+    TEST_ASSERT_EQUAL_STRING("b c", valbuff);
+
+    destroy_hashtbl(ts.tbl);
+}
+
+void test_jsonl(void)
+{
+    struct test_sink ts;
+    struct import_stats stats;
+    TEST_ASSERT_EQUAL_INT(1, import_str("{\"key\": \"a\", \"val\": \"x\\ty\\u00e9\"}\n"
+                                        "{\"n\": 1, \"val\": \"2\", \"key\": \"b\"}\n"
+                                        "{\"key\": \"c\"}\n"
+                                        "{\"key\": \"d\", \"val\": [1]}\n"
+                                        "{\"key\": \"e\", \"val\": \"v\"} x\n",
+                                        BULK_JSONL, &ts, &stats));
+    TEST_ASSERT_EQUAL_INT(2, stats.added);
+    TEST_ASSERT_EQUAL_INT(3, stats.malformed);
+
+    char valbuff[100];
+    find(valbuff, 100, ts.tbl, "a");
+    TEST_ASSERT_EQUAL_STRING("x\ty\xc3\xa9", valbuff);
+    find(valbuff, 100, ts.tbl, "b");
+    TEST_ASSERT_EQUAL_STRING("2", valbuff);
+
+    destroy_hashtbl(ts.tbl);
+}
+
+// Fields longer than pairdb accepts are malformed
+void test_field_too_long(void)
+{
+    char line[256];
+    memset(line, 'x', sizeof(line));
+    line[0] = 'k';
+    line[1] = ',';
+    line[254] = '\n';
+    line[255] = '\0';
+
+    struct test_sink ts;
+    struct import_stats stats;
+    import_str(line, BULK_CSV, &ts, &stats);
+    TEST_ASSERT_EQUAL_INT(0, stats.added);
+    TEST_ASSERT_EQUAL_INT(1, stats.malformed);
+    destroy_hashtbl(ts.tbl);
+}
+
+void test_find_format(void)
+{
+    TEST_ASSERT_EQUAL_INT(BULK_TSV, find_bulk_format("tsv", "data.csv"));
+    TEST_ASSERT_EQUAL_INT(BULK_JSONL, find_bulk_format(NULL, "data.jsonl"));
+    TEST_ASSERT_EQUAL_INT(BULK_TSV, find_bulk_format("", "data.tsv"));
+    TEST_ASSERT_EQUAL_INT(BULK_CSV, find_bulk_format(NULL, "data"));
+    TEST_ASSERT_EQUAL_INT(BULK_UNKNOWN, find_bulk_format("xml", "data.csv"));
+    TEST_ASSERT_EQUAL_INT(BULK_BINARY, find_bulk_format("binary", "data.csv"));
+    TEST_ASSERT_EQUAL_INT(BULK_BINARY, find_bulk_format(NULL, "data.bin"));
+}
+
+void test_missing_file(void)
+{
+    struct import_sink sink = {NULL, test_row, NULL, NULL};
+    TEST_ASSERT_EQUAL_INT(-1, import_file("/nonexistent-dir/data.csv", BULK_CSV,
+                                          &sink, NULL));
+}
+
+// Binary stream rows are add records; other
+// records are reported and a truncated record
+// ends the import
+void test_binary(void)
+{
+    char buff[256];
+    char *p = buff;
+    memcpy(p, BIN_MAGIC, BIN_HEADER_LEN);
+    p += BIN_HEADER_LEN;
+    p += bin_encode(p, BIN_ADD, "k1", 2, "a,b\n\"c\"", 7);
+    p += bin_encode(p, BIN_USE, "tbl", 3, NULL, 0);
+    p += bin_encode(p, BIN_ADD, "k\0", 2, "v", 1);
+    p += bin_encode(p, BIN_ADD, "k2", 2, "", 0);
+    p += bin_encode(p, BIN_ADD, "k3", 2, "v3", 2) - 1;
+
+    FILE *f = fopen(path, "w");
+    fwrite(buff, 1, p - buff, f);
+    fclose(f);
+
+    struct test_sink ts = {init_hashtbl(8), 0, 0};
+    struct import_sink sink = {test_reserve, test_row, test_bad_row, &ts};
+    struct import_stats stats;
+    TEST_ASSERT_EQUAL_INT(1, import_file(path, BULK_BINARY, &sink, &stats));
+    TEST_ASSERT_EQUAL_INT(5, stats.rows);
+    TEST_ASSERT_EQUAL_INT(2, stats.added);
+    TEST_ASSERT_EQUAL_INT(3, stats.malformed);
+    TEST_ASSERT_EQUAL_INT(5, ts.last_bad);
+    TEST_ASSERT_TRUE(ts.reserved >= 4);
+
+    char valbuff[100];
+    find(valbuff, 100, ts.tbl, "k1");
+    TEST_ASSERT_EQUAL_STRING("a,b\n\"c\"", valbuff);
+    destroy_hashtbl(ts.tbl);
+
+    // Text file is not a binary stream
+    TEST_ASSERT_EQUAL_INT(1, import_str("k1,v1\n", BULK_BINARY, &ts, &stats));
+    TEST_ASSERT_EQUAL_INT(0, stats.added);
+    TEST_ASSERT_EQUAL_INT(1, stats.malformed);
+    destroy_hashtbl(ts.tbl);
+}
+
+// Read temporary file into buff
+static void read_output(char *buff, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    size_t n = fread(buff, 1, size - 1, f);
+    buff[n] = '\0';
+    fclose(f);
+}
+
+void test_export_escaping(void)
+{
+    char buff[512];
+    struct export_stats stats;
+
+    exporter ex = export_open(path, BULK_CSV, false, 1);
+    TEST_ASSERT_NOT_NULL(ex);
+    export_row(ex, "k1", "plain");
+    export_row(ex, "k,2", "say \"hi\"");
+    TEST_ASSERT_EQUAL_INT(1, export_close(ex, &stats));
+    read_output(buff, sizeof(buff));
+    TEST_ASSERT_EQUAL_STRING("k1,plain\n\"k,2\",\"say \"\"hi\"\"\"\n", buff);
+    TEST_ASSERT_EQUAL_INT(2, stats.rows);
+    TEST_ASSERT_EQUAL_INT(strlen(buff), stats.bytes);
+
+    ex = export_open(path, BULK_JSONL, false, 1);
+    export_row(ex, "k\"1", "a\tb\\c\x01");
+    export_close(ex, NULL);
+    read_output(buff, sizeof(buff));
+    TEST_ASSERT_EQUAL_STRING("{\"key\":\"k\\\"1\",\"val\":\"a\\tb\\\\c\\u0001\"}\n", buff);
+
+    // TSV cannot hold tab characters in fields
+    ex = export_open(path, BULK_TSV, false, 1);
+    export_row(ex, "k1", "v1");
+    export_row(ex, "k2", "a\tb");
+    export_close(ex, &stats);
+    read_output(buff, sizeof(buff));
+    TEST_ASSERT_EQUAL_STRING("k1\tv1\n", buff);
+    TEST_ASSERT_EQUAL_INT(1, stats.skipped);
+}
+
+// Exported file imports back to the same pairs
+void test_export_import_round_trip(void)
+{
+    enum bulk_format formats[] = {BULK_CSV, BULK_TSV, BULK_JSONL, BULK_BINARY};
+    for (size_t f = 0; f < 4; f++) {
+        exporter ex = export_open(path, formats[f], false, 1);
+        export_row(ex, "k1", "v,1");
+        export_row(ex, "k2", "");
+        export_row(ex, "k3", "\"quoted\"");
+        TEST_ASSERT_EQUAL_INT(1, export_close(ex, NULL));
+
+        struct test_sink ts = {init_hashtbl(8), 0, 0};
+        struct import_sink sink = {NULL, test_row, test_bad_row, &ts};
+        struct import_stats stats;
+        TEST_ASSERT_EQUAL_INT(1, import_file(path, formats[f], &sink, &stats));
+        TEST_ASSERT_EQUAL_INT(3, stats.added);
+        TEST_ASSERT_EQUAL_INT(0, stats.malformed);
+
+        char valbuff[100];
+        find(valbuff, 100, ts.tbl, "k3");
+        TEST_ASSERT_EQUAL_STRING("\"quoted\"", valbuff);
+        destroy_hashtbl(ts.tbl);
+    }
+}
+
+// Sorted export large enough to be sorted by
+// several threads writes keys in strcmp order
+void test_export_sorted(void)
+{
+    exporter ex = export_open(path, BULK_TSV, true, 4);
+    char keybuff[32];
+    for (int i = 0; i < 100000; i++) {
+        snprintf(keybuff, sizeof(keybuff), "k%d", (i * 7919) % 100000);
+        export_row(ex, keybuff, "v");
+    }
+    struct export_stats stats;
+    TEST_ASSERT_EQUAL_INT(1, export_close(ex, &stats));
+    TEST_ASSERT_EQUAL_INT(100000, stats.rows);
+
+    FILE *f = fopen(path, "r");
+    char prev[64] = "";
+    char line[64];
+    size_t n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        TEST_ASSERT_TRUE(strcmp(prev, line) < 0);
+        strcpy(prev, line);
+        n++;
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL_INT(100000, n);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_csv);
+    RUN_TEST(test_tsv);
+    RUN_TEST(test_jsonl);
+    RUN_TEST(test_field_too_long);
+    RUN_TEST(test_find_format);
+    RUN_TEST(test_missing_file);
+    RUN_TEST(test_binary);
+    RUN_TEST(test_export_escaping);
+    RUN_TEST(test_export_import_round_trip);
+    RUN_TEST(test_export_sorted);
+
+    return UNITY_END();
+}
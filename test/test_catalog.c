@@ -0,0 +1,154 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/catalog.h"
+#include "../src/stringutil.h"
+
+static char path[] = "/tmp/pairdb-catalog-test-XXXXXX";
+
+void setUp(void)
+{
+    strcpy(path, "/tmp/pairdb-catalog-test-XXXXXX");
+    int fd = mkstemp(path);
+    close(fd);
+    unlink(path);
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+static struct cat_entry new_entry(catalog cat, const char *name)
+{
+    struct cat_entry entry = {0};
+    strtcpy(entry.name, name, TBL_NAME_MAX);
+    strtcpy(entry.engine, "hash", CAT_ENGINE_MAX);
+    catalog_new_fname(cat, entry.fname);
+    return entry;
+}
+
+static int count_entry(const struct cat_entry *entry, void *arg)
+{
+    (void) entry;
+    (*(size_t *) arg)++;
+    return 0;
+}
+
+
+void test_add_find_remove(void)
+{
+    catalog cat = catalog_open(path);
+    TEST_ASSERT_NOT_NULL(cat);
+    TEST_ASSERT_EQUAL_INT(0, catalog_count(cat));
+
+    struct cat_entry entry = new_entry(cat, "tbl1");
+    TEST_ASSERT_EQUAL_INT(1, catalog_add(cat, &entry));
+    TEST_ASSERT_EQUAL_INT(-1, catalog_add(cat, &entry));
+
+    struct cat_entry found;
+    TEST_ASSERT_EQUAL_INT(true, catalog_find(cat, "tbl1", &found));
+    TEST_ASSERT_EQUAL_STRING(entry.fname, found.fname);
+    TEST_ASSERT_EQUAL_STRING("hash", found.engine);
+    TEST_ASSERT_EQUAL_INT(false, catalog_find(cat, "tbl2", NULL));
+
+    TEST_ASSERT_EQUAL_INT(1, catalog_set_stats(cat, "tbl1", 42, 8192, 1000));
+    TEST_ASSERT_EQUAL_INT(-1, catalog_set_stats(cat, "tbl2", 0, 0, 0));
+    catalog_find(cat, "tbl1", &found);
+    TEST_ASSERT_EQUAL_INT(42, found.entries);
+    TEST_ASSERT_EQUAL_INT(8192, found.bytes);
+
+    TEST_ASSERT_EQUAL_INT(1, catalog_remove(cat, "tbl1"));
+    TEST_ASSERT_EQUAL_INT(-1, catalog_remove(cat, "tbl1"));
+    TEST_ASSERT_EQUAL_INT(false, catalog_find(cat, "tbl1", NULL));
+    TEST_ASSERT_EQUAL_INT(0, catalog_count(cat));
+
+    catalog_close(cat);
+}
+
+// Catalog grows past its initial size and
+// keeps every table across reopening
+void test_grow_and_reopen(void)
+{
+    catalog cat = catalog_open(path);
+    char name[TBL_NAME_MAX];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, TBL_NAME_MAX, "tbl%d", i);
+        struct cat_entry entry = new_entry(cat, name);
+        TEST_ASSERT_EQUAL_INT(1, catalog_add(cat, &entry));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        snprintf(name, TBL_NAME_MAX, "tbl%d", i);
+        TEST_ASSERT_EQUAL_INT(1, catalog_remove(cat, name));
+    }
+    TEST_ASSERT_EQUAL_INT(1, catalog_sync(cat));
+    catalog_close(cat);
+
+    cat = catalog_open(path);
+    TEST_ASSERT_NOT_NULL(cat);
+    TEST_ASSERT_EQUAL_INT(500, catalog_count(cat));
+    TEST_ASSERT_EQUAL_INT(true, catalog_find(cat, "tbl999", NULL));
+    TEST_ASSERT_EQUAL_INT(false, catalog_find(cat, "tbl998", NULL));
+
+    size_t n = 0;
+    catalog_foreach(cat, count_entry, &n);
+    TEST_ASSERT_EQUAL_INT(500, n);
+
+    char **names = catalog_get_names(cat);
+    TEST_ASSERT_NOT_NULL(names);
+    TEST_ASSERT_EQUAL_INT(true, catalog_find(cat, names[499], NULL));
+    free(names);
+
+    catalog_close(cat);
+}
+
+// File names are never reused, including names
+// imported from an earlier table list
+void test_unique_fnames(void)
+{
+    catalog cat = catalog_open(path);
+
+    char first[CAT_FNAME_MAX];
+    char second[CAT_FNAME_MAX];
+    TEST_ASSERT_EQUAL_INT(1, catalog_new_fname(cat, first));
+    TEST_ASSERT_EQUAL_INT(1, catalog_new_fname(cat, second));
+    TEST_ASSERT_TRUE(strcmp(first, second) != 0);
+
+    struct cat_entry entry = {0};
+    strtcpy(entry.name, "old", TBL_NAME_MAX);
+    strtcpy(entry.fname, "0000000100", CAT_FNAME_MAX);
+    catalog_add(cat, &entry);
+    catalog_close(cat);
+
+    cat = catalog_open(path);
+    catalog_new_fname(cat, first);
+    TEST_ASSERT_EQUAL_STRING("0000000101", first);
+    catalog_close(cat);
+}
+
+void test_null_catalog(void)
+{
+    TEST_ASSERT_NULL(catalog_open("/nonexistent-dir/catalog.idx"));
+    TEST_ASSERT_EQUAL_INT(false, catalog_find(NULL, "tbl", NULL));
+    TEST_ASSERT_EQUAL_INT(0, catalog_count(NULL));
+    TEST_ASSERT_EQUAL_INT(-1, catalog_foreach(NULL, count_entry, NULL));
+    catalog_close(NULL);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_add_find_remove);
+    RUN_TEST(test_grow_and_reopen);
+    RUN_TEST(test_unique_fnames);
+    RUN_TEST(test_null_catalog);
+
+    return UNITY_END();
+}
@@ -0,0 +1,199 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/cuckoo.h"
+#include "../src/stringutil.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static int count_entry(const char *key, const char *val, void *arg)
+{
+    (void) key;
+    (void) val;
+    (*(size_t *) arg)++;
+    return 0;
+}
+
+
+void test_put_find_delete(void)
+{
+    cuckoo_tbl tbl = cuckoo_init(0);
+    TEST_ASSERT_NOT_NULL(tbl);
+
+    TEST_ASSERT_EQUAL_INT(1, cuckoo_put(tbl, "key1", "val1"));
+    TEST_ASSERT_EQUAL_INT(1, cuckoo_put(tbl, "key2", "val2"));
+    TEST_ASSERT_EQUAL_INT(-1, cuckoo_put(tbl, "key1", "other"));
+
+    char valbuff[100];
+    TEST_ASSERT_EQUAL_INT(4, cuckoo_find(valbuff, 100, tbl, "key1"));
+    TEST_ASSERT_EQUAL_STRING("val1", valbuff);
+    TEST_ASSERT_EQUAL_INT(0, cuckoo_find(valbuff, 100, tbl, "key3"));
+
+    cuckoo_delete(tbl, "key1");
+    cuckoo_delete(tbl, "key1");
+    TEST_ASSERT_EQUAL_INT(false, cuckoo_exists(tbl, "key1"));
+    TEST_ASSERT_EQUAL_INT(true, cuckoo_exists(tbl, "key2"));
+    TEST_ASSERT_EQUAL_INT(1, cuckoo_count(tbl));
+
+    cuckoo_destroy(tbl);
+}
+
+// Table grows from its smallest size and every
+// key stays reachable through moves and resizes
+void test_grow(void)
+{
+    cuckoo_tbl tbl = cuckoo_init(0);
+    char keybuff[100];
+    char valbuff[100];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        snprintf(valbuff, 100, "val%d", i);
+        TEST_ASSERT_EQUAL_INT(1, cuckoo_put(tbl, keybuff, valbuff));
+    }
+    TEST_ASSERT_EQUAL_INT(20000, cuckoo_count(tbl));
+
+    for (int i = 0; i < 20000; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        snprintf(valbuff, 100, "val%d", i);
+        char found[100];
+        cuckoo_find(found, 100, tbl, keybuff);
+        TEST_ASSERT_EQUAL_STRING(valbuff, found);
+    }
+
+    struct cuckoo_stats stats;
+    cuckoo_get_stats(tbl, &stats);
+    TEST_ASSERT_GREATER_THAN(0, stats.resizes);
+    TEST_ASSERT_GREATER_THAN(0, stats.kicks);
+
+    size_t n = 0;
+    cuckoo_foreach(tbl, count_entry, &n);
+    TEST_ASSERT_EQUAL_INT(20000, n);
+
+    char **keys = cuckoo_get_keys(tbl);
+    char **vals = cuckoo_get_vals(tbl);
+    cuckoo_find(valbuff, 100, tbl, keys[123]);
+    TEST_ASSERT_EQUAL_STRING(valbuff, vals[123]);
+    free(keys);
+    free(vals);
+
+    cuckoo_destroy(tbl);
+}
+
+// Reserved table takes its entries without rebuilding
+void test_reserve(void)
+{
+    cuckoo_tbl tbl = cuckoo_init(0);
+    TEST_ASSERT_EQUAL_INT(1, cuckoo_reserve(tbl, 5000));
+
+    struct cuckoo_stats before;
+    cuckoo_get_stats(tbl, &before);
+
+    char keybuff[100];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        cuckoo_put(tbl, keybuff, "val");
+    }
+
+    struct cuckoo_stats after;
+    cuckoo_get_stats(tbl, &after);
+    TEST_ASSERT_EQUAL_INT(before.resizes, after.resizes);
+    TEST_ASSERT_EQUAL_INT(5000, cuckoo_count(tbl));
+
+    cuckoo_destroy(tbl);
+}
+
+void test_write_and_load(void)
+{
+    cuckoo_tbl tbl = cuckoo_init(0);
+    char keybuff[100];
+    char valbuff[100];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        snprintf(valbuff, 100, "val%d", i);
+        cuckoo_put(tbl, keybuff, valbuff);
+    }
+    cuckoo_put(tbl, "empty", "");
+
+    char path[] = "/tmp/pairdb-cuckoo-test-XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    TEST_ASSERT_GREATER_THAN(0, cuckoo_write_fd(tbl, fd, false));
+
+    cuckoo_tbl loaded = cuckoo_load_fd(fd);
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_INT(1001, cuckoo_count(loaded));
+    cuckoo_find(valbuff, 100, loaded, "key999");
+    TEST_ASSERT_EQUAL_STRING("val999", valbuff);
+    TEST_ASSERT_EQUAL_INT(true, cuckoo_exists(loaded, "empty"));
+
+    // Not a cuckoo table file
+    TEST_ASSERT_EQUAL_INT(0, ftruncate(fd, 4));
+    TEST_ASSERT_NULL(cuckoo_load_fd(fd));
+
+    close(fd);
+    cuckoo_destroy(loaded);
+    cuckoo_destroy(tbl);
+}
+
+// Counts entries until page of 5 is full
+static int count_page(const char *key, const char *val, void *arg)
+{
+    count_entry(key, val, arg);
+    return *(size_t *) arg % 5 == 0;
+}
+
+// Scanning in pages visits every entry once
+void test_scan(void)
+{
+    cuckoo_tbl tbl = cuckoo_init(0);
+    char keybuff[100];
+    for (int i = 0; i < 5003; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        cuckoo_put(tbl, keybuff, "val");
+    }
+
+    size_t visited = 0;
+    size_t pages = 0;
+    size_t cursor = 0;
+    do {
+        cursor = cuckoo_scan(tbl, cursor, count_page, &visited);
+        pages++;
+    } while (cursor != 0);
+    TEST_ASSERT_EQUAL_UINT(5003, visited);
+    TEST_ASSERT_EQUAL_UINT(1001, pages);
+
+    cuckoo_destroy(tbl);
+}
+
+void test_null_tbl(void)
+{
+    char valbuff[100];
+    TEST_ASSERT_EQUAL_INT(-2, cuckoo_put(NULL, "key", "val"));
+    TEST_ASSERT_EQUAL_INT(0, cuckoo_find(valbuff, 100, NULL, "key"));
+    TEST_ASSERT_EQUAL_INT(false, cuckoo_exists(NULL, "key"));
+    TEST_ASSERT_EQUAL_INT(-1, cuckoo_write_fd(NULL, 1, false));
+    TEST_ASSERT_NULL(cuckoo_get_keys(NULL));
+    cuckoo_delete(NULL, "key");
+    cuckoo_destroy(NULL);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_put_find_delete);
+    RUN_TEST(test_grow);
+    RUN_TEST(test_reserve);
+    RUN_TEST(test_write_and_load);
+    RUN_TEST(test_scan);
+    RUN_TEST(test_null_tbl);
+
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/hashstat.h"
+#include "../src/hashtable.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void add_keys(struct hs_keys *ks, int numkeys)
+{
+    char keybuff[100];
+    for (int i = 0; i < numkeys; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        TEST_ASSERT_EQUAL_INT(1, hs_keys_add(ks, keybuff));
+    }
+}
+
+
+void test_hash_functions(void)
+{
+    TEST_ASSERT_EQUAL_UINT(hash_key("key1"), hs_hash_key(HS_FNV1A, "key1"));
+    TEST_ASSERT_EQUAL_UINT(hash_key(""), hs_hash_key(HS_FNV1A, ""));
+
+    // MurmurHash3 x86_32 reference values, seed 0
+    TEST_ASSERT_EQUAL_UINT(0, hs_hash_key(HS_MURMUR3, ""));
+    TEST_ASSERT_EQUAL_UINT(0x3c2569b2, hs_hash_key(HS_MURMUR3, "a"));
+    TEST_ASSERT_EQUAL_UINT(0x2e4ff723, hs_hash_key(HS_MURMUR3,
+                            "The quick brown fox jumps over the lazy dog"));
+
+    TEST_ASSERT_EQUAL_UINT(5381, hs_hash_key(HS_DJB2, ""));
+    TEST_ASSERT_EQUAL_UINT(5381 * 33 + 'a', hs_hash_key(HS_DJB2, "a"));
+
+    TEST_ASSERT_EQUAL_STRING("fnv1a", hs_hash_name(HS_FNV1A));
+    TEST_ASSERT_EQUAL_STRING("djb2", hs_hash_name(HS_DJB2));
+    TEST_ASSERT_EQUAL_STRING("", hs_hash_name(HS_NUM_HASHES));
+}
+
+// Every key is counted once among probe lengths
+// and once among home buckets
+void test_analyze_counts(void)
+{
+    struct hs_keys ks = {0};
+    add_keys(&ks, 5000);
+
+    for (int fn = 0; fn < HS_NUM_HASHES; fn++) {
+        struct hs_report rep;
+        TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, fn, 0.6, false, &rep));
+        TEST_ASSERT_EQUAL_size_t(5000, rep.numkeys);
+        TEST_ASSERT_EQUAL_size_t(16384, rep.arrsize);
+
+        size_t placed = 0;
+        for (size_t i = 0; i <= HS_PROBE_MAX; i++) {
+            placed += rep.probes[i];
+        }
+        TEST_ASSERT_EQUAL_size_t(5000, placed);
+
+        size_t buckets = 0;
+        size_t homed = 0;
+        for (size_t k = 0; k <= HS_HOME_MAX; k++) {
+            buckets += rep.home[k];
+            homed += k * rep.home[k];
+        }
+        TEST_ASSERT_EQUAL_size_t(16384, buckets);
+        TEST_ASSERT_EQUAL_size_t(5000, homed);
+
+        TEST_ASSERT_EQUAL_size_t(HS_OUTLIERS, rep.numoutliers);
+        TEST_ASSERT_EQUAL_size_t(rep.maxprobe, rep.outliers[0].probes);
+        for (size_t i = 1; i < rep.numoutliers; i++) {
+            TEST_ASSERT_TRUE(rep.outliers[i - 1].probes >= rep.outliers[i].probes);
+        }
+        TEST_ASSERT_TRUE(hs_probe_percentile(&rep, 0.99) <= rep.maxprobe);
+    }
+
+    hs_keys_free(&ks);
+}
+
+// Full table holds only the keys that fit
+// before it would resize
+void test_analyze_full(void)
+{
+    struct hs_keys ks = {0};
+    add_keys(&ks, 5000);
+
+    struct hs_report rep;
+    TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, HS_FNV1A, 0.5, true, &rep));
+    TEST_ASSERT_EQUAL_size_t(8192, rep.arrsize);
+    TEST_ASSERT_EQUAL_size_t(4096, rep.numkeys);
+
+    // Keys already fill table exactly
+    TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, HS_FNV1A, 5000.0 / 8192, true, &rep));
+    TEST_ASSERT_EQUAL_size_t(8192, rep.arrsize);
+    TEST_ASSERT_EQUAL_size_t(5000, rep.numkeys);
+
+    hs_keys_free(&ks);
+}
+
+void test_analyze_single_key(void)
+{
+    struct hs_keys ks = {0};
+    add_keys(&ks, 1);
+
+    struct hs_report rep;
+    TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, HS_FNV1A, 0.6, false, &rep));
+    TEST_ASSERT_EQUAL_size_t(2, rep.arrsize);
+    TEST_ASSERT_EQUAL_size_t(0, rep.maxprobe);
+    TEST_ASSERT_EQUAL_size_t(1, rep.probes[0]);
+    TEST_ASSERT_EQUAL_size_t(0, rep.hash_collisions);
+    TEST_ASSERT_EQUAL_size_t(1, rep.numoutliers);
+    TEST_ASSERT_EQUAL_STRING("key0", rep.outliers[0].key);
+
+    hs_keys_free(&ks);
+}
+
+void test_analyze_errors(void)
+{
+    struct hs_keys ks = {0};
+    struct hs_report rep;
+    TEST_ASSERT_EQUAL_INT(-1, hs_analyze(&ks, HS_FNV1A, 0.6, false, &rep));
+
+    add_keys(&ks, 10);
+    TEST_ASSERT_EQUAL_INT(-1, hs_analyze(&ks, HS_FNV1A, 0, false, &rep));
+    TEST_ASSERT_EQUAL_INT(-1, hs_analyze(&ks, HS_FNV1A, 1.5, false, &rep));
+
+    hs_keys_free(&ks);
+    TEST_ASSERT_EQUAL_size_t(0, ks.numkeys);
+}
+
+// Duplicate keys share a hash value
+void test_collisions(void)
+{
+    struct hs_keys ks = {0};
+    add_keys(&ks, 100);
+    add_keys(&ks, 3);
+
+    struct hs_report rep;
+    TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, HS_MURMUR3, 0.6, false, &rep));
+    TEST_ASSERT_EQUAL_size_t(6, rep.hash_collisions);
+
+    hs_keys_free(&ks);
+}
+
+// Keys are read up to first tab, empty lines skipped
+void test_keys_read(void)
+{
+    char path[] = "/tmp/test_hashstat_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    const char *dump = "key1\tval1\n\nkey2\nkey3\tval\twith tab\r\n";
+    TEST_ASSERT_EQUAL_INT((int) strlen(dump), write(fd, dump, strlen(dump)));
+    close(fd);
+
+    struct hs_keys ks = {0};
+    TEST_ASSERT_EQUAL_INT(1, hs_keys_read(&ks, path));
+    TEST_ASSERT_EQUAL_size_t(3, ks.numkeys);
+    TEST_ASSERT_EQUAL_STRING("key1", ks.keys[0]);
+    TEST_ASSERT_EQUAL_STRING("key2", ks.keys[1]);
+    TEST_ASSERT_EQUAL_STRING("key3", ks.keys[2]);
+    hs_keys_free(&ks);
+
+    unlink(path);
+    TEST_ASSERT_EQUAL_INT(-1, hs_keys_read(&ks, path));
+}
+
+void test_uniform_home(void)
+{
+    struct hs_keys ks = {0};
+    add_keys(&ks, 5000);
+
+    struct hs_report rep;
+    TEST_ASSERT_EQUAL_INT(1, hs_analyze(&ks, HS_FNV1A, 0.6, false, &rep));
+
+    double buckets = 0;
+    double homed = 0;
+    for (size_t k = 0; k < HS_HOME_MAX; k++) {
+        buckets += hs_uniform_home(&rep, k);
+        homed += k * hs_uniform_home(&rep, k);
+    }
+    buckets += hs_uniform_home(&rep, HS_HOME_MAX);
+    TEST_ASSERT_TRUE(buckets > 16383.99 && buckets < 16384.01);
+    TEST_ASSERT_TRUE(homed > 4999 && homed < 5001);
+
+    hs_keys_free(&ks);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_hash_functions);
+    RUN_TEST(test_analyze_counts);
+    RUN_TEST(test_analyze_full);
+    RUN_TEST(test_analyze_single_key);
+    RUN_TEST(test_analyze_errors);
+    RUN_TEST(test_collisions);
+    RUN_TEST(test_keys_read);
+    RUN_TEST(test_uniform_home);
+
+    return UNITY_END();
+}
@@ -103,6 +103,47 @@ void test_resize(void)
     destroy_hashtbl(tbl);
 }
 
+void test_reserve(void)
+{
+    hashtbl tbl = init_hashtbl(2);
+    put(tbl, "key1", "val1");
+
+    // 0.60 load factor limit - 100 entries need 256 buckets
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_reserve(tbl, 100));
+    TEST_ASSERT_EQUAL_INT(256, get_tbl_size(tbl));
+
+    // Never shrinks
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_reserve(tbl, 10));
+    TEST_ASSERT_EQUAL_INT(256, get_tbl_size(tbl));
+
+    char keybuff[100];
+    for (int i = 2; i <= 100; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        put(tbl, keybuff, "val");
+    }
+    TEST_ASSERT_EQUAL_INT(256, get_tbl_size(tbl));
+    TEST_ASSERT_EQUAL_INT(true, exists(tbl, "key1"));
+    TEST_ASSERT_EQUAL_INT(true, exists(tbl, "key100"));
+
+    destroy_hashtbl(tbl);
+}
+
+void test_mem_usage(void)
+{
+    hashtbl tbl = init_hashtbl(8);
+    size_t empty = get_mem_usage(tbl);
+    TEST_ASSERT_GREATER_THAN(0, empty);
+
+    put(tbl, "key1", "val1");
+    size_t one = get_mem_usage(tbl);
+    TEST_ASSERT_GREATER_THAN(empty, one);
+
+    delete(tbl, "key1");
+    TEST_ASSERT_EQUAL_INT(empty, get_mem_usage(tbl));
+
+    destroy_hashtbl(tbl);
+}
+
 void test_find(void)
 {
     hashtbl tbl = init_hashtbl(4);
@@ -134,6 +175,54 @@ void test_exists(void)
     destroy_hashtbl(tbl);
 }
 
+// Keys stay reachable past buckets emptied by
+// deletes, and deleted keys can be added again
+void test_find_after_delete(void)
+{
+    hashtbl tbl = init_hashtbl(1024);
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_reserve(tbl, 5000));
+    char keybuff[32];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(keybuff, sizeof(keybuff), "key%d", i);
+        TEST_ASSERT_EQUAL_INT(1, put(tbl, keybuff, "val"));
+    }
+    for (int i = 0; i < 5000; i += 2) {
+        snprintf(keybuff, sizeof(keybuff), "key%d", i);
+        delete(tbl, keybuff);
+    }
+    for (int i = 0; i < 5000; i++) {
+        snprintf(keybuff, sizeof(keybuff), "key%d", i);
+        TEST_ASSERT_EQUAL_INT(i % 2 == 1, exists(tbl, keybuff));
+        TEST_ASSERT_EQUAL_INT(i % 2 == 1 ? -1 : 1, put(tbl, keybuff, "val"));
+    }
+    TEST_ASSERT_EQUAL_INT(5000, get_numentries(tbl));
+
+    destroy_hashtbl(tbl);
+}
+
+void test_replace(void)
+{
+    hashtbl tbl = init_hashtbl(8);
+    put(tbl, "key1", "val1");
+    put(tbl, "key2", "val2");
+    size_t mem = get_mem_usage(tbl);
+
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_replace(tbl, "key1", "longer value"));
+    TEST_ASSERT_EQUAL_INT(-1, hashtbl_replace(tbl, "key3", "val3"));
+    TEST_ASSERT_EQUAL_INT(2, get_numentries(tbl));
+    TEST_ASSERT_EQUAL_INT(mem + strlen("longer value") - strlen("val1"),
+                          get_mem_usage(tbl));
+
+    char valbuff[32];
+    find(valbuff, sizeof(valbuff), tbl, "key1");
+    TEST_ASSERT_EQUAL_STRING("longer value", valbuff);
+    find(valbuff, sizeof(valbuff), tbl, "key2");
+    TEST_ASSERT_EQUAL_STRING("val2", valbuff);
+    TEST_ASSERT_FALSE(exists(tbl, "key3"));
+
+    destroy_hashtbl(tbl);
+}
+
 void test_hashtbl_fileio(void)
 {
     hashtbl tbl = init_hashtbl(8);
@@ -183,6 +272,209 @@ void test_hashtbl_fileio(void)
     destroy_hashtbl(tbl2);
 }
 
+void test_hashtbl_sync_file(void)
+{
+    hashtbl tbl = init_hashtbl(64);
+
+    put(tbl, "key1", "val1");
+    put(tbl, "key2", "val2");
+    put(tbl, "key3", "val3");
+
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+
+    // New table is written in full
+    TEST_ASSERT_EQUAL_INT(true, hashtbl_needs_full_sync(tbl));
+    ssize_t full = hashtbl_sync_file(tbl, fd, false, false);
+    TEST_ASSERT_GREATER_THAN(0, full);
+    TEST_ASSERT_EQUAL_INT(false, hashtbl_needs_full_sync(tbl));
+
+    // Only pages holding changed buckets are rewritten
+    delete(tbl, "key2");
+    put(tbl, "key4", "val4");
+    ssize_t delta = hashtbl_sync_file(tbl, fd, false, false);
+    TEST_ASSERT_GREATER_THAN(0, delta);
+    TEST_ASSERT_LESS_OR_EQUAL(HT_FILE_PAGE + 2 * 16 * HT_FILE_SLOT, delta);
+
+    // No changes - only header page is written
+    delta = hashtbl_sync_file(tbl, fd, false, false);
+    TEST_ASSERT_EQUAL_INT(HT_FILE_PAGE, delta);
+
+    hashtbl tbl2 = load_hashtbl_from_fd(fd);
+    TEST_ASSERT_NOT_NULL(tbl2);
+    TEST_ASSERT_EQUAL_INT(get_tbl_size(tbl), get_tbl_size(tbl2));
+    TEST_ASSERT_EQUAL_INT(3, get_numentries(tbl2));
+    TEST_ASSERT_EQUAL_INT(false, exists(tbl2, "key2"));
+
+    char valbuff[HT_VAL_MAX];
+    find(valbuff, HT_VAL_MAX, tbl2, "key1");
+    TEST_ASSERT_EQUAL_STRING("val1", valbuff);
+    find(valbuff, HT_VAL_MAX, tbl2, "key4");
+    TEST_ASSERT_EQUAL_STRING("val4", valbuff);
+
+    // Loaded table matches its file
+    TEST_ASSERT_EQUAL_INT(false, hashtbl_needs_full_sync(tbl2));
+
+    fclose(f);
+    destroy_hashtbl(tbl);
+    destroy_hashtbl(tbl2);
+}
+
+void test_resize_needs_full_sync(void)
+{
+    hashtbl tbl = init_hashtbl(2);
+    FILE *f = tmpfile();
+    hashtbl_sync_file(tbl, fileno(f), false, false);
+    TEST_ASSERT_EQUAL_INT(false, hashtbl_needs_full_sync(tbl));
+
+    put(tbl, "key1", "val1");
+    put(tbl, "key2", "val2");
+    put(tbl, "key3", "val3");
+    TEST_ASSERT_EQUAL_INT(true, hashtbl_needs_full_sync(tbl));
+
+    fclose(f);
+    destroy_hashtbl(tbl);
+}
+
+void test_load_parallel(void)
+{
+    // Large enough to be split across threads
+    hashtbl tbl = init_hashtbl(131072);
+    char keybuff[HT_KEY_MAX];
+    char valbuff[HT_VAL_MAX];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(keybuff, HT_KEY_MAX, "key%d", i);
+        snprintf(valbuff, HT_VAL_MAX, "val%d", i);
+        put(tbl, keybuff, valbuff);
+    }
+
+    FILE *f = tmpfile();
+    hashtbl_sync_file(tbl, fileno(f), true, false);
+
+    hashtbl tbl2 = load_hashtbl_parallel(fileno(f), 4);
+    TEST_ASSERT_NOT_NULL(tbl2);
+    TEST_ASSERT_EQUAL_INT(get_tbl_size(tbl), get_tbl_size(tbl2));
+    TEST_ASSERT_EQUAL_INT(20000, get_numentries(tbl2));
+    TEST_ASSERT_EQUAL_INT(get_mem_usage(tbl), get_mem_usage(tbl2));
+
+    find(valbuff, HT_VAL_MAX, tbl2, "key0");
+    TEST_ASSERT_EQUAL_STRING("val0", valbuff);
+    find(valbuff, HT_VAL_MAX, tbl2, "key19999");
+    TEST_ASSERT_EQUAL_STRING("val19999", valbuff);
+
+    // Chunk counts carried over - deleting and
+    // syncing again keeps the table consistent
+    delete(tbl2, "key5");
+    hashtbl_sync_file(tbl2, fileno(f), false, false);
+    hashtbl tbl3 = load_hashtbl_parallel(fileno(f), 8);
+    TEST_ASSERT_EQUAL_INT(19999, get_numentries(tbl3));
+    TEST_ASSERT_EQUAL_INT(false, exists(tbl3, "key5"));
+
+    fclose(f);
+    destroy_hashtbl(tbl);
+    destroy_hashtbl(tbl2);
+    destroy_hashtbl(tbl3);
+}
+
+void test_load_from_fd_rejects_stream_format(void)
+{
+    hashtbl tbl = init_hashtbl(8);
+    put(tbl, "key1", "val1");
+
+    FILE *f = tmpfile();
+    hashtbl_to_file(tbl, f);
+    fflush(f);
+
+    hashtbl tbl2 = load_hashtbl_from_fd(fileno(f));
+    TEST_ASSERT_NULL(tbl2);
+
+    fclose(f);
+    destroy_hashtbl(tbl);
+}
+
+// Keys are found in the file without loading it
+void test_lookup_fd(void)
+{
+    hashtbl tbl = init_hashtbl(64);
+    char keybuff[16];
+    for (int i = 0; i < 30; i++) {
+        snprintf(keybuff, sizeof(keybuff), "key%d", i);
+        put(tbl, keybuff, "val");
+    }
+    put(tbl, "key", "value");
+
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+    hashtbl_sync_file(tbl, fd, true, false);
+
+    char valbuff[HT_VAL_MAX];
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_lookup_fd(fd, "key", valbuff, HT_VAL_MAX));
+    TEST_ASSERT_EQUAL_STRING("value", valbuff);
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_lookup_fd(fd, "key29", valbuff, HT_VAL_MAX));
+    TEST_ASSERT_EQUAL_INT(0, hashtbl_lookup_fd(fd, "key30", valbuff, HT_VAL_MAX));
+
+    // Value is cut to fit dst
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_lookup_fd(fd, "key", valbuff, 3));
+    TEST_ASSERT_EQUAL_STRING("va", valbuff);
+
+    // Stream format cannot be read this way
+    FILE *sf = tmpfile();
+    hashtbl_to_file(tbl, sf);
+    fflush(sf);
+    TEST_ASSERT_EQUAL_INT(-1, hashtbl_lookup_fd(fileno(sf), "key", valbuff, HT_VAL_MAX));
+
+    fclose(sf);
+    fclose(f);
+    destroy_hashtbl(tbl);
+}
+
+// Pairs added and deleted in the file are seen
+// by lookups and by loading the table
+void test_update_fd(void)
+{
+    hashtbl tbl = init_hashtbl(16);
+    put(tbl, "key1", "val1");
+    put(tbl, "key2", "val2");
+
+    FILE *f = tmpfile();
+    int fd = fileno(f);
+    hashtbl_sync_file(tbl, fd, true, false);
+    destroy_hashtbl(tbl);
+
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_update_fd(fd, "key3", "val3", false));
+    TEST_ASSERT_EQUAL_INT(-1, hashtbl_update_fd(fd, "key1", "new", false));
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_update_fd(fd, "key2", NULL, false));
+    TEST_ASSERT_EQUAL_INT(0, hashtbl_update_fd(fd, "key2", NULL, false));
+
+    char valbuff[HT_VAL_MAX];
+    TEST_ASSERT_EQUAL_INT(1, hashtbl_lookup_fd(fd, "key3", valbuff, HT_VAL_MAX));
+    TEST_ASSERT_EQUAL_STRING("val3", valbuff);
+    TEST_ASSERT_EQUAL_INT(0, hashtbl_lookup_fd(fd, "key2", valbuff, HT_VAL_MAX));
+
+    // Adding pairs until the table would resize
+    char keybuff[16];
+    int added = 0;
+    int ret = 1;
+    while (ret == 1) {
+        snprintf(keybuff, sizeof(keybuff), "more%d", added);
+        ret = hashtbl_update_fd(fd, keybuff, "v", false);
+        added += ret == 1;
+    }
+    TEST_ASSERT_EQUAL_INT(-3, ret);
+
+    tbl = load_hashtbl_from_fd(fd);
+    TEST_ASSERT_NOT_NULL(tbl);
+    TEST_ASSERT_EQUAL_INT(16, get_tbl_size(tbl));
+    TEST_ASSERT_EQUAL_INT(2 + added, get_numentries(tbl));
+    TEST_ASSERT_EQUAL_INT(false, exists(tbl, "key2"));
+    find(valbuff, HT_VAL_MAX, tbl, "key3");
+    TEST_ASSERT_EQUAL_STRING("val3", valbuff);
+    TEST_ASSERT_EQUAL_INT(true, exists(tbl, "more0"));
+
+    fclose(f);
+    destroy_hashtbl(tbl);
+}
+
 void test_get_keys(void)
 {
     hashtbl tbl = init_hashtbl(4);
@@ -225,6 +517,41 @@ void test_get_vals(void)
     destroy_hashtbl(tbl);
 }
 
+static int count_scanned(const char *key, const char *val, void *arg)
+{
+    (void) key;
+    (void) val;
+    size_t *counts = arg;
+    counts[0]++;
+    counts[1]++;
+    return counts[1] == 7;
+}
+
+// Scanning in pages visits every entry once
+void test_scan(void)
+{
+    hashtbl tbl = init_hashtbl(16);
+    char keybuff[100];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(keybuff, 100, "key%d", i);
+        put(tbl, keybuff, "val");
+    }
+
+    // Entries visited, and visited in this page
+    size_t counts[2] = {0, 0};
+    size_t cursor = 0;
+    size_t pages = 0;
+    do {
+        counts[1] = 0;
+        cursor = hashtbl_scan(tbl, cursor, count_scanned, counts);
+        pages++;
+    } while (cursor != 0);
+    TEST_ASSERT_EQUAL_UINT(1000, counts[0]);
+    TEST_ASSERT_TRUE(pages >= 1000 / 7);
+
+    destroy_hashtbl(tbl);
+}
+
 /*------- Tests to check behavior on uninitialized input ------*/
 
 void test_null_destroy(void)
@@ -335,6 +662,16 @@ void test_null_fromfile(void)
     TEST_ASSERT_EQUAL_INT(0, tbl);
 }
 
+void test_null_sync_file(void)
+{
+    hashtbl tbl = NULL;
+    ssize_t result = hashtbl_sync_file(tbl, -1, true, false);
+    TEST_ASSERT_EQUAL_INT(-1, result);
+
+    tbl = load_hashtbl_from_fd(-1);
+    TEST_ASSERT_EQUAL_INT(0, tbl);
+}
+
 
 int main(void)
 {
@@ -344,11 +681,22 @@ int main(void)
     RUN_TEST(test_put_and_size);
     RUN_TEST(test_put_and_delete_size);
     RUN_TEST(test_resize);
+    RUN_TEST(test_reserve);
+    RUN_TEST(test_mem_usage);
     RUN_TEST(test_find);
     RUN_TEST(test_exists);
+    RUN_TEST(test_find_after_delete);
+    RUN_TEST(test_replace);
     RUN_TEST(test_hashtbl_fileio);
+    RUN_TEST(test_hashtbl_sync_file);
+    RUN_TEST(test_resize_needs_full_sync);
+    RUN_TEST(test_load_parallel);
+    RUN_TEST(test_load_from_fd_rejects_stream_format);
+    RUN_TEST(test_lookup_fd);
+    RUN_TEST(test_update_fd);
     RUN_TEST(test_get_keys);
     RUN_TEST(test_get_vals);
+    RUN_TEST(test_scan);
     RUN_TEST(test_null_destroy);
     RUN_TEST(test_null_get_size);
     RUN_TEST(test_null_get_numentries);
@@ -360,6 +708,7 @@ int main(void)
     RUN_TEST(test_null_get_vals);
     RUN_TEST(test_null_tofile);
     RUN_TEST(test_null_fromfile);
+    RUN_TEST(test_null_sync_file);
 
     return UNITY_END();
 }
@@ -0,0 +1,165 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity/unity.h"
+#include "../src/latency.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static int count_slow(const struct lat_slow *entry, void *arg)
+{
+    (void) entry;
+    (*(size_t *) arg)++;
+    return 0;
+}
+
+static int first_slow(const struct lat_slow *entry, void *arg)
+{
+    *(const struct lat_slow **) arg = entry;
+    return 1;
+}
+
+
+// Every latency falls in a bucket whose range
+// holds it, and buckets cover latencies in order
+void test_buckets(void)
+{
+    latency lat = latency_init();
+    TEST_ASSERT_NOT_NULL(lat);
+
+    uint64_t values[] = {0, 1, 7, 8, 15, 16, 1000, 123456789, UINT64_MAX};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        latency_reset(lat);
+        latency_record(lat, 0, values[i]);
+
+        size_t found = 0;
+        uint64_t prev_high = 0;
+        for (size_t b = 0; b < LAT_BUCKETS; b++) {
+            uint64_t low;
+            uint64_t high;
+            uint64_t count = latency_bucket(lat, 0, b, &low, &high);
+            TEST_ASSERT_TRUE(low <= high);
+            TEST_ASSERT_TRUE(b == 0 || low == prev_high + 1);
+            prev_high = high;
+            if (count > 0) {
+                TEST_ASSERT_TRUE(values[i] >= low && values[i] <= high);
+                found++;
+            }
+        }
+        TEST_ASSERT_EQUAL_size_t(1, found);
+        TEST_ASSERT_EQUAL_UINT64(UINT64_MAX, prev_high);
+    }
+
+    latency_destroy(lat);
+}
+
+// Percentiles are within one bucket of the
+// exact value and never above the maximum
+void test_summary(void)
+{
+    latency lat = latency_init();
+    for (uint64_t ns = 1; ns <= 1000; ns++) {
+        latency_record(lat, 3, ns * 1000);
+    }
+
+    struct lat_summary sum;
+    latency_summary(lat, 3, &sum);
+    TEST_ASSERT_EQUAL_UINT64(1000, sum.count);
+    TEST_ASSERT_EQUAL_UINT64(500500000, sum.total_ns);
+    TEST_ASSERT_EQUAL_UINT64(1000000, sum.max_ns);
+    TEST_ASSERT_TRUE(sum.p50_ns >= 500000 && sum.p50_ns <= 500000 + 500000 / LAT_SUB_BUCKETS);
+    TEST_ASSERT_TRUE(sum.p99_ns >= 990000 && sum.p99_ns <= 1000000);
+    TEST_ASSERT_TRUE(sum.p999_ns >= 999000 && sum.p999_ns <= 1000000);
+
+    // Other command kinds are unaffected
+    latency_summary(lat, 4, &sum);
+    TEST_ASSERT_EQUAL_UINT64(0, sum.count);
+    TEST_ASSERT_FALSE(latency_record(lat, LAT_CMDS, 1));
+
+    latency_destroy(lat);
+}
+
+void test_slow_threshold(void)
+{
+    latency lat = latency_init();
+    TEST_ASSERT_EQUAL_UINT(LAT_SLOW_MS, latency_slow_ms(lat));
+    TEST_ASSERT_FALSE(latency_record(lat, 1, (uint64_t) LAT_SLOW_MS * 1000000 - 1));
+    TEST_ASSERT_TRUE(latency_record(lat, 1, (uint64_t) LAT_SLOW_MS * 1000000));
+
+    latency_set_slow_ms(lat, 0);
+    TEST_ASSERT_TRUE(latency_record(lat, 1, 0));
+
+    latency_destroy(lat);
+}
+
+// Slow log keeps the newest LAT_SLOWLOG_LEN
+// entries and lists them newest first
+void test_slowlog(void)
+{
+    latency lat = latency_init();
+    char arg[100];
+    for (size_t i = 0; i < LAT_SLOWLOG_LEN + 5; i++) {
+        snprintf(arg, sizeof(arg), "key%zu", i);
+        latency_log_slow(lat, 2, i, 8, "tbl1", arg);
+    }
+
+    size_t count = 0;
+    latency_slowlog(lat, count_slow, &count);
+    TEST_ASSERT_EQUAL_size_t(LAT_SLOWLOG_LEN, count);
+
+    const struct lat_slow *newest = NULL;
+    latency_slowlog(lat, first_slow, &newest);
+    TEST_ASSERT_NOT_NULL(newest);
+    TEST_ASSERT_EQUAL_UINT64(LAT_SLOWLOG_LEN + 4, newest->ns);
+    TEST_ASSERT_EQUAL_STRING("tbl1", newest->tbl_name);
+    TEST_ASSERT_EQUAL_UINT(8, newest->events);
+
+    // Long arguments are cut
+    char longarg[LAT_ARG_MAX * 2];
+    memset(longarg, 'a', sizeof(longarg) - 1);
+    longarg[sizeof(longarg) - 1] = '\0';
+    latency_log_slow(lat, 2, 1, 0, NULL, longarg);
+    latency_slowlog(lat, first_slow, &newest);
+    TEST_ASSERT_EQUAL_size_t(LAT_ARG_MAX - 1, strlen(newest->arg));
+    TEST_ASSERT_EQUAL_STRING("", newest->tbl_name);
+
+    latency_set_slow_ms(lat, 50);
+    latency_record(lat, 2, 10);
+    latency_reset(lat);
+    count = 0;
+    latency_slowlog(lat, count_slow, &count);
+    TEST_ASSERT_EQUAL_size_t(0, count);
+    struct lat_summary sum;
+    latency_summary(lat, 2, &sum);
+    TEST_ASSERT_EQUAL_UINT64(0, sum.count);
+    TEST_ASSERT_EQUAL_UINT(50, latency_slow_ms(lat));
+
+    latency_destroy(lat);
+}
+
+void test_null_lat(void)
+{
+    TEST_ASSERT_FALSE(latency_record(NULL, 0, 1));
+    latency_log_slow(NULL, 0, 1, 0, NULL, NULL);
+    latency_reset(NULL);
+    latency_destroy(NULL);
+    TEST_ASSERT_EQUAL_UINT(0, latency_slow_ms(NULL));
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_buckets);
+    RUN_TEST(test_summary);
+    RUN_TEST(test_slow_threshold);
+    RUN_TEST(test_slowlog);
+    RUN_TEST(test_null_lat);
+
+    return UNITY_END();
+}
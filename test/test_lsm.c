@@ -0,0 +1,220 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/lsm.h"
+#include "../src/stringutil.h"
+
+static char dirpath[64];
+
+void setUp(void)
+{
+    strcpy(dirpath, "/tmp/pairdb-lsm-test-XXXXXX");
+    mkdtemp(dirpath);
+}
+
+void tearDown(void)
+{
+    lsm_remove_dir(dirpath);
+}
+
+
+void test_put_get_del(void)
+{
+    lsm_tbl lsm = lsm_open(dirpath);
+    TEST_ASSERT_NOT_NULL(lsm);
+
+    TEST_ASSERT_EQUAL_INT(1, lsm_put(lsm, "key1", "val1"));
+    TEST_ASSERT_EQUAL_INT(1, lsm_put(lsm, "key2", "val2"));
+
+    char valbuff[100];
+    size_t len = lsm_get(valbuff, 100, lsm, "key1");
+    TEST_ASSERT_EQUAL_INT(4, len);
+    TEST_ASSERT_EQUAL_STRING("val1", valbuff);
+
+    // Put replaces value
+    lsm_put(lsm, "key1", "other");
+    lsm_get(valbuff, 100, lsm, "key1");
+    TEST_ASSERT_EQUAL_STRING("other", valbuff);
+
+    lsm_del(lsm, "key1");
+    TEST_ASSERT_EQUAL_INT(false, lsm_exists(lsm, "key1"));
+    TEST_ASSERT_EQUAL_INT(true, lsm_exists(lsm, "key2"));
+    TEST_ASSERT_EQUAL_INT(0, lsm_get(valbuff, 100, lsm, "key3"));
+
+    lsm_close(lsm);
+}
+
+void test_flush_and_reopen(void)
+{
+    lsm_tbl lsm = lsm_open(dirpath);
+    lsm_put(lsm, "key1", "val1");
+    lsm_put(lsm, "key2", "val2");
+    TEST_ASSERT_GREATER_THAN(0, lsm_flush(lsm, true));
+
+    // Tombstone in newer file hides key in older file
+    lsm_del(lsm, "key2");
+    lsm_put(lsm, "key3", "val3");
+    TEST_ASSERT_GREATER_THAN(0, lsm_flush(lsm, true));
+
+    // Not flushed - lost on close
+    lsm_put(lsm, "key4", "val4");
+    lsm_close(lsm);
+
+    lsm = lsm_open(dirpath);
+    TEST_ASSERT_NOT_NULL(lsm);
+    char valbuff[100];
+    lsm_get(valbuff, 100, lsm, "key1");
+    TEST_ASSERT_EQUAL_STRING("val1", valbuff);
+    lsm_get(valbuff, 100, lsm, "key3");
+    TEST_ASSERT_EQUAL_STRING("val3", valbuff);
+    TEST_ASSERT_EQUAL_INT(false, lsm_exists(lsm, "key2"));
+    TEST_ASSERT_EQUAL_INT(false, lsm_exists(lsm, "key4"));
+    TEST_ASSERT_EQUAL_INT(2, lsm_count(lsm));
+
+    struct lsm_stats stats;
+    lsm_get_stats(lsm, &stats);
+    TEST_ASSERT_EQUAL_INT(2, stats.files[0]);
+
+    lsm_close(lsm);
+}
+
+void test_compaction(void)
+{
+    lsm_tbl lsm = lsm_open(dirpath);
+    lsm_set_memtable_max(lsm, 4096);
+
+    char keybuff[100];
+    char valbuff[100];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(keybuff, 100, "key%05d", i);
+        snprintf(valbuff, 100, "val%d", i);
+        TEST_ASSERT_EQUAL_INT(1, lsm_put(lsm, keybuff, valbuff));
+    }
+    // Overwrite and delete keys held in older files
+    for (int i = 0; i < 5000; i += 10) {
+        snprintf(keybuff, 100, "key%05d", i);
+        lsm_put(lsm, keybuff, "new");
+        snprintf(keybuff, 100, "key%05d", i + 1);
+        lsm_del(lsm, keybuff);
+    }
+    lsm_flush(lsm, false);
+    lsm_wait_compaction(lsm);
+
+    struct lsm_stats stats;
+    lsm_get_stats(lsm, &stats);
+    TEST_ASSERT_GREATER_THAN(0, stats.compactions);
+    TEST_ASSERT_LESS_THAN(4, stats.files[0]);
+
+    lsm_get(valbuff, 100, lsm, "key00000");
+    TEST_ASSERT_EQUAL_STRING("new", valbuff);
+    TEST_ASSERT_EQUAL_INT(false, lsm_exists(lsm, "key00001"));
+    lsm_get(valbuff, 100, lsm, "key04999");
+    TEST_ASSERT_EQUAL_STRING("val4999", valbuff);
+    TEST_ASSERT_EQUAL_INT(4500, lsm_count(lsm));
+
+    lsm_close(lsm);
+
+    // Compacted files are listed in manifest
+    lsm = lsm_open(dirpath);
+    TEST_ASSERT_EQUAL_INT(4500, lsm_count(lsm));
+    lsm_close(lsm);
+}
+
+void test_keys_in_order(void)
+{
+    lsm_tbl lsm = lsm_open(dirpath);
+    lsm_put(lsm, "b", "2");
+    lsm_flush(lsm, false);
+    lsm_put(lsm, "c", "3");
+    lsm_put(lsm, "a", "1");
+
+    char **keys = lsm_get_keys(lsm);
+    char **vals = lsm_get_vals(lsm);
+    TEST_ASSERT_EQUAL_STRING("a", keys[0]);
+    TEST_ASSERT_EQUAL_STRING("b", keys[1]);
+    TEST_ASSERT_EQUAL_STRING("c", keys[2]);
+    TEST_ASSERT_EQUAL_STRING("1", vals[0]);
+    TEST_ASSERT_EQUAL_STRING("3", vals[2]);
+
+    free(keys);
+    free(vals);
+    lsm_close(lsm);
+}
+
+// Number of table files listed in MANIFEST
+static int manifest_files(void)
+{
+    char path[100];
+    snprintf(path, 100, "%s/MANIFEST", dirpath);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    // Header and next file id come first
+    int lines = 0;
+    char line[100];
+    while (fgets(line, 100, f)) {
+        lines++;
+    }
+    fclose(f);
+    return lines - 2;
+}
+
+void test_group_sync(void)
+{
+    lsm_tbl lsm = lsm_open(dirpath);
+    lsm_set_sync(lsm, false, 50);
+
+    // File is readable at once but left out of
+    // MANIFEST until the compaction thread syncs it
+    lsm_put(lsm, "key1", "val1");
+    TEST_ASSERT_GREATER_THAN(0, lsm_flush(lsm, false));
+    TEST_ASSERT_EQUAL_INT(0, manifest_files());
+    TEST_ASSERT_EQUAL_INT(true, lsm_exists(lsm, "key1"));
+
+    usleep(300 * 1000);
+    TEST_ASSERT_EQUAL_INT(1, manifest_files());
+
+    // Close syncs files still waiting
+    lsm_put(lsm, "key2", "val2");
+    TEST_ASSERT_GREATER_THAN(0, lsm_flush(lsm, false));
+    lsm_close(lsm);
+    TEST_ASSERT_EQUAL_INT(2, manifest_files());
+
+    lsm = lsm_open(dirpath);
+    TEST_ASSERT_EQUAL_INT(2, lsm_count(lsm));
+    lsm_close(lsm);
+}
+
+void test_null_lsm(void)
+{
+    char valbuff[100];
+    TEST_ASSERT_NULL(lsm_open(NULL));
+    TEST_ASSERT_EQUAL_INT(-2, lsm_put(NULL, "key", "val"));
+    TEST_ASSERT_EQUAL_INT(0, lsm_get(valbuff, 100, NULL, "key"));
+    TEST_ASSERT_EQUAL_INT(-2, lsm_del(NULL, "key"));
+    TEST_ASSERT_EQUAL_INT(-1, lsm_flush(NULL, false));
+    TEST_ASSERT_NULL(lsm_get_keys(NULL));
+    lsm_close(NULL);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_put_get_del);
+    RUN_TEST(test_flush_and_reopen);
+    RUN_TEST(test_compaction);
+    RUN_TEST(test_keys_in_order);
+    RUN_TEST(test_group_sync);
+    RUN_TEST(test_null_lsm);
+
+    return UNITY_END();
+}
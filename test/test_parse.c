@@ -1,3 +1,6 @@
+#include <stdio.h>
+#include <string.h>
+
 #include "unity/unity.h"
 #include "../src/parse.h"
 
@@ -55,6 +58,18 @@ void test_cmd_enum_lstbls(void)
     parse_input(inbuff, &parse_data);
     enum CMD cmd = LSTABLES;
     TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+}
+
+// Test lstables command with long listing option
+void test_cmd_enum_lstbls_long(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "lstbls -l\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = LSTABLES;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("-l", parse_data.opt);
 }
 
 // Test newtbl command - enum value and table name str
@@ -66,6 +81,13 @@ void test_cmd_enum_and_str_nt(void)
     enum CMD cmd = NEWTABLE;
     TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
     TEST_ASSERT_EQUAL_STRING("table1", parse_data.tbl_name);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+
+    char inbuff2[] = "newtbl table2 lsm\n";
+    parse_input(inbuff2, &parse_data);
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("table2", parse_data.tbl_name);
+    TEST_ASSERT_EQUAL_STRING("lsm", parse_data.opt);
 }
 
 // Test use command - enum value and table name str
@@ -123,6 +145,16 @@ void test_cmd_enum_save(void)
     TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
 }
 
+// Test bgsave command enum value
+void test_cmd_enum_bgsave(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "bgsave\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = BGSAVE;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+}
+
 // Test drop command - enum value and table name str
 void test_cmd_enum_and_str_drop(void)
 {
@@ -144,6 +176,35 @@ void test_cmd_enum_lsdata(void)
     TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
 }
 
+// Test lsdata settings in any order
+void test_lsdata_args(void)
+{
+    struct parse_object parse_data = {0};
+    char all[] = "lsdata cursor 42 format json limit 10\n";
+    parse_input(all, &parse_data);
+    TEST_ASSERT_EQUAL_INT(LSDATA, parse_data.cmd);
+    TEST_ASSERT_EQUAL_INT(10, parse_data.num);
+    TEST_ASSERT_EQUAL_INT(42, parse_data.cursor);
+    TEST_ASSERT_EQUAL_STRING("json", parse_data.opt);
+
+    char none[] = "lsdata\n";
+    parse_input(none, &parse_data);
+    TEST_ASSERT_EQUAL_INT(LSDATA, parse_data.cmd);
+    TEST_ASSERT_EQUAL_INT(0, parse_data.num);
+    TEST_ASSERT_EQUAL_INT(0, parse_data.cursor);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+
+    char zero[] = "lsdata limit 0\n";
+    parse_input(zero, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    char missing[] = "lsdata cursor\n";
+    parse_input(missing, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    char unknown[] = "lsdata sorted 1\n";
+    parse_input(unknown, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+}
+
 // Test help command enum value
 void test_cmd_enum_help(void)
 {
@@ -154,6 +215,274 @@ void test_cmd_enum_help(void)
     TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
 }
 
+// Test durability command - enum value, mode and group interval
+void test_cmd_enum_and_opt_durability(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "durability group 50\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = DURABILITY;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("group", parse_data.opt);
+    TEST_ASSERT_EQUAL_INT(50, parse_data.num);
+
+    char inbuff2[] = "durability\n";
+    parse_input(inbuff2, &parse_data);
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+
+    char inbuff3[] = "durability group abc\n";
+    parse_input(inbuff3, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+}
+
+// Test cache command - enum value and budget
+void test_cmd_enum_and_num_cache(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "cache 64\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = CACHE;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_INT(64, parse_data.num);
+
+    char inbuff2[] = "cache\n";
+    parse_input(inbuff2, &parse_data);
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+}
+
+// Test latency command - subcommand in opt,
+// slow log threshold in key and num
+void test_cmd_enum_latency(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "latency\n";
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(LATENCY, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+
+    char inbuff2[] = "latency slow 0\n";
+    parse_input(inbuff2, &parse_data);
+    TEST_ASSERT_EQUAL_INT(LATENCY, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("slow", parse_data.opt);
+    TEST_ASSERT_EQUAL_STRING("0", parse_data.key);
+    TEST_ASSERT_EQUAL_INT(0, parse_data.num);
+
+    char inbuff3[] = "latency add\n";
+    parse_input(inbuff3, &parse_data);
+    TEST_ASSERT_EQUAL_INT(LATENCY, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("add", parse_data.opt);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.key);
+
+    char inbuff4[] = "latency slow ten\n";
+    parse_input(inbuff4, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+}
+
+// Test info command enum value
+void test_cmd_enum_info(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "info\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = INFO;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+}
+
+// Test import command - table name, file, and format
+void test_cmd_enum_import(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "import tbl1 /tmp/data.csv tsv\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = IMPORT;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("tbl1", parse_data.tbl_name);
+    TEST_ASSERT_EQUAL_STRING("/tmp/data.csv", parse_data.path);
+    TEST_ASSERT_EQUAL_STRING("tsv", parse_data.opt);
+
+    char missing[] = "import tbl1\n";
+    parse_input(missing, &parse_data);
+    cmd = FAIL;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+}
+
+// Test export command - format and sorted option in any order
+void test_cmd_enum_export(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "export tbl1 out.json sorted jsonl\n";
+    parse_input(inbuff, &parse_data);
+    enum CMD cmd = EXPORT;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("out.json", parse_data.path);
+    TEST_ASSERT_EQUAL_STRING("jsonl", parse_data.opt);
+    TEST_ASSERT_EQUAL_INT(1, parse_data.num);
+
+    char unsorted[] = "export tbl1 out.csv\n";
+    parse_input(unsorted, &parse_data);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.opt);
+    TEST_ASSERT_EQUAL_INT(0, parse_data.num);
+
+    char extra[] = "export tbl1 out.csv csv tsv\n";
+    parse_input(extra, &parse_data);
+    cmd = FAIL;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+}
+
+// Program arguments are parsed without quoting rules
+void test_parse_argv(void)
+{
+    struct parse_object parse_data = {0};
+    char *args[] = {"add", "it's", "say \"hi\""};
+    parse_argv(3, args, &parse_data);
+    enum CMD cmd = ADD;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("it's", parse_data.key);
+    TEST_ASSERT_EQUAL_STRING("say \"hi\"", parse_data.val);
+
+    char *get_args[] = {"get"};
+    parse_argv(1, get_args, &parse_data);
+    cmd = FAIL;
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+
+    char *many[] = {"export", "t", "f", "csv", "sorted", "extra"};
+    parse_argv(6, many, &parse_data);
+    TEST_ASSERT_EQUAL_INT(cmd, parse_data.cmd);
+}
+
+// Every command word is found through the
+// perfect hash table
+void test_cmd_dispatch(void)
+{
+    struct parse_object parse_data = {0};
+    for (int cmd = LSTABLES; cmd <= QUIT; cmd++) {
+        char inbuff[64];
+        snprintf(inbuff, sizeof(inbuff), "%s %s\n", cmd_name(cmd),
+                 cmd == LSDATA ? "limit 1" : "1 1");
+        parse_input(inbuff, &parse_data);
+        TEST_ASSERT_EQUAL_STRING(cmd_name(cmd), cmd_name(parse_data.cmd));
+    }
+
+    // Same hash as a command word, or a prefix
+    char inbuff[] = "gat key1\n";
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    char prefix[] = "ad key1 val1\n";
+    parse_input(prefix, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    char upper[] = "ADD key1 val1\n";
+    parse_input(upper, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+}
+
+// Keys and values point into the input buffer
+void test_args_in_place(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "add key1 val1\n";
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_TRUE(parse_data.key == inbuff + 4);
+    TEST_ASSERT_TRUE(parse_data.val == inbuff + 9);
+
+    // No newline, and other separators
+    char tabs[] = "  add\tkey2 \t val2  \r";
+    parse_input(tabs, &parse_data);
+    TEST_ASSERT_EQUAL_INT(ADD, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("key2", parse_data.key);
+    TEST_ASSERT_EQUAL_STRING("val2", parse_data.val);
+}
+
+// Quoted sections and escape sequences
+void test_quotes_and_escapes(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[] = "add \"my key\" 'say \"hi\"'\n";
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(ADD, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("my key", parse_data.key);
+    TEST_ASSERT_EQUAL_STRING("say \"hi\"", parse_data.val);
+
+    char escapes[] = "add it\\'s a\\tb\\\\c\\ d\\q\n";
+    parse_input(escapes, &parse_data);
+    TEST_ASSERT_EQUAL_INT(ADD, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("it's", parse_data.key);
+    TEST_ASSERT_EQUAL_STRING("a\tb\\c d\\q", parse_data.val);
+
+    // Quoted sections join the text around them,
+    // and an empty quoted section is an argument
+    char joined[] = "add pre\"fix suf\"fix ''\n";
+    parse_input(joined, &parse_data);
+    TEST_ASSERT_EQUAL_INT(ADD, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("prefix suffix", parse_data.key);
+    TEST_ASSERT_EQUAL_STRING("", parse_data.val);
+}
+
+// Arguments have no length limit, but keys, values,
+// and table names longer than a table stores fail
+void test_long_args(void)
+{
+    struct parse_object parse_data = {0};
+    char inbuff[2048];
+    char path[1500];
+    memset(path, 'p', sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    snprintf(inbuff, sizeof(inbuff), "import tbl1 %s\n", path);
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(IMPORT, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING(path, parse_data.path);
+
+    char key[KEY_MAX + 1];
+    memset(key, 'k', KEY_MAX);
+    key[KEY_MAX] = '\0';
+    snprintf(inbuff, sizeof(inbuff), "add %s val\n", key);
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("Key too long", parse_data.error);
+
+    key[KEY_MAX - 1] = '\0';
+    snprintf(inbuff, sizeof(inbuff), "get %s\n", key);
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(GET, parse_data.cmd);
+    TEST_ASSERT_TRUE(parse_data.error == NULL);
+
+    // Table name is kept when a new one is too long
+    char use[] = "use tbl1\n";
+    parse_input(use, &parse_data);
+    TEST_ASSERT_TRUE(parse_data.tbl_set);
+    snprintf(inbuff, sizeof(inbuff), "use %s\n", path);
+    parse_input(inbuff, &parse_data);
+    TEST_ASSERT_EQUAL_INT(FAIL, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("Table name too long", parse_data.error);
+    TEST_ASSERT_EQUAL_STRING("tbl1", parse_data.tbl_name);
+    TEST_ASSERT_FALSE(parse_data.tbl_set);
+}
+
+// Transaction commands take no arguments
+// and keep the table name
+void test_cmd_enum_txn(void)
+{
+    struct parse_object parse_data = {0};
+    char use[] = "use tbl1\n";
+    parse_input(use, &parse_data);
+
+    char begin[] = "begin\n";
+    parse_input(begin, &parse_data);
+    TEST_ASSERT_EQUAL_INT(BEGIN, parse_data.cmd);
+    TEST_ASSERT_FALSE(parse_data.tbl_set);
+    TEST_ASSERT_EQUAL_STRING("tbl1", parse_data.tbl_name);
+
+    char commit[] = "commit\n";
+    parse_input(commit, &parse_data);
+    TEST_ASSERT_EQUAL_INT(COMMIT, parse_data.cmd);
+
+    char abort_cmd[] = "abort\n";
+    parse_input(abort_cmd, &parse_data);
+    TEST_ASSERT_EQUAL_INT(ABORT, parse_data.cmd);
+    TEST_ASSERT_EQUAL_STRING("tbl1", parse_data.tbl_name);
+}
+
 // Test quit command enum value
 void test_cmd_enum_quit(void)
 {
@@ -172,15 +501,30 @@ int main(void)
     RUN_TEST(test_cmd_enum_f2);
     RUN_TEST(test_cmd_enum_f3);
     RUN_TEST(test_cmd_enum_lstbls);
+    RUN_TEST(test_cmd_enum_lstbls_long);
     RUN_TEST(test_cmd_enum_and_str_nt);
     RUN_TEST(test_cmd_enum_and_str_ut);
     RUN_TEST(test_cmd_enum_and_str_add);
     RUN_TEST(test_cmd_enum_and_str_get);
     RUN_TEST(test_cmd_enum_and_str_del);
     RUN_TEST(test_cmd_enum_save);
+    RUN_TEST(test_cmd_enum_bgsave);
     RUN_TEST(test_cmd_enum_and_str_drop);
     RUN_TEST(test_cmd_enum_lsdata);
+    RUN_TEST(test_lsdata_args);
     RUN_TEST(test_cmd_enum_help);
+    RUN_TEST(test_cmd_enum_and_opt_durability);
+    RUN_TEST(test_cmd_enum_and_num_cache);
+    RUN_TEST(test_cmd_enum_latency);
+    RUN_TEST(test_cmd_enum_info);
+    RUN_TEST(test_cmd_enum_import);
+    RUN_TEST(test_cmd_enum_export);
+    RUN_TEST(test_parse_argv);
+    RUN_TEST(test_cmd_dispatch);
+    RUN_TEST(test_args_in_place);
+    RUN_TEST(test_quotes_and_escapes);
+    RUN_TEST(test_long_args);
+    RUN_TEST(test_cmd_enum_txn);
     RUN_TEST(test_cmd_enum_quit);
 
     return UNITY_END();
@@ -0,0 +1,180 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity/unity.h"
+#include "../src/pipeline.h"
+
+static char path[] = "/tmp/pairdb-test-pipeline-XXXXXX";
+static int fd = -1;
+
+void setUp(void)
+{
+    strcpy(path, "/tmp/pairdb-test-pipeline-XXXXXX");
+    fd = mkstemp(path);
+}
+
+void tearDown(void)
+{
+    close(fd);
+    unlink(path);
+}
+
+// Write contents to temporary file and
+// rewind it for the pipeline to read
+static void write_input(const char *contents, size_t len)
+{
+    TEST_ASSERT_EQUAL_INT((int) len, write(fd, contents, len));
+    lseek(fd, 0, SEEK_SET);
+}
+
+// Copy commands of all chunks into cmds. Chunks
+// are not released, so that arguments stay valid
+// until the pipeline is stopped.
+// Returns number of commands.
+static size_t read_all(pipeline pl, struct parse_object *cmds, size_t max)
+{
+    size_t n = 0;
+    struct cmd_chunk *chunk;
+    while ((chunk = pipeline_next(pl)) != NULL) {
+        for (size_t i = 0; i < chunk->ncmds && n < max; i++) {
+            cmds[n++] = chunk->cmds[i];
+        }
+    }
+    return n;
+}
+
+
+// Commands arrive in order, and only commands
+// naming a table set it
+void test_commands_in_order(void)
+{
+    const char input[] = "newtbl t1\nadd k1 v1\n\n  \nget \"k 1\"\nuse t2\r\ndel k2";
+    write_input(input, sizeof(input) - 1);
+
+    pipeline pl = pipeline_start(fd);
+    TEST_ASSERT_NOT_NULL(pl);
+    struct parse_object cmds[8];
+    TEST_ASSERT_EQUAL_UINT(6, read_all(pl, cmds, 8));
+    TEST_ASSERT_EQUAL_INT(NEWTABLE, cmds[0].cmd);
+    TEST_ASSERT_TRUE(cmds[0].tbl_set);
+    TEST_ASSERT_EQUAL_STRING("t1", cmds[0].tbl_name);
+    TEST_ASSERT_EQUAL_INT(ADD, cmds[1].cmd);
+    TEST_ASSERT_FALSE(cmds[1].tbl_set);
+    TEST_ASSERT_EQUAL_STRING("v1", cmds[1].val);
+    TEST_ASSERT_EQUAL_INT(FAIL, cmds[2].cmd);
+    TEST_ASSERT_EQUAL_INT(GET, cmds[3].cmd);
+    TEST_ASSERT_EQUAL_STRING("k 1", cmds[3].key);
+    TEST_ASSERT_EQUAL_INT(USETABLE, cmds[4].cmd);
+    TEST_ASSERT_EQUAL_STRING("t2", cmds[4].tbl_name);
+    TEST_ASSERT_EQUAL_INT(DELETE, cmds[5].cmd);
+    TEST_ASSERT_EQUAL_STRING("k2", cmds[5].key);
+    TEST_ASSERT_NULL(pipeline_next(pl));
+    pipeline_stop(pl);
+}
+
+// Input larger than the chunks, with lines
+// split between blocks, arrives whole
+void test_many_chunks(void)
+{
+    enum { LINES = 300000 };
+    FILE *f = fdopen(dup(fd), "w");
+    for (int i = 0; i < LINES; i++) {
+        fprintf(f, "add key%d value%d\n", i, i);
+    }
+    fclose(f);
+    lseek(fd, 0, SEEK_SET);
+
+    pipeline pl = pipeline_start(fd);
+    size_t n = 0;
+    size_t chunks = 0;
+    char expected[32];
+    struct cmd_chunk *chunk;
+    while ((chunk = pipeline_next(pl)) != NULL) {
+        for (size_t i = 0; i < chunk->ncmds; i++, n++) {
+            snprintf(expected, sizeof(expected), "value%zu", n);
+            TEST_ASSERT_EQUAL_INT(ADD, chunk->cmds[i].cmd);
+            TEST_ASSERT_EQUAL_STRING(expected, chunk->cmds[i].val);
+        }
+        chunks++;
+        pipeline_release(pl, chunk);
+    }
+    TEST_ASSERT_EQUAL_UINT(LINES, n);
+    TEST_ASSERT_TRUE(chunks > 1);
+    pipeline_stop(pl);
+}
+
+void test_line_too_long(void)
+{
+    size_t len = PIPE_LINE_MAX * 3;
+    char *input = malloc(len);
+    memset(input, 'x', len);
+    memcpy(input, "get ", 4);
+    memcpy(input + len - 12, "\nget k1\nget ", 12);
+    input[PIPE_LINE_MAX + 10] = '\n';
+    write_input(input, len);
+    free(input);
+
+    pipeline pl = pipeline_start(fd);
+    struct parse_object cmds[8];
+    size_t n = read_all(pl, cmds, 8);
+    TEST_ASSERT_EQUAL_UINT(4, n);
+    TEST_ASSERT_EQUAL_INT(FAIL, cmds[0].cmd);
+    TEST_ASSERT_EQUAL_STRING("Command too long", cmds[0].error);
+    TEST_ASSERT_EQUAL_INT(FAIL, cmds[1].cmd);
+    TEST_ASSERT_EQUAL_STRING("Command too long", cmds[1].error);
+    TEST_ASSERT_EQUAL_INT(GET, cmds[2].cmd);
+    TEST_ASSERT_EQUAL_INT(FAIL, cmds[3].cmd);
+    pipeline_stop(pl);
+}
+
+// Stopping before end of input does not wait
+// for input that may never come
+void test_stop_early(void)
+{
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    TEST_ASSERT_EQUAL_INT(5, write(pfd[1], "quit\n", 5));
+
+    pipeline pl = pipeline_start(pfd[0]);
+    struct cmd_chunk *chunk = pipeline_next(pl);
+    TEST_ASSERT_NOT_NULL(chunk);
+    TEST_ASSERT_EQUAL_INT(QUIT, chunk->cmds[0].cmd);
+    pipeline_release(pl, chunk);
+    pipeline_stop(pl);
+    close(pfd[0]);
+    close(pfd[1]);
+}
+
+void test_output(void)
+{
+    FILE *out = pipeline_output(fd);
+    TEST_ASSERT_NOT_NULL(out);
+    size_t total = 0;
+    for (int i = 0; i < 200000; i++) {
+        total += fprintf(out, "line %d\n", i);
+    }
+    TEST_ASSERT_EQUAL_INT(0, fclose(out));
+
+    TEST_ASSERT_EQUAL_INT((int) total, lseek(fd, 0, SEEK_END));
+    char buff[32];
+    TEST_ASSERT_EQUAL_INT(14, pread(fd, buff, 14, total - 14));
+    TEST_ASSERT_EQUAL_MEMORY("\nline 199999\n", buff + 1, 13);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_commands_in_order);
+    RUN_TEST(test_many_chunks);
+    RUN_TEST(test_line_too_long);
+    RUN_TEST(test_stop_early);
+    RUN_TEST(test_output);
+
+    return UNITY_END();
+}
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity/unity.h"
+#include "../src/resp.h"
+
+static struct resp_cmd cmd;
+
+void setUp(void)
+{
+
+}
+
+void tearDown(void)
+{
+    resp_cmd_free(&cmd);
+}
+
+
+void test_parse_array(void)
+{
+    char buf[] = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nva\0ue\r\n*1\r\n";
+    size_t len = sizeof(buf) - 1;
+    TEST_ASSERT_EQUAL_INT(len - 4, resp_parse(buf, len, &cmd));
+    TEST_ASSERT_EQUAL_INT(3, cmd.argc);
+    TEST_ASSERT_EQUAL_STRING("SET", cmd.argv[0].data);
+    TEST_ASSERT_EQUAL_STRING("key", cmd.argv[1].data);
+    TEST_ASSERT_EQUAL_INT(5, cmd.argv[2].len);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(cmd.argv[2].data, "va\0ue", 6));
+
+    // Arguments point into the buffer
+    TEST_ASSERT_TRUE(cmd.argv[1].data == buf + 17);
+}
+
+void test_parse_incomplete(void)
+{
+    const char *full = "*2\r\n$3\r\nGET\r\n$10\r\n0123456789\r\n";
+    size_t len = strlen(full);
+    char buf[64];
+    for (size_t i = 0; i < len; i++) {
+        memcpy(buf, full, len);
+        TEST_ASSERT_EQUAL_INT(0, resp_parse(buf, i, &cmd));
+        // Nothing is written before the command is complete
+        TEST_ASSERT_EQUAL_INT(0, memcmp(buf, full, len));
+    }
+    TEST_ASSERT_EQUAL_INT(len, resp_parse(buf, len, &cmd));
+    TEST_ASSERT_EQUAL_STRING("0123456789", cmd.argv[1].data);
+}
+
+void test_parse_inline(void)
+{
+    char buf[] = "  set  key\tval \r\nPING\n";
+    TEST_ASSERT_EQUAL_INT(17, resp_parse(buf, sizeof(buf) - 1, &cmd));
+    TEST_ASSERT_EQUAL_INT(3, cmd.argc);
+    TEST_ASSERT_EQUAL_STRING("set", cmd.argv[0].data);
+    TEST_ASSERT_EQUAL_STRING("key", cmd.argv[1].data);
+    TEST_ASSERT_EQUAL_STRING("val", cmd.argv[2].data);
+
+    TEST_ASSERT_EQUAL_INT(5, resp_parse(buf + 17, 5, &cmd));
+    TEST_ASSERT_EQUAL_INT(1, cmd.argc);
+    TEST_ASSERT_EQUAL_STRING("PING", cmd.argv[0].data);
+
+    char partial[] = "GET ke";
+    TEST_ASSERT_EQUAL_INT(0, resp_parse(partial, 6, &cmd));
+}
+
+void test_parse_large(void)
+{
+    // Many arguments, each longer than a command line
+    size_t argc = 5000;
+    size_t arglen = 1000;
+    char *buf = malloc(argc * (arglen + 16) + 16);
+    char *p = buf + sprintf(buf, "*%zu\r\n", argc);
+    for (size_t i = 0; i < argc; i++) {
+        p += sprintf(p, "$%zu\r\n", arglen);
+        memset(p, 'a' + i % 26, arglen);
+        p += arglen;
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    TEST_ASSERT_EQUAL_INT(p - buf, resp_parse(buf, p - buf, &cmd));
+    TEST_ASSERT_EQUAL_INT(argc, cmd.argc);
+    TEST_ASSERT_EQUAL_INT(arglen, strlen(cmd.argv[argc - 1].data));
+    TEST_ASSERT_EQUAL_INT('a' + (argc - 1) % 26, cmd.argv[argc - 1].data[0]);
+    free(buf);
+}
+
+void test_parse_malformed(void)
+{
+    char bad_type[] = "*1\r\n+GET\r\n";
+    char bad_len[] = "*1\r\n$x\r\n";
+    char bad_end[] = "*1\r\n$3\r\nGETXX";
+    char neg[] = "*-1\r\n";
+    char too_long[] = "*1\r\n$9999999999999999999\r\n";
+    TEST_ASSERT_EQUAL_INT(-1, resp_parse(bad_type, strlen(bad_type), &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, resp_parse(bad_len, strlen(bad_len), &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, resp_parse(bad_end, strlen(bad_end), &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, resp_parse(neg, strlen(neg), &cmd));
+    TEST_ASSERT_EQUAL_INT(-1, resp_parse(too_long, strlen(too_long), &cmd));
+}
+
+void test_encode(void)
+{
+    struct netbuf out = {0};
+    resp_simple(&out, "OK");
+    resp_error(&out, "bad");
+    resp_int(&out, -42);
+    resp_int(&out, 0);
+    resp_array(&out, 2);
+    resp_bulk(&out, "va\0l", 4);
+    resp_nil(&out);
+
+    const char expect[] = "+OK\r\n-ERR bad\r\n:-42\r\n:0\r\n*2\r\n$4\r\nva\0l\r\n$-1\r\n";
+    TEST_ASSERT_EQUAL_INT(sizeof(expect) - 1, netbuf_used(&out));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(out.data, expect, sizeof(expect) - 1));
+    netbuf_free(&out);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_parse_array);
+    RUN_TEST(test_parse_incomplete);
+    RUN_TEST(test_parse_inline);
+    RUN_TEST(test_parse_large);
+    RUN_TEST(test_parse_malformed);
+    RUN_TEST(test_encode);
+
+    return UNITY_END();
+}
@@ -0,0 +1,356 @@
+// Tests of the sharded server through its RESP
+// socket. Each test starts a server with several
+// shards in a child process and sends it pipelined
+// commands, so requests cross the queues between
+// workers.
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "unity/unity.h"
+#include "../src/shard.h"
+#include "../src/wire.h"
+
+enum {
+    NUM_SHARDS = 4,
+
+    // Several times the 1024 requests a queue
+    // between two workers holds
+    NUM_KEYS = 3 * 1024,
+
+    REPLY_WAIT_MS = 5000
+};
+
+static char home[] = "/tmp/test_shard_XXXXXX";
+static char sockpath[128];
+static pid_t server_pid;
+
+static void start_server(void)
+{
+    fflush(stdout);
+    server_pid = fork();
+    TEST_ASSERT_TRUE(server_pid >= 0);
+    if (server_pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(run_sharded_server(sockpath, NUM_SHARDS));
+    }
+}
+
+// Stop server and return its exit status
+static int stop_server(void)
+{
+    int status = 0;
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, &status, 0);
+    server_pid = 0;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Returns socket connected to server,
+// -1 if the server does not start
+static int connect_server(void)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockpath);
+
+    for (int tries = 0; tries < 500; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10 * 1000);
+    }
+    return -1;
+}
+
+// Append RESP command of argc strings to buf
+static void add_cmd(struct netbuf *buf, int argc, ...)
+{
+    va_list args;
+    va_start(args, argc);
+    netbuf_printf(buf, "*%d\r\n", argc);
+    for (int i = 0; i < argc; i++) {
+        const char *arg = va_arg(args, const char *);
+        netbuf_printf(buf, "$%zu\r\n%s\r\n", strlen(arg), arg);
+    }
+    va_end(args);
+}
+
+// Send what the socket takes of cmds now
+static void send_some(int fd, struct netbuf *cmds)
+{
+    ssize_t n = send(fd, cmds->data + cmds->off, netbuf_used(cmds), MSG_DONTWAIT);
+    if (n > 0) {
+        netbuf_consume(cmds, n);
+    }
+}
+
+// Send cmds while reading replies, since the server
+// stops reading a client whose replies pile up,
+// until the replies are as long as expected.
+// Frees cmds and expected.
+static void expect_replies(int fd, struct netbuf *cmds, struct netbuf *expected)
+{
+    size_t len = netbuf_used(expected);
+    char *got = malloc(len);
+    TEST_ASSERT_NOT_NULL(got);
+
+    size_t n = 0;
+    while (n < len) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (netbuf_used(cmds) > 0) {
+            pfd.events |= POLLOUT;
+        }
+        if (poll(&pfd, 1, REPLY_WAIT_MS) <= 0) {
+            break;
+        }
+        if (pfd.revents & POLLOUT) {
+            send_some(fd, cmds);
+        }
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            ssize_t r = recv(fd, got + n, len - n, MSG_DONTWAIT);
+            if (r <= 0) {
+                break;
+            }
+            n += r;
+        }
+    }
+
+    bool same = (n == len && memcmp(got, expected->data + expected->off, len) == 0);
+    free(got);
+    netbuf_free(cmds);
+    netbuf_free(expected);
+    TEST_ASSERT_EQUAL_size_t(len, n);
+    TEST_ASSERT_TRUE(same);
+}
+
+void setUp(void)
+{
+    start_server();
+}
+
+void tearDown(void)
+{
+    if (server_pid > 0) {
+        stop_server();
+    }
+}
+
+
+// SET replaces values and honors NX and XX,
+// and keys of every shard are counted
+void test_set_get(void)
+{
+    int fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    struct netbuf cmds = {0};
+    add_cmd(&cmds, 2, "SELECT", "setget");
+    add_cmd(&cmds, 3, "SET", "k1", "v1");
+    add_cmd(&cmds, 3, "SET", "k1", "v2");
+    add_cmd(&cmds, 2, "GET", "k1");
+    add_cmd(&cmds, 4, "SET", "k1", "v3", "NX");
+    add_cmd(&cmds, 4, "SET", "k2", "v3", "XX");
+    add_cmd(&cmds, 4, "SET", "k2", "v2", "NX");
+    add_cmd(&cmds, 4, "EXISTS", "k1", "k2", "k3");
+    add_cmd(&cmds, 2, "DEL", "k1");
+    add_cmd(&cmds, 2, "GET", "k1");
+    add_cmd(&cmds, 1, "DBSIZE");
+
+    struct netbuf expected = {0};
+    netbuf_printf(&expected, "+OK\r\n+OK\r\n+OK\r\n$2\r\nv2\r\n$-1\r\n$-1\r\n+OK\r\n"
+                             ":2\r\n:1\r\n$-1\r\n:1\r\n");
+    expect_replies(fd, &cmds, &expected);
+
+    close(fd);
+}
+
+// Replies of multi-key commands are gathered
+// from every shard and sent in command order
+void test_fanout_order(void)
+{
+    int fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    struct netbuf cmds = {0};
+    add_cmd(&cmds, 2, "SELECT", "fanout");
+    add_cmd(&cmds, 9, "MSET", "k1", "v1", "k2", "v2", "k3", "v3", "k4", "v4");
+    add_cmd(&cmds, 6, "MGET", "k4", "x", "k2", "k1", "k3");
+    add_cmd(&cmds, 4, "DEL", "k3", "x", "k1");
+    add_cmd(&cmds, 1, "PING");
+    add_cmd(&cmds, 4, "MGET", "k1", "k2", "k3");
+
+    struct netbuf expected = {0};
+    netbuf_printf(&expected, "+OK\r\n+OK\r\n"
+                             "*5\r\n$2\r\nv4\r\n$-1\r\n$2\r\nv2\r\n$2\r\nv1\r\n$2\r\nv3\r\n"
+                             ":2\r\n"
+                             "+PONG\r\n"
+                             "*3\r\n$-1\r\n$2\r\nv2\r\n$-1\r\n");
+    expect_replies(fd, &cmds, &expected);
+
+    close(fd);
+}
+
+// Commands with more requests for a shard than
+// its queues hold wait in a backlog, and
+// replies stay in order
+void test_fanout_backlog(void)
+{
+    int fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    char key[32];
+    char val[32];
+    struct netbuf cmds = {0};
+    add_cmd(&cmds, 2, "SELECT", "backlog");
+    netbuf_printf(&cmds, "*%d\r\n$4\r\nMSET\r\n", 2 * NUM_KEYS + 1);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(val, sizeof(val), "val%d", i);
+        netbuf_printf(&cmds, "$%zu\r\n%s\r\n$%zu\r\n%s\r\n", strlen(key), key,
+                      strlen(val), val);
+    }
+    netbuf_printf(&cmds, "*%d\r\n$4\r\nMGET\r\n", NUM_KEYS + 1);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        netbuf_printf(&cmds, "$%zu\r\n%s\r\n", strlen(key), key);
+    }
+    netbuf_printf(&cmds, "*%d\r\n$6\r\nEXISTS\r\n", NUM_KEYS + 1);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        netbuf_printf(&cmds, "$%zu\r\n%s\r\n", strlen(key), key);
+    }
+
+    struct netbuf expected = {0};
+    netbuf_printf(&expected, "+OK\r\n+OK\r\n*%d\r\n", NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(val, sizeof(val), "val%d", i);
+        netbuf_printf(&expected, "$%zu\r\n%s\r\n", strlen(val), val);
+    }
+    netbuf_printf(&expected, ":%d\r\n", NUM_KEYS);
+    expect_replies(fd, &cmds, &expected);
+
+    close(fd);
+}
+
+// Single-key commands pipelined on two
+// connections are answered in order on each
+void test_pipeline_order(void)
+{
+    int fd1 = connect_server();
+    int fd2 = connect_server();
+    TEST_ASSERT_TRUE(fd1 >= 0);
+    TEST_ASSERT_TRUE(fd2 >= 0);
+
+    char key[32];
+    char val[32];
+    struct netbuf cmds1 = {0};
+    struct netbuf cmds2 = {0};
+    struct netbuf expected1 = {0};
+    struct netbuf expected2 = {0};
+    add_cmd(&cmds1, 2, "SELECT", "pipeline");
+    add_cmd(&cmds2, 2, "SELECT", "pipeline");
+    netbuf_printf(&expected1, "+OK\r\n");
+    netbuf_printf(&expected2, "+OK\r\n");
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(val, sizeof(val), "val%d", i);
+        add_cmd(&cmds1, 3, "SET", key, val);
+        add_cmd(&cmds1, 2, "GET", key);
+        netbuf_printf(&expected1, "+OK\r\n$%zu\r\n%s\r\n", strlen(val), val);
+
+        snprintf(key, sizeof(key), "other%d", i);
+        add_cmd(&cmds2, 3, "SET", key, "x");
+        add_cmd(&cmds2, 2, "EXISTS", key);
+        netbuf_printf(&expected2, "+OK\r\n:1\r\n");
+    }
+
+    // Second connection's commands run
+    // alongside those of the first
+    send_some(fd2, &cmds2);
+    expect_replies(fd1, &cmds1, &expected1);
+    expect_replies(fd2, &cmds2, &expected2);
+
+    close(fd1);
+    close(fd2);
+}
+
+// Tables changed by clients are saved when the
+// server stops, and split into shards again
+// when the next server loads them
+void test_saved_on_stop(void)
+{
+    int fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+    struct netbuf cmds = {0};
+    struct netbuf expected = {0};
+    add_cmd(&cmds, 2, "SELECT", "saved");
+    add_cmd(&cmds, 7, "MSET", "k1", "v1", "k2", "v2", "k3", "v3");
+    add_cmd(&cmds, 3, "SET", "k2", "new");
+    netbuf_printf(&expected, "+OK\r\n+OK\r\n+OK\r\n");
+    expect_replies(fd, &cmds, &expected);
+    close(fd);
+
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, stop_server());
+    start_server();
+
+    fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+    add_cmd(&cmds, 2, "SELECT", "saved");
+    add_cmd(&cmds, 4, "MGET", "k1", "k2", "k3");
+    add_cmd(&cmds, 1, "DBSIZE");
+    netbuf_printf(&expected, "+OK\r\n*3\r\n$2\r\nv1\r\n$3\r\nnew\r\n$2\r\nv3\r\n:3\r\n");
+    expect_replies(fd, &cmds, &expected);
+    close(fd);
+}
+
+
+int main(void)
+{
+    // Tables are saved under $HOME/pairdb-data
+    char datadir[64];
+    if (!mkdtemp(home)) {
+        return 1;
+    }
+    snprintf(datadir, sizeof(datadir), "%s/pairdb-data", home);
+    mkdir(datadir, 0700);
+    setenv("HOME", home, 1);
+    snprintf(sockpath, sizeof(sockpath), "%s/shard.sock", home);
+
+    // A closed connection fails the
+    // test instead of stopping it
+    signal(SIGPIPE, SIG_IGN);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_set_get);
+    RUN_TEST(test_fanout_order);
+    RUN_TEST(test_fanout_backlog);
+    RUN_TEST(test_pipeline_order);
+    RUN_TEST(test_saved_on_stop);
+
+    int result = UNITY_END();
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", home);
+    if (system(cmd) != 0) {
+        return 1;
+    }
+    return result;
+}
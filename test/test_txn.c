@@ -0,0 +1,429 @@
+// Tests of transactions through txn.h and
+// db_manager.h. Tables are kept under a
+// temporary HOME directory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "unity/unity.h"
+#include "../src/txn.h"
+#include "../src/db_manager.h"
+#include "../src/hashtable.h"
+#include "../src/pairdbconst.h"
+
+enum {
+    // Buckets of the table grown by test_undo_commit,
+    // so that its next resize needs more memory than
+    // ADDR_MARGIN
+    UNDO_BUCKETS = 1 << 18,
+    ADDR_MARGIN = 1024 * 1024,
+
+    // Adds of test_lsm_commit - several times the
+    // default 4 MiB memtable of an lsm table
+    LSM_ADDS = 80000
+};
+
+static char home[] = "/tmp/test_txn_XXXXXX";
+static db_mgr dbm;
+
+// Current table "t" holds a=1, b=2, c=3
+void setUp(void)
+{
+    dbm = init_db_mgr();
+    TEST_ASSERT_NOT_NULL(dbm);
+    drop_tbl(dbm, "t");
+    TEST_ASSERT_EQUAL_INT(1, get_new_tbl(dbm, "t", NULL));
+    TEST_ASSERT_EQUAL_INT(1, add(dbm, "a", "1"));
+    TEST_ASSERT_EQUAL_INT(1, add(dbm, "b", "2"));
+    TEST_ASSERT_EQUAL_INT(1, add(dbm, "c", "3"));
+}
+
+void tearDown(void)
+{
+    drop_tbl(dbm, "t");
+    destroy_db_mgr(dbm);
+}
+
+static void expect_tbl_val(char *key, const char *expected)
+{
+    char buff[VAL_MAX];
+    size_t len = get(buff, VAL_MAX, dbm, key);
+    if (!expected) {
+        TEST_ASSERT_EQUAL_size_t(0, len);
+        return;
+    }
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING(expected, buff);
+}
+
+static void expect_txn_val(txn t, char *key, const char *expected)
+{
+    char buff[VAL_MAX];
+    size_t len = txn_get(buff, VAL_MAX, t, key);
+    if (!expected) {
+        TEST_ASSERT_EQUAL_size_t(0, len);
+        return;
+    }
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING(expected, buff);
+}
+
+// Pairs seen by txn_iterate, as "key=val;" in
+// order of key
+struct seen {
+    char pairs[16][32];
+    size_t count;
+    size_t stop_after;
+};
+
+static int collect_pair(const char *key, const char *val, void *arg)
+{
+    struct seen *s = arg;
+    if (s->count < 16) {
+        snprintf(s->pairs[s->count], 32, "%s=%s;", key, val);
+    }
+    s->count++;
+    return s->stop_after > 0 && s->count == s->stop_after;
+}
+
+static int cmp_pair(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static void joined_pairs(struct seen *s, char *dst, size_t dsize)
+{
+    qsort(s->pairs, s->count, sizeof(s->pairs[0]), cmp_pair);
+    dst[0] = '\0';
+    for (size_t i = 0; i < s->count; i++) {
+        strncat(dst, s->pairs[i], dsize - strlen(dst) - 1);
+    }
+}
+
+// Returns engine counter name of current
+// table, SIZE_MAX if it has none
+static size_t tbl_stat(const char *name)
+{
+    struct tbl_info info;
+    if (get_tbl_info(dbm, &info) < 0) {
+        return SIZE_MAX;
+    }
+    for (size_t i = 0; i < info.numstats; i++) {
+        if (strcmp(info.stats[i].name, name) == 0) {
+            return info.stats[i].value;
+        }
+    }
+    return SIZE_MAX;
+}
+
+// Bytes of address space used by this process
+static size_t addr_space_used(void)
+{
+    size_t pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%zu", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+// Inode of the file of table "t" - the only
+// table file in the data directory
+static ino_t tbl_file_ino(void)
+{
+    char dirpath[64];
+    snprintf(dirpath, sizeof(dirpath), "%s/pairdb-data", home);
+    DIR *dir = opendir(dirpath);
+    if (!dir) {
+        return 0;
+    }
+    ino_t ino = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char *ext = strrchr(ent->d_name, '.');
+        if (ext && strcmp(ext, ".pairdb") == 0) {
+            ino = ent->d_ino;
+        }
+    }
+    closedir(dir);
+    return ino;
+}
+
+
+void test_begin_needs_table(void)
+{
+    db_mgr empty = init_db_mgr();
+    TEST_ASSERT_NOT_NULL(empty);
+    TEST_ASSERT_NULL(txn_begin(empty));
+    destroy_db_mgr(empty);
+}
+
+// A key can be added only if it is in neither
+// the table nor the overlay, as seen by the
+// transaction
+void test_add_conflict(void)
+{
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+
+    TEST_ASSERT_EQUAL_INT(-1, txn_add(t, "a", "10"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+    TEST_ASSERT_EQUAL_INT(-1, txn_add(t, "d", "40"));
+
+    // Deleted keys can be added again
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "a", "10"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "d"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "40"));
+    TEST_ASSERT_EQUAL_size_t(3, txn_num_writes(t));
+
+    txn_abort(t);
+    expect_tbl_val("a", "1");
+    expect_tbl_val("d", NULL);
+}
+
+// Commit fails and applies nothing if a key
+// added by the transaction was added to the
+// table since
+void test_commit_conflict(void)
+{
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "e", "5"));
+
+    TEST_ASSERT_EQUAL_INT(1, add(dbm, "e", "50"));
+    TEST_ASSERT_EQUAL_INT(-1, txn_commit(t));
+
+    expect_tbl_val("a", "1");
+    expect_tbl_val("d", NULL);
+    expect_tbl_val("e", "50");
+}
+
+// Gets see the overlay over the table, while
+// the table itself is unchanged
+void test_overlay_reads(void)
+{
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "b"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "b", "22"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+
+    // Removing a key added in the transaction
+    // drops the add
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "e", "5"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "e"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "missing"));
+
+    expect_txn_val(t, "a", NULL);
+    expect_txn_val(t, "b", "22");
+    expect_txn_val(t, "c", "3");
+    expect_txn_val(t, "d", "4");
+    expect_txn_val(t, "e", NULL);
+    expect_txn_val(t, "missing", NULL);
+
+    expect_tbl_val("a", "1");
+    expect_tbl_val("b", "2");
+    expect_tbl_val("d", NULL);
+    TEST_ASSERT_EQUAL_size_t(3, get_num_tbl_entries(dbm));
+
+    txn_abort(t);
+}
+
+// Iteration sees each pair of the table as seen
+// by the transaction once, and stops early
+void test_iterate_visibility(void)
+{
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "b"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "b", "22"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+
+    struct seen s = {0};
+    char joined[256];
+    TEST_ASSERT_EQUAL_INT(1, txn_iterate(t, collect_pair, &s));
+    TEST_ASSERT_EQUAL_size_t(3, s.count);
+    joined_pairs(&s, joined, sizeof(joined));
+    TEST_ASSERT_EQUAL_STRING("b=22;c=3;d=4;", joined);
+
+    for (size_t stop = 1; stop <= 3; stop++) {
+        struct seen part = {.stop_after = stop};
+        TEST_ASSERT_EQUAL_INT(1, txn_iterate(t, collect_pair, &part));
+        TEST_ASSERT_EQUAL_size_t(stop, part.count);
+    }
+
+    txn_abort(t);
+}
+
+// Writes applied before a failed add are undone,
+// leaving the table as it was. The table is filled
+// until one more entry passes its load limit, so
+// the last add of the commit must resize it, and
+// the address space of the process is limited so
+// that the resize cannot allocate its buckets.
+void test_undo_commit(void)
+{
+    char key[32];
+    size_t n = 0;
+    while (tbl_stat("buckets") < UNDO_BUCKETS ||
+           (double) tbl_stat("entries") / tbl_stat("buckets") <= hashtbl_load_limit()) {
+        snprintf(key, sizeof(key), "fill%zu", n++);
+        TEST_ASSERT_EQUAL_INT(1, add(dbm, key, "x"));
+    }
+    size_t entries = get_num_tbl_entries(dbm);
+    size_t buckets = tbl_stat("buckets");
+
+    // Two deletes, then three adds - the
+    // third add resizes and fails
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "b"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "b", "22"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "e", "5"));
+
+    struct rlimit prev;
+    TEST_ASSERT_EQUAL_INT(0, getrlimit(RLIMIT_AS, &prev));
+    struct rlimit low = {addr_space_used() + ADDR_MARGIN, prev.rlim_max};
+    TEST_ASSERT_EQUAL_INT(0, setrlimit(RLIMIT_AS, &low));
+    int result = txn_commit(t);
+    setrlimit(RLIMIT_AS, &prev);
+
+    TEST_ASSERT_EQUAL_INT(-2, result);
+    expect_tbl_val("a", "1");
+    expect_tbl_val("b", "2");
+    expect_tbl_val("c", "3");
+    expect_tbl_val("d", NULL);
+    expect_tbl_val("e", NULL);
+    TEST_ASSERT_EQUAL_size_t(entries, get_num_tbl_entries(dbm));
+    TEST_ASSERT_EQUAL_size_t(buckets, tbl_stat("buckets"));
+}
+
+// Commit with no writes succeeds without
+// changing or saving the table
+void test_commit_no_writes(void)
+{
+    TEST_ASSERT_EQUAL_INT(1, save_curr_tbl(dbm));
+    struct durability_stats before;
+    get_durability_stats(dbm, &before);
+
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_size_t(0, txn_num_writes(t));
+    TEST_ASSERT_EQUAL_INT(1, txn_commit(t));
+
+    struct durability_stats after;
+    get_durability_stats(dbm, &after);
+    TEST_ASSERT_EQUAL_size_t(before.saves, after.saves);
+    TEST_ASSERT_EQUAL_size_t(3, get_num_tbl_entries(dbm));
+}
+
+// Commit applies the overlay and saves the table
+// by renaming a new file over the old one, where a
+// plain save of a few changes writes in place
+void test_commit_saves_by_rename(void)
+{
+    TEST_ASSERT_EQUAL_INT(1, save_curr_tbl(dbm));
+    ino_t ino = tbl_file_ino();
+    TEST_ASSERT_TRUE(ino != 0);
+
+    TEST_ASSERT_EQUAL_INT(1, add(dbm, "x", "9"));
+    TEST_ASSERT_EQUAL_INT(1, save_curr_tbl(dbm));
+    TEST_ASSERT_TRUE(tbl_file_ino() == ino);
+
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(1, txn_remove(t, "a"));
+    TEST_ASSERT_EQUAL_INT(1, txn_add(t, "d", "4"));
+    TEST_ASSERT_EQUAL_INT(1, txn_commit(t));
+    TEST_ASSERT_TRUE(tbl_file_ino() != ino);
+
+    // Saved table holds the commit
+    destroy_db_mgr(dbm);
+    dbm = init_db_mgr();
+    TEST_ASSERT_NOT_NULL(dbm);
+    TEST_ASSERT_EQUAL_INT(1, use_tbl(dbm, "t"));
+    expect_tbl_val("a", NULL);
+    expect_tbl_val("d", "4");
+    expect_tbl_val("x", "9");
+    TEST_ASSERT_EQUAL_size_t(4, get_num_tbl_entries(dbm));
+}
+
+// A commit on an lsm table larger than its
+// memtable writes nothing before the save, which
+// then flushes it as a single table file
+void test_lsm_commit(void)
+{
+    drop_tbl(dbm, "l");
+    TEST_ASSERT_EQUAL_INT(1, get_new_tbl(dbm, "l", "lsm"));
+    size_t flushes = tbl_stat("flushes");
+    TEST_ASSERT_TRUE(flushes != SIZE_MAX);
+
+    txn t = txn_begin(dbm);
+    TEST_ASSERT_NOT_NULL(t);
+    char key[32];
+    char val[VAL_MAX];
+    memset(val, 'v', VAL_MAX - 1);
+    val[VAL_MAX - 1] = '\0';
+    for (int i = 0; i < LSM_ADDS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        TEST_ASSERT_EQUAL_INT(1, txn_add(t, key, val));
+    }
+    TEST_ASSERT_EQUAL_INT(1, txn_commit(t));
+    TEST_ASSERT_EQUAL_size_t(flushes + 1, tbl_stat("flushes"));
+
+    // Later writes flush as usual
+    for (int i = 0; i < LSM_ADDS; i++) {
+        snprintf(key, sizeof(key), "more%d", i);
+        TEST_ASSERT_EQUAL_INT(1, add(dbm, key, val));
+    }
+    TEST_ASSERT_TRUE(tbl_stat("flushes") > flushes + 1);
+    TEST_ASSERT_EQUAL_INT(1, drop_tbl(dbm, "l"));
+}
+
+
+int main(void)
+{
+    char datadir[64];
+    if (!mkdtemp(home)) {
+        return 1;
+    }
+    snprintf(datadir, sizeof(datadir), "%s/pairdb-data", home);
+    mkdir(datadir, 0700);
+    setenv("HOME", home, 1);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_begin_needs_table);
+    RUN_TEST(test_add_conflict);
+    RUN_TEST(test_commit_conflict);
+    RUN_TEST(test_overlay_reads);
+    RUN_TEST(test_iterate_visibility);
+    RUN_TEST(test_undo_commit);
+    RUN_TEST(test_commit_no_writes);
+    RUN_TEST(test_commit_saves_by_rename);
+    RUN_TEST(test_lsm_commit);
+
+    int result = UNITY_END();
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", home);
+    if (system(cmd) != 0) {
+        return 1;
+    }
+    return result;
+}
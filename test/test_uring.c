@@ -0,0 +1,204 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "unity/unity.h"
+#include "../src/uring.h"
+
+enum {
+    BUFSIZE = 4096,
+    NUMBUFS = 50    // More buffers than a writer holds
+};
+
+static char path[] = "/tmp/pairdb-test-uring-XXXXXX";
+static int fd = -1;
+
+void setUp(void)
+{
+    strcpy(path, "/tmp/pairdb-test-uring-XXXXXX");
+    fd = mkstemp(path);
+}
+
+void tearDown(void)
+{
+    close(fd);
+    unlink(path);
+}
+
+// Write NUMBUFS buffers after a header page
+// and the header last, then read them back
+static void write_and_check(enum io_backend io, bool sync)
+{
+    TEST_ASSERT_EQUAL_INT(1, set_io_backend(io));
+    struct io_stats before = {0};
+    get_file_io_stats(&before);
+
+    file_writer fw = fw_open(fd, BUFSIZE);
+    TEST_ASSERT_NOT_NULL(fw);
+    for (int i = 0; i < NUMBUFS; i++) {
+        char *buf = fw_buffer(fw);
+        TEST_ASSERT_NOT_NULL(buf);
+        memset(buf, 'a' + i % 26, BUFSIZE);
+        TEST_ASSERT_EQUAL_INT(1, fw_write(fw, buf, BUFSIZE, (off_t) (i + 1) * BUFSIZE));
+    }
+    char *hdr = fw_buffer(fw);
+    TEST_ASSERT_NOT_NULL(hdr);
+    memset(hdr, 'H', BUFSIZE);
+    TEST_ASSERT_EQUAL_INT(1, fw_finish(fw, hdr, BUFSIZE, 0, sync));
+    TEST_ASSERT_EQUAL_INT(1, fw_close(fw));
+
+    char readbuf[BUFSIZE];
+    char expected[BUFSIZE];
+    TEST_ASSERT_EQUAL_INT(BUFSIZE, pread(fd, readbuf, BUFSIZE, 0));
+    memset(expected, 'H', BUFSIZE);
+    TEST_ASSERT_EQUAL_MEMORY(expected, readbuf, BUFSIZE);
+    for (int i = 0; i < NUMBUFS; i++) {
+        TEST_ASSERT_EQUAL_INT(BUFSIZE, pread(fd, readbuf, BUFSIZE, (off_t) (i + 1) * BUFSIZE));
+        memset(expected, 'a' + i % 26, BUFSIZE);
+        TEST_ASSERT_EQUAL_MEMORY(expected, readbuf, BUFSIZE);
+    }
+
+    struct io_stats after = {0};
+    get_file_io_stats(&after);
+    TEST_ASSERT_EQUAL_UINT((NUMBUFS + 1) * BUFSIZE, after.bytes - before.bytes);
+    TEST_ASSERT_EQUAL_UINT(NUMBUFS + 1 + sync, after.requests - before.requests);
+    TEST_ASSERT_TRUE(after.calls > before.calls);
+    if (io == IO_URING) {
+        // Writes are submitted in batches
+        TEST_ASSERT_TRUE(after.calls - before.calls < NUMBUFS);
+    }
+}
+
+
+void test_backend_names(void)
+{
+    enum io_backend io;
+    TEST_ASSERT_EQUAL_INT(1, find_io_backend("blocking", &io));
+    TEST_ASSERT_EQUAL_INT(IO_BLOCKING, io);
+    TEST_ASSERT_EQUAL_INT(1, find_io_backend("uring", &io));
+    TEST_ASSERT_EQUAL_INT(IO_URING, io);
+    TEST_ASSERT_EQUAL_INT(-1, find_io_backend("aio", &io));
+    TEST_ASSERT_EQUAL_STRING("blocking", io_backend_name(IO_BLOCKING));
+    TEST_ASSERT_EQUAL_STRING("uring", io_backend_name(IO_URING));
+
+    TEST_ASSERT_EQUAL_INT(1, set_io_backend(IO_BLOCKING));
+    TEST_ASSERT_EQUAL_INT(IO_BLOCKING, get_io_backend());
+    TEST_ASSERT_EQUAL_INT(uring_available() ? 1 : -1, set_io_backend(IO_URING));
+}
+
+void test_writer_blocking(void)
+{
+    write_and_check(IO_BLOCKING, false);
+}
+
+void test_writer_blocking_sync(void)
+{
+    write_and_check(IO_BLOCKING, true);
+}
+
+void test_writer_uring(void)
+{
+    if (!uring_available()) {
+        return;     // io_uring not available
+    }
+    write_and_check(IO_URING, false);
+}
+
+// Last write and fsync are linked
+void test_writer_uring_sync(void)
+{
+    if (!uring_available()) {
+        return;     // io_uring not available
+    }
+    write_and_check(IO_URING, true);
+}
+
+// Writes to a bad descriptor fail and are
+// reported by fw_finish and fw_close
+void test_writer_error(void)
+{
+    enum io_backend backends[] = {IO_BLOCKING, IO_URING};
+    for (size_t i = 0; i < 2; i++) {
+        if (set_io_backend(backends[i]) < 0) {
+            continue;
+        }
+        file_writer fw = fw_open(-1, BUFSIZE);
+        TEST_ASSERT_NOT_NULL(fw);
+        char *buf = fw_buffer(fw);
+        TEST_ASSERT_NOT_NULL(buf);
+        memset(buf, 'x', BUFSIZE);
+        TEST_ASSERT_EQUAL_INT(-1, fw_finish(fw, buf, BUFSIZE, 0, true));
+        TEST_ASSERT_EQUAL_INT(-1, fw_close(fw));
+    }
+}
+
+void test_ring_send_recv(void)
+{
+    if (!uring_available()) {
+        return;     // io_uring not available
+    }
+    int sv[2];
+    TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    uring ring = uring_init(8);
+    TEST_ASSERT_NOT_NULL(ring);
+
+    // Nothing to read yet
+    char buf[64];
+    uint64_t data;
+    int res;
+    TEST_ASSERT_EQUAL_INT(1, uring_recv(ring, sv[1], buf, sizeof(buf), 7));
+    TEST_ASSERT_EQUAL_INT(1, uring_submit(ring, 1));
+    TEST_ASSERT_TRUE(uring_result(ring, &data, &res));
+    TEST_ASSERT_EQUAL_UINT64(7, data);
+    TEST_ASSERT_TRUE(res == -EAGAIN || res == -EWOULDBLOCK);
+
+    // Send on one end and read on the other
+    // in one call each
+    TEST_ASSERT_EQUAL_INT(1, uring_send(ring, sv[0], "ping", 4, 1));
+    TEST_ASSERT_EQUAL_INT(1, uring_send(ring, sv[0], "pong", 4, 2));
+    TEST_ASSERT_EQUAL_UINT(2, uring_inflight(ring));
+    TEST_ASSERT_EQUAL_INT(1, uring_submit(ring, 2));
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(uring_result(ring, &data, &res));
+        TEST_ASSERT_EQUAL_INT(4, res);
+    }
+    TEST_ASSERT_FALSE(uring_result(ring, &data, &res));
+    TEST_ASSERT_EQUAL_UINT(0, uring_inflight(ring));
+
+    TEST_ASSERT_EQUAL_INT(1, uring_recv(ring, sv[1], buf, sizeof(buf), 3));
+    TEST_ASSERT_EQUAL_INT(1, uring_submit(ring, 1));
+    TEST_ASSERT_TRUE(uring_result(ring, &data, &res));
+    TEST_ASSERT_EQUAL_UINT64(3, data);
+    TEST_ASSERT_EQUAL_INT(8, res);
+    TEST_ASSERT_EQUAL_MEMORY("pingpong", buf, 8);
+
+    struct io_stats stats = {0};
+    uring_get_stats(ring, &stats);
+    TEST_ASSERT_EQUAL_UINT(3, stats.calls);
+    TEST_ASSERT_EQUAL_UINT(4, stats.requests);
+
+    uring_destroy(ring);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_backend_names);
+    RUN_TEST(test_writer_blocking);
+    RUN_TEST(test_writer_blocking_sync);
+    RUN_TEST(test_writer_uring);
+    RUN_TEST(test_writer_uring_sync);
+    RUN_TEST(test_writer_error);
+    RUN_TEST(test_ring_send_recv);
+
+    return UNITY_END();
+}
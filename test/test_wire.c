@@ -0,0 +1,100 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "unity/unity.h"
+#include "../src/wire.h"
+
+void setUp(void)
+{
+
+}
+
+void tearDown(void)
+{
+
+}
+
+
+void test_netbuf_append_consume(void)
+{
+    struct netbuf buf = {0};
+    TEST_ASSERT_EQUAL_INT(1, netbuf_append(&buf, "hello ", 6));
+    TEST_ASSERT_EQUAL_INT(1, netbuf_printf(&buf, "%s %d", "world", 42));
+    TEST_ASSERT_EQUAL_INT(14, netbuf_used(&buf));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf.data + buf.off, "hello world 42", 14));
+
+    netbuf_consume(&buf, 6);
+    TEST_ASSERT_EQUAL_INT(8, netbuf_used(&buf));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf.data + buf.off, "world 42", 8));
+
+    netbuf_consume(&buf, 8);
+    TEST_ASSERT_EQUAL_INT(0, netbuf_used(&buf));
+    TEST_ASSERT_EQUAL_INT(0, buf.off);
+    netbuf_free(&buf);
+    TEST_ASSERT_NULL(buf.data);
+}
+
+void test_netbuf_growth(void)
+{
+    struct netbuf buf = {0};
+    char line[64];
+    for (int i = 0; i < 10000; i++) {
+        int len = snprintf(line, sizeof(line), "line %d\n", i);
+        TEST_ASSERT_EQUAL_INT(1, netbuf_append(&buf, line, len));
+    }
+    // Long formatted output is reformatted after growing
+    char big[10000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    size_t before = netbuf_used(&buf);
+    TEST_ASSERT_EQUAL_INT(1, netbuf_printf(&buf, "%s", big));
+    TEST_ASSERT_EQUAL_INT(before + sizeof(big) - 1, netbuf_used(&buf));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf.data + buf.off, "line 0\nline 1\n", 14));
+    TEST_ASSERT_EQUAL_INT('x', buf.data[buf.len - 1]);
+
+    // Consumed bytes are reused before growing
+    size_t cap = buf.cap;
+    netbuf_consume(&buf, netbuf_used(&buf) - 1);
+    TEST_ASSERT_EQUAL_INT(1, netbuf_reserve(&buf, cap - 1));
+    TEST_ASSERT_EQUAL_INT(cap, buf.cap);
+    TEST_ASSERT_EQUAL_INT(0, buf.off);
+    TEST_ASSERT_EQUAL_INT('x', buf.data[0]);
+    netbuf_free(&buf);
+}
+
+void test_reply_len(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, wire_reply_len("", 0));
+    TEST_ASSERT_EQUAL_INT(4, wire_reply_len("+OK\n+OK\n", 8));
+    TEST_ASSERT_EQUAL_INT(0, wire_reply_len("+OK", 3));
+    TEST_ASSERT_EQUAL_INT(15, wire_reply_len("-Key not found\n", 15));
+
+    const char *multi = "*2\nkey1\nkey2\n";
+    size_t len = strlen(multi);
+    TEST_ASSERT_EQUAL_INT(len, wire_reply_len(multi, len));
+    for (size_t i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL_INT(0, wire_reply_len(multi, i));
+    }
+    TEST_ASSERT_EQUAL_INT(3, wire_reply_len("*0\n+OK\n", 7));
+}
+
+void test_reply_malformed(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, wire_reply_len("OK\n", 3));
+    TEST_ASSERT_EQUAL_INT(-1, wire_reply_len("*x\n", 3));
+    TEST_ASSERT_EQUAL_INT(-1, wire_reply_len("*\n", 2));
+    TEST_ASSERT_EQUAL_INT(-1, wire_reply_len("*-1\n", 4));
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_netbuf_append_consume);
+    RUN_TEST(test_netbuf_growth);
+    RUN_TEST(test_reply_len);
+    RUN_TEST(test_reply_malformed);
+
+    return UNITY_END();
+}